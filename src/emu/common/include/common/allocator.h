@@ -106,4 +106,78 @@ namespace eka2l1::common {
          */
         int allocated_count(const std::uint32_t offset, const std::uint32_t offset_end);
     };
+    /**
+     * @brief Pool of fixed-size memory chunks, recycled between arena allocators.
+     *
+     * Chunks released back to the pool are kept (up to a limit) so that arenas that are
+     * filled and reset repeatedly do not hit the heap in steady state.
+     */
+    class arena_chunk_pool {
+        std::vector<std::uint8_t *> free_chunks_;
+
+        std::size_t chunk_size_;
+        std::size_t max_free_chunks_;
+
+        std::uint64_t heap_allocation_count_;
+
+    public:
+        explicit arena_chunk_pool(const std::size_t chunk_size = 16384, const std::size_t max_free_chunks = 16);
+        ~arena_chunk_pool();
+
+        arena_chunk_pool(const arena_chunk_pool &) = delete;
+        arena_chunk_pool &operator=(const arena_chunk_pool &) = delete;
+
+        std::uint8_t *acquire();
+        void release(std::uint8_t *chunk);
+
+        std::uint8_t *allocate_large(const std::size_t size);
+        void free_large(std::uint8_t *block);
+
+        std::size_t chunk_size() const {
+            return chunk_size_;
+        }
+
+        /**
+         * @brief   Get the total number of heap allocations this pool has done.
+         *
+         * Sampling this before and after a frame tells how much the arenas using this pool
+         * still churn the allocator.
+         */
+        std::uint64_t heap_allocation_count() const {
+            return heap_allocation_count_;
+        }
+    };
+
+    /**
+     * @brief Bump allocator backed by chunks from an arena_chunk_pool.
+     *
+     * Memory can not be freed individually. Everything is given back at once with reset().
+     */
+    class arena_allocator {
+        arena_chunk_pool *pool_;
+
+        std::vector<std::uint8_t *> chunks_;
+        std::vector<std::uint8_t *> large_blocks_;
+
+        std::size_t current_offset_;
+        std::size_t used_bytes_;
+
+    public:
+        explicit arena_allocator(arena_chunk_pool &pool);
+        ~arena_allocator();
+
+        arena_allocator(const arena_allocator &) = delete;
+        arena_allocator &operator=(const arena_allocator &) = delete;
+
+        void *allocate(const std::size_t size, const std::size_t alignment = alignof(std::max_align_t));
+
+        /**
+         * @brief Release all allocated memory back to the pool.
+         */
+        void reset();
+
+        std::size_t used_bytes() const {
+            return used_bytes_;
+        }
+    };
 }
@@ -48,6 +48,8 @@ namespace eka2l1 {
 
         class basic_stream {
         public:
+            virtual ~basic_stream() = default;
+
             virtual void seek(const std::int64_t amount, seek_where wh) = 0;
             virtual bool valid() = 0;
             virtual std::uint64_t left() = 0;
@@ -169,6 +171,10 @@ namespace eka2l1 {
             }
 
             std::uint64_t read(void *buf, const std::uint64_t read_size) override {
+                if (crr_pos >= static_cast<std::uint64_t>(end - beg)) {
+                    return 0;
+                }
+
                 std::uint64_t actual_read_size = common::min(read_size,
                     static_cast<std::uint64_t>(end - beg - crr_pos));
 
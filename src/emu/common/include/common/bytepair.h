@@ -31,6 +31,7 @@
 namespace eka2l1 {
     namespace common {
         class ro_stream;
+        class thread_pool;
 
         /*! \brief Given a chunk of data compress by byte-pair compression, decompress the chunk.
 		 *
@@ -45,6 +46,44 @@ namespace eka2l1 {
             BYTEPAIR_PAGE_SIZE = 4096
         };
 
+        /**
+         * \brief Bytepair pages read from a stream but kept compressed.
+         *
+         * Pages are independent of each other, so they can be decompressed in any order, on any thread.
+         */
+        class bytepair_pages {
+            std::vector<uint8_t> compressed_;
+            std::vector<uint32_t> offsets_;
+            uint32_t decompressed_size_ = 0;
+
+            friend class ibytepair_stream;
+
+        public:
+            std::size_t page_count() const {
+                return offsets_.empty() ? 0 : offsets_.size() - 1;
+            }
+
+            uint32_t decompressed_size() const {
+                return decompressed_size_;
+            }
+
+            /*! \brief Get the number of bytes a page decompresses to. */
+            uint32_t page_size(const std::size_t page) const;
+
+            /*! \brief Decompress a page. The destination must hold page_size(page) bytes.
+             *
+             *  \returns The number of bytes written.
+             */
+            uint32_t decompress_page(void *dest, const std::size_t page) const;
+
+            /*! \brief Decompress all pages, one after another.
+             *
+             *  \param pool Optional. Pages are split between its threads if given.
+             *  \returns The number of bytes written.
+             */
+            uint32_t decompress(void *dest, const std::size_t size, thread_pool *pool = nullptr) const;
+        };
+
         /*! \brief A read-only bytepair stream. */
         class ibytepair_stream {
             common::ro_stream *compress_stream;
@@ -97,8 +136,12 @@ namespace eka2l1 {
 			 *
 			 *  \param dest The destination to write decompressed data to 
 			 *  \param size The destination size 
+			 *  \param pool Optional thread pool to decompress pages in parallel
 			*/
-            uint32_t read_pages(char *dest, size_t size);
+            uint32_t read_pages(char *dest, size_t size, thread_pool *pool = nullptr);
+
+            /*! \brief Read the index table and all the pages, without decompressing them. */
+            bool read_compressed_pages(bytepair_pages &pages);
 
             /*! \brief Get all the pages's offsets */
             std::vector<uint32_t> page_offsets(uint32_t initial_off);
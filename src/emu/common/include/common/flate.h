@@ -19,7 +19,9 @@
  */
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <miniz.h>
 #include <vector>
 
@@ -31,6 +33,22 @@ namespace eka2l1 {
     namespace flate {
         bool inflate_data(mz_stream *stream, void *in, void *out, uint32_t in_size, uint32_t *out_size = nullptr);
 
+        using stream_read_func = std::function<std::size_t(std::uint8_t *buf, const std::size_t size)>;
+        using stream_write_func = std::function<bool(const std::uint8_t *data, const std::size_t size)>;
+
+        /*! \brief Inflate a zlib stream through fixed size buffers.
+         *
+         * Compressed data is pulled from the reader and inflated data pushed to the writer as it
+         * comes, so neither side has to be held whole in memory, however well it compresses.
+         *
+         * \param reader   Fills a buffer with compressed data. Returns the bytes filled, 0 at the end.
+         * \param writer   Takes a piece of inflated data. Returns false to stop inflating.
+         * \param out_size Receives the total inflated size. Can be null.
+         *
+         * \returns True if the stream was inflated to its end.
+         */
+        bool inflate_stream(const stream_read_func &reader, const stream_write_func &writer, std::uint64_t *out_size = nullptr);
+
         // Made specificlly for Image Compressing
         enum : uint64_t {
             DEFLATE_LENGTH_MAG = 8,
@@ -85,12 +103,17 @@ namespace eka2l1 {
             void pad(uint32_t pad_size);
         };
 
-        /*! \brief Represents a deflate bit input. */
+        /**
+         * \brief Represents a deflate bit input.
+         *
+         * Bits are read most significant first. Up to 64 bits are buffered at a time, so that a Huffman code and
+         * its extra bits can be peeked at with a single refill.
+         */
         class bit_input {
+            uint64_t bits;
             int count;
-            uint32_t bits;
             int remain;
-            const uint32_t *buf_ptr;
+            const uint8_t *buf_ptr;
 
         public:
             bit_input();
@@ -105,6 +128,17 @@ namespace eka2l1 {
 
             uint32_t read(int size);
             uint32_t huffman(const uint32_t *tree);
+
+            /*! \brief Fill the buffer to at least 57 bits, or with what is left of the stream. */
+            void refill();
+
+            /*! \brief Get the next bits without consuming them. Bits past the end of the stream are undefined. */
+            uint32_t peek(int size) const {
+                return static_cast<uint32_t>(bits >> (64 - size));
+            }
+
+            /*! \brief Consume bits that have been peeked at. Returns false if not that much is buffered. */
+            bool consume(int size);
         };
 
         enum {
@@ -129,8 +163,16 @@ namespace eka2l1 {
             INFLATER_SAFE_ZONE = 8
         };
 
+        enum {
+            INFLATER_LIT_LEN_LOOKUP_BITS = 10,
+            INFLATER_DIST_LOOKUP_BITS = 9
+        };
+
         /**
          * \brief An inflater for non-standard Gzip data.
+         *
+         * Symbols are decoded through lookup tables indexed by the next bits of the stream. Codes longer than
+         * the first table resolve through smaller tables chained to it.
          */
         class inflater {
             bit_input *bits;
@@ -139,12 +181,17 @@ namespace eka2l1 {
             const uint8_t *avail;
             const uint8_t *limit;
             encoding encode;
+            std::vector<uint32_t> lit_len_lookup;
+            std::vector<uint32_t> dist_lookup;
             uint8_t out[DEFLATE_MAX_DIST];
             uint8_t huff[INFLATER_BUF_SIZE + INFLATER_SAFE_ZONE];
 
             /** \brief Do inflation */
             int inflate();
 
+            /** \brief Copy the pending match from the history, until it ends or the output window is full. */
+            uint8_t *copy_history(uint8_t *tout, uint8_t *end);
+
         public:
             explicit inflater(bit_input &input);
             ~inflater() {}
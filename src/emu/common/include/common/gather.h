@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace eka2l1::common {
+    enum gather_convert {
+        gather_convert_copy,            ///< Copy the components untouched.
+        gather_convert_fixed_to_float,  ///< Signed 16.16 fixed point to float.
+        gather_convert_byte_norm,       ///< Signed byte to float in [-1, 1].
+        gather_convert_ubyte_norm,      ///< Unsigned byte to float in [0, 1].
+        gather_convert_short_norm,      ///< Signed short to float in [-1, 1].
+        gather_convert_ushort_norm      ///< Unsigned short to float in [0, 1].
+    };
+
+    /**
+     * \brief Describe one strided source array to gather into an interleaved vertex stream.
+     */
+    struct gather_source {
+        const std::uint8_t *data_;          ///< Pointer to the first element to gather.
+        std::uint32_t stride_;              ///< Bytes between two consecutive elements in the source.
+        std::uint32_t component_count_;     ///< Components per element, from 1 to 4.
+        std::uint32_t component_size_;      ///< Size of one source component in bytes: 1, 2 or 4.
+        gather_convert convert_;
+        std::uint32_t dest_offset_;         ///< Offset of the element inside one destination vertex.
+    };
+
+    /**
+     * \brief Get the number of bytes one element of the source takes in the destination.
+     *
+     * Converted elements are floats. The size is rounded up to 4 bytes so that every element
+     * in an interleaved vertex stays aligned.
+     */
+    std::uint32_t gather_dest_size(const gather_source &source);
+
+    /**
+     * \brief Gather strided source arrays into an interleaved destination, converting on the way.
+     *
+     * SSE2 or NEON is used when the target has it, each vertex being converted as one vector of
+     * four lanes.
+     *
+     * \param dest          The destination of the first vertex.
+     * \param dest_stride   Size of one destination vertex in bytes.
+     * \param sources       The source arrays. Each is written at its dest_offset_ in every vertex.
+     * \param source_count  Number of sources.
+     * \param vertex_count  Number of vertices to gather.
+     */
+    void gather_vertices(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source *sources,
+        const std::size_t source_count, const std::size_t vertex_count);
+
+    /**
+     * \brief Same as gather_vertices, but never uses the vector paths.
+     *
+     * The results are identical to gather_vertices. This exists for testing and benchmarking.
+     */
+    void gather_vertices_scalar(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source *sources,
+        const std::size_t source_count, const std::size_t vertex_count);
+
+    /**
+     * \brief Find the smallest and largest index in an index array.
+     *
+     * \param indices       The index array.
+     * \param count         Number of indices.
+     * \param index_size    Size of one index in bytes, 1 or 2.
+     * \param min_index     The smallest index on return.
+     * \param max_index     The largest index on return.
+     *
+     * \returns False if there are no indices or the index size is not supported.
+     */
+    bool scan_index_range(const void *indices, const std::size_t count, const std::uint32_t index_size,
+        std::uint32_t &min_index, std::uint32_t &max_index);
+
+    /**
+     * \brief Copy an index array, subtracting a base from every index.
+     *
+     * Every index must be at least the base. Source and destination may be the same.
+     *
+     * \param dest          The destination array.
+     * \param indices       The source array.
+     * \param count         Number of indices.
+     * \param index_size    Size of one index in bytes, 1 or 2.
+     * \param base          Value to subtract.
+     */
+    void rebase_indices(void *dest, const void *indices, const std::size_t count, const std::uint32_t index_size,
+        const std::uint32_t base);
+}
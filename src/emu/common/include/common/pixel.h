@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace eka2l1::common {
+    class thread_pool;
+
+    /**
+     * \brief Layout of pixels in memory.
+     *
+     * Formats below 8 bits per pixel store the first pixel in the lowest bits of a byte, like Symbian does.
+     * 16-bit formats are little endian words.
+     */
+    enum class pixel_format {
+        gray2, ///< 1 bpp.
+        gray4, ///< 2 bpp.
+        gray16, ///< 4 bpp.
+        gray256, ///< 8 bpp.
+        palette16, ///< 4 bpp indices to a palette.
+        palette256, ///< 8 bpp indices to a palette.
+        xrgb4444, ///< 0x0RGB words, Symbian's Color4K.
+        rgb565, ///< Symbian's Color64K.
+        bgr888, ///< Bytes B, G, R. Symbian's Color16M.
+        bgrx8888, ///< Bytes B, G, R, unused. Symbian's Color16MU.
+        bgra8888, ///< Bytes B, G, R, A. Symbian's Color16MA.
+        bgra8888_premultiplied, ///< Bytes B, G, R, A with colours multiplied by alpha. Symbian's Color16MAP.
+        rgb888, ///< Bytes R, G, B.
+        rgba8888 ///< Bytes R, G, B, A. The layout textures and host images use.
+    };
+
+    enum class pixel_simd_level {
+        scalar,
+        sse2,
+        avx2,
+        neon
+    };
+
+    std::uint32_t get_pixel_format_bpp(const pixel_format format);
+
+    /**
+     * \brief Get the number of bytes a run of pixels takes, without any row alignment.
+     */
+    std::size_t get_pixel_run_size(const pixel_format format, const std::size_t count);
+
+    /**
+     * \brief Convert a run of pixels from one format to another.
+     *
+     * Colours are converted through 8-bit RGBA. Channels are widened with rounding and narrowed by truncation,
+     * like Symbian's TRgb does. Gray is computed as (2R + 5G + B) / 8. Formats without alpha are read as opaque,
+     * and premultiplied colours are divided back by alpha when written to a straight format.
+     *
+     * \param palette   Entries in 0x00BBGGRR form, like TRgb values. Needed only when the source is a palette format.
+     *
+     * \return False if the pair is not supported. Palette formats can only be converted from.
+     */
+    bool convert_pixels(void *dest, const pixel_format dest_format, const void *source, const pixel_format source_format,
+        const std::size_t count, const std::uint32_t *palette = nullptr);
+
+    /**
+     * \brief Convert a rectangle of pixels, row by row.
+     *
+     * With a pool, large conversions are split between its threads.
+     */
+    bool convert_pixel_rows(void *dest, const std::size_t dest_stride, const pixel_format dest_format, const void *source,
+        const std::size_t source_stride, const pixel_format source_format, const std::size_t width, const std::size_t height,
+        const std::uint32_t *palette = nullptr, thread_pool *pool = nullptr);
+
+    /**
+     * \brief Get the instruction set the conversion kernels currently use.
+     *
+     * The best one the CPU supports is picked on first use.
+     */
+    pixel_simd_level get_pixel_simd_level();
+
+    /**
+     * \brief Force the conversion kernels to an instruction set. Used to compare them in tests.
+     *
+     * \return False if the CPU does not support it. The current level is then kept.
+     */
+    bool set_pixel_simd_level(const pixel_simd_level level);
+
+    bool is_pixel_simd_level_supported(const pixel_simd_level level);
+}
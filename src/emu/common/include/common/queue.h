@@ -3,9 +3,11 @@
 #include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <mutex>
 #include <optional>
 #include <queue>
+#include <utility>
 
 namespace eka2l1 {
     /*! \brief A modified queue from std::priority_queue.
@@ -227,4 +229,107 @@ namespace eka2l1 {
             abort_ = false;
         }
     };
+
+    /**
+     * \brief A bounded ring that one producer thread and one consumer thread can use at the same time without locks.
+     *
+     * The producer only writes the tail index and the consumer only writes the head index. Each side
+     * publishes its index with release ordering, so a slot is fully written before the other side can
+     * see it. Neither push nor pop blocks; waiting on a full or empty ring is left to the owner.
+     *
+     * \tparam T           Type of element. Must be default constructible and movable.
+     * \tparam Capacity    Number of slots. Must be a power of two.
+     */
+    template <typename T, std::size_t Capacity>
+    class spsc_ring {
+        static_assert((Capacity != 0) && ((Capacity & (Capacity - 1)) == 0), "Ring capacity must be a power of two!");
+
+        T items_[Capacity];
+
+        // Keep the two indices on separate cache lines so the threads do not fight over them.
+        alignas(64) std::atomic<std::size_t> head_;
+        alignas(64) std::atomic<std::size_t> tail_;
+
+    public:
+        explicit spsc_ring()
+            : head_(0)
+            , tail_(0) {
+        }
+
+        /**
+         * \brief Push an item to the ring. Only call this from the producer thread.
+         *
+         * \param item     The item to push.
+         * \returns False if the ring is full.
+         */
+        bool push(const T &item) {
+            const std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+            if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+
+            items_[tail & (Capacity - 1)] = item;
+            tail_.store(tail + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * \brief Push an item to the ring by moving it. Only call this from the producer thread.
+         *
+         * The item is left untouched if the ring is full, so the push can be retried.
+         *
+         * \param item     The item to push.
+         * \returns False if the ring is full.
+         */
+        bool push(T &&item) {
+            const std::size_t tail = tail_.load(std::memory_order_relaxed);
+
+            if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+
+            items_[tail & (Capacity - 1)] = std::move(item);
+            tail_.store(tail + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * \brief Pop the oldest item from the ring. Only call this from the consumer thread.
+         *
+         * \returns Nullopt if the ring is empty.
+         */
+        std::optional<T> pop() {
+            const std::size_t head = head_.load(std::memory_order_relaxed);
+
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return std::nullopt;
+            }
+
+            T item = std::move(items_[head & (Capacity - 1)]);
+            head_.store(head + 1, std::memory_order_release);
+
+            return item;
+        }
+
+        /**
+         * \brief Get the number of items waiting in the ring.
+         *
+         * When called from a thread that does not own either end, the result is only a snapshot.
+         */
+        std::size_t size() const {
+            const std::size_t head = head_.load(std::memory_order_acquire);
+            return tail_.load(std::memory_order_acquire) - head;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        static constexpr std::size_t capacity() {
+            return Capacity;
+        }
+    };
 }
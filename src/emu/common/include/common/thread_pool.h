@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace eka2l1::common {
+    /**
+     * \brief A fixed set of worker threads that split ranges of work between them.
+     *
+     * The thread calling parallel_for also works on its own range, so a call made from inside a
+     * worker can not deadlock. Several threads may call parallel_for at the same time.
+     */
+    class thread_pool {
+    public:
+        using range_func = std::function<void(const std::size_t begin, const std::size_t end)>;
+
+    private:
+        struct job {
+            const range_func *func_;
+            std::size_t count_;
+            std::size_t chunk_size_;
+            std::size_t chunk_count_;
+
+            std::atomic<std::size_t> next_chunk_;
+            std::atomic<std::size_t> done_chunk_;
+            std::size_t users_;         ///< Workers holding a pointer to this job. Guarded by the pool lock.
+        };
+
+        std::vector<std::thread> workers_;
+        std::deque<job *> jobs_;
+
+        std::mutex lock_;
+        std::condition_variable job_cond_;
+        std::condition_variable done_cond_;
+        bool stopping_;
+
+        bool run_chunk(job &j);
+        void worker_loop();
+
+    public:
+        /**
+         * \brief Create the pool.
+         *
+         * \param worker_count  Number of threads to spawn. With zero, all work runs on the calling thread.
+         */
+        explicit thread_pool(const std::size_t worker_count);
+        ~thread_pool();
+
+        std::size_t worker_count() const {
+            return workers_.size();
+        }
+
+        /**
+         * \brief Call a function over sub-ranges of [0, count) on the workers, and wait for all of them.
+         *
+         * \param count         Size of the range.
+         * \param min_chunk     Smallest sub-range worth handing to another thread.
+         * \param func          The function, called with the begin and end of each sub-range.
+         */
+        void parallel_for(const std::size_t count, const std::size_t min_chunk, const range_func &func);
+    };
+
+    /**
+     * \brief Get the pool shared by the emulator, with one worker less than there are host cores.
+     */
+    thread_pool &get_shared_thread_pool();
+}
@@ -98,9 +98,10 @@ namespace eka2l1::common {
     /**
      * \brief Unmap a file mapped to memory
      *
+     * \param size The size of the mapped region. On POSIX platforms, nothing is unmapped if this is 0.
      * \returns True on success.
     */
-    bool unmap_file(void *ptr);
+    bool unmap_file(void *ptr, const std::size_t size = 0);
 
     /**
      * @param   Align address to host page size
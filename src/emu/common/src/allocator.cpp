@@ -308,4 +308,100 @@ namespace eka2l1::common {
 
         return allocated_count;
     }
+    arena_chunk_pool::arena_chunk_pool(const std::size_t chunk_size, const std::size_t max_free_chunks)
+        : chunk_size_(chunk_size)
+        , max_free_chunks_(max_free_chunks)
+        , heap_allocation_count_(0) {
+    }
+
+    arena_chunk_pool::~arena_chunk_pool() {
+        for (std::uint8_t *chunk : free_chunks_) {
+            delete[] chunk;
+        }
+    }
+
+    std::uint8_t *arena_chunk_pool::acquire() {
+        if (!free_chunks_.empty()) {
+            std::uint8_t *chunk = free_chunks_.back();
+            free_chunks_.pop_back();
+
+            return chunk;
+        }
+
+        heap_allocation_count_++;
+        return new std::uint8_t[chunk_size_];
+    }
+
+    void arena_chunk_pool::release(std::uint8_t *chunk) {
+        if (!chunk) {
+            return;
+        }
+
+        if (free_chunks_.size() >= max_free_chunks_) {
+            delete[] chunk;
+            return;
+        }
+
+        free_chunks_.push_back(chunk);
+    }
+
+    std::uint8_t *arena_chunk_pool::allocate_large(const std::size_t size) {
+        heap_allocation_count_++;
+        return new std::uint8_t[size];
+    }
+
+    void arena_chunk_pool::free_large(std::uint8_t *block) {
+        delete[] block;
+    }
+
+    arena_allocator::arena_allocator(arena_chunk_pool &pool)
+        : pool_(&pool)
+        , current_offset_(0)
+        , used_bytes_(0) {
+    }
+
+    arena_allocator::~arena_allocator() {
+        reset();
+    }
+
+    void *arena_allocator::allocate(const std::size_t size, const std::size_t alignment) {
+        const std::size_t chunk_size = pool_->chunk_size();
+
+        // Big allocations would waste most of a chunk, give them their own block
+        if (size > chunk_size / 2) {
+            std::uint8_t *block = pool_->allocate_large(size);
+            large_blocks_.push_back(block);
+
+            used_bytes_ += size;
+            return block;
+        }
+
+        std::size_t aligned_offset = (current_offset_ + alignment - 1) & ~(alignment - 1);
+
+        if (chunks_.empty() || (aligned_offset + size > chunk_size)) {
+            chunks_.push_back(pool_->acquire());
+            aligned_offset = 0;
+        }
+
+        current_offset_ = aligned_offset + size;
+        used_bytes_ += size;
+
+        return chunks_.back() + aligned_offset;
+    }
+
+    void arena_allocator::reset() {
+        for (std::uint8_t *chunk : chunks_) {
+            pool_->release(chunk);
+        }
+
+        for (std::uint8_t *block : large_blocks_) {
+            pool_->free_large(block);
+        }
+
+        chunks_.clear();
+        large_blocks_.clear();
+
+        current_offset_ = 0;
+        used_bytes_ = 0;
+    }
 }
@@ -22,6 +22,7 @@
 #include <common/buffer.h>
 #include <common/bytepair.h>
 #include <common/log.h>
+#include <common/thread_pool.h>
 
 #include <cstdint>
 #include <functional>
@@ -204,25 +205,87 @@ namespace eka2l1 {
             return bytepair_decompress(dest, static_cast<int>(len), buf.data(), idx_tab.page_size[page]);
         }
 
-        uint32_t ibytepair_stream::read_pages(char *dest, size_t size) {
-            uint32_t decompressed_size = 0;
+        uint32_t bytepair_pages::page_size(const std::size_t page) const {
+            const std::size_t start = page * BYTEPAIR_PAGE_SIZE;
+
+            if (start >= decompressed_size_) {
+                return 0;
+            }
+
+            return static_cast<uint32_t>(common::min<std::size_t>(decompressed_size_ - start, BYTEPAIR_PAGE_SIZE));
+        }
+
+        uint32_t bytepair_pages::decompress_page(void *dest, const std::size_t page) const {
+            if (page >= page_count()) {
+                return 0;
+            }
+
+            uint8_t *source = const_cast<uint8_t *>(compressed_.data()) + offsets_[page];
+            return bytepair_decompress(dest, page_size(page), source, offsets_[page + 1] - offsets_[page]);
+        }
+
+        uint32_t bytepair_pages::decompress(void *dest, const std::size_t size, thread_pool *pool) const {
+            const std::size_t count = common::min<std::size_t>(page_count(), (size + BYTEPAIR_PAGE_SIZE - 1) / BYTEPAIR_PAGE_SIZE);
+            std::vector<uint32_t> written(count, 0);
+
+            auto decompress_range = [&](const std::size_t begin, const std::size_t end) {
+                for (std::size_t i = begin; i < end; i++) {
+                    const std::size_t start = i * BYTEPAIR_PAGE_SIZE;
+                    const uint32_t len = static_cast<uint32_t>(common::min<std::size_t>(size - start, BYTEPAIR_PAGE_SIZE));
+                    uint8_t *source = const_cast<uint8_t *>(compressed_.data()) + offsets_[i];
+
+                    written[i] = bytepair_decompress(reinterpret_cast<uint8_t *>(dest) + start, len, source,
+                        offsets_[i + 1] - offsets_[i]);
+                }
+            };
+
+            if (pool) {
+                pool->parallel_for(count, 4, decompress_range);
+            } else {
+                decompress_range(0, count);
+            }
+
+            uint32_t total = 0;
+
+            for (const uint32_t page_written : written) {
+                total += page_written;
+            }
+
+            return total;
+        }
+
+        bool ibytepair_stream::read_compressed_pages(bytepair_pages &pages) {
             read_table();
 
-            uint64_t tsize = 0;
+            pages.offsets_.resize(idx_tab.header.number_of_pages + 1);
+            pages.decompressed_size_ = static_cast<uint32_t>(idx_tab.header.decompressed_size);
 
-            for (uint32_t i = 0; i < idx_tab.page_size.size(); i++) {
-                tsize += idx_tab.page_size[i];
+            uint32_t total = 0;
+
+            for (std::size_t i = 0; i < idx_tab.page_size.size(); i++) {
+                pages.offsets_[i] = total;
+                total += idx_tab.page_size[i];
             }
 
-            for (auto i = 0; i < idx_tab.header.number_of_pages; i++) {
-                uint32_t dcs_page = read_page(dest, i, size);
+            pages.offsets_.back() = total;
+            pages.compressed_.resize(total);
+
+            if (compress_stream->read(pages.compressed_.data(), total) != total) {
+                LOG_ERROR(COMMON, "Bytepair pages are truncated!");
+                return false;
+            }
 
-                decompressed_size += dcs_page;
-                dest += dcs_page;
-                size -= dcs_page;
+            return true;
+        }
+
+        uint32_t ibytepair_stream::read_pages(char *dest, size_t size, thread_pool *pool) {
+            bytepair_pages pages;
+
+            if (!read_compressed_pages(pages)) {
+                return 0;
             }
 
-            return decompressed_size;
+            return pages.decompress(dest, size, pool);
         }
 
         std::vector<uint32_t> ibytepair_stream::page_offsets(uint32_t initial_off) {
@@ -231,14 +294,14 @@ namespace eka2l1 {
 
             res.resize(idx_tab.header.number_of_pages + 1);
 
-            size_t bytes = initial_off + 10 + res.size() * sizeof(uint16_t);
+            size_t bytes = initial_off + 10 + idx_tab.page_size.size() * sizeof(uint16_t);
 
-            for (auto i = 0; i < res.size(); ++i) {
+            for (std::size_t i = 0; i < idx_tab.page_size.size(); ++i) {
                 res[i] = static_cast<uint32_t>(bytes);
                 bytes += idx_tab.page_size[i];
             }
 
-            res[res.size()] = static_cast<uint32_t>(bytes);
+            res.back() = static_cast<uint32_t>(bytes);
 
             return res;
         }
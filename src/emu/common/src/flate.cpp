@@ -21,7 +21,9 @@
 #include <common/flate.h>
 #include <common/log.h>
 
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <miniz.h>
 
 namespace eka2l1 {
@@ -55,6 +57,78 @@ namespace eka2l1 {
             return true;
         }
 
+        static constexpr std::size_t INFLATE_STREAM_IN_SIZE = 0x10000;
+        static constexpr std::size_t INFLATE_STREAM_OUT_SIZE = 0x40000;
+
+        bool inflate_stream(const stream_read_func &reader, const stream_write_func &writer, std::uint64_t *out_size) {
+            std::vector<std::uint8_t> in(INFLATE_STREAM_IN_SIZE);
+            std::vector<std::uint8_t> out(INFLATE_STREAM_OUT_SIZE);
+
+            mz_stream stream;
+            std::memset(&stream, 0, sizeof(stream));
+
+            if (inflateInit(&stream) != MZ_OK) {
+                LOG_ERROR(COMMON, "Can not initialize inflate stream");
+                return false;
+            }
+
+            std::uint64_t total = 0;
+            bool ended = false;
+            bool failed = false;
+
+            while (!ended && !failed) {
+                const std::size_t filled = reader(in.data(), in.size());
+
+                if (filled == 0) {
+                    break;
+                }
+
+                stream.next_in = in.data();
+                stream.avail_in = static_cast<unsigned int>(filled);
+
+                // A small input can inflate to much more than the output buffer, drain it all
+                do {
+                    stream.next_out = out.data();
+                    stream.avail_out = static_cast<unsigned int>(out.size());
+
+                    const int res = inflate(&stream, MZ_NO_FLUSH);
+                    const std::size_t produced = out.size() - stream.avail_out;
+
+                    if ((res != MZ_OK) && (res != MZ_STREAM_END) && (res != MZ_BUF_ERROR)) {
+                        LOG_ERROR(COMMON, "Inflate failed description: {}", mz_error(res));
+
+                        failed = true;
+                        break;
+                    }
+
+                    total += produced;
+
+                    if (produced && !writer(out.data(), produced)) {
+                        failed = true;
+                        break;
+                    }
+
+                    if (res == MZ_STREAM_END) {
+                        ended = true;
+                        break;
+                    }
+
+                    if ((res == MZ_BUF_ERROR) && (produced == 0)) {
+                        // Needs more input
+                        break;
+                    }
+                } while ((stream.avail_in > 0) || (stream.avail_out == 0));
+            }
+
+            inflateEnd(&stream);
+
+            if (out_size) {
+                *out_size = total;
+            }
+
+            return ended && !failed;
+        }
+
         namespace huffman {
             using huff = uint16_t;
             using v2u32p = std::pair<uint32_t, uint32_t>;
@@ -395,7 +469,7 @@ namespace eka2l1 {
                 }
 
                 if (codes == 1) {
-                    uint8_t term = decode_tree[0] >> 16;
+                    uint32_t term = decode_tree[0] >> 16;
                     decode_tree[0] = term | (term << 16);
                 } else if (codes > 1) {
                     huffman_subtree(decode_tree + codes - 1, decode_tree + codes - 1, &lvl[0]);
@@ -531,97 +605,98 @@ namespace eka2l1 {
                 do_write(pad_size ? 0xffffffffu : 0, -bits);
         }
 
-        uint32_t swap_bo(uint32_t val) {
-            uint32_t tval = (val << 16) | (val >> 16);
-            tval ^= val;
-            tval &= 0xff00ffff;
-            val = (val >> 8) | (val << 24);
-            return val ^ (tval >> 8);
+        static uint64_t load_big_endian_64(const uint8_t *ptr) {
+            return (static_cast<uint64_t>(ptr[0]) << 56) | (static_cast<uint64_t>(ptr[1]) << 48) | (static_cast<uint64_t>(ptr[2]) << 40)
+                | (static_cast<uint64_t>(ptr[3]) << 32) | (static_cast<uint64_t>(ptr[4]) << 24) | (static_cast<uint64_t>(ptr[5]) << 16)
+                | (static_cast<uint64_t>(ptr[6]) << 8) | static_cast<uint64_t>(ptr[7]);
         }
 
-        bit_input::bit_input() {}
+        bit_input::bit_input()
+            : bits(0)
+            , count(0)
+            , remain(0)
+            , buf_ptr(nullptr) {}
 
         bit_input::bit_input(const uint8_t *ptr, int len, int off) {
             set(ptr, len, off);
         }
 
         void bit_input::set(const uint8_t *ptr, int len, int off) {
-            uintptr_t p = (uintptr_t)ptr;
-
-            p += off >> 3; // nearest byte to the specified bit offset
+            buf_ptr = ptr + (off >> 3); // nearest byte to the specified bit offset
             off &= 7; // bit offset within the byte
-            uint32_t *nptr = (uint32_t *)(p & ~3); // word containing this byte
-            off += (p & 3) << 3; // bit offset within the word
 
-            if (len == 0)
-                count = 0;
-            else {
-                // read the first few bits of the stream
-                bits = swap_bo(*nptr++) << off;
-                off = 32 - off;
-                len -= off;
+            bits = 0;
+            count = 0;
+            remain = 0;
 
-                if (len < 0)
-                    off += len;
+            if (len > 0) {
+                remain = len + off;
 
-                count = off;
+                refill();
+                consume(off);
             }
-
-            remain = len;
-            buf_ptr = nptr;
         }
 
-        uint32_t bit_input::read() {
-            uint32_t tbits = bits;
-            int tcount = count;
+        void bit_input::refill() {
+            if (count > 56) {
+                return;
+            }
 
-            if (--tcount < 0)
-                return read(1);
+            if (remain >= 64) {
+                // Take the whole bytes that fit. The bits of the next byte that get in too are the same
+                // as the ones the next refill will put there.
+                const int bytes = (64 - count) >> 3;
 
-            count = tcount;
-            bits = tbits << 1;
+                bits |= load_big_endian_64(buf_ptr) >> count;
+                buf_ptr += bytes;
+                count += bytes << 3;
+                remain -= bytes << 3;
 
-            return tbits >> 31;
-        }
+                return;
+            }
 
-        uint32_t bit_input::read(int size) {
-            // Nothing to read
-            if (!size)
-                return 0;
+            while ((count <= 56) && (remain > 0)) {
+                bits |= static_cast<uint64_t>(*buf_ptr++) << (56 - count);
 
-            uint32_t val = 0;
-            uint32_t tbits = bits;
+                const int taken = common::min(remain, 8);
+                count += taken;
+                remain -= taken;
+            }
+        }
 
+        bool bit_input::consume(int size) {
+            if (size > count) {
+                return false;
+            }
+
+            bits = (size == 64) ? 0 : (bits << size);
             count -= size;
 
-            while (count < 0) {
-                // Disable warning
-                if (count + size != 0)
-                    val |= tbits >> (32 - (count + size)) << (-count);
+            return true;
+        }
 
-                size = -count; // bits still required
+        uint32_t bit_input::read() {
+            return read(1);
+        }
 
-                // Things are still remain shit
-                if (remain > 0) {
-                    tbits = swap_bo(*buf_ptr++);
-                    count += 32;
-                    remain -= 32;
+        uint32_t bit_input::read(int size) {
+            // Nothing to read
+            if (!size)
+                return 0;
 
-                    if (remain < 0)
-                        count += remain;
+            if (count < size) {
+                refill();
 
-                } else {
+                if (count < size) {
                     LOG_ERROR(COMMON, "Bit input read underflow!");
-                    tbits = bits;
-                    count -= size;
-
                     return 0;
                 }
             }
 
-            bits = (size == 32) ? 0 : tbits << size;
+            const uint32_t val = peek(size);
+            consume(size);
 
-            return val | (tbits >> (32 - size));
+            return val;
         }
 
         uint32_t bit_input::huffman(const uint32_t *tree) {
@@ -640,6 +715,153 @@ namespace eka2l1 {
             return huff >> 17;
         }
 
+        namespace huffman {
+            // Lookup entries. A leaf holds the symbol and the length of its code past the table's bits.
+            // A link holds the index and the bit count of the next table.
+            static constexpr uint32_t LOOKUP_LINK = 0x80000000u;
+            static constexpr int LOOKUP_CHAIN_BITS = 6;
+
+            struct lookup_code {
+                uint32_t code;
+                int len;
+                uint32_t symbol;
+            };
+
+            static void fill_lookup(std::vector<uint32_t> &table, const std::size_t base, const int table_bits,
+                const std::vector<lookup_code> &codes) {
+                std::vector<lookup_code> longer;
+
+                for (const lookup_code &code : codes) {
+                    if (code.len <= table_bits) {
+                        // Every index that starts with the code decodes to it
+                        const std::size_t first = base + (static_cast<std::size_t>(code.code) << (table_bits - code.len));
+                        const std::size_t span = std::size_t(1) << (table_bits - code.len);
+
+                        std::fill(table.begin() + first, table.begin() + first + span, code.symbol | (code.len << 16));
+                    } else {
+                        longer.push_back(code);
+                    }
+                }
+
+                // Canonical codes sharing a prefix are next to each other
+                std::size_t i = 0;
+
+                while (i < longer.size()) {
+                    const uint32_t prefix = longer[i].code >> (longer[i].len - table_bits);
+                    std::vector<lookup_code> rest;
+                    int max_len = 0;
+
+                    for (; (i < longer.size()) && ((longer[i].code >> (longer[i].len - table_bits)) == prefix); i++) {
+                        const int rest_len = longer[i].len - table_bits;
+
+                        rest.push_back({ longer[i].code & ((1u << rest_len) - 1), rest_len, longer[i].symbol });
+                        max_len = common::max(max_len, rest_len);
+                    }
+
+                    const int chain_bits = common::min(max_len, static_cast<int>(LOOKUP_CHAIN_BITS));
+                    const std::size_t chain_base = table.size();
+
+                    table.resize(chain_base + (std::size_t(1) << chain_bits), 0);
+                    table[base + prefix] = LOOKUP_LINK | (chain_bits << 24) | static_cast<uint32_t>(chain_base);
+
+                    fill_lookup(table, chain_base, chain_bits, rest);
+                }
+            }
+
+            // Build lookup tables from code lengths. Codes are assigned the same way decoding() does: shorter
+            // codes first, then by symbol.
+            static void lookup(const uint32_t *huffman, const int num_codes, std::vector<uint32_t> &table, const int root_bits,
+                const int sym_base = 0) {
+                std::array<uint32_t, HUFFMAN_MAX_CODELENGTH + 1> counts;
+                std::fill(counts.begin(), counts.end(), 0);
+
+                for (int i = 0; i < num_codes; i++) {
+                    if (huffman[i] <= HUFFMAN_MAX_CODELENGTH) {
+                        counts[huffman[i]]++;
+                    }
+                }
+
+                counts[0] = 0;
+
+                std::array<uint32_t, HUFFMAN_MAX_CODELENGTH + 1> next_code;
+                uint32_t code = 0;
+
+                for (int len = 1; len <= HUFFMAN_MAX_CODELENGTH; len++) {
+                    code = (code + counts[len - 1]) << 1;
+                    next_code[len] = code;
+                }
+
+                std::vector<lookup_code> codes;
+
+                for (int len = 1; len <= HUFFMAN_MAX_CODELENGTH; len++) {
+                    for (int i = 0; i < num_codes; i++) {
+                        if (huffman[i] != static_cast<uint32_t>(len)) {
+                            continue;
+                        }
+
+                        // Over-subscribed codes do not fit, leave them out
+                        if (next_code[len] < (1u << len)) {
+                            codes.push_back({ next_code[len], len, static_cast<uint32_t>(i + sym_base) });
+                        }
+
+                        next_code[len]++;
+                    }
+                }
+
+                table.assign(std::size_t(1) << root_bits, 0);
+
+                if (codes.size() == 1) {
+                    // The decode tree gives both branches to a lone code
+                    std::fill(table.begin(), table.end(), codes[0].symbol | (1 << 16));
+                    return;
+                }
+
+                fill_lookup(table, 0, root_bits, codes);
+            }
+
+            // Decode a symbol from buffered bits. Returns -1 if the code is not in the table or the stream is short.
+            static int decode(bit_input &input, const uint32_t *table, const int root_bits) {
+                int table_bits = root_bits;
+                uint32_t entry = table[input.peek(root_bits)];
+
+                while (entry & LOOKUP_LINK) {
+                    if (!input.consume(table_bits)) {
+                        return -1;
+                    }
+
+                    table_bits = (entry >> 24) & 0x7F;
+                    entry = table[(entry & 0xFFFFFF) + input.peek(table_bits)];
+                }
+
+                const int code_len = (entry >> 16) & 0xFF;
+
+                if ((code_len == 0) || !input.consume(code_len)) {
+                    return -1;
+                }
+
+                return static_cast<int>(entry & 0xFFFF);
+            }
+        }
+
+        // Get the length or distance a code stands for, with its extra bits. Returns -1 if the stream is short.
+        static int read_match_value(bit_input &input, int code) {
+            if (code >= 8) {
+                const int xtra = (code >> 2) - 1;
+                code -= xtra << 2;
+                code <<= xtra;
+
+                const uint32_t extra = input.peek(xtra);
+
+                if (!input.consume(xtra)) {
+                    return -1;
+                }
+
+                code |= extra;
+            }
+
+            return code;
+        }
+
         inflater::inflater(bit_input &input)
             : bits(&input) {
             out[0] = 5;
@@ -649,71 +871,98 @@ namespace eka2l1 {
             limit = out;
         }
 
+        uint8_t *inflater::copy_history(uint8_t *tout, uint8_t *end) {
+            int tfr = common::min(static_cast<int>(end - tout), len);
+            len -= tfr;
+
+            const uint8_t *from = rptr;
+
+            if (from >= tout) {
+                // The match starts in the previous window, which is ahead in the buffer. Take it up to the end
+                const int ahead = common::min(tfr, static_cast<int>(end - from));
+
+                std::memmove(tout, from, ahead);
+                tout += ahead;
+                from += ahead;
+                tfr -= ahead;
+
+                if (from == end)
+                    from -= DEFLATE_MAX_DIST;
+            }
+
+            if (tfr > 0) {
+                // Copies overlap when the distance is shorter than the length. The copied part then repeats
+                // with the distance as period, so each copy can double in size.
+                const uint8_t *src = from;
+                int left = tfr;
+
+                while (left > 0) {
+                    const int chunk = common::min(left, static_cast<int>(tout - src));
+
+                    std::memcpy(tout, src, chunk);
+                    tout += chunk;
+                    left -= chunk;
+                }
+
+                from += tfr;
+            }
+
+            rptr = from;
+            return tout;
+        }
+
         int inflater::inflate() {
             uint8_t *tout = out;
             uint8_t *end = out + DEFLATE_MAX_DIST;
-            uint32_t *tree = encode.lit_len;
 
-            if (len < 0) // Nothing more for you
+            if ((len < 0) || lit_len_lookup.empty()) // Nothing more for you
                 return 0;
+
             if (len > 0)
-                goto useHistory; // TODO: Lambda.
+                tout = copy_history(tout, end);
 
             while (tout < end) {
-                {
-                    int val = bits->huffman(reinterpret_cast<uint32_t *>(tree)) - ENCODING_LITERALS;
+                bits->refill();
 
-                    if (val < 0) {
-                        *tout++ = (uint8_t)val;
-                        continue; // Combo literal, please continue getting them
-                    }
+                const int lit_len = huffman::decode(*bits, lit_len_lookup.data(), INFLATER_LIT_LEN_LOOKUP_BITS);
 
-                    if (val == ENCODING_EOS - ENCODING_LITERALS) {
-                        len -= 1;
-                        break;
-                    }
+                if (lit_len < 0) {
+                    LOG_ERROR(COMMON, "Inflate stream corrupted!");
+                    len = -1;
+                    break;
+                }
 
-                    // Get the extra bits for the code
-                    int code = val & 0xff;
+                if (lit_len < ENCODING_LITERALS) {
+                    *tout++ = static_cast<uint8_t>(lit_len);
+                    continue; // Combo literal, please continue getting them
+                }
 
-                    if (code >= 8) {
-                        int xtra = (code >> 2) - 1;
-                        code -= xtra << 2;
-                        code <<= xtra;
-                        code |= bits->read(xtra);
-                    }
+                if (lit_len == ENCODING_EOS) {
+                    len = -1;
+                    break;
+                }
 
-                    if (val < DEFLATE_DIST_CODE_BASE - ENCODING_LITERALS) {
-                        // Length code
-                        len = code + DEFLATE_MIN_LENGTH;
-                        tree = encode.dist;
-                        continue; // read the huffman code
-                    }
+                const int length = read_match_value(*bits, lit_len - ENCODING_LITERALS);
 
-                    // distance code
-                    rptr = tout - (code + 1);
+                bits->refill();
+                const int dist = (length < 0) ? -1 : huffman::decode(*bits, dist_lookup.data(), INFLATER_DIST_LOOKUP_BITS);
+                const int code = (dist < 0) ? -1 : read_match_value(*bits, (dist - ENCODING_LITERALS) & 0xff);
 
-                    if (rptr + DEFLATE_MAX_DIST < end) {
-                        rptr += DEFLATE_MAX_DIST;
-                    }
+                if (code < 0) {
+                    LOG_ERROR(COMMON, "Inflate stream corrupted!");
+                    len = -1;
+                    break;
                 }
-            // Digging things up from the cache: rptr
-            useHistory:
-                int tfr = common::min(static_cast<int>(end - tout), static_cast<int>(len));
-                len -= tfr;
 
-                const uint8_t *from = rptr;
-                do {
-                    *tout++ = *from++;
+                len = length + DEFLATE_MIN_LENGTH;
+                rptr = tout - (code + 1);
 
-                    if (from == end)
-                        from -= DEFLATE_MAX_DIST;
-
-                } while (--tfr != 0);
+                if (rptr < out) {
+                    rptr += DEFLATE_MAX_DIST;
+                }
 
-                rptr = from;
-                tree = encode.lit_len;
-            };
+                tout = copy_history(tout, end);
+            }
 
             return static_cast<int>(tout - out);
         }
@@ -727,11 +976,12 @@ namespace eka2l1 {
                 }
             } else {
                 LOG_ERROR(COMMON, "Inflate stream invalid!");
+                len = -1;
                 return;
             }
 
-            huffman::decoding(reinterpret_cast<int *>(encode.lit_len), ENCODING_LITERAL_LEN, reinterpret_cast<uint32_t *>(encode.lit_len));
-            huffman::decoding(reinterpret_cast<int *>(encode.dist), ENCODING_DISTS, reinterpret_cast<uint32_t *>(encode.dist), DEFLATE_DIST_CODE_BASE);
+            huffman::lookup(encode.lit_len, ENCODING_LITERAL_LEN, lit_len_lookup, INFLATER_LIT_LEN_LOOKUP_BITS);
+            huffman::lookup(encode.dist, ENCODING_DISTS, dist_lookup, INFLATER_DIST_LOOKUP_BITS, DEFLATE_DIST_CODE_BASE);
         }
 
         int inflater::read(uint8_t *buf, size_t rlen) {
@@ -0,0 +1,604 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common/gather.h>
+#include <common/platform.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if EKA2L1_ARCH(X64) || (EKA2L1_ARCH(X86) && (defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))))
+#define GATHER_USE_SSE2 1
+#include <emmintrin.h>
+#elif EKA2L1_ARCH(ARM64)
+#define GATHER_USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace eka2l1::common {
+    // Normalisation follows the modern GL rule: c / (2^(b-1) - 1) clamped to -1 for signed types.
+    // Both the scalar and the vector paths multiply by the same reciprocals, so they agree bit for bit.
+    static constexpr float FIXED_SCALE = 1.0f / 65536.0f;
+    static constexpr float BYTE_SCALE = 1.0f / 127.0f;
+    static constexpr float UBYTE_SCALE = 1.0f / 255.0f;
+    static constexpr float SHORT_SCALE = 1.0f / 32767.0f;
+    static constexpr float USHORT_SCALE = 1.0f / 65535.0f;
+
+    std::uint32_t gather_dest_size(const gather_source &source) {
+        const std::uint32_t size = (source.convert_ == gather_convert_copy) ? (source.component_count_ * source.component_size_)
+                                                                            : (source.component_count_ * 4);
+
+        return (size + 3) & ~3U;
+    }
+
+    static float convert_component(const std::uint8_t *src, const gather_convert convert) {
+        switch (convert) {
+        case gather_convert_fixed_to_float: {
+            std::int32_t value = 0;
+            std::memcpy(&value, src, sizeof(value));
+            return static_cast<float>(value) * FIXED_SCALE;
+        }
+
+        case gather_convert_byte_norm:
+            return std::max(static_cast<float>(*reinterpret_cast<const std::int8_t *>(src)) * BYTE_SCALE, -1.0f);
+
+        case gather_convert_ubyte_norm:
+            return static_cast<float>(*src) * UBYTE_SCALE;
+
+        case gather_convert_short_norm: {
+            std::int16_t value = 0;
+            std::memcpy(&value, src, sizeof(value));
+            return std::max(static_cast<float>(value) * SHORT_SCALE, -1.0f);
+        }
+
+        case gather_convert_ushort_norm: {
+            std::uint16_t value = 0;
+            std::memcpy(&value, src, sizeof(value));
+            return static_cast<float>(value) * USHORT_SCALE;
+        }
+
+        default:
+            break;
+        }
+
+        return 0.0f;
+    }
+
+    template <std::uint32_t Size>
+    static void gather_copy_fixed_size(std::uint8_t *dest, const std::uint32_t dest_stride, const std::uint8_t *src,
+        const std::uint32_t src_stride, const std::size_t count) {
+        for (std::size_t i = 0; i < count; i++, dest += dest_stride, src += src_stride) {
+            std::memcpy(dest, src, Size);
+        }
+    }
+
+    static void gather_copy(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source &source, const std::size_t count) {
+        std::uint8_t *dest_ptr = dest + source.dest_offset_;
+        const std::uint32_t size = source.component_count_ * source.component_size_;
+
+        switch (size) {
+        case 4:
+            gather_copy_fixed_size<4>(dest_ptr, dest_stride, source.data_, source.stride_, count);
+            break;
+
+        case 8:
+            gather_copy_fixed_size<8>(dest_ptr, dest_stride, source.data_, source.stride_, count);
+            break;
+
+        case 12:
+            gather_copy_fixed_size<12>(dest_ptr, dest_stride, source.data_, source.stride_, count);
+            break;
+
+        case 16:
+            gather_copy_fixed_size<16>(dest_ptr, dest_stride, source.data_, source.stride_, count);
+            break;
+
+        default: {
+            const std::uint8_t *src_ptr = source.data_;
+            for (std::size_t i = 0; i < count; i++, dest_ptr += dest_stride, src_ptr += source.stride_) {
+                std::memcpy(dest_ptr, src_ptr, size);
+            }
+
+            break;
+        }
+        }
+    }
+
+    static void gather_convert_scalar(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source &source, const std::size_t count) {
+        std::uint8_t *dest_ptr = dest + source.dest_offset_;
+        const std::uint8_t *src_ptr = source.data_;
+
+        for (std::size_t i = 0; i < count; i++, dest_ptr += dest_stride, src_ptr += source.stride_) {
+            for (std::uint32_t c = 0; c < source.component_count_; c++) {
+                const float value = convert_component(src_ptr + c * source.component_size_, source.convert_);
+                std::memcpy(dest_ptr + c * sizeof(float), &value, sizeof(float));
+            }
+        }
+    }
+
+#if GATHER_USE_SSE2 || GATHER_USE_NEON
+    template <gather_convert Convert>
+    static constexpr std::uint32_t gather_component_size() {
+        switch (Convert) {
+        case gather_convert_byte_norm:
+        case gather_convert_ubyte_norm:
+            return 1;
+
+        case gather_convert_short_norm:
+        case gather_convert_ushort_norm:
+            return 2;
+
+        default:
+            break;
+        }
+
+        return 4;
+    }
+
+#if GATHER_USE_SSE2
+    using gather_vector = __m128;
+
+    template <gather_convert Convert>
+    static gather_vector convert_lanes(const std::uint8_t *lanes) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i values;
+        float scale = 1.0f;
+
+        switch (Convert) {
+        case gather_convert_fixed_to_float:
+            values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes));
+            scale = FIXED_SCALE;
+            break;
+
+        case gather_convert_byte_norm: {
+            std::int32_t packed = 0;
+            std::memcpy(&packed, lanes, sizeof(packed));
+
+            // Put each byte at the top of its lane, then shift it back down with the sign.
+            values = _mm_cvtsi32_si128(packed);
+            values = _mm_unpacklo_epi8(values, values);
+            values = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 24);
+            scale = BYTE_SCALE;
+            break;
+        }
+
+        case gather_convert_ubyte_norm: {
+            std::int32_t packed = 0;
+            std::memcpy(&packed, lanes, sizeof(packed));
+
+            values = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+            scale = UBYTE_SCALE;
+            break;
+        }
+
+        case gather_convert_short_norm:
+            values = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(lanes));
+            values = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+            scale = SHORT_SCALE;
+            break;
+
+        case gather_convert_ushort_norm:
+            values = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(lanes)), zero);
+            scale = USHORT_SCALE;
+            break;
+
+        default:
+            return _mm_setzero_ps();
+        }
+
+        __m128 result = _mm_mul_ps(_mm_cvtepi32_ps(values), _mm_set1_ps(scale));
+
+        if ((Convert == gather_convert_byte_norm) || (Convert == gather_convert_short_norm)) {
+            result = _mm_max_ps(result, _mm_set1_ps(-1.0f));
+        }
+
+        return result;
+    }
+
+    template <gather_convert Convert>
+    static constexpr std::uint32_t gather_load_size() {
+        return (Convert == gather_convert_fixed_to_float) ? 16 : (gather_component_size<Convert>() * 4);
+    }
+
+    template <std::uint32_t Comp>
+    static void store_lanes(std::uint8_t *dest, const gather_vector value) {
+        float *dest_float = reinterpret_cast<float *>(dest);
+
+        switch (Comp) {
+        case 1:
+            _mm_store_ss(dest_float, value);
+            break;
+
+        case 2:
+            _mm_storel_pi(reinterpret_cast<__m64 *>(dest), value);
+            break;
+
+        case 3:
+            _mm_storel_pi(reinterpret_cast<__m64 *>(dest), value);
+            _mm_store_ss(dest_float + 2, _mm_movehl_ps(value, value));
+            break;
+
+        default:
+            _mm_storeu_ps(dest_float, value);
+            break;
+        }
+    }
+#else
+    using gather_vector = float32x4_t;
+
+    template <gather_convert Convert>
+    static gather_vector convert_lanes(const std::uint8_t *lanes) {
+        float32x4_t result;
+
+        switch (Convert) {
+        case gather_convert_fixed_to_float:
+            return vmulq_f32(vcvtq_f32_s32(vld1q_s32(reinterpret_cast<const std::int32_t *>(lanes))), vdupq_n_f32(FIXED_SCALE));
+
+        case gather_convert_byte_norm:
+            result = vcvtq_f32_s32(vmovl_s16(vget_low_s16(vmovl_s8(vld1_s8(reinterpret_cast<const std::int8_t *>(lanes))))));
+            return vmaxq_f32(vmulq_f32(result, vdupq_n_f32(BYTE_SCALE)), vdupq_n_f32(-1.0f));
+
+        case gather_convert_ubyte_norm:
+            result = vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(vld1_u8(lanes)))));
+            return vmulq_f32(result, vdupq_n_f32(UBYTE_SCALE));
+
+        case gather_convert_short_norm:
+            result = vcvtq_f32_s32(vmovl_s16(vld1_s16(reinterpret_cast<const std::int16_t *>(lanes))));
+            return vmaxq_f32(vmulq_f32(result, vdupq_n_f32(SHORT_SCALE)), vdupq_n_f32(-1.0f));
+
+        case gather_convert_ushort_norm:
+            result = vcvtq_f32_u32(vmovl_u16(vld1_u16(reinterpret_cast<const std::uint16_t *>(lanes))));
+            return vmulq_f32(result, vdupq_n_f32(USHORT_SCALE));
+
+        default:
+            break;
+        }
+
+        return vdupq_n_f32(0.0f);
+    }
+
+    template <gather_convert Convert>
+    static constexpr std::uint32_t gather_load_size() {
+        return (Convert == gather_convert_fixed_to_float) ? 16 : 8;
+    }
+
+    template <std::uint32_t Comp>
+    static void store_lanes(std::uint8_t *dest, const gather_vector value) {
+        float *dest_float = reinterpret_cast<float *>(dest);
+
+        switch (Comp) {
+        case 1:
+            vst1q_lane_f32(dest_float, value, 0);
+            break;
+
+        case 2:
+            vst1_f32(dest_float, vget_low_f32(value));
+            break;
+
+        case 3:
+            vst1_f32(dest_float, vget_low_f32(value));
+            vst1q_lane_f32(dest_float + 2, value, 2);
+            break;
+
+        default:
+            vst1q_f32(dest_float, value);
+            break;
+        }
+    }
+#endif
+
+    template <gather_convert Convert, std::uint32_t Comp>
+    static void gather_convert_vector(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source &source, const std::size_t count) {
+        constexpr std::uint32_t SRC_SIZE = Comp * gather_component_size<Convert>();
+
+        constexpr std::uint32_t LOAD_SIZE = gather_load_size<Convert>();
+
+        std::uint8_t *dest_ptr = dest + source.dest_offset_;
+        const std::uint8_t *src_ptr = source.data_;
+
+        // A vector load reads LOAD_SIZE bytes, which may be more than one element. Load straight
+        // from the source while that stays inside the gathered range, and stage the last elements
+        // through a buffer, since they may be the last bytes of guest memory.
+        std::size_t direct_count = 0;
+
+        if (count != 0) {
+            const std::size_t range_size = (count - 1) * source.stride_ + SRC_SIZE;
+            if (range_size >= LOAD_SIZE) {
+                direct_count = (source.stride_ == 0) ? count : std::min<std::size_t>(count, (range_size - LOAD_SIZE) / source.stride_ + 1);
+            }
+        }
+
+        std::size_t i = 0;
+
+        for (; i < direct_count; i++, dest_ptr += dest_stride, src_ptr += source.stride_) {
+            store_lanes<Comp>(dest_ptr, convert_lanes<Convert>(src_ptr));
+        }
+
+        alignas(16) std::uint8_t lanes[16] = {};
+
+        for (; i < count; i++, dest_ptr += dest_stride, src_ptr += source.stride_) {
+            std::memcpy(lanes, src_ptr, SRC_SIZE);
+            store_lanes<Comp>(dest_ptr, convert_lanes<Convert>(lanes));
+        }
+    }
+
+    template <gather_convert Convert>
+    static void gather_convert_vector(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source &source, const std::size_t count) {
+        switch (source.component_count_) {
+        case 1:
+            gather_convert_vector<Convert, 1>(dest, dest_stride, source, count);
+            break;
+
+        case 2:
+            gather_convert_vector<Convert, 2>(dest, dest_stride, source, count);
+            break;
+
+        case 3:
+            gather_convert_vector<Convert, 3>(dest, dest_stride, source, count);
+            break;
+
+        case 4:
+            gather_convert_vector<Convert, 4>(dest, dest_stride, source, count);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    static void gather_convert_vector(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source &source, const std::size_t count) {
+        switch (source.convert_) {
+        case gather_convert_fixed_to_float:
+            gather_convert_vector<gather_convert_fixed_to_float>(dest, dest_stride, source, count);
+            break;
+
+        case gather_convert_byte_norm:
+            gather_convert_vector<gather_convert_byte_norm>(dest, dest_stride, source, count);
+            break;
+
+        case gather_convert_ubyte_norm:
+            gather_convert_vector<gather_convert_ubyte_norm>(dest, dest_stride, source, count);
+            break;
+
+        case gather_convert_short_norm:
+            gather_convert_vector<gather_convert_short_norm>(dest, dest_stride, source, count);
+            break;
+
+        case gather_convert_ushort_norm:
+            gather_convert_vector<gather_convert_ushort_norm>(dest, dest_stride, source, count);
+            break;
+
+        default:
+            break;
+        }
+    }
+#endif
+
+    void gather_vertices(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source *sources,
+        const std::size_t source_count, const std::size_t vertex_count) {
+        for (std::size_t i = 0; i < source_count; i++) {
+            if ((sources[i].component_count_ == 0) || (sources[i].component_count_ > 4)) {
+                continue;
+            }
+
+            if (sources[i].convert_ == gather_convert_copy) {
+                gather_copy(dest, dest_stride, sources[i], vertex_count);
+            } else {
+#if GATHER_USE_SSE2 || GATHER_USE_NEON
+                gather_convert_vector(dest, dest_stride, sources[i], vertex_count);
+#else
+                gather_convert_scalar(dest, dest_stride, sources[i], vertex_count);
+#endif
+            }
+        }
+    }
+
+    void gather_vertices_scalar(std::uint8_t *dest, const std::uint32_t dest_stride, const gather_source *sources,
+        const std::size_t source_count, const std::size_t vertex_count) {
+        for (std::size_t i = 0; i < source_count; i++) {
+            if ((sources[i].component_count_ == 0) || (sources[i].component_count_ > 4)) {
+                continue;
+            }
+
+            if (sources[i].convert_ == gather_convert_copy) {
+                gather_copy(dest, dest_stride, sources[i], vertex_count);
+            } else {
+                gather_convert_scalar(dest, dest_stride, sources[i], vertex_count);
+            }
+        }
+    }
+
+    template <typename T>
+    static void scan_index_range_scalar(const std::uint8_t *indices, const std::size_t count, std::uint32_t &min_index, std::uint32_t &max_index) {
+        for (std::size_t i = 0; i < count; i++) {
+            T index = 0;
+            std::memcpy(&index, indices + i * sizeof(T), sizeof(T));
+
+            min_index = std::min<std::uint32_t>(min_index, index);
+            max_index = std::max<std::uint32_t>(max_index, index);
+        }
+    }
+
+    template <typename T>
+    static void rebase_indices_scalar(std::uint8_t *dest, const std::uint8_t *indices, const std::size_t count, const std::uint32_t base) {
+        for (std::size_t i = 0; i < count; i++) {
+            T index = 0;
+            std::memcpy(&index, indices + i * sizeof(T), sizeof(T));
+
+            index = static_cast<T>(index - base);
+            std::memcpy(dest + i * sizeof(T), &index, sizeof(T));
+        }
+    }
+
+    bool scan_index_range(const void *indices, const std::size_t count, const std::uint32_t index_size,
+        std::uint32_t &min_index, std::uint32_t &max_index) {
+        if ((count == 0) || ((index_size != 1) && (index_size != 2))) {
+            return false;
+        }
+
+        const std::uint8_t *data = reinterpret_cast<const std::uint8_t *>(indices);
+        std::size_t vector_done = 0;
+
+        min_index = 0xFFFFFFFF;
+        max_index = 0;
+
+#if GATHER_USE_SSE2 || GATHER_USE_NEON
+        const std::size_t per_vector = 16 / index_size;
+        const std::size_t vector_count = count / per_vector;
+#endif
+
+#if GATHER_USE_SSE2
+        if (vector_count != 0) {
+            alignas(16) std::uint16_t reduced_min[8];
+            alignas(16) std::uint16_t reduced_max[8];
+
+            if (index_size == 1) {
+                __m128i vmin = _mm_set1_epi8(static_cast<char>(0xFF));
+                __m128i vmax = _mm_setzero_si128();
+
+                for (std::size_t i = 0; i < vector_count; i++) {
+                    const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16));
+                    vmin = _mm_min_epu8(vmin, values);
+                    vmax = _mm_max_epu8(vmax, values);
+                }
+
+                // Widen to 16-bit so one reduction below serves both sizes
+                const __m128i zero = _mm_setzero_si128();
+                vmin = _mm_min_epi16(_mm_unpacklo_epi8(vmin, zero), _mm_unpackhi_epi8(vmin, zero));
+                vmax = _mm_max_epi16(_mm_unpacklo_epi8(vmax, zero), _mm_unpackhi_epi8(vmax, zero));
+
+                _mm_store_si128(reinterpret_cast<__m128i *>(reduced_min), vmin);
+                _mm_store_si128(reinterpret_cast<__m128i *>(reduced_max), vmax);
+            } else {
+                // SSE2 only has signed 16-bit min/max, so flip the sign bit around them
+                const __m128i sign = _mm_set1_epi16(static_cast<short>(0x8000));
+                __m128i vmin = _mm_set1_epi16(0x7FFF);
+                __m128i vmax = _mm_set1_epi16(static_cast<short>(0x8000));
+
+                for (std::size_t i = 0; i < vector_count; i++) {
+                    const __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)), sign);
+                    vmin = _mm_min_epi16(vmin, values);
+                    vmax = _mm_max_epi16(vmax, values);
+                }
+
+                _mm_store_si128(reinterpret_cast<__m128i *>(reduced_min), _mm_xor_si128(vmin, sign));
+                _mm_store_si128(reinterpret_cast<__m128i *>(reduced_max), _mm_xor_si128(vmax, sign));
+            }
+
+            for (std::size_t i = 0; i < 8; i++) {
+                min_index = std::min<std::uint32_t>(min_index, reduced_min[i]);
+                max_index = std::max<std::uint32_t>(max_index, reduced_max[i]);
+            }
+        }
+#elif GATHER_USE_NEON
+        if (vector_count != 0) {
+            if (index_size == 1) {
+                uint8x16_t vmin = vdupq_n_u8(0xFF);
+                uint8x16_t vmax = vdupq_n_u8(0);
+
+                for (std::size_t i = 0; i < vector_count; i++) {
+                    const uint8x16_t values = vld1q_u8(data + i * 16);
+                    vmin = vminq_u8(vmin, values);
+                    vmax = vmaxq_u8(vmax, values);
+                }
+
+                min_index = vminvq_u8(vmin);
+                max_index = vmaxvq_u8(vmax);
+            } else {
+                uint16x8_t vmin = vdupq_n_u16(0xFFFF);
+                uint16x8_t vmax = vdupq_n_u16(0);
+
+                for (std::size_t i = 0; i < vector_count; i++) {
+                    const uint16x8_t values = vreinterpretq_u16_u8(vld1q_u8(data + i * 16));
+                    vmin = vminq_u16(vmin, values);
+                    vmax = vmaxq_u16(vmax, values);
+                }
+
+                min_index = vminvq_u16(vmin);
+                max_index = vmaxvq_u16(vmax);
+            }
+        }
+#endif
+
+#if GATHER_USE_SSE2 || GATHER_USE_NEON
+        vector_done = vector_count * per_vector;
+#endif
+
+        if (index_size == 1) {
+            scan_index_range_scalar<std::uint8_t>(data + vector_done, count - vector_done, min_index, max_index);
+        } else {
+            scan_index_range_scalar<std::uint16_t>(data + vector_done * 2, count - vector_done, min_index, max_index);
+        }
+
+        return true;
+    }
+
+    void rebase_indices(void *dest, const void *indices, const std::size_t count, const std::uint32_t index_size,
+        const std::uint32_t base) {
+        if ((index_size != 1) && (index_size != 2)) {
+            return;
+        }
+
+        std::uint8_t *dest_data = reinterpret_cast<std::uint8_t *>(dest);
+        const std::uint8_t *data = reinterpret_cast<const std::uint8_t *>(indices);
+
+        if (base == 0) {
+            if (dest_data != data) {
+                std::memmove(dest_data, data, count * index_size);
+            }
+
+            return;
+        }
+
+        std::size_t done = 0;
+
+#if GATHER_USE_SSE2
+        const std::size_t per_vector = 16 / index_size;
+        const __m128i vbase = (index_size == 1) ? _mm_set1_epi8(static_cast<char>(base)) : _mm_set1_epi16(static_cast<short>(base));
+
+        for (; done + per_vector <= count; done += per_vector) {
+            const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + done * index_size));
+            const __m128i result = (index_size == 1) ? _mm_sub_epi8(values, vbase) : _mm_sub_epi16(values, vbase);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest_data + done * index_size), result);
+        }
+#elif GATHER_USE_NEON
+        const std::size_t per_vector = 16 / index_size;
+
+        for (; done + per_vector <= count; done += per_vector) {
+            const uint8x16_t values = vld1q_u8(data + done * index_size);
+            uint8x16_t result;
+
+            if (index_size == 1) {
+                result = vsubq_u8(values, vdupq_n_u8(static_cast<std::uint8_t>(base)));
+            } else {
+                result = vreinterpretq_u8_u16(vsubq_u16(vreinterpretq_u16_u8(values), vdupq_n_u16(static_cast<std::uint16_t>(base))));
+            }
+
+            vst1q_u8(dest_data + done * index_size, result);
+        }
+#endif
+
+        if (index_size == 1) {
+            rebase_indices_scalar<std::uint8_t>(dest_data + done, data + done, count - done, base);
+        } else {
+            rebase_indices_scalar<std::uint16_t>(dest_data + done * 2, data + done * 2, count - done, base);
+        }
+    }
+}
@@ -0,0 +1,1019 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common/pixel.h>
+#include <common/platform.h>
+#include <common/thread_pool.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#if EKA2L1_ARCH(X64) || EKA2L1_ARCH(X86)
+#include <immintrin.h>
+#define PIXEL_SSE2 1
+#define PIXEL_AVX2 1
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXEL_TARGET_AVX2
+#else
+#define PIXEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif EKA2L1_ARCH(ARM64)
+#include <arm_neon.h>
+#define PIXEL_NEON 1
+#endif
+
+namespace eka2l1::common {
+    static constexpr std::uint32_t ALPHA_MASK = 0xFF000000;
+
+    // Pixels converted at a time when going through RGBA
+    static constexpr std::size_t CONVERT_CHUNK_SIZE = 256;
+
+    // Splitting small conversions between threads costs more than it saves
+    static constexpr std::size_t PARALLEL_MIN_PIXELS = 65536;
+    static constexpr std::size_t PARALLEL_MIN_ROWS = 16;
+
+    struct pixel_kernels {
+        // Between RGBA and BGRA, both ways. The alpha bits given are set in every pixel
+        void (*swap_red_blue_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const std::uint32_t alpha_or);
+        void (*rgb565_to_rgba_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count);
+        void (*rgba_to_rgb565_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count);
+        void (*rgb24_to_rgba_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr);
+        void (*rgba_to_rgb24_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr);
+        void (*gray256_to_rgba_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count);
+
+        // Can be done in place
+        void (*premultiply_)(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count);
+    };
+
+    static inline std::uint32_t read_pixel32(const std::uint8_t *source) {
+        std::uint32_t value = 0;
+        std::memcpy(&value, source, sizeof(std::uint32_t));
+
+        return value;
+    }
+
+    static inline void write_pixel32(std::uint8_t *dest, const std::uint32_t value) {
+        std::memcpy(dest, &value, sizeof(std::uint32_t));
+    }
+
+    static inline std::uint16_t read_pixel16(const std::uint8_t *source) {
+        std::uint16_t value = 0;
+        std::memcpy(&value, source, sizeof(std::uint16_t));
+
+        return value;
+    }
+
+    static inline void write_pixel16(std::uint8_t *dest, const std::uint16_t value) {
+        std::memcpy(dest, &value, sizeof(std::uint16_t));
+    }
+
+    static inline std::uint32_t expand_5_bits(const std::uint32_t value) {
+        return (value * 527 + 23) >> 6;
+    }
+
+    static inline std::uint32_t expand_6_bits(const std::uint32_t value) {
+        return (value * 259 + 33) >> 6;
+    }
+
+    // Exact round(value / 255) for value up to 255 * 255
+    static inline std::uint32_t divide_by_255(const std::uint32_t value) {
+        const std::uint32_t rounded = value + 128;
+        return (rounded + (rounded >> 8)) >> 8;
+    }
+
+    static const std::uint8_t *get_unpremultiply_table() {
+        static const std::array<std::uint8_t, 256 * 256> table = []() {
+            std::array<std::uint8_t, 256 * 256> result{};
+
+            for (std::uint32_t alpha = 1; alpha < 256; alpha++) {
+                for (std::uint32_t color = 0; color < 256; color++) {
+                    result[alpha * 256 + color] = static_cast<std::uint8_t>(std::min<std::uint32_t>(255, (color * 255 + alpha / 2) / alpha));
+                }
+            }
+
+            return result;
+        }();
+
+        return table.data();
+    }
+
+    static void swap_red_blue_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const std::uint32_t alpha_or) {
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint32_t pixel = read_pixel32(source + i * 4);
+            write_pixel32(dest + i * 4, (pixel & 0xFF00FF00) | ((pixel >> 16) & 0xFF) | ((pixel & 0xFF) << 16) | alpha_or);
+        }
+    }
+
+    static void rgb565_to_rgba_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint16_t pixel = read_pixel16(source + i * 2);
+
+            dest[i * 4] = static_cast<std::uint8_t>(expand_5_bits(pixel >> 11));
+            dest[i * 4 + 1] = static_cast<std::uint8_t>(expand_6_bits((pixel >> 5) & 0x3F));
+            dest[i * 4 + 2] = static_cast<std::uint8_t>(expand_5_bits(pixel & 0x1F));
+            dest[i * 4 + 3] = 0xFF;
+        }
+    }
+
+    static void rgba_to_rgb565_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint8_t *pixel = source + i * 4;
+            write_pixel16(dest + i * 2, static_cast<std::uint16_t>(((pixel[0] >> 3) << 11) | ((pixel[1] >> 2) << 5) | (pixel[2] >> 3)));
+        }
+    }
+
+    static void rgb24_to_rgba_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr) {
+        const int red = bgr ? 2 : 0;
+
+        for (std::size_t i = 0; i < count; i++) {
+            dest[i * 4] = source[i * 3 + red];
+            dest[i * 4 + 1] = source[i * 3 + 1];
+            dest[i * 4 + 2] = source[i * 3 + 2 - red];
+            dest[i * 4 + 3] = 0xFF;
+        }
+    }
+
+    static void rgba_to_rgb24_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr) {
+        const int red = bgr ? 2 : 0;
+
+        for (std::size_t i = 0; i < count; i++) {
+            dest[i * 3 + red] = source[i * 4];
+            dest[i * 3 + 1] = source[i * 4 + 1];
+            dest[i * 3 + 2 - red] = source[i * 4 + 2];
+        }
+    }
+
+    static void gray256_to_rgba_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            write_pixel32(dest + i * 4, (source[i] * 0x010101u) | ALPHA_MASK);
+        }
+    }
+
+    static void premultiply_scalar(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint32_t alpha = source[i * 4 + 3];
+
+            dest[i * 4] = static_cast<std::uint8_t>(divide_by_255(source[i * 4] * alpha));
+            dest[i * 4 + 1] = static_cast<std::uint8_t>(divide_by_255(source[i * 4 + 1] * alpha));
+            dest[i * 4 + 2] = static_cast<std::uint8_t>(divide_by_255(source[i * 4 + 2] * alpha));
+            dest[i * 4 + 3] = static_cast<std::uint8_t>(alpha);
+        }
+    }
+
+    // Few premultiplied bitmaps exist, and the division does not vectorise well. Stays scalar
+    static void unpremultiply(std::uint8_t *pixels, const std::size_t count) {
+        const std::uint8_t *table = get_unpremultiply_table();
+
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint8_t *row = table + pixels[i * 4 + 3] * 256;
+
+            pixels[i * 4] = row[pixels[i * 4]];
+            pixels[i * 4 + 1] = row[pixels[i * 4 + 1]];
+            pixels[i * 4 + 2] = row[pixels[i * 4 + 2]];
+        }
+    }
+
+#if defined(PIXEL_SSE2)
+    static void swap_red_blue_sse2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const std::uint32_t alpha_or) {
+        const __m128i mask_byte = _mm_set1_epi32(0xFF);
+        const __m128i mask_green_alpha = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(alpha_or));
+
+        std::size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4));
+
+            const __m128i first = _mm_and_si128(_mm_srli_epi32(pixels, 16), mask_byte);
+            const __m128i middle = _mm_or_si128(_mm_and_si128(pixels, mask_green_alpha), alpha);
+            const __m128i third = _mm_slli_epi32(_mm_and_si128(pixels, mask_byte), 16);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4), _mm_or_si128(_mm_or_si128(first, middle), third));
+        }
+
+        swap_red_blue_scalar(dest + i * 4, source + i * 4, count - i, alpha_or);
+    }
+
+    static void rgb565_to_rgba_sse2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        const __m128i mask_5 = _mm_set1_epi16(0x1F);
+        const __m128i mask_6 = _mm_set1_epi16(0x3F);
+        const __m128i mul_5 = _mm_set1_epi16(527);
+        const __m128i mul_6 = _mm_set1_epi16(259);
+        const __m128i round_5 = _mm_set1_epi16(23);
+        const __m128i round_6 = _mm_set1_epi16(33);
+        const __m128i alpha = _mm_set1_epi16(static_cast<short>(0xFF00));
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 2));
+
+            const __m128i r5 = _mm_srli_epi16(pixels, 11);
+            const __m128i g6 = _mm_and_si128(_mm_srli_epi16(pixels, 5), mask_6);
+            const __m128i b5 = _mm_and_si128(pixels, mask_5);
+
+            const __m128i r8 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(r5, mul_5), round_5), 6);
+            const __m128i g8 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(g6, mul_6), round_6), 6);
+            const __m128i b8 = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(b5, mul_5), round_5), 6);
+
+            const __m128i rg = _mm_or_si128(r8, _mm_slli_epi16(g8, 8));
+            const __m128i ba = _mm_or_si128(b8, alpha);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4), _mm_unpacklo_epi16(rg, ba));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+        }
+
+        rgb565_to_rgba_scalar(dest + i * 4, source + i * 2, count - i);
+    }
+
+    // Packs the low 16 bits of each 32-bit lane. The shifts keep packs from saturating
+    static inline __m128i pack_low_words_sse2(const __m128i first, const __m128i second) {
+        return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(first, 16), 16), _mm_srai_epi32(_mm_slli_epi32(second, 16), 16));
+    }
+
+    static inline __m128i rgba_to_rgb565_words_sse2(const __m128i pixels) {
+        const __m128i red = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xF8)), 8);
+        const __m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 5), _mm_set1_epi32(0x7E0));
+        const __m128i blue = _mm_and_si128(_mm_srli_epi32(pixels, 19), _mm_set1_epi32(0x1F));
+
+        return _mm_or_si128(_mm_or_si128(red, green), blue);
+    }
+
+    static void rgba_to_rgb565_sse2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const __m128i first = rgba_to_rgb565_words_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4)));
+            const __m128i second = rgba_to_rgb565_words_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4 + 16)));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 2), pack_low_words_sse2(first, second));
+        }
+
+        rgba_to_rgb565_scalar(dest + i * 2, source + i * 4, count - i);
+    }
+
+    static void gray256_to_rgba_sse2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            const __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+            const __m128i gray_lo = _mm_unpacklo_epi8(gray, gray);
+            const __m128i gray_hi = _mm_unpackhi_epi8(gray, gray);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4), _mm_or_si128(_mm_unpacklo_epi16(gray_lo, gray_lo), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4 + 16), _mm_or_si128(_mm_unpackhi_epi16(gray_lo, gray_lo), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4 + 32), _mm_or_si128(_mm_unpacklo_epi16(gray_hi, gray_hi), alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4 + 48), _mm_or_si128(_mm_unpackhi_epi16(gray_hi, gray_hi), alpha));
+        }
+
+        gray256_to_rgba_scalar(dest + i * 4, source + i, count - i);
+    }
+
+    // Two pixels, one channel per 16-bit lane
+    static inline __m128i premultiply_words_sse2(const __m128i pixels) {
+        const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+        const __m128i rounded = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+        const __m128i result = _mm_srli_epi16(_mm_add_epi16(rounded, _mm_srli_epi16(rounded, 8)), 8);
+
+        return _mm_or_si128(_mm_andnot_si128(alpha_lanes, result), _mm_and_si128(alpha_lanes, pixels));
+    }
+
+    static void premultiply_sse2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        std::size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4));
+            const __m128i lo = premultiply_words_sse2(_mm_unpacklo_epi8(pixels, zero));
+            const __m128i hi = premultiply_words_sse2(_mm_unpackhi_epi8(pixels, zero));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4), _mm_packus_epi16(lo, hi));
+        }
+
+        premultiply_scalar(dest + i * 4, source + i * 4, count - i);
+    }
+#endif
+
+#if defined(PIXEL_AVX2)
+    PIXEL_TARGET_AVX2 static void swap_red_blue_avx2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const std::uint32_t alpha_or) {
+        const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        const __m256i alpha = _mm256_set1_epi32(static_cast<int>(alpha_or));
+
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+        }
+
+        swap_red_blue_scalar(dest + i * 4, source + i * 4, count - i, alpha_or);
+    }
+
+    PIXEL_TARGET_AVX2 static void rgb565_to_rgba_avx2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        const __m256i mask_5 = _mm256_set1_epi16(0x1F);
+        const __m256i mask_6 = _mm256_set1_epi16(0x3F);
+        const __m256i mul_5 = _mm256_set1_epi16(527);
+        const __m256i mul_6 = _mm256_set1_epi16(259);
+        const __m256i round_5 = _mm256_set1_epi16(23);
+        const __m256i round_6 = _mm256_set1_epi16(33);
+        const __m256i alpha = _mm256_set1_epi16(static_cast<short>(0xFF00));
+
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i * 2));
+
+            const __m256i r5 = _mm256_srli_epi16(pixels, 11);
+            const __m256i g6 = _mm256_and_si256(_mm256_srli_epi16(pixels, 5), mask_6);
+            const __m256i b5 = _mm256_and_si256(pixels, mask_5);
+
+            const __m256i r8 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r5, mul_5), round_5), 6);
+            const __m256i g8 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(g6, mul_6), round_6), 6);
+            const __m256i b8 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(b5, mul_5), round_5), 6);
+
+            const __m256i rg = _mm256_or_si256(r8, _mm256_slli_epi16(g8, 8));
+            const __m256i ba = _mm256_or_si256(b8, alpha);
+
+            // Unpacks work inside 128-bit lanes, the permutes put the pixels back in order
+            const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+            const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        rgb565_to_rgba_scalar(dest + i * 4, source + i * 2, count - i);
+    }
+
+    PIXEL_TARGET_AVX2 static void rgba_to_rgb565_avx2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        const __m256i mask_red = _mm256_set1_epi32(0xF8);
+        const __m256i mask_green = _mm256_set1_epi32(0x7E0);
+        const __m256i mask_blue = _mm256_set1_epi32(0x1F);
+
+        std::size_t i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m256i words[2];
+
+            for (int half = 0; half < 2; half++) {
+                const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i * 4 + half * 32));
+
+                const __m256i red = _mm256_slli_epi32(_mm256_and_si256(pixels, mask_red), 8);
+                const __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 5), mask_green);
+                const __m256i blue = _mm256_and_si256(_mm256_srli_epi32(pixels, 19), mask_blue);
+
+                words[half] = _mm256_or_si256(_mm256_or_si256(red, green), blue);
+            }
+
+            // Values fit in 16 bits, unsigned saturation does not touch them
+            const __m256i packed = _mm256_packus_epi32(words[0], words[1]);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 2), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+
+        rgba_to_rgb565_scalar(dest + i * 2, source + i * 4, count - i);
+    }
+
+    PIXEL_TARGET_AVX2 static void rgb24_to_rgba_avx2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr) {
+        const __m128i shuffle = bgr ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+                                    : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+
+        std::size_t i = 0;
+
+        // Each load takes 16 bytes for 4 pixels, stop before reading past the source
+        for (; i + 6 <= count; i += 4) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+        }
+
+        rgb24_to_rgba_scalar(dest + i * 4, source + i * 3, count - i, bgr);
+    }
+
+    PIXEL_TARGET_AVX2 static void rgba_to_rgb24_avx2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr) {
+        const __m128i shuffle = bgr ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+                                    : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        std::size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128i packed = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4)), shuffle);
+            const std::uint32_t last = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(packed, 8)));
+
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + i * 3), packed);
+            std::memcpy(dest + i * 3 + 8, &last, sizeof(std::uint32_t));
+        }
+
+        rgba_to_rgb24_scalar(dest + i * 3, source + i * 4, count - i, bgr);
+    }
+
+    PIXEL_TARGET_AVX2 static inline __m256i premultiply_words_avx2(const __m256i pixels) {
+        const __m256i alpha_lanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+        const __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+        const __m256i rounded = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), _mm256_set1_epi16(128));
+        const __m256i result = _mm256_srli_epi16(_mm256_add_epi16(rounded, _mm256_srli_epi16(rounded, 8)), 8);
+
+        return _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, result), _mm256_and_si256(alpha_lanes, pixels));
+    }
+
+    PIXEL_TARGET_AVX2 static void premultiply_avx2(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        const __m256i zero = _mm256_setzero_si256();
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i * 4));
+
+            // Unpack and pack both stay inside 128-bit lanes, so the order comes out right
+            const __m256i lo = premultiply_words_avx2(_mm256_unpacklo_epi8(pixels, zero));
+            const __m256i hi = premultiply_words_avx2(_mm256_unpackhi_epi8(pixels, zero));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 4), _mm256_packus_epi16(lo, hi));
+        }
+
+        premultiply_scalar(dest + i * 4, source + i * 4, count - i);
+    }
+
+    static bool cpu_supports_avx2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+
+        if (info[0] < 7) {
+            return false;
+        }
+
+        __cpuid(info, 1);
+
+        // The OS must save the YMM registers too
+        if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || ((_xgetbv(0) & 6) != 6)) {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+#if defined(PIXEL_NEON)
+    static void swap_red_blue_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const std::uint32_t alpha_or) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const uint8x8x4_t pixels = vld4_u8(source + i * 4);
+
+            uint8x8x4_t result;
+            result.val[0] = pixels.val[2];
+            result.val[1] = pixels.val[1];
+            result.val[2] = pixels.val[0];
+            result.val[3] = vorr_u8(pixels.val[3], vdup_n_u8(static_cast<std::uint8_t>(alpha_or >> 24)));
+
+            vst4_u8(dest + i * 4, result);
+        }
+
+        swap_red_blue_scalar(dest + i * 4, source + i * 4, count - i, alpha_or);
+    }
+
+    static void rgb565_to_rgba_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const uint16x8_t pixels = vld1q_u16(reinterpret_cast<const std::uint16_t *>(source + i * 2));
+
+            const uint16x8_t r5 = vshrq_n_u16(pixels, 11);
+            const uint16x8_t g6 = vandq_u16(vshrq_n_u16(pixels, 5), vdupq_n_u16(0x3F));
+            const uint16x8_t b5 = vandq_u16(pixels, vdupq_n_u16(0x1F));
+
+            uint8x8x4_t result;
+            result.val[0] = vmovn_u16(vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(23), r5, 527), 6));
+            result.val[1] = vmovn_u16(vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(33), g6, 259), 6));
+            result.val[2] = vmovn_u16(vshrq_n_u16(vmlaq_n_u16(vdupq_n_u16(23), b5, 527), 6));
+            result.val[3] = vdup_n_u8(0xFF);
+
+            vst4_u8(dest + i * 4, result);
+        }
+
+        rgb565_to_rgba_scalar(dest + i * 4, source + i * 2, count - i);
+    }
+
+    static void rgba_to_rgb565_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const uint8x8x4_t pixels = vld4_u8(source + i * 4);
+
+            const uint16x8_t red = vshll_n_u8(vand_u8(pixels.val[0], vdup_n_u8(0xF8)), 8);
+            const uint16x8_t green = vshlq_n_u16(vmovl_u8(vshr_n_u8(pixels.val[1], 2)), 5);
+            const uint16x8_t blue = vmovl_u8(vshr_n_u8(pixels.val[2], 3));
+
+            vst1q_u16(reinterpret_cast<std::uint16_t *>(dest + i * 2), vorrq_u16(vorrq_u16(red, green), blue));
+        }
+
+        rgba_to_rgb565_scalar(dest + i * 2, source + i * 4, count - i);
+    }
+
+    static void rgb24_to_rgba_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr) {
+        const int red = bgr ? 2 : 0;
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const uint8x8x3_t pixels = vld3_u8(source + i * 3);
+
+            uint8x8x4_t result;
+            result.val[0] = pixels.val[red];
+            result.val[1] = pixels.val[1];
+            result.val[2] = pixels.val[2 - red];
+            result.val[3] = vdup_n_u8(0xFF);
+
+            vst4_u8(dest + i * 4, result);
+        }
+
+        rgb24_to_rgba_scalar(dest + i * 4, source + i * 3, count - i, bgr);
+    }
+
+    static void rgba_to_rgb24_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const bool bgr) {
+        const int red = bgr ? 2 : 0;
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const uint8x8x4_t pixels = vld4_u8(source + i * 4);
+
+            uint8x8x3_t result;
+            result.val[red] = pixels.val[0];
+            result.val[1] = pixels.val[1];
+            result.val[2 - red] = pixels.val[2];
+
+            vst3_u8(dest + i * 3, result);
+        }
+
+        rgba_to_rgb24_scalar(dest + i * 3, source + i * 4, count - i, bgr);
+    }
+
+    static void gray256_to_rgba_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            const uint8x8_t gray = vld1_u8(source + i);
+
+            uint8x8x4_t result;
+            result.val[0] = gray;
+            result.val[1] = gray;
+            result.val[2] = gray;
+            result.val[3] = vdup_n_u8(0xFF);
+
+            vst4_u8(dest + i * 4, result);
+        }
+
+        gray256_to_rgba_scalar(dest + i * 4, source + i, count - i);
+    }
+
+    static inline uint8x8_t premultiply_channel_neon(const uint8x8_t color, const uint8x8_t alpha) {
+        const uint16x8_t rounded = vaddq_u16(vmull_u8(color, alpha), vdupq_n_u16(128));
+        return vaddhn_u16(rounded, vshrq_n_u16(rounded, 8));
+    }
+
+    static void premultiply_neon(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count) {
+        std::size_t i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            uint8x8x4_t pixels = vld4_u8(source + i * 4);
+
+            pixels.val[0] = premultiply_channel_neon(pixels.val[0], pixels.val[3]);
+            pixels.val[1] = premultiply_channel_neon(pixels.val[1], pixels.val[3]);
+            pixels.val[2] = premultiply_channel_neon(pixels.val[2], pixels.val[3]);
+
+            vst4_u8(dest + i * 4, pixels);
+        }
+
+        premultiply_scalar(dest + i * 4, source + i * 4, count - i);
+    }
+#endif
+
+    static const pixel_kernels SCALAR_KERNELS = { swap_red_blue_scalar, rgb565_to_rgba_scalar, rgba_to_rgb565_scalar, rgb24_to_rgba_scalar,
+        rgba_to_rgb24_scalar, gray256_to_rgba_scalar, premultiply_scalar };
+
+#if defined(PIXEL_SSE2)
+    static const pixel_kernels SSE2_KERNELS = { swap_red_blue_sse2, rgb565_to_rgba_sse2, rgba_to_rgb565_sse2, rgb24_to_rgba_scalar,
+        rgba_to_rgb24_scalar, gray256_to_rgba_sse2, premultiply_sse2 };
+#endif
+
+#if defined(PIXEL_AVX2)
+    static const pixel_kernels AVX2_KERNELS = { swap_red_blue_avx2, rgb565_to_rgba_avx2, rgba_to_rgb565_avx2, rgb24_to_rgba_avx2,
+        rgba_to_rgb24_avx2, gray256_to_rgba_sse2, premultiply_avx2 };
+#endif
+
+#if defined(PIXEL_NEON)
+    static const pixel_kernels NEON_KERNELS = { swap_red_blue_neon, rgb565_to_rgba_neon, rgba_to_rgb565_neon, rgb24_to_rgba_neon,
+        rgba_to_rgb24_neon, gray256_to_rgba_neon, premultiply_neon };
+#endif
+
+    static std::atomic<pixel_simd_level> current_level(pixel_simd_level::scalar);
+    static std::atomic<const pixel_kernels *> current_kernels(nullptr);
+
+    static const pixel_kernels *get_kernels_for_level(const pixel_simd_level level) {
+        switch (level) {
+#if defined(PIXEL_SSE2)
+        case pixel_simd_level::sse2:
+            return &SSE2_KERNELS;
+#endif
+
+#if defined(PIXEL_AVX2)
+        case pixel_simd_level::avx2:
+            return &AVX2_KERNELS;
+#endif
+
+#if defined(PIXEL_NEON)
+        case pixel_simd_level::neon:
+            return &NEON_KERNELS;
+#endif
+
+        default:
+            break;
+        }
+
+        return &SCALAR_KERNELS;
+    }
+
+    bool is_pixel_simd_level_supported(const pixel_simd_level level) {
+        switch (level) {
+        case pixel_simd_level::scalar:
+            return true;
+
+#if defined(PIXEL_SSE2)
+        case pixel_simd_level::sse2:
+            return true;
+#endif
+
+#if defined(PIXEL_AVX2)
+        case pixel_simd_level::avx2: {
+            static const bool supported = cpu_supports_avx2();
+            return supported;
+        }
+#endif
+
+#if defined(PIXEL_NEON)
+        case pixel_simd_level::neon:
+            return true;
+#endif
+
+        default:
+            break;
+        }
+
+        return false;
+    }
+
+    static const pixel_kernels &get_kernels() {
+        const pixel_kernels *kernels = current_kernels.load(std::memory_order_acquire);
+
+        if (!kernels) {
+            pixel_simd_level best = pixel_simd_level::scalar;
+
+            for (const pixel_simd_level level: { pixel_simd_level::sse2, pixel_simd_level::avx2, pixel_simd_level::neon }) {
+                if (is_pixel_simd_level_supported(level)) {
+                    best = level;
+                }
+            }
+
+            set_pixel_simd_level(best);
+            kernels = current_kernels.load(std::memory_order_acquire);
+        }
+
+        return *kernels;
+    }
+
+    pixel_simd_level get_pixel_simd_level() {
+        get_kernels();
+        return current_level.load();
+    }
+
+    bool set_pixel_simd_level(const pixel_simd_level level) {
+        if (!is_pixel_simd_level_supported(level)) {
+            return false;
+        }
+
+        current_level = level;
+        current_kernels.store(get_kernels_for_level(level), std::memory_order_release);
+
+        return true;
+    }
+
+    std::uint32_t get_pixel_format_bpp(const pixel_format format) {
+        switch (format) {
+        case pixel_format::gray2:
+            return 1;
+
+        case pixel_format::gray4:
+            return 2;
+
+        case pixel_format::gray16:
+        case pixel_format::palette16:
+            return 4;
+
+        case pixel_format::gray256:
+        case pixel_format::palette256:
+            return 8;
+
+        case pixel_format::xrgb4444:
+        case pixel_format::rgb565:
+            return 16;
+
+        case pixel_format::bgr888:
+        case pixel_format::rgb888:
+            return 24;
+
+        default:
+            break;
+        }
+
+        return 32;
+    }
+
+    std::size_t get_pixel_run_size(const pixel_format format, const std::size_t count) {
+        return (count * get_pixel_format_bpp(format) + 7) / 8;
+    }
+
+    static bool is_palette_format(const pixel_format format) {
+        return (format == pixel_format::palette16) || (format == pixel_format::palette256);
+    }
+
+    static void decode_to_rgba(std::uint8_t *dest, const std::uint8_t *source, const pixel_format format, const std::size_t count,
+        const std::uint32_t *palette, const pixel_kernels &kernels) {
+        switch (format) {
+        case pixel_format::gray2:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint32_t gray = ((source[i >> 3] >> (i & 7)) & 1) * 0xFF;
+                write_pixel32(dest + i * 4, (gray * 0x010101u) | ALPHA_MASK);
+            }
+
+            break;
+
+        case pixel_format::gray4:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint32_t gray = ((source[i >> 2] >> ((i & 3) * 2)) & 3) * 85;
+                write_pixel32(dest + i * 4, (gray * 0x010101u) | ALPHA_MASK);
+            }
+
+            break;
+
+        case pixel_format::gray16:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint32_t gray = ((source[i >> 1] >> ((i & 1) * 4)) & 0xF) * 17;
+                write_pixel32(dest + i * 4, (gray * 0x010101u) | ALPHA_MASK);
+            }
+
+            break;
+
+        case pixel_format::gray256:
+            kernels.gray256_to_rgba_(dest, source, count);
+            break;
+
+        // 0x00BBGGRR entries are R, G, B in memory, only alpha is missing
+        case pixel_format::palette16:
+            for (std::size_t i = 0; i < count; i++) {
+                write_pixel32(dest + i * 4, palette[(source[i >> 1] >> ((i & 1) * 4)) & 0xF] | ALPHA_MASK);
+            }
+
+            break;
+
+        case pixel_format::palette256:
+            for (std::size_t i = 0; i < count; i++) {
+                write_pixel32(dest + i * 4, palette[source[i]] | ALPHA_MASK);
+            }
+
+            break;
+
+        case pixel_format::xrgb4444:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint16_t pixel = read_pixel16(source + i * 2);
+
+                dest[i * 4] = static_cast<std::uint8_t>(((pixel >> 8) & 0xF) * 17);
+                dest[i * 4 + 1] = static_cast<std::uint8_t>(((pixel >> 4) & 0xF) * 17);
+                dest[i * 4 + 2] = static_cast<std::uint8_t>((pixel & 0xF) * 17);
+                dest[i * 4 + 3] = 0xFF;
+            }
+
+            break;
+
+        case pixel_format::rgb565:
+            kernels.rgb565_to_rgba_(dest, source, count);
+            break;
+
+        case pixel_format::bgr888:
+        case pixel_format::rgb888:
+            kernels.rgb24_to_rgba_(dest, source, count, format == pixel_format::bgr888);
+            break;
+
+        case pixel_format::bgrx8888:
+            kernels.swap_red_blue_(dest, source, count, ALPHA_MASK);
+            break;
+
+        case pixel_format::bgra8888:
+            kernels.swap_red_blue_(dest, source, count, 0);
+            break;
+
+        case pixel_format::bgra8888_premultiplied:
+            kernels.swap_red_blue_(dest, source, count, 0);
+            unpremultiply(dest, count);
+            break;
+
+        case pixel_format::rgba8888:
+            std::memcpy(dest, source, count * 4);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // Symbian's TRgb::Gray256
+    static inline std::uint32_t rgba_to_gray256(const std::uint8_t *pixel) {
+        return (pixel[0] * 2 + pixel[1] * 5 + pixel[2]) >> 3;
+    }
+
+    // Keeps the bits of the pixels past the run, for rows that end in the middle of a byte
+    static void encode_gray_bits(std::uint8_t *dest, const std::uint8_t *source, const std::size_t count, const std::uint32_t bpp) {
+        const std::uint32_t pixels_per_byte = 8 / bpp;
+        const std::uint32_t mask = (1 << bpp) - 1;
+
+        for (std::size_t i = 0; i < count; i++) {
+            const std::uint32_t value = rgba_to_gray256(source + i * 4) >> (8 - bpp);
+            const std::uint32_t shift = static_cast<std::uint32_t>(i % pixels_per_byte) * bpp;
+
+            std::uint8_t &target = dest[i / pixels_per_byte];
+            target = static_cast<std::uint8_t>((target & ~(mask << shift)) | (value << shift));
+        }
+    }
+
+    static void encode_from_rgba(std::uint8_t *dest, const pixel_format format, const std::uint8_t *source, const std::size_t count,
+        const pixel_kernels &kernels) {
+        switch (format) {
+        case pixel_format::gray2:
+            encode_gray_bits(dest, source, count, 1);
+            break;
+
+        case pixel_format::gray4:
+            encode_gray_bits(dest, source, count, 2);
+            break;
+
+        case pixel_format::gray16:
+            encode_gray_bits(dest, source, count, 4);
+            break;
+
+        case pixel_format::gray256:
+            for (std::size_t i = 0; i < count; i++) {
+                dest[i] = static_cast<std::uint8_t>(rgba_to_gray256(source + i * 4));
+            }
+
+            break;
+
+        case pixel_format::xrgb4444:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint8_t *pixel = source + i * 4;
+                write_pixel16(dest + i * 2, static_cast<std::uint16_t>(((pixel[0] >> 4) << 8) | ((pixel[1] >> 4) << 4) | (pixel[2] >> 4)));
+            }
+
+            break;
+
+        case pixel_format::rgb565:
+            kernels.rgba_to_rgb565_(dest, source, count);
+            break;
+
+        case pixel_format::bgr888:
+        case pixel_format::rgb888:
+            kernels.rgba_to_rgb24_(dest, source, count, format == pixel_format::bgr888);
+            break;
+
+        case pixel_format::bgrx8888:
+            kernels.swap_red_blue_(dest, source, count, ALPHA_MASK);
+            break;
+
+        case pixel_format::bgra8888:
+            kernels.swap_red_blue_(dest, source, count, 0);
+            break;
+
+        case pixel_format::bgra8888_premultiplied:
+            kernels.swap_red_blue_(dest, source, count, 0);
+            kernels.premultiply_(dest, dest, count);
+            break;
+
+        case pixel_format::rgba8888:
+            std::memcpy(dest, source, count * 4);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    static void copy_pixels(std::uint8_t *dest, const std::uint8_t *source, const pixel_format format, const std::size_t count) {
+        const std::size_t total_bits = count * get_pixel_format_bpp(format);
+        std::memcpy(dest, source, total_bits / 8);
+
+        if (total_bits & 7) {
+            const std::uint8_t mask = static_cast<std::uint8_t>((1 << (total_bits & 7)) - 1);
+            dest[total_bits / 8] = static_cast<std::uint8_t>((dest[total_bits / 8] & ~mask) | (source[total_bits / 8] & mask));
+        }
+    }
+
+    static bool is_conversion_supported(const pixel_format dest_format, const pixel_format source_format, const std::uint32_t *palette) {
+        if (dest_format == source_format) {
+            return true;
+        }
+
+        return !is_palette_format(dest_format) && (!is_palette_format(source_format) || palette);
+    }
+
+    bool convert_pixels(void *dest, const pixel_format dest_format, const void *source, const pixel_format source_format,
+        const std::size_t count, const std::uint32_t *palette) {
+        if (!is_conversion_supported(dest_format, source_format, palette)) {
+            return false;
+        }
+
+        std::uint8_t *dest8 = reinterpret_cast<std::uint8_t *>(dest);
+        const std::uint8_t *source8 = reinterpret_cast<const std::uint8_t *>(source);
+
+        if (dest_format == source_format) {
+            copy_pixels(dest8, source8, source_format, count);
+            return true;
+        }
+
+        const pixel_kernels &kernels = get_kernels();
+
+        if (source_format == pixel_format::rgba8888) {
+            encode_from_rgba(dest8, dest_format, source8, count, kernels);
+            return true;
+        }
+
+        if (dest_format == pixel_format::rgba8888) {
+            decode_to_rgba(dest8, source8, source_format, count, palette, kernels);
+            return true;
+        }
+
+        alignas(32) std::uint8_t rgba[CONVERT_CHUNK_SIZE * 4];
+
+        const std::uint32_t source_bpp = get_pixel_format_bpp(source_format);
+        const std::uint32_t dest_bpp = get_pixel_format_bpp(dest_format);
+
+        // The chunk size is a multiple of 8, so every chunk starts at a byte boundary
+        for (std::size_t done = 0; done < count; done += CONVERT_CHUNK_SIZE) {
+            const std::size_t chunk = std::min(CONVERT_CHUNK_SIZE, count - done);
+
+            decode_to_rgba(rgba, source8 + done * source_bpp / 8, source_format, chunk, palette, kernels);
+            encode_from_rgba(dest8 + done * dest_bpp / 8, dest_format, rgba, chunk, kernels);
+        }
+
+        return true;
+    }
+
+    bool convert_pixel_rows(void *dest, const std::size_t dest_stride, const pixel_format dest_format, const void *source,
+        const std::size_t source_stride, const pixel_format source_format, const std::size_t width, const std::size_t height,
+        const std::uint32_t *palette, thread_pool *pool) {
+        if (!is_conversion_supported(dest_format, source_format, palette)) {
+            return false;
+        }
+
+        std::uint8_t *dest8 = reinterpret_cast<std::uint8_t *>(dest);
+        const std::uint8_t *source8 = reinterpret_cast<const std::uint8_t *>(source);
+
+        auto convert_range = [&](const std::size_t begin, const std::size_t end) {
+            for (std::size_t y = begin; y < end; y++) {
+                convert_pixels(dest8 + y * dest_stride, dest_format, source8 + y * source_stride, source_format, width, palette);
+            }
+        };
+
+        if (pool && (width * height >= PARALLEL_MIN_PIXELS) && (height >= PARALLEL_MIN_ROWS)) {
+            pool->parallel_for(height, PARALLEL_MIN_ROWS / 2, convert_range);
+        } else {
+            convert_range(0, height);
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common/thread.h>
+#include <common/thread_pool.h>
+
+#include <algorithm>
+
+namespace eka2l1::common {
+    // Chunks handed out per thread, so a slow chunk does not leave the others idle
+    static constexpr std::size_t CHUNKS_PER_THREAD = 4;
+
+    thread_pool::thread_pool(const std::size_t worker_count)
+        : stopping_(false) {
+        for (std::size_t i = 0; i < worker_count; i++) {
+            workers_.emplace_back([this]() {
+                set_thread_name("Worker thread");
+                worker_loop();
+            });
+        }
+    }
+
+    thread_pool::~thread_pool() {
+        {
+            const std::lock_guard<std::mutex> guard(lock_);
+            stopping_ = true;
+        }
+
+        job_cond_.notify_all();
+
+        for (auto &worker: workers_) {
+            worker.join();
+        }
+    }
+
+    bool thread_pool::run_chunk(job &j) {
+        const std::size_t chunk = j.next_chunk_.fetch_add(1);
+        if (chunk >= j.chunk_count_) {
+            return false;
+        }
+
+        const std::size_t begin = chunk * j.chunk_size_;
+        (*j.func_)(begin, std::min(begin + j.chunk_size_, j.count_));
+
+        if (j.done_chunk_.fetch_add(1) + 1 == j.chunk_count_) {
+            const std::lock_guard<std::mutex> guard(lock_);
+            done_cond_.notify_all();
+        }
+
+        return true;
+    }
+
+    void thread_pool::worker_loop() {
+        std::unique_lock<std::mutex> guard(lock_);
+
+        while (true) {
+            job *target = nullptr;
+
+            job_cond_.wait(guard, [&]() {
+                if (stopping_) {
+                    return true;
+                }
+
+                while (!jobs_.empty() && (jobs_.front()->next_chunk_ >= jobs_.front()->chunk_count_)) {
+                    jobs_.pop_front();
+                }
+
+                return !jobs_.empty();
+            });
+
+            if (stopping_) {
+                return;
+            }
+
+            target = jobs_.front();
+            target->users_++;
+
+            guard.unlock();
+            while (run_chunk(*target)) {
+            }
+            guard.lock();
+
+            if (--target->users_ == 0) {
+                done_cond_.notify_all();
+            }
+        }
+    }
+
+    void thread_pool::parallel_for(const std::size_t count, const std::size_t min_chunk, const range_func &func) {
+        if (count == 0) {
+            return;
+        }
+
+        const std::size_t max_chunks = (workers_.size() + 1) * CHUNKS_PER_THREAD;
+        const std::size_t chunk_count = std::min(max_chunks, count / std::max<std::size_t>(min_chunk, 1));
+
+        if (workers_.empty() || (chunk_count <= 1)) {
+            func(0, count);
+            return;
+        }
+
+        job j;
+        j.func_ = &func;
+        j.count_ = count;
+        j.chunk_size_ = (count + chunk_count - 1) / chunk_count;
+        j.chunk_count_ = (count + j.chunk_size_ - 1) / j.chunk_size_;
+        j.next_chunk_ = 0;
+        j.done_chunk_ = 0;
+        j.users_ = 0;
+
+        {
+            const std::lock_guard<std::mutex> guard(lock_);
+            jobs_.push_back(&j);
+        }
+
+        job_cond_.notify_all();
+
+        while (run_chunk(j)) {
+        }
+
+        std::unique_lock<std::mutex> guard(lock_);
+
+        auto ite = std::find(jobs_.begin(), jobs_.end(), &j);
+        if (ite != jobs_.end()) {
+            jobs_.erase(ite);
+        }
+
+        done_cond_.wait(guard, [&]() {
+            return (j.done_chunk_ == j.chunk_count_) && (j.users_ == 0);
+        });
+    }
+
+    thread_pool &get_shared_thread_pool() {
+        static thread_pool pool(std::max<std::size_t>(std::thread::hardware_concurrency(), 2) - 1);
+        return pool;
+    }
+}
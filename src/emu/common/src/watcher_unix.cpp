@@ -20,10 +20,12 @@
 #include "watcher_unix.h"
 #include <common/log.h>
 
+#include <poll.h>
 #include <sys/inotify.h>
 
 namespace eka2l1::common {
     static constexpr std::size_t EVENT_MAX_SIZE = sizeof(struct inotify_event) + 16;
+    static constexpr int WAIT_POLL_TIMEOUT_MS = 100;
 
     directory_watcher_impl::directory_watcher_impl()
         : should_stop(false) {
@@ -41,18 +43,36 @@ namespace eka2l1::common {
             std::vector<directory_change> changes;
 
             auto flush_changes = [&](const int wd) {
-                // Flush changes
-                auto ite = std::find(container_.begin(), container_.end(), wd);
+                // Flush changes. Call outside of the lock, so the callback can manage watches.
+                directory_watcher_callback_pair callback_pair;
 
-                if (ite != container_.end()) {
-                    auto &callback = callbacks_[std::distance(container_.begin(), ite)];
-                    callback.callback_pair_.first(callback.callback_pair_.second, changes);
+                {
+                    const std::lock_guard<std::mutex> guard(lock_);
+                    auto ite = std::find(container_.begin(), container_.end(), wd);
 
-                    changes.clear();
+                    if (ite != container_.end()) {
+                        callback_pair = callbacks_[std::distance(container_.begin(), ite)].callback_pair_;
+                    }
+                }
+
+                if (callback_pair.first) {
+                    callback_pair.first(callback_pair.second, changes);
                 }
+
+                changes.clear();
             };
 
             while (!should_stop) {
+                // Wake up from time to time to check if the watcher is being destroyed
+                struct pollfd poll_info;
+                poll_info.fd = instance_;
+                poll_info.events = POLLIN;
+                poll_info.revents = 0;
+
+                if (poll(&poll_info, 1, WAIT_POLL_TIMEOUT_MS) <= 0) {
+                    continue;
+                }
+
                 const ssize_t length = read(instance_, &events_[0], events_.size());
 
                 if (length == -1) {
@@ -100,12 +120,12 @@ namespace eka2l1::common {
                         change.change_ |= directory_change_action_modified;
                     }
 
-                    changes.push_back(change);
-
                     if ((last_wd != -1) && (last_wd != evt->wd)) {
-                        flush_changes(evt->wd);
+                        flush_changes(last_wd);
                     }
 
+                    changes.push_back(change);
+
                     last_wd = evt->wd;
                     i += evt->len + sizeof(struct inotify_event);
                 }
@@ -118,17 +138,20 @@ namespace eka2l1::common {
     }
 
     directory_watcher_impl::~directory_watcher_impl() {
+        should_stop = true;
+
         for (auto &wd : container_) {
             inotify_rm_watch(instance_, wd);
         }
 
-        should_stop = true;
         wait_thread_->join();
 
         close(instance_);
     }
 
     bool directory_watcher_impl::unwatch(const std::int32_t watch_handle) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
         // Find in container
         auto ite = std::find(container_.begin(), container_.end(), watch_handle);
 
@@ -174,7 +197,9 @@ namespace eka2l1::common {
 
     std::int32_t directory_watcher_impl::watch(const std::string &folder, directory_watcher_callback callback,
         void *callback_userdata, const std::uint32_t mask) {
-        const int wd_handle = inotify_add_watch(instance_, folder.c_str(), IN_CREATE | IN_DELETE | IN_MODIFY);
+        const std::lock_guard<std::mutex> guard(lock_);
+        const int wd_handle = inotify_add_watch(instance_, folder.c_str(), IN_CREATE | IN_DELETE | IN_MODIFY
+            | convert_to_unix_notify_mask(mask));
 
         if (wd_handle == -1) {
             LOG_ERROR(COMMON, "Error creating new inotify watch!");
@@ -125,6 +125,9 @@ namespace eka2l1::config {
         bool report_mmfdev_underflow{ false };
         bool disable_display_content_scale { false };
         bool enable_hw_gles1 { true };
+        bool demand_page_code { false };
+        bool enable_codeseg_cache { true };
+        bool enable_vfs_metadata_cache { true };
 
         keybind_profile keybinds;
 
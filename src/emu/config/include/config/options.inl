@@ -73,6 +73,9 @@ OPTION(midi-backend, midi_backend_string, "tsf")
 OPTION(hsb-bank-path, hsb_bank_path, "resources/defaultbank.hsb")
 OPTION(sf2-bank-path, sf2_bank_path, "resources/defaultbank.sf2")
 OPTION(enable-hw-gles1, enable_hw_gles1, true)
+OPTION(demand-page-code, demand_page_code, false)
+OPTION(enable-codeseg-cache, enable_codeseg_cache, true)
+OPTION(enable-vfs-metadata-cache, enable_vfs_metadata_cache, true)
 OPTION(log-filter, log_filter, DEFAULT_LOG_FILTERING)
 
 #ifdef OPTION
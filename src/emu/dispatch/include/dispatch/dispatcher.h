@@ -191,12 +191,33 @@ namespace eka2l1::dispatch {
         }
     };
 
+    /**
+     * @brief Number of staging buffers each screen rotates through when posting frames.
+     * 
+     * A buffer is reused once the driver has uploaded from it, so with three the emulator rarely waits.
+     */
+    static constexpr std::size_t SCREEN_POST_STAGING_RING_SIZE = 3;
+
+    struct screen_post_stats {
+        std::uint64_t posted_frames_ = 0;
+        std::uint64_t skipped_frames_ = 0;          ///< Frames identical to the previous one, which were not uploaded.
+        std::uint64_t uploaded_bytes_ = 0;
+        std::uint64_t staging_waits_ = 0;           ///< Posts that waited for the driver to release a staging buffer.
+    };
+
     class screen_post_transferer {
     private:
         struct screen_post_source_info {
             drivers::handle transfer_texture_;
             eka2l1::vec2 transfer_texture_size_;
             std::int32_t format_;
+
+            // Frames converted to RGBA8, uploaded by the driver straight from here
+            std::vector<std::uint8_t> staging_[SCREEN_POST_STAGING_RING_SIZE];
+            std::uint64_t staging_fences_[SCREEN_POST_STAGING_RING_SIZE];
+            std::size_t staging_index_;
+
+            std::uint64_t last_frame_hash_;
         };
 
         std::vector<screen_post_source_info> infos_;
@@ -206,6 +227,8 @@ namespace eka2l1::dispatch {
         std::mutex lock_;
         ntimer *timing_;
 
+        screen_post_stats stats_;
+
     public:
         void complete_notify(epoc::notify_info *info);
 
@@ -215,8 +238,22 @@ namespace eka2l1::dispatch {
         void wait_vsync(epoc::screen *scr, epoc::notify_info &info);
         void cancel_wait_vsync(const epoc::notify_info &info);
 
+        /**
+         * @brief Get a texture holding a posted frame.
+         * 
+         * The frame is converted to RGBA8 into a staging buffer of the screen, and the upload is submitted
+         * right away. A frame identical to the last one posted on the screen is not uploaded again.
+         * 
+         * @param builder       Builder to record texture state changes to.
+         * 
+         * @returns Handle to the texture, 0 on failure.
+         */
         drivers::handle transfer_data_to_texture(drivers::graphics_driver *drv, drivers::graphics_command_builder &builder,
             std::int32_t screen_index, std::uint8_t *data, eka2l1::vec2 size, std::int32_t format);
+
+        const screen_post_stats &get_stats() const {
+            return stats_;
+        }
     };
 
     struct dispatcher {
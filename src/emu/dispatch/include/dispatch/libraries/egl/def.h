@@ -406,6 +406,29 @@ namespace eka2l1::dispatch {
 
     struct egl_context;
 
+    /**
+     * @brief Number of driver bitmaps a window surface rotates through on swap.
+     * 
+     * The window server composites the buffer that was just swapped, while the context already renders
+     * the next frame into another one. With three, the driver can run up to two frames behind before a swap waits.
+     */
+    static constexpr std::size_t EGL_SURFACE_PRESENT_RING_SIZE = 3;
+
+    /**
+     * @brief Frame pacing counters of a window surface, updated on each swap.
+     */
+    struct egl_frame_pacing_stats {
+        std::uint64_t swaps_ = 0;
+        std::uint64_t total_swap_us_ = 0;               ///< Time spent inside swaps, including throttling.
+        std::uint64_t last_swap_us_ = 0;
+        std::uint64_t peak_swap_us_ = 0;
+        std::uint64_t last_frame_interval_us_ = 0;      ///< Time between the starts of the last two swaps.
+        std::uint64_t throttled_swaps_ = 0;             ///< Swaps that waited for the driver before reusing a buffer.
+        std::uint64_t throttle_wait_us_ = 0;
+        std::uint32_t queue_depth_ = 0;                 ///< Swapped frames the driver had not finished, at the last swap.
+        std::uint32_t peak_queue_depth_ = 0;
+    };
+
     struct egl_surface {
         drivers::handle handle_;
         egl_config config_;
@@ -420,8 +443,56 @@ namespace eka2l1::dispatch {
         float current_scale_;
         egl_context *bounded_context_;
 
+        // Buffers of a window surface, handle_ being the one currently rendered to. Other surfaces only use the first slot.
+        drivers::handle present_ring_[EGL_SURFACE_PRESENT_RING_SIZE];
+        std::uint64_t present_fences_[EGL_SURFACE_PRESENT_RING_SIZE];
+        std::size_t present_index_;
+
+        std::uint64_t last_swap_start_us_;
+        egl_frame_pacing_stats pacing_stats_;
+
         explicit egl_surface(epoc::canvas_base *backed_window, epoc::screen *screen, eka2l1::vec2 dim,
             drivers::handle h, egl_config config);
+
+        /**
+         * @brief Mark the start of a swap, for frame pacing.
+         */
+        void begin_swap();
+
+        /**
+         * @brief Make the next ring buffer the one rendered to.
+         * 
+         * Call after the swapped buffer has been handed to the window, and before the frame is flushed. Waits for
+         * the driver if the next buffer is still used by a frame in flight, and creates it if needed. Only the binding
+         * moves, the next buffer keeps whatever it had (EGL_BUFFER_DESTROYED swap behaviour).
+         * 
+         * @param driver        The driver to create buffers and wait on.
+         * 
+         * @returns The slot of the buffer that was swapped, to pass to frame_flushed.
+         */
+        std::size_t rotate_present_buffer(drivers::graphics_driver *driver);
+
+        /**
+         * @brief Record the fence of a swapped frame, and finish the pacing counters of the swap.
+         * 
+         * Call once the window has submitted its composite of the swapped buffer, so the fence covers it.
+         * 
+         * @param slot          Slot returned by rotate_present_buffer, or EGL_SURFACE_PRESENT_RING_SIZE if no rotation happened.
+         */
+        void frame_flushed(drivers::graphics_driver *driver, const std::size_t slot);
+
+        /**
+         * @brief Replace the buffers after the display scale changed.
+         * 
+         * The content of the current buffer is kept, scaled. Other buffers are recreated on demand.
+         */
+        void rescale_buffers(drivers::graphics_driver *driver, drivers::graphics_command_builder &builder, const float new_scale);
+
+        void destroy_buffers(drivers::graphics_command_builder &builder);
+
+        const egl_frame_pacing_stats &get_pacing_stats() const {
+            return pacing_stats_;
+        }
     };
 
     struct egl_context {
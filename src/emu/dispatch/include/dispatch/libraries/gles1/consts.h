@@ -8,7 +8,13 @@ namespace eka2l1::dispatch {
         GLES1_EMU_MAX_TEXTURE_MIP_LEVEL = 10,
         GLES1_EMU_MAX_TEXTURE_COUNT = 3,
         GLES1_EMU_MAX_LIGHT = 8,
-        GLES1_EMU_MAX_CLIP_PLANE = 6
+        GLES1_EMU_MAX_CLIP_PLANE = 6,
+        GLES1_EMU_MAX_VERTEX_ATTRIB = 3 + GLES1_EMU_MAX_TEXTURE_COUNT,    // Position, color, normal and texcoords
+        GLES1_EMU_INPUT_DESCRIPTORS_CACHE_SIZE = 16,
+        GLES1_EMU_VERTEX_CACHE_MIN_STREAM_SIZE = 1024,                    // Smaller streams are cheaper to push than to hash and track
+        GLES1_EMU_VERTEX_CACHE_PROMOTE_COUNT = 2,                        // Identical draws needed before a stream gets its own buffer
+        GLES1_EMU_VERTEX_CACHE_MAX_ENTRY = 256,
+        GLES1_EMU_VERTEX_CACHE_BUDGET = 16 * 1024 * 1024
     };
 
     enum gles1_static_string_key {
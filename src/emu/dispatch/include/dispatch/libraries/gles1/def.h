@@ -34,6 +34,8 @@
 #include <optional>
 #include <stack>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace eka2l1 {
     class system;
@@ -311,14 +313,61 @@ namespace eka2l1::dispatch {
         void destroy(drivers::graphics_command_builder &builder);
         void done_frame();
 
-        drivers::handle push_buffer(const std::uint8_t *data, const std::size_t buffer_size, std::size_t &buffer_offset);
-        drivers::handle push_buffer(const std::uint8_t *data, const gles1_vertex_attrib &attrib, const std::int32_t first_index, const std::size_t vert_count, std::size_t &buffer_offset);
+        /**
+         * @brief Reserve space in a buffer to be written directly, instead of copying from another place.
+         * 
+         * @param size              Number of bytes to reserve.
+         * @param alignment         The returned offset is a multiple of this. Does not need to be a power of two.
+         * @param buffer_offset     Offset of the reserved space in the returned buffer.
+         * @param buffer            The driver handle of the buffer containing the space.
+         * 
+         * @return Pointer to the reserved space. Null if all buffers are full and flushing is needed.
+         */
+        std::uint8_t *reserve(const std::size_t size, const std::size_t alignment, std::size_t &buffer_offset, drivers::handle &buffer);
 
         void flush(drivers::graphics_command_builder &builder);
     };
 
     using gles1_driver_object_instance = std::unique_ptr<gles1_driver_object>;
 
+    /**
+     * @brief Bytes of draw data sent to the driver during one frame.
+     */
+    struct gles1_upload_stats {
+        std::uint64_t vertex_bytes_ = 0;            ///< Client vertex data pushed through the stream buffers.
+        std::uint64_t index_bytes_ = 0;             ///< Client index data pushed through the stream buffers.
+        std::uint64_t cached_vertex_bytes_ = 0;     ///< Client vertex data not pushed because a cached buffer held it.
+        std::uint64_t cache_fill_bytes_ = 0;        ///< Data uploaded to create cached vertex buffers.
+        std::uint32_t draw_count_ = 0;
+    };
+
+    /**
+     * @brief A client vertex stream tracked across draws, keyed by its source addresses and layout.
+     * 
+     * Once the same content has been drawn a few times, it gets its own buffer and is no longer pushed.
+     */
+    struct gles1_vertex_cache_entry {
+        std::uint64_t content_hash_ = 0;
+        std::uint32_t size_ = 0;
+        std::uint32_t seen_count_ = 0;
+        std::uint64_t last_use_frame_ = 0;
+        drivers::handle buffer_ = 0;
+    };
+
+    /**
+     * @brief An input descriptors object kept alive for one attribute layout.
+     * 
+     * Games redraw with a handful of layouts, so rebinding a cached object avoids re-specifying the
+     * attributes on every draw.
+     */
+    struct gles1_input_descriptors_cache_entry {
+        drivers::handle handle_ = 0;
+        std::uint64_t hash_ = 0;
+        std::uint64_t last_use_ = 0;
+        std::uint32_t count_ = 0;
+        drivers::input_descriptor descs_[GLES1_EMU_MAX_VERTEX_ATTRIB];
+    };
+
     struct egl_context_es1 : public egl_context {
         float clear_color_[4];
         float clear_depth_;
@@ -429,6 +478,9 @@ namespace eka2l1::dispatch {
         gles1_vertex_attrib normal_attrib_;
         drivers::handle input_desc_;
 
+        gles1_input_descriptors_cache_entry input_desc_cache_[GLES1_EMU_INPUT_DESCRIPTORS_CACHE_SIZE];
+        std::uint64_t input_desc_cache_tick_;
+
         bool attrib_changed_;
         std::int32_t previous_first_index_;
 
@@ -494,6 +546,14 @@ namespace eka2l1::dispatch {
         gles1_buffer_pusher vertex_buffer_pusher_;
         gles1_buffer_pusher index_buffer_pusher_;
 
+        std::unordered_map<std::uint64_t, gles1_vertex_cache_entry> vertex_cache_;
+        std::vector<std::uint8_t> vertex_cache_scratch_;
+        std::size_t vertex_cache_buffer_bytes_;
+
+        std::uint64_t frame_index_;
+        gles1_upload_stats upload_stats_;
+        gles1_upload_stats last_frame_upload_stats_;
+
         explicit egl_context_es1();
 
         glm::mat4 &active_matrix();
@@ -509,6 +569,13 @@ namespace eka2l1::dispatch {
         void flush_to_driver(drivers::graphics_driver *driver, const bool is_frame_swap_flush = false) override;
         void flush_state_changes();
 
+        /**
+         * @brief Get the upload statistics of the last completed frame.
+         */
+        const gles1_upload_stats &last_frame_upload_stats() const {
+            return last_frame_upload_stats_;
+        }
+
         egl_context_type context_type() const override {
             return EGL_GLES1_CONTEXT;
         }
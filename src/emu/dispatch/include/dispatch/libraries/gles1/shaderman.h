@@ -20,8 +20,12 @@
 #pragma once
 
 #include <cstdint>
+#include <future>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <vector>
 
 #include <drivers/graphics/common.h>
 #include <drivers/graphics/graphics.h>
@@ -61,6 +65,35 @@ namespace eka2l1::dispatch {
         std::int32_t light_attenuatation_vec_loc_[GLES1_EMU_MAX_LIGHT];
     };
 
+    /**
+     * @brief State needed to rebuild one program from the persistent shader cache.
+     */
+    struct gles1_persistent_program_entry {
+        std::uint64_t vertex_hash_;
+        std::uint64_t fragment_hash_;
+        std::uint64_t vertex_statuses_;
+        std::uint64_t fragment_statuses_;
+        std::uint32_t active_texs_;
+        std::uint32_t reserved_;
+    };
+
+    /**
+     * @brief Content of a persistent shader cache file, as loaded from disk.
+     */
+    struct gles1_persistent_shader_cache {
+        std::unordered_map<std::uint64_t, std::string> vertex_sources_;
+        std::unordered_map<std::uint64_t, std::string> fragment_sources_;
+        std::vector<gles1_persistent_program_entry> programs_;
+
+        bool need_rewrite_ = false;         ///< The file is missing, from another version or damaged.
+    };
+
+    struct gles1_shader_cache_stats {
+        std::uint32_t preloaded_programs_ = 0;  ///< Programs compiled from the persistent cache before first use.
+        std::uint32_t hits_ = 0;                ///< Programs first used this session that came from the persistent cache.
+        std::uint32_t misses_ = 0;              ///< Programs that had to be generated and compiled on first use.
+    };
+
     struct gles1_shaderman {
     protected:
         std::unordered_map<std::uint64_t, drivers::handle> vertex_cache_;
@@ -71,6 +104,21 @@ namespace eka2l1::dispatch {
         drivers::graphics_driver *driver_;
         void *fragment_status_hasher_;
 
+        std::string persistent_cache_path_;
+        std::future<std::unique_ptr<gles1_persistent_shader_cache>> persistent_cache_future_;
+        std::unordered_set<drivers::handle> preloaded_programs_unused_;
+        gles1_shader_cache_stats persistent_cache_stats_;
+
+        drivers::handle create_module(const std::uint64_t hash, const drivers::shader_module_type type, const std::string &source);
+        drivers::handle create_program(const drivers::handle vert_module, const drivers::handle fragment_module, const std::uint64_t vertex_statuses,
+            const std::uint64_t fragment_statuses, const std::uint32_t active_texs, gles1_shader_variables_info *&info);
+
+        void poll_persistent_cache(const bool wait);
+        void warm_from_persistent_cache(gles1_persistent_shader_cache &cache);
+        void append_to_persistent_cache(const std::uint8_t type, const std::uint64_t hash, const std::string &source);
+        void append_to_persistent_cache(const gles1_persistent_program_entry &entry);
+        void report_persistent_cache();
+
     public:
         explicit gles1_shaderman(drivers::graphics_driver *driver);
         ~gles1_shaderman();
@@ -79,5 +127,19 @@ namespace eka2l1::dispatch {
 
         drivers::handle retrieve_program(const std::uint64_t vertex_statuses, const std::uint64_t fragment_statuses,
             const std::uint32_t active_texs, gles_texture_env_info *tex_env_infos, gles1_shader_variables_info *&info);
+
+        /**
+         * @brief Start loading the persistent shader cache of a game in the background.
+         *
+         * Shaders of the cache are compiled on the next program retrieval after the load finishes, and every shader
+         * generated from then on is appended to the file. Loading the same path twice does nothing.
+         *
+         * @param path      Path to the cache file. Created if it does not exist.
+         */
+        void load_persistent_cache(const std::string &path);
+
+        const gles1_shader_cache_stats &get_persistent_cache_stats() const {
+            return persistent_cache_stats_;
+        }
     };
 }
\ No newline at end of file
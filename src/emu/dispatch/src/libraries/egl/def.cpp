@@ -21,8 +21,11 @@
 #include <drivers/graphics/graphics.h>
 #include <services/window/screen.h>
 
+#include <common/algorithm.h>
 #include <common/log.h>
 
+#include <chrono>
+
 namespace eka2l1::dispatch {
     static const std::uint32_t RED_SIZE_CONFIG_LOOKUP_TABLE[3] = { 5, 8, 8 };
     static const std::uint32_t GREEN_SIZE_CONFIG_LOOKUP_TABLE[3] = { 6, 8, 8 };
@@ -53,6 +56,111 @@ namespace eka2l1::dispatch {
         if (screen) {
             current_scale_ = screen->display_scale_factor;
         }
+
+        for (std::size_t i = 0; i < EGL_SURFACE_PRESENT_RING_SIZE; i++) {
+            present_ring_[i] = 0;
+            present_fences_[i] = 0;
+        }
+
+        present_ring_[0] = h;
+        present_index_ = 0;
+        last_swap_start_us_ = 0;
+    }
+
+    static std::uint64_t pacing_clock_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void egl_surface::begin_swap() {
+        const std::uint64_t now = pacing_clock_us();
+        if (last_swap_start_us_ != 0) {
+            pacing_stats_.last_frame_interval_us_ = now - last_swap_start_us_;
+        }
+
+        last_swap_start_us_ = now;
+    }
+
+    std::size_t egl_surface::rotate_present_buffer(drivers::graphics_driver *driver) {
+        const std::size_t swapped_slot = present_index_;
+        const std::size_t next_slot = (present_index_ + 1) % EGL_SURFACE_PRESENT_RING_SIZE;
+
+        // The frame last rendered to this buffer may not have run yet. Waiting here is what bounds the queue.
+        if (present_fences_[next_slot] > driver->completed_fence()) {
+            const std::uint64_t wait_start = pacing_clock_us();
+            driver->wait_fence(present_fences_[next_slot]);
+
+            pacing_stats_.throttled_swaps_++;
+            pacing_stats_.throttle_wait_us_ += pacing_clock_us() - wait_start;
+        }
+
+        if (!present_ring_[next_slot]) {
+            present_ring_[next_slot] = drivers::create_bitmap(driver, dimension_ * current_scale_, config_.buffer_size());
+
+            if (!present_ring_[next_slot]) {
+                LOG_ERROR(HLE_DISPATCHER, "Unable to create present buffer for EGL window surface, staying single buffered");
+                return swapped_slot;
+            }
+        }
+
+        present_index_ = next_slot;
+        handle_ = present_ring_[next_slot];
+
+        return swapped_slot;
+    }
+
+    void egl_surface::frame_flushed(drivers::graphics_driver *driver, const std::size_t slot) {
+        if (slot < EGL_SURFACE_PRESENT_RING_SIZE) {
+            present_fences_[slot] = driver->current_fence();
+        }
+
+        const std::uint64_t completed = driver->completed_fence();
+        std::uint32_t depth = 0;
+
+        for (std::size_t i = 0; i < EGL_SURFACE_PRESENT_RING_SIZE; i++) {
+            if (present_fences_[i] > completed) {
+                depth++;
+            }
+        }
+
+        const std::uint64_t swap_us = pacing_clock_us() - last_swap_start_us_;
+
+        pacing_stats_.swaps_++;
+        pacing_stats_.last_swap_us_ = swap_us;
+        pacing_stats_.total_swap_us_ += swap_us;
+        pacing_stats_.peak_swap_us_ = common::max(pacing_stats_.peak_swap_us_, swap_us);
+        pacing_stats_.queue_depth_ = depth;
+        pacing_stats_.peak_queue_depth_ = common::max(pacing_stats_.peak_queue_depth_, depth);
+    }
+
+    void egl_surface::rescale_buffers(drivers::graphics_driver *driver, drivers::graphics_command_builder &builder, const float new_scale) {
+        const eka2l1::vec2 new_scaled_size = dimension_ * new_scale;
+        drivers::handle new_surface = drivers::create_bitmap(driver, new_scaled_size, config_.buffer_size());
+
+        builder.bind_bitmap(new_surface);
+        builder.draw_bitmap(handle_, 0, eka2l1::rect(eka2l1::vec2(0, 0), new_scaled_size),
+            eka2l1::rect(eka2l1::vec2(0, 0), eka2l1::vec2(0, 0)));
+
+        destroy_buffers(builder);
+
+        present_ring_[present_index_] = new_surface;
+        handle_ = new_surface;
+        current_scale_ = new_scale;
+    }
+
+    void egl_surface::destroy_buffers(drivers::graphics_command_builder &builder) {
+        for (std::size_t i = 0; i < EGL_SURFACE_PRESENT_RING_SIZE; i++) {
+            if (present_ring_[i] && (present_ring_[i] != handle_)) {
+                builder.destroy_bitmap(present_ring_[i]);
+            }
+
+            present_ring_[i] = 0;
+        }
+
+        if (handle_) {
+            builder.destroy_bitmap(handle_);
+        }
+
+        handle_ = 0;
     }
 
     void egl_context::destroy(drivers::graphics_driver *driver, drivers::graphics_command_builder &builder) {
@@ -78,7 +186,7 @@ namespace eka2l1::dispatch {
 
         for (auto &surface: dsurfaces_) {
             if (surface) {
-                cmd_builder.destroy_bitmap(surface->handle_);
+                surface->destroy_buffers(cmd_builder);
             }
         }
 
@@ -95,7 +203,7 @@ namespace eka2l1::dispatch {
         auto ite = active_context_.find(thread_id);
         if ((ite != active_context_.end()) && ite->second && (ite->second != context_to_set)) {
             if (ite->second->draw_surface_ && ite->second->draw_surface_->dead_pending_) {
-                ite->second->cmd_builder_.destroy_bitmap(ite->second->draw_surface_->handle_);
+                ite->second->draw_surface_->destroy_buffers(ite->second->cmd_builder_);
 
                 for (auto &var: dsurfaces_) {
                     if (var.get() == ite->second->draw_surface_) {
@@ -106,7 +214,7 @@ namespace eka2l1::dispatch {
             }
 
             if ((ite->second->draw_surface_ != ite->second->read_surface_) && ite->second->read_surface_ && ite->second->read_surface_->dead_pending_) {
-                ite->second->cmd_builder_.destroy_bitmap(ite->second->read_surface_->handle_);
+                ite->second->read_surface_->destroy_buffers(ite->second->cmd_builder_);
 
                 for (auto &var: dsurfaces_) {
                     if (var.get() == ite->second->read_surface_) {
@@ -191,8 +299,8 @@ namespace eka2l1::dispatch {
         if (inst && inst->get()) {
             bool can_del_imm = true;
 
-            for (auto ite = active_context_.begin(); ite != active_context_.end(); ) {
-                if ((ite->second->draw_surface_ == inst->get()) || (ite->second->read_surface_ == inst->get())) {
+            for (auto ite = active_context_.begin(); ite != active_context_.end(); ite++) {
+                if (ite->second && ((ite->second->draw_surface_ == inst->get()) || (ite->second->read_surface_ == inst->get()))) {
                     inst->get()->dead_pending_ = true;
                     can_del_imm = false;
 
@@ -201,10 +309,10 @@ namespace eka2l1::dispatch {
             }
 
             if (can_del_imm) {
-                if ((*inst)->handle_) {
-                    drivers::graphics_command_builder builder;
-                    builder.destroy_bitmap((*inst)->handle_);
+                drivers::graphics_command_builder builder;
+                (*inst)->destroy_buffers(builder);
 
+                if (!builder.is_empty()) {
                     drivers::command_list retrieved = builder.retrieve_command_list();
                     driver_->submit_command_list(retrieved);
                 }
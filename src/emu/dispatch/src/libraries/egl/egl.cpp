@@ -345,9 +345,16 @@ namespace eka2l1::dispatch {
         egl_context_instance context_inst = nullptr;
 
         switch (choosen_config.get_target_context_version()) {
-        case egl_config::EGL_TARGET_CONTEXT_ES11:
+        case egl_config::EGL_TARGET_CONTEXT_ES11: {
             context_inst = std::make_unique<egl_context_es1>();
+
+            // Warm the generated shaders this game used before, while it is still loading
+            kernel::process *crr_process = sys->get_kernel_system()->crr_process();
+            sys->get_dispatcher()->get_egl_controller().get_es1_shaderman().load_persistent_cache(
+                fmt::format("cache/shaders/gles1_{:08X}.bin", crr_process->get_uid()));
+
             break;
+        }
 
         default:
             LOG_ERROR(HLE_DISPATCHER, "Context other than ES 1.1 is not yet supported!");
@@ -391,7 +398,7 @@ namespace eka2l1::dispatch {
                     context_real->read_surface_->bounded_context_ = nullptr;
 
                     if (context_real->read_surface_->dead_pending_) {
-                        context_real->cmd_builder_.destroy_bitmap(context_real->read_surface_->handle_);
+                        context_real->read_surface_->destroy_buffers(context_real->cmd_builder_);
                         controller.remove_managed_surface_from_management(context_real->read_surface_);
                     }
                 }
@@ -401,7 +408,7 @@ namespace eka2l1::dispatch {
                 if (context_real->draw_surface_) {
                     context_real->draw_surface_->bounded_context_ = nullptr;
                     if ((context_real->read_surface_ != context_real->draw_surface_) && (context_real->draw_surface_->dead_pending_))
-                        context_real->cmd_builder_.destroy_bitmap(context_real->draw_surface_->handle_);
+                        context_real->draw_surface_->destroy_buffers(context_real->cmd_builder_);
                         controller.remove_managed_surface_from_management(context_real->draw_surface_);
                 }
             }
@@ -452,23 +459,15 @@ namespace eka2l1::dispatch {
         }
 
         drivers::graphics_driver *drv = sys->get_graphics_driver();
+        std::size_t swapped_slot = EGL_SURFACE_PRESENT_RING_SIZE;
+
+        surface->begin_swap();
 
         if (surface->backed_window_) {
             egl_context *ctx = surface->bounded_context_;
-            if (surface->current_scale_ != surface->backed_screen_->display_scale_factor) {
+            if (ctx && (surface->current_scale_ != surface->backed_screen_->display_scale_factor)) {
                 // Silently resize and scale
-                float new_display_factor = surface->backed_screen_->display_scale_factor;
-                eka2l1::vec2 new_scaled_size = surface->dimension_ * new_display_factor;
-
-                drivers::handle new_surface = drivers::create_bitmap(drv, new_scaled_size, 32);
-
-                ctx->cmd_builder_.bind_bitmap(new_surface);
-                ctx->cmd_builder_.draw_bitmap(surface->handle_, 0, eka2l1::rect(eka2l1::vec2(0, 0), new_scaled_size),
-                    eka2l1::rect(eka2l1::vec2(0, 0), eka2l1::vec2(0, 0)));
-                ctx->cmd_builder_.destroy_bitmap(surface->handle_);
-
-                surface->handle_ = new_surface;
-                surface->current_scale_ = surface->backed_screen_->display_scale_factor;
+                surface->rescale_buffers(drv, ctx->cmd_builder_, surface->backed_screen_->display_scale_factor);
             }
 
             if (ctx && surface->backed_window_->can_be_physically_seen()) {
@@ -484,6 +483,12 @@ namespace eka2l1::dispatch {
 
                 surface->backed_window_->content_changed(true);
             }
+
+            // The window now owns the swapped buffer until it is composited, render the next frame elsewhere.
+            // The flush below still targets the swapped buffer, the new one is bound for the commands after it.
+            if (ctx) {
+                swapped_slot = surface->rotate_present_buffer(drv);
+            }
         }
 
         if (surface->bounded_context_) {
@@ -491,7 +496,10 @@ namespace eka2l1::dispatch {
         }
 
         if (surface->backed_window_)
-            surface->backed_window_->try_update(sys->get_kernel_system()->crr_thread());
+            surface->backed_window_->try_update_gpu_content(sys->get_kernel_system()->crr_thread());
+
+        // The composite of the swapped buffer is submitted now, only then is the buffer free to render to again
+        surface->frame_flushed(drv, swapped_slot);
 
         return EGL_TRUE;
     }
@@ -20,14 +20,22 @@
 #include <dispatch/libraries/gles1/gles1.h>
 #include <dispatch/libraries/gles1/def.h>
 
+#include <common/gather.h>
+#include <common/thread_pool.h>
 #include <dispatch/dispatcher.h>
 #include <drivers/graphics/graphics.h>
+#include <drivers/graphics/texture_decode.h>
 #include <services/window/screen.h>
 #include <system/epoc.h>
 #include <kernel/kernel.h>
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
 namespace eka2l1::dispatch {    
     std::string get_es1_extensions(drivers::graphics_driver *driver) {
         std::string original_list = GLES1_STATIC_STRING_EXTENSIONS;
@@ -96,30 +104,22 @@ namespace eka2l1::dispatch {
             palette_bits = 4;
         }
 
+        // Levels follow each other right after the palette, each starting on a new byte
+        const std::uint8_t *palette = source;
+        const std::uint8_t *level_indices = source + (1 << palette_bits) * bytes_per_pixel;
+
         while ((mip_count > 0) && (height > 0) && (width > 0)) {
             const std::size_t prev_size = dest.size();
-            const std::size_t calculated_size = width * height * bytes_per_pixel;
+            const std::size_t texel_count = static_cast<std::size_t>(width) * height;
+            const std::size_t calculated_size = texel_count * bytes_per_pixel;
 
             out_size.push_back(calculated_size);
             dest.resize(dest.size() + calculated_size);
-            
-            std::uint8_t *current_dest = dest.data() + prev_size;
-
-            std::uint8_t *source_start = source + (1 << palette_bits) * bytes_per_pixel;
-            for (std::int32_t y = 0; y < height; y++) {
-                for (std::int32_t x = 0; x < width / (8 / palette_bits); x++) {
-                    const std::int32_t current_pixel_idx = y * width + x;
-                    const std::int32_t current_ptr_pixel_idx = current_pixel_idx * bytes_per_pixel;
-                    const std::uint8_t indicies = source_start[current_pixel_idx];
-
-                    if (palette_bits == 8) {
-                        std::memcpy(current_dest + current_ptr_pixel_idx, source + indicies * bytes_per_pixel, bytes_per_pixel);
-                    } else {
-                        std::memcpy(current_dest + current_ptr_pixel_idx * 2, source + (indicies & 0xF) * bytes_per_pixel, bytes_per_pixel);
-                        std::memcpy(current_dest + current_ptr_pixel_idx * 2 + bytes_per_pixel, source + ((indicies & 0xF0) >> 4) * bytes_per_pixel, bytes_per_pixel);
-                    }
-                }
-            }
+
+            drivers::decode_paletted_texture(dest.data() + prev_size, level_indices, palette, palette_bits, bytes_per_pixel,
+                texel_count, &common::get_shared_thread_pool());
+
+            level_indices += (palette_bits == 8) ? texel_count : ((texel_count + 1) / 2);
 
             mip_count--;
             width /= 2;
@@ -316,60 +316,65 @@ namespace eka2l1::dispatch {
         current_buffer_ = 0;
     }
 
-    std::uint32_t get_gl_attrib_stride(const gles1_vertex_attrib &attrib) {
-        std::uint32_t stride = attrib.stride_;
-        if (!stride) {
-            switch (attrib.data_type_) {
-            case GL_BYTE_EMU:
-            case GL_UNSIGNED_BYTE_EMU:
-                stride = 1;
-                break;
+    std::uint32_t get_gl_data_type_size(const std::uint32_t data_type) {
+        switch (data_type) {
+        case GL_BYTE_EMU:
+        case GL_UNSIGNED_BYTE_EMU:
+            return 1;
 
-            case GL_SHORT_EMU:
-            case GL_UNSIGNED_SHORT_EMU:
-                stride = 2;
-                break;
+        case GL_SHORT_EMU:
+        case GL_UNSIGNED_SHORT_EMU:
+            return 2;
 
-            case GL_FLOAT_EMU:
-                stride = 4;
-                break;
+        case GL_FLOAT_EMU:
+        case GL_FIXED_EMU:
+            return 4;
 
-            case GL_FIXED_EMU:
-                stride = 4;
-                break;
+        default:
+            break;
+        }
 
-            default:
-                return 0;
-            }
+        return 0;
+    }
 
-            stride *= attrib.size_;
+    std::uint32_t get_gl_attrib_stride(const gles1_vertex_attrib &attrib) {
+        if (attrib.stride_) {
+            return attrib.stride_;
         }
 
-        return stride;
+        return get_gl_data_type_size(attrib.data_type_) * attrib.size_;
     }
-    
-    drivers::handle gles1_buffer_pusher::push_buffer(const std::uint8_t *data, const gles1_vertex_attrib &attrib, const std::int32_t first_index, const std::size_t vert_count, std::size_t &buffer_offset) {
-        std::uint32_t stride = get_gl_attrib_stride(attrib);
-        std::size_t total_buffer_size = stride * vert_count;
 
-        return push_buffer(data + first_index * stride, total_buffer_size, buffer_offset);
-    }
+    std::uint8_t *gles1_buffer_pusher::reserve(const std::size_t size, const std::size_t alignment, std::size_t &buffer_offset, drivers::handle &buffer) {
+        if (current_buffer_ == MAX_BUFFER_SLOT) {
+            return nullptr;
+        }
+
+        auto align_used_size = [&]() {
+            return ((used_size_[current_buffer_] + alignment - 1) / alignment) * alignment;
+        };
+
+        std::size_t aligned_offset = align_used_size();
 
-    drivers::handle gles1_buffer_pusher::push_buffer(const std::uint8_t *data_source, const std::size_t total_buffer_size, std::size_t &buffer_offset) {
-        if (used_size_[current_buffer_] + total_buffer_size > size_per_buffer_) {
+        if (aligned_offset + size > size_per_buffer_) {
             current_buffer_++;
-        }
 
-        if (current_buffer_ == MAX_BUFFER_SLOT) {
-            // No more slots, require flushing
-            return 0;
+            if (current_buffer_ == MAX_BUFFER_SLOT) {
+                return nullptr;
+            }
+
+            aligned_offset = align_used_size();
+
+            if (aligned_offset + size > size_per_buffer_) {
+                return nullptr;
+            }
         }
 
-        buffer_offset = used_size_[current_buffer_];
-        std::memcpy(data_[current_buffer_] + buffer_offset, data_source, total_buffer_size);
+        buffer_offset = aligned_offset;
+        buffer = buffers_[current_buffer_];
 
-        used_size_[current_buffer_] += (((total_buffer_size + 3) / 4) * 4);
-        return buffers_[current_buffer_];
+        used_size_[current_buffer_] = aligned_offset + size;
+        return data_[current_buffer_] + aligned_offset;
     }
 
     gles_texture_unit::gles_texture_unit()
@@ -466,12 +471,15 @@ namespace eka2l1::dispatch {
         , stencil_depth_pass_action_(GL_KEEP_EMU)
         , alpha_test_ref_(0)
         , input_desc_(0)
+        , input_desc_cache_tick_(0)
         , polygon_offset_factor_(0.0f)
         , polygon_offset_units_(0.0f)
         , pack_alignment_(4)
         , unpack_alignment_(4)
         , depth_range_min_(0.0f)
-        , depth_range_max_(1.0f) {
+        , depth_range_max_(1.0f)
+        , vertex_cache_buffer_bytes_(0)
+        , frame_index_(0) {
         clear_color_[0] = 0.0f;
         clear_color_[1] = 0.0f;
         clear_color_[2] = 0.0f;
@@ -540,13 +548,27 @@ namespace eka2l1::dispatch {
     }
 
     void egl_context_es1::destroy(drivers::graphics_driver *driver, drivers::graphics_command_builder &builder) {
-        if (input_desc_) {
-            cmd_builder_.destroy(input_desc_);
+        for (gles1_input_descriptors_cache_entry &entry: input_desc_cache_) {
+            if (entry.handle_) {
+                cmd_builder_.destroy(entry.handle_);
+                entry.handle_ = 0;
+            }
         }
 
+        input_desc_ = 0;
+
         vertex_buffer_pusher_.destroy(builder);
         index_buffer_pusher_.destroy(builder);
 
+        for (auto &[key, entry]: vertex_cache_) {
+            if (entry.buffer_) {
+                builder.destroy(entry.buffer_);
+            }
+        }
+
+        vertex_cache_.clear();
+        vertex_cache_buffer_bytes_ = 0;
+
         for (auto &obj: objects_) {
             if (obj) {
                 obj.reset();
@@ -587,6 +609,11 @@ namespace eka2l1::dispatch {
         if (is_frame_swap_flush) {
             vertex_buffer_pusher_.done_frame();
             index_buffer_pusher_.done_frame();
+
+            last_frame_upload_stats_ = upload_stats_;
+            upload_stats_ = gles1_upload_stats();
+
+            frame_index_++;
         }
     }
 
@@ -4254,146 +4281,419 @@ namespace eka2l1::dispatch {
         return true;
     }
 
-    static void prepare_vertex_buffer_and_descriptors(egl_context_es1 *ctx, drivers::graphics_driver *drv, kernel::process *crr_process, const std::int32_t first_index, const std::uint32_t vcount, const std::uint32_t active_texs) {
-        if (ctx->attrib_changed_ || (ctx->previous_first_index_ != first_index)) {
-            std::vector<drivers::handle> vertex_buffers_alloc;
-            bool can_turn_off_change = true;
+    struct gles1_draw_attrib {
+        const gles1_vertex_attrib *attrib_;
+        std::int32_t location_;
+        bool normalized_;
+    };
 
-            auto retrieve_vertex_buffer_slot = [&](gles1_vertex_attrib attrib, std::uint32_t &res, int &offset) -> bool {
-                drivers::handle buffer_handle_drv = 0;
-                if (attrib.buffer_obj_ == 0) {
-                    std::uint8_t *data_raw = eka2l1::ptr<std::uint8_t>(attrib.offset_).get(crr_process);
-                    if (!data_raw) {
-                        LOG_ERROR(HLE_DISPATCHER, "Unable to retrieve raw pointer of non-buffer binded attribute!");
-                        return false;
-                    }
+    static common::gather_convert get_client_attrib_convert(const gles1_vertex_attrib &attrib, const bool normalized) {
+        switch (attrib.data_type_) {
+        case GL_FIXED_EMU:
+            return common::gather_convert_fixed_to_float;
 
-                    if (!ctx->vertex_buffer_pusher_.is_initialized()) {
-                        ctx->vertex_buffer_pusher_.initialize(drv, common::MB(4));
-                    }
+        // Signed normalisation rule differs between GLES hosts and desktop GL, so do it here
+        // to get the same result everywhere. Unsigned types are the same on all hosts.
+        case GL_BYTE_EMU:
+            return normalized ? common::gather_convert_byte_norm : common::gather_convert_copy;
 
-                    std::size_t offset_big = 0;
-                    buffer_handle_drv = ctx->vertex_buffer_pusher_.push_buffer(data_raw, attrib, first_index, vcount, offset_big);
+        case GL_SHORT_EMU:
+            return normalized ? common::gather_convert_short_norm : common::gather_convert_copy;
 
-                    offset = static_cast<int>(offset_big);
+        default:
+            break;
+        }
 
-                    if (buffer_handle_drv == 0) {
-                        // Buffers are full, need flushing all
-                        ctx->flush_to_driver(drv);
-                        buffer_handle_drv = ctx->vertex_buffer_pusher_.push_buffer(data_raw, attrib, first_index, vcount, offset_big);
-                    }
+        return common::gather_convert_copy;
+    }
 
-                    if (can_turn_off_change) {
-                        can_turn_off_change = false;
-                    }
-                } else {
-                    offset = static_cast<int>(attrib.offset_);
-                    if (first_index) {
-                        offset += first_index * get_gl_attrib_stride(attrib);
-                    }
-                    auto *buffer_inst_ptr = ctx->objects_.get(attrib.buffer_obj_);
-                    if (!buffer_inst_ptr || ((*buffer_inst_ptr)->object_type() != GLES1_OBJECT_BUFFER)) {
-                        return false;
-                    }
+    static std::uint64_t hash_input_descriptors(const drivers::input_descriptor *descs, const std::uint32_t count) {
+        // FNV-1a
+        const std::uint8_t *data = reinterpret_cast<const std::uint8_t *>(descs);
+        std::uint64_t hash = 0xCBF29CE484222325ULL;
 
-                    gles1_driver_buffer *buffer = reinterpret_cast<gles1_driver_buffer*>((*buffer_inst_ptr).get());
-                    buffer_handle_drv = buffer->handle_value();
-                }
+        for (std::size_t i = 0; i < count * sizeof(drivers::input_descriptor); i++) {
+            hash = (hash ^ data[i]) * 0x100000001B3ULL;
+        }
 
-                auto ite = std::find(vertex_buffers_alloc.begin(), vertex_buffers_alloc.end(), buffer_handle_drv);
-                if (ite != vertex_buffers_alloc.end()) {
-                    res = static_cast<std::uint32_t>(std::distance(vertex_buffers_alloc.begin(), ite));
-                    return true;
-                }
+        return hash;
+    }
 
-                vertex_buffers_alloc.push_back(buffer_handle_drv);
-                res = static_cast<std::uint32_t>(vertex_buffers_alloc.size() - 1);
+    static drivers::handle get_cached_input_descriptors(egl_context_es1 *ctx, drivers::graphics_driver *drv, drivers::input_descriptor *descs, const std::uint32_t count) {
+        const std::uint64_t hash = hash_input_descriptors(descs, count);
+        gles1_input_descriptors_cache_entry *victim = nullptr;
 
-                return true;
-            };
+        ctx->input_desc_cache_tick_++;
 
-            // Remade and attach descriptors
-            std::vector<drivers::input_descriptor> descs;
-            drivers::data_format temp_format;
+        for (gles1_input_descriptors_cache_entry &entry: ctx->input_desc_cache_) {
+            if (entry.handle_ && (entry.hash_ == hash) && (entry.count_ == count) && (std::memcmp(entry.descs_, descs, count * sizeof(drivers::input_descriptor)) == 0)) {
+                entry.last_use_ = ctx->input_desc_cache_tick_;
+                return entry.handle_;
+            }
 
-            drivers::input_descriptor temp_desc;
-            if (!retrieve_vertex_buffer_slot(ctx->vertex_attrib_, temp_desc.buffer_slot, temp_desc.offset)) {
-                LOG_WARN(HLE_DISPATCHER, "Vertex attribute not bound to a valid buffer, draw call skipping!");
-                return;
+            if (!victim || (victim->handle_ && (!entry.handle_ || (entry.last_use_ < victim->last_use_)))) {
+                victim = &entry;
+            }
+        }
+
+        if (!victim->handle_) {
+            victim->handle_ = drivers::create_input_descriptors(drv, descs, count);
+        } else {
+            ctx->cmd_builder_.update_input_descriptors(victim->handle_, descs, count);
+        }
+
+        victim->hash_ = hash;
+        victim->count_ = count;
+        victim->last_use_ = ctx->input_desc_cache_tick_;
+
+        std::memcpy(victim->descs_, descs, count * sizeof(drivers::input_descriptor));
+        return victim->handle_;
+    }
+
+    static void destroy_vertex_cache_buffer(egl_context_es1 *ctx, gles1_vertex_cache_entry &entry) {
+        if (entry.buffer_) {
+            ctx->cmd_builder_.destroy(entry.buffer_);
+            ctx->vertex_cache_buffer_bytes_ -= entry.size_;
+
+            entry.buffer_ = 0;
+        }
+    }
+
+    // Free the least recently used entry other than the given key. Only entries with a buffer are
+    // considered if buffer_only is true.
+    static bool evict_vertex_cache_entry(egl_context_es1 *ctx, const std::uint64_t keep_key, const bool buffer_only) {
+        auto victim = ctx->vertex_cache_.end();
+
+        for (auto ite = ctx->vertex_cache_.begin(); ite != ctx->vertex_cache_.end(); ite++) {
+            if ((ite->first == keep_key) || (buffer_only && !ite->second.buffer_)) {
+                continue;
+            }
+
+            if ((victim == ctx->vertex_cache_.end()) || (ite->second.last_use_frame_ < victim->second.last_use_frame_)) {
+                victim = ite;
+            }
+        }
+
+        if (victim == ctx->vertex_cache_.end()) {
+            return false;
+        }
+
+        destroy_vertex_cache_buffer(ctx, victim->second);
+
+        if (!buffer_only) {
+            ctx->vertex_cache_.erase(victim);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Look for a buffer already holding this client stream.
+     * 
+     * The stream is keyed by its source addresses, strides and formats, and checked against a hash of
+     * the source bytes, so a game rewriting its arrays in place is still seen. A buffer is only created
+     * once the same content has been drawn GLES1_EMU_VERTEX_CACHE_PROMOTE_COUNT times in a row.
+     * 
+     * @return Handle of the buffer holding the gathered stream at offset 0, or 0 if it must be pushed.
+     */
+    static drivers::handle get_cached_client_stream(egl_context_es1 *ctx, drivers::graphics_driver *drv, const common::gather_source *sources,
+        const std::uint32_t source_count, const std::uint32_t stride, const std::uint32_t vcount) {
+        const std::size_t stream_size = static_cast<std::size_t>(stride) * vcount;
+
+        if ((vcount == 0) || (stream_size < GLES1_EMU_VERTEX_CACHE_MIN_STREAM_SIZE) || (stream_size > GLES1_EMU_VERTEX_CACHE_BUDGET)) {
+            return 0;
+        }
+
+        std::uint64_t key_data[GLES1_EMU_MAX_VERTEX_ATTRIB * 3 + 1];
+        std::uint32_t key_count = 0;
+
+        struct source_range {
+            const std::uint8_t *start_;
+            const std::uint8_t *end_;
+        } ranges[GLES1_EMU_MAX_VERTEX_ATTRIB];
+
+        for (std::uint32_t i = 0; i < source_count; i++) {
+            key_data[key_count++] = reinterpret_cast<std::uint64_t>(sources[i].data_);
+            key_data[key_count++] = (static_cast<std::uint64_t>(sources[i].stride_) << 32) | sources[i].dest_offset_;
+            key_data[key_count++] = sources[i].component_count_ | (sources[i].component_size_ << 8) | (static_cast<std::uint32_t>(sources[i].convert_) << 16);
+
+            ranges[i].start_ = sources[i].data_;
+            ranges[i].end_ = sources[i].data_ + static_cast<std::size_t>(vcount - 1) * sources[i].stride_
+                + sources[i].component_count_ * sources[i].component_size_;
+        }
+
+        key_data[key_count++] = vcount;
+
+        const std::uint64_t key = XXH64(key_data, key_count * sizeof(std::uint64_t), 0);
+
+        // Interleaved arrays overlap, merge them so every byte is hashed once
+        std::sort(ranges, ranges + source_count, [](const source_range &lhs, const source_range &rhs) {
+            return lhs.start_ < rhs.start_;
+        });
+
+        std::uint64_t content_hash = 0;
+        const std::uint8_t *range_start = ranges[0].start_;
+        const std::uint8_t *range_end = ranges[0].end_;
+
+        for (std::uint32_t i = 1; i <= source_count; i++) {
+            if ((i < source_count) && (ranges[i].start_ <= range_end)) {
+                range_end = std::max(range_end, ranges[i].end_);
+                continue;
             }
 
-            temp_desc.location = 0;
-            temp_desc.stride = ctx->vertex_attrib_.stride_;
+            content_hash = XXH64(range_start, range_end - range_start, content_hash);
 
-            gl_enum_to_drivers_data_format(ctx->vertex_attrib_.data_type_, temp_format);
-            temp_desc.set_format(ctx->vertex_attrib_.size_, temp_format);
+            if (i < source_count) {
+                range_start = ranges[i].start_;
+                range_end = ranges[i].end_;
+            }
+        }
+
+        auto ite = ctx->vertex_cache_.find(key);
 
-            if (ctx->vertex_attrib_.data_type_ == GL_FIXED_EMU) {
-                temp_desc.set_normalized(true);
+        if (ite == ctx->vertex_cache_.end()) {
+            if (ctx->vertex_cache_.size() >= GLES1_EMU_VERTEX_CACHE_MAX_ENTRY) {
+                evict_vertex_cache_entry(ctx, key, false);
             }
 
-            descs.push_back(temp_desc);
+            ite = ctx->vertex_cache_.emplace(key, gles1_vertex_cache_entry()).first;
+        }
 
-            if (ctx->vertex_statuses_ & egl_context_es1::VERTEX_STATE_CLIENT_COLOR_ARRAY) {
-                if (retrieve_vertex_buffer_slot(ctx->color_attrib_, temp_desc.buffer_slot, temp_desc.offset)) {
-                    temp_desc.location = 1;
-                    temp_desc.stride = ctx->color_attrib_.stride_;
-                    temp_desc.set_normalized(true);
+        gles1_vertex_cache_entry &entry = ite->second;
+        entry.last_use_frame_ = ctx->frame_index_;
 
-                    gl_enum_to_drivers_data_format(ctx->color_attrib_.data_type_, temp_format);
-                    temp_desc.set_format(ctx->color_attrib_.size_, temp_format);
+        if ((entry.seen_count_ == 0) || (entry.content_hash_ != content_hash) || (entry.size_ != stream_size)) {
+            // New or changed content. Dynamic data keeps going through the pusher.
+            destroy_vertex_cache_buffer(ctx, entry);
+
+            entry.content_hash_ = content_hash;
+            entry.size_ = static_cast<std::uint32_t>(stream_size);
+            entry.seen_count_ = 1;
+
+            return 0;
+        }
+
+        if (entry.buffer_) {
+            ctx->upload_stats_.cached_vertex_bytes_ += stream_size;
+            return entry.buffer_;
+        }
 
-                    descs.push_back(temp_desc);
+        if (++entry.seen_count_ < GLES1_EMU_VERTEX_CACHE_PROMOTE_COUNT) {
+            return 0;
+        }
+
+        while (ctx->vertex_cache_buffer_bytes_ + stream_size > GLES1_EMU_VERTEX_CACHE_BUDGET) {
+            if (!evict_vertex_cache_entry(ctx, key, true)) {
+                return 0;
+            }
+        }
+
+        ctx->vertex_cache_scratch_.resize(stream_size);
+        common::gather_vertices(ctx->vertex_cache_scratch_.data(), stride, sources, source_count, vcount);
+
+        entry.buffer_ = drivers::create_buffer(drv, ctx->vertex_cache_scratch_.data(), stream_size,
+            static_cast<drivers::buffer_upload_hint>(drivers::buffer_upload_static | drivers::buffer_upload_draw));
+
+        if (!entry.buffer_) {
+            return 0;
+        }
+
+        ctx->vertex_cache_buffer_bytes_ += stream_size;
+        ctx->upload_stats_.cache_fill_bytes_ += stream_size;
+
+        return entry.buffer_;
+    }
+
+    /**
+     * @brief Upload client arrays and bind the vertex buffers and input descriptors for a draw.
+     * 
+     * All client arrays are gathered into one interleaved stream, with fixed point and signed normalized
+     * data converted to float. When nothing comes from a buffer object and the caller allows it, the
+     * stream is placed at a multiple of its stride, and its position is returned as a base vertex instead
+     * of being baked into the descriptors, so the same descriptors are reused draw after draw.
+     * 
+     * @param can_use_base_vertex   True if the draw can start at a vertex other than zero.
+     * @param vertex_base           The first vertex the draw should use.
+     * 
+     * @return False if the draw should be skipped.
+     */
+    static bool prepare_vertex_buffer_and_descriptors(egl_context_es1 *ctx, drivers::graphics_driver *drv, kernel::process *crr_process, const std::int32_t first_index,
+        const std::uint32_t vcount, const std::uint32_t active_texs, const bool can_use_base_vertex, std::int32_t &vertex_base) {
+        vertex_base = 0;
+
+        if (!ctx->attrib_changed_ && (ctx->previous_first_index_ == first_index)) {
+            // Nothing is uploaded from client memory, so the previous bindings are still good
+            ctx->cmd_builder_.bind_input_descriptors(ctx->input_desc_);
+            return true;
+        }
+
+        gles1_draw_attrib attribs[GLES1_EMU_MAX_VERTEX_ATTRIB];
+        std::uint32_t attrib_count = 0;
+
+        attribs[attrib_count++] = { &ctx->vertex_attrib_, 0, ctx->vertex_attrib_.data_type_ == GL_FIXED_EMU };
+
+        if (ctx->vertex_statuses_ & egl_context_es1::VERTEX_STATE_CLIENT_COLOR_ARRAY) {
+            attribs[attrib_count++] = { &ctx->color_attrib_, 1, true };
+        }
+
+        if (ctx->vertex_statuses_ & egl_context_es1::VERTEX_STATE_CLIENT_NORMAL_ARRAY) {
+            attribs[attrib_count++] = { &ctx->normal_attrib_, 2, true };
+        }
+
+        if (active_texs) {
+            for (std::int32_t i = 0; i < GLES1_EMU_MAX_TEXTURE_COUNT; i++) {
+                if ((active_texs & (1 << i)) && (ctx->vertex_statuses_ & (1 << (egl_context_es1::VERTEX_STATE_CLIENT_TEXCOORD_ARRAY_POS + static_cast<std::uint8_t>(i))))) {
+                    attribs[attrib_count++] = { &ctx->texture_units_[i].coord_attrib_, 3 + i, false };
                 }
             }
+        }
 
-            temp_desc.set_normalized(false);
+        drivers::input_descriptor descs[GLES1_EMU_MAX_VERTEX_ATTRIB];
+        common::gather_source client_sources[GLES1_EMU_MAX_VERTEX_ATTRIB];
+        std::uint32_t client_desc_indices[GLES1_EMU_MAX_VERTEX_ATTRIB];
 
-            if (ctx->vertex_statuses_ & egl_context_es1::VERTEX_STATE_CLIENT_NORMAL_ARRAY) {
-                if (retrieve_vertex_buffer_slot(ctx->normal_attrib_, temp_desc.buffer_slot, temp_desc.offset)) {
-                    temp_desc.location = 2;
-                    temp_desc.stride = ctx->normal_attrib_.stride_;
+        drivers::handle vertex_buffers[GLES1_EMU_MAX_VERTEX_ATTRIB + 1];
+
+        std::uint32_t desc_count = 0;
+        std::uint32_t client_count = 0;
+        std::uint32_t vertex_buffer_count = 0;
+        std::uint32_t client_stride = 0;
+
+        auto get_vertex_buffer_slot = [&](const drivers::handle buffer_handle) -> std::uint32_t {
+            drivers::handle *ite = std::find(vertex_buffers, vertex_buffers + vertex_buffer_count, buffer_handle);
+            if (ite == vertex_buffers + vertex_buffer_count) {
+                vertex_buffers[vertex_buffer_count++] = buffer_handle;
+            }
 
-                    gl_enum_to_drivers_data_format(ctx->normal_attrib_.data_type_, temp_format);
-                    temp_desc.set_format(ctx->normal_attrib_.size_, temp_format);
-                    temp_desc.set_normalized(true);
+            return static_cast<std::uint32_t>(ite - vertex_buffers);
+        };
 
-                    descs.push_back(temp_desc);
+        for (std::uint32_t i = 0; i < attrib_count; i++) {
+            const gles1_vertex_attrib &attrib = *attribs[i].attrib_;
+            drivers::input_descriptor &desc = descs[desc_count];
+
+            std::memset(&desc, 0, sizeof(drivers::input_descriptor));
+
+            drivers::data_format temp_format = drivers::data_format::sfloat;
+            gl_enum_to_drivers_data_format(attrib.data_type_, temp_format);
+
+            desc.location = attribs[i].location_;
+            desc.set_format(attrib.size_, temp_format);
+            desc.set_normalized(attribs[i].normalized_);
+
+            if (attrib.buffer_obj_ == 0) {
+                const std::uint32_t stride = get_gl_attrib_stride(attrib);
+                const std::uint8_t *data_raw = eka2l1::ptr<std::uint8_t>(attrib.offset_).get(crr_process);
+
+                if (!data_raw) {
+                    LOG_ERROR(HLE_DISPATCHER, "Unable to retrieve raw pointer of non-buffer binded attribute!");
+
+                    if (i == 0) {
+                        LOG_WARN(HLE_DISPATCHER, "Vertex attribute not bound to a valid buffer, draw call skipping!");
+                        return false;
+                    }
+
+                    continue;
+                }
+
+                common::gather_source &source = client_sources[client_count];
+
+                source.data_ = data_raw + first_index * stride;
+                source.stride_ = stride;
+                source.component_count_ = static_cast<std::uint32_t>(attrib.size_);
+                source.component_size_ = get_gl_data_type_size(attrib.data_type_);
+                source.convert_ = get_client_attrib_convert(attrib, attribs[i].normalized_);
+                source.dest_offset_ = client_stride;
+
+                if (source.convert_ != common::gather_convert_copy) {
+                    desc.set_format(attrib.size_, drivers::data_format::sfloat);
+                    desc.set_normalized(false);
                 }
+
+                // Offset and stride are filled once the stream is placed
+                client_stride += common::gather_dest_size(source);
+                client_desc_indices[client_count++] = desc_count;
+            } else {
+                auto *buffer_inst_ptr = ctx->objects_.get(attrib.buffer_obj_);
+                if (!buffer_inst_ptr || ((*buffer_inst_ptr)->object_type() != GLES1_OBJECT_BUFFER)) {
+                    if (i == 0) {
+                        LOG_WARN(HLE_DISPATCHER, "Vertex attribute not bound to a valid buffer, draw call skipping!");
+                        return false;
+                    }
+
+                    continue;
+                }
+
+                gles1_driver_buffer *buffer = reinterpret_cast<gles1_driver_buffer*>((*buffer_inst_ptr).get());
+
+                desc.offset = static_cast<int>(attrib.offset_ + first_index * get_gl_attrib_stride(attrib));
+                desc.stride = attrib.stride_;
+                desc.buffer_slot = get_vertex_buffer_slot(buffer->handle_value());
+            }
+
+            desc_count++;
+        }
+
+        if (client_count != 0) {
+            // Base vertex only works if every attribute comes from the stream
+            const bool use_base_vertex = can_use_base_vertex && (vertex_buffer_count == 0);
+
+            if (!ctx->vertex_buffer_pusher_.is_initialized()) {
+                ctx->vertex_buffer_pusher_.initialize(drv, common::MB(4));
             }
 
-            temp_desc.set_normalized(false);
+            const std::size_t stream_size = static_cast<std::size_t>(client_stride) * vcount;
+            const std::size_t stream_alignment = use_base_vertex ? client_stride : 4;
+
+            std::size_t stream_offset = 0;
+            drivers::handle stream_buffer = get_cached_client_stream(ctx, drv, client_sources, client_count, client_stride, vcount);
 
-            if (active_texs) {
-                for (std::int32_t i = 0; i < GLES1_EMU_MAX_TEXTURE_COUNT; i++) {
-                    if ((active_texs & (1 << i)) && (ctx->vertex_statuses_ & (1 << (egl_context_es1::VERTEX_STATE_CLIENT_TEXCOORD_ARRAY_POS + static_cast<std::uint8_t>(i))))
-                        && retrieve_vertex_buffer_slot(ctx->texture_units_[i].coord_attrib_, temp_desc.buffer_slot, temp_desc.offset)) {
-                        temp_desc.location = 3 + i;
-                        temp_desc.stride = ctx->texture_units_[i].coord_attrib_.stride_;
+            if (!stream_buffer) {
+                std::uint8_t *stream = ctx->vertex_buffer_pusher_.reserve(stream_size, stream_alignment, stream_offset, stream_buffer);
 
-                        gl_enum_to_drivers_data_format(ctx->texture_units_[i].coord_attrib_.data_type_, temp_format);
-                        temp_desc.set_format(ctx->texture_units_[i].coord_attrib_.size_, temp_format);
+                if (!stream) {
+                    // Buffers are full, need flushing all
+                    ctx->flush_to_driver(drv);
+                    stream = ctx->vertex_buffer_pusher_.reserve(stream_size, stream_alignment, stream_offset, stream_buffer);
 
-                        descs.push_back(temp_desc);
+                    if (!stream) {
+                        LOG_ERROR(HLE_DISPATCHER, "Client vertex data of size {} is too large to upload, draw call skipping!", stream_size);
+                        return false;
                     }
                 }
+
+                common::gather_vertices(stream, client_stride, client_sources, client_count, vcount);
+                ctx->upload_stats_.vertex_bytes_ += stream_size;
             }
 
-            if (!ctx->input_desc_) {
-                ctx->input_desc_ = drivers::create_input_descriptors(drv, descs.data(), static_cast<std::uint32_t>(descs.size()));
-            } else {
-                ctx->cmd_builder_.update_input_descriptors(ctx->input_desc_, descs.data(), static_cast<std::uint32_t>(descs.size()));
+            const std::uint32_t stream_slot = get_vertex_buffer_slot(stream_buffer);
+            const int base_offset = use_base_vertex ? 0 : static_cast<int>(stream_offset);
+
+            if (use_base_vertex) {
+                vertex_base = static_cast<std::int32_t>(stream_offset / client_stride);
             }
 
-            ctx->cmd_builder_.set_vertex_buffers(vertex_buffers_alloc.data(), 0, static_cast<std::uint32_t>(vertex_buffers_alloc.size()));
+            for (std::uint32_t i = 0; i < client_count; i++) {
+                drivers::input_descriptor &desc = descs[client_desc_indices[i]];
 
-            if (can_turn_off_change)
-                ctx->attrib_changed_ = false;
+                desc.offset = base_offset + static_cast<int>(client_sources[i].dest_offset_);
+                desc.stride = static_cast<int>(client_stride);
+                desc.buffer_slot = stream_slot;
+            }
+        }
+
+        ctx->input_desc_ = get_cached_input_descriptors(ctx, drv, descs, desc_count);
+        ctx->cmd_builder_.set_vertex_buffers(vertex_buffers, 0, vertex_buffer_count);
 
-            ctx->previous_first_index_ = first_index;
+        // Client memory may change between draws, so it must be uploaded again next time
+        if (client_count == 0) {
+            ctx->attrib_changed_ = false;
         }
 
+        ctx->previous_first_index_ = first_index;
         ctx->cmd_builder_.bind_input_descriptors(ctx->input_desc_);
+
+        return true;
     }
 
     static std::uint32_t retrieve_active_textures_bitarr(egl_context_es1 *ctx) {
@@ -4411,14 +4711,21 @@ namespace eka2l1::dispatch {
         return arr;
     }
 
-    static bool prepare_gles1_draw(egl_context_es1 *ctx, drivers::graphics_driver *drv, kernel::process *crr_process, const std::int32_t first_index, const std::uint32_t vcount, dispatch::egl_controller &controller) {
+    static bool prepare_gles1_draw(egl_context_es1 *ctx, drivers::graphics_driver *drv, kernel::process *crr_process, const std::int32_t first_index, const std::uint32_t vcount,
+        dispatch::egl_controller &controller, const bool can_use_base_vertex, std::int32_t &vertex_base) {
+        vertex_base = 0;
+
         if ((ctx->vertex_statuses_ & egl_context_es1::VERTEX_STATE_CLIENT_VERTEX_ARRAY) == 0) {
             // No drawing needed?
             return true;
         }
 
         std::uint32_t active_textures_bitarr = retrieve_active_textures_bitarr(ctx);
-        prepare_vertex_buffer_and_descriptors(ctx, drv, crr_process, first_index, vcount, active_textures_bitarr);
+        if (!prepare_vertex_buffer_and_descriptors(ctx, drv, crr_process, first_index, vcount, active_textures_bitarr, can_use_base_vertex, vertex_base)) {
+            return false;
+        }
+
+        ctx->upload_stats_.draw_count_++;
 
         ctx->flush_state_changes();
 
@@ -4497,12 +4804,14 @@ namespace eka2l1::dispatch {
             return;
         }
 
-        if (!prepare_gles1_draw(ctx, drv, sys->get_kernel_system()->crr_process(), first_index, count, controller)) {
+        std::int32_t vertex_base = 0;
+
+        if (!prepare_gles1_draw(ctx, drv, sys->get_kernel_system()->crr_process(), first_index, count, controller, true, vertex_base)) {
             LOG_ERROR(HLE_DISPATCHER, "Error while preparing GLES1 draw. This should not happen!");
             return;
         }
 
-        ctx->cmd_builder_.draw_arrays(prim_mode_drv, 0, count, false);
+        ctx->cmd_builder_.draw_arrays(prim_mode_drv, vertex_base, count, false);
  
         if (ctx->cmd_builder_.need_flush()) {
             ctx->flush_to_driver(drv);
@@ -4532,17 +4841,17 @@ namespace eka2l1::dispatch {
         }
 
         drivers::data_format index_format_drv;
-        std::size_t size_ibuffer = 0;
+        std::uint32_t index_size = 1;
 
         switch (index_type) {
         case GL_UNSIGNED_BYTE_EMU:
             index_format_drv = drivers::data_format::byte;
-            size_ibuffer = static_cast<std::size_t>(count);
+            index_size = 1;
             break;
 
         case GL_UNSIGNED_SHORT_EMU:
             index_format_drv = drivers::data_format::word;
-            size_ibuffer = static_cast<std::size_t>(count * 2);
+            index_size = 2;
             break;
 
         default:
@@ -4554,24 +4863,25 @@ namespace eka2l1::dispatch {
         const std::uint8_t *indicies_data_raw = nullptr;
 
         std::int32_t total_vert = count;
+        std::int32_t first_vert = 0;
+
+        const std::size_t size_ibuffer = static_cast<std::size_t>(count) * index_size;
 
         if (ctx->binded_element_array_buffer_handle_ == 0) {
             indicies_data_raw = reinterpret_cast<const std::uint8_t*>(kern->crr_process()->get_ptr_on_addr_space(indices_ptr));
  
             if (indicies_data_raw) {
-                std::int32_t max_vert_index = 0;
-                for (std::int32_t i = 0; i < count; i++) {
-                    std::int32_t index = 0;
-                    if (index_type == GL_UNSIGNED_BYTE_EMU) {
-                        index = static_cast<std::int32_t>((reinterpret_cast<const std::uint8_t*>(indicies_data_raw))[i]);
-                    } else {
-                        index = static_cast<std::int32_t>((reinterpret_cast<const std::uint16_t*>(indicies_data_raw))[i]);
-                    }
+                std::uint32_t min_vert_index = 0;
+                std::uint32_t max_vert_index = 0;
 
-                    max_vert_index = common::max(index, max_vert_index);
+                if (!common::scan_index_range(indicies_data_raw, count, index_size, min_vert_index, max_vert_index)) {
+                    // Nothing to draw
+                    return;
                 }
 
-                total_vert = max_vert_index + 1;
+                // Only the referenced window of the client arrays is uploaded. Indices are rebased to it on upload.
+                first_vert = static_cast<std::int32_t>(min_vert_index);
+                total_vert = static_cast<std::int32_t>(max_vert_index - min_vert_index + 1);
             }
         }
 
@@ -4591,24 +4901,37 @@ namespace eka2l1::dispatch {
             }
 
             std::size_t offset_bytes = 0;
-            drivers::handle to_bind = ctx->index_buffer_pusher_.push_buffer(indicies_data_raw, size_ibuffer, offset_bytes);
-            if (to_bind == 0) {
+            drivers::handle to_bind = 0;
+
+            std::uint8_t *index_dest = ctx->index_buffer_pusher_.reserve(size_ibuffer, 4, offset_bytes, to_bind);
+            if (!index_dest) {
                 ctx->flush_to_driver(drv);
-                to_bind = ctx->index_buffer_pusher_.push_buffer(indicies_data_raw, size_ibuffer, offset_bytes);
+                index_dest = ctx->index_buffer_pusher_.reserve(size_ibuffer, 4, offset_bytes, to_bind);
+
+                if (!index_dest) {
+                    LOG_ERROR(HLE_DISPATCHER, "Client index data of size {} is too large to upload, draw call skipping!", size_ibuffer);
+                    return;
+                }
             }
 
+            common::rebase_indices(index_dest, indicies_data_raw, count, index_size, static_cast<std::uint32_t>(first_vert));
+            ctx->upload_stats_.index_bytes_ += size_ibuffer;
+
             ctx->cmd_builder_.set_index_buffer(to_bind);
             indices_ptr = static_cast<std::uint32_t>(offset_bytes);
         } else {
             ctx->cmd_builder_.set_index_buffer(binded_elem_buffer_managed->handle_value());
         }
 
-        if (!prepare_gles1_draw(ctx, drv, sys->get_kernel_system()->crr_process(), 0, total_vert, controller)) {
+        std::int32_t vertex_base = 0;
+
+        if (!prepare_gles1_draw(ctx, drv, sys->get_kernel_system()->crr_process(), first_vert, total_vert, controller,
+            drv->support_extension(drivers::graphics_driver_extension_base_vertex), vertex_base)) {
             LOG_ERROR(HLE_DISPATCHER, "Error while preparing GLES1 draw. This should not happen!");
             return;
         }
 
-        ctx->cmd_builder_.draw_indexed(prim_mode_drv, count, index_format_drv, static_cast<int>(indices_ptr), 0);
+        ctx->cmd_builder_.draw_indexed(prim_mode_drv, count, index_format_drv, static_cast<int>(indices_ptr), vertex_base);
 
         if (ctx->cmd_builder_.need_flush()) {
             ctx->flush_to_driver(drv);
@@ -22,10 +22,120 @@
 
 #include <dispatch/libraries/gles1/def.h>
 
+#include <common/buffer.h>
+#include <common/fileutils.h>
+#include <common/log.h>
+#include <common/path.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
 #define XXH_INLINE_ALL
 #include <xxhash.h>
 
 namespace eka2l1::dispatch {
+    static constexpr std::uint32_t GLES1_SHADER_CACHE_MAGIC = 0x43533147;        // G1SC
+    
+    // Bump this whenever the shader generator output or the hashing of states changes
+    static constexpr std::uint32_t GLES1_SHADER_CACHE_VERSION = 1;
+
+    enum gles1_shader_cache_record_type : std::uint8_t {
+        GLES1_SHADER_CACHE_RECORD_VERTEX = 0,
+        GLES1_SHADER_CACHE_RECORD_FRAGMENT = 1,
+        GLES1_SHADER_CACHE_RECORD_PROGRAM = 2
+    };
+
+    struct gles1_shader_cache_header {
+        std::uint32_t magic_;
+        std::uint32_t version_;
+        std::uint32_t api_;
+        std::uint32_t stricted_;
+    };
+
+    // Only the low bits of the texture environment are used, the rest of the word is not initialized
+    static constexpr std::uint64_t GLES1_TEXTURE_ENV_INFO_USED_MASK = (1ULL << 39) - 1;
+
+    static_assert(sizeof(gles_texture_env_info) == sizeof(std::uint64_t));
+
+    static gles1_shader_cache_header make_shader_cache_header(const drivers::graphic_api api, const bool stricted) {
+        gles1_shader_cache_header header;
+        header.magic_ = GLES1_SHADER_CACHE_MAGIC;
+        header.version_ = GLES1_SHADER_CACHE_VERSION;
+        header.api_ = static_cast<std::uint32_t>(api);
+        header.stricted_ = static_cast<std::uint32_t>(stricted);
+
+        return header;
+    }
+
+    static std::unique_ptr<gles1_persistent_shader_cache> load_shader_cache_file(const std::string path, const gles1_shader_cache_header expected) {
+        std::unique_ptr<gles1_persistent_shader_cache> cache = std::make_unique<gles1_persistent_shader_cache>();
+        common::ro_std_file_stream stream(path, true);
+
+        gles1_shader_cache_header header;
+
+        if (!stream.valid() || (stream.read(&header, sizeof(header)) != sizeof(header)) || (std::memcmp(&header, &expected, sizeof(header)) != 0)) {
+            cache->need_rewrite_ = true;
+            return cache;
+        }
+
+        std::uint8_t type = 0;
+        std::uint64_t hash = 0;
+
+        while (stream.read(&type, sizeof(type)) == sizeof(type)) {
+            if (stream.read(&hash, sizeof(hash)) != sizeof(hash)) {
+                cache->need_rewrite_ = true;
+                break;
+            }
+
+            if (type == GLES1_SHADER_CACHE_RECORD_PROGRAM) {
+                gles1_persistent_program_entry entry;
+                if (stream.read(&entry, sizeof(entry)) != sizeof(entry)) {
+                    cache->need_rewrite_ = true;
+                    break;
+                }
+
+                cache->programs_.push_back(entry);
+                continue;
+            }
+
+            std::uint32_t source_size = 0;
+            if ((type > GLES1_SHADER_CACHE_RECORD_FRAGMENT) || (stream.read(&source_size, sizeof(source_size)) != sizeof(source_size))) {
+                cache->need_rewrite_ = true;
+                break;
+            }
+
+            std::string source(source_size, '\0');
+            if (stream.read(source.data(), source_size) != source_size) {
+                cache->need_rewrite_ = true;
+                break;
+            }
+
+            auto &target = (type == GLES1_SHADER_CACHE_RECORD_VERTEX) ? cache->vertex_sources_ : cache->fragment_sources_;
+            target.emplace(hash, std::move(source));
+        }
+
+        return cache;
+    }
+
+    static void write_shader_cache_source(FILE *f, const std::uint8_t type, const std::uint64_t hash, const std::string &source) {
+        const std::uint32_t source_size = static_cast<std::uint32_t>(source.size());
+
+        fwrite(&type, sizeof(type), 1, f);
+        fwrite(&hash, sizeof(hash), 1, f);
+        fwrite(&source_size, sizeof(source_size), 1, f);
+        fwrite(source.data(), 1, source.size(), f);
+    }
+
+    static void write_shader_cache_program(FILE *f, const gles1_persistent_program_entry &entry) {
+        const std::uint8_t type = GLES1_SHADER_CACHE_RECORD_PROGRAM;
+        const std::uint64_t hash = 0;
+
+        fwrite(&type, sizeof(type), 1, f);
+        fwrite(&hash, sizeof(hash), 1, f);
+        fwrite(&entry, sizeof(entry), 1, f);
+    }
+
     gles1_shaderman::gles1_shaderman(drivers::graphics_driver *driver)
         : driver_(driver)
         , fragment_status_hasher_(nullptr) {
@@ -37,6 +147,12 @@ namespace eka2l1::dispatch {
     }
 
     gles1_shaderman::~gles1_shaderman() {
+        if (persistent_cache_future_.valid()) {
+            persistent_cache_future_.wait();
+        }
+
+        report_persistent_cache();
+
         if (driver_) {
             drivers::graphics_command_builder builder;
 
@@ -61,121 +177,166 @@ namespace eka2l1::dispatch {
             XXH64_freeState(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_));
         }
     }
-    
-    drivers::handle gles1_shaderman::retrieve_program(const std::uint64_t vertex_statuses, const std::uint64_t fragment_statuses,
-        const std::uint32_t active_texs, gles_texture_env_info *tex_env_infos, gles1_shader_variables_info *&info) {
-        // Turn off states that are not used (for hashing)
-        std::uint64_t cleansed_fragment_statuses = fragment_statuses;
-        if ((fragment_statuses & egl_context_es1::FRAGMENT_STATE_ALPHA_TEST) == 0) {
-            cleansed_fragment_statuses &= ~egl_context_es1::FRAGMENT_STATE_ALPHA_FUNC_MASK;
+
+    void gles1_shaderman::load_persistent_cache(const std::string &path) {
+        if (!driver_ || (path == persistent_cache_path_)) {
+            return;
         }
 
-        if ((fragment_statuses & egl_context_es1::FRAGMENT_STATE_FOG_ENABLE) == 0) {
-            cleansed_fragment_statuses &= ~egl_context_es1::FRAGMENT_STATE_FOG_MODE_MASK;
+        if (persistent_cache_future_.valid()) {
+            persistent_cache_future_.wait();
+            persistent_cache_future_ = std::future<std::unique_ptr<gles1_persistent_shader_cache>>();
         }
 
-        if ((fragment_statuses & egl_context_es1::FRAGMENT_STATE_LIGHTING_ENABLE) == 0) {
-            cleansed_fragment_statuses &= ~egl_context_es1::FRAGMENT_STATE_LIGHT_RELATED_MASK;
+        report_persistent_cache();
+
+        persistent_cache_path_ = path;
+        persistent_cache_stats_ = gles1_shader_cache_stats();
+        preloaded_programs_unused_.clear();
+
+        const std::string folder = eka2l1::file_directory(path);
+        if (!folder.empty() && !common::exists(folder)) {
+            common::create_directories(folder);
         }
 
-        drivers::handle vert_module = 0;
-        std::uint64_t vertex_hash = vertex_statuses | (static_cast<std::uint64_t>(active_texs) << egl_context_es1::VERTEX_STATE_REVERSED_BITS_POS);
+        persistent_cache_future_ = std::async(std::launch::async, load_shader_cache_file, path,
+            make_shader_cache_header(driver_->get_current_api(), driver_->is_stricted()));
+    }
 
-        if (active_texs != 0) {
-            // Clean texcoord bits of unused textures...
-            for (std::uint8_t i = 0; i < GLES1_EMU_MAX_TEXTURE_COUNT; i++) {
-                if ((active_texs & (1 << i)) == 0) {
-                    vertex_hash &= ~(1 << (egl_context_es1::VERTEX_STATE_CLIENT_TEXCOORD_ARRAY_POS + i));
+    void gles1_shaderman::poll_persistent_cache(const bool wait) {
+        if (!persistent_cache_future_.valid()) {
+            return;
+        }
+
+        if (!wait && (persistent_cache_future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+            return;
+        }
+
+        std::unique_ptr<gles1_persistent_shader_cache> cache = persistent_cache_future_.get();
+
+        if (cache->need_rewrite_) {
+            // Start the file over, keeping what was read intact before the damage
+            FILE *f = common::open_c_file(persistent_cache_path_, "wb");
+            if (!f) {
+                LOG_ERROR(HLE_DISPATCHER, "Unable to create GLES1 shader cache file {}", persistent_cache_path_);
+                persistent_cache_path_.clear();
+            } else {
+                const gles1_shader_cache_header header = make_shader_cache_header(driver_->get_current_api(), driver_->is_stricted());
+                fwrite(&header, sizeof(header), 1, f);
+
+                for (const auto &[hash, source]: cache->vertex_sources_) {
+                    write_shader_cache_source(f, GLES1_SHADER_CACHE_RECORD_VERTEX, hash, source);
+                }
+
+                for (const auto &[hash, source]: cache->fragment_sources_) {
+                    write_shader_cache_source(f, GLES1_SHADER_CACHE_RECORD_FRAGMENT, hash, source);
                 }
+
+                for (const auto &entry: cache->programs_) {
+                    write_shader_cache_program(f, entry);
+                }
+
+                fclose(f);
             }
         }
 
-        auto vert_cache_ite = vertex_cache_.find(vertex_hash);
-        if (vert_cache_ite == vertex_cache_.end()) {
-            std::string source_shader;
-            switch (driver_->get_current_api()) {
-            case drivers::graphic_api::opengl:
-                source_shader = generate_gl_vertex_shader(vertex_statuses, active_texs, driver_->is_stricted());
-                break;
+        warm_from_persistent_cache(*cache);
+    }
 
-            default:
-                LOG_ERROR(HLE_DISPATCHER, "Current backend does not support GLES1 shadergen yet!");
-                return 0;
+    void gles1_shaderman::warm_from_persistent_cache(gles1_persistent_shader_cache &cache) {
+        for (const auto &[hash, source]: cache.vertex_sources_) {
+            if (vertex_cache_.find(hash) == vertex_cache_.end()) {
+                create_module(hash, drivers::shader_module_type::vertex, source);
+            }
+        }
+
+        for (const auto &[hash, source]: cache.fragment_sources_) {
+            if (fragment_cache_.find(hash) == fragment_cache_.end()) {
+                create_module(hash, drivers::shader_module_type::fragment, source);
             }
+        }
 
-            vert_module = drivers::create_shader_module(driver_, source_shader.data(), source_shader.size(),
-                drivers::shader_module_type::vertex);
+        for (const auto &entry: cache.programs_) {
+            auto vert_ite = vertex_cache_.find(entry.vertex_hash_);
+            auto frag_ite = fragment_cache_.find(entry.fragment_hash_);
 
-            if (!vert_module) {
-                LOG_ERROR(HLE_DISPATCHER, "Fail to create GLES1 vertex shader module!");
-                return 0;
+            if ((vert_ite == vertex_cache_.end()) || (frag_ite == fragment_cache_.end())) {
+                continue;
             }
 
-            vertex_cache_.emplace(vertex_hash, vert_module);
-        } else {
-            vert_module = vert_cache_ite->second;
-        }
+            auto level1_program_ite = program_cache_.find(vert_ite->second);
+            if ((level1_program_ite != program_cache_.end()) && (level1_program_ite->second.find(frag_ite->second) != level1_program_ite->second.end())) {
+                continue;
+            }
 
-        drivers::handle fragment_module = 0;
-        if (!fragment_status_hasher_) {
-            fragment_status_hasher_ = XXH64_createState();
+            gles1_shader_variables_info *info = nullptr;
+            const drivers::handle program = create_program(vert_ite->second, frag_ite->second, entry.vertex_statuses_,
+                entry.fragment_statuses_, entry.active_texs_, info);
+
+            if (program) {
+                preloaded_programs_unused_.insert(program);
+                persistent_cache_stats_.preloaded_programs_++;
+            }
         }
+    }
 
-        // Doodle GLES1 (the seed I try to write 0_0)
-        XXH64_reset(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_), 0xD00D1E61E51ULL);
-        XXH64_update(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_), &cleansed_fragment_statuses, sizeof(std::uint64_t));
+    void gles1_shaderman::append_to_persistent_cache(const std::uint8_t type, const std::uint64_t hash, const std::string &source) {
+        if (persistent_cache_path_.empty() || persistent_cache_future_.valid()) {
+            return;
+        }
 
-        if (active_texs != 0) {
-            for (std::size_t i = 0; i < GLES1_EMU_MAX_TEXTURE_COUNT; i++) {
-                if (active_texs & (1 << i)) {
-                    XXH64_update(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_), tex_env_infos + i, sizeof(gles_texture_env_info));
-                }
-            }
+        FILE *f = common::open_c_file(persistent_cache_path_, "ab");
+        if (!f) {
+            return;
         }
 
-        std::uint64_t fragment_module_hash = XXH64_digest(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_));
-        auto frag_cache_ite = fragment_cache_.find(fragment_module_hash);
-        if (frag_cache_ite == fragment_cache_.end()) {
-            std::string source_shader;
-            switch (driver_->get_current_api()) {
-            case drivers::graphic_api::opengl:
-                source_shader = generate_gl_fragment_shader(cleansed_fragment_statuses, active_texs, tex_env_infos, driver_->is_stricted());
-                break;
+        write_shader_cache_source(f, type, hash, source);
+        fclose(f);
+    }
 
-            default:
-                LOG_ERROR(HLE_DISPATCHER, "Current backend does not support GLES1 shadergen yet!");
-                return 0;
-            }
+    void gles1_shaderman::append_to_persistent_cache(const gles1_persistent_program_entry &entry) {
+        if (persistent_cache_path_.empty() || persistent_cache_future_.valid()) {
+            return;
+        }
 
-            fragment_module = drivers::create_shader_module(driver_, source_shader.data(), source_shader.size(),
-                drivers::shader_module_type::fragment);
+        FILE *f = common::open_c_file(persistent_cache_path_, "ab");
+        if (!f) {
+            return;
+        }
 
-            if (!fragment_module) {
-                LOG_ERROR(HLE_DISPATCHER, "Fail to create GLES1 fragment shader module!");
-                return 0;
-            }
+        write_shader_cache_program(f, entry);
+        fclose(f);
+    }
 
-            fragment_cache_.emplace(fragment_module_hash, fragment_module);
-        } else {
-            fragment_module = frag_cache_ite->second;
+    void gles1_shaderman::report_persistent_cache() {
+        if (persistent_cache_path_.empty()) {
+            return;
         }
 
-        // Got the two handles, try to produce a program
-        bool need_produce_program = false;
+        LOG_INFO(HLE_DISPATCHER, "GLES1 shader cache {}: {} programs preloaded, {} hits, {} misses, {} preloaded programs unused",
+            persistent_cache_path_, persistent_cache_stats_.preloaded_programs_, persistent_cache_stats_.hits_,
+            persistent_cache_stats_.misses_, preloaded_programs_unused_.size());
+    }
 
-        auto level1_program_ite = program_cache_.find(vert_module);
-        if (level1_program_ite == program_cache_.end()) {
-            need_produce_program = true;
+    drivers::handle gles1_shaderman::create_module(const std::uint64_t hash, const drivers::shader_module_type type, const std::string &source) {
+        drivers::handle module = drivers::create_shader_module(driver_, source.data(), source.size(), type);
+
+        if (!module) {
+            LOG_ERROR(HLE_DISPATCHER, "Fail to create GLES1 {} shader module!", (type == drivers::shader_module_type::vertex) ? "vertex" : "fragment");
+            return 0;
+        }
+
+        if (type == drivers::shader_module_type::vertex) {
+            vertex_cache_.emplace(hash, module);
         } else {
-            auto level2_program_ite = level1_program_ite->second.find(fragment_module);
-            if (level2_program_ite == level1_program_ite->second.end()) {
-                need_produce_program = true;
-            } else {
-                info = level2_program_ite->second.second.get();
-                return level2_program_ite->second.first;
-            }
+            fragment_cache_.emplace(hash, module);
         }
 
+        return module;
+    }
+
+    drivers::handle gles1_shaderman::create_program(const drivers::handle vert_module, const drivers::handle fragment_module, const std::uint64_t vertex_statuses,
+        const std::uint64_t fragment_statuses, const std::uint32_t active_texs, gles1_shader_variables_info *&info) {
         drivers::shader_program_metadata metadata(nullptr);
         drivers::handle program_handle = drivers::create_shader_program(driver_, vert_module, fragment_module, &metadata);
         if (!program_handle) {
@@ -288,4 +449,142 @@ namespace eka2l1::dispatch {
 
         return program_handle;
     }
-}
\ No newline at end of file
+    
+    drivers::handle gles1_shaderman::retrieve_program(const std::uint64_t vertex_statuses, const std::uint64_t fragment_statuses,
+        const std::uint32_t active_texs, gles_texture_env_info *tex_env_infos, gles1_shader_variables_info *&info) {
+        poll_persistent_cache(false);
+
+        // Turn off states that are not used (for hashing)
+        std::uint64_t cleansed_fragment_statuses = fragment_statuses;
+        if ((fragment_statuses & egl_context_es1::FRAGMENT_STATE_ALPHA_TEST) == 0) {
+            cleansed_fragment_statuses &= ~egl_context_es1::FRAGMENT_STATE_ALPHA_FUNC_MASK;
+        }
+
+        if ((fragment_statuses & egl_context_es1::FRAGMENT_STATE_FOG_ENABLE) == 0) {
+            cleansed_fragment_statuses &= ~egl_context_es1::FRAGMENT_STATE_FOG_MODE_MASK;
+        }
+
+        if ((fragment_statuses & egl_context_es1::FRAGMENT_STATE_LIGHTING_ENABLE) == 0) {
+            cleansed_fragment_statuses &= ~egl_context_es1::FRAGMENT_STATE_LIGHT_RELATED_MASK;
+        }
+
+        std::uint64_t vertex_hash = vertex_statuses | (static_cast<std::uint64_t>(active_texs) << egl_context_es1::VERTEX_STATE_REVERSED_BITS_POS);
+
+        if (active_texs != 0) {
+            // Clean texcoord bits of unused textures...
+            for (std::uint8_t i = 0; i < GLES1_EMU_MAX_TEXTURE_COUNT; i++) {
+                if ((active_texs & (1 << i)) == 0) {
+                    vertex_hash &= ~(1 << (egl_context_es1::VERTEX_STATE_CLIENT_TEXCOORD_ARRAY_POS + i));
+                }
+            }
+        }
+
+        if (!fragment_status_hasher_) {
+            fragment_status_hasher_ = XXH64_createState();
+        }
+
+        // Doodle GLES1 (the seed I try to write 0_0)
+        XXH64_reset(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_), 0xD00D1E61E51ULL);
+        XXH64_update(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_), &cleansed_fragment_statuses, sizeof(std::uint64_t));
+
+        if (active_texs != 0) {
+            for (std::size_t i = 0; i < GLES1_EMU_MAX_TEXTURE_COUNT; i++) {
+                if (active_texs & (1 << i)) {
+                    // The hash is persisted, so it must not depend on the uninitialized bits
+                    std::uint64_t env_info_bits = 0;
+                    std::memcpy(&env_info_bits, tex_env_infos + i, sizeof(std::uint64_t));
+                    env_info_bits &= GLES1_TEXTURE_ENV_INFO_USED_MASK;
+
+                    XXH64_update(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_), &env_info_bits, sizeof(std::uint64_t));
+                }
+            }
+        }
+
+        std::uint64_t fragment_module_hash = XXH64_digest(reinterpret_cast<XXH64_state_t*>(fragment_status_hasher_));
+
+        auto vert_cache_ite = vertex_cache_.find(vertex_hash);
+        auto frag_cache_ite = fragment_cache_.find(fragment_module_hash);
+
+        if (((vert_cache_ite == vertex_cache_.end()) || (frag_cache_ite == fragment_cache_.end())) && persistent_cache_future_.valid()) {
+            // A compile is about to happen anyway. Reading the cache file costs much less, and may have these shaders
+            poll_persistent_cache(true);
+
+            vert_cache_ite = vertex_cache_.find(vertex_hash);
+            frag_cache_ite = fragment_cache_.find(fragment_module_hash);
+        }
+
+        drivers::handle vert_module = 0;
+        if (vert_cache_ite == vertex_cache_.end()) {
+            std::string source_shader;
+            switch (driver_->get_current_api()) {
+            case drivers::graphic_api::opengl:
+                source_shader = generate_gl_vertex_shader(vertex_statuses, active_texs, driver_->is_stricted());
+                break;
+
+            default:
+                LOG_ERROR(HLE_DISPATCHER, "Current backend does not support GLES1 shadergen yet!");
+                return 0;
+            }
+
+            vert_module = create_module(vertex_hash, drivers::shader_module_type::vertex, source_shader);
+            if (!vert_module) {
+                return 0;
+            }
+
+            append_to_persistent_cache(GLES1_SHADER_CACHE_RECORD_VERTEX, vertex_hash, source_shader);
+        } else {
+            vert_module = vert_cache_ite->second;
+        }
+
+        drivers::handle fragment_module = 0;
+        if (frag_cache_ite == fragment_cache_.end()) {
+            std::string source_shader;
+            switch (driver_->get_current_api()) {
+            case drivers::graphic_api::opengl:
+                source_shader = generate_gl_fragment_shader(cleansed_fragment_statuses, active_texs, tex_env_infos, driver_->is_stricted());
+                break;
+
+            default:
+                LOG_ERROR(HLE_DISPATCHER, "Current backend does not support GLES1 shadergen yet!");
+                return 0;
+            }
+
+            fragment_module = create_module(fragment_module_hash, drivers::shader_module_type::fragment, source_shader);
+            if (!fragment_module) {
+                return 0;
+            }
+
+            append_to_persistent_cache(GLES1_SHADER_CACHE_RECORD_FRAGMENT, fragment_module_hash, source_shader);
+        } else {
+            fragment_module = frag_cache_ite->second;
+        }
+
+        // Got the two handles, try to produce a program
+        auto level1_program_ite = program_cache_.find(vert_module);
+        if (level1_program_ite != program_cache_.end()) {
+            auto level2_program_ite = level1_program_ite->second.find(fragment_module);
+            if (level2_program_ite != level1_program_ite->second.end()) {
+                if (!preloaded_programs_unused_.empty()) {
+                    auto preloaded_ite = preloaded_programs_unused_.find(level2_program_ite->second.first);
+                    if (preloaded_ite != preloaded_programs_unused_.end()) {
+                        persistent_cache_stats_.hits_++;
+                        preloaded_programs_unused_.erase(preloaded_ite);
+                    }
+                }
+
+                info = level2_program_ite->second.second.get();
+                return level2_program_ite->second.first;
+            }
+        }
+
+        const drivers::handle program_handle = create_program(vert_module, fragment_module, vertex_statuses, fragment_statuses,
+            active_texs, info);
+
+        if (program_handle) {
+            persistent_cache_stats_.misses_++;
+            append_to_persistent_cache({ vertex_hash, fragment_module_hash, vertex_statuses, fragment_statuses, active_texs });
+        }
+
+        return program_handle;
+    }
+}
@@ -17,7 +17,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <common/algorithm.h>
 #include <common/log.h>
+#include <common/pixel.h>
+#include <common/thread_pool.h>
 #include <config/config.h>
 #include <dispatch/dispatcher.h>
 #include <dispatch/screen.h>
@@ -28,9 +31,13 @@
 #include <services/window/window.h>
 #include <system/epoc.h>
 
+#include <cstring>
 #include <fstream>
 
-namespace eka2l1::dispatch {    
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+namespace eka2l1::dispatch {
     void screen_post_transferer::construct(ntimer *timing) {
         vsync_notify_event_ = timing->register_event("VSyncNotifyEvent", [this](const std::uint64_t data, const int cycles_late) {
             epoc::notify_info *info = reinterpret_cast<epoc::notify_info*>(data);
@@ -110,12 +117,17 @@ namespace eka2l1::dispatch {
                 drivers::command_list retrieved = builder.retrieve_command_list();
                 drv->submit_command_list(retrieved);
             }
+
+            // The driver may still be uploading from the staging buffers
+            drv->wait_fence(drv->current_fence());
         }
+
+        infos_.clear();
     }
 
     drivers::handle screen_post_transferer::transfer_data_to_texture(drivers::graphics_driver *drv, drivers::graphics_command_builder &builder,
         std::int32_t screen_index, std::uint8_t *data, eka2l1::vec2 size, std::int32_t format) {
-        if ((screen_index < 0) || (screen_index > 10) || !drv) {
+        if ((screen_index < 0) || (screen_index > 10) || !drv || (size.x <= 0) || (size.y <= 0)) {
             return 0;
         }
 
@@ -125,36 +137,35 @@ namespace eka2l1::dispatch {
 
             for (std::size_t i = current_size; i < infos_.size(); i++) {
                 infos_[i].transfer_texture_ = 0;
+                infos_[i].format_ = 0;
+                infos_[i].staging_index_ = 0;
+                infos_[i].last_frame_hash_ = 0;
+
+                for (std::size_t j = 0; j < SCREEN_POST_STAGING_RING_SIZE; j++) {
+                    infos_[i].staging_fences_[j] = 0;
+                }
             }
         }
 
-        drivers::texture_format data_format = drivers::texture_format::rgba;
-        drivers::texture_format internal_format = drivers::texture_format::rgba;
-        drivers::texture_data_type type = drivers::texture_data_type::ubyte;
-
+        common::pixel_format source_format = common::pixel_format::rgba8888;
         std::size_t line_stride = 0;
 
+        // Source lines are 4 bytes aligned
         switch (format) {
         case FORMAT_RGB16_565_LE:
-            data_format = drivers::texture_format::rgb;
-            internal_format = drivers::texture_format::rgb;
-            type = drivers::texture_data_type::ushort_5_6_5;
-            line_stride = ((size.x * 2) + 1) / 4 * 4; 
+            source_format = common::pixel_format::rgb565;
+            line_stride = common::align(size.x * 2, 4);
 
             break;
 
         case FORMAT_RGB24_888_LE:
-            data_format = drivers::texture_format::rgb;
-            internal_format = drivers::texture_format::rgb;
-            type = drivers::texture_data_type::ubyte;
-            line_stride = ((size.x * 3) + 1) / 4 * 4; 
+            source_format = common::pixel_format::rgb888;
+            line_stride = common::align(size.x * 3, 4);
 
             break;
 
         case FORMAT_RGB32_X888_LE:
-            data_format = drivers::texture_format::rgba;
-            internal_format = drivers::texture_format::rgba;
-            type = drivers::texture_data_type::ubyte;
+            source_format = common::pixel_format::bgrx8888;
             line_stride = (size.x * 4);
 
             break;
@@ -165,29 +176,58 @@ namespace eka2l1::dispatch {
         }
 
         screen_post_source_info &info = infos_[screen_index];
-        if ((info.transfer_texture_ == 0) || (info.transfer_texture_size_.x > size.x) || (info.transfer_texture_size_.y > size.y)
-            || (info.format_ != format)) {
+        stats_.posted_frames_++;
+
+        const std::uint64_t frame_hash = XXH3_64bits(data, line_stride * size.y);
+
+        if ((info.transfer_texture_ == 0) || (info.transfer_texture_size_ != size) || (info.format_ != format)) {
             if (info.transfer_texture_ != 0) {
                 builder.destroy(info.transfer_texture_);
             }
 
-            info.transfer_texture_ = drivers::create_texture(drv, 2, 0, internal_format, data_format, type, nullptr, 0,
-                eka2l1::vec3(size.x, size.y, 0));
+            info.transfer_texture_ = drivers::create_texture(drv, 2, 0, drivers::texture_format::rgba, drivers::texture_format::rgba,
+                drivers::texture_data_type::ubyte, nullptr, 0, eka2l1::vec3(size.x, size.y, 0));
 
             info.transfer_texture_size_ = size;
             info.format_ = format;
+            info.last_frame_hash_ = 0;
 
             builder.set_texture_filter(info.transfer_texture_, false, drivers::filter_option::linear);
+        } else if (frame_hash == info.last_frame_hash_) {
+            // Games often post the same frame again while idle, the texture already has it
+            stats_.skipped_frames_++;
+            return info.transfer_texture_;
         }
 
-        builder.update_texture(info.transfer_texture_, reinterpret_cast<const char*>(data), line_stride * size.y, 0, data_format, type, eka2l1::vec3(0, 0, 0),
-            eka2l1::vec3(size.x, size.y, 0), 0);
+        info.last_frame_hash_ = frame_hash;
 
-        if (format == FORMAT_RGB32_X888_LE) {
-            builder.set_swizzle(info.transfer_texture_, drivers::channel_swizzle::blue, drivers::channel_swizzle::green,
-                drivers::channel_swizzle::red, drivers::channel_swizzle::one);
+        // Take the next staging buffer, once the driver is done uploading from it
+        const std::size_t slot = info.staging_index_;
+        info.staging_index_ = (info.staging_index_ + 1) % SCREEN_POST_STAGING_RING_SIZE;
+
+        if (info.staging_fences_[slot] > drv->completed_fence()) {
+            drv->wait_fence(info.staging_fences_[slot]);
+            stats_.staging_waits_++;
         }
 
+        std::vector<std::uint8_t> &staging = info.staging_[slot];
+        const std::size_t staging_size = static_cast<std::size_t>(size.x) * size.y * 4;
+
+        staging.resize(staging_size);
+
+        common::convert_pixel_rows(staging.data(), size.x * 4, common::pixel_format::rgba8888, data, line_stride, source_format,
+            size.x, size.y, nullptr, &common::get_shared_thread_pool());
+
+        drivers::graphics_command_builder upload_builder;
+        upload_builder.update_texture_from_staging(info.transfer_texture_, reinterpret_cast<const char *>(staging.data()), staging_size,
+            0, drivers::texture_format::rgba, drivers::texture_data_type::ubyte, eka2l1::vec3(0, 0, 0), eka2l1::vec3(size.x, size.y, 0), 0);
+
+        drivers::command_list retrieved = upload_builder.retrieve_command_list();
+        drv->submit_command_list(retrieved);
+
+        info.staging_fences_[slot] = drv->current_fence();
+        stats_.uploaded_bytes_ += staging_size;
+
         return info.transfer_texture_;
     }
 
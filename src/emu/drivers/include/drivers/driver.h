@@ -20,7 +20,9 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <condition_variable>
 #include <mutex>
 
@@ -29,70 +31,219 @@ namespace eka2l1 {
 }
 
 namespace eka2l1::drivers {
+    static constexpr std::uint32_t MAX_COMMAND_DATA_WORDS = 10;
+    static constexpr std::size_t COMMAND_CHUNK_SIZE = 64 * 1024;
+    static constexpr std::size_t MAX_FREE_COMMAND_CHUNKS = 64;
+
+    enum command_flags : std::uint8_t {
+        command_flag_inline_payload = 1 << 0,       ///< Pointer arguments point into the command's own payload.
+        command_flag_borrowed_payload = 1 << 1      ///< Pointer arguments point to memory the submitter keeps alive until the list is executed.
+    };
+
     /**
      * \brief Represent a command for driver.
+     * 
+     * Inside a command list, only the first word_count_ data words are stored, followed by
+     * the payload (if any). The record is size_ bytes long.
      */
     struct command {
-        std::uint32_t opcode_;
-        std::uint64_t data_[10];
+        std::uint16_t opcode_;
+        std::uint8_t word_count_;
+        std::uint8_t flags_;
+        std::uint32_t size_;
         int *status_;
+        std::uint64_t data_[MAX_COMMAND_DATA_WORDS];
 
         explicit command()
             : opcode_(0)
-            , data_()
-            , status_(nullptr) {
+            , word_count_(MAX_COMMAND_DATA_WORDS)
+            , flags_(0)
+            , size_(sizeof(command))
+            , status_(nullptr)
+            , data_() {
         }
 
         explicit command(const std::uint16_t opcode, int *status = nullptr)
             : opcode_(opcode)
-            , data_()
-            , status_(status) {
+            , word_count_(MAX_COMMAND_DATA_WORDS)
+            , flags_(0)
+            , size_(sizeof(command))
+            , status_(status)
+            , data_() {
+        }
+
+        std::uint8_t *payload() {
+            return reinterpret_cast<std::uint8_t *>(data_ + word_count_);
+        }
+
+        /**
+         * \brief Free data passed through a pointer argument, if the command owns a heap copy of it.
+         */
+        void free_data(const void *data) {
+            if ((flags_ & (command_flag_inline_payload | command_flag_borrowed_payload)) == 0) {
+                delete[] reinterpret_cast<const std::uint8_t *>(data);
+            }
         }
     };
 
+    static constexpr std::size_t COMMAND_HEADER_SIZE = sizeof(command) - sizeof(std::uint64_t) * MAX_COMMAND_DATA_WORDS;
+
     /**
-     * \brief A linked list of command.
+     * \brief A block of packed commands.
+     */
+    struct command_chunk {
+        command_chunk *next_;
+
+        std::size_t size_;
+        std::size_t capacity_;
+
+        std::uint8_t *data() {
+            return reinterpret_cast<std::uint8_t *>(this + 1);
+        }
+    };
+
+    /**
+     * \brief Get a chunk that can hold at least the given number of bytes.
+     *
+     * Standard sized chunks are recycled from a free pool shared by all command lists.
+     */
+    command_chunk *acquire_command_chunk(const std::size_t min_capacity);
+
+    /**
+     * \brief Give a chain of chunks back to the free pool.
+     */
+    void release_command_chunks(command_chunk *first);
+
+    /**
+     * \brief A list of packed, variable-length commands.
+     *
+     * The list owns its chunks. It can only be moved, and gives the chunks back to the pool when
+     * destroyed, so a list that is dropped without being submitted does not leak them.
      */
     struct command_list {
-        command *base_;
+        command_chunk *first_;
+        command_chunk *last_;
 
         std::size_t size_;
-        std::size_t max_cap_;
 
-        explicit command_list(std::size_t max_cap = 0)
-            : base_(nullptr)
-            , size_(0)
-            , max_cap_(max_cap) {
+        explicit command_list()
+            : first_(nullptr)
+            , last_(nullptr)
+            , size_(0) {
+        }
+
+        command_list(const command_list &) = delete;
+        command_list &operator=(const command_list &) = delete;
+
+        command_list(command_list &&another) noexcept
+            : first_(another.first_)
+            , last_(another.last_)
+            , size_(another.size_) {
+            another.first_ = nullptr;
+            another.last_ = nullptr;
+            another.size_ = 0;
+        }
+
+        command_list &operator=(command_list &&another) noexcept {
+            if (this != &another) {
+                release();
+                append(another);
+            }
+
+            return *this;
+        }
+
+        ~command_list() {
+            release();
         }
 
         bool empty() const {
             return (size_ == 0);
         }
 
-        command *retrieve_next() {
-            if (!max_cap_) {
-                return nullptr;
-            }
+        /**
+         * \brief Reserve the next command in the list.
+         * 
+         * \param word_count       Number of data words the command uses. They are zeroed.
+         * \param payload_size     Bytes of inline payload to reserve after the data words.
+         */
+        command *retrieve_next(const std::uint32_t word_count = MAX_COMMAND_DATA_WORDS, const std::size_t payload_size = 0) {
+            const std::size_t record_size = (COMMAND_HEADER_SIZE + word_count * sizeof(std::uint64_t) + payload_size + 7) & ~static_cast<std::size_t>(7);
+
+            if (!last_ || (last_->size_ + record_size > last_->capacity_)) {
+                command_chunk *chunk = acquire_command_chunk(record_size);
+
+                if (last_) {
+                    last_->next_ = chunk;
+                } else {
+                    first_ = chunk;
+                }
 
-            if (!base_) {
-                renew();
+                last_ = chunk;
             }
 
-            command *res = base_ + size_;
+            command *res = reinterpret_cast<command *>(last_->data() + last_->size_);
+            last_->size_ += record_size;
+
+            res->opcode_ = 0;
+            res->word_count_ = static_cast<std::uint8_t>(word_count);
+            res->flags_ = 0;
+            res->size_ = static_cast<std::uint32_t>(record_size);
             res->status_ = nullptr;
 
+            std::memset(res->data_, 0, word_count * sizeof(std::uint64_t));
+
             size_++;
 
             return res;
         }
 
-        void renew() {
-            if (max_cap_ == 0) {
+        /**
+         * \brief Move all commands of another list to the end of this list.
+         */
+        void append(command_list &another) {
+            if (!another.first_) {
                 return;
             }
-            // NOTE: After command all iterated, the base will be deleted.
-            // No memory leak!
-            base_ = new command[max_cap_];
+
+            if (last_) {
+                last_->next_ = another.first_;
+            } else {
+                first_ = another.first_;
+            }
+
+            last_ = another.last_;
+            size_ += another.size_;
+
+            another.first_ = nullptr;
+            another.last_ = nullptr;
+            another.size_ = 0;
+        }
+
+        template <typename F>
+        void iterate(F func) {
+            for (command_chunk *chunk = first_; chunk; chunk = chunk->next_) {
+                std::size_t offset = 0;
+
+                while (offset < chunk->size_) {
+                    command *cmd = reinterpret_cast<command *>(chunk->data() + offset);
+                    offset += cmd->size_;
+
+                    func(*cmd);
+                }
+            }
+        }
+
+        /**
+         * \brief Give the list's memory back to the pool. The list is empty afterwards.
+         */
+        void release() {
+            if (first_) {
+                release_command_chunks(first_);
+            }
+
+            first_ = nullptr;
+            last_ = nullptr;
             size_ = 0;
         }
     };
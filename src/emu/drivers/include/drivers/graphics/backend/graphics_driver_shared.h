@@ -21,6 +21,7 @@
 
 #include <drivers/graphics/fb.h>
 #include <drivers/graphics/graphics.h>
+#include <drivers/graphics/sprite_batch.h>
 #include <drivers/graphics/texture.h>
 
 #define GLM_FORCE_RADIANS
@@ -32,9 +33,14 @@
 #include <common/queue.h>
 #include <common/vecx.h>
 
+#include <vector>
+
 namespace eka2l1::drivers {
     #define HANDLE_BITMAP (1ULL << 32)
 
+    // Budget for the CPU copies of bitmap reads, over all bitmaps
+    static constexpr std::size_t MAX_BITMAP_READ_CACHE_BYTES = 8 * 1024 * 1024;
+
     /**
      * \brief Bitmap is basically a texture. It can be drawn into and can be taken to draw.
      */
@@ -46,6 +52,15 @@ namespace eka2l1::drivers {
         texture_ptr ds_tex;
         int bpp;
 
+        std::uint64_t generation;               ///< Bumped whenever the content may have changed.
+
+        // CPU copy of the last read, served again while the content stays the same
+        std::vector<std::uint8_t> read_cache;
+        std::uint64_t read_cache_generation;
+        eka2l1::point read_cache_pos;
+        eka2l1::object_size read_cache_size;
+        std::uint32_t read_cache_bpp;
+
         explicit bitmap(graphics_driver *driver, const eka2l1::vec2 &size, const int initial_bpp);
         virtual ~bitmap();
 
@@ -54,6 +69,22 @@ namespace eka2l1::drivers {
     };
 
     using bitmap_ptr = std::unique_ptr<bitmap>;
+
+    /**
+     * \brief A bitmap read that was queued on the GPU and has not been copied out yet.
+     */
+    struct pending_bitmap_read {
+        bitmap *bmp_;
+        std::int32_t slot_;
+        std::uint8_t *dest_;
+        std::size_t dest_size_;
+        int *status_;
+        bool cacheable_;
+        std::uint64_t generation_;
+        eka2l1::point pos_;
+        eka2l1::object_size size_;
+        std::uint32_t bpp_;
+    };
     using graphics_object_instance = std::unique_ptr<graphics_object>;
 
     class shared_graphics_driver : public graphics_driver {
@@ -68,9 +99,14 @@ namespace eka2l1::drivers {
         int current_fb_height;
         eka2l1::vec2 swapchain_size;
 
+        std::vector<pending_bitmap_read> pending_reads_;
+        std::size_t read_cache_bytes_;
+
         glm::mat4 projection_matrix;
         eka2l1::vecx<float, 4> brush_color;
 
+        sprite_batch sprite_batch_;
+
         drivers::handle append_graphics_object(graphics_object_instance &instance);
         bool delete_graphics_object(const drivers::handle handle);
         graphics_object *get_graphics_object(const drivers::handle num);
@@ -102,6 +138,21 @@ namespace eka2l1::drivers {
         void create_input_descriptors(command &cmd);
         void set_max_mip_level(command &cmd);
 
+        void complete_bitmap_read(pending_bitmap_read &read);
+
+        /**
+         * \brief Keep a CPU copy of a finished read, evicting other bitmaps' copies to stay in budget.
+         */
+        void store_read_cache(bitmap *bmp, const pending_bitmap_read &read);
+        void drop_read_cache(bitmap *bmp);
+
+        /**
+         * \brief Copy out bitmap reads that the GPU has finished, completing their status.
+         *
+         * \param wait_all     If true, wait for reads still in flight instead of leaving them pending.
+         */
+        void resolve_pending_reads(const bool wait_all);
+
     public:
         explicit shared_graphics_driver(const graphic_api gr_api);
 
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <drivers/graphics/graphics.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace eka2l1::common {
+    class wo_std_file_stream;
+}
+
+namespace eka2l1::drivers {
+    /**
+     * \brief Number of commands and bytes seen for one opcode.
+     */
+    struct graphics_command_stats {
+        std::uint64_t count_ = 0;
+        std::uint64_t bytes_ = 0;       ///< Command record bytes, plus any data the command points to.
+    };
+
+    enum null_object_kind : std::uint8_t {
+        null_object_none,
+        null_object_shader_module,
+        null_object_shader_program,
+        null_object_texture,
+        null_object_buffer,
+        null_object_input_descriptors
+    };
+
+    /**
+     * \brief A graphics driver that consumes command lists without rendering anything.
+     *
+     * Lists are processed on the submitting thread, so no GPU, context or window is needed. Object
+     * handles are allocated the same way the real backends do, and every handle a command refers to
+     * is checked against the live objects. Per-opcode statistics are collected, and the stream can
+     * be recorded to a file.
+     *
+     * Recording format: a "NGCS" magic and a 32-bit version, then for each command the 16-byte command
+     * header, the data words and the inline payload, exactly as laid out in the list. The header's
+     * size field gives the record length. Words that point into the record's own payload are stored
+     * as offsets from the record start, and flagged in a 16-bit mask written before each record.
+     * Other pointer words are host addresses and are only meaningful as identities.
+     */
+    class null_graphics_driver : public graphics_driver {
+        std::mutex process_lock_;
+        std::atomic<bool> should_stop_;
+
+        std::vector<bool> bitmaps_;
+        std::vector<null_object_kind> objects_;
+
+        std::vector<graphics_command_stats> stats_;
+        std::uint64_t submitted_lists_;
+        std::uint64_t invalid_handle_uses_;
+
+        std::unique_ptr<common::wo_std_file_stream> record_stream_;
+        std::vector<std::uint8_t> record_buffer_;
+
+        bool is_bitmap_valid(const drivers::handle h);
+        bool is_object_valid(const drivers::handle h, const null_object_kind kind);
+        void check_bitmap(const drivers::handle h);
+        void check_object(const drivers::handle h, const null_object_kind kind);
+
+        drivers::handle new_bitmap();
+        drivers::handle new_object(const null_object_kind kind);
+
+        std::uint64_t process(command &cmd);
+        void record(const command &cmd);
+
+    public:
+        explicit null_graphics_driver();
+        ~null_graphics_driver() override;
+
+        void run() override;
+        void abort() override;
+
+        void update_bitmap(drivers::handle h, const std::size_t size, const eka2l1::vec2 &offset,
+            const eka2l1::vec2 &dim, const void *data, const std::size_t pixels_per_line = 0) override;
+
+        void set_viewport(const eka2l1::rect &viewport) override;
+        void update_surface(void *surface) override;
+        void submit_command_list(command_list &cmd_list) override;
+
+        // Lists run on submit, so the fence of the last one is always signalled.
+        std::uint64_t current_fence() const override;
+
+        void set_upscale_shader(const std::string &name) override;
+        std::string get_active_upscale_shader() const override;
+
+        bool support_extension(const graphics_driver_extension ext) override;
+        bool query_extension_value(const graphics_driver_extension_query query, void *data_ptr) override;
+
+        graphics_queue_stats get_queue_stats() const override;
+
+        /**
+         * \brief Start writing every processed command to a file.
+         *
+         * \param path      Path of the file to write to. Overwritten if it exists.
+         * \returns False if the file can not be opened.
+         */
+        bool start_recording(const std::string &path);
+        void stop_recording();
+
+        /**
+         * \brief Get the per-opcode statistics, indexed by opcode.
+         */
+        std::vector<graphics_command_stats> get_command_stats();
+        void reset_command_stats();
+
+        /**
+         * \brief Get the number of commands that referred to a handle which was not alive.
+         */
+        std::uint64_t invalid_handle_uses();
+
+        /**
+         * \brief Get the number of bitmaps and objects that are alive.
+         */
+        std::size_t live_object_count();
+    };
+}
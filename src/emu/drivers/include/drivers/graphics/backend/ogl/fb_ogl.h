@@ -25,6 +25,7 @@
 
 #include <common/vecx.h>
 
+#include <cstddef>
 #include <cstdint>
 
 namespace eka2l1::drivers {
@@ -39,6 +40,26 @@ namespace eka2l1::drivers {
         int max_color_attachment{ 0 };
         graphics_driver *bind_driver;
 
+        static constexpr std::int32_t PACK_SLOT_COUNT = 2;
+
+        /**
+         * \brief Pixel pack staging for asynchronous reads.
+         *
+         * There are two slots so a new read can start while the previous one is still in flight.
+         */
+        struct pack_slot {
+            std::uint32_t buffer_ = 0;
+            void *fence_ = nullptr;
+            texture_format format_ = texture_format::rgba;
+            texture_data_type data_type_ = texture_data_type::ubyte;
+            eka2l1::object_size size_;
+            std::size_t data_size_ = 0;
+            bool native_ = false;
+            bool in_use_ = false;
+        };
+
+        pack_slot pack_slots_[PACK_SLOT_COUNT];
+
     public:
         std::uint32_t get_fbo() const {
             return fbo;
@@ -62,5 +83,9 @@ namespace eka2l1::drivers {
             const filter_option copy_filter) override;
 
         bool read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size, std::uint8_t *buffer_ptr) override;
+
+        std::int32_t start_read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size) override;
+        bool is_read_done(const std::int32_t slot_index) override;
+        bool finish_read(const std::int32_t slot_index, std::uint8_t *buffer_ptr) override;
     };
 }
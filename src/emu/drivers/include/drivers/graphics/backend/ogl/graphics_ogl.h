@@ -25,12 +25,17 @@
 #include <drivers/graphics/backend/ogl/texture_ogl.h>
 #include <drivers/graphics/backend/ogl/input_desc_ogl.h>
 #include <drivers/graphics/context.h>
+#include <drivers/graphics/texture_decode.h>
 
 #include <common/queue.h>
 #include <common/region.h>
 #include <glad/glad.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <queue>
 
 namespace eka2l1::drivers {
@@ -59,11 +64,36 @@ namespace eka2l1::drivers {
         OGL_FEATURE_SUPPORT_ETC2 = 1 << 0,
         OGL_FEATURE_SUPPORT_PVRTC = 1 << 1,
         OGL_FEATURE_SUPPORT_ANISOTROPHY = 1 << 2,
-        OGL_MAX_FEATURE = 2
+        OGL_FEATURE_SUPPORT_BASE_VERTEX = 1 << 3,
+        OGL_MAX_FEATURE = 3
     };
 
+    // Bytes of decoded compressed textures kept around, for hosts that can not sample them natively
+    static constexpr std::size_t OGL_DECODED_TEXTURE_CACHE_BUDGET = 64 * 1024 * 1024;
+
     class ogl_graphics_driver : public shared_graphics_driver {
-        eka2l1::request_queue<command_list> list_queue;
+        static constexpr std::size_t LIST_RING_CAPACITY = 128;
+
+        eka2l1::spsc_ring<command_list, LIST_RING_CAPACITY> list_ring_;
+
+        // Submitters are serialised with this flag so the ring only ever sees one producer at a time.
+        // It is uncontended unless a frontend thread submits while the emulator thread does too.
+        std::atomic_flag producer_lock_ = ATOMIC_FLAG_INIT;
+
+        // Only taken when one side has to sleep: producer on a full ring, consumer on an empty one.
+        std::mutex ring_wait_mut_;
+        std::condition_variable ring_space_cond_;
+        std::condition_variable ring_data_cond_;
+        std::atomic<bool> producer_waiting_;
+        std::atomic<bool> consumer_waiting_;
+
+        std::atomic<std::uint64_t> submitted_fence_;
+        std::atomic<std::uint64_t> completed_fence_;
+        std::atomic<std::uint32_t> fence_waiters_;
+
+        std::atomic<std::uint32_t> peak_depth_;
+        std::atomic<std::uint64_t> producer_stall_us_;
+        std::atomic<std::uint64_t> consumer_idle_us_;
 
         std::unique_ptr<ogl_shader_program> sprite_program;
         std::unique_ptr<ogl_shader_program> brush_program;
@@ -77,6 +107,10 @@ namespace eka2l1::drivers {
 
         GLuint brush_vao;
         GLuint brush_vbo;
+
+        GLuint batch_vao_;
+        GLuint batch_vbo_;
+        GLuint batch_ibo_;
         GLuint pen_vao;
         GLuint pen_vbo;
         GLuint pen_ibo;
@@ -145,10 +179,13 @@ namespace eka2l1::drivers {
 
         float anisotrophy_max_;
 
+        decoded_texture_cache decoded_textures_;
+
         void do_init();
         void prepare_draw_lines_shared();
 
         void draw_rectangle(const eka2l1::rect &brush_rect);
+        void flush_sprite_batch();
 
         void clear(command &cmd);
         void draw_bitmap(command &cmd);
@@ -188,6 +225,10 @@ namespace eka2l1::drivers {
 
         void commit_upscale_shader_change();
 
+        bool wait_for_ring_space(command_list &list);
+        std::optional<command_list> wait_for_ring_data();
+        void signal_list_completed();
+
     public:
         explicit ogl_graphics_driver(const window_system_info &info);
         ~ogl_graphics_driver() override;
@@ -201,6 +242,11 @@ namespace eka2l1::drivers {
         void bind_swapchain_framebuf() override;
         void update_surface(void *new_surface) override;
         void wait_for(int *status) override;
+
+        std::uint64_t current_fence() const override;
+        std::uint64_t completed_fence() const override;
+        void wait_fence(const std::uint64_t fence) override;
+        graphics_queue_stats get_queue_stats() const override;
         void set_upscale_shader(const std::string &name) override;
         std::string get_active_upscale_shader() const override;
 
@@ -214,5 +260,9 @@ namespace eka2l1::drivers {
         bool get_supported_feature(const std::uint32_t feature_mask) const {
             return feature_flags_ & feature_mask;
         }
+
+        decoded_texture_cache &get_decoded_texture_cache() {
+            return decoded_textures_;
+        }
     };
 }
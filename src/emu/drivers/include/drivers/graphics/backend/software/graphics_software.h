@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <drivers/graphics/backend/graphics_driver_shared.h>
+#include <drivers/graphics/backend/software/raster_software.h>
+#include <drivers/graphics/backend/software/texture_software.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace eka2l1::drivers {
+    /**
+     * \brief State saved and restored by the backup and restore state commands.
+     */
+    struct software_render_state {
+        eka2l1::rect viewport_;
+        bool viewport_set_ = false;
+
+        bool scissor_enabled_ = false;
+        eka2l1::rect scissor_;
+
+        bool stencil_enabled_ = false;
+        std::vector<eka2l1::rect> clip_region_;
+
+        software_blend_state blend_;
+        pen_style pen_style_ = pen_style_solid;
+    };
+
+    /**
+     * \brief A graphics driver that renders the window server's 2D commands on the CPU.
+     *
+     * Bitmap blits, brush rectangles, pen lines and polygons are supported, with masks, tinting,
+     * rotation, scissor and region clipping and blending. Texels are sampled nearest. Shaders and
+     * the rest of the 3D commands are not supported, creating such objects fails.
+     *
+     * Like the null driver, lists are processed on the submitting thread, so no GPU or window is
+     * needed. Large draws are split into row bands over the shared thread pool. The screen is kept
+     * as RGBA8 pixels, top row first, and can be fetched to compare against a reference image.
+     */
+    class software_graphics_driver : public shared_graphics_driver {
+        std::mutex process_lock_;
+        std::atomic<bool> should_stop_;
+
+        std::unique_ptr<software_texture> screen_;
+
+        software_framebuffer *read_fb_;
+        software_framebuffer *draw_fb_;
+
+        software_render_state state_;
+        software_render_state backup_state_;
+
+        std::uint64_t submitted_lists_;
+
+        software_texture *get_target();
+        eka2l1::rect get_viewport(software_texture *target) const;
+
+        /**
+         * \brief Get the column ranges of a row that pass the viewport, scissor and region clipping.
+         */
+        void get_row_spans(const int y, const eka2l1::rect &bounds, std::vector<std::pair<int, int>> &spans) const;
+        bool is_pixel_visible(const int x, const int y, const eka2l1::rect &bounds) const;
+
+        glm::mat4 get_window_matrix(software_texture *target) const;
+
+        void draw_bitmap(command &cmd);
+        void draw_rectangle(command &cmd);
+        void draw_line(const eka2l1::point &start, const eka2l1::point &end);
+        void draw_line(command &cmd);
+        void draw_polygon(command &cmd);
+        void clip_rect(command &cmd);
+        void clip_region(command &cmd);
+        void set_feature(command &cmd);
+        void blend_formula(command &cmd);
+        void clear(command &cmd);
+        void set_viewport(command &cmd);
+        void set_pen_style(command &cmd);
+        void set_swapchain_size(command &cmd);
+        void display(command &cmd);
+
+    public:
+        explicit software_graphics_driver();
+        ~software_graphics_driver() override;
+
+        void run() override;
+        void abort() override;
+
+        void set_viewport(const eka2l1::rect &viewport) override;
+        void update_surface(void *surface) override;
+        void submit_command_list(command_list &cmd_list) override;
+
+        void set_upscale_shader(const std::string &name) override;
+        std::string get_active_upscale_shader() const override;
+
+        bool support_extension(const graphics_driver_extension ext) override;
+        bool query_extension_value(const graphics_driver_extension_query query, void *data_ptr) override;
+
+        graphics_queue_stats get_queue_stats() const override;
+
+        void dispatch(command &cmd) override;
+        void bind_swapchain_framebuf() override;
+
+        void bind_framebuffer(software_framebuffer *fb, const framebuffer_bind_type type);
+        void unbind_framebuffer(software_framebuffer *fb);
+
+        /**
+         * \brief Get the texture a framebuffer blit reads from or writes to. The screen if no framebuffer is bound.
+         */
+        software_texture *get_blit_texture(const framebuffer_bind_type type);
+
+        /**
+         * \brief Copy the screen pixels out, as RGBA8 with R in the lowest byte, top row first.
+         *
+         * \param size      Receives the size of the screen.
+         */
+        std::vector<std::uint32_t> get_screen_pixels(eka2l1::vec2 &size);
+    };
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <drivers/graphics/common.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace eka2l1::drivers {
+    /**
+     * \brief Blending of the software rasteriser, with the same meaning as the GL blend state.
+     *
+     * Pixels are RGBA8, R in the lowest byte. Each product is rounded to 8 bits on its own, so results
+     * may differ by one from a GPU, which blends in floating point.
+     */
+    struct software_blend_state {
+        bool enabled_ = false;
+
+        blend_equation rgb_equation_ = blend_equation::add;
+        blend_equation alpha_equation_ = blend_equation::add;
+        blend_factor rgb_source_ = blend_factor::one;
+        blend_factor rgb_dest_ = blend_factor::zero;
+        blend_factor alpha_source_ = blend_factor::one;
+        blend_factor alpha_dest_ = blend_factor::zero;
+
+        /**
+         * \brief Check if the source simply replaces the destination.
+         */
+        bool is_replace() const;
+    };
+
+    inline std::uint32_t pack_software_color(const std::uint32_t r, const std::uint32_t g, const std::uint32_t b, const std::uint32_t a) {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    /**
+     * \brief Blend a span of source pixels into the destination.
+     *
+     * Uses SSE2 or NEON when the blend factors only depend on alpha, which covers what the window server uses.
+     */
+    void software_blend_span(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state);
+
+    /**
+     * \brief Blend one color over a span of the destination.
+     */
+    void software_fill_span(std::uint32_t *dest, const std::uint32_t color, const std::size_t count, const software_blend_state &state);
+
+    /**
+     * \brief Multiply each pixel of a span with a color, channel by channel.
+     */
+    void software_modulate_span(std::uint32_t *span, const std::uint32_t color, const std::size_t count);
+
+    /**
+     * \brief Same as software_blend_span, but never uses the vector paths. Exists for testing.
+     */
+    void software_blend_span_scalar(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state);
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <drivers/graphics/fb.h>
+#include <drivers/graphics/texture.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace eka2l1::drivers {
+    class software_graphics_driver;
+
+    /**
+     * \brief Texture of the software rasteriser, stored as RGBA8 with R in the lowest byte.
+     *
+     * Uploads are converted to RGBA8, with missing channels filled the way GL does. The channel
+     * swizzle is applied to a copy that is made the first time the texture is sampled after a change.
+     */
+    class software_texture : public texture {
+        eka2l1::vec2 size_;
+        int dimensions_;
+        texture_format format_;
+        texture_data_type data_type_;
+
+        std::vector<std::uint32_t> pixels_;
+        std::vector<std::uint32_t> swizzled_pixels_;
+
+        channel_swizzles swizzle_;
+        bool swizzled_dirty_;
+
+        void upload(const eka2l1::vec2 &offset, const eka2l1::vec2 &size, const std::size_t pixels_per_line, const texture_format data_format,
+            const texture_data_type data_type, const void *data, const std::size_t data_size, const std::uint32_t unpack_alignment);
+
+    public:
+        explicit software_texture();
+
+        bool create(graphics_driver *driver, const int dim, const int miplvl, const vec3 &size, const texture_format internal_format,
+            const texture_format format, const texture_data_type data_type, void *data, const std::size_t data_size, const std::size_t pixels_per_line = 0,
+            const std::uint32_t unpack_alignment = 4) override;
+
+        std::uint64_t texture_handle() override;
+
+        void set_filter_minmag(const bool min, const filter_option op) override;
+        void set_addressing_mode(const addressing_direction dir, const addressing_option op) override;
+        void set_channel_swizzle(channel_swizzles swizz) override;
+        void generate_mips() override;
+        void set_max_mip_level(const std::uint32_t max_mip) override;
+
+        void bind(graphics_driver *driver, const int binding) override;
+        void unbind(graphics_driver *driver) override;
+
+        vec2 get_size() const override;
+        texture_format get_format() const override;
+        texture_data_type get_data_type() const override;
+        int get_total_dimensions() const override;
+
+        void update_data(graphics_driver *driver, const int mip_lvl, const vec3 &offset, const vec3 &size, const std::size_t byte_width,
+            const texture_format data_format, const texture_data_type data_type, const void *data, const std::size_t data_size, const std::uint32_t unpack_alignment) override;
+
+        /**
+         * \brief Resize the storage, keeping the overlapping content.
+         */
+        void resize(const eka2l1::vec2 &new_size);
+
+        /**
+         * \brief Get the pixels to render into. The texture is assumed to be modified.
+         *
+         * \returns Null if the texture has no color storage, like a depth stencil texture.
+         */
+        std::uint32_t *get_storage();
+
+        /**
+         * \brief Get the pixels as seen by sampling, with the channel swizzle applied.
+         */
+        const std::uint32_t *get_sample_pixels();
+
+        /**
+         * \brief Get the pixels as stored, without the channel swizzle.
+         */
+        const std::uint32_t *get_raw_pixels() const;
+    };
+
+    /**
+     * \brief Framebuffer of the software rasteriser.
+     *
+     * Binding only tells the driver where blits read from and write to. Draws land in the bitmap
+     * bound through the driver.
+     */
+    class software_framebuffer : public framebuffer {
+        software_graphics_driver *driver_;
+
+    public:
+        explicit software_framebuffer(std::initializer_list<texture *> color_buffer_list, texture *depth_and_stencil_buffer);
+
+        void bind(graphics_driver *driver, const framebuffer_bind_type type_bind) override;
+        void unbind(graphics_driver *driver) override;
+
+        bool set_draw_buffer(const std::int32_t attachment_id) override;
+        bool set_read_buffer(const std::int32_t attachment_id) override;
+        bool set_depth_stencil_buffer(texture *tex) override;
+        std::int32_t set_color_buffer(texture *tex, const std::int32_t position = -1) override;
+        bool remove_color_buffer(const std::int32_t position) override;
+
+        bool blit(const eka2l1::rect &source_rect, const eka2l1::rect &dest_rect, const std::uint32_t flags,
+            const filter_option copy_filter) override;
+
+        bool read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size,
+            std::uint8_t *buffer_ptr) override;
+
+        software_texture *get_color_buffer();
+    };
+
+    /**
+     * \brief Convert a row of pixels of a GL format and type into RGBA8.
+     *
+     * \returns False if the format is not supported.
+     */
+    bool convert_row_to_software(std::uint32_t *dest, const std::uint8_t *source, const std::size_t count, const texture_format format,
+        const texture_data_type data_type);
+
+    /**
+     * \brief Get the size of a pixel of a GL format and type in bytes. Zero if the format is not supported.
+     */
+    std::size_t software_source_pixel_size(const texture_format format, const texture_data_type data_type);
+}
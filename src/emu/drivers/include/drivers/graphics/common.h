@@ -26,7 +26,9 @@ namespace eka2l1::drivers {
 
     enum class graphic_api {
         opengl,
-        vulkan
+        vulkan,
+        null,           ///< Consumes commands without rendering. For headless runs and benchmarks.
+        software        ///< Renders the 2D commands on the CPU. For headless runs and reference images.
     };
 
     class graphics_object {
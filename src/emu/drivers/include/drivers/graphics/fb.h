@@ -107,6 +107,36 @@ namespace eka2l1::drivers {
         virtual bool remove_color_buffer(const std::int32_t position) = 0;
         virtual bool read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size, std::uint8_t *buffer_ptr) = 0;
 
+        /**
+         * @brief       Queue a read of the framebuffer into staging memory, without waiting for rendering to finish.
+         * 
+         * The framebuffer must be bound for reading. Complete the read later with finish_read.
+         * 
+         * @returns     Slot to pass to finish_read, or -1 if asynchronous read is not available or all slots are busy.
+         */
+        virtual std::int32_t start_read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size) {
+            return -1;
+        }
+
+        /**
+         * @brief       Check if a read queued by start_read has landed in staging memory.
+         */
+        virtual bool is_read_done(const std::int32_t slot) {
+            return true;
+        }
+
+        /**
+         * @brief       Wait for a read queued by start_read and copy it out. The slot can be reused afterwards.
+         * 
+         * @param       slot          Slot returned by start_read.
+         * @param       buffer_ptr    The buffer to write the data to, in the same layout as read().
+         * 
+         * @returns     True on success.
+         */
+        virtual bool finish_read(const std::int32_t slot, std::uint8_t *buffer_ptr) {
+            return false;
+        }
+
         virtual std::uint64_t color_attachment_handle(const std::int32_t attachment_id);
     };
 
@@ -102,7 +102,8 @@ namespace eka2l1::drivers {
     };
 
     enum graphics_driver_extension {
-        graphics_driver_extension_anisotrophy_filtering = 1 << 0
+        graphics_driver_extension_anisotrophy_filtering = 1 << 0,
+        graphics_driver_extension_base_vertex = 1 << 1         ///< Indexed draws can take a non-zero vertex base.
     };
 
     enum graphics_driver_extension_query {
@@ -111,6 +112,19 @@ namespace eka2l1::drivers {
 
     using display_hook = std::function<void()>;
 
+    /**
+     * \brief Counters describing the traffic between the emulator threads and the graphics thread.
+     */
+    struct graphics_queue_stats {
+        std::uint32_t depth_;               ///< Lists submitted but not yet picked up by the graphics thread.
+        std::uint32_t peak_depth_;          ///< Highest depth observed since the driver was created.
+        std::uint64_t submitted_lists_;     ///< Total lists submitted.
+        std::uint64_t producer_stall_us_;   ///< Time submitters spent waiting for a free slot, in microseconds.
+        std::uint64_t consumer_idle_us_;    ///< Time the graphics thread spent waiting for work, in microseconds.
+        std::uint64_t sprite_draws_;        ///< Bitmap and rectangle draws executed.
+        std::uint64_t sprite_draw_calls_;   ///< Backend draw calls issued for them, after batching.
+    };
+
     class graphics_driver : public driver {
         graphic_api api_;
 
@@ -162,6 +176,41 @@ namespace eka2l1::drivers {
          */
         virtual void submit_command_list(command_list &cmd_list) = 0;
 
+        /**
+         * \brief Get the fence of the most recently submitted command list.
+         *
+         * A fence is signalled once the driver has executed its list and every list submitted before it.
+         *
+         * \returns The fence value, which can be passed to wait_fence.
+         */
+        virtual std::uint64_t current_fence() const {
+            return 0;
+        }
+
+        /**
+         * \brief Get the fence of the most recently executed command list, without blocking.
+         *
+         * Every fence up to and including the returned value is signalled.
+         */
+        virtual std::uint64_t completed_fence() const {
+            return current_fence();
+        }
+
+        /**
+         * \brief Block the calling thread until the given fence is signalled, or the driver stops.
+         *
+         * \param fence     The fence to wait for.
+         */
+        virtual void wait_fence(const std::uint64_t fence) {
+        }
+
+        /**
+         * \brief Get a snapshot of the submission queue counters.
+         */
+        virtual graphics_queue_stats get_queue_stats() const {
+            return graphics_queue_stats{};
+        }
+
         virtual void set_upscale_shader(const std::string &name) = 0;
         virtual std::string get_active_upscale_shader() const = 0;
 
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/vecx.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace eka2l1::drivers {
+    // Quads of a batch are indexed with 16-bit indices, 4 vertices each
+    static constexpr std::size_t SPRITE_BATCH_MAX_QUADS = 4096;
+    static constexpr std::size_t SPRITE_BATCH_INDICES_PER_QUAD = 6;
+
+    enum sprite_batch_kind {
+        sprite_batch_kind_none,
+        sprite_batch_kind_textured,         ///< Bitmap blit, textured and tinted.
+        sprite_batch_kind_fill              ///< Rectangle filled with the brush color.
+    };
+
+    /**
+     * \brief State that all quads of a batch share.
+     */
+    struct sprite_batch_key {
+        sprite_batch_kind kind_ = sprite_batch_kind_none;
+        std::uint64_t texture_ = 0;                     ///< Backend texture handle. 0 for fills.
+        std::array<float, 4> color_ = {};
+
+        bool operator==(const sprite_batch_key &rhs) const {
+            return (kind_ == rhs.kind_) && (texture_ == rhs.texture_) && (color_ == rhs.color_);
+        }
+
+        bool operator!=(const sprite_batch_key &rhs) const {
+            return !(*this == rhs);
+        }
+    };
+
+    /**
+     * \brief A vertex of a batched quad. Position is in framebuffer pixels.
+     */
+    struct sprite_vertex {
+        float pos_[2];
+        float coord_[2];
+    };
+
+    struct sprite_batch_stats {
+        std::uint64_t sprites_;             ///< Bitmap and rectangle draws requested.
+        std::uint64_t draw_calls_;          ///< Draw calls issued for them.
+    };
+
+    /**
+     * \brief Collect consecutive bitmap and rectangle draws sharing the same state into one draw.
+     *
+     * Quads are transformed on the CPU, so the backend draws a batch with an identity model matrix
+     * and the indices from fill_quad_indices. The backend must flush the batch before any command
+     * that changes the state a draw depends on (program, blend, clip, target, texture content).
+     */
+    class sprite_batch {
+        std::vector<sprite_vertex> vertices_;
+        sprite_batch_key key_;
+
+        std::atomic<std::uint64_t> sprites_;
+        std::atomic<std::uint64_t> draw_calls_;
+
+    public:
+        explicit sprite_batch();
+
+        /**
+         * \brief Check if a quad with the given state can go into this batch without flushing first.
+         */
+        bool can_append(const sprite_batch_key &key) const;
+
+        /**
+         * \brief Add a textured quad.
+         *
+         * \param dest          Destination rectangle in pixels. Size must be resolved already.
+         * \param source        Source rectangle in texels. Empty to use the whole texture.
+         * \param texture_size  Size of the texture, to normalise source coordinates.
+         * \param origin        Rotation origin, relative to the top left of the destination.
+         * \param rotation      Rotation in degrees.
+         * \param flip          Flip the texture vertically.
+         */
+        void add_sprite(const sprite_batch_key &key, const eka2l1::rect &dest, const eka2l1::rect &source,
+            const eka2l1::vec2 &texture_size, const eka2l1::vec2 &origin, const float rotation, const bool flip);
+
+        /**
+         * \brief Add a rectangle fill.
+         */
+        void add_fill(const sprite_batch_key &key, const eka2l1::rect &dest);
+
+        /**
+         * \brief Count a draw that was issued alone, outside of a batch.
+         */
+        void count_unbatched_draw();
+
+        /**
+         * \brief Empty the batch, after the backend has drawn it.
+         */
+        void clear();
+
+        bool empty() const {
+            return vertices_.empty();
+        }
+
+        std::size_t quad_count() const {
+            return vertices_.size() / 4;
+        }
+
+        const std::vector<sprite_vertex> &vertices() const {
+            return vertices_;
+        }
+
+        const sprite_batch_key &key() const {
+            return key_;
+        }
+
+        sprite_batch_stats get_stats() const;
+
+        /**
+         * \brief Fill the index list to draw a batch of quads with, as triangles.
+         *
+         * \param dest          Must have room for quad_count * SPRITE_BATCH_INDICES_PER_QUAD indices.
+         */
+        static void fill_quad_indices(std::uint16_t *dest, const std::size_t quad_count);
+    };
+}
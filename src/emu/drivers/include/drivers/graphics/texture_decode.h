@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <drivers/graphics/common.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace eka2l1::common {
+    class thread_pool;
+}
+
+namespace eka2l1::drivers {
+    /**
+     * \brief Decode one 8-byte ETC1 block into 4x4 RGBA8 pixels.
+     *
+     * The colors of both sub-blocks are computed with SSE2 or NEON when the target has it. Blocks
+     * using the ETC2 T, H or planar modes are handed to the reference ETC2 decoder.
+     *
+     * \param block         The block, in the big endian layout of the format.
+     * \param dest          Where the top left pixel goes.
+     * \param dest_pitch    Bytes between two rows of the destination.
+     */
+    void decode_etc_block(const std::uint8_t *block, std::uint8_t *dest, const std::size_t dest_pitch);
+
+    /**
+     * \brief Same as decode_etc_block, but never uses the vector paths. Exists for testing.
+     */
+    void decode_etc_block_scalar(const std::uint8_t *block, std::uint8_t *dest, const std::size_t dest_pitch);
+
+    /**
+     * \brief Decode an ETC1/ETC2 RGB texture into tightly packed RGBA8.
+     *
+     * Rows of blocks are spread over the thread pool. Sizes that are not a multiple of 4 are supported.
+     *
+     * \param dest      Destination, width * height * 4 bytes.
+     * \param source    The compressed data, one 8-byte block per 4x4 pixels.
+     * \param pool      Pool to decode on. Null to decode on the calling thread.
+     */
+    void decode_etc_texture(std::uint8_t *dest, const std::uint8_t *source, const std::uint32_t width, const std::uint32_t height,
+        common::thread_pool *pool);
+
+    /**
+     * \brief Decode a PVRTC 2bpp or 4bpp texture into tightly packed RGBA8.
+     *
+     * Rows of PVRTC words are spread over the thread pool. Each row writes a different set of
+     * pixels, so no synchronization is needed.
+     */
+    void decode_pvrtc_texture(std::uint8_t *dest, const std::uint8_t *source, const std::uint32_t width, const std::uint32_t height,
+        const bool is_2bpp, common::thread_pool *pool);
+
+    /**
+     * \brief Expand one level of an OES_compressed_paletted_texture image.
+     *
+     * Texels are packed without row padding. With 4-bit indices, the first texel of a byte is in the
+     * high nibble.
+     *
+     * \param dest              Destination, width * height * entry_size bytes.
+     * \param indices           The indices of the level.
+     * \param palette           The palette, 16 or 256 entries.
+     * \param index_bits        4 or 8.
+     * \param entry_size        Size of a palette entry in bytes, from 1 to 4.
+     * \param texel_count       Number of texels in the level.
+     * \param pool              Pool to expand on. Null to expand on the calling thread.
+     */
+    void decode_paletted_texture(std::uint8_t *dest, const std::uint8_t *indices, const std::uint8_t *palette, const std::uint32_t index_bits,
+        const std::uint32_t entry_size, const std::size_t texel_count, common::thread_pool *pool);
+
+    struct decoded_texture_cache_stats {
+        std::uint64_t hits_ = 0;
+        std::uint64_t disk_hits_ = 0;
+        std::uint64_t misses_ = 0;
+        std::size_t used_bytes_ = 0;
+    };
+
+    using decoded_texture = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+    /**
+     * \brief Keep decoded textures around, keyed by a hash of their compressed content.
+     *
+     * Entries are evicted least recently used first once the byte budget is exceeded. With a disk
+     * path set, decoded textures are also written there and looked up on a memory miss, so they
+     * survive restarts. All functions are thread-safe.
+     */
+    class decoded_texture_cache {
+        struct entry {
+            decoded_texture data_;
+            std::list<std::uint64_t>::iterator lru_ite_;
+        };
+
+        std::mutex lock_;
+        std::unordered_map<std::uint64_t, entry> entries_;
+        std::list<std::uint64_t> lru_;
+
+        std::size_t budget_;
+        std::string disk_path_;
+        decoded_texture_cache_stats stats_;
+
+        void add_locked(const std::uint64_t key, decoded_texture data);
+
+    public:
+        explicit decoded_texture_cache(const std::size_t budget);
+
+        /**
+         * \brief Make the key of a compressed texture.
+         */
+        static std::uint64_t make_key(const texture_format format, const std::uint32_t width, const std::uint32_t height,
+            const void *data, const std::size_t data_size);
+
+        /**
+         * \brief Find a decoded texture.
+         *
+         * \param key               Key of the texture.
+         * \param expected_size     Size the decoded data must have. Disk entries of another size are ignored.
+         *
+         * \returns Null on miss.
+         */
+        decoded_texture get(const std::uint64_t key, const std::size_t expected_size);
+        decoded_texture put(const std::uint64_t key, std::vector<std::uint8_t> &&data);
+
+        /**
+         * \brief Set the folder decoded textures are persisted in. Empty to keep them in memory only.
+         */
+        void set_disk_path(const std::string &path);
+
+        decoded_texture_cache_stats get_stats();
+    };
+}
@@ -39,6 +39,7 @@
 #include <mutex>
 #include <optional>
 #include <string>
+#include <utility>
 
 namespace eka2l1::drivers {
     struct command_list;
@@ -160,7 +161,6 @@ namespace eka2l1::drivers {
         const std::uint32_t bpp, std::uint8_t *buffer_ptr);
 
     static constexpr std::size_t MAX_THRESHOLD_TO_FLUSH = 12000;
-    static constexpr std::size_t MAX_CAP_COMMAND_COUNT = 12800;
 
     #define PACK_2U32_TO_U64(a, b) (static_cast<std::uint64_t>(b) << 32) | static_cast<std::uint32_t>(a)
 
@@ -177,16 +177,16 @@ namespace eka2l1::drivers {
     protected:
         command_list list_;
 
-    public:
-        explicit graphics_command_builder()
-            : list_(MAX_CAP_COMMAND_COUNT) {
-        }
+        /**
+         * @brief Reserve a command, with room for a copy of the given data right after its data words.
+         * 
+         * @returns Pointer to the copy as a command argument, or 0 if there is no data.
+         */
+        std::uint64_t create_command_with_payload(command *&cmd, const std::uint32_t word_count,
+            const void *data, const std::size_t size);
 
-        ~graphics_command_builder() {
-            if (list_.base_) {
-                delete list_.base_;
-            }
-        }
+    public:
+        explicit graphics_command_builder() = default;
 
         bool is_empty() const {
             return list_.size_ == 0;
@@ -197,18 +197,11 @@ namespace eka2l1::drivers {
         }
 
         void reset_list() {
-            delete list_.base_;
-
-            list_.size_ = 0;
-            list_.base_ = nullptr;
+            list_.release();
         }
 
         command_list retrieve_command_list() {
-            command_list copy = list_;
-            list_.base_ = nullptr;
-            list_.size_ = 0;
-
-            return copy;
+            return std::move(list_);
         }
 
         command *create_next_command() {
@@ -216,22 +209,7 @@ namespace eka2l1::drivers {
         }
 
         bool merge(command_list &another) {
-            if (!another.base_ || !another.size_) {
-                return true;
-            }
-
-            if (list_.base_ == nullptr) {
-                list_ = another;
-            } else {
-                if (another.size_ + list_.size_ > list_.max_cap_) {
-                    return false;
-                }
-
-                std::memcpy(list_.base_ + list_.size_, another.base_, another.size_ * sizeof(command));
-                list_.size_ += another.size_;
-            }
-
-            delete[] another.base_;
+            list_.append(another);
             return true;
         }
 
@@ -291,6 +269,25 @@ namespace eka2l1::drivers {
             const eka2l1::vec2 &offset, const eka2l1::vec2 &dim, const std::size_t pixels_per_line = 0,
             const bool need_copy = true);
 
+        /**
+         * \brief Read bitmap data back to memory, without waiting for the read to complete.
+         *
+         * The status is set to -100 and stays so until the data has landed in the buffer. The buffer
+         * must stay alive and untouched until then; wait on the status with the driver's wait_for.
+         *
+         * Reads of a bitmap whose content has not changed since the last read are served from a
+         * CPU copy the driver keeps.
+         *
+         * \param h                 Handle to the bitmap.
+         * \param pos               The position to start clipping bitmap data from.
+         * \param size              The size of the clipped bitmap region.
+         * \param bpp               The target BPP that will be written to the memory.
+         * \param buffer_ptr        The buffer to read the data into.
+         * \param status            Pointer to the status, which is 1 on success and 0 on failure once completed.
+         */
+        void read_bitmap(drivers::handle h, const eka2l1::point &pos, const eka2l1::object_size &size,
+            const std::uint32_t bpp, std::uint8_t *buffer_ptr, int *status);
+
         /**
          * @brief Update a texture data region.
          * 
@@ -313,6 +310,19 @@ namespace eka2l1::drivers {
             const eka2l1::vec3 &offset, const eka2l1::vec3 &dim, const std::size_t pixels_per_line = 0,
             const std::uint32_t unpack_alignment = 4);
 
+        /**
+         * @brief Update a texture data region from memory that stays owned by the caller.
+         * 
+         * Unlike update_texture, the data is not copied into the list. The memory must stay alive and
+         * untouched until the fence of the submitted list is signalled.
+         * 
+         * @see update_texture
+         */
+        void update_texture_from_staging(drivers::handle h, const char *data, const std::size_t size,
+            const std::uint8_t level, const texture_format data_format, const texture_data_type data_type,
+            const eka2l1::vec3 &offset, const eka2l1::vec3 &dim, const std::size_t pixels_per_line = 0,
+            const std::uint32_t unpack_alignment = 4);
+
         /**
          * \brief Draw a bitmap to currently binded bitmap.
          *
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2022 EKA2L1 Team.
+ * 
+ * This file is part of EKA2L1 project 
+ * (see bentokun.github.com/EKA2L1).
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/driver.h>
+
+#include <new>
+#include <vector>
+
+namespace eka2l1::drivers {
+    // Lists are built on emulator threads and released on the driver thread, so the pool is shared and locked.
+    struct command_chunk_pool {
+        std::mutex lock_;
+        std::vector<command_chunk *> free_chunks_;
+
+        ~command_chunk_pool() {
+            for (command_chunk *chunk : free_chunks_) {
+                ::operator delete(chunk);
+            }
+        }
+    };
+
+    static command_chunk_pool &get_command_chunk_pool() {
+        static command_chunk_pool pool;
+        return pool;
+    }
+
+    command_chunk *acquire_command_chunk(const std::size_t min_capacity) {
+        command_chunk *chunk = nullptr;
+
+        if (min_capacity <= COMMAND_CHUNK_SIZE) {
+            command_chunk_pool &pool = get_command_chunk_pool();
+            const std::lock_guard<std::mutex> guard(pool.lock_);
+
+            if (!pool.free_chunks_.empty()) {
+                chunk = pool.free_chunks_.back();
+                pool.free_chunks_.pop_back();
+            }
+        }
+
+        if (!chunk) {
+            const std::size_t capacity = (min_capacity <= COMMAND_CHUNK_SIZE) ? COMMAND_CHUNK_SIZE : min_capacity;
+
+            chunk = reinterpret_cast<command_chunk *>(::operator new(sizeof(command_chunk) + capacity));
+            chunk->capacity_ = capacity;
+        }
+
+        chunk->next_ = nullptr;
+        chunk->size_ = 0;
+
+        return chunk;
+    }
+
+    void release_command_chunks(command_chunk *first) {
+        command_chunk_pool &pool = get_command_chunk_pool();
+        const std::lock_guard<std::mutex> guard(pool.lock_);
+
+        while (first) {
+            command_chunk *next = first->next_;
+
+            // Oversized chunks are one-off (big texture uploads), do not keep them around
+            if ((first->capacity_ == COMMAND_CHUNK_SIZE) && (pool.free_chunks_.size() < MAX_FREE_COMMAND_CHUNKS)) {
+                pool.free_chunks_.push_back(first);
+            } else {
+                ::operator delete(first);
+            }
+
+            first = next;
+        }
+    }
+}
@@ -27,6 +27,9 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace eka2l1::drivers {
     static void translate_bpp_to_format(const int bpp, texture_format &internal_format, texture_format &format,
         texture_data_type &data_type, const bool stricted) {
@@ -113,7 +116,10 @@ namespace eka2l1::drivers {
     }
 
     bitmap::bitmap(graphics_driver *driver, const eka2l1::vec2 &size, const int initial_bpp)
-        : bpp(initial_bpp) {
+        : bpp(initial_bpp)
+        , generation(0)
+        , read_cache_generation(0)
+        , read_cache_bpp(0) {
         // Make color buffer for our bitmap!
         tex = std::move(instantiate_suit_color_bitmap_texture(driver, size, bpp));
     }
@@ -148,6 +154,8 @@ namespace eka2l1::drivers {
 
         tex = std::move(tex_to_replace);
         ds_tex = std::move(ds_tex_to_replace);
+
+        generation++;
     }
 
     void bitmap::init_fb(graphics_driver *driver) {
@@ -159,7 +167,8 @@ namespace eka2l1::drivers {
         : graphics_driver(gr_api)
         , binding(nullptr)
         , brush_color({ 255.0f, 255.0f, 255.0f, 255.0f })
-        , current_fb_height(0) {
+        , current_fb_height(0)
+        , read_cache_bytes_(0) {
     }
 
     shared_graphics_driver::~shared_graphics_driver() {
@@ -215,6 +224,8 @@ namespace eka2l1::drivers {
             return;
         }
 
+        bmp->generation++;
+
         texture_format internal_format = texture_format::none;
         texture_format data_format = texture_format::none;
         texture_data_type data_type = texture_data_type::ubyte;
@@ -280,7 +291,7 @@ namespace eka2l1::drivers {
 
         update_bitmap(handle, size, offset, dim, data, pixels_per_line);
 
-        delete[] data;
+        cmd.free_data(data);
     }
 
     void shared_graphics_driver::update_texture(command &cmd) {
@@ -306,7 +317,7 @@ namespace eka2l1::drivers {
 
         obj->update_data(this, static_cast<int>(lvl), offset, dim, pixels_per_line, data_format, data_type, data, size, unpack_alignment);
 
-        delete[] data;
+        cmd.free_data(data);
     }
 
     void shared_graphics_driver::create_bitmap(command &cmd) {
@@ -375,6 +386,9 @@ namespace eka2l1::drivers {
         bmp->fb->bind(this, bind_type);
         binding = bmp;
 
+        // Anything drawn from now on lands in this bitmap. Reads of it are not cached while it's bound.
+        bmp->generation++;
+
         bool no_need_flip = !(!binding && (get_current_api() == drivers::graphic_api::opengl));
 
         // Build projection matrixx
@@ -438,16 +452,129 @@ namespace eka2l1::drivers {
             return;
         }
 
+        // 8, 24 and 32 bpp are all read back as RGBA. Each row is aligned to 4 bytes.
+        const std::size_t bytes_per_pixel = ((bpp == 12) || (bpp == 16)) ? 2 : 4;
+        const std::size_t read_size = ((((size.x * bytes_per_pixel) + 3) >> 2) << 2) * size.y;
+
+        // While the bitmap is bound, commands after this one may still draw to it
+        const bool cacheable = (bmp != binding);
+
+        if (cacheable && !bmp->read_cache.empty() && (bmp->read_cache_generation == bmp->generation) && (bmp->read_cache_pos == pos)
+            && (bmp->read_cache_size == size) && (bmp->read_cache_bpp == bpp)) {
+            std::memcpy(ptr, bmp->read_cache.data(), read_size);
+            finish(cmd.status_, true);
+
+            return;
+        }
+
         if (!bmp->fb) {
             // Make new one
             bmp->init_fb(this);
         }
 
+        pending_bitmap_read read;
+        read.bmp_ = bmp;
+        read.dest_ = ptr;
+        read.dest_size_ = read_size;
+        read.status_ = cmd.status_;
+        read.cacheable_ = cacheable;
+        read.generation_ = bmp->generation;
+        read.pos_ = pos;
+        read.size_ = size;
+        read.bpp_ = bpp;
+
         bmp->fb->bind(this, drivers::framebuffer_bind_read_draw);
-        const bool res = bmp->fb->read(target_format, target_data_type, pos, size, ptr);
+        read.slot_ = bmp->fb->start_read(target_format, target_data_type, pos, size);
+
+        if (read.slot_ < 0) {
+            // Both staging slots are busy or async read is not supported. Free up the oldest read
+            // of this bitmap and try again before falling back to a blocking read.
+            auto oldest = std::find_if(pending_reads_.begin(), pending_reads_.end(), [bmp](const pending_bitmap_read &pending) {
+                return pending.bmp_ == bmp;
+            });
+
+            if (oldest != pending_reads_.end()) {
+                complete_bitmap_read(*oldest);
+                pending_reads_.erase(oldest);
+
+                read.slot_ = bmp->fb->start_read(target_format, target_data_type, pos, size);
+            }
+        }
+
+        if (read.slot_ < 0) {
+            const bool res = bmp->fb->read(target_format, target_data_type, pos, size, ptr);
+            bmp->fb->unbind(this);
+
+            if (res && cacheable) {
+                store_read_cache(bmp, read);
+            }
+
+            finish(cmd.status_, res);
+            return;
+        }
+
         bmp->fb->unbind(this);
+        pending_reads_.push_back(read);
+    }
+
+    void shared_graphics_driver::complete_bitmap_read(pending_bitmap_read &read) {
+        bitmap *bmp = read.bmp_;
+        const bool res = bmp->fb->finish_read(read.slot_, read.dest_);
 
-        finish(cmd.status_, res);
+        if (res && read.cacheable_) {
+            store_read_cache(bmp, read);
+        }
+
+        finish(read.status_, res);
+    }
+
+    void shared_graphics_driver::store_read_cache(bitmap *bmp, const pending_bitmap_read &read) {
+        drop_read_cache(bmp);
+
+        if (read.dest_size_ > MAX_BITMAP_READ_CACHE_BYTES / 2) {
+            return;
+        }
+
+        // Make room by dropping other bitmaps' copies
+        for (std::size_t i = 0; (i < bmp_textures.size()) && (read_cache_bytes_ + read.dest_size_ > MAX_BITMAP_READ_CACHE_BYTES); i++) {
+            if (bmp_textures[i]) {
+                drop_read_cache(bmp_textures[i].get());
+            }
+        }
+
+        bmp->read_cache.assign(read.dest_, read.dest_ + read.dest_size_);
+        bmp->read_cache_generation = read.generation_;
+        bmp->read_cache_pos = read.pos_;
+        bmp->read_cache_size = read.size_;
+        bmp->read_cache_bpp = read.bpp_;
+
+        read_cache_bytes_ += bmp->read_cache.size();
+    }
+
+    void shared_graphics_driver::drop_read_cache(bitmap *bmp) {
+        read_cache_bytes_ -= bmp->read_cache.size();
+        std::vector<std::uint8_t>().swap(bmp->read_cache);
+    }
+
+    void shared_graphics_driver::resolve_pending_reads(const bool wait_all) {
+        if (pending_reads_.empty()) {
+            return;
+        }
+
+        // Complete in submission order, so a waiter on a later read also sees earlier ones done
+        std::size_t completed = 0;
+
+        for (; completed < pending_reads_.size(); completed++) {
+            pending_bitmap_read &read = pending_reads_[completed];
+
+            if (!wait_all && !read.bmp_->fb->is_read_done(read.slot_)) {
+                break;
+            }
+
+            complete_bitmap_read(read);
+        }
+
+        pending_reads_.erase(pending_reads_.begin(), pending_reads_.begin() + completed);
     }
 
     void shared_graphics_driver::destroy_bitmap(command &cmd) {
@@ -458,6 +585,12 @@ namespace eka2l1::drivers {
             return;
         }
 
+        resolve_pending_reads(true);
+
+        if (bmp_textures[(h & ~HANDLE_BITMAP) - 1]) {
+            drop_read_cache(bmp_textures[(h & ~HANDLE_BITMAP) - 1].get());
+        }
+
         bmp_textures[(h & ~HANDLE_BITMAP) - 1].reset();
     }
 
@@ -471,10 +604,14 @@ namespace eka2l1::drivers {
             return;
         }
 
+        // The staging buffers of pending reads belong to the framebuffer being replaced
+        resolve_pending_reads(true);
+
         vec2 new_size = { 0, 0 };
         unpack_u64_to_2u32(cmd.data_[1], new_size.x, new_size.y);
 
-        // Change texture size
+        // Change texture size. Any copy of an earlier read no longer matches
+        drop_read_cache(bmp);
         bmp->resize(this, new_size);
     }
 
@@ -581,7 +718,7 @@ namespace eka2l1::drivers {
         } else {
             if (data != nullptr) {
                 std::uint8_t *data_org = reinterpret_cast<std::uint8_t*>(data);
-                delete[] data_org;
+                cmd.free_data(data_org);
             }
         }
 
@@ -619,7 +756,7 @@ namespace eka2l1::drivers {
             finish(cmd.status_, 0);
         } else if ((initial_data != nullptr) && (existing_handle)) {
             std::uint8_t *data_casted = reinterpret_cast<std::uint8_t*>(initial_data);
-            delete[] data_casted;
+            cmd.free_data(data_casted);
         }
     }
 
@@ -653,7 +790,7 @@ namespace eka2l1::drivers {
             finish(cmd.status_, 0);
         } else if ((descs != nullptr) && (existing_handle)) {
             std::uint8_t *data_casted = reinterpret_cast<std::uint8_t*>(descs);
-            delete[] data_casted;
+            cmd.free_data(data_casted);
         }
     }
 
@@ -734,7 +871,7 @@ namespace eka2l1::drivers {
 
         bufobj->update_data(this, data, offset, size);
 
-        delete[] data;
+        cmd.free_data(data);
     }
 
     void shared_graphics_driver::destroy_object(command &cmd) {
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/graphics/backend/graphics_driver_shared.h>
+#include <drivers/graphics/backend/null/graphics_null.h>
+#include <drivers/itc.h>
+
+#include <common/buffer.h>
+#include <common/log.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace eka2l1::drivers {
+    static constexpr std::uint32_t NULL_RECORD_MAGIC = 0x5343474E; // NGCS
+    static constexpr std::uint32_t NULL_RECORD_VERSION = 1;
+
+    null_graphics_driver::null_graphics_driver()
+        : graphics_driver(graphic_api::null)
+        , should_stop_(false)
+        , submitted_lists_(0)
+        , invalid_handle_uses_(0) {
+    }
+
+    null_graphics_driver::~null_graphics_driver() {
+        if (live_object_count() != 0) {
+            LOG_TRACE(DRIVER_GRAPHICS, "Null graphics driver destroyed with {} objects still alive", live_object_count());
+        }
+    }
+
+    void null_graphics_driver::run() {
+        // Lists are processed on submit. Just stay here until told to stop, like a real backend would.
+        std::unique_lock<std::mutex> ulock(mut_);
+        cond_.wait(ulock, [this]() { return should_stop_.load(); });
+    }
+
+    void null_graphics_driver::abort() {
+        should_stop_ = true;
+
+        const std::lock_guard<std::mutex> guard(mut_);
+        cond_.notify_all();
+    }
+
+    bool null_graphics_driver::is_bitmap_valid(const drivers::handle h) {
+        if ((h & HANDLE_BITMAP) == 0) {
+            return false;
+        }
+
+        const drivers::handle index = (h & ~HANDLE_BITMAP);
+        return (index != 0) && (index <= bitmaps_.size()) && bitmaps_[index - 1];
+    }
+
+    bool null_graphics_driver::is_object_valid(const drivers::handle h, const null_object_kind kind) {
+        if ((h == 0) || (h > objects_.size())) {
+            return false;
+        }
+
+        return objects_[h - 1] == kind;
+    }
+
+    void null_graphics_driver::check_bitmap(const drivers::handle h) {
+        if (!is_bitmap_valid(h)) {
+            invalid_handle_uses_++;
+        }
+    }
+
+    void null_graphics_driver::check_object(const drivers::handle h, const null_object_kind kind) {
+        // Texture-like slots also accept bitmaps
+        if ((kind == null_object_texture) && (h & HANDLE_BITMAP)) {
+            check_bitmap(h);
+            return;
+        }
+
+        if (!is_object_valid(h, kind)) {
+            invalid_handle_uses_++;
+        }
+    }
+
+    drivers::handle null_graphics_driver::new_bitmap() {
+        auto free_slot = std::find(bitmaps_.begin(), bitmaps_.end(), false);
+
+        if (free_slot != bitmaps_.end()) {
+            *free_slot = true;
+            return (std::distance(bitmaps_.begin(), free_slot) + 1) | HANDLE_BITMAP;
+        }
+
+        bitmaps_.push_back(true);
+        return bitmaps_.size() | HANDLE_BITMAP;
+    }
+
+    drivers::handle null_graphics_driver::new_object(const null_object_kind kind) {
+        auto free_slot = std::find(objects_.begin(), objects_.end(), null_object_none);
+
+        if (free_slot != objects_.end()) {
+            *free_slot = kind;
+            return std::distance(objects_.begin(), free_slot) + 1;
+        }
+
+        objects_.push_back(kind);
+        return objects_.size();
+    }
+
+    template <typename T>
+    static void store_result(const std::uint64_t address, const T value) {
+        T *store = reinterpret_cast<T *>(address);
+
+        if (store) {
+            *store = value;
+        }
+    }
+
+    std::uint64_t null_graphics_driver::process(command &cmd) {
+        // Bytes referred to by the command, but not part of the list
+        std::uint64_t external_bytes = 0;
+
+        switch (cmd.opcode_) {
+        case graphics_driver_create_bitmap:
+            store_result(cmd.data_[2], new_bitmap());
+            finish(cmd.status_, 0);
+            break;
+
+        case graphics_driver_destroy_bitmap:
+            if (is_bitmap_valid(cmd.data_[0])) {
+                bitmaps_[(cmd.data_[0] & ~HANDLE_BITMAP) - 1] = false;
+            } else {
+                invalid_handle_uses_++;
+            }
+
+            break;
+
+        case graphics_driver_bind_bitmap:
+            if (cmd.data_[0] != 0) {
+                check_bitmap(cmd.data_[0]);
+            }
+
+            if ((cmd.word_count_ > 1) && (cmd.data_[1] != 0)) {
+                check_bitmap(cmd.data_[1]);
+            }
+
+            break;
+
+        case graphics_driver_resize_bitmap:
+            check_bitmap(cmd.data_[0]);
+            break;
+
+        case graphics_driver_update_bitmap:
+            check_bitmap(cmd.data_[0]);
+
+            if (!(cmd.flags_ & command_flag_inline_payload)) {
+                external_bytes = cmd.data_[2];
+            }
+
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_read_bitmap:
+            // No pixels exist to read, leave the destination alone
+            finish(cmd.status_, is_bitmap_valid(cmd.data_[0]));
+            break;
+
+        case graphics_driver_draw_bitmap:
+            check_object(cmd.data_[0], null_object_texture);
+
+            if (cmd.data_[1] != 0) {
+                check_object(cmd.data_[1], null_object_texture);
+            }
+
+            break;
+
+        case graphics_driver_update_texture:
+            check_object(cmd.data_[0], null_object_texture);
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_clip_region:
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_draw_polygon:
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_create_shader_module:
+            store_result(cmd.data_[3], new_object(null_object_shader_module));
+            finish(cmd.status_, 0);
+            break;
+
+        case graphics_driver_create_shader_program:
+            check_object(cmd.data_[0], null_object_shader_module);
+            check_object(cmd.data_[1], null_object_shader_module);
+
+            // No metadata, callers treat this as reflection being unavailable
+            store_result<void *>(cmd.data_[2], nullptr);
+            store_result(cmd.data_[3], new_object(null_object_shader_program));
+            finish(cmd.status_, 0);
+
+            break;
+
+        case graphics_driver_create_texture:
+            if (cmd.data_[7] != 0) {
+                check_object(cmd.data_[7], null_object_texture);
+                cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            } else {
+                store_result(cmd.data_[8], new_object(null_object_texture));
+            }
+
+            finish(cmd.status_, 0);
+            break;
+
+        case graphics_driver_create_buffer:
+            if (cmd.data_[3] != 0) {
+                check_object(cmd.data_[3], null_object_buffer);
+                cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[0]));
+            } else {
+                store_result(cmd.data_[4], new_object(null_object_buffer));
+                finish(cmd.status_, 0);
+            }
+
+            break;
+
+        case graphics_driver_create_input_descriptor:
+            if (cmd.data_[2] != 0) {
+                check_object(cmd.data_[2], null_object_input_descriptors);
+                cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[0]));
+            } else {
+                store_result(cmd.data_[3], new_object(null_object_input_descriptors));
+                finish(cmd.status_, 0);
+            }
+
+            break;
+
+        case graphics_driver_destroy_object: {
+            const drivers::handle h = cmd.data_[0];
+
+            if ((h != 0) && (h <= objects_.size()) && (objects_[h - 1] != null_object_none)) {
+                objects_[h - 1] = null_object_none;
+            } else {
+                invalid_handle_uses_++;
+            }
+
+            break;
+        }
+
+        case graphics_driver_use_program:
+            check_object(cmd.data_[0], null_object_shader_program);
+            break;
+
+        case graphics_driver_set_uniform:
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_bind_texture:
+        case graphics_driver_set_texture_filter:
+        case graphics_driver_set_texture_wrap:
+        case graphics_driver_generate_mips:
+        case graphics_driver_set_max_mip_level:
+        case graphics_driver_set_texture_anisotrophy:
+        case graphics_driver_set_swizzle:
+            check_object(cmd.data_[0], null_object_texture);
+            break;
+
+        case graphics_driver_bind_vertex_buffers: {
+            const drivers::handle *arr = reinterpret_cast<const drivers::handle *>(cmd.data_[0]);
+            const std::uint32_t count = static_cast<std::uint32_t>(cmd.data_[1] >> 32);
+
+            for (std::uint32_t i = 0; i < count; i++) {
+                check_object(arr[i], null_object_buffer);
+            }
+
+            cmd.free_data(arr);
+            break;
+        }
+
+        case graphics_driver_bind_index_buffer:
+            check_object(cmd.data_[0], null_object_buffer);
+            break;
+
+        case graphics_driver_bind_input_descriptor:
+            check_object(cmd.data_[0], null_object_input_descriptors);
+            break;
+
+        case graphics_driver_update_buffer:
+            check_object(cmd.data_[0], null_object_buffer);
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_display:
+            if (disp_hook_) {
+                disp_hook_();
+            }
+
+            finish(cmd.status_, 0);
+            break;
+
+        default:
+            // Pure state changes and draws, nothing to validate. Still complete anything that waits.
+            finish(cmd.status_, 0);
+            break;
+        }
+
+        return external_bytes;
+    }
+
+    void null_graphics_driver::record(const command &cmd) {
+        const std::uint8_t *record_start = reinterpret_cast<const std::uint8_t *>(&cmd);
+        const std::uint8_t *record_end = record_start + cmd.size_;
+
+        const std::size_t pos = record_buffer_.size();
+        record_buffer_.resize(pos + sizeof(std::uint16_t) + cmd.size_);
+
+        std::uint8_t *dest = record_buffer_.data() + pos;
+        std::memcpy(dest + sizeof(std::uint16_t), record_start, cmd.size_);
+
+        command *copied = reinterpret_cast<command *>(dest + sizeof(std::uint16_t));
+        copied->status_ = nullptr;
+
+        std::uint16_t relocated_mask = 0;
+
+        for (std::uint8_t i = 0; i < cmd.word_count_; i++) {
+            const std::uint8_t *target = reinterpret_cast<const std::uint8_t *>(cmd.data_[i]);
+
+            if ((target >= record_start) && (target < record_end)) {
+                copied->data_[i] = static_cast<std::uint64_t>(target - record_start);
+                relocated_mask |= static_cast<std::uint16_t>(1 << i);
+            }
+        }
+
+        std::memcpy(dest, &relocated_mask, sizeof(std::uint16_t));
+    }
+
+    void null_graphics_driver::submit_command_list(command_list &cmd_list) {
+        if (should_stop_) {
+            cmd_list.release();
+            return;
+        }
+
+        const std::lock_guard<std::mutex> guard(process_lock_);
+
+        cmd_list.iterate([this](command &cmd) {
+            if (record_stream_) {
+                record(cmd);
+            }
+
+            const std::uint64_t external_bytes = process(cmd);
+
+            if (cmd.opcode_ >= stats_.size()) {
+                stats_.resize(cmd.opcode_ + 1);
+            }
+
+            stats_[cmd.opcode_].count_++;
+            stats_[cmd.opcode_].bytes_ += cmd.size_ + external_bytes;
+        });
+
+        if (record_stream_ && !record_buffer_.empty()) {
+            record_stream_->write(record_buffer_.data(), record_buffer_.size());
+            record_buffer_.clear();
+        }
+
+        submitted_lists_++;
+        cmd_list.release();
+    }
+
+    void null_graphics_driver::update_bitmap(drivers::handle h, const std::size_t size, const eka2l1::vec2 &offset,
+        const eka2l1::vec2 &dim, const void *data, const std::size_t pixels_per_line) {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+        check_bitmap(h);
+    }
+
+    void null_graphics_driver::set_viewport(const eka2l1::rect &viewport) {
+    }
+
+    void null_graphics_driver::update_surface(void *surface) {
+    }
+
+    void null_graphics_driver::set_upscale_shader(const std::string &name) {
+    }
+
+    std::string null_graphics_driver::get_active_upscale_shader() const {
+        return "Default";
+    }
+
+    bool null_graphics_driver::support_extension(const graphics_driver_extension ext) {
+        return false;
+    }
+
+    bool null_graphics_driver::query_extension_value(const graphics_driver_extension_query query, void *data_ptr) {
+        return false;
+    }
+
+    std::uint64_t null_graphics_driver::current_fence() const {
+        return submitted_lists_;
+    }
+
+    graphics_queue_stats null_graphics_driver::get_queue_stats() const {
+        graphics_queue_stats stats{};
+        stats.submitted_lists_ = submitted_lists_;
+
+        return stats;
+    }
+
+    bool null_graphics_driver::start_recording(const std::string &path) {
+        auto stream = std::make_unique<common::wo_std_file_stream>(path, true);
+
+        if (!stream->valid()) {
+            LOG_ERROR(DRIVER_GRAPHICS, "Unable to open {} to record graphics commands", path);
+            return false;
+        }
+
+        stream->write(&NULL_RECORD_MAGIC, sizeof(NULL_RECORD_MAGIC));
+        stream->write(&NULL_RECORD_VERSION, sizeof(NULL_RECORD_VERSION));
+
+        const std::lock_guard<std::mutex> guard(process_lock_);
+        record_stream_ = std::move(stream);
+
+        return true;
+    }
+
+    void null_graphics_driver::stop_recording() {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+        record_stream_.reset();
+    }
+
+    std::vector<graphics_command_stats> null_graphics_driver::get_command_stats() {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+        return stats_;
+    }
+
+    void null_graphics_driver::reset_command_stats() {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+
+        stats_.clear();
+        invalid_handle_uses_ = 0;
+    }
+
+    std::uint64_t null_graphics_driver::invalid_handle_uses() {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+        return invalid_handle_uses_;
+    }
+
+    std::size_t null_graphics_driver::live_object_count() {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+
+        return std::count(bitmaps_.begin(), bitmaps_.end(), true) + (objects_.size() - std::count(objects_.begin(), objects_.end(), null_object_none));
+    }
+}
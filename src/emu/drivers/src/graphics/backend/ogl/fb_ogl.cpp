@@ -25,6 +25,9 @@
 #include <common/log.h>
 #include <common/platform.h>
 
+#include <cstring>
+#include <vector>
+
 namespace eka2l1::drivers {
     ogl_framebuffer::ogl_framebuffer(std::initializer_list<texture *> color_buffer_list, texture *depth_and_stencil_buffer)
         : framebuffer(color_buffer_list, depth_and_stencil_buffer)
@@ -66,6 +69,16 @@ namespace eka2l1::drivers {
     }
 
     ogl_framebuffer::~ogl_framebuffer() {
+        for (pack_slot &slot : pack_slots_) {
+            if (slot.fence_) {
+                glDeleteSync(reinterpret_cast<GLsync>(slot.fence_));
+            }
+
+            if (slot.buffer_) {
+                glDeleteBuffers(1, &slot.buffer_);
+            }
+        }
+
         glDeleteFramebuffers(1, &fbo);
     }
 
@@ -210,7 +223,7 @@ namespace eka2l1::drivers {
         return true;
     }
 
-    bool ogl_framebuffer::read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size, std::uint8_t *buffer_ptr) {
+    static bool is_read_combination_valid(const texture_format type, const texture_data_type dest_format) {
         if ((type != texture_format::rgb) && (type != texture_format::rgba) && (type != texture_format::rgba4)) {
             LOG_ERROR(DRIVER_GRAPHICS, "Framebuffer read only supports RGB/RGBA/RGBA4 (got format={})", static_cast<int>(type));
             return false;
@@ -223,7 +236,11 @@ namespace eka2l1::drivers {
             LOG_ERROR(DRIVER_GRAPHICS, "Conflicted read back type/format!");
             return false;
         }
-        
+
+        return true;
+    }
+
+    static bool is_native_read_format(const texture_format type, const texture_data_type dest_format) {
         GLuint format_gl = texture_data_type_to_gl_enum(dest_format);
         GLuint type_gl = texture_format_to_gl_enum(type);
 
@@ -233,84 +250,227 @@ namespace eka2l1::drivers {
         glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &read_type);
         glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &read_format);
 
-        if ((read_format == format_gl) && (read_type == type_gl)) {
-            glReadPixels(pos.x, pos.y, size.x, size.y, type_gl, format_gl, buffer_ptr);
-            return true;
-        } else {
-            // Read RGBA than do manual conversion. Isn't this just too cruel!!
-            std::vector<std::uint8_t> temp_data;
-            temp_data.resize(size.x * 4 * size.y);
-
-            glReadPixels(pos.x, pos.y, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, temp_data.data());
-    
-            switch (dest_format) {
-            case texture_data_type::ushort_4_4_4_4: {
-                for (int y = 0; y < size.y; y++) {
-                    std::uint16_t *ptr = reinterpret_cast<std::uint16_t*>(buffer_ptr + (y * (((size.x * 2) + 3) >> 2) << 2));
-                    std::uint32_t *ptr_source = reinterpret_cast<std::uint32_t*>(temp_data.data() + y * size.x * 4);
-
-                    for (int x = 0; x < size.x; x++) {
-                        *ptr = ((((*ptr_source & 0xFF) / 17) & 0xF) << 8) | (((((*ptr_source >> 24) & 0xFF) / 17) & 0xF) << 12)
-                            | (((((*ptr_source >> 8) & 0xFF) / 17) & 0xF) << 4) | ((((*ptr_source >> 16) & 0xFF) / 17) & 0xF);
-                    
-                        ptr++;
-                        ptr_source++;
-                    }
+        return (read_format == format_gl) && (read_type == type_gl);
+    }
+
+    static std::size_t get_read_data_size(const texture_format type, const texture_data_type dest_format, const eka2l1::object_size &size) {
+        std::size_t bytes_per_pixel = 4;
+
+        if ((dest_format == texture_data_type::ushort_4_4_4_4) || (dest_format == texture_data_type::ushort_5_6_5)) {
+            bytes_per_pixel = 2;
+        } else if (type == texture_format::rgb) {
+            bytes_per_pixel = 3;
+        }
+
+        // Rows are aligned to 4 bytes, same as the default pack alignment
+        return ((((size.x * bytes_per_pixel) + 3) >> 2) << 2) * size.y;
+    }
+
+    static bool convert_rgba_read_data(const std::uint8_t *source, const texture_format type, const texture_data_type dest_format,
+        const eka2l1::object_size &size, std::uint8_t *buffer_ptr) {
+        switch (dest_format) {
+        case texture_data_type::ushort_4_4_4_4: {
+            for (int y = 0; y < size.y; y++) {
+                std::uint16_t *ptr = reinterpret_cast<std::uint16_t*>(buffer_ptr + (y * (((size.x * 2) + 3) >> 2) << 2));
+                const std::uint32_t *ptr_source = reinterpret_cast<const std::uint32_t*>(source + y * size.x * 4);
+
+                for (int x = 0; x < size.x; x++) {
+                    *ptr = ((((*ptr_source & 0xFF) / 17) & 0xF) << 8) | (((((*ptr_source >> 24) & 0xFF) / 17) & 0xF) << 12)
+                        | (((((*ptr_source >> 8) & 0xFF) / 17) & 0xF) << 4) | ((((*ptr_source >> 16) & 0xFF) / 17) & 0xF);
+                
+                    ptr++;
+                    ptr_source++;
                 }
+            }
+
+            return true;
+        }
 
-                return true;
+        case texture_data_type::ushort_5_6_5: {
+            for (int y = 0; y < size.y; y++) {
+                std::uint16_t *ptr = reinterpret_cast<std::uint16_t*>(buffer_ptr + (y * (((size.x * 2) + 3) >> 2) << 2));
+                const std::uint32_t *ptr_source = reinterpret_cast<const std::uint32_t*>(source + y * size.x * 4);
+
+                for (int x = 0; x < size.x; x++) {
+                    // In order: R, G, B
+                    *ptr = (((*ptr_source & 0xFF) & 0xF8) << 8) | ((((*ptr_source >> 8) & 0xFF) & 0xFC) << 3) |
+                        ((((*ptr_source >> 16) & 0xFF) & 0xF8) >> 3);
+
+                    ptr++;
+                    ptr_source++;
+                }
             }
 
-            case texture_data_type::ushort_5_6_5: {
-                for (int y = 0; y < size.y; y++) {
-                    std::uint16_t *ptr = reinterpret_cast<std::uint16_t*>(buffer_ptr + (y * (((size.x * 2) + 3) >> 2) << 2));
-                    std::uint32_t *ptr_source = reinterpret_cast<std::uint32_t*>(temp_data.data() + y * size.x * 4);
+            return true;
+        }
+
+        case texture_data_type::ubyte: {
+            // Reorder the data
+            std::uint32_t bytes_per_pixel = (type == texture_format::rgb) ? 3 : 4;
+
+            for (int y = 0; y < size.y; y++) {
+                std::uint8_t *ptr = buffer_ptr + (y * (((size.x * bytes_per_pixel) + 3) >> 2) << 2);
+                const std::uint8_t *ptr_source = source + y * size.x * 4;
 
-                    for (int x = 0; x < size.x; x++) {
-                        // In order: R, G, B
-                        *ptr = (((*ptr_source & 0xFF) & 0xF8) << 8) | ((((*ptr_source >> 8) & 0xFF) & 0xFC) << 3) |
-                            ((((*ptr_source >> 16) & 0xFF) & 0xF8) >> 3);
+                for (int x = 0; x < size.x; x++) {
+                    // In order: R, G, B
+                    ptr[0] = ptr_source[0];
+                    ptr[1] = ptr_source[1];
+                    ptr[2] = ptr_source[2];
 
-                        ptr++;
-                        ptr_source++;
+                    if (bytes_per_pixel == 4) {
+                        ptr[3] = ptr_source[3];
                     }
+
+                    ptr += bytes_per_pixel;
+                    ptr_source += 4;
                 }
+            }
+
+            return true;
+        }
+
+        default:
+            LOG_ERROR(DRIVER_GRAPHICS, "Unsupported format for read conversion {}", static_cast<int>(dest_format));
+            break;
+        }
+
+        return false;
+    }
+
+    bool ogl_framebuffer::read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size, std::uint8_t *buffer_ptr) {
+        if (!is_read_combination_valid(type, dest_format)) {
+            return false;
+        }
+
+        GLuint format_gl = texture_data_type_to_gl_enum(dest_format);
+        GLuint type_gl = texture_format_to_gl_enum(type);
 
-                return true;
+        if (is_native_read_format(type, dest_format)) {
+            glReadPixels(pos.x, pos.y, size.x, size.y, type_gl, format_gl, buffer_ptr);
+            return true;
+        }
+
+        // Read RGBA than do manual conversion. Isn't this just too cruel!!
+        std::vector<std::uint8_t> temp_data;
+        temp_data.resize(size.x * 4 * size.y);
+
+        glReadPixels(pos.x, pos.y, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, temp_data.data());
+        return convert_rgba_read_data(temp_data.data(), type, dest_format, size, buffer_ptr);
+    }
+
+    std::int32_t ogl_framebuffer::start_read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size) {
+        if (!is_read_combination_valid(type, dest_format)) {
+            return -1;
+        }
+
+        std::int32_t slot_index = -1;
+
+        for (std::int32_t i = 0; i < PACK_SLOT_COUNT; i++) {
+            if (!pack_slots_[i].in_use_) {
+                slot_index = i;
+                break;
             }
+        }
+
+        if (slot_index == -1) {
+            return -1;
+        }
 
-            case texture_data_type::ubyte: {
-                // Reorder the data
-                std::uint32_t bytes_per_pixel = (type == texture_format::rgb) ? 3 : 4;
+        pack_slot &slot = pack_slots_[slot_index];
 
-                for (int y = 0; y < size.y; y++) {
-                    std::uint8_t *ptr = buffer_ptr + (y * (((size.x * bytes_per_pixel) + 3) >> 2) << 2);
-                    std::uint8_t *ptr_source = temp_data.data() + y * size.x * 4;
+        slot.format_ = type;
+        slot.data_type_ = dest_format;
+        slot.size_ = size;
+        slot.native_ = is_native_read_format(type, dest_format);
+        slot.data_size_ = slot.native_ ? get_read_data_size(type, dest_format, size) : (size.x * 4 * size.y);
 
-                    for (int x = 0; x < size.x; x++) {
-                        // In order: R, G, B
-                        ptr[0] = ptr_source[0];
-                        ptr[1] = ptr_source[1];
-                        ptr[2] = ptr_source[2];
+        if (!slot.buffer_) {
+            glGenBuffers(1, &slot.buffer_);
+        }
 
-                        if (bytes_per_pixel == 4) {
-                            ptr[3] = ptr_source[3];
-                        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer_);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(slot.data_size_), nullptr, GL_STREAM_READ);
 
-                        ptr += bytes_per_pixel;
-                        ptr_source += 4;
-                    }
-                }
+        if (slot.native_) {
+            glReadPixels(pos.x, pos.y, size.x, size.y, texture_format_to_gl_enum(type), texture_data_type_to_gl_enum(dest_format), nullptr);
+        } else {
+            glReadPixels(pos.x, pos.y, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.in_use_ = true;
+
+        return slot_index;
+    }
+
+    bool ogl_framebuffer::is_read_done(const std::int32_t slot_index) {
+        if ((slot_index < 0) || (slot_index >= PACK_SLOT_COUNT) || !pack_slots_[slot_index].in_use_) {
+            return true;
+        }
 
-                return true;
+        GLsync fence = reinterpret_cast<GLsync>(pack_slots_[slot_index].fence_);
+
+        if (!fence) {
+            return true;
+        }
+
+        const GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        return (result == GL_ALREADY_SIGNALED) || (result == GL_CONDITION_SATISFIED);
+    }
+
+    bool ogl_framebuffer::finish_read(const std::int32_t slot_index, std::uint8_t *buffer_ptr) {
+        if ((slot_index < 0) || (slot_index >= PACK_SLOT_COUNT) || !pack_slots_[slot_index].in_use_) {
+            return false;
+        }
+
+        pack_slot &slot = pack_slots_[slot_index];
+        slot.in_use_ = false;
+
+        if (slot.fence_) {
+            GLsync fence = reinterpret_cast<GLsync>(slot.fence_);
+            GLenum result = GL_TIMEOUT_EXPIRED;
+
+            // Wait in one second steps, the driver may decide to timeout earlier than us anyway
+            while (result == GL_TIMEOUT_EXPIRED) {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
             }
 
-            default:
-                LOG_ERROR(DRIVER_GRAPHICS, "Unsupported format for read conversion {}", static_cast<int>(dest_format));
-                break;
+            glDeleteSync(fence);
+            slot.fence_ = nullptr;
+
+            if (result == GL_WAIT_FAILED) {
+                LOG_ERROR(DRIVER_GRAPHICS, "Waiting for framebuffer read fence failed!");
+                return false;
             }
         }
 
-        return false;
+        if (!buffer_ptr) {
+            return false;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer_);
+        const std::uint8_t *source = reinterpret_cast<const std::uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+            static_cast<GLsizeiptr>(slot.data_size_), GL_MAP_READ_BIT));
+
+        bool result = false;
+
+        if (source) {
+            if (slot.native_) {
+                std::memcpy(buffer_ptr, source, slot.data_size_);
+                result = true;
+            } else {
+                result = convert_rgba_read_data(source, slot.format_, slot.data_type_, slot.size_, buffer_ptr);
+            }
+
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            LOG_ERROR(DRIVER_GRAPHICS, "Unable to map framebuffer read staging buffer!");
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return result;
     }
 }
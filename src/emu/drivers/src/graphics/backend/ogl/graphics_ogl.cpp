@@ -21,8 +21,12 @@
 #include <common/log.h>
 #include <common/platform.h>
 #include <common/rgb.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #include <drivers/graphics/backend/ogl/common_ogl.h>
 #include <drivers/graphics/backend/ogl/graphics_ogl.h>
@@ -72,6 +76,14 @@ namespace eka2l1::drivers {
 
     ogl_graphics_driver::ogl_graphics_driver(const window_system_info &info)
         : shared_graphics_driver(graphic_api::opengl)
+        , producer_waiting_(false)
+        , consumer_waiting_(false)
+        , submitted_fence_(0)
+        , completed_fence_(0)
+        , fence_waiters_(0)
+        , peak_depth_(0)
+        , producer_stall_us_(0)
+        , consumer_idle_us_(0)
         , should_stop(false)
         , surface_update_needed(false)
         , new_surface(nullptr)
@@ -82,7 +94,8 @@ namespace eka2l1::drivers {
         , active_input_descriptors_(nullptr)
         , index_buffer_current_(0)
         , feature_flags_(0)
-        , active_upscale_shader_("Default") {
+        , active_upscale_shader_("Default")
+        , decoded_textures_(OGL_DECODED_TEXTURE_CACHE_BUDGET) {
         context_ = graphics::make_gl_context(info, false, true);
 
         if (!context_) {
@@ -91,7 +104,6 @@ namespace eka2l1::drivers {
         }
 
         init_gl_graphics_library(context_->gl_mode());
-        list_queue.max_pending_count_ = 128;
 
         context_->set_swap_interval(1);
 
@@ -134,6 +146,11 @@ namespace eka2l1::drivers {
             }
         }
 
+        // Required on desktop (checked above). The GLES loader only goes up to 3.0, which lacks it.
+        if (!is_gles) {
+            feature_flags_ |= OGL_FEATURE_SUPPORT_BASE_VERTEX;
+        }
+
         std::int32_t ext_count = 0;
         glGetIntegerv(GL_NUM_EXTENSIONS, &ext_count);
 
@@ -169,6 +186,10 @@ namespace eka2l1::drivers {
             feature += "AnisotrophyFiltering;";
         }
 
+        if (feature_flags_ & OGL_FEATURE_SUPPORT_BASE_VERTEX) {
+            feature += "BaseVertex;";
+        }
+
         if (!feature.empty()) {
             feature.pop_back();
         }
@@ -199,6 +220,10 @@ namespace eka2l1::drivers {
             return (feature_flags_ & OGL_FEATURE_SUPPORT_ANISOTROPHY);
         }
 
+        if (ext == graphics_driver_extension_base_vertex) {
+            return (feature_flags_ & OGL_FEATURE_SUPPORT_BASE_VERTEX);
+        }
+
         return false;
     }
 
@@ -314,6 +339,19 @@ namespace eka2l1::drivers {
 
         glGenBuffers(1, &pen_ibo);
 
+        // Batched sprites are all drawn with the same index list, only the length changes
+        std::vector<GLushort> batch_indices(SPRITE_BATCH_MAX_QUADS * SPRITE_BATCH_INDICES_PER_QUAD);
+        sprite_batch::fill_quad_indices(batch_indices.data(), SPRITE_BATCH_MAX_QUADS);
+
+        glGenVertexArrays(1, &batch_vao_);
+        glGenBuffers(1, &batch_vbo_);
+        glGenBuffers(1, &batch_ibo_);
+        glBindVertexArray(batch_vao_);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch_ibo_);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, batch_indices.size() * sizeof(GLushort), batch_indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
         color_loc = sprite_program->get_uniform_location("u_color").value_or(-1);
         proj_loc = sprite_program->get_uniform_location("u_proj").value_or(-1);
         model_loc = sprite_program->get_uniform_location("u_model").value_or(-1);
@@ -453,7 +491,67 @@ namespace eka2l1::drivers {
             brush_rect.size.y = current_fb_height;
         }
 
-        draw_rectangle(brush_rect);
+        sprite_batch_key key;
+        key.kind_ = sprite_batch_kind_fill;
+        std::copy(brush_color.elements.begin(), brush_color.elements.end(), key.color_.begin());
+
+        if (!sprite_batch_.can_append(key)) {
+            flush_sprite_batch();
+        }
+
+        sprite_batch_.add_fill(key, brush_rect);
+    }
+
+    void ogl_graphics_driver::flush_sprite_batch() {
+        if (sprite_batch_.empty()) {
+            return;
+        }
+
+        if (!sprite_program) {
+            do_init();
+        }
+
+        const sprite_batch_key &key = sprite_batch_.key();
+        const std::vector<sprite_vertex> &vertices = sprite_batch_.vertices();
+
+        const glm::mat4 model_matrix = glm::identity<glm::mat4>();
+
+        glBindVertexArray(batch_vao_);
+        glBindBuffer(GL_ARRAY_BUFFER, batch_vbo_);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(sprite_vertex), nullptr, GL_STREAM_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(sprite_vertex), vertices.data(), GL_STREAM_DRAW);
+
+        if (key.kind_ == sprite_batch_kind_fill) {
+            brush_program->use(this);
+
+            glUniformMatrix4fv(model_loc_brush, 1, false, glm::value_ptr(model_matrix));
+            glUniformMatrix4fv(proj_loc_brush, 1, false, glm::value_ptr(projection_matrix));
+            glUniform4fv(color_loc_brush, 1, key.color_.data());
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex), (GLvoid *)offsetof(sprite_vertex, pos_));
+            glDisableVertexAttribArray(1);
+        } else {
+            sprite_program->use(this);
+
+            glUniformMatrix4fv(model_loc, 1, false, glm::value_ptr(model_matrix));
+            glUniformMatrix4fv(proj_loc, 1, false, glm::value_ptr(projection_matrix));
+            glUniform4fv(color_loc, 1, key.color_.data());
+
+            glEnableVertexAttribArray(in_position_loc);
+            glVertexAttribPointer(in_position_loc, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex), (GLvoid *)offsetof(sprite_vertex, pos_));
+            glEnableVertexAttribArray(in_texcoord_loc);
+            glVertexAttribPointer(in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex), (GLvoid *)offsetof(sprite_vertex, coord_));
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(key.texture_));
+        }
+
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(sprite_batch_.quad_count() * SPRITE_BATCH_INDICES_PER_QUAD),
+            GL_UNSIGNED_SHORT, 0);
+
+        glBindVertexArray(0);
+        sprite_batch_.clear();
     }
 
     void ogl_graphics_driver::draw_bitmap(command &cmd) {
@@ -503,17 +601,6 @@ namespace eka2l1::drivers {
         unpack_u64_to_2u32(cmd.data_[2], dest_rect.top.x, dest_rect.top.y);
         unpack_u64_to_2u32(cmd.data_[3], dest_rect.size.x, dest_rect.size.y);
 
-        if (flags & bitmap_draw_flag_use_upscale_shader) {
-            commit_upscale_shader_change();
-            upscale_program->use(this);
-        } else {
-            if (mask_bmp) {
-                mask_program->use(this);
-            } else {
-                sprite_program->use(this);
-            }
-        }
-
         // Build texcoords
         eka2l1::rect source_rect;
         unpack_u64_to_2u32(cmd.data_[4], source_rect.top.x, source_rect.top.y);
@@ -525,6 +612,53 @@ namespace eka2l1::drivers {
         std::uint32_t rot_f32 = static_cast<std::uint32_t>(cmd.data_[7]);
         float rotation = *reinterpret_cast<float*>(&rot_f32);
 
+        bool need_texture_flip = (flags & bitmap_draw_flag_flip);
+
+        if (!mask_draw_texture && !(flags & bitmap_draw_flag_use_upscale_shader)) {
+            // Plain blits are the bulk of UI drawing, put those that share a texture and tint in one draw
+            sprite_batch_key key;
+            key.kind_ = sprite_batch_kind_textured;
+            key.texture_ = draw_texture->texture_handle();
+
+            if (flags & bitmap_draw_flag_use_brush) {
+                std::copy(brush_color.elements.begin(), brush_color.elements.end(), key.color_.begin());
+            } else {
+                key.color_ = { 255.0f, 255.0f, 255.0f, 255.0f };
+            }
+
+            const eka2l1::vec2 texture_size = draw_texture->get_size();
+            eka2l1::rect resolved_dest_rect = dest_rect;
+
+            if (resolved_dest_rect.size.x == 0) {
+                resolved_dest_rect.size.x = (source_rect.size.x == 0) ? texture_size.x : source_rect.size.x;
+            }
+
+            if (resolved_dest_rect.size.y == 0) {
+                resolved_dest_rect.size.y = (source_rect.size.y == 0) ? texture_size.y : source_rect.size.y;
+            }
+
+            if (!sprite_batch_.can_append(key)) {
+                flush_sprite_batch();
+            }
+
+            sprite_batch_.add_sprite(key, resolved_dest_rect, source_rect, texture_size, origin, rotation, need_texture_flip);
+            return;
+        }
+
+        flush_sprite_batch();
+        sprite_batch_.count_unbatched_draw();
+
+        if (flags & bitmap_draw_flag_use_upscale_shader) {
+            commit_upscale_shader_change();
+            upscale_program->use(this);
+        } else {
+            if (mask_bmp) {
+                mask_program->use(this);
+            } else {
+                sprite_program->use(this);
+            }
+        }
+
         struct sprite_vertex {
             float top[2];
             float coord[2];
@@ -570,8 +704,6 @@ namespace eka2l1::drivers {
 
         void *vert_pointer = verts_default;
 
-        bool need_texture_flip = (flags & bitmap_draw_flag_flip);
-
         if (!source_rect.empty()) {
             const float texel_width = 1.0f / draw_texture->get_size().x;
             const float texel_height = 1.0f / draw_texture->get_size().y;
@@ -736,7 +868,7 @@ namespace eka2l1::drivers {
 
         unpack_to_two_floats(cmd.data_[2], scale, temp);
 
-        delete[] to_clip_rects;
+        cmd.free_data(to_clip_rects);
 
         if (to_clip.empty()) {
             glDisable(GL_SCISSOR_TEST);
@@ -1295,7 +1427,7 @@ namespace eka2l1::drivers {
 
         glDrawElements(GL_LINES, static_cast<GLsizei>(indicies.size()), GL_UNSIGNED_INT, 0);
 
-        delete[] point_list;
+        cmd.free_data(point_list);
     }
 
     void ogl_graphics_driver::set_cull_face(command &cmd) {
@@ -1348,34 +1480,34 @@ namespace eka2l1::drivers {
         switch (var_type) {
         case shader_set_var_type::integer: {
             glUniform1i(binding, *reinterpret_cast<const GLint *>(data));
-            delete[] data;
+            cmd.free_data(data);
 
             return;
         }
 
         case shader_set_var_type::real:
             glUniform1f(binding, *reinterpret_cast<const GLfloat*>(data));
-            delete[] data;
+            cmd.free_data(data);
 
             return;
 
         case shader_set_var_type::mat4: {
             glUniformMatrix4fv(binding, 1, GL_FALSE, reinterpret_cast<const GLfloat *>(data));
-            delete[] data;
+            cmd.free_data(data);
 
             return;
         }
 
         case shader_set_var_type::vec3: {
             glUniform3fv(binding, 1, reinterpret_cast<const GLfloat *>(data));
-            delete[] data;
+            cmd.free_data(data);
 
             return;
         }
 
         case shader_set_var_type::vec4: {
             glUniform4fv(binding, 1, reinterpret_cast<const GLfloat *>(data));
-            delete[] data;
+            cmd.free_data(data);
 
             return;
         }
@@ -1405,7 +1537,7 @@ namespace eka2l1::drivers {
 
         if (starting_slots + count >= GL_BACKEND_MAX_VBO_SLOTS) {
             LOG_ERROR(DRIVER_GRAPHICS, "Slot to bind VBO exceed maximum (startSlot={}, count={})", starting_slots, count);
-            delete[] arr;
+            cmd.free_data(arr);
 
             return;
         }
@@ -1420,7 +1552,7 @@ namespace eka2l1::drivers {
             vbo_slots_[starting_slots + i] = bufobj->buffer_handle();
         }
 
-        delete[] arr;
+        cmd.free_data(arr);
     }
 
     void ogl_graphics_driver::bind_index_buffer(command &cmd) {
@@ -1595,15 +1727,103 @@ namespace eka2l1::drivers {
             backup.last_scissor[3]);
     }
 
+    bool ogl_graphics_driver::wait_for_ring_space(command_list &list) {
+        const auto stall_start = std::chrono::steady_clock::now();
+        bool pushed = false;
+
+        {
+            std::unique_lock<std::mutex> ulock(ring_wait_mut_);
+
+            producer_waiting_ = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            ring_space_cond_.wait(ulock, [&]() {
+                pushed = list_ring_.push(std::move(list));
+                return pushed || should_stop;
+            });
+
+            producer_waiting_ = false;
+        }
+
+        producer_stall_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - stall_start).count();
+
+        return pushed;
+    }
+
     void ogl_graphics_driver::submit_command_list(command_list &list) {
-        if ((list.size_ == 0) || !list.base_ || should_stop) {
-            if (list.base_) {
-                delete[] list.base_;
-            }
+        if ((list.size_ == 0) || should_stop) {
+            list.release();
+            return;
+        }
+
+        while (producer_lock_.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        if (!list_ring_.push(std::move(list)) && !wait_for_ring_space(list)) {
+            producer_lock_.clear(std::memory_order_release);
+            list.release();
+
+            return;
+        }
+
+        submitted_fence_.fetch_add(1, std::memory_order_relaxed);
+
+        const std::uint32_t depth = static_cast<std::uint32_t>(list_ring_.size());
+        if (depth > peak_depth_.load(std::memory_order_relaxed)) {
+            peak_depth_.store(depth, std::memory_order_relaxed);
+        }
+
+        producer_lock_.clear(std::memory_order_release);
 
+        // Pairs with the fence in wait_for_ring_data: either the consumer sees the new tail, or we see it sleeping.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (consumer_waiting_.load(std::memory_order_relaxed)) {
+            const std::lock_guard<std::mutex> guard(ring_wait_mut_);
+            ring_data_cond_.notify_one();
+        }
+    }
+
+    std::uint64_t ogl_graphics_driver::current_fence() const {
+        return submitted_fence_.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t ogl_graphics_driver::completed_fence() const {
+        return completed_fence_.load(std::memory_order_acquire);
+    }
+
+    void ogl_graphics_driver::wait_fence(const std::uint64_t fence) {
+        if (completed_fence_.load(std::memory_order_acquire) >= fence) {
             return;
         }
-        list_queue.push(list);
+
+        fence_waiters_++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        {
+            std::unique_lock<std::mutex> ulock(mut_);
+            cond_.wait(ulock, [&]() { return should_stop || (completed_fence_.load(std::memory_order_acquire) >= fence); });
+        }
+
+        fence_waiters_--;
+    }
+
+    graphics_queue_stats ogl_graphics_driver::get_queue_stats() const {
+        graphics_queue_stats stats;
+
+        stats.depth_ = static_cast<std::uint32_t>(list_ring_.size());
+        stats.peak_depth_ = peak_depth_.load(std::memory_order_relaxed);
+        stats.submitted_lists_ = submitted_fence_.load(std::memory_order_relaxed);
+        stats.producer_stall_us_ = producer_stall_us_.load(std::memory_order_relaxed);
+        stats.consumer_idle_us_ = consumer_idle_us_.load(std::memory_order_relaxed);
+
+        const sprite_batch_stats batch_stats = sprite_batch_.get_stats();
+        stats.sprite_draws_ = batch_stats.sprites_;
+        stats.sprite_draw_calls_ = batch_stats.draw_calls_;
+
+        return stats;
     }
 
     void ogl_graphics_driver::display(command &cmd) {
@@ -1614,6 +1834,13 @@ namespace eka2l1::drivers {
     }
 
     void ogl_graphics_driver::dispatch(command &cmd) {
+        // Everything but the batched draws themselves and the brush color (part of the batch key)
+        // may change what a batched draw depends on, so draw what was collected first.
+        if ((cmd.opcode_ != graphics_driver_draw_bitmap) && (cmd.opcode_ != graphics_driver_draw_rectangle)
+            && (cmd.opcode_ != graphics_driver_set_brush_color)) {
+            flush_sprite_batch();
+        }
+
         switch (cmd.opcode_) {
         case graphics_driver_draw_bitmap: {
             draw_bitmap(cmd);
@@ -1770,27 +1997,92 @@ namespace eka2l1::drivers {
         }
     }
 
+    std::optional<command_list> ogl_graphics_driver::wait_for_ring_data() {
+        const auto idle_start = std::chrono::steady_clock::now();
+        std::optional<command_list> list;
+
+        {
+            std::unique_lock<std::mutex> ulock(ring_wait_mut_);
+
+            consumer_waiting_ = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            ring_data_cond_.wait(ulock, [&]() {
+                list = list_ring_.pop();
+                return should_stop || list.has_value();
+            });
+
+            consumer_waiting_ = false;
+        }
+
+        consumer_idle_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - idle_start).count();
+
+        return list;
+    }
+
+    void ogl_graphics_driver::signal_list_completed() {
+        completed_fence_.fetch_add(1, std::memory_order_release);
+
+        // A slot was freed when the list was popped, and a fence may have been reached. Only go
+        // through the mutexes when somebody is actually sleeping on them.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (producer_waiting_.load(std::memory_order_relaxed)) {
+            const std::lock_guard<std::mutex> guard(ring_wait_mut_);
+            ring_space_cond_.notify_one();
+        }
+
+        if (fence_waiters_.load(std::memory_order_relaxed) != 0) {
+            const std::lock_guard<std::mutex> guard(mut_);
+            cond_.notify_all();
+        }
+    }
+
     void ogl_graphics_driver::run() {
         while (!should_stop) {
-            std::optional<command_list> list = list_queue.pop();
+            std::optional<command_list> list = list_ring_.pop();
 
             if (!list) {
-                LOG_ERROR(DRIVER_GRAPHICS, "Corrupted graphics command list! Emulation halt.");
-                break;
-            }
+                // Nothing else to do before sleeping, so finish the reads still in flight now
+                resolve_pending_reads(true);
+                list = wait_for_ring_data();
 
-            for (std::size_t i = 0; i < list->size_; i++) {
-                dispatch(list->base_[i]);
+                if (!list) {
+                    // Only happens when the driver is stopping
+                    break;
+                }
             }
 
-            delete[] list->base_;
+            list->iterate([this](command &cmd) {
+                dispatch(cmd);
+            });
+
+            flush_sprite_batch();
+            list->release();
+            resolve_pending_reads(false);
+
+            signal_list_completed();
+        }
+
+        resolve_pending_reads(true);
+
+        // Give back lists that were never executed
+        while (std::optional<command_list> list = list_ring_.pop()) {
+            list->release();
         }
     }
 
     void ogl_graphics_driver::abort() {
-        list_queue.abort();
         should_stop = true;
 
+        {
+            const std::lock_guard<std::mutex> guard(ring_wait_mut_);
+            ring_space_cond_.notify_all();
+            ring_data_cond_.notify_all();
+        }
+
+        const std::lock_guard<std::mutex> guard(mut_);
         cond_.notify_all();
     }
 
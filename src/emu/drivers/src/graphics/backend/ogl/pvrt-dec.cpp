@@ -725,7 +725,8 @@ static void mapDecompressedData(Pixel32 *pOutput, int width, const Pixel32 *pWor
         }
     }
 }
-static int pvrtcDecompress(uint8_t *pCompressedData, Pixel32 *pDecompressedData, uint32_t ui32Width, uint32_t ui32Height, uint8_t ui8Bpp, uint32_t uiII) {
+static int pvrtcDecompress(uint8_t *pCompressedData, Pixel32 *pDecompressedData, uint32_t ui32Width, uint32_t ui32Height, uint8_t ui8Bpp, uint32_t uiII,
+    int i32FirstRow = 0, int i32EndRow = -1) {
     uint32_t ui32WordWidth = 4;
     uint32_t ui32WordHeight = 4;
     if (ui8Bpp == 2) {
@@ -743,8 +744,13 @@ static int pvrtcDecompress(uint8_t *pCompressedData, Pixel32 *pDecompressedData,
     PVRTCWordIndices indices;
     std::vector<Pixel32> pPixels(ui32WordWidth * ui32WordHeight);
 
-    // For each row of words
-    for (int wordY = -1; wordY < i32NumYWords - 1; wordY++) {
+    if ((i32EndRow < 0) || (i32EndRow > i32NumYWords)) {
+        i32EndRow = i32NumYWords;
+    }
+
+    // For each row of words. Each row writes the bottom half of one word row and the top half of the next,
+    // so different rows never write the same pixels.
+    for (int wordY = i32FirstRow - 1; wordY < i32EndRow - 1; wordY++) {
         // for each column of words
         for (int wordX = -1; wordX < i32NumXWords - 1; wordX++) {
             indices.P[0] = wrapWordIndex(i32NumXWords, wordX);
@@ -819,6 +825,17 @@ uint32_t PVRTDecompressPVRTC(const void *pCompressedData, uint32_t Do2bitMode, u
     return retval;
 }
 
+uint32_t PVRTDecompressPVRTCRows(const void *pCompressedData, uint32_t Do2bitMode, uint32_t XDim, uint32_t YDim, uint32_t DoPvrtType, uint8_t *pResultImage,
+    uint32_t FirstRow, uint32_t EndRow) {
+    // Only for images at least the minimum size, which are decoded in place
+    if ((XDim < ((Do2bitMode == 1u) ? 16u : 8u)) || (YDim < 8u)) {
+        return 0;
+    }
+
+    return pvrtcDecompress((uint8_t *)pCompressedData, (Pixel32 *)pResultImage, XDim, YDim, (Do2bitMode == 1 ? 2 : 4), DoPvrtType,
+        static_cast<int>(FirstRow), static_cast<int>(EndRow));
+}
+
 ////////////////////////////////////// ETC Compression //////////////////////////////////////
 
 #define _CLAMP_(X, Xmin, Xmax) ((X) < (Xmax) ? ((X) < (Xmin) ? (Xmin) : (X)) : (Xmax))
@@ -24,11 +24,10 @@
 
 #include <glad/glad.h>
 
-#include <common/bytes.h>
-#include <cassert>
+#include <drivers/graphics/texture_decode.h>
 
-void decompressBlockETC2(unsigned int block_part1, unsigned int block_part2, std::uint8_t *img, int width, int height, int startx, int starty);
-uint32_t PVRTDecompressPVRTC(const void *compressedData, uint32_t do2bitMode, uint32_t xDim, uint32_t yDim, uint32_t doPvrtType, uint8_t *outResultImage);
+#include <common/thread_pool.h>
+#include <cassert>
 
 namespace eka2l1::drivers {
     static GLint to_gl_tex_dim(const int dim) {
@@ -49,20 +48,42 @@ namespace eka2l1::drivers {
         return 0;
     }
 
-    static void decode_rgb_etc2_texture(std::vector<std::uint8_t> &dest, const std::uint8_t *source, const std::int32_t width, const std::int32_t height) {
-        dest.resize(3 * width * height);
+    static bool is_pvrtc_format(const texture_format format) {
+        return (format == drivers::texture_format::pvrtc_4bppv1_rgba) || (format == drivers::texture_format::pvrtc_2bppv1_rgba)
+            || (format == drivers::texture_format::pvrtc_4bppv1_rgb) || (format == drivers::texture_format::pvrtc_2bppv1_rgb);
+    }
+
+    // Decode a compressed texture the host can not sample into RGBA8, going through the decoded texture cache.
+    // Returns null if the host supports the format natively.
+    static decoded_texture decode_unsupported_texture(ogl_graphics_driver *driver, const texture_format format, const void *data,
+        const std::size_t data_size, const std::uint32_t width, const std::uint32_t height) {
+        const bool is_etc = (format == drivers::texture_format::etc2_rgb8);
+        const bool is_pvrtc = is_pvrtc_format(format);
+
+        if ((!is_etc || driver->get_supported_feature(OGL_FEATURE_SUPPORT_ETC2)) && (!is_pvrtc || driver->get_supported_feature(OGL_FEATURE_SUPPORT_PVRTC))) {
+            return nullptr;
+        }
+
+        decoded_texture_cache &cache = driver->get_decoded_texture_cache();
+
+        const std::size_t decoded_size = width * height * 4;
+        const std::uint64_t key = decoded_texture_cache::make_key(format, width, height, data, data_size);
 
-        std::uint32_t block_read = 0;
-        const std::uint32_t *source_u32 = reinterpret_cast<const std::uint32_t*>(source);
+        decoded_texture decoded = cache.get(key, decoded_size);
+        if (decoded) {
+            return decoded;
+        }
 
-        for (std::int32_t y = 0; y < height / 4; y++) {
-            for (std::int32_t x = 0; x < width / 4; x++) {
-                std::uint32_t block_part1 = common::byte_swap(source_u32[block_read++]);
-                std::uint32_t block_part2 = common::byte_swap(source_u32[block_read++]);
+        std::vector<std::uint8_t> decoded_data(decoded_size);
 
-                decompressBlockETC2(block_part1, block_part2, dest.data(), width, height, 4 * x, 4 * y);
-            } 
+        if (is_etc) {
+            decode_etc_texture(decoded_data.data(), reinterpret_cast<const std::uint8_t *>(data), width, height, &common::get_shared_thread_pool());
+        } else {
+            const bool is_2bpp = (format == drivers::texture_format::pvrtc_2bppv1_rgba) || (format == drivers::texture_format::pvrtc_2bppv1_rgb);
+            decode_pvrtc_texture(decoded_data.data(), reinterpret_cast<const std::uint8_t *>(data), width, height, is_2bpp, &common::get_shared_thread_pool());
         }
+
+        return cache.put(key, std::move(decoded_data));
     }
 
     bool ogl_texture::create(graphics_driver *driver, const int dim, const int miplvl, const vec3 &size, const texture_format internal_format,
@@ -90,29 +111,21 @@ namespace eka2l1::drivers {
         drivers::texture_format converted_format = format;
         drivers::texture_data_type converted_data_type = tex_data_type;
 
-        std::vector<std::uint8_t> converted_data;
+        decoded_texture decoded = nullptr;
         if (tex_data_type == drivers::texture_data_type::compressed) {
-            ogl_graphics_driver *ogl_driver = reinterpret_cast<ogl_graphics_driver*>(driver);
-            if (internal_format == drivers::texture_format::etc2_rgb8 && !ogl_driver->get_supported_feature(OGL_FEATURE_SUPPORT_ETC2)) {
-                converted_data_type = drivers::texture_data_type::ubyte;
-                converted_internal_format = drivers::texture_format::rgb;
-                converted_format = drivers::texture_format::rgb;
+            decoded = decode_unsupported_texture(reinterpret_cast<ogl_graphics_driver*>(driver), internal_format, data, total_size,
+                size.x, size.y);
 
-                decode_rgb_etc2_texture(converted_data, reinterpret_cast<std::uint8_t*>(data), size.x, size.y);
-
-                data = converted_data.data();
-            } else if (((internal_format == drivers::texture_format::pvrtc_4bppv1_rgba) || (internal_format == drivers::texture_format::pvrtc_2bppv1_rgba) || (internal_format == drivers::texture_format::pvrtc_4bppv1_rgb) ||
-                (internal_format == drivers::texture_format::pvrtc_2bppv1_rgb)) && !ogl_driver->get_supported_feature(OGL_FEATURE_SUPPORT_PVRTC)) {
+            if (decoded) {
                 converted_data_type = drivers::texture_data_type::ubyte;
                 converted_internal_format = drivers::texture_format::rgba;
                 converted_format = drivers::texture_format::rgba;
 
-                std::uint32_t is_2bit = ((internal_format == drivers::texture_format::pvrtc_2bppv1_rgba) || (internal_format == drivers::texture_format::pvrtc_2bppv1_rgb));
-
-                converted_data.resize(4 * size.x * size.y);
-                PVRTDecompressPVRTC(data, is_2bit, size.x, size.y, 0, converted_data.data());
+                // The decoded pixels are tightly packed
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-                data = converted_data.data();
+                data = const_cast<std::uint8_t*>(decoded->data());
             }
         }
 
@@ -288,16 +301,19 @@ namespace eka2l1::drivers {
         drivers::texture_format converted_format = data_format;
         drivers::texture_data_type converted_data_type = data_type;
 
-        std::vector<std::uint8_t> converted_data;
+        decoded_texture decoded = nullptr;
         if (data_type == drivers::texture_data_type::compressed) {
-            ogl_graphics_driver *ogl_driver = reinterpret_cast<ogl_graphics_driver*>(driver);
-            if (!ogl_driver->get_supported_feature(OGL_FEATURE_SUPPORT_ETC2)) {
+            decoded = decode_unsupported_texture(reinterpret_cast<ogl_graphics_driver*>(driver), data_format, data, data_size,
+                size.x, size.y);
+
+            if (decoded) {
                 converted_data_type = drivers::texture_data_type::ubyte;
-                converted_format = drivers::texture_format::rgb;
+                converted_format = drivers::texture_format::rgba;
 
-                decode_rgb_etc2_texture(converted_data, reinterpret_cast<const std::uint8_t*>(data), size.x, size.y);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-                data = converted_data.data();
+                data = decoded->data();
             }
         }
     
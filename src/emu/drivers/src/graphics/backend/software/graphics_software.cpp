@@ -0,0 +1,1043 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/graphics/backend/software/graphics_software.h>
+#include <drivers/itc.h>
+
+#include <common/algorithm.h>
+#include <common/buffer.h>
+#include <common/log.h>
+#include <common/region.h>
+#include <common/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace eka2l1::drivers {
+    // Draws covering fewer pixels than this are not worth splitting between threads
+    static constexpr std::size_t SOFTWARE_PARALLEL_MIN_PIXELS = 65536;
+    static constexpr std::size_t SOFTWARE_PARALLEL_MIN_ROWS = 16;
+
+    static std::uint32_t pack_brush_color(const eka2l1::vecx<float, 4> &color) {
+        std::uint32_t channels[4];
+
+        for (int i = 0; i < 4; i++) {
+            channels[i] = static_cast<std::uint32_t>(std::lround(std::clamp(color.elements[i], 0.0f, 255.0f)));
+        }
+
+        return pack_software_color(channels[0], channels[1], channels[2], channels[3]);
+    }
+
+    /**
+     * \brief What to fill a quad with.
+     */
+    struct software_quad_source {
+        const std::uint32_t *texels_ = nullptr;     ///< Null to fill with the color.
+        eka2l1::vec2 texture_size_;
+        eka2l1::rect source_rect_;
+        bool flip_ = false;
+
+        const std::uint32_t *mask_ = nullptr;
+        eka2l1::vec2 mask_size_;
+        bool invert_mask_ = false;
+        bool flat_mask_ = false;
+
+        std::uint32_t color_ = 0xFFFFFFFF;          ///< Fill color, or tint of the texels.
+    };
+
+    software_graphics_driver::software_graphics_driver()
+        : shared_graphics_driver(graphic_api::software)
+        , should_stop_(false)
+        , read_fb_(nullptr)
+        , draw_fb_(nullptr)
+        , submitted_lists_(0) {
+        screen_ = std::make_unique<software_texture>();
+        screen_->create(this, 2, 0, eka2l1::vec3(0, 0, 0), texture_format::rgba, texture_format::rgba, texture_data_type::ubyte, nullptr, 0);
+    }
+
+    software_graphics_driver::~software_graphics_driver() {
+        // Bitmaps go first, their framebuffers still call back while being destroyed
+        bmp_textures.clear();
+        graphic_objects.clear();
+    }
+
+    void software_graphics_driver::run() {
+        // Lists are processed on submit, same as the null driver
+        std::unique_lock<std::mutex> ulock(mut_);
+        cond_.wait(ulock, [this]() { return should_stop_.load(); });
+    }
+
+    void software_graphics_driver::abort() {
+        should_stop_ = true;
+
+        const std::lock_guard<std::mutex> guard(mut_);
+        cond_.notify_all();
+    }
+
+    void software_graphics_driver::set_viewport(const eka2l1::rect &viewport) {
+        state_.viewport_ = viewport;
+        state_.viewport_.size.y = common::abs(viewport.size.y);
+        state_.viewport_set_ = true;
+    }
+
+    void software_graphics_driver::update_surface(void *surface) {
+    }
+
+    void software_graphics_driver::set_upscale_shader(const std::string &name) {
+    }
+
+    std::string software_graphics_driver::get_active_upscale_shader() const {
+        return "Default";
+    }
+
+    bool software_graphics_driver::support_extension(const graphics_driver_extension ext) {
+        return false;
+    }
+
+    bool software_graphics_driver::query_extension_value(const graphics_driver_extension_query query, void *data_ptr) {
+        return false;
+    }
+
+    graphics_queue_stats software_graphics_driver::get_queue_stats() const {
+        graphics_queue_stats stats{};
+        stats.submitted_lists_ = submitted_lists_;
+
+        const sprite_batch_stats batch_stats = sprite_batch_.get_stats();
+        stats.sprite_draws_ = batch_stats.sprites_;
+        stats.sprite_draw_calls_ = batch_stats.draw_calls_;
+
+        return stats;
+    }
+
+    void software_graphics_driver::submit_command_list(command_list &cmd_list) {
+        if (should_stop_) {
+            cmd_list.release();
+            return;
+        }
+
+        const std::lock_guard<std::mutex> guard(process_lock_);
+
+        cmd_list.iterate([this](command &cmd) {
+            dispatch(cmd);
+        });
+
+        submitted_lists_++;
+        cmd_list.release();
+    }
+
+    void software_graphics_driver::bind_swapchain_framebuf() {
+        read_fb_ = nullptr;
+        draw_fb_ = nullptr;
+    }
+
+    void software_graphics_driver::bind_framebuffer(software_framebuffer *fb, const framebuffer_bind_type type) {
+        if (type & framebuffer_bind_read) {
+            read_fb_ = fb;
+        }
+
+        if (type & framebuffer_bind_draw) {
+            draw_fb_ = fb;
+        }
+    }
+
+    void software_graphics_driver::unbind_framebuffer(software_framebuffer *fb) {
+        if (read_fb_ == fb) {
+            read_fb_ = nullptr;
+        }
+
+        if (draw_fb_ == fb) {
+            draw_fb_ = nullptr;
+        }
+    }
+
+    software_texture *software_graphics_driver::get_blit_texture(const framebuffer_bind_type type) {
+        software_framebuffer *fb = (type == framebuffer_bind_read) ? read_fb_ : draw_fb_;
+        return fb ? fb->get_color_buffer() : screen_.get();
+    }
+
+    std::vector<std::uint32_t> software_graphics_driver::get_screen_pixels(eka2l1::vec2 &size) {
+        const std::lock_guard<std::mutex> guard(process_lock_);
+        size = screen_->get_size();
+
+        const std::uint32_t *pixels = screen_->get_raw_pixels();
+        if (!pixels) {
+            return {};
+        }
+
+        return std::vector<std::uint32_t>(pixels, pixels + static_cast<std::size_t>(size.x) * size.y);
+    }
+
+    software_texture *software_graphics_driver::get_target() {
+        software_texture *target = binding ? static_cast<software_texture *>(binding->tex.get()) : screen_.get();
+
+        if (!target->get_raw_pixels()) {
+            return nullptr;
+        }
+
+        return target;
+    }
+
+    eka2l1::rect software_graphics_driver::get_viewport(software_texture *target) const {
+        if (!state_.viewport_set_) {
+            return eka2l1::rect(eka2l1::vec2(0, 0), target->get_size());
+        }
+
+        return state_.viewport_;
+    }
+
+    glm::mat4 software_graphics_driver::get_window_matrix(software_texture *target) const {
+        // Clip space to pixels of the target, top row first. The projection for this API never flips.
+        const eka2l1::rect viewport = get_viewport(target);
+
+        glm::mat4 window_matrix = glm::identity<glm::mat4>();
+        window_matrix = glm::translate(window_matrix, glm::vec3(viewport.top.x + viewport.size.x * 0.5f, viewport.top.y + viewport.size.y * 0.5f, 0.0f));
+        window_matrix = glm::scale(window_matrix, glm::vec3(viewport.size.x * 0.5f, viewport.size.y * -0.5f, 1.0f));
+
+        return window_matrix * projection_matrix;
+    }
+
+    void software_graphics_driver::get_row_spans(const int y, const eka2l1::rect &bounds, std::vector<std::pair<int, int>> &spans) const {
+        spans.clear();
+
+        if ((y < bounds.top.y) || (y >= bounds.top.y + bounds.size.y)) {
+            return;
+        }
+
+        int begin = bounds.top.x;
+        int end = bounds.top.x + bounds.size.x;
+
+        if (state_.scissor_enabled_) {
+            if ((y < state_.scissor_.top.y) || (y >= state_.scissor_.top.y + state_.scissor_.size.y)) {
+                return;
+            }
+
+            begin = common::max<int>(begin, state_.scissor_.top.x);
+            end = common::min<int>(end, state_.scissor_.top.x + state_.scissor_.size.x);
+        }
+
+        if (begin >= end) {
+            return;
+        }
+
+        if (!state_.stencil_enabled_) {
+            spans.emplace_back(begin, end);
+            return;
+        }
+
+        for (const eka2l1::rect &region_rect: state_.clip_region_) {
+            if ((y < region_rect.top.y) || (y >= region_rect.top.y + region_rect.size.y)) {
+                continue;
+            }
+
+            const int span_begin = common::max<int>(begin, region_rect.top.x);
+            const int span_end = common::min<int>(end, region_rect.top.x + region_rect.size.x);
+
+            if (span_begin < span_end) {
+                spans.emplace_back(span_begin, span_end);
+            }
+        }
+
+        if (spans.size() <= 1) {
+            return;
+        }
+
+        // Region rectangles may overlap, do not draw a pixel twice
+        std::sort(spans.begin(), spans.end());
+        std::size_t merged = 0;
+
+        for (std::size_t i = 1; i < spans.size(); i++) {
+            if (spans[i].first <= spans[merged].second) {
+                spans[merged].second = common::max<int>(spans[merged].second, spans[i].second);
+            } else {
+                spans[++merged] = spans[i];
+            }
+        }
+
+        spans.resize(merged + 1);
+    }
+
+    bool software_graphics_driver::is_pixel_visible(const int x, const int y, const eka2l1::rect &bounds) const {
+        if ((x < bounds.top.x) || (y < bounds.top.y) || (x >= bounds.top.x + bounds.size.x) || (y >= bounds.top.y + bounds.size.y)) {
+            return false;
+        }
+
+        if (state_.scissor_enabled_ && ((x < state_.scissor_.top.x) || (y < state_.scissor_.top.y) || (x >= state_.scissor_.top.x + state_.scissor_.size.x)
+                || (y >= state_.scissor_.top.y + state_.scissor_.size.y))) {
+            return false;
+        }
+
+        if (!state_.stencil_enabled_) {
+            return true;
+        }
+
+        return std::any_of(state_.clip_region_.begin(), state_.clip_region_.end(), [x, y](const eka2l1::rect &region_rect) {
+            return (x >= region_rect.top.x) && (y >= region_rect.top.y) && (x < region_rect.top.x + region_rect.size.x)
+                && (y < region_rect.top.y + region_rect.size.y);
+        });
+    }
+
+    static eka2l1::rect intersect_with_target(const eka2l1::rect &area, software_texture *target) {
+        const eka2l1::vec2 size = target->get_size();
+
+        const int left = common::max<int>(area.top.x, 0);
+        const int top = common::max<int>(area.top.y, 0);
+        const int right = common::min<int>(area.top.x + area.size.x, size.x);
+        const int bottom = common::min<int>(area.top.y + area.size.y, size.y);
+
+        return eka2l1::rect(eka2l1::vec2(left, top), eka2l1::vec2(common::max<int>(right - left, 0), common::max<int>(bottom - top, 0)));
+    }
+
+    // Pixel range, in the form [begin, end), whose centers are in [low, high)
+    static inline void center_range(const double low, const double high, int &begin, int &end, const int limit_begin, const int limit_end) {
+        const double begin_f = std::ceil(std::max(low - 0.5, static_cast<double>(limit_begin)));
+        const double end_f = std::ceil(std::min(high - 0.5, static_cast<double>(limit_end)));
+
+        begin = static_cast<int>(begin_f);
+        end = common::max<int>(static_cast<int>(end_f), begin);
+    }
+
+    // Narrow [low, high) to where 0 <= base + x * delta < 1
+    static inline void restrict_unit_range(const double base, const double delta, double &low, double &high) {
+        if (std::abs(delta) < 1e-12) {
+            if ((base < 0.0) || (base >= 1.0)) {
+                high = low;
+            }
+
+            return;
+        }
+
+        double first = -base / delta;
+        double second = (1.0 - base) / delta;
+
+        if (first > second) {
+            std::swap(first, second);
+        }
+
+        low = std::max(low, first);
+        high = std::min(high, second);
+    }
+
+    static inline int sample_coord(const double unit, const int start, const int length, const int limit) {
+        const int coord = start + static_cast<int>(std::floor(unit * length));
+        return std::clamp(coord, common::max<int>(0, common::min<int>(start, start + length - 1)),
+            common::min<int>(limit - 1, common::max<int>(start, start + length - 1)));
+    }
+
+    static void rasterize_quad(software_texture *target, const glm::mat4 &transform, const eka2l1::rect &bounds, const software_quad_source &source,
+        const software_blend_state &blend, const std::function<void(int, std::vector<std::pair<int, int>> &)> &get_spans) {
+        const glm::vec4 origin_f = transform * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        const glm::vec4 u_axis_f = transform * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) - origin_f;
+        const glm::vec4 v_axis_f = transform * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f) - origin_f;
+
+        const double ox = origin_f.x;
+        const double oy = origin_f.y;
+        const double ax = u_axis_f.x;
+        const double ay = u_axis_f.y;
+        const double bx = v_axis_f.x;
+        const double by = v_axis_f.y;
+
+        const double det = ax * by - ay * bx;
+
+        if (std::abs(det) < 1e-9) {
+            return;
+        }
+
+        const double min_y = std::min({ oy, oy + ay, oy + by, oy + ay + by });
+        const double max_y = std::max({ oy, oy + ay, oy + by, oy + ay + by });
+
+        int row_begin = 0;
+        int row_end = 0;
+
+        center_range(min_y, max_y, row_begin, row_end, bounds.top.y, bounds.top.y + bounds.size.y);
+
+        if (row_begin >= row_end) {
+            return;
+        }
+
+        std::uint32_t *target_pixels = target->get_storage();
+        const int target_width = target->get_size().x;
+
+        const eka2l1::rect &src = source.source_rect_;
+
+        // A 1:1 unrotated blit reads texels in order, straight from the texture rows
+        const bool is_direct = source.texels_ && !source.flip_ && (ay == 0.0) && (bx == 0.0) && (ax == src.size.x) && (by == src.size.y)
+            && (std::floor(ox) == ox) && (std::floor(oy) == oy) && (src.top.x >= 0) && (src.top.y >= 0)
+            && (src.top.x + src.size.x <= source.texture_size_.x) && (src.top.y + src.size.y <= source.texture_size_.y);
+
+        auto rasterize_rows = [&](const std::size_t begin, const std::size_t end) {
+            std::vector<std::pair<int, int>> spans;
+            std::vector<std::uint32_t> colors;
+
+            for (std::size_t row = begin; row < end; row++) {
+                const int y = row_begin + static_cast<int>(row);
+                const double yc = y + 0.5;
+
+                // u = u_base + x * u_delta, same for v, where x is the pixel center
+                const double u_base = (-ox * by - (yc - oy) * bx) / det;
+                const double u_delta = by / det;
+                const double v_base = (ax * (yc - oy) + ay * ox) / det;
+                const double v_delta = -ay / det;
+
+                double low = -1e9;
+                double high = 1e9;
+
+                restrict_unit_range(u_base, u_delta, low, high);
+                restrict_unit_range(v_base, v_delta, low, high);
+
+                if (low >= high) {
+                    continue;
+                }
+
+                int column_begin = 0;
+                int column_end = 0;
+
+                center_range(low, high, column_begin, column_end, bounds.top.x, bounds.top.x + bounds.size.x);
+                get_spans(y, spans);
+
+                std::uint32_t *target_row = target_pixels + static_cast<std::size_t>(y) * target_width;
+
+                for (const auto &[span_begin_clip, span_end_clip]: spans) {
+                    const int span_begin = common::max<int>(span_begin_clip, column_begin);
+                    const int span_end = common::min<int>(span_end_clip, column_end);
+
+                    if (span_begin >= span_end) {
+                        continue;
+                    }
+
+                    const std::size_t count = span_end - span_begin;
+
+                    if (!source.texels_) {
+                        software_fill_span(target_row + span_begin, source.color_, count, blend);
+                        continue;
+                    }
+
+                    const std::uint32_t *span_colors = nullptr;
+
+                    if (is_direct) {
+                        const int texel_y = src.top.y + (y - static_cast<int>(oy));
+                        const int texel_x = src.top.x + (span_begin - static_cast<int>(ox));
+
+                        span_colors = source.texels_ + static_cast<std::size_t>(texel_y) * source.texture_size_.x + texel_x;
+                    }
+
+                    const bool needs_copy = !span_colors || (source.color_ != 0xFFFFFFFF) || source.mask_;
+
+                    if (needs_copy) {
+                        colors.resize(count);
+
+                        if (span_colors) {
+                            std::copy(span_colors, span_colors + count, colors.begin());
+                        } else {
+                            for (std::size_t i = 0; i < count; i++) {
+                                const double xc = span_begin + static_cast<int>(i) + 0.5;
+                                const double u = u_base + xc * u_delta;
+                                const double v = source.flip_ ? (1.0 - (v_base + xc * v_delta)) : (v_base + xc * v_delta);
+
+                                const int texel_x = sample_coord(u, src.top.x, src.size.x, source.texture_size_.x);
+                                const int texel_y = sample_coord(v, src.top.y, src.size.y, source.texture_size_.y);
+
+                                colors[i] = source.texels_[static_cast<std::size_t>(texel_y) * source.texture_size_.x + texel_x];
+                            }
+                        }
+
+                        software_modulate_span(colors.data(), source.color_, count);
+
+                        if (source.mask_) {
+                            for (std::size_t i = 0; i < count; i++) {
+                                const double xc = span_begin + static_cast<int>(i) + 0.5;
+                                const double u = u_base + xc * u_delta;
+                                const double v = source.flip_ ? (1.0 - (v_base + xc * v_delta)) : (v_base + xc * v_delta);
+
+                                // Same normalized coordinates as the texture, on the mask's own size
+                                const double s = (src.top.x + u * src.size.x) / source.texture_size_.x;
+                                const double t = (src.top.y + v * src.size.y) / source.texture_size_.y;
+
+                                const int mask_x = sample_coord(s, 0, source.mask_size_.x, source.mask_size_.x);
+                                const int mask_y = sample_coord(t, 0, source.mask_size_.y, source.mask_size_.y);
+
+                                std::uint32_t mask_value = source.mask_[static_cast<std::size_t>(mask_y) * source.mask_size_.x + mask_x] & 0xFF;
+
+                                if (source.invert_mask_) {
+                                    mask_value = 255 - mask_value;
+                                }
+
+                                if (source.flat_mask_) {
+                                    mask_value = (mask_value > 0) ? 255 : 0;
+                                }
+
+                                colors[i] = (colors[i] & 0x00FFFFFF) | (mask_value << 24);
+                            }
+                        }
+
+                        span_colors = colors.data();
+                    }
+
+                    software_blend_span(target_row + span_begin, span_colors, count, blend);
+                }
+            }
+        };
+
+        const std::size_t row_count = row_end - row_begin;
+        const std::size_t approx_pixels = row_count * static_cast<std::size_t>(std::max(std::abs(ax) + std::abs(bx), 1.0));
+
+        if ((approx_pixels >= SOFTWARE_PARALLEL_MIN_PIXELS) && (row_count >= SOFTWARE_PARALLEL_MIN_ROWS)) {
+            common::get_shared_thread_pool().parallel_for(row_count, SOFTWARE_PARALLEL_MIN_ROWS, rasterize_rows);
+        } else {
+            rasterize_rows(0, row_count);
+        }
+    }
+
+    void software_graphics_driver::draw_bitmap(command &cmd) {
+        software_texture *target = get_target();
+        sprite_batch_.count_unbatched_draw();
+
+        if (!target) {
+            return;
+        }
+
+        drivers::handle to_draw = static_cast<drivers::handle>(cmd.data_[0]);
+        std::uint32_t flags = static_cast<std::uint32_t>(cmd.data_[7] >> 32);
+
+        bitmap *bmp = get_bitmap(to_draw);
+        software_texture *draw_texture = bmp ? static_cast<software_texture *>(bmp->tex.get())
+                                             : reinterpret_cast<software_texture *>(get_graphics_object(to_draw));
+
+        if (!draw_texture) {
+            LOG_ERROR(DRIVER_GRAPHICS, "Invalid bitmap handle to draw");
+            return;
+        }
+
+        drivers::handle mask_to_use = static_cast<drivers::handle>(cmd.data_[1]);
+        software_texture *mask_texture = nullptr;
+
+        if (mask_to_use) {
+            bitmap *mask_bmp = get_bitmap(mask_to_use);
+            mask_texture = mask_bmp ? static_cast<software_texture *>(mask_bmp->tex.get())
+                                    : reinterpret_cast<software_texture *>(get_graphics_object(mask_to_use));
+
+            if (!mask_texture) {
+                LOG_ERROR(DRIVER_GRAPHICS, "Mask handle was provided but invalid!");
+                return;
+            }
+        }
+
+        eka2l1::rect dest_rect;
+        unpack_u64_to_2u32(cmd.data_[2], dest_rect.top.x, dest_rect.top.y);
+        unpack_u64_to_2u32(cmd.data_[3], dest_rect.size.x, dest_rect.size.y);
+
+        eka2l1::rect source_rect;
+        unpack_u64_to_2u32(cmd.data_[4], source_rect.top.x, source_rect.top.y);
+        unpack_u64_to_2u32(cmd.data_[5], source_rect.size.x, source_rect.size.y);
+
+        eka2l1::vec2 origin = eka2l1::vec2(0, 0);
+        unpack_u64_to_2u32(cmd.data_[6], origin.x, origin.y);
+
+        std::uint32_t rot_f32 = static_cast<std::uint32_t>(cmd.data_[7]);
+        float rotation = *reinterpret_cast<float *>(&rot_f32);
+
+        const eka2l1::vec2 texture_size = draw_texture->get_size();
+
+        if (source_rect.empty()) {
+            source_rect.top = eka2l1::vec2(0, 0);
+        }
+
+        if (source_rect.size.x == 0) {
+            source_rect.size.x = texture_size.x;
+        }
+
+        if (source_rect.size.y == 0) {
+            source_rect.size.y = texture_size.y;
+        }
+
+        if (dest_rect.size.x == 0) {
+            dest_rect.size.x = source_rect.size.x;
+        }
+
+        if (dest_rect.size.y == 0) {
+            dest_rect.size.y = source_rect.size.y;
+        }
+
+        software_quad_source source;
+        source.texels_ = draw_texture->get_sample_pixels();
+        source.texture_size_ = texture_size;
+        source.source_rect_ = source_rect;
+        source.flip_ = (flags & bitmap_draw_flag_flip);
+
+        if (!source.texels_ || (texture_size.x <= 0) || (texture_size.y <= 0)) {
+            return;
+        }
+
+        if (flags & bitmap_draw_flag_use_brush) {
+            source.color_ = pack_brush_color(brush_color);
+        }
+
+        if (mask_texture) {
+            source.mask_ = mask_texture->get_sample_pixels();
+            source.mask_size_ = mask_texture->get_size();
+            source.invert_mask_ = (flags & bitmap_draw_flag_invert_mask);
+            source.flat_mask_ = (flags & bitmap_draw_flag_flat_blending);
+
+            if (!source.mask_ || (source.mask_size_.x <= 0) || (source.mask_size_.y <= 0)) {
+                return;
+            }
+        }
+
+        // Same model matrix as the GPU backends
+        glm::mat4 model_matrix = glm::identity<glm::mat4>();
+
+        model_matrix = glm::translate(model_matrix, { dest_rect.top.x, dest_rect.top.y, 0.0f });
+        model_matrix = glm::translate(model_matrix, glm::vec3(static_cast<float>(origin.x), static_cast<float>(origin.y), 0.0f));
+        model_matrix = glm::rotate(model_matrix, glm::radians(rotation), glm::vec3(0.0f, 0.0f, 1.0f));
+        model_matrix = glm::translate(model_matrix, glm::vec3(static_cast<float>(-origin.x), static_cast<float>(-origin.y), 0.0f));
+        model_matrix = glm::scale(model_matrix, glm::vec3(dest_rect.size.x, dest_rect.size.y, 1.0f));
+
+        rasterize_quad(target, get_window_matrix(target) * model_matrix, intersect_with_target(get_viewport(target), target), source, state_.blend_,
+            [this, target](const int y, std::vector<std::pair<int, int>> &spans) {
+                get_row_spans(y, intersect_with_target(get_viewport(target), target), spans);
+            });
+    }
+
+    void software_graphics_driver::draw_rectangle(command &cmd) {
+        software_texture *target = get_target();
+        sprite_batch_.count_unbatched_draw();
+
+        if (!target) {
+            return;
+        }
+
+        eka2l1::rect brush_rect;
+        unpack_u64_to_2u32(cmd.data_[0], brush_rect.top.x, brush_rect.top.y);
+        unpack_u64_to_2u32(cmd.data_[1], brush_rect.size.x, brush_rect.size.y);
+
+        if (brush_rect.size.x == 0) {
+            brush_rect.size.x = target->get_size().x;
+        }
+
+        if (brush_rect.size.y == 0) {
+            brush_rect.size.y = target->get_size().y;
+        }
+
+        glm::mat4 model_matrix = glm::identity<glm::mat4>();
+        model_matrix = glm::translate(model_matrix, { brush_rect.top.x, brush_rect.top.y, 0.0f });
+        model_matrix = glm::scale(model_matrix, { brush_rect.size.x, brush_rect.size.y, 1.0f });
+
+        software_quad_source source;
+        source.color_ = pack_brush_color(brush_color);
+
+        const eka2l1::rect bounds = intersect_with_target(get_viewport(target), target);
+
+        rasterize_quad(target, get_window_matrix(target) * model_matrix, bounds, source, state_.blend_,
+            [this, &bounds](const int y, std::vector<std::pair<int, int>> &spans) {
+                get_row_spans(y, bounds, spans);
+            });
+    }
+
+    static std::uint32_t get_pen_pattern(const pen_style style) {
+        switch (style) {
+        case pen_style_solid:
+            return 0xFFFF;
+
+        case pen_style_dotted:
+            return 0x6666;
+
+        case pen_style_dashed:
+            return 0x3F3F;
+
+        case pen_style_dashed_dot:
+            return 0xFF18;
+
+        case pen_style_dashed_dot_dot:
+            return 0x7E66;
+
+        default:
+            break;
+        }
+
+        return 0;
+    }
+
+    void software_graphics_driver::draw_line(const eka2l1::point &start, const eka2l1::point &end) {
+        software_texture *target = get_target();
+
+        if (!target) {
+            return;
+        }
+
+        const std::uint32_t pattern = get_pen_pattern(state_.pen_style_);
+
+        if (pattern == 0) {
+            LOG_WARN(DRIVER_GRAPHICS, "Unrecognised pen style {}!", static_cast<int>(state_.pen_style_));
+            return;
+        }
+
+        const glm::mat4 window_matrix = get_window_matrix(target);
+        const glm::vec4 start_window = window_matrix * glm::vec4(static_cast<float>(start.x), static_cast<float>(start.y), 0.0f, 1.0f);
+        const glm::vec4 end_window = window_matrix * glm::vec4(static_cast<float>(end.x), static_cast<float>(end.y), 0.0f, 1.0f);
+
+        const int x0 = static_cast<int>(std::floor(start_window.x));
+        const int y0 = static_cast<int>(std::floor(start_window.y));
+        const int x1 = static_cast<int>(std::floor(end_window.x));
+        const int y1 = static_cast<int>(std::floor(end_window.y));
+
+        const int dx = common::abs(x1 - x0);
+        const int dy = -common::abs(y1 - y0);
+        const int step_x = (x0 < x1) ? 1 : -1;
+        const int step_y = (y0 < y1) ? 1 : -1;
+
+        const eka2l1::rect bounds = intersect_with_target(get_viewport(target), target);
+        const std::uint32_t color = pack_brush_color(brush_color);
+
+        std::uint32_t *pixels = target->get_storage();
+        const int width = target->get_size().x;
+
+        int x = x0;
+        int y = y0;
+        int error = dx + dy;
+
+        // The last point is not drawn, same as GL lines
+        while ((x != x1) || (y != y1)) {
+            const double dist = std::sqrt(static_cast<double>((x - x0) * (x - x0) + (y - y0) * (y - y0)));
+            const std::uint32_t bit = static_cast<std::uint32_t>(std::lround(dist)) & 15;
+
+            if ((pattern & (1 << bit)) && is_pixel_visible(x, y, bounds)) {
+                software_fill_span(pixels + static_cast<std::size_t>(y) * width + x, color, 1, state_.blend_);
+            }
+
+            const int double_error = error * 2;
+
+            if (double_error >= dy) {
+                error += dy;
+                x += step_x;
+            }
+
+            if (double_error <= dx) {
+                error += dx;
+                y += step_y;
+            }
+        }
+    }
+
+    void software_graphics_driver::draw_line(command &cmd) {
+        sprite_batch_.count_unbatched_draw();
+
+        if (state_.pen_style_ == pen_style_none) {
+            return;
+        }
+
+        eka2l1::point start;
+        eka2l1::point end;
+
+        unpack_u64_to_2u32(cmd.data_[0], start.x, start.y);
+        unpack_u64_to_2u32(cmd.data_[1], end.x, end.y);
+
+        draw_line(start, end);
+    }
+
+    void software_graphics_driver::draw_polygon(command &cmd) {
+        std::size_t point_count = static_cast<std::size_t>(cmd.data_[0]);
+        eka2l1::point *point_list = reinterpret_cast<eka2l1::point *>(cmd.data_[1]);
+
+        sprite_batch_.count_unbatched_draw();
+
+        if (state_.pen_style_ != pen_style_none) {
+            for (std::size_t i = 0; i + 1 < point_count; i++) {
+                draw_line(point_list[i], point_list[i + 1]);
+            }
+        }
+
+        cmd.free_data(point_list);
+    }
+
+    void software_graphics_driver::clip_rect(command &cmd) {
+        eka2l1::rect clip_rect;
+        unpack_u64_to_2u32(cmd.data_[0], clip_rect.top.x, clip_rect.top.y);
+        unpack_u64_to_2u32(cmd.data_[1], clip_rect.size.x, clip_rect.size.y);
+
+        // Pixels are stored top row first for both the screen and bitmaps, so no flip is needed
+        clip_rect.size.y = common::abs(clip_rect.size.y);
+        state_.scissor_ = clip_rect;
+    }
+
+    void software_graphics_driver::clip_region(command &cmd) {
+        eka2l1::rect *to_clip_rects = reinterpret_cast<eka2l1::rect *>(cmd.data_[1]);
+        std::vector<eka2l1::rect> rects(to_clip_rects, to_clip_rects + cmd.data_[0]);
+
+        float scale = 0.0f;
+        float temp = 0.0f;
+
+        unpack_to_two_floats(cmd.data_[2], scale, temp);
+
+        cmd.free_data(to_clip_rects);
+
+        if (rects.empty()) {
+            state_.scissor_enabled_ = false;
+            state_.stencil_enabled_ = false;
+
+            return;
+        }
+
+        if (rects.size() == 1) {
+            state_.scissor_enabled_ = true;
+            state_.stencil_enabled_ = false;
+
+            state_.scissor_ = rects[0];
+            state_.scissor_.scale(scale);
+
+            return;
+        }
+
+        state_.stencil_enabled_ = true;
+        state_.scissor_enabled_ = false;
+        state_.clip_region_.clear();
+
+        for (eka2l1::rect &region_rect: rects) {
+            if (region_rect.valid()) {
+                region_rect.scale(scale);
+                state_.clip_region_.push_back(region_rect);
+            }
+        }
+    }
+
+    void software_graphics_driver::set_feature(command &cmd) {
+        drivers::graphics_feature feature;
+        bool enable = true;
+
+        unpack_u64_to_2u32(cmd.data_[0], feature, enable);
+
+        switch (feature) {
+        case drivers::graphics_feature::blend:
+            state_.blend_.enabled_ = enable;
+            break;
+
+        case drivers::graphics_feature::clipping:
+            state_.scissor_enabled_ = enable;
+            break;
+
+        case drivers::graphics_feature::stencil_test:
+            state_.stencil_enabled_ = enable;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    void software_graphics_driver::blend_formula(command &cmd) {
+        software_blend_state &blend = state_.blend_;
+
+        unpack_u64_to_2u32(cmd.data_[0], blend.rgb_equation_, blend.alpha_equation_);
+        unpack_u64_to_2u32(cmd.data_[1], blend.rgb_source_, blend.rgb_dest_);
+        unpack_u64_to_2u32(cmd.data_[2], blend.alpha_source_, blend.alpha_dest_);
+    }
+
+    void software_graphics_driver::clear(command &cmd) {
+        float color_to_clear[6];
+        std::uint8_t clear_bits = static_cast<std::uint8_t>(cmd.data_[3]);
+
+        unpack_to_two_floats(cmd.data_[0], color_to_clear[0], color_to_clear[1]);
+        unpack_to_two_floats(cmd.data_[1], color_to_clear[2], color_to_clear[3]);
+        unpack_to_two_floats(cmd.data_[2], color_to_clear[4], color_to_clear[5]);
+
+        software_texture *target = get_target();
+
+        // There is no depth or stencil buffer, the region clip is kept on the side
+        if (!target || !(clear_bits & draw_buffer_bit_color_buffer)) {
+            return;
+        }
+
+        std::uint32_t channels[4];
+
+        for (int i = 0; i < 4; i++) {
+            channels[i] = static_cast<std::uint32_t>(std::lround(std::clamp(color_to_clear[i], 0.0f, 1.0f) * 255.0f));
+        }
+
+        const std::uint32_t color = pack_software_color(channels[0], channels[1], channels[2], channels[3]);
+
+        // Clears only respect the scissor
+        eka2l1::rect area(eka2l1::vec2(0, 0), target->get_size());
+
+        if (state_.scissor_enabled_) {
+            area = state_.scissor_;
+        }
+
+        area = intersect_with_target(area, target);
+
+        std::uint32_t *pixels = target->get_storage();
+        const int width = target->get_size().x;
+
+        for (int y = area.top.y; y < area.top.y + area.size.y; y++) {
+            std::fill_n(pixels + static_cast<std::size_t>(y) * width + area.top.x, area.size.x, color);
+        }
+    }
+
+    void software_graphics_driver::set_viewport(command &cmd) {
+        eka2l1::rect viewport;
+        unpack_u64_to_2u32(cmd.data_[0], viewport.top.x, viewport.top.y);
+        unpack_u64_to_2u32(cmd.data_[1], viewport.size.x, viewport.size.y);
+
+        set_viewport(viewport);
+    }
+
+    void software_graphics_driver::set_pen_style(command &cmd) {
+        state_.pen_style_ = static_cast<pen_style>(cmd.data_[0]);
+    }
+
+    void software_graphics_driver::set_swapchain_size(command &cmd) {
+        shared_graphics_driver::set_swapchain_size(cmd);
+
+        if (screen_->get_size() != swapchain_size) {
+            screen_->resize(swapchain_size);
+        }
+    }
+
+    void software_graphics_driver::display(command &cmd) {
+        if (disp_hook_) {
+            disp_hook_();
+        }
+
+        finish(cmd.status_, 0);
+    }
+
+    void software_graphics_driver::dispatch(command &cmd) {
+        switch (cmd.opcode_) {
+        case graphics_driver_draw_bitmap:
+            draw_bitmap(cmd);
+            break;
+
+        case graphics_driver_draw_rectangle:
+            draw_rectangle(cmd);
+            break;
+
+        case graphics_driver_draw_line:
+            draw_line(cmd);
+            break;
+
+        case graphics_driver_draw_polygon:
+            draw_polygon(cmd);
+            break;
+
+        case graphics_driver_clip_rect:
+        case graphics_driver_clip_bitmap_rect:
+            clip_rect(cmd);
+            break;
+
+        case graphics_driver_clip_region:
+            clip_region(cmd);
+            break;
+
+        case graphics_driver_set_feature:
+            set_feature(cmd);
+            break;
+
+        case graphics_driver_blend_formula:
+            blend_formula(cmd);
+            break;
+
+        case graphics_driver_clear:
+            clear(cmd);
+            break;
+
+        case graphics_driver_set_viewport:
+        case graphics_driver_set_bitmap_viewport:
+            set_viewport(cmd);
+            break;
+
+        case graphics_driver_set_pen_style:
+            set_pen_style(cmd);
+            break;
+
+        case graphics_driver_set_swapchain_size:
+            set_swapchain_size(cmd);
+            break;
+
+        case graphics_driver_display:
+            display(cmd);
+            break;
+
+        case graphics_driver_backup_state:
+            backup_state_ = state_;
+            break;
+
+        case graphics_driver_restore_state:
+            state_ = backup_state_;
+            break;
+
+        // No programmable pipeline here. Fail the creations so callers take their fallback paths.
+        case graphics_driver_create_shader_module:
+        case graphics_driver_create_shader_program:
+            finish(cmd.status_, -1);
+            break;
+
+        case graphics_driver_create_buffer:
+            if (cmd.data_[3] != 0) {
+                cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[0]));
+            } else {
+                finish(cmd.status_, -1);
+            }
+
+            break;
+
+        case graphics_driver_create_input_descriptor:
+            if (cmd.data_[2] != 0) {
+                cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[0]));
+            } else {
+                finish(cmd.status_, -1);
+            }
+
+            break;
+
+        case graphics_driver_update_buffer:
+        case graphics_driver_set_uniform:
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[1]));
+            break;
+
+        case graphics_driver_bind_vertex_buffers:
+            cmd.free_data(reinterpret_cast<std::uint8_t *>(cmd.data_[0]));
+            break;
+
+        case graphics_driver_use_program:
+        case graphics_driver_set_texture_for_shader:
+        case graphics_driver_draw_array:
+        case graphics_driver_draw_indexed:
+        case graphics_driver_bind_index_buffer:
+        case graphics_driver_bind_input_descriptor:
+        case graphics_driver_depth_pass_condition:
+        case graphics_driver_depth_set_mask:
+        case graphics_driver_stencil_pass_condition:
+        case graphics_driver_stencil_set_action:
+        case graphics_driver_stencil_set_mask:
+        case graphics_driver_set_front_face_rule:
+        case graphics_driver_cull_face:
+        case graphics_driver_set_point_size:
+        case graphics_driver_set_color_mask:
+        case graphics_driver_set_depth_func:
+        case graphics_driver_set_line_width:
+        case graphics_driver_set_depth_bias:
+        case graphics_driver_set_depth_range:
+        case graphics_driver_set_texture_anisotrophy:
+            break;
+
+        default:
+            shared_graphics_driver::dispatch(cmd);
+            break;
+        }
+    }
+}
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/graphics/backend/software/raster_software.h>
+
+#include <common/platform.h>
+
+#include <algorithm>
+
+#if EKA2L1_ARCH(X64) || EKA2L1_ARCH(X86)
+#include <emmintrin.h>
+#define RASTER_SOFTWARE_SSE2 1
+#elif EKA2L1_ARCH(ARM64)
+#include <arm_neon.h>
+#define RASTER_SOFTWARE_NEON 1
+#endif
+
+namespace eka2l1::drivers {
+    bool software_blend_state::is_replace() const {
+        if (!enabled_) {
+            return true;
+        }
+
+        return (rgb_equation_ == blend_equation::add) && (alpha_equation_ == blend_equation::add) && (rgb_source_ == blend_factor::one)
+            && (rgb_dest_ == blend_factor::zero) && (alpha_source_ == blend_factor::one) && (alpha_dest_ == blend_factor::zero);
+    }
+
+    // Rounded a * b / 255
+    static inline std::uint32_t mul255(const std::uint32_t a, const std::uint32_t b) {
+        const std::uint32_t t = a * b + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    static std::uint32_t blend_factor_value(const blend_factor factor, const std::uint32_t source, const std::uint32_t dest,
+        const int channel) {
+        const std::uint32_t sc = (source >> (channel * 8)) & 0xFF;
+        const std::uint32_t dc = (dest >> (channel * 8)) & 0xFF;
+        const std::uint32_t sa = source >> 24;
+        const std::uint32_t da = dest >> 24;
+
+        switch (factor) {
+        case blend_factor::one:
+            return 255;
+
+        case blend_factor::zero:
+            return 0;
+
+        case blend_factor::frag_out_alpha:
+            return sa;
+
+        case blend_factor::one_minus_frag_out_alpha:
+            return 255 - sa;
+
+        case blend_factor::current_alpha:
+            return da;
+
+        case blend_factor::one_minus_current_alpha:
+            return 255 - da;
+
+        case blend_factor::frag_out_color:
+            return sc;
+
+        case blend_factor::one_minus_frag_out_color:
+            return 255 - sc;
+
+        case blend_factor::current_color:
+            return dc;
+
+        case blend_factor::one_minus_current_color:
+            return 255 - dc;
+
+        case blend_factor::frag_out_alpha_saturate:
+            return (channel == 3) ? 255 : std::min<std::uint32_t>(sa, 255 - da);
+
+        default:
+            break;
+        }
+
+        return 255;
+    }
+
+    static inline std::uint32_t blend_channel(const blend_equation equation, const std::uint32_t source, const std::uint32_t dest) {
+        switch (equation) {
+        case blend_equation::sub:
+            return (source > dest) ? (source - dest) : 0;
+
+        case blend_equation::isub:
+            return (dest > source) ? (dest - source) : 0;
+
+        default:
+            break;
+        }
+
+        return std::min<std::uint32_t>(source + dest, 255);
+    }
+
+    static inline std::uint32_t blend_pixel(const std::uint32_t source, const std::uint32_t dest, const software_blend_state &state) {
+        std::uint32_t result = 0;
+
+        for (int channel = 0; channel < 4; channel++) {
+            const bool is_alpha = (channel == 3);
+
+            const std::uint32_t sc = (source >> (channel * 8)) & 0xFF;
+            const std::uint32_t dc = (dest >> (channel * 8)) & 0xFF;
+
+            const std::uint32_t sf = blend_factor_value(is_alpha ? state.alpha_source_ : state.rgb_source_, source, dest, channel);
+            const std::uint32_t df = blend_factor_value(is_alpha ? state.alpha_dest_ : state.rgb_dest_, source, dest, channel);
+
+            result |= blend_channel(is_alpha ? state.alpha_equation_ : state.rgb_equation_, mul255(sc, sf), mul255(dc, df)) << (channel * 8);
+        }
+
+        return result;
+    }
+
+    void software_blend_span_scalar(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state) {
+        if (state.is_replace()) {
+            std::copy(source, source + count, dest);
+            return;
+        }
+
+        for (std::size_t i = 0; i < count; i++) {
+            dest[i] = blend_pixel(source[i], dest[i], state);
+        }
+    }
+
+    static bool is_alpha_only_factor(const blend_factor factor) {
+        return (factor == blend_factor::one) || (factor == blend_factor::zero) || (factor == blend_factor::frag_out_alpha)
+            || (factor == blend_factor::one_minus_frag_out_alpha) || (factor == blend_factor::current_alpha)
+            || (factor == blend_factor::one_minus_current_alpha);
+    }
+
+#if RASTER_SOFTWARE_SSE2
+    // Factor for a pair of pixels unpacked to 16-bit lanes
+    static inline __m128i blend_factor_sse2(const blend_factor factor, const __m128i source_alpha, const __m128i dest_alpha) {
+        const __m128i full = _mm_set1_epi16(255);
+
+        switch (factor) {
+        case blend_factor::zero:
+            return _mm_setzero_si128();
+
+        case blend_factor::frag_out_alpha:
+            return source_alpha;
+
+        case blend_factor::one_minus_frag_out_alpha:
+            return _mm_sub_epi16(full, source_alpha);
+
+        case blend_factor::current_alpha:
+            return dest_alpha;
+
+        case blend_factor::one_minus_current_alpha:
+            return _mm_sub_epi16(full, dest_alpha);
+
+        default:
+            break;
+        }
+
+        return full;
+    }
+
+    static inline __m128i broadcast_alpha_sse2(const __m128i pixels) {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    static inline __m128i mul255_sse2(const __m128i a, const __m128i b) {
+        const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    static inline __m128i blend_equation_sse2(const blend_equation equation, const __m128i source, const __m128i dest) {
+        switch (equation) {
+        case blend_equation::sub:
+            return _mm_subs_epu16(source, dest);
+
+        case blend_equation::isub:
+            return _mm_subs_epu16(dest, source);
+
+        default:
+            break;
+        }
+
+        // Saturated when packed back to bytes
+        return _mm_add_epi16(source, dest);
+    }
+
+    static inline __m128i blend_pair_sse2(const __m128i source, const __m128i dest, const software_blend_state &state, const __m128i alpha_mask) {
+        const __m128i source_alpha = broadcast_alpha_sse2(source);
+        const __m128i dest_alpha = broadcast_alpha_sse2(dest);
+
+        const __m128i source_factor = _mm_or_si128(_mm_andnot_si128(alpha_mask, blend_factor_sse2(state.rgb_source_, source_alpha, dest_alpha)),
+            _mm_and_si128(alpha_mask, blend_factor_sse2(state.alpha_source_, source_alpha, dest_alpha)));
+        const __m128i dest_factor = _mm_or_si128(_mm_andnot_si128(alpha_mask, blend_factor_sse2(state.rgb_dest_, source_alpha, dest_alpha)),
+            _mm_and_si128(alpha_mask, blend_factor_sse2(state.alpha_dest_, source_alpha, dest_alpha)));
+
+        const __m128i source_term = mul255_sse2(source, source_factor);
+        const __m128i dest_term = mul255_sse2(dest, dest_factor);
+
+        if (state.rgb_equation_ == state.alpha_equation_) {
+            return blend_equation_sse2(state.rgb_equation_, source_term, dest_term);
+        }
+
+        return _mm_or_si128(_mm_andnot_si128(alpha_mask, blend_equation_sse2(state.rgb_equation_, source_term, dest_term)),
+            _mm_and_si128(alpha_mask, blend_equation_sse2(state.alpha_equation_, source_term, dest_term)));
+    }
+
+    static std::size_t blend_span_vector(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+        std::size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128i source_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+            const __m128i dest_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dest + i));
+
+            const __m128i low = blend_pair_sse2(_mm_unpacklo_epi8(source_pixels, zero), _mm_unpacklo_epi8(dest_pixels, zero), state, alpha_mask);
+            const __m128i high = blend_pair_sse2(_mm_unpackhi_epi8(source_pixels, zero), _mm_unpackhi_epi8(dest_pixels, zero), state, alpha_mask);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_packus_epi16(low, high));
+        }
+
+        return i;
+    }
+
+    static std::size_t modulate_span_vector(std::uint32_t *span, const std::uint32_t color, const std::size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i color_wide = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color)), zero);
+
+        std::size_t i = 0;
+
+        for (; i + 4 <= count; i += 4) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(span + i));
+
+            const __m128i low = mul255_sse2(_mm_unpacklo_epi8(pixels, zero), color_wide);
+            const __m128i high = mul255_sse2(_mm_unpackhi_epi8(pixels, zero), color_wide);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(span + i), _mm_packus_epi16(low, high));
+        }
+
+        return i;
+    }
+#elif RASTER_SOFTWARE_NEON
+    static inline uint16x8_t blend_factor_neon(const blend_factor factor, const uint16x8_t source_alpha, const uint16x8_t dest_alpha) {
+        const uint16x8_t full = vdupq_n_u16(255);
+
+        switch (factor) {
+        case blend_factor::zero:
+            return vdupq_n_u16(0);
+
+        case blend_factor::frag_out_alpha:
+            return source_alpha;
+
+        case blend_factor::one_minus_frag_out_alpha:
+            return vsubq_u16(full, source_alpha);
+
+        case blend_factor::current_alpha:
+            return dest_alpha;
+
+        case blend_factor::one_minus_current_alpha:
+            return vsubq_u16(full, dest_alpha);
+
+        default:
+            break;
+        }
+
+        return full;
+    }
+
+    static inline uint16x8_t mul255_neon(const uint16x8_t a, const uint16x8_t b) {
+        const uint16x8_t t = vaddq_u16(vmulq_u16(a, b), vdupq_n_u16(128));
+        return vshrq_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+    }
+
+    static inline uint16x8_t blend_equation_neon(const blend_equation equation, const uint16x8_t source, const uint16x8_t dest) {
+        switch (equation) {
+        case blend_equation::sub:
+            return vqsubq_u16(source, dest);
+
+        case blend_equation::isub:
+            return vqsubq_u16(dest, source);
+
+        default:
+            break;
+        }
+
+        return vaddq_u16(source, dest);
+    }
+
+    static inline uint8x8_t blend_pair_neon(const uint8x8_t source, const uint8x8_t dest, const software_blend_state &state, const uint16x8_t alpha_mask) {
+        static const std::uint8_t ALPHA_INDICES[8] = { 3, 3, 3, 3, 7, 7, 7, 7 };
+        const uint8x8_t alpha_indices = vld1_u8(ALPHA_INDICES);
+
+        const uint16x8_t source_wide = vmovl_u8(source);
+        const uint16x8_t dest_wide = vmovl_u8(dest);
+        const uint16x8_t source_alpha = vmovl_u8(vtbl1_u8(source, alpha_indices));
+        const uint16x8_t dest_alpha = vmovl_u8(vtbl1_u8(dest, alpha_indices));
+
+        const uint16x8_t source_factor = vbslq_u16(alpha_mask, blend_factor_neon(state.alpha_source_, source_alpha, dest_alpha),
+            blend_factor_neon(state.rgb_source_, source_alpha, dest_alpha));
+        const uint16x8_t dest_factor = vbslq_u16(alpha_mask, blend_factor_neon(state.alpha_dest_, source_alpha, dest_alpha),
+            blend_factor_neon(state.rgb_dest_, source_alpha, dest_alpha));
+
+        const uint16x8_t source_term = mul255_neon(source_wide, source_factor);
+        const uint16x8_t dest_term = mul255_neon(dest_wide, dest_factor);
+
+        const uint16x8_t result = vbslq_u16(alpha_mask, blend_equation_neon(state.alpha_equation_, source_term, dest_term),
+            blend_equation_neon(state.rgb_equation_, source_term, dest_term));
+
+        return vqmovn_u16(result);
+    }
+
+    static std::size_t blend_span_vector(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state) {
+        static const std::uint16_t ALPHA_MASK[8] = { 0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF };
+        const uint16x8_t alpha_mask = vld1q_u16(ALPHA_MASK);
+
+        std::size_t i = 0;
+
+        for (; i + 2 <= count; i += 2) {
+            const uint8x8_t source_pixels = vld1_u8(reinterpret_cast<const std::uint8_t *>(source + i));
+            const uint8x8_t dest_pixels = vld1_u8(reinterpret_cast<const std::uint8_t *>(dest + i));
+
+            vst1_u8(reinterpret_cast<std::uint8_t *>(dest + i), blend_pair_neon(source_pixels, dest_pixels, state, alpha_mask));
+        }
+
+        return i;
+    }
+
+    static std::size_t modulate_span_vector(std::uint32_t *span, const std::uint32_t color, const std::size_t count) {
+        const uint16x8_t color_wide = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(color)));
+
+        std::size_t i = 0;
+
+        for (; i + 2 <= count; i += 2) {
+            const uint8x8_t pixels = vld1_u8(reinterpret_cast<const std::uint8_t *>(span + i));
+            vst1_u8(reinterpret_cast<std::uint8_t *>(span + i), vqmovn_u16(mul255_neon(vmovl_u8(pixels), color_wide)));
+        }
+
+        return i;
+    }
+#else
+    static std::size_t blend_span_vector(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state) {
+        return 0;
+    }
+
+    static std::size_t modulate_span_vector(std::uint32_t *span, const std::uint32_t color, const std::size_t count) {
+        return 0;
+    }
+#endif
+
+    void software_blend_span(std::uint32_t *dest, const std::uint32_t *source, const std::size_t count, const software_blend_state &state) {
+        if (state.is_replace()) {
+            std::copy(source, source + count, dest);
+            return;
+        }
+
+        std::size_t done = 0;
+
+        if (is_alpha_only_factor(state.rgb_source_) && is_alpha_only_factor(state.rgb_dest_) && is_alpha_only_factor(state.alpha_source_)
+            && is_alpha_only_factor(state.alpha_dest_)) {
+            done = blend_span_vector(dest, source, count, state);
+        }
+
+        for (std::size_t i = done; i < count; i++) {
+            dest[i] = blend_pixel(source[i], dest[i], state);
+        }
+    }
+
+    void software_fill_span(std::uint32_t *dest, const std::uint32_t color, const std::size_t count, const software_blend_state &state) {
+        if (state.is_replace()) {
+            std::fill(dest, dest + count, color);
+            return;
+        }
+
+        static constexpr std::size_t CHUNK_SIZE = 64;
+
+        std::uint32_t source[CHUNK_SIZE];
+        std::fill(source, source + CHUNK_SIZE, color);
+
+        for (std::size_t i = 0; i < count; i += CHUNK_SIZE) {
+            software_blend_span(dest + i, source, std::min(CHUNK_SIZE, count - i), state);
+        }
+    }
+
+    void software_modulate_span(std::uint32_t *span, const std::uint32_t color, const std::size_t count) {
+        if (color == 0xFFFFFFFF) {
+            return;
+        }
+
+        for (std::size_t i = modulate_span_vector(span, color, count); i < count; i++) {
+            std::uint32_t result = 0;
+
+            for (int channel = 0; channel < 4; channel++) {
+                result |= mul255((span[i] >> (channel * 8)) & 0xFF, (color >> (channel * 8)) & 0xFF) << (channel * 8);
+            }
+
+            span[i] = result;
+        }
+    }
+}
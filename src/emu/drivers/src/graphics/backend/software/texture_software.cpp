@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/graphics/backend/software/graphics_software.h>
+#include <drivers/graphics/backend/software/raster_software.h>
+#include <drivers/graphics/backend/software/texture_software.h>
+#include <drivers/graphics/texture_decode.h>
+
+#include <common/algorithm.h>
+#include <common/log.h>
+#include <common/pixel.h>
+#include <common/thread_pool.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace eka2l1::drivers {
+    static inline std::uint32_t expand_5_bits(const std::uint32_t value) {
+        return (value * 527 + 23) >> 6;
+    }
+
+    // GL rounds to the nearest value when packing normalized channels
+    static inline std::uint32_t narrow_channel(const std::uint32_t value, const std::uint32_t max_value) {
+        return (value * max_value + 127) / 255;
+    }
+
+    static inline std::uint16_t read_u16(const std::uint8_t *source) {
+        std::uint16_t value = 0;
+        std::memcpy(&value, source, sizeof(std::uint16_t));
+
+        return value;
+    }
+
+    std::size_t software_source_pixel_size(const texture_format format, const texture_data_type data_type) {
+        switch (data_type) {
+        case texture_data_type::ushort_5_6_5:
+        case texture_data_type::ushort_4_4_4_4:
+        case texture_data_type::ushort_5_5_5_1:
+            return 2;
+
+        case texture_data_type::ubyte:
+            break;
+
+        default:
+            return 0;
+        }
+
+        switch (format) {
+        case texture_format::r:
+        case texture_format::r8:
+            return 1;
+
+        case texture_format::rg:
+        case texture_format::rg8:
+            return 2;
+
+        case texture_format::rgb:
+        case texture_format::bgr:
+            return 3;
+
+        case texture_format::rgba:
+        case texture_format::bgra:
+            return 4;
+
+        default:
+            break;
+        }
+
+        return 0;
+    }
+
+    bool convert_row_to_software(std::uint32_t *dest, const std::uint8_t *source, const std::size_t count, const texture_format format,
+        const texture_data_type data_type) {
+        switch (data_type) {
+        case texture_data_type::ushort_5_6_5:
+            return common::convert_pixels(dest, common::pixel_format::rgba8888, source, common::pixel_format::rgb565, count);
+
+        case texture_data_type::ushort_4_4_4_4:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint16_t value = read_u16(source + i * 2);
+                dest[i] = pack_software_color((value >> 12) * 17, ((value >> 8) & 0xF) * 17, ((value >> 4) & 0xF) * 17, (value & 0xF) * 17);
+            }
+
+            return true;
+
+        case texture_data_type::ushort_5_5_5_1:
+            for (std::size_t i = 0; i < count; i++) {
+                const std::uint16_t value = read_u16(source + i * 2);
+                dest[i] = pack_software_color(expand_5_bits(value >> 11), expand_5_bits((value >> 6) & 0x1F), expand_5_bits((value >> 1) & 0x1F),
+                    (value & 1) ? 0xFF : 0);
+            }
+
+            return true;
+
+        case texture_data_type::ubyte:
+            break;
+
+        default:
+            return false;
+        }
+
+        switch (format) {
+        case texture_format::r:
+        case texture_format::r8:
+            for (std::size_t i = 0; i < count; i++) {
+                dest[i] = pack_software_color(source[i], 0, 0, 0xFF);
+            }
+
+            return true;
+
+        case texture_format::rg:
+        case texture_format::rg8:
+            for (std::size_t i = 0; i < count; i++) {
+                dest[i] = pack_software_color(source[i * 2], source[i * 2 + 1], 0, 0xFF);
+            }
+
+            return true;
+
+        case texture_format::rgb:
+            return common::convert_pixels(dest, common::pixel_format::rgba8888, source, common::pixel_format::rgb888, count);
+
+        case texture_format::bgr:
+            return common::convert_pixels(dest, common::pixel_format::rgba8888, source, common::pixel_format::bgr888, count);
+
+        case texture_format::rgba:
+            return common::convert_pixels(dest, common::pixel_format::rgba8888, source, common::pixel_format::rgba8888, count);
+
+        case texture_format::bgra:
+            return common::convert_pixels(dest, common::pixel_format::rgba8888, source, common::pixel_format::bgra8888, count);
+
+        default:
+            break;
+        }
+
+        return false;
+    }
+
+    static bool is_depth_stencil_format(const texture_format format) {
+        return (format == texture_format::depth_stencil) || (format == texture_format::depth24_stencil8);
+    }
+
+    software_texture::software_texture()
+        : size_(0, 0)
+        , dimensions_(2)
+        , format_(texture_format::none)
+        , data_type_(texture_data_type::ubyte)
+        , swizzle_({ channel_swizzle::red, channel_swizzle::green, channel_swizzle::blue, channel_swizzle::alpha })
+        , swizzled_dirty_(true) {
+    }
+
+    bool software_texture::create(graphics_driver *driver, const int dim, const int miplvl, const vec3 &size, const texture_format internal_format,
+        const texture_format format, const texture_data_type data_type, void *data, const std::size_t data_size, const std::size_t pixels_per_line,
+        const std::uint32_t unpack_alignment) {
+        if (miplvl != 0) {
+            // Sampling is always done from the base level
+            return true;
+        }
+
+        size_ = eka2l1::vec2(size.x, size.y);
+        dimensions_ = dim;
+        format_ = internal_format;
+        data_type_ = data_type;
+        swizzled_dirty_ = true;
+
+        if (is_depth_stencil_format(internal_format) || is_depth_stencil_format(format)) {
+            pixels_.clear();
+            return true;
+        }
+
+        pixels_.assign(static_cast<std::size_t>(size_.x) * size_.y, pack_software_color(0, 0, 0, 0));
+
+        if (!data) {
+            return true;
+        }
+
+        std::uint8_t *dest = reinterpret_cast<std::uint8_t *>(pixels_.data());
+        const std::uint8_t *source = reinterpret_cast<const std::uint8_t *>(data);
+
+        switch (format) {
+        case texture_format::etc2_rgb8:
+            decode_etc_texture(dest, source, size_.x, size_.y, &common::get_shared_thread_pool());
+            return true;
+
+        case texture_format::pvrtc_4bppv1_rgb:
+        case texture_format::pvrtc_4bppv1_rgba:
+            decode_pvrtc_texture(dest, source, size_.x, size_.y, false, &common::get_shared_thread_pool());
+            return true;
+
+        case texture_format::pvrtc_2bppv1_rgb:
+        case texture_format::pvrtc_2bppv1_rgba:
+            decode_pvrtc_texture(dest, source, size_.x, size_.y, true, &common::get_shared_thread_pool());
+            return true;
+
+        default:
+            break;
+        }
+
+        upload(eka2l1::vec2(0, 0), size_, pixels_per_line, format, data_type, data, data_size, unpack_alignment);
+        return true;
+    }
+
+    void software_texture::upload(const eka2l1::vec2 &offset, const eka2l1::vec2 &size, const std::size_t pixels_per_line, const texture_format data_format,
+        const texture_data_type data_type, const void *data, const std::size_t data_size, const std::uint32_t unpack_alignment) {
+        const std::size_t pixel_size = software_source_pixel_size(data_format, data_type);
+
+        if (pixel_size == 0) {
+            LOG_ERROR(DRIVER_GRAPHICS, "Unsupported texture format {} with data type {} for the software rasteriser",
+                static_cast<int>(data_format), static_cast<int>(data_type));
+            return;
+        }
+
+        const std::size_t alignment = (unpack_alignment == 0) ? 1 : unpack_alignment;
+        const std::size_t row_pixels = (pixels_per_line == 0) ? size.x : pixels_per_line;
+        const std::size_t row_bytes = ((row_pixels * pixel_size + alignment - 1) / alignment) * alignment;
+
+        const int copy_width = common::min<int>(size.x, size_.x - offset.x);
+        const int copy_height = common::min<int>(size.y, size_.y - offset.y);
+
+        if ((copy_width <= 0) || (copy_height <= 0) || (offset.x < 0) || (offset.y < 0)) {
+            return;
+        }
+
+        const std::uint8_t *source = reinterpret_cast<const std::uint8_t *>(data);
+
+        for (int y = 0; y < copy_height; y++) {
+            const std::size_t row_offset = y * row_bytes;
+
+            if ((data_size != 0) && (row_offset + copy_width * pixel_size > data_size)) {
+                break;
+            }
+
+            convert_row_to_software(pixels_.data() + (offset.y + y) * size_.x + offset.x, source + row_offset, copy_width, data_format, data_type);
+        }
+
+        swizzled_dirty_ = true;
+    }
+
+    void software_texture::update_data(graphics_driver *driver, const int mip_lvl, const vec3 &offset, const vec3 &size, const std::size_t byte_width,
+        const texture_format data_format, const texture_data_type data_type, const void *data, const std::size_t data_size, const std::uint32_t unpack_alignment) {
+        if ((mip_lvl != 0) || !data || pixels_.empty()) {
+            return;
+        }
+
+        upload(eka2l1::vec2(offset.x, offset.y), eka2l1::vec2(size.x, size.y), byte_width, data_format, data_type, data, data_size, unpack_alignment);
+    }
+
+    void software_texture::resize(const eka2l1::vec2 &new_size) {
+        std::vector<std::uint32_t> new_pixels(static_cast<std::size_t>(new_size.x) * new_size.y, pack_software_color(0, 0, 0, 0));
+
+        const int copy_width = common::min<int>(size_.x, new_size.x);
+        const int copy_height = common::min<int>(size_.y, new_size.y);
+
+        if (!pixels_.empty()) {
+            for (int y = 0; y < copy_height; y++) {
+                std::copy(pixels_.begin() + y * size_.x, pixels_.begin() + y * size_.x + copy_width, new_pixels.begin() + y * new_size.x);
+            }
+        }
+
+        pixels_ = std::move(new_pixels);
+        size_ = new_size;
+        swizzled_dirty_ = true;
+    }
+
+    std::uint64_t software_texture::texture_handle() {
+        return reinterpret_cast<std::uint64_t>(this);
+    }
+
+    void software_texture::set_filter_minmag(const bool min, const filter_option op) {
+        // Sampling is always nearest
+    }
+
+    void software_texture::set_addressing_mode(const addressing_direction dir, const addressing_option op) {
+        // Coordinates are always clamped to the edge
+    }
+
+    void software_texture::set_channel_swizzle(channel_swizzles swizz) {
+        if (swizzle_ != swizz) {
+            swizzle_ = swizz;
+            swizzled_dirty_ = true;
+        }
+    }
+
+    void software_texture::generate_mips() {
+    }
+
+    void software_texture::set_max_mip_level(const std::uint32_t max_mip) {
+    }
+
+    void software_texture::bind(graphics_driver *driver, const int binding) {
+    }
+
+    void software_texture::unbind(graphics_driver *driver) {
+    }
+
+    vec2 software_texture::get_size() const {
+        return size_;
+    }
+
+    texture_format software_texture::get_format() const {
+        return format_;
+    }
+
+    texture_data_type software_texture::get_data_type() const {
+        return data_type_;
+    }
+
+    int software_texture::get_total_dimensions() const {
+        return dimensions_;
+    }
+
+    std::uint32_t *software_texture::get_storage() {
+        if (pixels_.empty()) {
+            return nullptr;
+        }
+
+        swizzled_dirty_ = true;
+        return pixels_.data();
+    }
+
+    const std::uint32_t *software_texture::get_raw_pixels() const {
+        return pixels_.empty() ? nullptr : pixels_.data();
+    }
+
+    static std::uint32_t swizzle_channel(const std::uint32_t pixel, const channel_swizzle swizzle) {
+        switch (swizzle) {
+        case channel_swizzle::red:
+            return pixel & 0xFF;
+
+        case channel_swizzle::green:
+            return (pixel >> 8) & 0xFF;
+
+        case channel_swizzle::blue:
+            return (pixel >> 16) & 0xFF;
+
+        case channel_swizzle::alpha:
+            return pixel >> 24;
+
+        case channel_swizzle::zero:
+            return 0;
+
+        default:
+            break;
+        }
+
+        return 0xFF;
+    }
+
+    const std::uint32_t *software_texture::get_sample_pixels() {
+        if (pixels_.empty()) {
+            return nullptr;
+        }
+
+        const channel_swizzles identity = { channel_swizzle::red, channel_swizzle::green, channel_swizzle::blue, channel_swizzle::alpha };
+
+        if (swizzle_ == identity) {
+            return pixels_.data();
+        }
+
+        if (swizzled_dirty_) {
+            swizzled_pixels_.resize(pixels_.size());
+
+            for (std::size_t i = 0; i < pixels_.size(); i++) {
+                const std::uint32_t pixel = pixels_[i];
+
+                swizzled_pixels_[i] = pack_software_color(swizzle_channel(pixel, swizzle_[0]), swizzle_channel(pixel, swizzle_[1]),
+                    swizzle_channel(pixel, swizzle_[2]), swizzle_channel(pixel, swizzle_[3]));
+            }
+
+            swizzled_dirty_ = false;
+        }
+
+        return swizzled_pixels_.data();
+    }
+
+    software_framebuffer::software_framebuffer(std::initializer_list<texture *> color_buffer_list, texture *depth_and_stencil_buffer)
+        : framebuffer(color_buffer_list, depth_and_stencil_buffer)
+        , driver_(nullptr) {
+    }
+
+    void software_framebuffer::bind(graphics_driver *driver, const framebuffer_bind_type type_bind) {
+        driver_ = static_cast<software_graphics_driver *>(driver);
+        driver_->bind_framebuffer(this, type_bind);
+    }
+
+    void software_framebuffer::unbind(graphics_driver *driver) {
+        static_cast<software_graphics_driver *>(driver)->unbind_framebuffer(this);
+    }
+
+    bool software_framebuffer::set_draw_buffer(const std::int32_t attachment_id) {
+        return is_attachment_id_valid(attachment_id);
+    }
+
+    bool software_framebuffer::set_read_buffer(const std::int32_t attachment_id) {
+        return is_attachment_id_valid(attachment_id);
+    }
+
+    bool software_framebuffer::set_depth_stencil_buffer(texture *tex) {
+        depth_and_stencil_buffer = tex;
+        return true;
+    }
+
+    std::int32_t software_framebuffer::set_color_buffer(texture *tex, const std::int32_t position) {
+        if (position < 0) {
+            color_buffers.push_back(tex);
+            return static_cast<std::int32_t>(color_buffers.size() - 1);
+        }
+
+        if (static_cast<std::size_t>(position) >= color_buffers.size()) {
+            color_buffers.resize(position + 1, nullptr);
+        }
+
+        color_buffers[position] = tex;
+        return position;
+    }
+
+    bool software_framebuffer::remove_color_buffer(const std::int32_t position) {
+        if (!is_attachment_id_valid(position)) {
+            return false;
+        }
+
+        color_buffers[position] = nullptr;
+        return true;
+    }
+
+    software_texture *software_framebuffer::get_color_buffer() {
+        if (color_buffers.empty()) {
+            return nullptr;
+        }
+
+        return static_cast<software_texture *>(color_buffers[0]);
+    }
+
+    bool software_framebuffer::blit(const eka2l1::rect &source_rect, const eka2l1::rect &dest_rect, const std::uint32_t flags,
+        const filter_option copy_filter) {
+        if (!driver_ || !(flags & draw_buffer_bit_color_buffer)) {
+            return false;
+        }
+
+        software_texture *source = driver_->get_blit_texture(framebuffer_bind_read);
+        software_texture *dest = driver_->get_blit_texture(framebuffer_bind_draw);
+
+        if (!source || !dest || source_rect.empty() || dest_rect.empty()) {
+            return false;
+        }
+
+        const std::uint32_t *source_pixels = source->get_raw_pixels();
+        std::uint32_t *dest_pixels = dest->get_storage();
+
+        if (!source_pixels || !dest_pixels) {
+            return false;
+        }
+
+        const eka2l1::vec2 source_size = source->get_size();
+        const eka2l1::vec2 dest_size = dest->get_size();
+
+        const int dest_x_begin = common::max<int>(dest_rect.top.x, 0);
+        const int dest_x_end = common::min<int>(dest_rect.top.x + dest_rect.size.x, dest_size.x);
+        const int dest_y_begin = common::max<int>(dest_rect.top.y, 0);
+        const int dest_y_end = common::min<int>(dest_rect.top.y + dest_rect.size.y, dest_size.y);
+
+        // Nearest filtering only, linear filtering of a 1:1 copy gives the same result anyway
+        for (int y = dest_y_begin; y < dest_y_end; y++) {
+            const int source_y = source_rect.top.y + static_cast<int>((static_cast<std::int64_t>(y - dest_rect.top.y) * 2 + 1) * source_rect.size.y / (dest_rect.size.y * 2));
+
+            if ((source_y < 0) || (source_y >= source_size.y)) {
+                continue;
+            }
+
+            for (int x = dest_x_begin; x < dest_x_end; x++) {
+                const int source_x = source_rect.top.x + static_cast<int>((static_cast<std::int64_t>(x - dest_rect.top.x) * 2 + 1) * source_rect.size.x / (dest_rect.size.x * 2));
+
+                if ((source_x >= 0) && (source_x < source_size.x)) {
+                    dest_pixels[y * dest_size.x + x] = source_pixels[source_y * source_size.x + source_x];
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool software_framebuffer::read(const texture_format type, const texture_data_type dest_format, const eka2l1::point &pos, const eka2l1::object_size &size,
+        std::uint8_t *buffer_ptr) {
+        software_texture *source = get_color_buffer();
+
+        if (!source || !source->get_raw_pixels() || !buffer_ptr) {
+            return false;
+        }
+
+        const bool is_16bit = (dest_format == texture_data_type::ushort_4_4_4_4) || (dest_format == texture_data_type::ushort_5_6_5);
+        const std::size_t dest_pitch = (((size.x * (is_16bit ? 2 : 4)) + 3) >> 2) << 2;
+
+        const std::uint32_t *pixels = source->get_raw_pixels();
+        const eka2l1::vec2 source_size = source->get_size();
+
+        for (int y = 0; y < size.y; y++) {
+            std::uint8_t *dest = buffer_ptr + y * dest_pitch;
+            const int source_y = pos.y + y;
+
+            for (int x = 0; x < size.x; x++) {
+                const int source_x = pos.x + x;
+                std::uint32_t pixel = 0;
+
+                if ((source_x >= 0) && (source_y >= 0) && (source_x < source_size.x) && (source_y < source_size.y)) {
+                    pixel = pixels[source_y * source_size.x + source_x];
+                }
+
+                const std::uint32_t r = pixel & 0xFF;
+                const std::uint32_t g = (pixel >> 8) & 0xFF;
+                const std::uint32_t b = (pixel >> 16) & 0xFF;
+                const std::uint32_t a = pixel >> 24;
+
+                if (dest_format == texture_data_type::ushort_4_4_4_4) {
+                    const std::uint16_t value = static_cast<std::uint16_t>((narrow_channel(r, 15) << 12) | (narrow_channel(g, 15) << 8)
+                        | (narrow_channel(b, 15) << 4) | narrow_channel(a, 15));
+
+                    std::memcpy(dest + x * 2, &value, sizeof(std::uint16_t));
+                } else if (dest_format == texture_data_type::ushort_5_6_5) {
+                    const std::uint16_t value = static_cast<std::uint16_t>((narrow_channel(r, 31) << 11) | (narrow_channel(g, 63) << 5)
+                        | narrow_channel(b, 31));
+
+                    std::memcpy(dest + x * 2, &value, sizeof(std::uint16_t));
+                } else if (type == texture_format::bgra) {
+                    dest[x * 4] = static_cast<std::uint8_t>(b);
+                    dest[x * 4 + 1] = static_cast<std::uint8_t>(g);
+                    dest[x * 4 + 2] = static_cast<std::uint8_t>(r);
+                    dest[x * 4 + 3] = static_cast<std::uint8_t>(a);
+                } else {
+                    std::memcpy(dest + x * 4, &pixel, sizeof(std::uint32_t));
+                }
+            }
+        }
+
+        return true;
+    }
+}
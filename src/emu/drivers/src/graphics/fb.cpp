@@ -18,6 +18,7 @@
  */
 
 #include <drivers/graphics/backend/ogl/fb_ogl.h>
+#include <drivers/graphics/backend/software/texture_software.h>
 #include <drivers/graphics/fb.h>
 #include <drivers/graphics/graphics.h>
 
@@ -42,6 +43,9 @@ namespace eka2l1::drivers {
             break;
         }
 
+        case graphic_api::software:
+            return std::make_unique<software_framebuffer>(color_buffer_list, depth_and_stencil_buffer);
+
         default:
             break;
         }
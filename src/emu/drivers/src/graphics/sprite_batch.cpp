@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/graphics/sprite_batch.h>
+
+#include <cmath>
+
+namespace eka2l1::drivers {
+    // Corners of the unit quad, in the order the single sprite draw uses: bottom left, top right, top left, bottom right
+    static constexpr float QUAD_CORNERS[4][2] = {
+        { 0.0f, 1.0f },
+        { 1.0f, 0.0f },
+        { 0.0f, 0.0f },
+        { 1.0f, 1.0f }
+    };
+
+    static constexpr std::uint16_t QUAD_INDICES[SPRITE_BATCH_INDICES_PER_QUAD] = { 0, 1, 2, 0, 3, 1 };
+    static constexpr float PI = 3.14159265358979323846f;
+
+    sprite_batch::sprite_batch()
+        : sprites_(0)
+        , draw_calls_(0) {
+        vertices_.reserve(256 * 4);
+    }
+
+    bool sprite_batch::can_append(const sprite_batch_key &key) const {
+        if (vertices_.empty()) {
+            return true;
+        }
+
+        return (key_ == key) && (quad_count() < SPRITE_BATCH_MAX_QUADS);
+    }
+
+    void sprite_batch::add_sprite(const sprite_batch_key &key, const eka2l1::rect &dest, const eka2l1::rect &source,
+        const eka2l1::vec2 &texture_size, const eka2l1::vec2 &origin, const float rotation, const bool flip) {
+        key_ = key;
+
+        const float texel_width = 1.0f / static_cast<float>(texture_size.x);
+        const float texel_height = 1.0f / static_cast<float>(texture_size.y);
+
+        // Same transform as the model matrix of a single draw: scale, rotate around the origin, then move
+        const float radians = rotation * PI / 180.0f;
+        const float cos_value = std::cos(radians);
+        const float sin_value = std::sin(radians);
+
+        for (std::size_t i = 0; i < 4; i++) {
+            const float unit_x = QUAD_CORNERS[i][0];
+            const float unit_y = QUAD_CORNERS[i][1];
+
+            const float local_x = unit_x * static_cast<float>(dest.size.x) - static_cast<float>(origin.x);
+            const float local_y = unit_y * static_cast<float>(dest.size.y) - static_cast<float>(origin.y);
+
+            sprite_vertex vertex;
+            vertex.pos_[0] = local_x * cos_value - local_y * sin_value + static_cast<float>(origin.x + dest.top.x);
+            vertex.pos_[1] = local_x * sin_value + local_y * cos_value + static_cast<float>(origin.y + dest.top.y);
+
+            const float coord_y = flip ? (1.0f - unit_y) : unit_y;
+
+            if (source.empty()) {
+                vertex.coord_[0] = unit_x;
+                vertex.coord_[1] = coord_y;
+            } else {
+                vertex.coord_[0] = (static_cast<float>(source.top.x) + unit_x * static_cast<float>(source.size.x)) * texel_width;
+                vertex.coord_[1] = (static_cast<float>(source.top.y) + coord_y * static_cast<float>(source.size.y)) * texel_height;
+            }
+
+            vertices_.push_back(vertex);
+        }
+
+        sprites_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sprite_batch::add_fill(const sprite_batch_key &key, const eka2l1::rect &dest) {
+        key_ = key;
+
+        for (std::size_t i = 0; i < 4; i++) {
+            sprite_vertex vertex;
+            vertex.pos_[0] = static_cast<float>(dest.top.x) + QUAD_CORNERS[i][0] * static_cast<float>(dest.size.x);
+            vertex.pos_[1] = static_cast<float>(dest.top.y) + QUAD_CORNERS[i][1] * static_cast<float>(dest.size.y);
+            vertex.coord_[0] = QUAD_CORNERS[i][0];
+            vertex.coord_[1] = QUAD_CORNERS[i][1];
+
+            vertices_.push_back(vertex);
+        }
+
+        sprites_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sprite_batch::count_unbatched_draw() {
+        sprites_.fetch_add(1, std::memory_order_relaxed);
+        draw_calls_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sprite_batch::clear() {
+        if (!vertices_.empty()) {
+            draw_calls_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        vertices_.clear();
+        key_ = sprite_batch_key{};
+    }
+
+    sprite_batch_stats sprite_batch::get_stats() const {
+        sprite_batch_stats stats;
+        stats.sprites_ = sprites_.load(std::memory_order_relaxed);
+        stats.draw_calls_ = draw_calls_.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+    void sprite_batch::fill_quad_indices(std::uint16_t *dest, const std::size_t quad_count) {
+        for (std::size_t i = 0; i < quad_count; i++) {
+            for (std::size_t j = 0; j < SPRITE_BATCH_INDICES_PER_QUAD; j++) {
+                dest[i * SPRITE_BATCH_INDICES_PER_QUAD + j] = static_cast<std::uint16_t>(i * 4 + QUAD_INDICES[j]);
+            }
+        }
+    }
+}
@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <drivers/graphics/texture_decode.h>
+
+#include <common/algorithm.h>
+#include <common/fileutils.h>
+#include <common/path.h>
+#include <common/platform.h>
+#include <common/thread_pool.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if EKA2L1_ARCH(X64) || EKA2L1_ARCH(X86)
+#include <emmintrin.h>
+#define TEXTURE_DECODE_SSE2 1
+#elif EKA2L1_ARCH(ARM64)
+#include <arm_neon.h>
+#define TEXTURE_DECODE_NEON 1
+#endif
+
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+void decompressBlockETC2(unsigned int block_part1, unsigned int block_part2, std::uint8_t *img, int width, int height, int startx, int starty);
+uint32_t PVRTDecompressPVRTC(const void *compressedData, uint32_t do2bitMode, uint32_t xDim, uint32_t yDim, uint32_t doPvrtType, uint8_t *outResultImage);
+uint32_t PVRTDecompressPVRTCRows(const void *compressedData, uint32_t do2bitMode, uint32_t xDim, uint32_t yDim, uint32_t doPvrtType, uint8_t *outResultImage,
+    uint32_t firstRow, uint32_t endRow);
+
+namespace eka2l1::drivers {
+    // Blocks decoded by one thread before it is worth splitting the work
+    static constexpr std::size_t ETC_MIN_BLOCKS_PER_CHUNK = 1024;
+    static constexpr std::size_t PVRTC_MIN_WORDS_PER_CHUNK = 512;
+    static constexpr std::size_t PALETTE_MIN_TEXELS_PER_CHUNK = 64 * 1024;
+
+    static constexpr std::int16_t ETC_MODIFIER_TABLE[8][4] = {
+        { 2, 8, -2, -8 },
+        { 5, 17, -5, -17 },
+        { 9, 29, -9, -29 },
+        { 13, 42, -13, -42 },
+        { 18, 60, -18, -60 },
+        { 24, 80, -24, -80 },
+        { 33, 106, -33, -106 },
+        { 47, 183, -47, -183 }
+    };
+
+    struct etc_block_info {
+        std::int16_t base_[2][3];       ///< Base color of each sub-block.
+        std::uint8_t table_[2];         ///< Modifier table of each sub-block.
+        bool flip_;
+        std::uint32_t indices_;
+    };
+
+    static std::uint32_t read_be32(const std::uint8_t *data) {
+        return (static_cast<std::uint32_t>(data[0]) << 24) | (static_cast<std::uint32_t>(data[1]) << 16) | (static_cast<std::uint32_t>(data[2]) << 8) | data[3];
+    }
+
+    // Returns false for the ETC2 modes, which come from a differential color overflowing
+    static bool parse_etc_block(const std::uint8_t *block, etc_block_info &info) {
+        const std::uint32_t high = read_be32(block);
+
+        info.indices_ = read_be32(block + 4);
+        info.flip_ = (high & 1) != 0;
+        info.table_[0] = static_cast<std::uint8_t>((high >> 5) & 7);
+        info.table_[1] = static_cast<std::uint8_t>((high >> 2) & 7);
+
+        if (high & 2) {
+            for (std::uint32_t c = 0; c < 3; c++) {
+                const std::int32_t shift = 27 - c * 8;
+                const std::int32_t base = (high >> shift) & 0x1F;
+                const std::int32_t delta = static_cast<std::int32_t>((high >> (shift - 3)) & 7) - (((high >> (shift - 3)) & 4) ? 8 : 0);
+                const std::int32_t second = base + delta;
+
+                if ((second < 0) || (second > 31)) {
+                    return false;
+                }
+
+                info.base_[0][c] = static_cast<std::int16_t>((base << 3) | (base >> 2));
+                info.base_[1][c] = static_cast<std::int16_t>((second << 3) | (second >> 2));
+            }
+        } else {
+            for (std::uint32_t c = 0; c < 3; c++) {
+                const std::int32_t first = (high >> (28 - c * 8)) & 0xF;
+                const std::int32_t second = (high >> (24 - c * 8)) & 0xF;
+
+                info.base_[0][c] = static_cast<std::int16_t>(first * 0x11);
+                info.base_[1][c] = static_cast<std::int16_t>(second * 0x11);
+            }
+        }
+
+        return true;
+    }
+
+    static void decode_etc2_fallback_block(const std::uint8_t *block, std::uint8_t *dest, const std::size_t dest_pitch) {
+        std::uint8_t rgb[4 * 4 * 3];
+        decompressBlockETC2(read_be32(block), read_be32(block + 4), rgb, 4, 4, 0, 0);
+
+        for (std::uint32_t y = 0; y < 4; y++) {
+            for (std::uint32_t x = 0; x < 4; x++) {
+                std::uint8_t *pixel = dest + y * dest_pitch + x * 4;
+                std::memcpy(pixel, rgb + (y * 4 + x) * 3, 3);
+                pixel[3] = 0xFF;
+            }
+        }
+    }
+
+    // Pick the colors of the 16 pixels, from the 8 colors of the two sub-blocks
+    static void write_etc_pixels(const etc_block_info &info, const std::uint32_t *colors, std::uint8_t *dest, const std::size_t dest_pitch) {
+        for (std::uint32_t y = 0; y < 4; y++) {
+            std::uint32_t row[4];
+
+            for (std::uint32_t x = 0; x < 4; x++) {
+                const std::uint32_t bit = x * 4 + y;
+                const std::uint32_t index = (((info.indices_ >> (bit + 16)) & 1) << 1) | ((info.indices_ >> bit) & 1);
+                const std::uint32_t sub_block = info.flip_ ? (y >> 1) : (x >> 1);
+
+                row[x] = colors[sub_block * 4 + index];
+            }
+
+            std::memcpy(dest + y * dest_pitch, row, sizeof(row));
+        }
+    }
+
+    void decode_etc_block_scalar(const std::uint8_t *block, std::uint8_t *dest, const std::size_t dest_pitch) {
+        etc_block_info info;
+        if (!parse_etc_block(block, info)) {
+            decode_etc2_fallback_block(block, dest, dest_pitch);
+            return;
+        }
+
+        std::uint32_t colors[8];
+
+        for (std::uint32_t sub = 0; sub < 2; sub++) {
+            for (std::uint32_t i = 0; i < 4; i++) {
+                std::uint8_t color[4];
+                for (std::uint32_t c = 0; c < 3; c++) {
+                    color[c] = static_cast<std::uint8_t>(common::clamp(0, 255, info.base_[sub][c] + ETC_MODIFIER_TABLE[info.table_[sub]][i]));
+                }
+
+                color[3] = 0xFF;
+                std::memcpy(colors + sub * 4 + i, color, 4);
+            }
+        }
+
+        write_etc_pixels(info, colors, dest, dest_pitch);
+    }
+
+    void decode_etc_block(const std::uint8_t *block, std::uint8_t *dest, const std::size_t dest_pitch) {
+#if defined(TEXTURE_DECODE_SSE2) || defined(TEXTURE_DECODE_NEON)
+        etc_block_info info;
+        if (!parse_etc_block(block, info)) {
+            decode_etc2_fallback_block(block, dest, dest_pitch);
+            return;
+        }
+
+        alignas(16) std::int16_t bases[2][8];
+        alignas(16) std::int16_t mods[4][8];
+
+        // Each vector holds two colors of four lanes. Alpha gets 255 added to a base of zero
+        for (std::uint32_t sub = 0; sub < 2; sub++) {
+            for (std::uint32_t c = 0; c < 3; c++) {
+                bases[sub][c] = info.base_[sub][c];
+                bases[sub][c + 4] = info.base_[sub][c];
+            }
+
+            bases[sub][3] = 0;
+            bases[sub][7] = 0;
+
+            for (std::uint32_t half = 0; half < 2; half++) {
+                const std::int16_t *table = ETC_MODIFIER_TABLE[info.table_[sub]];
+                std::int16_t *target = mods[sub * 2 + half];
+
+                for (std::uint32_t c = 0; c < 3; c++) {
+                    target[c] = table[half * 2];
+                    target[c + 4] = table[half * 2 + 1];
+                }
+
+                target[3] = 255;
+                target[7] = 255;
+            }
+        }
+
+        alignas(16) std::uint32_t colors[8];
+
+#if defined(TEXTURE_DECODE_SSE2)
+        const __m128i base0 = _mm_load_si128(reinterpret_cast<const __m128i *>(bases[0]));
+        const __m128i base1 = _mm_load_si128(reinterpret_cast<const __m128i *>(bases[1]));
+
+        const __m128i sub0_colors01 = _mm_adds_epi16(base0, _mm_load_si128(reinterpret_cast<const __m128i *>(mods[0])));
+        const __m128i sub0_colors23 = _mm_adds_epi16(base0, _mm_load_si128(reinterpret_cast<const __m128i *>(mods[1])));
+        const __m128i sub1_colors01 = _mm_adds_epi16(base1, _mm_load_si128(reinterpret_cast<const __m128i *>(mods[2])));
+        const __m128i sub1_colors23 = _mm_adds_epi16(base1, _mm_load_si128(reinterpret_cast<const __m128i *>(mods[3])));
+
+        _mm_store_si128(reinterpret_cast<__m128i *>(colors), _mm_packus_epi16(sub0_colors01, sub0_colors23));
+        _mm_store_si128(reinterpret_cast<__m128i *>(colors + 4), _mm_packus_epi16(sub1_colors01, sub1_colors23));
+#else
+        const int16x8_t base0 = vld1q_s16(bases[0]);
+        const int16x8_t base1 = vld1q_s16(bases[1]);
+
+        const uint8x16_t sub0_colors = vcombine_u8(vqmovun_s16(vqaddq_s16(base0, vld1q_s16(mods[0]))),
+            vqmovun_s16(vqaddq_s16(base0, vld1q_s16(mods[1]))));
+        const uint8x16_t sub1_colors = vcombine_u8(vqmovun_s16(vqaddq_s16(base1, vld1q_s16(mods[2]))),
+            vqmovun_s16(vqaddq_s16(base1, vld1q_s16(mods[3]))));
+
+        vst1q_u8(reinterpret_cast<std::uint8_t *>(colors), sub0_colors);
+        vst1q_u8(reinterpret_cast<std::uint8_t *>(colors + 4), sub1_colors);
+#endif
+
+        write_etc_pixels(info, colors, dest, dest_pitch);
+#else
+        decode_etc_block_scalar(block, dest, dest_pitch);
+#endif
+    }
+
+    void decode_etc_texture(std::uint8_t *dest, const std::uint8_t *source, const std::uint32_t width, const std::uint32_t height,
+        common::thread_pool *pool) {
+        const std::uint32_t blocks_x = (width + 3) / 4;
+        const std::uint32_t blocks_y = (height + 3) / 4;
+        const std::size_t dest_pitch = width * 4;
+
+        auto decode_rows = [&](const std::size_t begin, const std::size_t end) {
+            std::uint8_t edge[4 * 4 * 4];
+
+            for (std::size_t by = begin; by < end; by++) {
+                const std::uint8_t *block = source + by * blocks_x * 8;
+
+                for (std::uint32_t bx = 0; bx < blocks_x; bx++, block += 8) {
+                    const std::uint32_t x = bx * 4;
+                    const std::uint32_t y = static_cast<std::uint32_t>(by * 4);
+
+                    if ((x + 4 <= width) && (y + 4 <= height)) {
+                        decode_etc_block(block, dest + y * dest_pitch + x * 4, dest_pitch);
+                        continue;
+                    }
+
+                    // Block on the right or bottom edge, partially outside the image
+                    decode_etc_block(block, edge, 16);
+
+                    const std::uint32_t visible_width = std::min<std::uint32_t>(4, width - x);
+                    const std::uint32_t visible_height = std::min<std::uint32_t>(4, height - y);
+
+                    for (std::uint32_t row = 0; row < visible_height; row++) {
+                        std::memcpy(dest + (y + row) * dest_pitch + x * 4, edge + row * 16, visible_width * 4);
+                    }
+                }
+            }
+        };
+
+        if (!pool) {
+            decode_rows(0, blocks_y);
+            return;
+        }
+
+        pool->parallel_for(blocks_y, std::max<std::size_t>(1, ETC_MIN_BLOCKS_PER_CHUNK / std::max<std::uint32_t>(blocks_x, 1)), decode_rows);
+    }
+
+    void decode_pvrtc_texture(std::uint8_t *dest, const std::uint8_t *source, const std::uint32_t width, const std::uint32_t height,
+        const bool is_2bpp, common::thread_pool *pool) {
+        const std::uint32_t word_width = is_2bpp ? 8 : 4;
+        const std::uint32_t min_width = is_2bpp ? 16 : 8;
+
+        // Small images are decoded through a padded copy, which is not worth splitting
+        if (!pool || (width < min_width) || (height < 8)) {
+            PVRTDecompressPVRTC(source, is_2bpp, width, height, 0, dest);
+            return;
+        }
+
+        const std::uint32_t word_rows = height / 4;
+        const std::uint32_t words_per_row = width / word_width;
+
+        pool->parallel_for(word_rows, std::max<std::size_t>(1, PVRTC_MIN_WORDS_PER_CHUNK / std::max<std::uint32_t>(words_per_row, 1)),
+            [&](const std::size_t begin, const std::size_t end) {
+                PVRTDecompressPVRTCRows(source, is_2bpp, width, height, 0, dest, static_cast<std::uint32_t>(begin),
+                    static_cast<std::uint32_t>(end));
+            });
+    }
+
+    template <typename T>
+    static void expand_palette_indices(T *dest, const std::uint8_t *indices, const T *palette, const std::uint32_t index_bits,
+        const std::size_t begin, const std::size_t end) {
+        if (index_bits == 8) {
+            for (std::size_t i = begin; i < end; i++) {
+                dest[i] = palette[indices[i]];
+            }
+
+            return;
+        }
+
+        // Begin is always even
+        std::size_t i = begin;
+        for (; i + 1 < end; i += 2) {
+            const std::uint8_t pair = indices[i >> 1];
+            dest[i] = palette[pair >> 4];
+            dest[i + 1] = palette[pair & 0xF];
+        }
+
+        if (i < end) {
+            dest[i] = palette[indices[i >> 1] >> 4];
+        }
+    }
+
+    void decode_paletted_texture(std::uint8_t *dest, const std::uint8_t *indices, const std::uint8_t *palette, const std::uint32_t index_bits,
+        const std::uint32_t entry_size, const std::size_t texel_count, common::thread_pool *pool) {
+        auto expand = [&](const std::size_t begin, const std::size_t end) {
+            switch (entry_size) {
+            case 1:
+                expand_palette_indices(dest, indices, palette, index_bits, begin, end);
+                break;
+
+            case 2:
+                expand_palette_indices(reinterpret_cast<std::uint16_t *>(dest), indices, reinterpret_cast<const std::uint16_t *>(palette),
+                    index_bits, begin, end);
+                break;
+
+            case 4:
+                expand_palette_indices(reinterpret_cast<std::uint32_t *>(dest), indices, reinterpret_cast<const std::uint32_t *>(palette),
+                    index_bits, begin, end);
+                break;
+
+            default:
+                for (std::size_t i = begin; i < end; i++) {
+                    const std::uint32_t index = (index_bits == 8) ? indices[i] : ((i & 1) ? (indices[i >> 1] & 0xF) : (indices[i >> 1] >> 4));
+                    std::memcpy(dest + i * entry_size, palette + index * entry_size, entry_size);
+                }
+
+                break;
+            }
+        };
+
+        if (!pool) {
+            expand(0, texel_count);
+            return;
+        }
+
+        // Split on texel pairs, so that no byte of 4-bit indices is shared by two ranges
+        const std::size_t pair_count = (texel_count + 1) / 2;
+        pool->parallel_for(pair_count, PALETTE_MIN_TEXELS_PER_CHUNK / 2, [&](const std::size_t begin, const std::size_t end) {
+            expand(begin * 2, std::min(end * 2, texel_count));
+        });
+    }
+
+    static constexpr std::uint32_t DECODED_TEXTURE_FILE_MAGIC = 0x58544344;     // DCTX
+
+    decoded_texture_cache::decoded_texture_cache(const std::size_t budget)
+        : budget_(budget) {
+    }
+
+    std::uint64_t decoded_texture_cache::make_key(const texture_format format, const std::uint32_t width, const std::uint32_t height,
+        const void *data, const std::size_t data_size) {
+        const std::uint64_t seed = (static_cast<std::uint64_t>(format) << 48) ^ (static_cast<std::uint64_t>(width) << 24) ^ height;
+        return XXH64(data, data_size, seed);
+    }
+
+    void decoded_texture_cache::add_locked(const std::uint64_t key, decoded_texture data) {
+        auto ite = entries_.find(key);
+        if (ite != entries_.end()) {
+            stats_.used_bytes_ -= ite->second.data_->size();
+            lru_.erase(ite->second.lru_ite_);
+            entries_.erase(ite);
+        }
+
+        stats_.used_bytes_ += data->size();
+        lru_.push_front(key);
+        entries_.emplace(key, entry{ std::move(data), lru_.begin() });
+
+        // Never evict the entry just added, even if it alone is over the budget
+        while ((stats_.used_bytes_ > budget_) && (lru_.size() > 1)) {
+            auto victim = entries_.find(lru_.back());
+            stats_.used_bytes_ -= victim->second.data_->size();
+
+            entries_.erase(victim);
+            lru_.pop_back();
+        }
+    }
+
+    decoded_texture decoded_texture_cache::get(const std::uint64_t key, const std::size_t expected_size) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        auto ite = entries_.find(key);
+        if ((ite != entries_.end()) && (ite->second.data_->size() == expected_size)) {
+            lru_.splice(lru_.begin(), lru_, ite->second.lru_ite_);
+            stats_.hits_++;
+
+            return ite->second.data_;
+        }
+
+        if (!disk_path_.empty()) {
+            FILE *f = common::open_c_file(eka2l1::add_path(disk_path_, fmt::format("{:016X}.bin", key)), "rb");
+
+            if (f) {
+                std::uint32_t header[2] = { 0, 0 };
+                std::shared_ptr<std::vector<std::uint8_t>> data = nullptr;
+
+                if ((fread(header, sizeof(header), 1, f) == 1) && (header[0] == DECODED_TEXTURE_FILE_MAGIC) && (header[1] == expected_size)) {
+                    data = std::make_shared<std::vector<std::uint8_t>>(expected_size);
+                    if (fread(data->data(), 1, expected_size, f) != expected_size) {
+                        data = nullptr;
+                    }
+                }
+
+                fclose(f);
+
+                if (data) {
+                    add_locked(key, data);
+                    stats_.disk_hits_++;
+
+                    return data;
+                }
+            }
+        }
+
+        stats_.misses_++;
+        return nullptr;
+    }
+
+    decoded_texture decoded_texture_cache::put(const std::uint64_t key, std::vector<std::uint8_t> &&data) {
+        decoded_texture result = std::make_shared<const std::vector<std::uint8_t>>(std::move(data));
+
+        const std::lock_guard<std::mutex> guard(lock_);
+        add_locked(key, result);
+
+        if (!disk_path_.empty()) {
+            FILE *f = common::open_c_file(eka2l1::add_path(disk_path_, fmt::format("{:016X}.bin", key)), "wb");
+
+            if (f) {
+                const std::uint32_t header[2] = { DECODED_TEXTURE_FILE_MAGIC, static_cast<std::uint32_t>(result->size()) };
+
+                fwrite(header, sizeof(header), 1, f);
+                fwrite(result->data(), 1, result->size(), f);
+                fclose(f);
+            }
+        }
+
+        return result;
+    }
+
+    void decoded_texture_cache::set_disk_path(const std::string &path) {
+        const std::lock_guard<std::mutex> guard(lock_);
+        disk_path_ = path;
+
+        if (!disk_path_.empty() && !common::exists(disk_path_)) {
+            common::create_directories(disk_path_);
+        }
+    }
+
+    decoded_texture_cache_stats decoded_texture_cache::get_stats() {
+        const std::lock_guard<std::mutex> guard(lock_);
+        return stats_;
+    }
+}
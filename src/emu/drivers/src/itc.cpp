@@ -32,28 +32,22 @@ namespace eka2l1::drivers {
         int status = -100;
         cmd.status_ = &status;
 
-        command_list cmd_list(1);
-        cmd_list.renew();
+        command_list cmd_list;
+        command *dest = cmd_list.retrieve_next(MAX_COMMAND_DATA_WORDS);
 
-        cmd_list.size_ = 1;
-        *cmd_list.base_ = cmd;
+        dest->opcode_ = cmd.opcode_;
+        dest->status_ = cmd.status_;
 
-        std::unique_lock<std::mutex> ulock(drv->mut_);
-        drv->submit_command_list(cmd_list);
-        drv->cond_.wait(ulock, [&]() { return status != -100; });
-
-        return status;
-    }
+        std::memcpy(dest->data_, cmd.data_, sizeof(cmd.data_));
 
-    static std::uint64_t make_data_copy(const void *source, const std::size_t size) {
-        if (!source) {
-            return 0;
-        }
+        drv->submit_command_list(cmd_list);
 
-        std::uint8_t *copy = new std::uint8_t[size];
-        std::copy(reinterpret_cast<const std::uint8_t *>(source), reinterpret_cast<const std::uint8_t *>(source) + size, copy);
+        // The fence covers our list even if another thread submits in between. The status wait
+        // is kept for drivers that do not track fences.
+        drv->wait_fence(drv->current_fence());
+        drv->wait_for(&status);
 
-        return reinterpret_cast<std::uint64_t>(copy);
+        return status;
     }
 
     drivers::handle create_bitmap(graphics_driver *driver, const eka2l1::vec2 &size, const std::uint32_t bpp) {
@@ -197,8 +191,22 @@ namespace eka2l1::drivers {
         f2 = *reinterpret_cast<float*>(&high);
     }
 
+    std::uint64_t graphics_command_builder::create_command_with_payload(command *&cmd, const std::uint32_t word_count,
+        const void *data, const std::size_t size) {
+        if (!data) {
+            cmd = list_.retrieve_next(word_count);
+            return 0;
+        }
+
+        cmd = list_.retrieve_next(word_count, size);
+        cmd->flags_ |= command_flag_inline_payload;
+
+        std::memcpy(cmd->payload(), data, size);
+        return reinterpret_cast<std::uint64_t>(cmd->payload());
+    }
+
     void graphics_command_builder::clip_rect(const eka2l1::rect &rect) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_clip_rect;
 
         cmd->data_[0] = PACK_2U32_TO_U64(rect.top.x, rect.top.y);
@@ -206,7 +214,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::clip_bitmap_rect(const eka2l1::rect &rect) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_clip_bitmap_rect;
 
         cmd->data_[0] = PACK_2U32_TO_U64(rect.top.x, rect.top.y);
@@ -227,17 +235,18 @@ namespace eka2l1::drivers {
 
             clip_bitmap_rect(to_scale);
         } else {
-            command *cmd = list_.retrieve_next();
+            command *cmd = nullptr;
+            const std::uint64_t rects_copy = create_command_with_payload(cmd, 3, region.rects_.data(), region.rects_.size() * sizeof(eka2l1::rect));
 
             cmd->opcode_ = graphics_driver_clip_region;
             cmd->data_[0] = static_cast<std::uint64_t>(region.rects_.size());
-            cmd->data_[1] = make_data_copy(region.rects_.data(), region.rects_.size() * sizeof(eka2l1::rect));
+            cmd->data_[1] = rects_copy;
             cmd->data_[2] = pack_from_two_floats(scale_factor, 0.0f);
         }
     }
 
     void graphics_command_builder::clear(vecx<float, 6> color, const std::uint8_t clear_bitarr) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(4);
         cmd->opcode_ = graphics_driver_clear;
 
         cmd->data_[0] = pack_from_two_floats(color[0], color[1]);
@@ -249,7 +258,7 @@ namespace eka2l1::drivers {
     void graphics_command_builder::resize_bitmap(drivers::handle h, const eka2l1::vec2 &new_size) {
         // This opcode has two variant: sync or async.
         // The first argument is bitmap handle. If it's null then the currently binded one will be used.
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_resize_bitmap;
         cmd->data_[0] = h;
         cmd->data_[1] = PACK_2U32_TO_U64(new_size.x, new_size.y);
@@ -257,12 +266,20 @@ namespace eka2l1::drivers {
 
     void graphics_command_builder::update_bitmap(drivers::handle h, const char *data, const std::size_t size,
         const eka2l1::vec2 &offset, const eka2l1::vec2 &dim, const std::size_t pixels_per_line, const bool need_copy) {
-        // Copy data
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        std::uint64_t data_arg = reinterpret_cast<std::uint64_t>(data);
+
+        if (need_copy) {
+            data_arg = create_command_with_payload(cmd, 6, data, size);
+        } else {
+            // Ownership of the data is passed to the driver
+            cmd = list_.retrieve_next(6);
+        }
+
         cmd->opcode_ = graphics_driver_update_bitmap;
 
         cmd->data_[0] = h;
-        cmd->data_[1] = (need_copy ? make_data_copy(data, size) : reinterpret_cast<std::uint64_t>(data));
+        cmd->data_[1] = data_arg;
         cmd->data_[2] = size;
         cmd->data_[3] = PACK_2U32_TO_U64(offset.x, offset.y);
         cmd->data_[4] = PACK_2U32_TO_U64(dim.x, dim.y);
@@ -272,12 +289,32 @@ namespace eka2l1::drivers {
     void graphics_command_builder::update_texture(drivers::handle h, const char *data, const std::size_t size, const std::uint8_t lvl,
         const texture_format data_format, const texture_data_type data_type,
         const eka2l1::vec3 &offset, const eka2l1::vec3 &dim, const std::size_t pixels_per_line, const std::uint32_t unpack_alignment) {
-        // Copy data
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t data_copy = create_command_with_payload(cmd, 9, data, size);
+
+        cmd->opcode_ = graphics_driver_update_texture;
+
+        cmd->data_[0] = h;
+        cmd->data_[1] = data_copy;
+        cmd->data_[2] = size;
+        cmd->data_[3] = lvl | (static_cast<std::uint64_t>(data_format) << 8) | (static_cast<std::uint64_t>(data_type) << 24); 
+        cmd->data_[4] = PACK_2U32_TO_U64(offset.x, offset.y);
+        cmd->data_[5] = PACK_2U32_TO_U64(offset.z, dim.x);
+        cmd->data_[6] = PACK_2U32_TO_U64(dim.y, dim.z);
+        cmd->data_[7] = pixels_per_line;
+        cmd->data_[8] = unpack_alignment;
+    }
+
+    void graphics_command_builder::update_texture_from_staging(drivers::handle h, const char *data, const std::size_t size, const std::uint8_t lvl,
+        const texture_format data_format, const texture_data_type data_type,
+        const eka2l1::vec3 &offset, const eka2l1::vec3 &dim, const std::size_t pixels_per_line, const std::uint32_t unpack_alignment) {
+        command *cmd = list_.retrieve_next(9);
+        cmd->flags_ |= command_flag_borrowed_payload;
+
         cmd->opcode_ = graphics_driver_update_texture;
 
         cmd->data_[0] = h;
-        cmd->data_[1] = make_data_copy(data, size);
+        cmd->data_[1] = reinterpret_cast<std::uint64_t>(data);
         cmd->data_[2] = size;
         cmd->data_[3] = lvl | (static_cast<std::uint64_t>(data_format) << 8) | (static_cast<std::uint64_t>(data_type) << 24); 
         cmd->data_[4] = PACK_2U32_TO_U64(offset.x, offset.y);
@@ -289,7 +326,7 @@ namespace eka2l1::drivers {
 
     void graphics_command_builder::draw_bitmap(drivers::handle h, drivers::handle maskh, const eka2l1::rect &dest_rect, const eka2l1::rect &source_rect, const eka2l1::vec2 &origin,
         const float rotation, const std::uint32_t flags) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(8);
         cmd->opcode_ = graphics_driver_draw_bitmap;
 
         cmd->data_[0] = h;
@@ -303,7 +340,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::bind_bitmap(const drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_bind_bitmap;
         cmd->data_[0] = h;
@@ -311,7 +348,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::bind_bitmap(const drivers::handle draw_handle, const drivers::handle read_handle) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_bind_bitmap;
         cmd->data_[0] = draw_handle;
@@ -319,7 +356,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::draw_rectangle(const eka2l1::rect &target_rect) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_draw_rectangle;
         cmd->data_[0] = PACK_2U32_TO_U64(target_rect.top.x, target_rect.top.y);
@@ -327,7 +364,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_brush_color_detail(const eka2l1::vec4 &color) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_set_brush_color;
         cmd->data_[0] = PACK_2U32_TO_U64(color.x, color.y);
@@ -335,22 +372,24 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::use_program(drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_use_program;
         cmd->data_[0] = h;
     }
 
     void graphics_command_builder::set_dynamic_uniform(const int binding, const drivers::shader_set_var_type var_type,
         const void *data, const std::size_t data_size) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t data_copy = create_command_with_payload(cmd, 2, data, data_size);
+
         cmd->opcode_ = graphics_driver_set_uniform;
 
         cmd->data_[0] = PACK_2U32_TO_U64(binding, var_type);
-        cmd->data_[1] = make_data_copy(data, data_size);
+        cmd->data_[1] = data_copy;
     }
 
     void graphics_command_builder::bind_texture(drivers::handle h, const int binding) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_bind_texture;
         cmd->data_[0] = h;
@@ -358,7 +397,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::draw_indexed(const graphics_primitive_mode prim_mode, const int count, const data_format index_type, const int index_off, const int vert_base) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(3);
         cmd->opcode_ = graphics_driver_draw_indexed;
 
         cmd->data_[0] = PACK_2U32_TO_U64(prim_mode, count);
@@ -367,7 +406,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::draw_arrays(const graphics_primitive_mode prim_mode, const std::int32_t first, const std::int32_t count, const std::int32_t instance_count) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_draw_array;
 
         cmd->data_[0] = PACK_2U32_TO_U64(prim_mode, first);
@@ -375,15 +414,17 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_vertex_buffers(drivers::handle *h, const std::uint32_t starting_slot, const std::uint32_t count) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t handles_copy = create_command_with_payload(cmd, 2, h, sizeof(drivers::handle) * count);
+
         cmd->opcode_ = graphics_driver_bind_vertex_buffers;
 
-        cmd->data_[0] = make_data_copy(h, sizeof(drivers::handle) * count);
+        cmd->data_[0] = handles_copy;
         cmd->data_[1] = PACK_2U32_TO_U64(starting_slot, count);
     }
 
     void graphics_command_builder::set_index_buffer(drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_bind_index_buffer;
         cmd->data_[0] = h;
     }
@@ -396,14 +437,17 @@ namespace eka2l1::drivers {
             total_chunk_size += chunk_size[i];
         }
 
-        std::uint8_t *data = new std::uint8_t[total_chunk_size];
+        // Merge the chunks straight into the command's payload
+        command *cmd = list_.retrieve_next(4, total_chunk_size);
+        cmd->flags_ |= command_flag_inline_payload;
+
+        std::uint8_t *data = cmd->payload();
 
         for (int i = 0; i < chunk_count; i++) {
             std::copy(reinterpret_cast<const std::uint8_t *>(chunk_ptr[i]), reinterpret_cast<const std::uint8_t *>(chunk_ptr[i]) + chunk_size[i], data + cursor);
             cursor += chunk_size[i];
         }
 
-        command *cmd = list_.retrieve_next();
         cmd->opcode_ = graphics_driver_update_buffer;
         cmd->data_[0] = h;
         cmd->data_[1] = reinterpret_cast<std::uint64_t>(data);
@@ -412,7 +456,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_viewport(const eka2l1::rect &viewport_rect) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_set_viewport;
 
         cmd->data_[0] = PACK_2U32_TO_U64(viewport_rect.top.x, viewport_rect.top.y);
@@ -420,7 +464,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_bitmap_viewport(const eka2l1::rect &viewport_rect) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_set_bitmap_viewport;
 
         cmd->data_[0] = PACK_2U32_TO_U64(viewport_rect.top.x, viewport_rect.top.y);
@@ -428,7 +472,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_feature(drivers::graphics_feature feature, const bool enable) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_feature;
         cmd->data_[0] = PACK_2U32_TO_U64(feature, enable);
     }
@@ -436,7 +480,7 @@ namespace eka2l1::drivers {
     void graphics_command_builder::blend_formula(const blend_equation rgb_equation, const blend_equation a_equation,
         const blend_factor rgb_frag_output_factor, const blend_factor rgb_current_factor,
         const blend_factor a_frag_output_factor, const blend_factor a_current_factor) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(3);
         cmd->opcode_ = graphics_driver_blend_formula;
 
         cmd->data_[0] = PACK_2U32_TO_U64(rgb_equation, a_equation);
@@ -446,7 +490,7 @@ namespace eka2l1::drivers {
 
     void graphics_command_builder::set_stencil_action(const rendering_face face_operate_on, const stencil_action on_stencil_fail,
         const stencil_action on_stencil_pass_depth_fail, const stencil_action on_both_stencil_depth_pass) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_stencil_set_action;
 
         cmd->data_[0] = PACK_2U32_TO_U64(face_operate_on, on_stencil_fail);
@@ -455,7 +499,7 @@ namespace eka2l1::drivers {
 
     void graphics_command_builder::set_stencil_pass_condition(const rendering_face face_operate_on, const condition_func cond_func,
         const int cond_func_ref_value, const std::uint32_t mask) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_stencil_pass_condition;
 
         cmd->data_[0] = PACK_2U32_TO_U64(face_operate_on, cond_func);
@@ -463,43 +507,60 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_stencil_mask(const rendering_face face_operate_on, const std::uint32_t mask) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_stencil_set_mask;
         cmd->data_[0] = PACK_2U32_TO_U64(face_operate_on, mask);
     }
 
     void graphics_command_builder::backup_state() {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(0);
         cmd->opcode_ = graphics_driver_backup_state;
     }
 
     void graphics_command_builder::load_backup_state() {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(0);
         cmd->opcode_ = graphics_driver_restore_state;
     }
 
+    void graphics_command_builder::read_bitmap(drivers::handle h, const eka2l1::point &pos, const eka2l1::object_size &size,
+        const std::uint32_t bpp, std::uint8_t *buffer_ptr, int *status) {
+        command *cmd = list_.retrieve_next(5);
+
+        cmd->opcode_ = graphics_driver_read_bitmap;
+        cmd->status_ = status;
+        cmd->data_[0] = h;
+        cmd->data_[1] = PACK_2U32_TO_U64(pos.x, pos.y);
+        cmd->data_[2] = PACK_2U32_TO_U64(size.x, size.y);
+        cmd->data_[3] = bpp;
+        cmd->data_[4] = reinterpret_cast<std::uint64_t>(buffer_ptr);
+
+        if (status) {
+            *status = -100;
+        }
+    }
+
     void graphics_command_builder::present(int *status) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(0);
         cmd->opcode_ = graphics_driver_display;
         cmd->status_ = status;
     }
 
     void graphics_command_builder::destroy(drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
 
         cmd->opcode_ = graphics_driver_destroy_object;
         cmd->data_[0] = h;
     }
 
     void graphics_command_builder::destroy_bitmap(drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
 
         cmd->opcode_ = graphics_driver_destroy_bitmap;
         cmd->data_[0] = h;
     }
 
     void graphics_command_builder::set_texture_filter(drivers::handle h, const bool is_min, const drivers::filter_option mag) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_set_texture_filter;
         cmd->data_[0] = h;
@@ -507,7 +568,7 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_texture_addressing_mode(drivers::handle h, const drivers::addressing_direction dir, const drivers::addressing_option opt) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_set_texture_wrap;
         cmd->data_[0] = h;
@@ -515,14 +576,14 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::regenerate_mips(drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_generate_mips;
         cmd->data_[0] = h;
     }
 
     void graphics_command_builder::set_swizzle(drivers::handle h, drivers::channel_swizzle r, drivers::channel_swizzle g,
         drivers::channel_swizzle b, drivers::channel_swizzle a) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(3);
 
         cmd->opcode_ = graphics_driver_set_swizzle;
         cmd->data_[0] = h;
@@ -531,31 +592,31 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_swapchain_size(const eka2l1::vec2 &swsize) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_swapchain_size;
         cmd->data_[0] = PACK_2U32_TO_U64(swsize.x, swsize.y);
     }
 
     void graphics_command_builder::set_ortho_size(const eka2l1::vec2 &osize) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_ortho_size;
         cmd->data_[0] = PACK_2U32_TO_U64(osize.x, osize.y);
     }
 
     void graphics_command_builder::set_point_size(const std::uint8_t value) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_point_size;
         cmd->data_[0] = static_cast<std::uint64_t>(value);
     }
 
     void graphics_command_builder::set_pen_style(const pen_style style) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_pen_style;
         cmd->data_[0] = static_cast<std::uint64_t>(style);
     }
 
     void graphics_command_builder::draw_line(const eka2l1::point &start, const eka2l1::point &end) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
 
         cmd->opcode_ = graphics_driver_draw_line;
         cmd->data_[0] = PACK_2U32_TO_U64(start.x, start.y);
@@ -563,36 +624,34 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::draw_polygons(const eka2l1::point *point_list, const std::size_t point_count) {
-        eka2l1::point *point_list_copied = new eka2l1::point[point_count];
-        memcpy(point_list_copied, point_list, point_count * sizeof(eka2l1::point));
-
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t point_list_copied = create_command_with_payload(cmd, 2, point_list, point_count * sizeof(eka2l1::point));
 
         cmd->opcode_ = graphics_driver_draw_polygon;
         cmd->data_[0] = point_count;
-        cmd->data_[1] = reinterpret_cast<std::uint64_t>(point_list_copied);
+        cmd->data_[1] = point_list_copied;
     }
 
     void graphics_command_builder::set_cull_face(const rendering_face face) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_cull_face;
         cmd->data_[0] = static_cast<std::uint64_t>(face);
     }
 
     void graphics_command_builder::set_front_face_rule(const rendering_face_determine_rule rule) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_front_face_rule;
         cmd->data_[0] = static_cast<std::uint64_t>(rule);
     }
 
     void graphics_command_builder::set_depth_mask(const std::uint32_t mask) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_depth_set_mask;
         cmd->data_[0] = static_cast<std::uint64_t>(mask);
     }
 
     void graphics_command_builder::set_depth_pass_condition(const condition_func func) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_depth_func;
         cmd->data_[0] = static_cast<std::uint64_t>(func);
     }
@@ -601,12 +660,13 @@ namespace eka2l1::drivers {
         drivers::texture_format internal_format, drivers::texture_format data_format, drivers::texture_data_type data_type,
         const void *data, const std::size_t data_size, const eka2l1::vec3 &size, const std::size_t pixels_per_line,
         const std::uint32_t unpack_alignment) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t data_copy = create_command_with_payload(cmd, 8, data, data_size);
 
         cmd->opcode_ = graphics_driver_create_texture;
         cmd->data_[0] = dim | (static_cast<std::uint64_t>(mip_levels) << 8) | (static_cast<std::uint64_t>(internal_format) << 16)
             | (static_cast<std::uint64_t>(data_format) << 32) | (static_cast<std::uint64_t>(data_type) << 48);
-        cmd->data_[1] = make_data_copy(data, data_size);
+        cmd->data_[1] = data_copy;
         cmd->data_[2] = data_size;
         cmd->data_[3] = pixels_per_line;
         cmd->data_[4] = static_cast<std::uint64_t>(unpack_alignment);
@@ -616,9 +676,11 @@ namespace eka2l1::drivers {
     }
     
     void graphics_command_builder::recreate_buffer(drivers::handle h, const void *initial_data, const std::size_t initial_size, const buffer_upload_hint upload_hint) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t data_copy = create_command_with_payload(cmd, 5, initial_data, initial_size);
+
         cmd->opcode_ = graphics_driver_create_buffer;
-        cmd->data_[0] = make_data_copy(initial_data, initial_size);
+        cmd->data_[0] = data_copy;
         cmd->data_[1] = initial_size;
         cmd->data_[2] = static_cast<std::uint64_t>(upload_hint);
         cmd->data_[3] = h;
@@ -626,13 +688,13 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::set_color_mask(const std::uint8_t mask) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_color_mask;
         cmd->data_[0] = static_cast<std::uint64_t>(mask);
     }
 
     void graphics_command_builder::set_texture_for_shader(const int texture_slot, const int shader_binding, const drivers::shader_module_type module) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_set_texture_for_shader;
     
         cmd->data_[0] = PACK_2U32_TO_U64(texture_slot, shader_binding);
@@ -640,49 +702,51 @@ namespace eka2l1::drivers {
     }
 
     void graphics_command_builder::update_input_descriptors(drivers::handle h, input_descriptor *descriptors, const std::uint32_t count) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = nullptr;
+        const std::uint64_t descriptors_copy = create_command_with_payload(cmd, 4, descriptors, count * sizeof(input_descriptor));
+
         cmd->opcode_ = graphics_driver_create_input_descriptor;
     
-        cmd->data_[0] = make_data_copy(descriptors, count * sizeof(input_descriptor));
+        cmd->data_[0] = descriptors_copy;
         cmd->data_[1] = count;
         cmd->data_[2] = h;
         cmd->data_[3] = reinterpret_cast<std::uint64_t>(&h);
     }
 
     void graphics_command_builder::bind_input_descriptors(drivers::handle h) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_bind_input_descriptor;
         cmd->data_[0] = h;
     }
 
     void graphics_command_builder::set_line_width(const float width) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_line_width;
         cmd->data_[0] = *reinterpret_cast<const std::uint32_t*>(&width);
     }
 
     void graphics_command_builder::set_texture_max_mip(drivers::handle h, const std::uint32_t max_mip) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_set_max_mip_level;
         cmd->data_[0] = h;
         cmd->data_[1] = static_cast<std::uint64_t>(max_mip);
     }
 
     void graphics_command_builder::set_depth_bias(float constant_factor, float clamp, float slope_factor) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_set_depth_bias;
         cmd->data_[0] = pack_from_two_floats(constant_factor, slope_factor);
         cmd->data_[1] = pack_from_two_floats(clamp, 0);
     }
 
     void graphics_command_builder::set_depth_range(const float min, const float max) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(1);
         cmd->opcode_ = graphics_driver_set_depth_range;
         cmd->data_[0] = pack_from_two_floats(min, max);
     }
     
     void graphics_command_builder::set_texture_anisotrophy(drivers::handle h, const float anisotrophy_fact) {
-        command *cmd = list_.retrieve_next();
+        command *cmd = list_.retrieve_next(2);
         cmd->opcode_ = graphics_driver_set_texture_anisotrophy;
         cmd->data_[0] = h;
         cmd->data_[1] = pack_from_two_floats(anisotrophy_fact, 0);
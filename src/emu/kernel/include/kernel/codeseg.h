@@ -25,14 +25,20 @@
 #include <mem/ptr.h>
 #include <utils/sec.h>
 
+#include <memory>
 #include <tuple>
 #include <vector>
 
 namespace eka2l1 {
+    namespace common {
+        class bytepair_pages;
+    }
+
     namespace kernel {
         class chunk;
         class process;
         class codeseg;
+        class codeseg_cache;
         class thread;
     }
 
@@ -82,6 +88,75 @@ namespace eka2l1::kernel {
 
         std::uint8_t *constant_data;
         std::uint8_t *code_data;
+
+        // If this is set, code pages are decompressed from here on first access, and code_data is not used
+        std::shared_ptr<common::bytepair_pages> code_pages;
+
+        // Optional. Relocated sections are looked up in and stored to this cache
+        codeseg_cache *cache = nullptr;
+        std::uint64_t cache_image_key = 0;
+    };
+
+    enum code_fixup_type {
+        code_fixup_set,
+        code_fixup_add,
+        code_fixup_add_inferred
+    };
+
+    /**
+     * @brief Code chunk whose pages are committed, decompressed and fixed up on first access.
+     */
+    struct demand_paged_code {
+        struct fixup {
+            std::uint32_t offset_;
+            std::uint32_t value_;
+            code_fixup_type type_;
+        };
+
+        chunk_ptr chunk_;
+        std::uint8_t *host_code_;
+
+        std::shared_ptr<common::bytepair_pages> pages_;
+
+        std::vector<fixup> fixups_;
+        std::vector<bool> present_;
+
+        std::uint32_t code_size_;
+
+        // Used to infer relocation targets
+        address code_base_;
+        address code_end_;
+        address data_base_;
+        address data_end_;
+
+        std::uint32_t code_delta_;
+        std::uint32_t data_delta_;
+
+        explicit demand_paged_code(chunk_ptr chunk, std::shared_ptr<common::bytepair_pages> pages, const std::uint32_t code_size);
+
+        /**
+         * @brief Page code into host memory that is already committed, instead of a code chunk.
+         *
+         * @param host_code  Memory of at least code_size bytes which receives the pages.
+         */
+        explicit demand_paged_code(std::uint8_t *host_code, std::shared_ptr<common::bytepair_pages> pages, const std::uint32_t code_size);
+
+        void add_fixup(const std::uint32_t offset, const std::uint32_t value, const code_fixup_type type);
+
+        /**
+         * @brief Sort the recorded fixups. Must be called before any page is brought in.
+         */
+        void finalise();
+
+        /**
+         * @brief Bring in the page containing an offset of the code.
+         *
+         * @param offset     Offset from the start of the code chunk.
+         * @returns True if the page was not present and has been brought in.
+         */
+        bool page_in(const std::uint32_t offset);
+
+        void page_in_all();
     };
 
     enum codeseg_state {
@@ -103,6 +178,8 @@ namespace eka2l1::kernel {
             chunk_ptr data_chunk;
             chunk_ptr code_chunk;
 
+            std::shared_ptr<demand_paged_code> paged_code;
+
             codeseg_state state;
 
             common::double_linked_queue_element closing_lib_link;
@@ -145,6 +222,7 @@ namespace eka2l1::kernel {
 
         std::unique_ptr<std::uint8_t[]> constant_data;
         std::unique_ptr<std::uint8_t[]> code_data;
+        std::shared_ptr<common::bytepair_pages> code_pages;
 
         bool mark{ false };
 
@@ -152,12 +230,25 @@ namespace eka2l1::kernel {
         std::vector<address> premade_eps;
 
         chunk_ptr code_chunk_shared;
+        std::shared_ptr<demand_paged_code> paged_code_shared;
 
         std::vector<std::uint64_t> relocation_list;
 
+        codeseg_cache *cache_{ nullptr };
+        std::uint64_t cache_image_key_{ 0 };
+
         bool patched_{ false };
         bool ep_disabled_{ false };
 
+        struct attach_batch_entry;
+
+        void collect_attach_batch(kernel::process *new_foe, std::vector<attach_batch_entry> &batch,
+            std::vector<std::size_t> &resolve_order);
+
+        bool attach_chunks(kernel::process *new_foe, attach_batch_entry &entry);
+        void resolve_and_relocate(kernel::process *new_foe, const bool forcefully, attach_batch_entry &entry,
+            std::vector<address> &exports);
+
     public:
         /*! \brief Create a new codeseg
          *
@@ -188,6 +279,18 @@ namespace eka2l1::kernel {
          */
         bool add_premade_entry_point(const address addr);
 
+        /**
+         * @brief Attach this codeseg and everything it imports from to a process.
+         *
+         * Codesegs not yet attached to the process are attached together: their chunks are
+         * made first, then imports are resolved in dependency order. Codesegs already attached
+         * only get their use count raised.
+         *
+         * @param new_foe       The process to attach to.
+         * @param forcefully    Attach even if already attached, and resolve imports of ROM code.
+         *
+         * @returns True if this codeseg was newly attached.
+         */
         bool attach(kernel::process *new_foe, const bool forcefully = false);
         bool detach(kernel::process *de_foe);
 
@@ -264,6 +367,19 @@ namespace eka2l1::kernel {
         }
 
         std::vector<std::uint32_t> get_export_table(kernel::process *pr);
+
+        /**
+         * @brief Fill a table with the export addresses of this codeseg, as seen by a process.
+         *
+         * Ordinal N goes to index N - 1. Unused ordinals stay 0.
+         *
+         * @param pr        The process the addresses are for.
+         * @param table     The table to fill, resized to the export count.
+         *
+         * @returns False if the codeseg is not in ROM and not attached to the process. The table is all 0 then.
+         */
+        bool fill_export_table(kernel::process *pr, std::vector<address> &table);
+
         std::vector<std::uint32_t> &get_export_table_raw() {
             return export_table;
         }
@@ -277,5 +393,15 @@ namespace eka2l1::kernel {
         void set_entry_point_disabled();
 
         address relocate(kernel::process *pr, const address addr_on_base);
+
+        /**
+         * @brief Bring in a demand paged code page of this codeseg.
+         *
+         * @param pr        The process that accessed the address.
+         * @param addr      The accessed address.
+         *
+         * @returns True if the address belongs to a code page of this codeseg that was not present.
+         */
+        bool page_in(kernel::process *pr, const address addr);
     };
 }
\ No newline at end of file
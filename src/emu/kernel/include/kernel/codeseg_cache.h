@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace eka2l1::loader {
+    struct e32img;
+}
+
+namespace eka2l1::kernel {
+    //! Size the cache folder is pruned back to at startup, in bytes.
+    static constexpr std::uint64_t CODESEG_CACHE_DEFAULT_MAX_SIZE = 256ULL * 1024 * 1024;
+
+    struct codeseg_cache_stats {
+        std::atomic<std::uint32_t> image_hits_{ 0 };
+        std::atomic<std::uint32_t> image_misses_{ 0 };
+        std::atomic<std::uint32_t> relocation_hits_{ 0 };
+        std::atomic<std::uint32_t> relocation_misses_{ 0 };
+
+        //! Time spent turning image files into parsed images, hit or miss.
+        std::atomic<std::uint64_t> image_load_us_{ 0 };
+
+        //! Time spent patching imports and relocating code and data, hit or miss.
+        std::atomic<std::uint64_t> relocate_us_{ 0 };
+    };
+
+    /**
+     * @brief Persistent cache of decompressed and relocated E32 images.
+     *
+     * Every image entry is keyed by the image's path, size and modification time, and holds the
+     * decompressed image. Relocation entries of an image are further keyed by the code and data run
+     * addresses plus every resolved import, and hold the code and data sections after imports are
+     * patched and relocations applied.
+     *
+     * Entries are separate files, written once and never modified in place, so they can be mapped.
+     * With an empty folder, the cache is disabled and only collects timings.
+     *
+     * An image and its relocations are pruned together, least recently written first, when the folder
+     * grows past the size limit. Entries of images that changed are never hit again, so they age out this way.
+     */
+    class codeseg_cache {
+        std::string folder_;
+        std::uint64_t max_size_;
+        codeseg_cache_stats stats_;
+
+        std::string image_path(const std::uint64_t image_key) const;
+        std::string relocation_path(const std::uint64_t image_key, const std::uint64_t relocation_key) const;
+
+    public:
+        explicit codeseg_cache(const std::string &folder, const std::uint64_t max_size = CODESEG_CACHE_DEFAULT_MAX_SIZE);
+        ~codeseg_cache();
+
+        /**
+         * @brief Remove the oldest images and their relocations until the folder fits in the size limit.
+         *
+         * Also removes temporary files left by an interrupted store. Done once on construction.
+         *
+         * @returns Number of bytes removed.
+         */
+        std::uint64_t prune();
+
+        bool enabled() const {
+            return !folder_.empty();
+        }
+
+        /**
+         * @brief Make the key identifying the relocated sections of an image.
+         *
+         * @param code_run_addr     Address the code runs at.
+         * @param data_run_addr     Address the data runs at.
+         * @param imports           Resolved imports, as pairs of offset in the code and patched value.
+         */
+        static std::uint64_t make_relocation_key(const std::uint32_t code_run_addr, const std::uint32_t data_run_addr,
+            const std::vector<std::pair<std::uint32_t, std::uint32_t>> &imports);
+
+        /**
+         * @brief Make the key identifying an image file.
+         *
+         * @param path          Full path of the image in the guest file system.
+         * @param size          Size of the image file.
+         * @param modify_time   Last modification time of the image file.
+         */
+        static std::uint64_t make_image_key(const std::u16string &path, const std::uint64_t size,
+            const std::uint64_t modify_time);
+
+        /**
+         * @brief Parse an image from its cached decompressed form.
+         *
+         * @returns The parsed image, or nullopt on a miss.
+         */
+        std::optional<loader::e32img> load_image(const std::uint64_t image_key);
+
+        /**
+         * @brief Store the decompressed form of a parsed image.
+         */
+        bool store_image(const std::uint64_t image_key, const loader::e32img &img);
+
+        /**
+         * @brief Copy the cached relocated sections of an image.
+         *
+         * @param code       Destination of the relocated code. Must hold code_size bytes.
+         * @param data       Destination of the relocated initialised data. Must hold data_size bytes.
+         *
+         * @returns True on hit.
+         */
+        bool load_relocated(const std::uint64_t image_key, const std::uint64_t relocation_key, std::uint8_t *code,
+            const std::uint32_t code_size, std::uint8_t *data, const std::uint32_t data_size);
+
+        bool store_relocated(const std::uint64_t image_key, const std::uint64_t relocation_key, const std::uint8_t *code,
+            const std::uint32_t code_size, const std::uint8_t *data, const std::uint32_t data_size);
+
+        codeseg_cache_stats &get_stats() {
+            return stats_;
+        }
+    };
+}
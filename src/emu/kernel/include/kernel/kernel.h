@@ -374,6 +374,16 @@ namespace eka2l1 {
 
         bool cpu_exception_handler(arm::core *core, arm::exception_type exception_type, const std::uint32_t exception_data);
 
+        /**
+         * @brief Bring in a demand paged code page.
+         *
+         * @param pr        The process that accessed the address.
+         * @param addr      The accessed address.
+         *
+         * @returns True if the address was in a code page that was not present and is now.
+         */
+        bool page_in_code(kernel::process *pr, const address addr);
+
         void call_ipc_send_callbacks(const std::string &server_name, const int ord, const ipc_arg &args,
             address reqsts_addr, kernel::thread *callee);
 
@@ -31,6 +31,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
 
 namespace YAML {
     class Node;
@@ -39,6 +40,7 @@ namespace YAML {
 namespace eka2l1 {
     class io_system;
     class memory_system;
+    class file;
     class kernel_system;
     class system;
 
@@ -57,6 +59,7 @@ namespace eka2l1 {
         class chunk;
         class process;
         class codeseg;
+        class codeseg_cache;
     }
 
     using process_ptr = kernel::process *;
@@ -136,6 +139,11 @@ namespace eka2l1 {
             std::vector<patch_pending_entry> patch_pendings_;
             std::map<address, address> trampoline_lookup_;
 
+            std::unique_ptr<kernel::codeseg_cache> codeseg_cache_;
+
+            //! Cache keys of parsed images, by lowercased path.
+            std::unordered_map<std::u16string, std::uint64_t> image_cache_keys_;
+
         protected:
             const std::uint8_t *entry_points_call_routine_;
             const std::uint8_t *thread_entry_routine_;
@@ -144,6 +152,14 @@ namespace eka2l1 {
 
             drive_number get_drive_rom();
 
+            /**
+             * \brief Parse an E32 image file, going through the codeseg cache first.
+             *
+             * \param f     The image file.
+             * \param path  The full path of the image.
+             */
+            std::optional<loader::e32img> parse_e32img_file(file *f, const std::u16string &path);
+
             void apply_pending_patches();
             void apply_trick_or_treat_algo();
             void jump_trampoline_through_svc();
@@ -187,6 +203,17 @@ namespace eka2l1 {
             bool try_apply_patch(codeseg_ptr original);
 
             system *get_sys();
+
+            kernel::codeseg_cache *get_codeseg_cache() {
+                return codeseg_cache_.get();
+            }
+
+            /**
+             * \brief Get the cache key of an image parsed through the codeseg cache.
+             *
+             * \returns The key, or 0 if the image did not go through the cache.
+             */
+            std::uint64_t get_image_cache_key(const std::u16string &path) const;
         };
     }
 
@@ -24,6 +24,8 @@
 #include <common/queue.h>
 #include <kernel/thread.h>
 
+#include <functional>
+
 namespace eka2l1 {
     namespace kernel {
         /*! \brief A mutex kernel object. 
@@ -45,6 +47,9 @@ namespace eka2l1 {
 
             int mutex_event_type;
 
+            //! Called before a thread tries to take the mutex
+            std::function<void()> acquire_hook;
+
         protected:
             void wake_next_thread();
 
@@ -67,6 +72,14 @@ namespace eka2l1 {
             void wait();
             void try_wait();
 
+            /*! \brief Set a function to be called every time a thread tries to take the mutex.
+             *
+             * HLE servers use this to finish work on data the mutex guards before the guest touches it.
+             */
+            void set_acquire_hook(std::function<void()> hook) {
+                acquire_hook = std::move(hook);
+            }
+
             void wait_for(int usecs);
 
             kernel::thread *holder() {
@@ -19,14 +19,125 @@
  */
 
 #include <common/algorithm.h>
+#include <common/bytepair.h>
 #include <common/log.h>
 #include <kernel/codeseg.h>
+#include <kernel/codeseg_cache.h>
 #include <kernel/kernel.h>
 #include <loader/common.h>
 
 #include <algorithm>
+#include <chrono>
+#include <unordered_set>
 
 namespace eka2l1::kernel {
+    demand_paged_code::demand_paged_code(chunk_ptr chunk, std::shared_ptr<common::bytepair_pages> pages, const std::uint32_t code_size)
+        : chunk_(chunk)
+        , host_code_(nullptr)
+        , pages_(std::move(pages))
+        , present_(pages_->page_count(), false)
+        , code_size_(code_size)
+        , code_base_(0)
+        , code_end_(0)
+        , data_base_(0)
+        , data_end_(0)
+        , code_delta_(0)
+        , data_delta_(0) {
+    }
+
+    demand_paged_code::demand_paged_code(std::uint8_t *host_code, std::shared_ptr<common::bytepair_pages> pages, const std::uint32_t code_size)
+        : demand_paged_code(chunk_ptr(nullptr), std::move(pages), code_size) {
+        host_code_ = host_code;
+    }
+
+    void demand_paged_code::add_fixup(const std::uint32_t offset, const std::uint32_t value, const code_fixup_type type) {
+        fixups_.push_back({ offset, value, type });
+    }
+
+    void demand_paged_code::finalise() {
+        std::stable_sort(fixups_.begin(), fixups_.end(), [](const fixup &lhs, const fixup &rhs) {
+            return lhs.offset_ < rhs.offset_;
+        });
+    }
+
+    bool demand_paged_code::page_in(const std::uint32_t offset) {
+        const std::uint32_t page = offset / common::BYTEPAIR_PAGE_SIZE;
+
+        if ((offset >= code_size_) || (page >= present_.size()) || present_[page]) {
+            return false;
+        }
+
+        const std::uint32_t page_start = page * common::BYTEPAIR_PAGE_SIZE;
+        const std::uint32_t page_end = common::min<std::uint32_t>(page_start + common::BYTEPAIR_PAGE_SIZE, code_size_);
+
+        std::uint8_t *code_ptr = host_code_;
+
+        if (chunk_) {
+            if (!chunk_->commit(page_start, common::BYTEPAIR_PAGE_SIZE)) {
+                LOG_ERROR(KERNEL, "Unable to commit code page {} of chunk {}", page, chunk_->name());
+                return false;
+            }
+
+            code_ptr = reinterpret_cast<std::uint8_t *>(chunk_->host_base());
+        }
+
+        std::uint8_t *page_ptr = code_ptr + page_start;
+
+        if (pages_->decompress_page(page_ptr, page) != page_end - page_start) {
+            LOG_ERROR(KERNEL, "Corrupted compressed code page {}", page);
+        }
+
+        present_[page] = true;
+
+        auto ite = std::lower_bound(fixups_.begin(), fixups_.end(), page_start, [](const fixup &lhs, const std::uint32_t off) {
+            return lhs.offset_ < off;
+        });
+
+        for (; (ite != fixups_.end()) && (ite->offset_ < page_end); ite++) {
+            if (ite->offset_ + sizeof(std::uint32_t) > page_end) {
+                // The fixup spans into the next page, which must be present before we patch it
+                page_in(page_end);
+            }
+
+            std::uint32_t *to_fix = reinterpret_cast<std::uint32_t *>(page_ptr + (ite->offset_ - page_start));
+
+            switch (ite->type_) {
+            case code_fixup_set:
+                *to_fix = ite->value_;
+                break;
+
+            case code_fixup_add:
+                *to_fix += ite->value_;
+                break;
+
+            case code_fixup_add_inferred: {
+                const std::uint32_t val = *to_fix;
+
+                if ((code_base_ <= val) && (val <= code_end_)) {
+                    *to_fix += code_delta_;
+                } else if ((data_base_ <= val) && (val <= data_end_)) {
+                    *to_fix += data_delta_;
+                } else {
+                    LOG_ERROR(KERNEL, "Unable to infer the relocation type of offset 0x{:X}", val);
+                }
+
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    void demand_paged_code::page_in_all() {
+        for (std::uint32_t offset = 0; offset < code_size_; offset += common::BYTEPAIR_PAGE_SIZE) {
+            page_in(offset);
+        }
+    }
+
     codeseg::codeseg(kernel_system *kern, const std::string &name, codeseg_create_info &info)
         : kernel_obj(kern, name, nullptr, kernel::access_type::global_access)
         , patched_(false)
@@ -59,12 +170,17 @@ namespace eka2l1::kernel {
             std::copy(info.constant_data, info.constant_data + info.data_size, constant_data.get());
         }
 
-        if (code_addr == 0) {
+        code_pages = std::move(info.code_pages);
+
+        if ((code_addr == 0) && !code_pages) {
             code_data = std::make_unique<std::uint8_t[]>(info.code_size);
             std::copy(info.code_data, info.code_data + info.code_size, code_data.get());
         }
 
         relocation_list = info.relocation_list;
+
+        cache_ = info.cache;
+        cache_image_key_ = info.cache_image_key;
     }
 
     int codeseg::destroy() {
@@ -95,6 +211,61 @@ namespace eka2l1::kernel {
         return true;
     }
 
+    struct codeseg::attach_batch_entry {
+        codeseg *seg_;
+        attached_info *info_{ nullptr };
+
+        address code_run_{ 0 };
+        address data_run_{ 0 };
+
+        std::uint8_t *code_base_ptr_{ nullptr };
+        std::uint8_t *data_base_ptr_{ nullptr };
+
+        std::shared_ptr<demand_paged_code> paged_code_;
+        bool need_patch_and_reloc_{ true };
+    };
+
+    void codeseg::collect_attach_batch(kernel::process *new_foe, std::vector<attach_batch_entry> &batch,
+        std::vector<std::size_t> &resolve_order) {
+        std::unordered_set<codeseg *> found;
+
+        // Index of a codeseg in the batch, and the next of its dependencies to visit
+        std::vector<std::pair<std::size_t, std::size_t>> stack;
+
+        auto attached_to_foe = [=](codeseg *seg) {
+            return common::find_and_ret_if(seg->attaches, [=](const std::unique_ptr<attached_info> &info) {
+                return info->attached_process == new_foe;
+            }) != nullptr;
+        };
+
+        auto add_to_batch = [&](codeseg *seg) {
+            found.insert(seg);
+            stack.emplace_back(batch.size(), 0);
+            batch.push_back(attach_batch_entry{ seg });
+        };
+
+        add_to_batch(this);
+
+        while (!stack.empty()) {
+            const std::size_t index = stack.back().first;
+            codeseg *seg = batch[index].seg_;
+
+            if (stack.back().second < seg->dependencies.size()) {
+                codeseg *dep = seg->dependencies[stack.back().second++].dep_;
+
+                if (new_foe && (found.find(dep) == found.end()) && !attached_to_foe(dep)) {
+                    add_to_batch(dep);
+                }
+
+                continue;
+            }
+
+            // All of its dependencies are in, resolve their exports before its imports
+            resolve_order.push_back(index);
+            stack.pop_back();
+        }
+    }
+
     bool codeseg::attach(kernel::process *new_foe, const bool forcefully) {
         if (!new_foe && !forcefully) {
             return false;
@@ -122,6 +293,38 @@ namespace eka2l1::kernel {
             }
         }
 
+        // Everything reachable that is not attached yet is attached in one batch. Chunks are made in the
+        // order codesegs are found, then imports are resolved with dependencies coming first.
+        std::vector<attach_batch_entry> batch;
+        std::vector<std::size_t> resolve_order;
+
+        collect_attach_batch(new_foe, batch, resolve_order);
+
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            if (!batch[i].seg_->attach_chunks(new_foe, batch[i]) && (i == 0)) {
+                return false;
+            }
+        }
+
+        // What is attached now already holds its reference, don't let other importers raise it
+        for (attach_batch_entry &entry : batch) {
+            entry.seg_->mark = true;
+        }
+
+        std::vector<address> exports;
+
+        for (const std::size_t index : resolve_order) {
+            attach_batch_entry &entry = batch[index];
+
+            if (entry.info_) {
+                entry.seg_->resolve_and_relocate(new_foe, forcefully && (index == 0), entry, exports);
+            }
+        }
+
+        return true;
+    }
+
+    bool codeseg::attach_chunks(kernel::process *new_foe, attach_batch_entry &entry) {
         // Allocate new data chunk for this!
         memory_system *mem = kern->get_memory_system();
         const auto data_size_align = common::align(data_size + bss_size, mem->get_page_size());
@@ -136,6 +339,8 @@ namespace eka2l1::kernel {
         std::uint8_t *code_base_ptr = nullptr;
         std::uint8_t *data_base_ptr = nullptr;
 
+        std::shared_ptr<demand_paged_code> paged_code;
+
         bool code_chunk_for_reuse = eligible_for_codeseg_reuse();
         bool need_patch_and_reloc = true;
 
@@ -145,10 +350,27 @@ namespace eka2l1::kernel {
             // EKA1 try to reuse code segment...
             if (code_chunk_shared) {
                 code_chunk = code_chunk_shared;
+                paged_code = paged_code_shared;
                 need_patch_and_reloc = false;
 
                 code_chunk->open_to(new_foe);
                 the_addr_of_code_run = code_chunk->base(new_foe).ptr_address();
+            } else if (code_pages) {
+                // Pages are committed as they are touched
+                code_chunk = kern->create<kernel::chunk>(mem, code_chunk_for_reuse ? nullptr : new_foe, "", 0, 0, code_size_align, prot_read_write_exec, kernel::chunk_type::disconnected,
+                    kernel::chunk_access::code, kernel::chunk_attrib::none);
+
+                if (!code_chunk_for_reuse) {
+                    code_chunk->open_to(new_foe);
+                }
+
+                the_addr_of_code_run = code_chunk->base(new_foe).ptr_address();
+                paged_code = std::make_shared<demand_paged_code>(code_chunk, code_pages, code_size);
+
+                if (code_chunk_for_reuse) {
+                    code_chunk_shared = code_chunk;
+                    paged_code_shared = paged_code;
+                }
             } else {
                 code_chunk = kern->create<kernel::chunk>(mem, code_chunk_for_reuse ? nullptr : new_foe, "", 0, code_size_align, code_size_align, prot_read_write_exec, kernel::chunk_type::normal,
                     kernel::chunk_access::code, kernel::chunk_attrib::none);
@@ -219,35 +441,109 @@ namespace eka2l1::kernel {
         LOG_INFO(KERNEL, "{} (UID3=0x{:X}) runtime data: 0x{:x}", name(), uids[2], the_addr_of_data_run);
 
         attaches.emplace_back(std::make_unique<attached_info>(this, new_foe, dt_chunk, code_chunk));
+        attaches.back()->paged_code = paged_code;
+
+        entry.info_ = attaches.back().get();
+        entry.code_run_ = the_addr_of_code_run;
+        entry.data_run_ = the_addr_of_data_run;
+        entry.code_base_ptr_ = code_base_ptr;
+        entry.data_base_ptr_ = data_base_ptr;
+        entry.paged_code_ = std::move(paged_code);
+        entry.need_patch_and_reloc_ = need_patch_and_reloc;
+
+        return true;
+    }
+
+    void codeseg::resolve_and_relocate(kernel::process *new_foe, const bool forcefully, attach_batch_entry &entry,
+        std::vector<address> &exports) {
+        const address the_addr_of_code_run = entry.code_run_;
+        const address the_addr_of_data_run = entry.data_run_;
+
+        std::uint8_t *code_base_ptr = entry.code_base_ptr_;
+        std::uint8_t *data_base_ptr = entry.data_base_ptr_;
 
-        // Attach all of its dependencies
+        const std::shared_ptr<demand_paged_code> &paged_code = entry.paged_code_;
+        bool need_patch_and_reloc = entry.need_patch_and_reloc_;
+
+        const auto relocate_start = std::chrono::steady_clock::now();
+
+        // Offset and value of each import to patch
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> import_patches;
+        const bool resolve_imports = need_patch_and_reloc && ((code_addr && forcefully) || !code_addr);
+
+        if (resolve_imports) {
+            std::size_t import_count = 0;
+
+            for (auto &dependency : dependencies) {
+                import_count += dependency.import_info_.size();
+            }
+
+            import_patches.reserve(import_count);
+        }
+
+        // Reference all of its dependencies, and resolve what imports we need
         for (auto &dependency : dependencies) {
             dependency.dep_->attach(new_foe);
 
-            // Patch what imports we need
-            if (need_patch_and_reloc) {
-                if ((code_addr && forcefully) || !code_addr) {
-                    for (const std::uint64_t import : dependency.import_info_) {
-                        const std::uint16_t ord = (import & 0xFFFF);
-                        const std::uint16_t adj = (import >> 16) & 0xFFFF;
-                        const std::uint32_t offset_to_apply = (import >> 32) & 0xFFFFFFFF;
-
-                        const address addr = dependency.dep_->lookup(new_foe, ord);
-                        if (!addr) {
-                            LOG_ERROR(KERNEL, "Invalid ordinal {}, requested from {}", ord, dependency.dep_->name());
-                        }
+            if (!resolve_imports) {
+                continue;
+            }
 
-                        *reinterpret_cast<std::uint32_t *>(&code_base_ptr[offset_to_apply]) = addr + adj;
-                    }
+            // Relocate the export table once, not once per import
+            dependency.dep_->fill_export_table(new_foe, exports);
+            const std::size_t export_count = exports.size();
+
+            for (const std::uint64_t import : dependency.import_info_) {
+                const std::uint16_t ord = (import & 0xFFFF);
+                const std::uint16_t adj = (import >> 16) & 0xFFFF;
+                const std::uint32_t offset_to_apply = (import >> 32) & 0xFFFFFFFF;
+
+                const address addr = ((ord != 0) && (ord <= export_count)) ? exports[ord - 1] : 0;
+                if (!addr) {
+                    LOG_ERROR(KERNEL, "Invalid ordinal {}, requested from {}", ord, dependency.dep_->name());
                 }
+
+                import_patches.emplace_back(offset_to_apply, addr + adj);
+            }
+        }
+
+        // The relocated sections only depend on the image, where it runs, and what it imports. Images without
+        // a key (not cached, or in ROM) would all share key 0, so they are never cached.
+        const bool use_cache = need_patch_and_reloc && cache_ && cache_->enabled() && (cache_image_key_ != 0) && (code_addr == 0) && !paged_code;
+        const std::uint32_t cached_data_size = data_base_ptr ? data_size : 0;
+
+        std::uint64_t relocation_key = 0;
+
+        if (use_cache) {
+            relocation_key = codeseg_cache::make_relocation_key(the_addr_of_code_run, the_addr_of_data_run, import_patches);
+
+            if (cache_->load_relocated(cache_image_key_, relocation_key, code_base_ptr, code_size, data_base_ptr, cached_data_size)) {
+                need_patch_and_reloc = false;
             }
         }
 
         if (need_patch_and_reloc) {
+            for (const auto &[offset_to_apply, value] : import_patches) {
+                if (paged_code) {
+                    paged_code->add_fixup(offset_to_apply, value, code_fixup_set);
+                } else {
+                    *reinterpret_cast<std::uint32_t *>(&code_base_ptr[offset_to_apply]) = value;
+                }
+            }
+
             if (!relocation_list.empty()) {
                 const std::uint32_t code_delta = the_addr_of_code_run - code_base;
                 const std::uint32_t data_delta = the_addr_of_data_run - data_base;
 
+                if (paged_code) {
+                    paged_code->code_base_ = code_base;
+                    paged_code->code_end_ = code_base + code_size;
+                    paged_code->data_base_ = data_base;
+                    paged_code->data_end_ = data_base + data_size + bss_size;
+                    paged_code->code_delta_ = code_delta;
+                    paged_code->data_delta_ = data_delta;
+                }
+
                 // Relocate the image
                 for (const std::uint64_t relocate_info : relocation_list) {
                     const loader::relocation_type rel_type = static_cast<loader::relocation_type>((relocate_info >> 32) & 0xFFFF);
@@ -271,6 +567,32 @@ namespace eka2l1::kernel {
                         break;
                     }
 
+                    if (paged_code && (sect_type == loader::relocate_section_text)) {
+                        // Code is not there yet, patch it when the page is brought in
+                        switch (rel_type) {
+                        case loader::relocation_type::data:
+                            paged_code->add_fixup(offset_to_relocate, data_delta, code_fixup_add);
+                            break;
+
+                        case loader::relocation_type::text:
+                            paged_code->add_fixup(offset_to_relocate, code_delta, code_fixup_add);
+                            break;
+
+                        case loader::relocation_type::inferred:
+                            paged_code->add_fixup(offset_to_relocate, 0, code_fixup_add_inferred);
+                            break;
+
+                        case loader::relocation_type::reserved:
+                            break;
+
+                        default:
+                            LOG_ERROR(KERNEL, "Unknown code relocation type {}", static_cast<std::uint32_t>(rel_type));
+                            break;
+                        }
+
+                        continue;
+                    }
+
                     std::uint32_t *to_relocate_ptr = reinterpret_cast<std::uint32_t *>(&base_ptr[offset_to_relocate]);
 
                     switch (rel_type) {
@@ -308,14 +630,25 @@ namespace eka2l1::kernel {
                     *to_relocate_ptr = *to_relocate_ptr + the_delta;
                 }
             }
+
+            if (use_cache) {
+                cache_->store_relocated(cache_image_key_, relocation_key, code_base_ptr, code_size, data_base_ptr, cached_data_size);
+            }
+        }
+
+        if (cache_) {
+            cache_->get_stats().relocate_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - relocate_start).count();
+        }
+
+        if (paged_code && need_patch_and_reloc) {
+            paged_code->finalise();
         }
 
         if (new_foe)
-            new_foe->codeseg_list.push(&attaches.back()->process_link);
+            new_foe->codeseg_list.push(&entry.info_->process_link);
 
         kern->run_codeseg_loaded_callback(obj_name, new_foe, this);
-
-        return true;
     }
 
     bool codeseg::detach(kernel::process *de_foe) {
@@ -475,6 +808,11 @@ namespace eka2l1::kernel {
         attached_info *attach_info = attach_info_ptr->get();
 
         if (base) {
+            if (attach_info->paged_code) {
+                // The caller is going to access the code directly
+                attach_info->paged_code->page_in_all();
+            }
+
             *base = reinterpret_cast<std::uint8_t *>(attach_info->code_chunk->host_base());
         }
 
@@ -618,6 +956,33 @@ namespace eka2l1::kernel {
         return true;
     }
 
+    bool codeseg::fill_export_table(kernel::process *pr, std::vector<address> &table) {
+        table.assign(export_table.begin(), export_table.end());
+
+        if ((code_addr != 0) || patched_) {
+            return true;
+        }
+
+        auto attach_info = common::find_and_ret_if(attaches, [=](const std::unique_ptr<attached_info> &info) {
+            return info->attached_process == pr;
+        });
+
+        if (attach_info == nullptr) {
+            std::fill(table.begin(), table.end(), 0);
+            return false;
+        }
+
+        const address delta = attach_info->get()->code_chunk->base(pr).ptr_address() - code_base;
+
+        for (address &entry : table) {
+            if (entry) {
+                entry += delta;
+            }
+        }
+
+        return true;
+    }
+
     std::vector<std::uint32_t> codeseg::get_export_table(kernel::process *pr) {
         if (code_addr != 0) {
             return export_table;
@@ -674,6 +1039,26 @@ namespace eka2l1::kernel {
         return addr_on_base - get_code_base() + get_code_run_addr(pr, nullptr);
     }
 
+    bool codeseg::page_in(kernel::process *pr, const address addr) {
+        for (auto &info : attaches) {
+            if (!info->paged_code) {
+                continue;
+            }
+
+            if ((info->code_chunk != code_chunk_shared) && (info->attached_process != pr)) {
+                continue;
+            }
+
+            const address base = info->code_chunk->base(pr).ptr_address();
+
+            if ((addr >= base) && (addr < base + code_size)) {
+                return info->paged_code->page_in(addr - base);
+            }
+        }
+
+        return false;
+    }
+
     std::vector<kernel::process*> codeseg::attached_processes() const {
         std::vector<kernel::process*> processes;
         for (std::size_t i = 0; i < attaches.size(); i++) {
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project
+ * (see bentokun.github.com/EKA2L1).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <common/algorithm.h>
+#include <common/buffer.h>
+#include <common/cvt.h>
+#include <common/fileutils.h>
+#include <common/log.h>
+#include <common/path.h>
+#include <common/virtualmem.h>
+
+#include <kernel/codeseg_cache.h>
+#include <loader/e32img.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace eka2l1::kernel {
+    static constexpr std::uint32_t CODESEG_CACHE_IMAGE_MAGIC = 0x49534345; // ECSI
+    static constexpr std::uint32_t CODESEG_CACHE_RELOCATION_MAGIC = 0x52534345; // ECSR
+    static constexpr std::uint32_t CODESEG_CACHE_VERSION = 1;
+
+    // Offset of the compression type in both EKA1 and EKA2 image headers
+    static constexpr std::size_t E32_COMPRESSION_TYPE_OFFSET = 0x1C;
+
+    struct codeseg_cache_image_header {
+        std::uint32_t magic_;
+        std::uint32_t version_;
+        std::uint64_t image_key_;
+        std::uint64_t data_size_;
+    };
+
+    struct codeseg_cache_relocation_header {
+        std::uint32_t magic_;
+        std::uint32_t version_;
+        std::uint64_t image_key_;
+        std::uint64_t relocation_key_;
+        std::uint32_t code_size_;
+        std::uint32_t data_size_;
+    };
+
+    static std::uint64_t fnv1a_64(std::uint64_t hash, const void *data, const std::size_t size) {
+        const std::uint8_t *bytes = reinterpret_cast<const std::uint8_t *>(data);
+
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ULL;
+        }
+
+        return hash;
+    }
+
+    // Write to a temporary file first, so a crash never leaves a partial entry behind
+    static bool write_cache_file(const std::string &path, const void *header, const std::size_t header_size,
+        const std::uint8_t **parts, const std::size_t *part_sizes, const std::size_t part_count) {
+        const std::string temp_path = path + ".tmp";
+        FILE *f = common::open_c_file(temp_path, "wb");
+
+        if (!f) {
+            return false;
+        }
+
+        bool ok = (fwrite(header, 1, header_size, f) == header_size);
+
+        for (std::size_t i = 0; ok && (i < part_count); i++) {
+            ok = (part_sizes[i] == 0) || (fwrite(parts[i], 1, part_sizes[i], f) == part_sizes[i]);
+        }
+
+        fclose(f);
+
+        if (!ok || !common::move_file(temp_path, path)) {
+            common::remove(temp_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    codeseg_cache::codeseg_cache(const std::string &folder, const std::uint64_t max_size)
+        : folder_(folder)
+        , max_size_(max_size) {
+        if (folder_.empty()) {
+            return;
+        }
+
+        if (!common::exists(folder_)) {
+            common::create_directories(folder_);
+        } else {
+            prune();
+        }
+    }
+
+    std::uint64_t codeseg_cache::prune() {
+        if (!enabled()) {
+            return 0;
+        }
+
+        auto iterator = common::make_directory_iterator(folder_);
+        if (!iterator || !iterator->is_valid()) {
+            return 0;
+        }
+
+        iterator->detail = true;
+
+        // An image and all its relocations, named after the image key
+        struct cache_entry_group {
+            std::vector<std::string> paths_;
+            std::uint64_t size_ = 0;
+            std::uint64_t newest_write_ = 0;
+        };
+
+        std::unordered_map<std::string, cache_entry_group> groups;
+        std::uint64_t total_size = 0;
+        std::uint64_t removed_size = 0;
+
+        common::dir_entry entry{};
+
+        while (iterator->next_entry(entry) == 0) {
+            if (entry.type != common::FILE_REGULAR) {
+                continue;
+            }
+
+            const std::string path = folder_ + entry.name;
+            const std::string extension = common::lowercase_string(eka2l1::path_extension(entry.name));
+
+            if (extension == ".tmp") {
+                if (common::remove(path)) {
+                    removed_size += entry.size;
+                }
+
+                continue;
+            }
+
+            if (((extension != ".img") && (extension != ".rel")) || (entry.name.length() < 16)) {
+                continue;
+            }
+
+            cache_entry_group &group = groups[entry.name.substr(0, 16)];
+            group.paths_.push_back(path);
+            group.size_ += entry.size;
+            group.newest_write_ = common::max(group.newest_write_, common::get_last_modifiy_since_ad(common::utf8_to_ucs2(path)));
+
+            total_size += entry.size;
+        }
+
+        if (total_size > max_size_) {
+            std::vector<cache_entry_group *> oldest_first;
+            for (auto &[key, group] : groups) {
+                oldest_first.push_back(&group);
+            }
+
+            std::sort(oldest_first.begin(), oldest_first.end(), [](const cache_entry_group *lhs, const cache_entry_group *rhs) {
+                return lhs->newest_write_ < rhs->newest_write_;
+            });
+
+            for (std::size_t i = 0; (i < oldest_first.size()) && (total_size > max_size_); i++) {
+                for (const std::string &path : oldest_first[i]->paths_) {
+                    common::remove(path);
+                }
+
+                total_size -= oldest_first[i]->size_;
+                removed_size += oldest_first[i]->size_;
+            }
+        }
+
+        if (removed_size) {
+            LOG_INFO(KERNEL, "Codeseg cache: pruned {} KB, {} KB left", removed_size / 1024, total_size / 1024);
+        }
+
+        return removed_size;
+    }
+
+    codeseg_cache::~codeseg_cache() {
+        LOG_INFO(KERNEL, "Codeseg cache: images {} hits/{} misses in {} ms, relocations {} hits/{} misses in {} ms",
+            stats_.image_hits_.load(), stats_.image_misses_.load(), stats_.image_load_us_.load() / 1000,
+            stats_.relocation_hits_.load(), stats_.relocation_misses_.load(), stats_.relocate_us_.load() / 1000);
+    }
+
+    std::string codeseg_cache::image_path(const std::uint64_t image_key) const {
+        return folder_ + fmt::format("{:016X}.img", image_key);
+    }
+
+    std::string codeseg_cache::relocation_path(const std::uint64_t image_key, const std::uint64_t relocation_key) const {
+        return folder_ + fmt::format("{:016X}_{:016X}.rel", image_key, relocation_key);
+    }
+
+    std::uint64_t codeseg_cache::make_image_key(const std::u16string &path, const std::uint64_t size,
+        const std::uint64_t modify_time) {
+        const std::string path_lower = common::lowercase_string(common::ucs2_to_utf8(path));
+
+        std::uint64_t hash = 0xCBF29CE484222325ULL;
+        hash = fnv1a_64(hash, path_lower.data(), path_lower.size());
+        hash = fnv1a_64(hash, &size, sizeof(size));
+        hash = fnv1a_64(hash, &modify_time, sizeof(modify_time));
+
+        return hash;
+    }
+
+    std::uint64_t codeseg_cache::make_relocation_key(const std::uint32_t code_run_addr, const std::uint32_t data_run_addr,
+        const std::vector<std::pair<std::uint32_t, std::uint32_t>> &imports) {
+        std::uint64_t hash = 0xCBF29CE484222325ULL;
+        hash = fnv1a_64(hash, &code_run_addr, sizeof(code_run_addr));
+        hash = fnv1a_64(hash, &data_run_addr, sizeof(data_run_addr));
+
+        for (const auto &import : imports) {
+            hash = fnv1a_64(hash, &import.first, sizeof(import.first));
+            hash = fnv1a_64(hash, &import.second, sizeof(import.second));
+        }
+
+        return hash;
+    }
+
+    std::optional<loader::e32img> codeseg_cache::load_image(const std::uint64_t image_key) {
+        if (!enabled()) {
+            return std::nullopt;
+        }
+
+        const std::string path = image_path(image_key);
+        const std::int64_t file_size = common::exists(path) ? common::file_size(path) : 0;
+
+        if (file_size <= static_cast<std::int64_t>(sizeof(codeseg_cache_image_header))) {
+            stats_.image_misses_++;
+            return std::nullopt;
+        }
+
+        std::uint8_t *map = reinterpret_cast<std::uint8_t *>(common::map_file(path, prot_read));
+
+        if (!map) {
+            stats_.image_misses_++;
+            return std::nullopt;
+        }
+
+        std::optional<loader::e32img> img = std::nullopt;
+
+        codeseg_cache_image_header header;
+        std::memcpy(&header, map, sizeof(header));
+
+        if ((header.magic_ == CODESEG_CACHE_IMAGE_MAGIC) && (header.version_ == CODESEG_CACHE_VERSION) && (header.image_key_ == image_key)
+            && (header.data_size_ == file_size - sizeof(header))) {
+            common::ro_buf_stream stream(map + sizeof(header), header.data_size_);
+            img = loader::parse_e32img(reinterpret_cast<common::ro_stream *>(&stream));
+        }
+
+        common::unmap_file(map, static_cast<std::size_t>(file_size));
+
+        if (!img) {
+            LOG_WARN(KERNEL, "Codeseg cache entry {} is invalid, discarding it", path);
+            common::remove(path);
+
+            stats_.image_misses_++;
+            return std::nullopt;
+        }
+
+        stats_.image_hits_++;
+        return img;
+    }
+
+    bool codeseg_cache::store_image(const std::uint64_t image_key, const loader::e32img &img) {
+        if (!enabled() || img.code_pages || (img.data.size() < E32_COMPRESSION_TYPE_OFFSET + sizeof(std::uint32_t))) {
+            return false;
+        }
+
+        codeseg_cache_image_header header;
+        header.magic_ = CODESEG_CACHE_IMAGE_MAGIC;
+        header.version_ = CODESEG_CACHE_VERSION;
+        header.image_key_ = image_key;
+        header.data_size_ = img.data.size();
+
+        // The data is already decompressed, mark it so in the cached copy
+        std::uint8_t header_part[E32_COMPRESSION_TYPE_OFFSET + sizeof(std::uint32_t)];
+        std::memcpy(header_part, img.data.data(), E32_COMPRESSION_TYPE_OFFSET);
+        std::memset(header_part + E32_COMPRESSION_TYPE_OFFSET, 0, sizeof(std::uint32_t));
+
+        const std::uint8_t *parts[2] = { header_part, reinterpret_cast<const std::uint8_t *>(img.data.data()) + sizeof(header_part) };
+        const std::size_t part_sizes[2] = { sizeof(header_part), img.data.size() - sizeof(header_part) };
+
+        return write_cache_file(image_path(image_key), &header, sizeof(header), parts, part_sizes, 2);
+    }
+
+    bool codeseg_cache::load_relocated(const std::uint64_t image_key, const std::uint64_t relocation_key, std::uint8_t *code,
+        const std::uint32_t code_size, std::uint8_t *data, const std::uint32_t data_size) {
+        if (!enabled()) {
+            return false;
+        }
+
+        const std::string path = relocation_path(image_key, relocation_key);
+        const std::int64_t file_size = common::exists(path) ? common::file_size(path) : 0;
+        const std::int64_t expected_size = sizeof(codeseg_cache_relocation_header) + static_cast<std::int64_t>(code_size) + data_size;
+
+        std::uint8_t *map = nullptr;
+
+        if (file_size == expected_size) {
+            map = reinterpret_cast<std::uint8_t *>(common::map_file(path, prot_read));
+        }
+
+        if (!map) {
+            stats_.relocation_misses_++;
+            return false;
+        }
+
+        codeseg_cache_relocation_header header;
+        std::memcpy(&header, map, sizeof(header));
+
+        const bool valid = (header.magic_ == CODESEG_CACHE_RELOCATION_MAGIC) && (header.version_ == CODESEG_CACHE_VERSION)
+            && (header.image_key_ == image_key) && (header.relocation_key_ == relocation_key)
+            && (header.code_size_ == code_size) && (header.data_size_ == data_size);
+
+        if (valid) {
+            std::memcpy(code, map + sizeof(header), code_size);
+
+            if (data_size) {
+                std::memcpy(data, map + sizeof(header) + code_size, data_size);
+            }
+        }
+
+        common::unmap_file(map, static_cast<std::size_t>(file_size));
+
+        if (valid) {
+            stats_.relocation_hits_++;
+        } else {
+            stats_.relocation_misses_++;
+        }
+
+        return valid;
+    }
+
+    bool codeseg_cache::store_relocated(const std::uint64_t image_key, const std::uint64_t relocation_key, const std::uint8_t *code,
+        const std::uint32_t code_size, const std::uint8_t *data, const std::uint32_t data_size) {
+        if (!enabled()) {
+            return false;
+        }
+
+        codeseg_cache_relocation_header header;
+        header.magic_ = CODESEG_CACHE_RELOCATION_MAGIC;
+        header.version_ = CODESEG_CACHE_VERSION;
+        header.image_key_ = image_key;
+        header.relocation_key_ = relocation_key;
+        header.code_size_ = code_size;
+        header.data_size_ = data_size;
+
+        const std::uint8_t *parts[2] = { code, data };
+        const std::size_t part_sizes[2] = { code_size, data_size };
+
+        return write_cache_file(relocation_path(image_key, relocation_key), &header, sizeof(header), parts, part_sizes, 2);
+    }
+}
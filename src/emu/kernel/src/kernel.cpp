@@ -327,6 +327,25 @@ namespace eka2l1 {
             }
         }
 
+        if (page_in_code(crr_process(), occurred)) {
+            return true;
+        }
+
+        return false;
+    }
+
+    bool kernel_system::page_in_code(kernel::process *pr, const address addr) {
+        // No code is left paged out otherwise, don't scan every codeseg on each miss
+        if (!conf_ || !conf_->demand_page_code) {
+            return false;
+        }
+
+        for (auto &seg : codesegs_) {
+            if (seg && reinterpret_cast<kernel::codeseg *>(seg.get())->page_in(pr, addr)) {
+                return true;
+            }
+        }
+
         return false;
     }
 
@@ -439,6 +458,30 @@ namespace eka2l1 {
 
     void kernel_system::install_memory(memory_system *new_mem) {
         mem_ = new_mem;
+
+        if (!conf_ || !conf_->demand_page_code) {
+            mem_->set_page_fault_handler(nullptr);
+            return;
+        }
+
+        mem_->set_page_fault_handler([this](const address addr, const mem::asid optional_asid) {
+            kernel::process *pr = crr_process();
+
+            if (optional_asid >= 0) {
+                pr = nullptr;
+
+                for (auto &pr_obj : processes_) {
+                    kernel::process *target = reinterpret_cast<kernel::process *>(pr_obj.get());
+
+                    if (target && (target->get_mem_model()->address_space_id() == optional_asid)) {
+                        pr = target;
+                        break;
+                    }
+                }
+            }
+
+            return page_in_code(pr, addr);
+        });
     }
 
     // For user-provided EPOC version
@@ -41,9 +41,11 @@
 #include <vfs/vfs.h>
 
 #include <kernel/codeseg.h>
+#include <kernel/codeseg_cache.h>
 #include <kernel/kernel.h>
 
 #include <cctype>
+#include <chrono>
 
 namespace eka2l1::hle {
     // Given relocation entries, relocate the code and data
@@ -240,6 +242,10 @@ namespace eka2l1::hle {
 
         if (force_code_addr != 0) {
             info.code_load_addr = force_code_addr;
+        } else {
+            info.code_pages = img->code_pages;
+            info.cache = mngr.get_codeseg_cache();
+            info.cache_image_key = mngr.get_image_cache_key(path);
         }
 
         codeseg_ptr cs = kern->create<kernel::codeseg>(get_e32_codeseg_name_from_path(path), info);
@@ -277,7 +283,7 @@ namespace eka2l1::hle {
         bool resolve_to_trampoline_map = false;
 
         // Quick check if the size is overlapped
-        std::vector<std::uint32_t> export_tables = dest_seg->get_export_table_raw();
+        const std::vector<std::uint32_t> &export_tables = dest_seg->get_export_table_raw();
         auto will_current_export_resolve_to_trampoline_map = [&](const std::size_t index) -> bool {
             if (export_tables[index] > dest_ptr) {
                 if (((dest_ptr & 1) && ((export_tables[index] & ~1) - (dest_ptr & ~1) < sizeof(THUMB_TRAMPOLINE_ASM))) ||
@@ -816,9 +822,7 @@ namespace eka2l1::hle {
                     return result;
                 }
 
-                eka2l1::ro_file_stream image_data_stream(f.get());
-
-                auto parse_result = loader::parse_e32img(reinterpret_cast<common::ro_stream *>(&image_data_stream));
+                auto parse_result = parse_e32img_file(f.get(), path);
                 if (parse_result != std::nullopt) {
                     f->close();
                     result.first = std::move(parse_result);
@@ -826,16 +830,19 @@ namespace eka2l1::hle {
                     return result;
                 }
 
-                image_data_stream.seek(0, common::seek_where::beg);
-                auto parse_result_2 = loader::parse_romimg(reinterpret_cast<common::ro_stream *>(&image_data_stream), mem_, kern_->get_epoc_version());
-                if (parse_result_2 != std::nullopt) {
-                    f->close();
-                    result.second = std::move(parse_result_2);
+                {
+                    // The stream puts the file cursor back when it goes, so it must go before the file is closed
+                    f->seek(0, file_seek_mode::beg);
+                    eka2l1::ro_file_stream image_data_stream(f.get());
 
-                    return result;
+                    result.second = loader::parse_romimg(reinterpret_cast<common::ro_stream *>(&image_data_stream), mem_, kern_->get_epoc_version());
                 }
 
                 f->close();
+
+                if (result.second) {
+                    return result;
+                }
             }
 
             return std::pair<std::optional<loader::e32img>, std::optional<loader::romimg>>{};
@@ -899,7 +906,12 @@ namespace eka2l1::hle {
 
                 return load_as_romimg(*romimg, lib_path);
             } else {
-                auto e32img = loader::parse_e32img(reinterpret_cast<common::ro_stream *>(&image_data_stream));
+                if (auto seg = kern_->get_by_name<kernel::codeseg>(get_e32_codeseg_name_from_path(lib_path))) {
+                    // Already loaded, no need to parse it again
+                    return seg;
+                }
+
+                auto e32img = parse_e32img_file(f.get(), lib_path);
                 if (!e32img) {
                     return nullptr;
                 }
@@ -1222,12 +1234,51 @@ namespace eka2l1::hle {
             // Circumvent ROM vs ROFS issue at the moment.
             additional_mode_ = PREFER_PHYSICAL;
         }
+
+        codeseg_cache_ = std::make_unique<kernel::codeseg_cache>(kern_->get_config()->enable_codeseg_cache ? "cache/codesegs/" : "");
     }
 
     lib_manager::~lib_manager() {
         svc_funcs_.clear();
     }
 
+    std::optional<loader::e32img> lib_manager::parse_e32img_file(file *f, const std::u16string &path) {
+        const auto parse_start = std::chrono::steady_clock::now();
+        const bool demand_page = kern_->get_config()->demand_page_code;
+
+        std::optional<loader::e32img> img = std::nullopt;
+        std::uint64_t image_key = 0;
+
+        // Demand paged images need their code kept compressed, which the cache does not keep
+        if (codeseg_cache_->enabled() && !demand_page && !f->is_in_rom()) {
+            image_key = kernel::codeseg_cache::make_image_key(path, f->size(), f->last_modify_since_0ad());
+            img = codeseg_cache_->load_image(image_key);
+        }
+
+        if (!img) {
+            eka2l1::ro_file_stream image_data_stream(f);
+            img = loader::parse_e32img(reinterpret_cast<common::ro_stream *>(&image_data_stream), true, demand_page);
+
+            if (img && image_key) {
+                codeseg_cache_->store_image(image_key, *img);
+            }
+        }
+
+        if (img && image_key) {
+            image_cache_keys_[common::lowercase_ucs2_string(path)] = image_key;
+        }
+
+        codeseg_cache_->get_stats().image_load_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - parse_start).count();
+
+        return img;
+    }
+
+    std::uint64_t lib_manager::get_image_cache_key(const std::u16string &path) const {
+        auto ite = image_cache_keys_.find(common::lowercase_ucs2_string(path));
+        return (ite == image_cache_keys_.end()) ? 0 : ite->second;
+    }
+
     system *lib_manager::get_sys() {
         return kern_->get_system();
     }
@@ -63,6 +63,10 @@ namespace eka2l1 {
         }
 
         void mutex::wait() {
+            if (acquire_hook) {
+                acquire_hook();
+            }
+
             if (!holding) {
                 holding = kern->crr_thread();
 
@@ -90,6 +94,10 @@ namespace eka2l1 {
         }
 
         void mutex::try_wait() {
+            if (acquire_hook) {
+                acquire_hook();
+            }
+
             if (!holding) {
                 holding = kern->crr_thread();
 
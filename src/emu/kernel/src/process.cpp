@@ -34,6 +34,8 @@
 #include <mem/mmu.h>
 #include <mem/process.h>
 
+#include <chrono>
+
 namespace eka2l1::kernel {
     std::int32_t process::refresh_generation() {
         if (flags & FLAG_KERNEL_PROCESS) {
@@ -82,6 +84,8 @@ namespace eka2l1::kernel {
             return;
         }
 
+        const auto create_start = std::chrono::steady_clock::now();
+
         codeseg = std::move(arg_codeseg);
         uids = codeseg->get_uids();
 
@@ -91,6 +95,8 @@ namespace eka2l1::kernel {
 
         codeseg->attached_report(this);
 
+        const auto attach_end = std::chrono::steady_clock::now();
+
         // Get security info
         sec_info = codeseg->get_sec_info();
         priority = pri;
@@ -117,6 +123,12 @@ namespace eka2l1::kernel {
 
         reload_compat_setting();
 
+        const auto create_end = std::chrono::steady_clock::now();
+
+        LOG_INFO(KERNEL, "Process {} created in {} us, {} us of that attaching codesegs", process_name,
+            std::chrono::duration_cast<std::chrono::microseconds>(create_end - create_start).count(),
+            std::chrono::duration_cast<std::chrono::microseconds>(attach_end - create_start).count());
+
         // TODO: Load all references DLL in the export list.
     }
 
@@ -451,7 +463,13 @@ namespace eka2l1::kernel {
     }
 
     void *process::get_ptr_on_addr_space(address addr) {
-        return mem->get_control()->get_host_pointer(mm_impl_->address_space_id(), addr);
+        void *result = mem->get_control()->get_host_pointer(mm_impl_->address_space_id(), addr);
+
+        if (!result && kern->page_in_code(this, addr)) {
+            result = mem->get_control()->get_host_pointer(mm_impl_->address_space_id(), addr);
+        }
+
+        return result;
     }
 
     // EKA2L1 doesn't use multicore yet, so rendezvous and logon
@@ -35,6 +35,7 @@ namespace eka2l1 {
 
     namespace common {
         class ro_stream;
+        class bytepair_pages;
     }
 
     /*! \brief Contains the loader for E32Image, ROMImage, SIS. */
@@ -192,6 +193,14 @@ namespace eka2l1 {
             bool has_extended_header = false;
 
             std::vector<std::string> dll_names;
+
+            /**
+             * @brief Compressed code pages, when the code is demand paged.
+             *
+             * Only the code pages the loader reads itself (the export directory, the import address table and
+             * the import fixups) are decompressed into data. The rest is left for whoever maps the code.
+             */
+            std::shared_ptr<common::bytepair_pages> code_pages;
         };
 
         /**
@@ -211,12 +220,16 @@ namespace eka2l1 {
         /**
          * @brief Parse an E32 Image from stream.
          * 
-         * @param stream     The stream to parse from.
-         * @param read_reloc If this is true, relocation section will be parsed.
+         * Bytepair compressed pages are decompressed in parallel on the shared thread pool.
+         *
+         * @param stream            The stream to parse from.
+         * @param read_reloc        If this is true, relocation section will be parsed.
+         * @param demand_page_code  If this is true and the image is bytepair compressed, code pages are kept
+         *                          compressed in code_pages instead.
          * 
          * @returns An optional contains E32 Image. Nullopt if invalid.
          */
-        std::optional<e32img> parse_e32img(common::ro_stream *stream, bool read_reloc = true);
+        std::optional<e32img> parse_e32img(common::ro_stream *stream, bool read_reloc = true, const bool demand_page_code = false);
 
         /**
          * @brief Check if the stream content is E32 Image.
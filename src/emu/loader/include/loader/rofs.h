@@ -24,6 +24,7 @@
 #include <atomic>
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace eka2l1::common {
@@ -78,5 +79,92 @@ namespace eka2l1::loader {
         bool read(common::ro_stream &stream, const int version);
     };
 
+    struct rofs_index_entry {
+        std::u16string name_;
+        std::uint32_t uids_[3]; ///< Only valid if has_uids_ is set
+        std::uint32_t offset_; ///< Offset of the file data in its image
+        std::uint32_t size_;
+        std::uint8_t att_;
+        std::uint8_t image_; ///< Index of the image the data lives in, in the order images were added
+        bool dir_;
+        bool has_uids_;
+        std::vector<std::uint32_t> children_;
+    };
+
+    /**
+     * @brief Flat, hashed index of the directory trees of one or more ROFS images.
+     *
+     * Entries are looked up by their case-insensitive path in constant time. Images added later
+     * overlay the earlier ones: a file with the same path replaces the previous entry, and directories
+     * with the same path merge their children.
+     *
+     * The index only records offsets, the image data is never copied.
+     */
+    class rofs_index {
+        std::vector<rofs_index_entry> entries_;
+        std::unordered_map<std::u16string, std::uint32_t> lookup_;
+        std::vector<std::uint64_t> image_times_;
+
+        std::uint32_t add_entry(const std::uint32_t parent, const std::u16string &parent_key, rofs_index_entry &entry);
+        bool add_directory(common::ro_stream &stream, const int version, const std::int64_t file_offset, const std::uint32_t offset,
+            const std::uint32_t dir_index, const std::u16string &dir_key, const std::uint8_t image, const int depth);
+
+    public:
+        explicit rofs_index();
+
+        /**
+         * @brief Index the directory tree of a ROFS image on top of the current entries.
+         *
+         * @param data      Pointer to the start of the image.
+         * @param size      Size of the image.
+         *
+         * @returns True on success. On failure, entries added before the error are kept.
+         */
+        bool add_image(const std::uint8_t *data, const std::size_t size);
+
+        /**
+         * @brief Find an entry with a path.
+         *
+         * The drive letter is ignored, and both separators are accepted.
+         *
+         * @returns Pointer to the entry, or nullptr if it does not exist.
+         */
+        const rofs_index_entry *find(const std::u16string &path) const;
+
+        const rofs_index_entry &get(const std::uint32_t index) const {
+            return entries_[index];
+        }
+
+        const rofs_index_entry &root() const {
+            return entries_[0];
+        }
+
+        std::size_t entry_count() const {
+            return entries_.size();
+        }
+
+        std::size_t image_count() const {
+            return image_times_.size();
+        }
+
+        std::uint64_t image_time(const std::uint8_t image) const {
+            return image_times_[image];
+        }
+
+        static std::u16string make_key(const std::u16string &path);
+    };
+
     bool dump_rofs_system(common::ro_stream &stream, const std::string &path, progress_changed_callback progress_cb, cancel_requested_callback cancel_cb);
+
+    /**
+     * @brief Get the file name a ROFS image of a layer is stored with, next to the ROM.
+     *
+     * @param layer     The layer, starting from 1. Higher layers overlay lower ones.
+     */
+    std::string get_rofs_image_name(const std::size_t layer);
+
+    /**
+     * @brief List the ROFS images stored in a folder, ordered from the lowest layer to the highest.
+     */
+    std::vector<std::string> find_rofs_images(const std::string &folder);
 }
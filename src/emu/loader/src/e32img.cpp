@@ -29,6 +29,7 @@
 #include <common/crypt.h>
 #include <common/flate.h>
 #include <common/log.h>
+#include <common/thread_pool.h>
 
 #include <utils/err.h>
 
@@ -316,7 +317,23 @@ namespace eka2l1::loader {
         return epoc::error_none;
     }
 
-    std::optional<e32img> parse_e32img(common::ro_stream *stream, bool read_reloc) {
+    // Decompress the compressed code pages covering a range of the code section into the image data
+    static void page_in_code(e32img &img, std::vector<bool> &paged_in, const std::uint32_t offset, const std::uint32_t size) {
+        if (!img.code_pages || (size == 0) || (offset >= img.header.code_size)) {
+            return;
+        }
+
+        const std::uint32_t last = common::min(offset + size, img.header.code_size) - 1;
+
+        for (std::uint32_t page = offset / common::BYTEPAIR_PAGE_SIZE; page <= last / common::BYTEPAIR_PAGE_SIZE; page++) {
+            if ((page < paged_in.size()) && !paged_in[page]) {
+                img.code_pages->decompress_page(&img.data[img.header.code_offset + page * common::BYTEPAIR_PAGE_SIZE], page);
+                paged_in[page] = true;
+            }
+        }
+    }
+
+    std::optional<e32img> parse_e32img(common::ro_stream *stream, bool read_reloc, const bool demand_page_code) {
         if (!stream) {
             return std::nullopt;
         }
@@ -376,8 +393,20 @@ namespace eka2l1::loader {
                 common::ro_buf_stream raw_bp_stream(reinterpret_cast<std::uint8_t *>(&temp[0]), temp.size());
                 common::ibytepair_stream bpstream(reinterpret_cast<common::ro_stream *>(&raw_bp_stream));
 
-                auto codesize = bpstream.read_pages(&img.data[img.header.code_offset], img.header.code_size);
-                auto restsize = bpstream.read_pages(&img.data[img.header.code_offset + img.header.code_size], img.uncompressed_size);
+                common::thread_pool *pool = &common::get_shared_thread_pool();
+
+                if (demand_page_code) {
+                    img.code_pages = std::make_shared<common::bytepair_pages>();
+
+                    if (!bpstream.read_compressed_pages(*img.code_pages)) {
+                        return std::nullopt;
+                    }
+                } else {
+                    bpstream.read_pages(&img.data[img.header.code_offset], img.header.code_size, pool);
+                }
+
+                bpstream.read_pages(&img.data[img.header.code_offset + img.header.code_size],
+                    img.uncompressed_size - img.header.code_size, pool);
             }
         } else {
             img.uncompressed_size = static_cast<uint32_t>(file_size);
@@ -388,6 +417,13 @@ namespace eka2l1::loader {
         }
 
         const std::uint32_t import_export_table_size = img.header.code_size - img.header.text_size;
+        std::vector<bool> paged_in(img.code_pages ? img.code_pages->page_count() : 0, false);
+
+        if (img.code_pages) {
+            page_in_code(img, paged_in, img.header.text_size, import_export_table_size);
+            page_in_code(img, paged_in, img.header.export_dir_offset - img.header.code_offset,
+                img.header.export_dir_count * sizeof(std::uint32_t));
+        }
 
         parse_export_dir(img);
         parse_iat(img);
@@ -432,6 +468,13 @@ namespace eka2l1::loader {
             for (auto &oridinal : import.ordinals) {
                 decompressed_stream.read(reinterpret_cast<void *>(&oridinal), 4);
             }
+
+            if (img.epoc_ver >= epocver::eka2) {
+                // The fixups are read from the code
+                for (const auto oridinal : import.ordinals) {
+                    page_in_code(img, paged_in, oridinal, sizeof(std::uint32_t));
+                }
+            }
         }
 
         if (read_reloc) {
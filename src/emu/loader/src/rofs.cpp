@@ -17,6 +17,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <common/algorithm.h>
 #include <common/buffer.h>
 #include <common/fileutils.h>
 #include <common/log.h>
@@ -25,6 +26,11 @@
 
 #include <common/cvt.h>
 
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+
 namespace eka2l1::loader {
     bool rofs_entry::read(common::ro_stream &stream, const int version) {
         const std::uint64_t start_pos = stream.tell();
@@ -250,4 +256,222 @@ namespace eka2l1::loader {
 
         return true;
     }
+
+    // Deeper than any sane image, only here so a corrupted tree can't loop forever
+    static constexpr int ROFS_INDEX_MAX_DEPTH = 64;
+
+    static std::u16string rofs_index_child_key(const std::u16string &parent_key, const std::u16string &name) {
+        const std::u16string name_lower = common::lowercase_ucs2_string(name);
+        return parent_key.empty() ? name_lower : (parent_key + u'\\' + name_lower);
+    }
+
+    rofs_index::rofs_index() {
+        rofs_index_entry root_entry;
+        root_entry.uids_[0] = root_entry.uids_[1] = root_entry.uids_[2] = 0;
+        root_entry.offset_ = 0;
+        root_entry.size_ = 0;
+        root_entry.att_ = 0x10;
+        root_entry.image_ = 0;
+        root_entry.dir_ = true;
+        root_entry.has_uids_ = false;
+
+        entries_.push_back(std::move(root_entry));
+        lookup_.emplace(u"", 0);
+    }
+
+    std::u16string rofs_index::make_key(const std::u16string &path) {
+        std::u16string key = path;
+
+        if ((key.length() >= 2) && (key[1] == u':')) {
+            key.erase(0, 2);
+        }
+
+        std::replace(key.begin(), key.end(), u'/', u'\\');
+        key = common::lowercase_ucs2_string(key);
+
+        const std::size_t first = key.find_first_not_of(u'\\');
+
+        if (first == std::u16string::npos) {
+            return u"";
+        }
+
+        const std::size_t last = key.find_last_not_of(u'\\');
+        return key.substr(first, last - first + 1);
+    }
+
+    std::uint32_t rofs_index::add_entry(const std::uint32_t parent, const std::u16string &parent_key, rofs_index_entry &entry) {
+        const std::u16string key = rofs_index_child_key(parent_key, entry.name_);
+        auto existing = lookup_.find(key);
+
+        if (existing != lookup_.end()) {
+            rofs_index_entry &old_entry = entries_[existing->second];
+
+            // Directories of upper layers merge with the lower ones, everything else is replaced
+            if (!(old_entry.dir_ && entry.dir_)) {
+                entry.children_ = std::move(old_entry.children_);
+                old_entry = std::move(entry);
+            }
+
+            return existing->second;
+        }
+
+        const std::uint32_t index = static_cast<std::uint32_t>(entries_.size());
+
+        entries_.push_back(std::move(entry));
+        entries_[parent].children_.push_back(index);
+        lookup_.emplace(key, index);
+
+        return index;
+    }
+
+    bool rofs_index::add_directory(common::ro_stream &stream, const int version, const std::int64_t file_offset, const std::uint32_t offset,
+        const std::uint32_t dir_index, const std::u16string &dir_key, const std::uint8_t image, const int depth) {
+        if ((depth > ROFS_INDEX_MAX_DEPTH) || (offset - file_offset < 0) || (offset - file_offset >= static_cast<std::int64_t>(stream.size()))) {
+            return false;
+        }
+
+        stream.seek(offset - file_offset, common::seek_where::beg);
+
+        rofs_dir dir_var;
+        if (!dir_var.read(stream, version)) {
+            return false;
+        }
+
+        const std::int64_t file_block_pos = dir_var.file_block_addr_ - file_offset;
+
+        if ((dir_var.file_block_addr_ != 0) && (file_block_pos > 0)) {
+            stream.seek(file_block_pos, common::seek_where::beg);
+
+            while (stream.tell() - file_block_pos < dir_var.file_block_size_) {
+                rofs_entry file_entry;
+                if (!file_entry.read(stream, version)) {
+                    return false;
+                }
+
+                const std::int64_t data_pos = file_entry.file_addr_ - file_offset;
+
+                if ((data_pos < 0) || (data_pos + file_entry.file_size_ > static_cast<std::int64_t>(stream.size()))) {
+                    LOG_WARN(LOADER, "ROFS file {} lies outside of the image, skipping", common::ucs2_to_utf8(file_entry.filename_));
+                    continue;
+                }
+
+                rofs_index_entry entry;
+                entry.name_ = std::move(file_entry.filename_);
+                entry.offset_ = static_cast<std::uint32_t>(data_pos);
+                entry.size_ = file_entry.file_size_;
+                entry.att_ = file_entry.att_;
+                entry.image_ = image;
+                entry.dir_ = false;
+                entry.has_uids_ = (version >= ROFS_MODERN_VERSION);
+
+                if (entry.has_uids_) {
+                    std::memcpy(entry.uids_, file_entry.uids_, sizeof(entry.uids_));
+                } else {
+                    entry.uids_[0] = entry.uids_[1] = entry.uids_[2] = 0;
+                }
+
+                add_entry(dir_index, dir_key, entry);
+            }
+        }
+
+        for (auto &subdir_ent : dir_var.subdirs_) {
+            const std::u16string subdir_key = rofs_index_child_key(dir_key, subdir_ent.filename_);
+
+            rofs_index_entry entry;
+            entry.name_ = subdir_ent.filename_;
+            entry.uids_[0] = entry.uids_[1] = entry.uids_[2] = 0;
+            entry.offset_ = 0;
+            entry.size_ = 0;
+            entry.att_ = subdir_ent.att_;
+            entry.image_ = image;
+            entry.dir_ = true;
+            entry.has_uids_ = false;
+
+            const std::uint32_t subdir_index = add_entry(dir_index, dir_key, entry);
+
+            if (!add_directory(stream, version, file_offset, subdir_ent.file_addr_, subdir_index, subdir_key, image, depth + 1)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool rofs_index::add_image(const std::uint8_t *data, const std::size_t size) {
+        if ((size < sizeof(rofs_header)) || (image_times_.size() >= 0xFF)) {
+            return false;
+        }
+
+        rofs_header rheader;
+        std::memcpy(&rheader, data, sizeof(rofs_header));
+
+        if (!supported_format(rheader)) {
+            return false;
+        }
+
+        const std::uint8_t image = static_cast<std::uint8_t>(image_times_.size());
+        image_times_.push_back(rheader.time_);
+
+        common::ro_buf_stream stream(const_cast<std::uint8_t *>(data), size);
+        const std::int64_t file_offset = static_cast<std::int64_t>(rheader.dir_tree_offset_) - rheader.header_size_;
+
+        return add_directory(stream, rheader.rofs_format_version_, file_offset, rheader.dir_tree_offset_, 0, u"", image, 0);
+    }
+
+    const rofs_index_entry *rofs_index::find(const std::u16string &path) const {
+        auto result = lookup_.find(make_key(path));
+
+        if (result == lookup_.end()) {
+            return nullptr;
+        }
+
+        return &entries_[result->second];
+    }
+
+    std::string get_rofs_image_name(const std::size_t layer) {
+        return fmt::format("ROFS{}.IMG", layer);
+    }
+
+    std::vector<std::string> find_rofs_images(const std::string &folder) {
+        std::vector<std::pair<std::size_t, std::string>> images;
+        auto iterator = common::make_directory_iterator(folder);
+
+        if (!iterator) {
+            return {};
+        }
+
+        iterator->detail = true;
+        common::dir_entry entry;
+
+        while (iterator->next_entry(entry) == 0) {
+            if (entry.type != common::FILE_REGULAR) {
+                continue;
+            }
+
+            const std::string name_lower = common::lowercase_string(entry.name);
+
+            if ((name_lower.length() <= 8) || (name_lower.compare(0, 4, "rofs") != 0)
+                || (name_lower.compare(name_lower.length() - 4, 4, ".img") != 0)) {
+                continue;
+            }
+
+            const std::string layer_str = name_lower.substr(4, name_lower.length() - 8);
+
+            if (layer_str.find_first_not_of("0123456789") != std::string::npos) {
+                continue;
+            }
+
+            images.emplace_back(std::stoull(layer_str), eka2l1::add_path(folder, entry.name));
+        }
+
+        std::sort(images.begin(), images.end());
+
+        std::vector<std::string> result;
+
+        for (auto &image : images) {
+            result.push_back(std::move(image.second));
+        }
+
+        return result;
+    }
 }
@@ -49,6 +49,11 @@ namespace eka2l1 {
         struct state;
     }
 
+    /**
+     * @brief Called when a host pointer lookup misses. Returns true if the address is now accessible.
+     */
+    using page_fault_handler = std::function<bool(const address, const mem::asid)>;
+
     class memory_system {
         friend class system;
 
@@ -61,6 +66,8 @@ namespace eka2l1 {
         mem::vm_address rom_addr_;
         config::state *conf_;
 
+        page_fault_handler fault_handler_;
+
     public:
         explicit memory_system(arm::exclusive_monitor *monitor, config::state *conf,
             const mem::mem_model_type model_type, const bool mem_map_old);
@@ -80,6 +87,10 @@ namespace eka2l1 {
 
         void *get_real_pointer(const address addr, const mem::asid optional_asid = -1);
 
+        void set_page_fault_handler(page_fault_handler handler) {
+            fault_handler_ = handler;
+        }
+
         bool read(const address addr, void *data, std::uint32_t size);
         bool write(const address addr, void *data, std::uint32_t size);
 
@@ -55,7 +55,13 @@ namespace eka2l1 {
             return nullptr;
         }
 
-        return impl_->get_host_pointer(optional_asid, addr);
+        void *result = impl_->get_host_pointer(optional_asid, addr);
+
+        if (!result && fault_handler_ && fault_handler_(addr, optional_asid)) {
+            result = impl_->get_host_pointer(optional_asid, addr);
+        }
+
+        return result;
     }
 
     bool memory_system::read(const address addr, void *data, uint32_t size) {
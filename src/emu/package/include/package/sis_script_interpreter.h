@@ -24,6 +24,7 @@
 
 #include <atomic>
 #include <functional>
+#include <mutex>
 #include <stack>
 #include <string>
 #include <vector>
@@ -69,6 +70,8 @@ namespace eka2l1 {
                 std::string file_path_;
                 std::uint32_t data_unit_index_;
                 std::uint16_t data_unit_block_index_;
+                std::uint64_t uncompressed_size_;
+                bool superseded_ = false;       ///< A later target writes the same file.
             };
 
             std::vector<extract_target_info> extract_targets;
@@ -78,8 +81,12 @@ namespace eka2l1 {
             progress_changed_callback progress_changed_cb;
             cancel_requested_callback cancel_cb;
 
+            std::mutex progress_lock;               ///< Serializes progress and cancel callbacks of extraction workers.
+            std::atomic<bool> extract_aborted{ false };
+
             drive_number install_drive;
             common::ro_stream *data_stream;
+            std::mutex data_stream_lock;            ///< Extraction workers share the SIS stream.
 
             io_system *io;
             manager::packages *mngr;
@@ -100,6 +107,17 @@ namespace eka2l1 {
              */
             int gasp_true_form_of_integral_expression(const sis_expression &expr);
 
+            /**
+             * \brief Mark targets overwritten by later ones, and create the folders of the rest.
+             */
+            void prepare_extract_targets();
+
+            /**
+             * \brief Add extracted bytes to the progress, and ask if the installation should go on.
+             * \returns False if the installation has been canceled.
+             */
+            bool report_extract_progress(const std::size_t extracted);
+
         protected:
             bool interpret(sis_install_block &install_block, sis_registry_tree &parent_tree, std::uint16_t crr_blck_idx = 0);
             bool interpret(sis_controller *controller, sis_registry_tree &tree, const std::uint16_t base_data_idx);
@@ -122,7 +140,8 @@ namespace eka2l1 {
             /**
              * \brief Get the data in the index of a buffer block in the SIS, write it to a physical file.
              * 
-             * Usually uses for extracting large app data.
+             * Usually uses for extracting large app data. The data is inflated straight to the file through
+             * fixed size buffers. Safe to call for several files at once; the file's folder must exist.
              * 
              * \param path          UTF-8 path to the physical file.
              * \param data_idx      The index of the source buffer in block buffer.
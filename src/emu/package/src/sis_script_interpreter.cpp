@@ -28,6 +28,7 @@
 #include <common/time.h>
 #include <common/types.h>
 #include <common/platform.h>
+#include <common/thread_pool.h>
 
 #include <config/config.h>
 #include <vfs/vfs.h>
@@ -38,7 +39,8 @@
 #include <package/manager.h>
 #include <package/sis_script_interpreter.h>
 
-#include <miniz.h>
+#include <mutex>
+#include <set>
 
 namespace eka2l1 {
     namespace loader {
@@ -82,38 +84,88 @@ namespace eka2l1 {
             , mngr(mngr) {
         }
 
-        std::vector<uint8_t> ss_interpreter::get_small_file_buf(uint32_t data_idx, uint16_t crr_blck_idx) {
-            sis_file_data *data = reinterpret_cast<sis_file_data *>(
-                reinterpret_cast<sis_data_unit *>(install_data->data_units.fields[crr_blck_idx].get())->data_unit.fields[data_idx].get());
-            sis_compressed compressed = data->raw_data;
+        // Input chunk for stored (not deflated) files
+        static constexpr std::size_t SIS_STORED_CHUNK_SIZE = 0x10000;
+
+        // Stream the content of a compressed field to a writer, a bounded chunk at a time. The source is
+        // shared by all extraction workers, so every read seeks to its own offset under the lock.
+        static bool read_sis_compressed(common::ro_stream *source, std::mutex &source_lock, const sis_compressed &compressed,
+            const flate::stream_write_func &writer, std::uint64_t *out_size = nullptr) {
+            std::uint64_t offset = compressed.offset;
+            std::uint64_t left = ((compressed.len_low) | (static_cast<std::uint64_t>(compressed.len_high) << 32)) - 12;
+            bool truncated = false;
+
+            const flate::stream_read_func reader = [&](std::uint8_t *buf, const std::size_t size) -> std::size_t {
+                const std::size_t grab = static_cast<std::size_t>(common::min<std::uint64_t>(left, size));
 
-            std::uint64_t us = ((compressed.len_low) | (static_cast<uint64_t>(compressed.len_high) << 32)) - 12;
+                if (grab == 0) {
+                    return 0;
+                }
+
+                std::uint64_t read = 0;
+
+                {
+                    const std::lock_guard<std::mutex> guard(source_lock);
 
-            compressed.compressed_data.resize(us);
+                    source->seek(static_cast<std::int64_t>(offset), common::seek_where::beg);
+                    read = source->read(buf, grab);
+                }
+
+                if (read != grab) {
+                    LOG_ERROR(PACKAGE, "Stream fail, SIS data at offset {} is truncated", offset);
+                    truncated = true;
 
-            data_stream->seek(compressed.offset, common::seek_where::beg);
-            data_stream->read(&compressed.compressed_data[0], us);
+                    return 0;
+                }
 
-            if (compressed.algorithm == sis_compressed_algorithm::none) {
-                return compressed.compressed_data;
+                offset += grab;
+                left -= grab;
+
+                return grab;
+            };
+
+            if (compressed.algorithm == sis_compressed_algorithm::deflated) {
+                return flate::inflate_stream(reader, writer, out_size) && !truncated;
             }
 
-            compressed.uncompressed_data.resize(compressed.uncompressed_size);
-            mz_stream stream;
+            std::vector<std::uint8_t> chunk(SIS_STORED_CHUNK_SIZE);
+            std::uint64_t total = 0;
 
-            stream.zalloc = nullptr;
-            stream.zfree = nullptr;
+            while (left > 0) {
+                const std::size_t grabbed = reader(chunk.data(), chunk.size());
+
+                if ((grabbed == 0) || !writer(chunk.data(), grabbed)) {
+                    return false;
+                }
 
-            if (inflateInit(&stream) != MZ_OK) {
-                LOG_ERROR(PACKAGE, "Can not intialize inflate stream");
+                total += grabbed;
             }
 
-            flate::inflate_data(&stream, compressed.compressed_data.data(),
-                compressed.uncompressed_data.data(), static_cast<std::uint32_t>(us));
+            if (out_size) {
+                *out_size = total;
+            }
+
+            return true;
+        }
+
+        std::vector<uint8_t> ss_interpreter::get_small_file_buf(uint32_t data_idx, uint16_t crr_blck_idx) {
+            sis_file_data *data = reinterpret_cast<sis_file_data *>(
+                reinterpret_cast<sis_data_unit *>(install_data->data_units.fields[crr_blck_idx].get())->data_unit.fields[data_idx].get());
+            const sis_compressed &compressed = data->raw_data;
+
+            std::vector<uint8_t> buf;
+            buf.reserve(static_cast<std::size_t>(compressed.uncompressed_size));
+
+            const bool result = read_sis_compressed(data_stream, data_stream_lock, compressed, [&](const std::uint8_t *piece, const std::size_t size) {
+                buf.insert(buf.end(), piece, piece + size);
+                return true;
+            });
 
-            inflateEnd(&stream);
+            if (!result) {
+                LOG_ERROR(PACKAGE, "Fail to read file data {} of block {}", data_idx, crr_blck_idx);
+            }
 
-            return compressed.uncompressed_data;
+            return buf;
         }
 
         // Assuming this file is small since it's stored in std::vector
@@ -128,114 +180,93 @@ namespace eka2l1 {
             stream.write(data.data(), data.size());
         }
 
-        bool ss_interpreter::extract_file(const std::string &path, const uint32_t idx, uint16_t crr_blck_idx) {
-            std::string rp = eka2l1::file_directory(path);
-            common::create_directories(rp);
+        bool ss_interpreter::report_extract_progress(const std::size_t extracted) {
+            const std::lock_guard<std::mutex> guard(progress_lock);
 
-            // Delete the file, starts over
-            if (common::is_system_case_insensitive() && common::exists(path)) {
-                if (!common::remove(path)) {
-                    LOG_WARN(PACKAGE, "Unable to remove {} to extract new file", path);
-                }
+            if (extract_aborted) {
+                return false;
             }
 
-            sis_data_unit *data_unit = reinterpret_cast<sis_data_unit *>(install_data->data_units.fields[crr_blck_idx].get());
-
-            if (data_unit->data_unit.fields.empty()) {
-                // Stub sis without file data
-                return true;
+            if (cancel_cb && cancel_cb()) {
+                extract_aborted = true;
+                return false;
             }
 
-            sis_file_data *data = reinterpret_cast<sis_file_data *>(data_unit->data_unit.fields[idx].get());
+            extract_target_decomped_size += extracted;
 
-            sis_compressed compressed = data->raw_data;
+            if (progress_changed_cb) {
+                if (extract_target_accumulated_size != 0) {
+                    progress_changed_cb(extract_target_decomped_size, extract_target_accumulated_size);
+                } else {
+                    progress_changed_cb(100, 100);
+                }
+            }
 
-            std::uint64_t left = ((compressed.len_low) | (static_cast<std::uint64_t>(compressed.len_high) << 32)) - 12;
-            data_stream->seek(compressed.offset, common::seek_where::beg);
+            return true;
+        }
 
-            std::vector<unsigned char> temp_chunk;
-            temp_chunk.resize(CHUNK_SIZE);
+        void ss_interpreter::prepare_extract_targets() {
+            std::set<std::string> seen_paths;
 
-            std::vector<unsigned char> temp_inflated_chunk;
-            temp_inflated_chunk.resize(CHUNK_MAX_INFLATED_SIZE);
+            // The last file written to a path wins, as when they were extracted one by one
+            for (auto ite = extract_targets.rbegin(); ite != extract_targets.rend(); ite++) {
+                if (!seen_paths.insert(common::lowercase_string(ite->file_path_)).second) {
+                    ite->superseded_ = true;
+                    extract_target_accumulated_size -= static_cast<std::size_t>(ite->uncompressed_size_);
 
-            mz_stream stream;
+                    continue;
+                }
 
-            stream.zalloc = nullptr;
-            stream.zfree = nullptr;
+                common::create_directories(eka2l1::file_directory(ite->file_path_));
 
-            if (compressed.algorithm == sis_compressed_algorithm::deflated) {
-                if (inflateInit(&stream) != MZ_OK) {
-                    LOG_ERROR(PACKAGE, "Can not intialize inflate stream");
+                // Delete the file, starts over
+                if (common::is_system_case_insensitive() && common::exists(ite->file_path_)) {
+                    if (!common::remove(ite->file_path_)) {
+                        LOG_WARN(PACKAGE, "Unable to remove {} to extract new file", ite->file_path_);
+                    }
                 }
             }
+        }
 
-            std::uint32_t total_inflated_size = 0;
-            bool cancel_requested = false;
+        bool ss_interpreter::extract_file(const std::string &path, const uint32_t idx, uint16_t crr_blck_idx) {
+            sis_data_unit *data_unit = reinterpret_cast<sis_data_unit *>(install_data->data_units.fields[crr_blck_idx].get());
 
-            {
-                common::wo_std_file_stream std_fstream(path, true);
+            if (data_unit->data_unit.fields.empty()) {
+                // Stub sis without file data
+                return true;
+            }
 
-                while (left > 0) {
-                    if (cancel_cb && cancel_cb()) {
-                        cancel_requested = true;
-                        break;
-                    }
+            sis_file_data *data = reinterpret_cast<sis_file_data *>(data_unit->data_unit.fields[idx].get());
+            const sis_compressed &compressed = data->raw_data;
 
-                    std::fill(temp_chunk.begin(), temp_chunk.end(), 0);
-                    int grab = static_cast<int>(left < CHUNK_SIZE ? left : CHUNK_SIZE);
+            std::uint64_t total_size = 0;
+            bool result = false;
 
-                    data_stream->read(&temp_chunk[0], grab);
+            {
+                common::wo_std_file_stream std_fstream(path, true);
 
-                    if (!data_stream->valid()) {
-                        LOG_ERROR(PACKAGE, "Stream fail, skipping this file, should report to developers.");
+                result = read_sis_compressed(data_stream, data_stream_lock, compressed, [&](const std::uint8_t *piece, const std::size_t size) {
+                    if (std_fstream.write(piece, size) != size) {
+                        LOG_ERROR(PACKAGE, "Unable to write to {}", path);
                         return false;
                     }
 
-                    if (compressed.algorithm == sis_compressed_algorithm::deflated) {
-                        uint32_t inflated_size = 0;
-
-                        auto res = flate::inflate_data(&stream, temp_chunk.data(), temp_inflated_chunk.data(), grab, &inflated_size);
-
-                        if (!res) {
-                            LOG_ERROR(PACKAGE, "Decompress failed! Report to developers");
-                            return false;
-                        }
-
-                        std_fstream.write(temp_inflated_chunk.data(), inflated_size);
-
-                        total_inflated_size += inflated_size;
-                        extract_target_decomped_size += inflated_size;
-                    } else {
-                        std_fstream.write(temp_chunk.data(), grab);
-                        extract_target_decomped_size += grab;
-                    }
-
-                    left -= grab;
+                    return report_extract_progress(size);
+                }, &total_size);
+            }
 
-                    if (progress_changed_cb) {
-                        if (extract_target_accumulated_size != 0) {
-                            progress_changed_cb(extract_target_decomped_size, extract_target_accumulated_size);
-                        } else {
-                            progress_changed_cb(100, 100);
-                        }
-                    }
+            if (!result) {
+                if (!extract_aborted) {
+                    LOG_ERROR(PACKAGE, "Fail to extract {}, should report to developers.", path);
                 }
 
-                if (compressed.algorithm == sis_compressed_algorithm::deflated) {
-                    if (!cancel_requested && (total_inflated_size != compressed.uncompressed_size)) {
-                        LOG_ERROR(PACKAGE, "Sanity check failed: Total inflated size not equal to specified uncompress size "
-                                           "in SISCompressed ({} vs {})!",
-                            total_inflated_size, compressed.uncompressed_size);
-                    }
-
-                    inflateEnd(&stream);
-                }
+                return false;
             }
 
-            if (cancel_requested) {
-                common::remove(path);
-                return false;
+            if ((compressed.algorithm == sis_compressed_algorithm::deflated) && (total_size != compressed.uncompressed_size)) {
+                LOG_ERROR(PACKAGE, "Sanity check failed: Total inflated size not equal to specified uncompress size "
+                                   "in SISCompressed ({} vs {})!",
+                    total_size, compressed.uncompressed_size);
             }
 
             return true;
@@ -612,6 +643,7 @@ namespace eka2l1 {
                             info.file_path_ = raw_path;
                             info.data_unit_block_index_ = file->idx;
                             info.data_unit_index_ = crr_blck_idx;
+                            info.uncompressed_size_ = file->uncompressed_len;
 
                             extract_targets.push_back(info);
                             extract_target_accumulated_size += file->uncompressed_len;
@@ -711,20 +743,33 @@ namespace eka2l1 {
                 if (cb)
                     cb(1, 1);
             } else {
-                std::size_t n = 0;
-                bool cancel_requested = false;
+                prepare_extract_targets();
 
-                for (; n < extract_targets.size(); n++) {
-                    extract_target_info &target = extract_targets[n];
-                    if (!extract_file(target.file_path_, target.data_unit_block_index_, target.data_unit_index_)) {
-                        cancel_requested = true;
-                        break;
+                extract_aborted = false;
+                std::vector<std::uint8_t> started(extract_targets.size(), 0);
+
+                // Files are independent, so inflate and write them on every core. Only reading the SIS is serialized.
+                common::get_shared_thread_pool().parallel_for(extract_targets.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+                    for (std::size_t i = begin; (i < end) && !extract_aborted; i++) {
+                        extract_target_info &target = extract_targets[i];
+
+                        if (target.superseded_) {
+                            continue;
+                        }
+
+                        started[i] = 1;
+
+                        if (!extract_file(target.file_path_, target.data_unit_block_index_, target.data_unit_index_)) {
+                            extract_aborted = true;
+                        }
                     }
-                }
+                });
 
-                if (cancel_requested) {
-                    for (std::size_t i = 0; i < n; i++) {
-                        common::remove(extract_targets[i].file_path_);
+                if (extract_aborted) {
+                    for (std::size_t i = 0; i < extract_targets.size(); i++) {
+                        if (started[i]) {
+                            common::remove(extract_targets[i].file_path_);
+                        }
                     }
 
                     return nullptr;
@@ -53,6 +53,14 @@ namespace eka2l1::epoc::adapter {
 
         virtual bool is_valid() = 0;
         virtual bool vectorizable() const = 0;
+
+        /**
+         * @brief Check if get_glyph_bitmap can be called from several threads at once.
+         */
+        virtual bool supports_concurrent_rasterization() const {
+            return false;
+        }
+
         virtual std::uint32_t line_gap(const std::size_t idx) {
             return 0;
         }
@@ -21,6 +21,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <common/container.h>
@@ -33,6 +34,7 @@ namespace eka2l1::epoc::adapter {
     private:
         std::vector<std::uint8_t> data_;
         std::map<int, stbtt_fontinfo> cache_info;
+        std::mutex cache_info_lock_;
 
         stbtt_fontinfo info_;
         common::identity_container<std::unique_ptr<stbtt_pack_context>> contexts_;
@@ -60,6 +62,10 @@ namespace eka2l1::epoc::adapter {
             return true;
         }
 
+        bool supports_concurrent_rasterization() const override {
+            return true;
+        }
+
         std::uint32_t line_gap(const std::size_t idx) override;
 
         bool get_face_attrib(const std::size_t idx, open_font_face_attrib &face_attrib) override;
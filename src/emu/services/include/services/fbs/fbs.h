@@ -30,6 +30,7 @@
 #include <services/fbs/font.h>
 #include <services/fbs/font_atlas.h>
 #include <services/fbs/font_store.h>
+#include <services/fbs/glyph_cache.h>
 #include <services/framework.h>
 #include <services/window/common.h>
 
@@ -40,6 +41,7 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <thread>
 #include <unordered_map>
@@ -239,7 +241,6 @@ namespace eka2l1 {
         epoc::open_font_info of_info;
         fbs_server *serv;
 
-        epoc::font_atlas atlas;
         std::vector<std::uint8_t*> shapings;
 
         explicit fbsfont()
@@ -326,6 +327,14 @@ namespace eka2l1 {
         explicit fbs_bitmap_data_info();
     };
 
+    // Bytes of glyph bitmaps kept for all sessions, and number of text atlases kept for the window server
+    static constexpr std::size_t FBS_GLYPH_CACHE_BUDGET = 4 * 1024 * 1024;
+    static constexpr std::size_t FBS_MAX_SHARED_FONT_ATLASES = 16;
+
+    // Range rasterized in one batch on first use of a typeface and size
+    static constexpr std::uint32_t BASIC_LATIN_FIRST_CODE = 0x20;
+    static constexpr std::uint32_t BASIC_LATIN_LAST_CODE = 0x7E;
+
     class fbs_server : public service::typical_server {
         friend struct fbscli;
         friend struct fbsfont;
@@ -357,6 +366,7 @@ namespace eka2l1 {
         epoc::open_font_session_cache_link *session_cache_link;
 
         epoc::font_store persistent_font_store;
+        epoc::glyph_cache glyph_cache_;
 
         void load_fonts(eka2l1::io_system *io);
 
@@ -367,6 +377,10 @@ namespace eka2l1 {
         eka2l1::vec2 pixel_size_in_twips;
         epoc::glyph_bitmap_type default_glyph_bitmap_type;
 
+        // GPU reads into bitmap data that have not been waited on yet. The compressor thread also touches bitmap data.
+        std::unordered_map<epoc::bitwise_bitmap *, int> pending_bitmap_reads_;
+        std::mutex pending_bitmap_reads_lock_;
+
     protected:
         void load_fonts_from_directory(eka2l1::io_system *io, eka2l1::directory *dir);
         void initialize_server();
@@ -433,6 +447,10 @@ namespace eka2l1 {
 
         drivers::graphics_driver *get_graphics_driver();
 
+        epoc::glyph_cache &get_glyph_cache() {
+            return glyph_cache_;
+        }
+
         fbsfont *look_for_font_with_address(const eka2l1::address addr);
 
         std::uint8_t *get_shared_chunk_base() const {
@@ -528,6 +546,28 @@ namespace eka2l1 {
         bool is_heap_busy();
         void spin_wait_heap(const std::uint32_t max_times = 200);
 
+        /**
+         * @brief   Get a status for a GPU read into the bitmap's data that does not need to be waited on right away.
+         * 
+         * The read is waited on when the bitmap data is next touched: on the server side through data_pointer(),
+         * or by the guest when it takes the large bitmap heap lock.
+         * 
+         * @param   bmp   The bitmap the read writes into.
+         * @returns Status to queue the read with. Null if the guest can touch the data without locking the heap,
+         *          or already holds the lock, in which case the read must be waited on before returning to the guest.
+         */
+        int *defer_bitmap_read(epoc::bitwise_bitmap *bmp);
+
+        /**
+         * @brief   Wait for a deferred read into the bitmap's data to land, if there is one.
+         */
+        void wait_bitmap_read(epoc::bitwise_bitmap *bmp);
+
+        /**
+         * @brief   Wait for all deferred bitmap reads to land.
+         */
+        void wait_all_bitmap_reads();
+
         template <typename T>
         bool free_general_data(const T *dat) {
             return free_general_data_impl(dat);
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <services/fbs/adapter/font_adapter.h>
+#include <services/fbs/font_atlas.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace eka2l1::common {
+    class thread_pool;
+}
+
+namespace eka2l1::drivers {
+    class graphics_driver;
+}
+
+namespace eka2l1::epoc {
+    /**
+     * @brief A rasterised glyph, as returned by a font adapter.
+     */
+    struct cached_glyph {
+        std::vector<std::uint8_t> bitmap_;
+        int width_ = 0;
+        int height_ = 0;
+        glyph_bitmap_type bitmap_type_ = glyph_bitmap_type::default_glyph_bitmap;
+        bool exists_ = false;           ///< False if the typeface has no such glyph.
+    };
+
+    using cached_glyph_ptr = std::shared_ptr<const cached_glyph>;
+
+    struct glyph_cache_stats {
+        std::uint64_t hits_ = 0;
+        std::uint64_t misses_ = 0;
+        std::uint64_t evictions_ = 0;
+        std::uint64_t batch_rasterized_ = 0;    ///< Glyphs rasterised ahead of use by rasterize_batch.
+        std::size_t used_bytes_ = 0;
+        std::size_t atlas_count_ = 0;
+        std::size_t retired_atlas_count_ = 0;  ///< Evicted atlases waiting for their draws to be submitted.
+    };
+
+    /**
+     * @brief Glyph bitmaps shared by every FBS session and the window server.
+     *
+     * Glyphs are keyed by typeface, size and code point, and evicted least recently used first once
+     * the byte budget is exceeded. Font atlases used by the window server to draw text are kept here
+     * too, one per typeface and size, instead of one per font object.
+     *
+     * Glyph functions are thread-safe. Atlas functions must be called from the emulator thread.
+     */
+    class glyph_cache {
+    public:
+        struct glyph_key {
+            adapter::font_file_adapter_base *adapter_;
+            std::uint32_t face_index_;
+            std::uint32_t font_size_;
+            std::uint32_t code_;
+
+            bool operator==(const glyph_key &rhs) const {
+                return (adapter_ == rhs.adapter_) && (face_index_ == rhs.face_index_) && (font_size_ == rhs.font_size_)
+                    && (code_ == rhs.code_);
+            }
+        };
+
+        struct glyph_key_hash {
+            std::size_t operator()(const glyph_key &key) const;
+        };
+
+    private:
+        struct glyph_entry {
+            cached_glyph_ptr glyph_;
+            std::list<glyph_key>::iterator lru_ite_;
+        };
+
+        struct atlas_entry {
+            std::unique_ptr<font_atlas> atlas_;
+            std::list<glyph_key>::iterator lru_ite_;
+        };
+
+        std::mutex lock_;
+
+        std::unordered_map<glyph_key, glyph_entry, glyph_key_hash> glyphs_;
+        std::list<glyph_key> lru_;
+
+        std::unordered_map<glyph_key, atlas_entry, glyph_key_hash> atlases_;
+        std::list<glyph_key> atlas_lru_;
+        std::vector<std::unique_ptr<font_atlas>> retired_atlases_;
+
+        std::size_t budget_;
+        std::size_t max_atlases_;
+        glyph_cache_stats stats_;
+
+        void add_locked(const glyph_key &key, cached_glyph_ptr glyph);
+
+        static cached_glyph_ptr rasterize(const glyph_key &key);
+
+    public:
+        explicit glyph_cache(const std::size_t budget, const std::size_t max_atlases);
+
+        /**
+         * @brief Get a glyph bitmap, rasterising it on miss.
+         *
+         * @param adapter       The adapter of the font file.
+         * @param face_index    Index of the typeface in the font file.
+         * @param font_size     Size to rasterise at, in pixels.
+         * @param code          The code point. With the top bit set, the glyph index.
+         * @param hit           Optional. Set to true if the glyph was already cached.
+         */
+        cached_glyph_ptr get(adapter::font_file_adapter_base *adapter, const std::size_t face_index, const std::uint16_t font_size,
+            const std::uint32_t code, bool *hit = nullptr);
+
+        /**
+         * @brief Rasterise the glyphs of a list that are not cached yet.
+         *
+         * Glyphs are spread over the pool if the adapter supports concurrent rasterisation.
+         */
+        void rasterize_batch(adapter::font_file_adapter_base *adapter, const std::size_t face_index, const std::uint16_t font_size,
+            const std::vector<std::uint32_t> &codes, common::thread_pool *pool);
+
+        /**
+         * @brief Get the atlas to draw text of a typeface at a size with, creating one if needed.
+         *
+         * When the maximum atlas count is reached, the least recently used atlas is retired. Command builders
+         * not submitted yet may still draw with it, so it lives on until release_retired_atlases().
+         */
+        font_atlas *get_atlas(adapter::font_file_adapter_base *adapter, const std::size_t face_index, const int font_size);
+
+        /**
+         * @brief Destroy the atlases retired by get_atlas().
+         *
+         * Call this once every command list built before the atlases were retired has been submitted,
+         * such as after a screen frame.
+         */
+        void release_retired_atlases(drivers::graphics_driver *driver);
+
+        void destroy_atlases(drivers::graphics_driver *driver);
+
+        glyph_cache_stats get_stats();
+    };
+}
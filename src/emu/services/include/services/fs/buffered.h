@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team
+ *
+ * This file is part of EKA2L1 project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vfs/vfs.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace eka2l1 {
+    class buffered_file_registry;
+
+    struct buffered_file_stats {
+        std::uint64_t reads_ = 0;
+        std::uint64_t read_hits_ = 0;           ///< Reads served entirely from the read-ahead buffer.
+        std::uint64_t writes_ = 0;
+        std::uint64_t coalesced_writes_ = 0;    ///< Writes appended to a pending write buffer.
+        std::uint64_t host_reads_ = 0;
+        std::uint64_t host_writes_ = 0;
+
+        //! Host reads and writes the guest's requests would have needed without buffering, minus those done.
+        std::uint64_t host_calls_saved() const {
+            const std::uint64_t requested = reads_ + writes_;
+            const std::uint64_t done = host_reads_ + host_writes_;
+
+            return (requested > done) ? (requested - done) : 0;
+        }
+    };
+
+    /**
+     * @brief A file handle with read-ahead and write coalescing in front of a VFS file.
+     *
+     * Reads continuing where the last one stopped grow a read-ahead window, up to MAX_READ_AHEAD
+     * bytes. Random reads shrink it back to nothing, and go straight to the file. Writes continuing
+     * the pending write buffer are appended to it, and everything else flushes it first.
+     *
+     * Pending writes reach the file on flush, close, resize, and before any read. Buffering is
+     * turned off while other handles have the same file open, so they always see the same data.
+     * Openers outside the file server reach the file through the IO system, which flushes the
+     * handles of the path first (see buffered_file_registry::flush). That flush may come from any
+     * thread, so every operation touching the buffers holds the handle's lock.
+     */
+    class buffered_file : public file {
+        friend class buffered_file_registry;
+
+    public:
+        static constexpr std::size_t MIN_READ_AHEAD = 4 * 1024;
+        static constexpr std::size_t MAX_READ_AHEAD = 64 * 1024;
+        static constexpr std::size_t WRITE_BUFFER_SIZE = 16 * 1024;
+
+    private:
+        std::unique_ptr<file> inner_;
+        buffered_file_registry *registry_;
+        std::u16string name_;           ///< Kept for logging, the inner file may be closed by then.
+
+        bool buffering_;
+        std::uint64_t pos_;
+        std::uint64_t inner_pos_;       ///< Where the inner file's cursor is, if known.
+        mutable std::optional<std::uint64_t> size_;
+
+        std::vector<std::uint8_t> read_buf_;
+        std::uint64_t read_buf_pos_;
+        std::uint64_t last_read_end_;
+        std::size_t read_ahead_;
+
+        std::vector<std::uint8_t> write_buf_;
+        std::uint64_t write_buf_pos_;
+
+        buffered_file_stats stats_;
+
+        mutable std::mutex lock_;
+
+        bool flush_writes();
+        std::uint64_t current_size() const;
+        void drop_read_buffer();
+        void seek_inner(const std::uint64_t target);
+
+    public:
+        explicit buffered_file(std::unique_ptr<file> inner, buffered_file_registry *registry = nullptr);
+        ~buffered_file() override;
+
+        /**
+         * @brief Turn buffering on or off. Pending writes are flushed when turning it off.
+         */
+        void set_buffering(const bool enable);
+
+        bool is_buffering() const {
+            return buffering_;
+        }
+
+        const buffered_file_stats &get_stats() const {
+            return stats_;
+        }
+
+        using file::read_file;
+
+        size_t write_file(const void *data, uint32_t size, uint32_t count) override;
+        size_t read_file(void *data, uint32_t size, uint32_t count) override;
+
+        int file_mode() const override;
+        std::u16string file_name() const override;
+
+        uint64_t size() const override;
+        uint64_t seek(std::int64_t seek_off, file_seek_mode where) override;
+        uint64_t tell() override;
+
+        bool close() override;
+        bool is_closed() const override;
+        bool flush() override;
+        bool resize(const std::size_t new_size) override;
+
+        std::string get_error_descriptor() override;
+        bool is_in_rom() const override;
+        address rom_address() const override;
+        bool valid() override;
+        std::uint64_t last_modify_since_0ad() override;
+
+        const std::uint8_t *map_view(const std::uint64_t offset, const std::uint64_t size) override;
+        bool is_mappable() const override;
+    };
+
+    /**
+     * @brief Tracks the buffered handles of every path, to keep handles sharing a file coherent.
+     *
+     * The registry lock is always taken before a handle's lock, never the other way around.
+     */
+    class buffered_file_registry {
+        std::unordered_map<std::u16string, std::vector<buffered_file *>> files_;
+        std::mutex lock_;
+
+        static std::u16string make_key(const std::u16string &path);
+
+    public:
+        ~buffered_file_registry();
+
+        void add(buffered_file *f);
+        void remove(buffered_file *f);
+
+        /**
+         * @brief Write out the pending data of all handles of a path.
+         */
+        void flush(const std::u16string &path);
+
+        /**
+         * @brief Flush callback for io_system::set_pending_write_flusher. The user data is the registry.
+         */
+        static void flush_for_io(void *userdata, const std::u16string &path);
+    };
+
+    /**
+     * @brief Put a buffered handle in front of a file, if its open mode allows it.
+     *
+     * Text and append mode files are returned untouched, their positions don't map
+     * to plain offsets. So are files that can be mapped, they are never copied twice.
+     */
+    std::unique_ptr<file> make_buffered_file(std::unique_ptr<file> inner, buffered_file_registry *registry);
+}
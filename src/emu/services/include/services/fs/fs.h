@@ -23,6 +23,8 @@
 #include <kernel/server.h>
 #include <services/context.h>
 #include <services/framework.h>
+#include <services/fs/buffered.h>
+#include <services/fs/section_cache.h>
 #include <utils/des.h>
 
 #include <mem/ptr.h>
@@ -321,8 +323,12 @@ namespace eka2l1 {
         std::uint32_t flags;
         void init();
 
+        file_section_cache section_cache_;
+        buffered_file_registry buffered_files_;
+
     public:
         explicit fs_server(system *sys);
+        ~fs_server() override;
 
         service::uid get_owner_secure_uid() const override {
             return 0x100039E3;
@@ -337,5 +343,13 @@ namespace eka2l1 {
         symfile get_temp_file(const std::u16string &base_dir);
 
         fs_server_client *get_correspond_client(service::session *ss);
+
+        file_section_cache &get_section_cache() {
+            return section_cache_;
+        }
+
+        buffered_file_registry &get_buffered_files() {
+            return buffered_files_;
+        }
     };
 }
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team
+ * 
+ * This file is part of EKA2L1 project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+
+namespace eka2l1 {
+    class io_system;
+    struct file;
+
+    struct file_section_cache_stats {
+        std::uint64_t hits_ = 0;
+        std::uint64_t misses_ = 0;
+        std::uint64_t evictions_ = 0;
+    };
+
+    /**
+     * @brief Small LRU of read-only file handles, for section reads by path.
+     *
+     * RFs::ReadFileSection names the file on every call, and resource readers call it in bursts
+     * on the same few files. Handles are checked against the entry's size and modification time
+     * before reuse, and must be invalidated when the file server deletes or renames the path,
+     * so no host handle outlives its file.
+     */
+    class file_section_cache {
+        struct cached_file {
+            std::u16string key_;
+            std::unique_ptr<file> file_;
+            std::uint64_t size_;
+            std::uint64_t modify_time_;
+        };
+
+        std::list<cached_file> files_;
+        std::size_t capacity_;
+
+        file_section_cache_stats stats_;
+
+    public:
+        explicit file_section_cache(const std::size_t capacity = 8);
+        ~file_section_cache();
+
+        /**
+         * @brief Get a handle of the file for reading.
+         *
+         * @param io        The IO system to open the file from on miss.
+         * @param path      Absolute path of the file.
+         *
+         * @returns The handle, owned by the cache, or nullptr if the file can't be opened.
+         */
+        file *get(io_system *io, const std::u16string &path);
+
+        /**
+         * @brief Read from a file by path.
+         *
+         * @returns Number of bytes read.
+         */
+        std::size_t read(io_system *io, const std::u16string &path, const std::uint64_t position, void *dest,
+            const std::size_t size, bool *found = nullptr);
+
+        /**
+         * @brief Drop the handle of a path, and of everything under it if it's a directory.
+         */
+        void invalidate(const std::u16string &path);
+        void clear();
+
+        const file_section_cache_stats &get_stats() const {
+            return stats_;
+        }
+    };
+}
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <common/vecx.h>
+#include <common/allocator.h>
 #include <common/region.h>
 
 #include <drivers/graphics/common.h>
@@ -27,6 +28,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace eka2l1::drivers {
     class graphics_driver;
@@ -127,18 +129,23 @@ namespace eka2l1::epoc {
 
     static constexpr std::size_t MAX_COMMAND_STORE_DATA_SIZE = sizeof(gdi_store_command_draw_bitmap_data);
 
+    /**
+     * @brief Command being built before it is stored into a segment.
+     *
+     * Variable-length data (text, points, rectangles) is only referenced here. It is copied
+     * into the segment's stream, and the data struct pointer is redirected to the copy, when the
+     * command is added to a segment.
+     */
     struct gdi_store_command {
         gdi_store_command_opcode opcode_ = gdi_store_command_invalid;
         std::uint8_t data_[MAX_COMMAND_STORE_DATA_SIZE];
-        std::shared_ptr<std::vector<std::uint8_t>> dynamic_data_;
 
-        std::uint8_t *allocate_dynamic_data(const std::size_t size) {
-            if (!dynamic_data_) {
-                dynamic_data_ = std::make_shared<std::vector<std::uint8_t>>();
-            }
+        const void *dynamic_data_ = nullptr;
+        std::uint32_t dynamic_size_ = 0;
 
-            dynamic_data_->resize(size);
-            return dynamic_data_->data();
+        void attach_dynamic_data(const void *data, const std::size_t size) {
+            dynamic_data_ = data;
+            dynamic_size_ = static_cast<std::uint32_t>(size);
         }
 
         template <typename T>
@@ -152,6 +159,22 @@ namespace eka2l1::epoc {
         }
     };
 
+    /**
+     * @brief Command stored inline in a segment's stream.
+     *
+     * The header is followed by the opcode's data struct, then by its dynamic data.
+     */
+    struct gdi_store_command_record {
+        gdi_store_command_opcode opcode_;
+        std::uint32_t record_size_;
+        gdi_store_command_record *next_;
+
+        template <typename T>
+        const T &get_data_struct_const() const {
+            return *reinterpret_cast<const T*>(this + 1);
+        }
+    };
+
     enum gdi_store_command_segment_type {
         gdi_store_command_segment_non_redraw,
         gdi_store_command_segment_pending_redraw,
@@ -160,36 +183,61 @@ namespace eka2l1::epoc {
 
     struct gdi_store_command_segment {
         gdi_store_command_segment_type type_;
-        std::uint64_t creation_date_;
 
         common::region region_;
-        std::vector<gdi_store_command> commands_;
+        common::arena_allocator stream_;
+
+        gdi_store_command_record *first_command_;
+        gdi_store_command_record *last_command_;
 
         std::vector<void*> font_objects_;
         std::vector<void*> bitmap_objects_;
 
+        explicit gdi_store_command_segment(common::arena_chunk_pool &pool);
         ~gdi_store_command_segment();
 
         void add_command(gdi_store_command &cmd);
+
+        /**
+         * @brief Drop all commands and object references, giving the stream memory back to the pool.
+         */
+        void reset();
+
+        bool empty() const {
+            return first_command_ == nullptr;
+        }
+
+        std::size_t byte_size() const {
+            return stream_.used_bytes();
+        }
     };
 
     class gdi_store_command_collection {
     private:
+        common::arena_chunk_pool &pool_;
+
         std::vector<std::unique_ptr<gdi_store_command_segment>> segments_;
+        std::vector<std::unique_ptr<gdi_store_command_segment>> free_segments_;
+        std::vector<std::unique_ptr<gdi_store_command_segment>> retired_segments_;
+
         gdi_store_command_segment *current_segment_;
 
+        void recycle_segment(std::unique_ptr<gdi_store_command_segment> &segment);
+
     public:
-        static constexpr std::uint32_t LIMIT_NON_REDRAW_SEGMENTS = 20;
-        static constexpr std::int32_t KEEP_NON_REDRAW_SEGMENTS = 12;
-        static constexpr std::uint64_t AGE_LIMIT_NONREDRAW_US = 1000000;
+        static constexpr std::size_t LIMIT_NON_REDRAW_BYTES = 512 * 1024;
+        static constexpr std::size_t KEEP_NON_REDRAW_BYTES = 256 * 1024;
+        static constexpr std::size_t ROLLOVER_NON_REDRAW_BYTES = 64 * 1024;
 
-        explicit gdi_store_command_collection();
+        explicit gdi_store_command_collection(common::arena_chunk_pool &pool);
 
         gdi_store_command_segment *add_new_segment(const eka2l1::rect &draw_rect, const gdi_store_command_segment_type type_);
         void promote_last_segment();
         
         // Returns true if this must cause an invalidation
         bool clean_old_nonredraw_segments();
+
+        // Recycle segments retired by the last promotion. Called when the next redraw begins
         void redraw_done();
 
         gdi_store_command_segment *get_current_segment() const {
@@ -199,6 +247,8 @@ namespace eka2l1::epoc {
         const std::vector<std::unique_ptr<gdi_store_command_segment>> &get_segments() const {
             return segments_;
         }
+
+        std::size_t total_bytes() const;
     };
 
     class gdi_command_builder {
@@ -228,7 +278,7 @@ namespace eka2l1::epoc {
         }
 
         void build_segment(const gdi_store_command_segment &segment);
-        void build_single_command(const gdi_store_command &command);
+        void build_single_command(const gdi_store_command_record &command);
         void build_command_draw_rect(const gdi_store_command_draw_rect_data &cmd);
         void build_command_draw_line(const gdi_store_command_draw_line_data &cmd);
         void build_command_draw_polygon(const gdi_store_command_draw_polygon_data &cmd);
@@ -87,12 +87,15 @@ namespace eka2l1::epoc {
         std::uint64_t last_draw_;
         std::uint64_t last_fps_sync_;
         std::uint64_t fps_count_;
+        std::uint64_t last_store_allocation_count_;
 
         // NOTE: If you ever want to access this and call a function that can directly affect this list elements, copy it first
         std::vector<dsa*> directs_;
 
         drivers::graphics_command_builder driver_builder_;
-        std::unique_ptr<epoc::gdi_store_command_segment> pending_segment_;
+
+        common::arena_chunk_pool store_pool_;
+        epoc::gdi_store_command_segment pending_segment_;
 
         explicit canvas_base(window_server_client_ptr client, screen *scr, window *parent, const epoc::window_type type_of_window, const epoc::display_mode dmode, const std::uint32_t client_handle);
         virtual ~canvas_base() override;
@@ -165,6 +168,19 @@ namespace eka2l1::epoc {
          */
         virtual std::uint64_t try_update(kernel::thread *drawer);
 
+        /**
+         * @brief Try update the window after its content was changed by GPU rendering only, like an EGL swap.
+         * 
+         * Windows backed by guest memory bring the content back the same way as try_update: the read
+         * is only left in flight where the guest must ask before touching the data
+         * (see fbs_server::defer_bitmap_read), and waited on before returning otherwise.
+         * 
+         * @returns Usually the time in microseconds until next screen update.
+         */
+        virtual std::uint64_t try_update_gpu_content(kernel::thread *drawer) {
+            return try_update(drawer);
+        }
+
         void queue_event(const epoc::event &evt) override;
 
         void set_non_fading(service::ipc_context &context, ws_cmd &cmd);
@@ -211,6 +227,10 @@ namespace eka2l1::epoc {
 
         void create_backed_bitmap();
 
+        // Returns the status the read was queued with: one held by FBS, or the fallback. Null if nothing was queued.
+        int *queue_sync_to_bitmap(int *fallback_status);
+        void wait_pending_sync();
+
         void on_activate() override;
         void handle_extent_changed(const eka2l1::vec2 &new_size, const eka2l1::vec2 &new_pos) override;
 
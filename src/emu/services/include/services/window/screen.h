@@ -113,6 +113,8 @@ namespace eka2l1::epoc {
         std::int32_t active_dsa_count_ = 0;
 
         bool sync_screen_buffer = false;
+        int sync_screen_buffer_status = 0;          ///< Status of the last read of the screen into the screen buffer.
+        bool sync_screen_buffer_flip = false;       ///< The last read needs to be flipped once it lands.
 
         enum {
             FLAG_NEED_RECALC_VISIBLE = 1 << 0,
@@ -186,7 +188,17 @@ namespace eka2l1::epoc {
 
         const void get_max_num_colors(int &colors, int &greys) const;
 
-        void sync_screen_buffer_data(drivers::graphics_driver *driver);
+        /**
+         * \brief Queue a read of the screen content into the screen buffer, after the draws in the builder.
+         *
+         * \returns True if the read must be finished with finish_screen_buffer_sync() once the builder is submitted.
+         */
+        bool queue_screen_buffer_sync(drivers::graphics_driver *driver, drivers::graphics_command_builder &builder);
+
+        /**
+         * \brief Wait for the last screen buffer read to land, and fix up its content.
+         */
+        void finish_screen_buffer_sync(drivers::graphics_driver *driver);
 
         /**
          * \brief Set screen mode.
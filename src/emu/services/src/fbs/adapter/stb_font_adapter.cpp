@@ -54,6 +54,9 @@ namespace eka2l1::epoc::adapter {
         }
 
         *off = stbtt_GetFontOffsetForIndex(&data_[0], static_cast<int>(idx));
+
+        // Infos are never removed, so pointers to them stay valid once the lock is released
+        const std::lock_guard<std::mutex> guard(cache_info_lock_);
         auto result = cache_info.find(*off);
 
         if (result != cache_info.end()) {
@@ -40,6 +40,7 @@
 #include <vfs/vfs.h>
 
 #include <config/config.h>
+#include <drivers/graphics/graphics.h>
 
 namespace eka2l1 {
     namespace epoc {
@@ -283,6 +284,7 @@ namespace eka2l1 {
     fbs_server::fbs_server(eka2l1::system *sys)
         : service::typical_server(sys, epoc::get_fbs_server_name_by_epocver(sys->get_symbian_version_use()))
         , persistent_font_store(sys->get_io_system())
+        , glyph_cache_(FBS_GLYPH_CACHE_BUDGET, FBS_MAX_SHARED_FONT_ATLASES)
         , shared_chunk(nullptr)
         , large_chunk(nullptr)
         , fntstr_seg(nullptr)
@@ -359,6 +361,11 @@ namespace eka2l1 {
 
         if (!large_bitmap_access_mutex) {
             LOG_WARN(SERVICE_FBS, "Large bitmap access mutex fail to create!");
+        } else if (!kern->is_eka1()) {
+            // Clients lock the heap before touching large bitmap data. Land any GPU read left in flight first.
+            large_bitmap_access_mutex->set_acquire_hook([this]() {
+                wait_all_bitmap_reads();
+            });
         }
 
         memory_system *mem = sys->get_memory_system();
@@ -483,6 +490,8 @@ namespace eka2l1 {
         font_obj_container.clear();
         obj_con.clear();
 
+        glyph_cache_.destroy_atlases(get_graphics_driver());
+
         if (session_cache_list) {
             session_cache_list->~open_font_session_cache_list();
         }
@@ -530,6 +539,61 @@ namespace eka2l1 {
         }
     }
 
+    int *fbs_server::defer_bitmap_read(epoc::bitwise_bitmap *bmp) {
+        // Only large bitmaps are guarded by the heap lock. Others can be read by the guest at any time.
+        if ((legacy_level() != FBS_LEGACY_LEVEL_EARLY_EKA2) || !bmp->allocator_ || !bmp->pile_ || !is_large_bitmap(bmp->header_.bitmap_size - sizeof(loader::sbm_header))) {
+            return nullptr;
+        }
+
+        // Only taking the lock waits for the read. A guest already holding it reads straight away.
+        if (!large_bitmap_access_mutex || kern->is_eka1() || large_bitmap_access_mutex->holder()) {
+            return nullptr;
+        }
+
+        const std::lock_guard<std::mutex> guard(pending_bitmap_reads_lock_);
+        int &status = pending_bitmap_reads_[bmp];
+
+        if (status != 0) {
+            get_graphics_driver()->wait_for(&status);
+        }
+
+        // In flight from now on, so anyone touching the data before the read is submitted waits for it
+        status = -100;
+        return &status;
+    }
+
+    void fbs_server::wait_bitmap_read(epoc::bitwise_bitmap *bmp) {
+        const std::lock_guard<std::mutex> guard(pending_bitmap_reads_lock_);
+
+        if (pending_bitmap_reads_.empty()) {
+            return;
+        }
+
+        auto ite = pending_bitmap_reads_.find(bmp);
+        if (ite == pending_bitmap_reads_.end()) {
+            return;
+        }
+
+        get_graphics_driver()->wait_for(&ite->second);
+        pending_bitmap_reads_.erase(ite);
+    }
+
+    void fbs_server::wait_all_bitmap_reads() {
+        const std::lock_guard<std::mutex> guard(pending_bitmap_reads_lock_);
+
+        if (pending_bitmap_reads_.empty()) {
+            return;
+        }
+
+        drivers::graphics_driver *driver = get_graphics_driver();
+
+        for (auto &[bmp, status]: pending_bitmap_reads_) {
+            driver->wait_for(&status);
+        }
+
+        pending_bitmap_reads_.clear();
+    }
+
     fbscli::fbscli(service::typical_server *serv, const kernel::uid ss_id, epoc::version client_version)
         : service::typical_session(serv, ss_id, client_version)
         , glyph_info_for_legacy_return_(nullptr)
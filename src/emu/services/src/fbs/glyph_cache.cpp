@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <services/fbs/glyph_cache.h>
+
+#include <common/thread_pool.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace eka2l1::epoc {
+    // Bookkeeping cost of an entry, so that empty glyphs are not free
+    static constexpr std::size_t GLYPH_ENTRY_OVERHEAD = 64;
+
+    static std::size_t glyph_entry_size(const cached_glyph &glyph) {
+        return glyph.bitmap_.size() + GLYPH_ENTRY_OVERHEAD;
+    }
+
+    std::size_t glyph_cache::glyph_key_hash::operator()(const glyph_key &key) const {
+        std::size_t result = std::hash<const void *>()(key.adapter_);
+        result ^= (static_cast<std::size_t>(key.face_index_) * 0x9E3779B1) + (result << 6) + (result >> 2);
+        result ^= (static_cast<std::size_t>(key.font_size_) * 0x85EBCA6B) + (result << 6) + (result >> 2);
+        result ^= (static_cast<std::size_t>(key.code_) * 0xC2B2AE35) + (result << 6) + (result >> 2);
+
+        return result;
+    }
+
+    glyph_cache::glyph_cache(const std::size_t budget, const std::size_t max_atlases)
+        : budget_(budget)
+        , max_atlases_(max_atlases) {
+    }
+
+    cached_glyph_ptr glyph_cache::rasterize(const glyph_key &key) {
+        auto glyph = std::make_shared<cached_glyph>();
+        std::uint32_t data_size = 0;
+
+        std::uint8_t *data = key.adapter_->get_glyph_bitmap(key.face_index_, key.code_, static_cast<std::uint16_t>(key.font_size_),
+            &glyph->width_, &glyph->height_, data_size, &glyph->bitmap_type_);
+
+        if (data) {
+            glyph->bitmap_.assign(data, data + data_size);
+            glyph->exists_ = true;
+
+            key.adapter_->free_glyph_bitmap(data);
+        } else {
+            // Spaces and the like have nothing to draw but still exist
+            glyph->exists_ = key.adapter_->does_glyph_exist(key.face_index_, key.code_);
+        }
+
+        return glyph;
+    }
+
+    void glyph_cache::add_locked(const glyph_key &key, cached_glyph_ptr glyph) {
+        if (glyphs_.find(key) != glyphs_.end()) {
+            // Someone else rasterised it meanwhile
+            return;
+        }
+
+        const std::size_t size = glyph_entry_size(*glyph);
+
+        while (!lru_.empty() && (stats_.used_bytes_ + size > budget_)) {
+            auto ite = glyphs_.find(lru_.back());
+            stats_.used_bytes_ -= glyph_entry_size(*ite->second.glyph_);
+            stats_.evictions_++;
+
+            glyphs_.erase(ite);
+            lru_.pop_back();
+        }
+
+        lru_.push_front(key);
+
+        glyph_entry &entry = glyphs_[key];
+        entry.glyph_ = std::move(glyph);
+        entry.lru_ite_ = lru_.begin();
+
+        stats_.used_bytes_ += size;
+    }
+
+    cached_glyph_ptr glyph_cache::get(adapter::font_file_adapter_base *adapter, const std::size_t face_index, const std::uint16_t font_size,
+        const std::uint32_t code, bool *hit) {
+        const glyph_key key{ adapter, static_cast<std::uint32_t>(face_index), font_size, code };
+
+        {
+            const std::lock_guard<std::mutex> guard(lock_);
+            auto ite = glyphs_.find(key);
+
+            if (hit) {
+                *hit = (ite != glyphs_.end());
+            }
+
+            if (ite != glyphs_.end()) {
+                lru_.splice(lru_.begin(), lru_, ite->second.lru_ite_);
+                stats_.hits_++;
+
+                return ite->second.glyph_;
+            }
+
+            stats_.misses_++;
+        }
+
+        // Rasterise outside the lock, this is the slow part
+        cached_glyph_ptr glyph = rasterize(key);
+
+        const std::lock_guard<std::mutex> guard(lock_);
+        add_locked(key, glyph);
+
+        return glyph;
+    }
+
+    void glyph_cache::rasterize_batch(adapter::font_file_adapter_base *adapter, const std::size_t face_index, const std::uint16_t font_size,
+        const std::vector<std::uint32_t> &codes, common::thread_pool *pool) {
+        std::vector<glyph_key> to_rasterize;
+
+        {
+            const std::lock_guard<std::mutex> guard(lock_);
+
+            for (const std::uint32_t code: codes) {
+                const glyph_key key{ adapter, static_cast<std::uint32_t>(face_index), font_size, code };
+                if (glyphs_.find(key) == glyphs_.end()) {
+                    to_rasterize.push_back(key);
+                }
+            }
+        }
+
+        if (to_rasterize.empty()) {
+            return;
+        }
+
+        std::vector<cached_glyph_ptr> results(to_rasterize.size());
+        auto rasterize_range = [&](const std::size_t begin, const std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                results[i] = rasterize(to_rasterize[i]);
+            }
+        };
+
+        if (pool && adapter->supports_concurrent_rasterization()) {
+            pool->parallel_for(to_rasterize.size(), 4, rasterize_range);
+        } else {
+            rasterize_range(0, to_rasterize.size());
+        }
+
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        for (std::size_t i = 0; i < to_rasterize.size(); i++) {
+            add_locked(to_rasterize[i], std::move(results[i]));
+        }
+
+        stats_.batch_rasterized_ += to_rasterize.size();
+    }
+
+    font_atlas *glyph_cache::get_atlas(adapter::font_file_adapter_base *adapter, const std::size_t face_index, const int font_size) {
+        const glyph_key key{ adapter, static_cast<std::uint32_t>(face_index), static_cast<std::uint32_t>(font_size), 0 };
+        auto ite = atlases_.find(key);
+
+        if (ite != atlases_.end()) {
+            atlas_lru_.splice(atlas_lru_.begin(), atlas_lru_, ite->second.lru_ite_);
+            return ite->second.atlas_.get();
+        }
+
+        while (!atlas_lru_.empty() && (atlases_.size() >= max_atlases_)) {
+            auto victim = atlases_.find(atlas_lru_.back());
+            retired_atlases_.push_back(std::move(victim->second.atlas_));
+
+            atlases_.erase(victim);
+            atlas_lru_.pop_back();
+        }
+
+        atlas_lru_.push_front(key);
+
+        atlas_entry &entry = atlases_[key];
+        entry.atlas_ = std::make_unique<font_atlas>(adapter, face_index, 0x20, 0xFF - 0x20, font_size);
+        entry.lru_ite_ = atlas_lru_.begin();
+
+        return entry.atlas_.get();
+    }
+
+    void glyph_cache::release_retired_atlases(drivers::graphics_driver *driver) {
+        for (auto &atlas: retired_atlases_) {
+            atlas->destroy(driver);
+        }
+
+        retired_atlases_.clear();
+    }
+
+    void glyph_cache::destroy_atlases(drivers::graphics_driver *driver) {
+        release_retired_atlases(driver);
+
+        for (auto &[key, entry]: atlases_) {
+            entry.atlas_->destroy(driver);
+        }
+
+        atlases_.clear();
+        atlas_lru_.clear();
+    }
+
+    glyph_cache_stats glyph_cache::get_stats() {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        glyph_cache_stats result = stats_;
+        result.atlas_count_ = atlases_.size();
+        result.retired_atlas_count_ = retired_atlases_.size();
+
+        return result;
+    }
+}
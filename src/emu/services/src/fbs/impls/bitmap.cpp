@@ -26,6 +26,7 @@
 #include <common/cvt.h>
 #include <common/fileutils.h>
 #include <common/log.h>
+#include <common/pixel.h>
 #include <common/runlen.h>
 
 #include <services/fbs/fbs.h>
@@ -334,6 +335,9 @@ namespace eka2l1 {
         }
 
         std::uint8_t *bitwise_bitmap::data_pointer(fbs_server *ss) {
+            // A GPU read may still be writing to the data
+            ss->wait_bitmap_read(this);
+
             // Use traditional method for on-rom bitmap that does not have additional info
             if (!allocator_ || !pile_ || !ss->is_large_bitmap(header_.bitmap_size - sizeof(loader::sbm_header))) {
                 return reinterpret_cast<std::uint8_t *>(this) + data_offset_;
@@ -1132,86 +1136,31 @@ namespace eka2l1 {
                     bitmap->header_.bit_per_pixels);
 
                 const std::uint8_t *packed_data = reinterpret_cast<const std::uint8_t *>(bitmap->data_offset_ + base);
+                const epoc::display_mode disp_mode = bitmap->settings_.current_display_mode();
 
-                switch (bitmap->settings_.current_display_mode()) {
-                case epoc::display_mode::color64k:
-                    for (std::size_t y = 0; y < bitmap->header_.size_pixels.y; y++) {
-                        for (std::size_t x = 0; x < bitmap->header_.size_pixels.x; x++) {
-                            const std::uint16_t pixel = *reinterpret_cast<const std::uint16_t *>(packed_data + y * byte_width + x * 2);
-                            std::uint8_t r = static_cast<std::uint8_t>((pixel & 0xF800) >> 8);
-                            r += r >> 5;
-
-                            std::uint8_t g = static_cast<std::uint8_t>((pixel & 0x07E0) >> 3);
-                            g += g >> 6;
-
-                            std::uint8_t b = static_cast<std::uint8_t>((pixel & 0x001F) << 3);
-                            b += b >> 5;
-
-                            file.write(reinterpret_cast<const char *>(&b), 1);
-                            file.write(reinterpret_cast<const char *>(&g), 1);
-                            file.write(reinterpret_cast<const char *>(&r), 1);
-                        }
-
-                        const std::size_t fill_align = common::align(bitmap->header_.size_pixels.x * 3, 4)
-                            - bitmap->header_.size_pixels.x * 3;
-
-                        const char fill_char = 0;
-
-                        for (std::size_t i = 0; i < fill_align; i++) {
-                            file.write(&fill_char, 1);
-                        }
-                    }
-
-                    break;
-
-                case epoc::display_mode::color256:
-                    for (std::size_t y = 0; y < bitmap->header_.size_pixels.y; y++) {
-                        for (std::size_t x = 0; x < bitmap->header_.size_pixels.x; x++) {
-                            const std::uint8_t pixel = *reinterpret_cast<const std::uint8_t *>(packed_data + y * byte_width + x);
-                            std::uint32_t palette_color = epoc::get_suitable_palette_256(sysver)[pixel];
-
-                            file.write(reinterpret_cast<const char *>(&palette_color) + 2, 1);
-                            file.write(reinterpret_cast<const char *>(&palette_color) + 1, 1);
-                            file.write(reinterpret_cast<const char *>(&palette_color) + 0, 1);
-                        }
-
-                        const std::size_t fill_align = common::align(bitmap->header_.size_pixels.x * 3, 4)
-                            - bitmap->header_.size_pixels.x * 3;
-
-                        const char fill_char = 0;
-
-                        for (std::size_t i = 0; i < fill_align; i++) {
-                            file.write(&fill_char, 1);
-                        }
-                    }
-
-                    break;
-
-                case epoc::display_mode::gray256:
-                    for (std::size_t y = 0; y < bitmap->header_.size_pixels.y; y++) {
-                        for (std::size_t x = 0; x < bitmap->header_.size_pixels.x; x++) {
-                            const std::uint8_t pixel = *reinterpret_cast<const std::uint8_t *>(packed_data + y * byte_width + x);
+                common::pixel_format source_format = common::pixel_format::bgr888;
 
-                            file.write(reinterpret_cast<const char *>(&pixel), 1);
-                            file.write(reinterpret_cast<const char *>(&pixel), 1);
-                            file.write(reinterpret_cast<const char *>(&pixel), 1);
-                        }
+                if (!get_pixel_format_from_display_mode(disp_mode, source_format)) {
+                    file.write(bitmap->data_offset_ + base, dib_header.uncompressed_size);
+                    return true;
+                }
 
-                        const std::size_t fill_align = common::align(bitmap->header_.size_pixels.x * 3, 4)
-                            - bitmap->header_.size_pixels.x * 3;
+                const std::uint32_t *palette = nullptr;
 
-                        const char fill_char = 0;
+                if (disp_mode == epoc::display_mode::color16) {
+                    palette = epoc::color_16_palette.data();
+                } else if (disp_mode == epoc::display_mode::color256) {
+                    palette = epoc::get_suitable_palette_256(sysver).data();
+                }
 
-                        for (std::size_t i = 0; i < fill_align; i++) {
-                            file.write(&fill_char, 1);
-                        }
-                    }
+                // BMP rows are aligned to 4 bytes, the padding stays zero
+                std::vector<std::uint8_t> row(common::align(bitmap->header_.size_pixels.x * 3, 4), 0);
 
-                    break;
+                for (std::size_t y = 0; y < bitmap->header_.size_pixels.y; y++) {
+                    common::convert_pixels(row.data(), common::pixel_format::bgr888, packed_data + y * byte_width, source_format,
+                        bitmap->header_.size_pixels.x, palette);
 
-                default:
-                    file.write(bitmap->data_offset_ + base, dib_header.uncompressed_size);
-                    break;
+                    file.write(reinterpret_cast<const char *>(row.data()), row.size());
                 }
             }
 
@@ -1311,161 +1260,52 @@ namespace eka2l1 {
                 byte_width = header.size_pixels.x * 3;
             }
 
-            switch (dpm) {
-            case epoc::display_mode::color256:
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {
-                    current_to_look->seek(y * byte_width, common::seek_where::beg);
-
-                    for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint8_t pixel = 0;
-                        if (current_to_look->read(&pixel, 1) != 1) {
-                            return false;
-                        }
-
-                        std::uint32_t palette_color = epoc::get_suitable_palette_256(serv->get_kernel_object_owner()->get_epoc_version())[pixel];
-
-                        std::uint8_t a = ((make_standard_mask) ? ((palette_color & 0xFFFFFF) == 0xFFFFFF) : 1) * 255;
-
-                        dest.write(reinterpret_cast<const char *>(&palette_color) + 0, 1);
-                        dest.write(reinterpret_cast<const char *>(&palette_color) + 1, 1);
-                        dest.write(reinterpret_cast<const char *>(&palette_color) + 2, 1);
-                        dest.write(&a, 1);
-                    }
-                }
-
-                break;
-
-            case epoc::display_mode::color4k:
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {
-                    current_to_look->seek(y * byte_width, common::seek_where::beg);
-
-                    for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint16_t pixel = 0;
-                        if (current_to_look->read(&pixel, 2) != 2) {
-                            return false;
-                        }
-                        std::uint8_t r = static_cast<std::uint8_t>(((pixel >> 8) & 0xF) * 17);
-                        std::uint8_t g = static_cast<std::uint8_t>(((pixel >> 4) & 0xF) * 17);
-                        std::uint8_t b = static_cast<std::uint8_t>((pixel & 0xF) * 17);
-                        std::uint8_t a = ((make_standard_mask) ? ((r == 255) && (g == 255) && (b == 255)) : 1) * 255;
-                        dest.write(&r, 1);
-                        dest.write(&g, 1);
-                        dest.write(&b, 1);
-                        dest.write(&a, 1);
-                    }
-                }
-
-                break;
-
-            case epoc::display_mode::color64k:
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {
-                    current_to_look->seek(y * byte_width, common::seek_where::beg);
-
-                    for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint16_t pixel = 0;
-                        if (current_to_look->read(&pixel, 2) != 2) {
-                            return false;
-                        }
-
-                        std::uint8_t r = static_cast<std::uint8_t>((pixel & 0xF800) >> 8);
-                        r += r >> 5;
-
-                        std::uint8_t g = static_cast<std::uint8_t>((pixel & 0x07E0) >> 3);
-                        g += g >> 6;
-
-                        std::uint8_t b = static_cast<std::uint8_t>((pixel & 0x001F) << 3);
-                        b += b >> 5;
-
-                        std::uint8_t a = ((make_standard_mask) ? ((r == 255) && (g == 255) && (b == 255)) : 1) * 255;
-                        dest.write(&r, 1);
-                        dest.write(&g, 1);
-                        dest.write(&b, 1);
-                        dest.write(&a, 1);
-                    }
-                }
-
-                break;
+            common::pixel_format source_format = common::pixel_format::rgba8888;
+            if (!get_pixel_format_from_display_mode(dpm, source_format)) {
+                LOG_ERROR(SERVICE_FBS, "Unsupported display mode to convert to ARGB8888 {}", static_cast<int>(dpm));
+                return false;
+            }
 
-            case epoc::display_mode::color16m:
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {
-                    current_to_look->seek(y * byte_width, common::seek_where::beg);
+            const std::uint32_t *palette = nullptr;
 
-                    for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint8_t base[3];
-                        if (current_to_look->read(base, 3) != 3) {
-                            return false;
-                        }
+            if (dpm == epoc::display_mode::color16) {
+                palette = epoc::color_16_palette.data();
+            } else if (dpm == epoc::display_mode::color256) {
+                palette = epoc::get_suitable_palette_256(serv->get_kernel_object_owner()->get_epoc_version()).data();
+            }
 
-                        std::uint8_t a = ((make_standard_mask) ? ((base[0] == 255) && (base[1] == 255) && (base[2] == 255)) : 1) * 255;
-                        dest.write(base + 2, 1);
-                        dest.write(base + 1, 1);
-                        dest.write(base, 1);
-                        dest.write(&a, 1);
-                    }
-                }
+            // Gray bitmaps are mostly masks, their level is the coverage
+            const bool gray_as_alpha = !is_display_mode_color(dpm);
+            const bool white_as_opaque = make_standard_mask && !is_display_mode_alpha(dpm);
 
-                break;
+            const std::size_t source_row_size = common::get_pixel_run_size(source_format, header.size_pixels.x);
 
-            case epoc::display_mode::color16ma: {
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {    
-                    current_to_look->seek(y * byte_width, common::seek_where::beg);
+            std::vector<std::uint8_t> source_row(source_row_size);
+            std::vector<std::uint8_t> dest_row(header.size_pixels.x * 4);
 
-                    for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint8_t base[4];
-                        if (current_to_look->read(base, 4) != 3) {
-                            return false;
-                        }
+            for (std::size_t y = 0; y < header.size_pixels.y; y++) {
+                current_to_look->seek(y * byte_width, common::seek_where::beg);
 
-                        dest.write(base + 2, 1);
-                        dest.write(base + 1, 1);
-                        dest.write(base, 1);
-                        dest.write(base + 3, 1);
-                    }
+                if (current_to_look->read(source_row.data(), source_row_size) != source_row_size) {
+                    return false;
                 }
 
-                break;
-            }
-
-            case epoc::display_mode::gray256:
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {
-                    current_to_look->seek(y * byte_width, common::seek_where::beg);
+                common::convert_pixels(dest_row.data(), common::pixel_format::rgba8888, source_row.data(), source_format,
+                    header.size_pixels.x, palette);
 
+                if (gray_as_alpha || white_as_opaque) {
                     for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint8_t pixel = 0;
-                        if (current_to_look->read(&pixel, 1) != 1) {
-                            return false;
-                        }
-                        dest.write(&pixel, 1);
-                        dest.write(&pixel, 1);
-                        dest.write(&pixel, 1);
-                        dest.write(&pixel, 1);
-                    }
-                }
-
-                break;
+                        std::uint8_t *pixel = dest_row.data() + x * 4;
 
-            case epoc::display_mode::gray2:
-                for (std::size_t y = 0; y < header.size_pixels.y; y++) {
-                    for (std::size_t x = 0; x < header.size_pixels.x; x++) {
-                        std::uint32_t color = 0;
-                        current_to_look->seek(y * byte_width + (x / 32) * 4, common::seek_where::beg);
-                        if (current_to_look->read(&color, 4) != 4) {
-                            return false;
-                        }
-                        std::uint32_t converted_color = 0;
-                        if (color & (1 << (x & 0x1F))) {
-                            converted_color = 0xFFFFFFFF;
+                        if (gray_as_alpha) {
+                            pixel[3] = pixel[0];
+                        } else {
+                            pixel[3] = ((pixel[0] & pixel[1] & pixel[2]) == 0xFF) ? 0xFF : 0;
                         }
-
-                        dest.write(&converted_color, sizeof(converted_color));
                     }
                 }
 
-                break;
-
-            default:
-                LOG_ERROR(SERVICE_FBS, "Unsupported display mode to convert to ARGB8888 {}", static_cast<int>(dpm));
-                return false;
+                dest.write(dest_row.data(), dest_row.size());
             }
 
             return true;
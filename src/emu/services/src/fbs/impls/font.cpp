@@ -26,6 +26,7 @@
 #include <common/cvt.h>
 #include <common/log.h>
 #include <common/path.h>
+#include <common/thread_pool.h>
 #include <common/vecx.h>
 
 #include <system/epoc.h>
@@ -807,19 +808,28 @@ namespace eka2l1 {
             //LOG_DEBUG(SERVICE_FBS, "Trying to rasterize character '{}' (code {})", static_cast<char>(codepoint), codepoint);
         }
 
-        int rasterized_width = 0;
-        int rasterized_height = 0;
-
         const epoc::open_font_info *info = &(font->of_info);
-        epoc::glyph_bitmap_type bitmap_type = epoc::glyph_bitmap_type::default_glyph_bitmap;
-        std::uint32_t bitmap_data_size = 0;
+        fbs_server *serv = server<fbs_server>();
 
         // Get server font handle
         // The returned bitmap is 8bpp single channel. Luckily Symbian likes this (at least in v3 and upper).
-        std::uint8_t *bitmap_data = info->adapter->get_glyph_bitmap(info->idx, codepoint, font->of_info.metrics.max_height,
-            &rasterized_width, &rasterized_height, bitmap_data_size, &bitmap_type);
+        // Glyphs are shared between all sessions, most of the time another process has rasterized it already.
+        bool cache_hit = false;
+        epoc::cached_glyph_ptr glyph = serv->get_glyph_cache().get(info->adapter, info->idx, font->of_info.metrics.max_height,
+            codepoint, &cache_hit);
+
+        if (!cache_hit && (codepoint >= BASIC_LATIN_FIRST_CODE) && (codepoint <= BASIC_LATIN_LAST_CODE)) {
+            // First time this typeface and size is drawn. Text will want the rest of Basic Latin soon, do it in one go.
+            std::vector<std::uint32_t> basic_latin;
+            for (std::uint32_t code = BASIC_LATIN_FIRST_CODE; code <= BASIC_LATIN_LAST_CODE; code++) {
+                basic_latin.push_back(code);
+            }
+
+            serv->get_glyph_cache().rasterize_batch(info->adapter, info->idx, font->of_info.metrics.max_height,
+                basic_latin, &common::get_shared_thread_pool());
+        }
 
-        if (!bitmap_data && !info->adapter->does_glyph_exist(info->idx, codepoint)) {
+        if (glyph->bitmap_.empty() && !glyph->exists_) {
             // The glyph is not available. Let the client know. With code 0, we already use '?'
             // On S^3, it expect us to return false here.
             // On lower version, it expect us to return nullptr, so use 0 here is for the best.
@@ -827,8 +837,9 @@ namespace eka2l1 {
             return;
         }
 
+        const std::uint32_t bitmap_data_size = static_cast<std::uint32_t>(glyph->bitmap_.size());
+
         // Add it to session cache
-        fbs_server *serv = server<fbs_server>();
         kernel::process *pr = ctx->msg->own_thr->owning_process();
 
 #define MAKE_CACHE_ENTRY(entry_ver, type)                                                                                                   \
@@ -840,18 +851,17 @@ namespace eka2l1 {
     info->adapter->get_glyph_metric(info->idx, codepoint, cache_entry->metric,                                                              \
         reinterpret_cast<type *>(bmp_font)->algorithic_style.baseline_offsets_in_pixel,                                                     \
         font->of_info.metrics.max_height);                                                                                                  \
-    cache_entry->metric.width = rasterized_width;                                                                                           \
-    cache_entry->metric.height = rasterized_height;                                                                                         \
-    cache_entry->metric.bitmap_type = bitmap_type;                                                                                          \
+    cache_entry->metric.width = glyph->width_;                                                                                              \
+    cache_entry->metric.height = glyph->height_;                                                                                            \
+    cache_entry->metric.bitmap_type = glyph->bitmap_type_;                                                                                  \
     const auto cache_entry_ptr = serv->host_ptr_to_guest_general_data(cache_entry).ptr_address();                                           \
     if (epoc::does_client_use_pointer_instead_of_offset(this)) {                                                                            \
         cache_entry->font_offset = static_cast<std::int32_t>(reinterpret_cast<type *>(bmp_font)->openfont.ptr_address());                   \
     } else {                                                                                                                                \
         cache_entry->font_offset = static_cast<std::int32_t>(reinterpret_cast<type *>(bmp_font)->openfont.ptr_address() - cache_entry_ptr); \
     }                                                                                                                                       \
-    std::memcpy(reinterpret_cast<std::uint8_t *>(cache_entry) + cache_entry->offset, bitmap_data,                                           \
+    std::memcpy(reinterpret_cast<std::uint8_t *>(cache_entry) + cache_entry->offset, glyph->bitmap_.data(),                                 \
         bitmap_data_size);                                                                                                                  \
-    info->adapter->free_glyph_bitmap(bitmap_data);                                                                                          \
     if (epoc::does_client_use_pointer_instead_of_offset(this)) {                                                                            \
         cache_entry->offset += static_cast<std::int32_t>(cache_entry_ptr);                                                                  \
     }
@@ -1033,8 +1043,7 @@ namespace eka2l1 {
     }
 
     fbsfont::~fbsfont() {
-        // Free atlas + bitmap
-        atlas.destroy(serv->get_graphics_driver());
+        // Free bitmap
         std::uint8_t *font_ptr = serv->get_shared_chunk_base() + guest_font_offset;
 
         switch (serv->legacy_level()) {
@@ -1065,8 +1074,12 @@ namespace eka2l1 {
 
             std::vector<std::uint8_t> buf;
 
-            buf.resize(fsize);
-            f->read_file(&buf[0], 1, static_cast<std::uint32_t>(buf.size()));
+            if (const std::uint8_t *view = f->map_view(0, fsize)) {
+                buf.assign(view, view + fsize);
+            } else {
+                buf.resize(fsize);
+                f->read_file(&buf[0], 1, static_cast<std::uint32_t>(buf.size()));
+            }
 
             f->close();
 
@@ -0,0 +1,519 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team
+ *
+ * This file is part of EKA2L1 project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <services/fs/buffered.h>
+
+#include <common/algorithm.h>
+#include <common/cvt.h>
+#include <common/log.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace eka2l1 {
+    static constexpr std::uint64_t UNKNOWN_POSITION = 0xFFFFFFFFFFFFFFFF;
+
+    buffered_file::buffered_file(std::unique_ptr<file> inner, buffered_file_registry *registry)
+        : file(inner->attribute)
+        , inner_(std::move(inner))
+        , registry_(registry)
+        , name_(inner_->file_name())
+        , buffering_(true)
+        , pos_(0)
+        , inner_pos_(UNKNOWN_POSITION)
+        , read_buf_pos_(0)
+        , last_read_end_(0)
+        , read_ahead_(0)
+        , write_buf_pos_(0) {
+        pos_ = inner_->tell();
+        last_read_end_ = pos_;
+        inner_pos_ = pos_;
+
+        if (registry_) {
+            registry_->add(this);
+        }
+    }
+
+    buffered_file::~buffered_file() {
+        {
+            const std::lock_guard<std::mutex> guard(lock_);
+            flush_writes();
+        }
+
+        if (registry_) {
+            registry_->remove(this);
+        }
+
+        if (stats_.reads_ || stats_.writes_) {
+            LOG_TRACE(SERVICE_EFSRV, "Buffered file {}: {} reads ({} from buffer), {} writes ({} coalesced), {} host calls saved",
+                common::ucs2_to_utf8(name_), stats_.reads_, stats_.read_hits_, stats_.writes_,
+                stats_.coalesced_writes_, stats_.host_calls_saved());
+        }
+    }
+
+    void buffered_file::seek_inner(const std::uint64_t target) {
+        if (inner_pos_ != target) {
+            inner_->seek(static_cast<std::int64_t>(target), file_seek_mode::beg);
+            inner_pos_ = target;
+        }
+    }
+
+    bool buffered_file::flush_writes() {
+        if (write_buf_.empty()) {
+            return true;
+        }
+
+        // Switching from reading to writing needs a seek on stdio streams, so never skip it here
+        inner_->seek(static_cast<std::int64_t>(write_buf_pos_), file_seek_mode::beg);
+
+        const std::size_t written = inner_->write_file(write_buf_.data(), 1, static_cast<std::uint32_t>(write_buf_.size()));
+        stats_.host_writes_++;
+
+        const bool ok = (written == write_buf_.size());
+
+        if (!ok) {
+            LOG_ERROR(SERVICE_EFSRV, "Only {} of {} buffered bytes were written to {}", written, write_buf_.size(),
+                common::ucs2_to_utf8(name_));
+        }
+
+        // Same for the way back
+        inner_pos_ = UNKNOWN_POSITION;
+        write_buf_.clear();
+
+        return ok;
+    }
+
+    void buffered_file::drop_read_buffer() {
+        read_buf_.clear();
+        read_buf_pos_ = 0;
+    }
+
+    void buffered_file::set_buffering(const bool enable) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (buffering_ == enable) {
+            return;
+        }
+
+        if (enable) {
+            // Other handles may have moved the file on since
+            pos_ = inner_->tell();
+            inner_pos_ = pos_;
+            last_read_end_ = pos_;
+            read_ahead_ = 0;
+            size_.reset();
+        } else {
+            flush_writes();
+            inner_->flush();
+            drop_read_buffer();
+
+            inner_->seek(static_cast<std::int64_t>(pos_), file_seek_mode::beg);
+        }
+
+        buffering_ = enable;
+    }
+
+    size_t buffered_file::read_file(void *data, uint32_t size, uint32_t count) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (!buffering_) {
+            return inner_->read_file(data, size, count);
+        }
+
+        const std::uint64_t total = static_cast<std::uint64_t>(size) * count;
+
+        if (total == 0) {
+            return 0;
+        }
+
+        stats_.reads_++;
+        flush_writes();
+
+        std::uint8_t *dest = reinterpret_cast<std::uint8_t *>(data);
+        std::uint64_t done = 0;
+
+        const bool sequential = (pos_ == last_read_end_);
+
+        if ((pos_ >= read_buf_pos_) && (pos_ < read_buf_pos_ + read_buf_.size())) {
+            const std::uint64_t in_buffer = common::min<std::uint64_t>(total, read_buf_pos_ + read_buf_.size() - pos_);
+            std::memcpy(dest, read_buf_.data() + (pos_ - read_buf_pos_), static_cast<std::size_t>(in_buffer));
+
+            done = in_buffer;
+
+            if (done == total) {
+                stats_.read_hits_++;
+            }
+        }
+
+        if (done < total) {
+            // Grow the window on every read that continues the last one, drop it on random access
+            if (sequential) {
+                read_ahead_ = (read_ahead_ == 0) ? MIN_READ_AHEAD : common::min<std::size_t>(read_ahead_ * 2, MAX_READ_AHEAD);
+            } else {
+                read_ahead_ = 0;
+            }
+
+            const std::uint64_t remaining = total - done;
+            seek_inner(pos_ + done);
+
+            if (remaining >= read_ahead_) {
+                // The buffer would not serve anything after this, read straight to the destination
+                const std::size_t read = inner_->read_file(dest + done, 1, static_cast<std::uint32_t>(remaining));
+                stats_.host_reads_++;
+
+                inner_pos_ += read;
+                done += read;
+
+                drop_read_buffer();
+            } else {
+                read_buf_.resize(read_ahead_);
+
+                const std::size_t read = inner_->read_file(read_buf_.data(), 1, static_cast<std::uint32_t>(read_ahead_));
+                stats_.host_reads_++;
+
+                read_buf_.resize(read);
+                read_buf_pos_ = pos_ + done;
+                inner_pos_ += read;
+
+                const std::uint64_t from_buffer = common::min<std::uint64_t>(remaining, read);
+                std::memcpy(dest + done, read_buf_.data(), static_cast<std::size_t>(from_buffer));
+
+                done += from_buffer;
+            }
+        }
+
+        pos_ += done;
+        last_read_end_ = pos_;
+
+        return static_cast<size_t>(done);
+    }
+
+    size_t buffered_file::write_file(const void *data, uint32_t size, uint32_t count) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (!buffering_) {
+            // Other handles of the file must see this right away
+            const size_t written = inner_->write_file(data, size, count);
+            inner_->flush();
+
+            return written;
+        }
+
+        const std::uint64_t total = static_cast<std::uint64_t>(size) * count;
+
+        if (total == 0) {
+            return 0;
+        }
+
+        stats_.writes_++;
+        drop_read_buffer();
+
+        const std::uint8_t *source = reinterpret_cast<const std::uint8_t *>(data);
+
+        if (!write_buf_.empty() && (pos_ == write_buf_pos_ + write_buf_.size()) && (write_buf_.size() + total <= WRITE_BUFFER_SIZE)) {
+            write_buf_.insert(write_buf_.end(), source, source + total);
+            stats_.coalesced_writes_++;
+        } else {
+            if (!flush_writes()) {
+                return 0;
+            }
+
+            if (total >= WRITE_BUFFER_SIZE) {
+                inner_->seek(static_cast<std::int64_t>(pos_), file_seek_mode::beg);
+
+                const std::size_t written = inner_->write_file(data, 1, static_cast<std::uint32_t>(total));
+                stats_.host_writes_++;
+
+                inner_pos_ = UNKNOWN_POSITION;
+                pos_ += written;
+
+                if (size_) {
+                    size_ = common::max<std::uint64_t>(size_.value(), pos_);
+                }
+
+                return written;
+            }
+
+            write_buf_pos_ = pos_;
+            write_buf_.assign(source, source + total);
+        }
+
+        pos_ += total;
+
+        if (size_) {
+            size_ = common::max<std::uint64_t>(size_.value(), pos_);
+        }
+
+        return static_cast<size_t>(total);
+    }
+
+    int buffered_file::file_mode() const {
+        return inner_->file_mode();
+    }
+
+    std::u16string buffered_file::file_name() const {
+        return inner_->file_name();
+    }
+
+    uint64_t buffered_file::size() const {
+        const std::lock_guard<std::mutex> guard(lock_);
+        return current_size();
+    }
+
+    std::uint64_t buffered_file::current_size() const {
+        if (!buffering_) {
+            return inner_->size();
+        }
+
+        // Only this handle changes the file while buffering, so ask the host once
+        if (!size_) {
+            size_ = inner_->size();
+
+            if (!write_buf_.empty()) {
+                size_ = common::max<std::uint64_t>(size_.value(), write_buf_pos_ + write_buf_.size());
+            }
+        }
+
+        return size_.value();
+    }
+
+    uint64_t buffered_file::seek(std::int64_t seek_off, file_seek_mode where) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (!buffering_) {
+            return inner_->seek(seek_off, where);
+        }
+
+        std::int64_t new_pos = seek_off;
+
+        switch (where) {
+        case file_seek_mode::address: {
+            // Let the underlying file decide, it knows where it lives
+            flush_writes();
+            drop_read_buffer();
+
+            inner_->seek(static_cast<std::int64_t>(pos_), file_seek_mode::beg);
+
+            const std::uint64_t result = inner_->seek(seek_off, where);
+            pos_ = inner_->tell();
+            inner_pos_ = pos_;
+
+            return result;
+        }
+
+        case file_seek_mode::crr:
+            new_pos += static_cast<std::int64_t>(pos_);
+            break;
+
+        case file_seek_mode::end:
+            new_pos += static_cast<std::int64_t>(current_size());
+            break;
+
+        default:
+            break;
+        }
+
+        if (new_pos < 0) {
+            LOG_ERROR(SERVICE_EFSRV, "Attempting to seek to a negative position ({})", new_pos);
+            return 0xFFFFFFFFFFFFFFFF;
+        }
+
+        pos_ = static_cast<std::uint64_t>(new_pos);
+        return pos_;
+    }
+
+    uint64_t buffered_file::tell() {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (!buffering_) {
+            return inner_->tell();
+        }
+
+        return pos_;
+    }
+
+    bool buffered_file::close() {
+        bool flushed = true;
+
+        {
+            const std::lock_guard<std::mutex> guard(lock_);
+
+            flushed = flush_writes();
+            drop_read_buffer();
+        }
+
+        // Leave the handle's lock first, the registry lock goes before it
+        if (registry_) {
+            registry_->remove(this);
+            registry_ = nullptr;
+        }
+
+        const std::lock_guard<std::mutex> guard(lock_);
+        return inner_->close() && flushed;
+    }
+
+    bool buffered_file::is_closed() const {
+        return inner_->is_closed();
+    }
+
+    bool buffered_file::flush() {
+        const std::lock_guard<std::mutex> guard(lock_);
+        const bool flushed = flush_writes();
+        return inner_->flush() && flushed;
+    }
+
+    bool buffered_file::resize(const std::size_t new_size) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (!flush_writes()) {
+            return false;
+        }
+
+        drop_read_buffer();
+        size_.reset();
+
+        const bool result = inner_->resize(new_size);
+        inner_pos_ = UNKNOWN_POSITION;
+
+        if (buffering_) {
+            // Resizing may reopen the file, put the cursor back where we think it is
+            inner_->seek(static_cast<std::int64_t>(pos_), file_seek_mode::beg);
+            inner_pos_ = pos_;
+        }
+
+        return result;
+    }
+
+    std::string buffered_file::get_error_descriptor() {
+        return inner_->get_error_descriptor();
+    }
+
+    bool buffered_file::is_in_rom() const {
+        return inner_->is_in_rom();
+    }
+
+    address buffered_file::rom_address() const {
+        return inner_->rom_address();
+    }
+
+    bool buffered_file::valid() {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        if (!buffering_) {
+            return inner_->valid();
+        }
+
+        return pos_ < current_size();
+    }
+
+    std::uint64_t buffered_file::last_modify_since_0ad() {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        flush_writes();
+        return inner_->last_modify_since_0ad();
+    }
+
+    const std::uint8_t *buffered_file::map_view(const std::uint64_t offset, const std::uint64_t size) {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        flush_writes();
+        return inner_->map_view(offset, size);
+    }
+
+    bool buffered_file::is_mappable() const {
+        return inner_->is_mappable();
+    }
+
+    std::u16string buffered_file_registry::make_key(const std::u16string &path) {
+        return common::lowercase_ucs2_string(path);
+    }
+
+    buffered_file_registry::~buffered_file_registry() {
+        const std::lock_guard<std::mutex> guard(lock_);
+
+        // Handles outliving the server still own their data, just stop them from calling back
+        for (auto &[key, files] : files_) {
+            for (buffered_file *f : files) {
+                f->flush();
+                f->registry_ = nullptr;
+            }
+        }
+    }
+
+    void buffered_file_registry::add(buffered_file *f) {
+        const std::lock_guard<std::mutex> guard(lock_);
+        std::vector<buffered_file *> &files = files_[make_key(f->name_)];
+        files.push_back(f);
+
+        if (files.size() == 2) {
+            files[0]->set_buffering(false);
+        }
+
+        f->set_buffering(files.size() == 1);
+    }
+
+    void buffered_file_registry::remove(buffered_file *f) {
+        const std::lock_guard<std::mutex> guard(lock_);
+        auto ite = files_.find(make_key(f->name_));
+
+        if (ite == files_.end()) {
+            return;
+        }
+
+        std::vector<buffered_file *> &files = ite->second;
+        files.erase(std::remove(files.begin(), files.end(), f), files.end());
+
+        if (files.empty()) {
+            files_.erase(ite);
+        } else if (files.size() == 1) {
+            files[0]->set_buffering(true);
+        }
+    }
+
+    void buffered_file_registry::flush_for_io(void *userdata, const std::u16string &path) {
+        reinterpret_cast<buffered_file_registry *>(userdata)->flush(path);
+    }
+
+    void buffered_file_registry::flush(const std::u16string &path) {
+        const std::lock_guard<std::mutex> guard(lock_);
+        auto ite = files_.find(make_key(path));
+
+        if (ite == files_.end()) {
+            return;
+        }
+
+        for (buffered_file *f : ite->second) {
+            f->flush();
+        }
+    }
+
+    std::unique_ptr<file> make_buffered_file(std::unique_ptr<file> inner, buffered_file_registry *registry) {
+        if (!inner) {
+            return nullptr;
+        }
+
+        const int mode = inner->file_mode();
+
+        if (!(mode & BIN_MODE) || (mode & APPEND_MODE) || inner->is_in_rom() || inner->is_mappable()) {
+            return inner;
+        }
+
+        return std::make_unique<buffered_file>(std::move(inner), registry);
+    }
+}
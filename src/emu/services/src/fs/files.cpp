@@ -34,6 +34,10 @@
 
 #include <services/fs/sec.h>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 namespace eka2l1 {
     bool file_attrib::claim_exclusive(const kernel::uid pr_uid) {
         if (owner == pr_uid) {
@@ -405,6 +409,12 @@ namespace eka2l1 {
             return;
         }
 
+        server<fs_server>()->get_section_cache().invalidate(vfs_file->file_name());
+        server<fs_server>()->get_section_cache().invalidate(new_path_abs);
+
+        // Pending data must land in the file before it moves
+        vfs_file->flush();
+
         bool res = ctx->sys->get_io_system()->rename(vfs_file->file_name(), new_path_abs);
 
         if (!res) {
@@ -418,7 +428,8 @@ namespace eka2l1 {
 
         vfs_file->close();
 
-        symfile new_vfs_file = ctx->sys->get_io_system()->open_file(new_path_abs, last_mode);
+        symfile new_vfs_file = make_buffered_file(ctx->sys->get_io_system()->open_file(new_path_abs, last_mode),
+            &server<fs_server>()->get_buffered_files());
         new_vfs_file->seek(last_pos, file_seek_mode::beg);
 
         node->vfs_node = std::move(new_vfs_file);
@@ -471,9 +482,9 @@ namespace eka2l1 {
         if (write_pos > size_of_file) {
             // Fill the file with temporary 0
             vfs_file->seek(0, file_seek_mode::end);
-            static char ZERO_BYTE = 0;
+            const std::vector<std::uint8_t> zeroes(static_cast<std::size_t>(write_pos - size_of_file), 0);
 
-            if (vfs_file->write_file(&ZERO_BYTE, 1, static_cast<std::uint32_t>(write_pos - size_of_file)) != write_pos - size_of_file) {
+            if (vfs_file->write_file(zeroes.data(), 1, static_cast<std::uint32_t>(zeroes.size())) != zeroes.size()) {
                 LOG_WARN(SERVICE_EFSRV, "Unable to supply stubbed bytes for beyond file size write operation!");
             }
         }
@@ -531,15 +542,36 @@ namespace eka2l1 {
 
         uint64_t size = vfs_file->size();
 
-        if (size - read_pos < read_len) {
+        if (read_pos >= size) {
+            read_len = 0;
+        } else if (size - read_pos < read_len) {
             read_len = static_cast<int>(size - read_pos);
         }
 
-        std::vector<char> read_data;
-        read_data.resize(read_len);
+        read_len = std::min<int>(read_len, static_cast<int>(ctx->get_argument_max_data_size(0)));
+
+        // Read straight into the client's descriptor, then only fix up its length
+        std::uint8_t *dest = ctx->get_descriptor_argument_ptr(0);
+
+        if (!dest) {
+            ctx->complete(epoc::error_argument);
+            return;
+        }
 
-        size_t read_finish_len = vfs_file->read_file(read_data.data(), 1, read_len);
-        ctx->write_data_to_descriptor_argument(0, reinterpret_cast<uint8_t *>(read_data.data()), static_cast<std::uint32_t>(read_finish_len));
+        size_t read_finish_len = 0;
+
+        if (read_len > 0) {
+            // Files that can't change while open (ROM, ROFS, read-only drives) are copied from their view
+            if (const std::uint8_t *view = vfs_file->map_view(read_pos, static_cast<std::uint64_t>(read_len))) {
+                std::memcpy(dest, view, read_len);
+                vfs_file->seek(static_cast<std::int64_t>(read_pos + read_len), file_seek_mode::beg);
+
+                read_finish_len = static_cast<std::size_t>(read_len);
+            } else {
+                read_finish_len = vfs_file->read_file(dest, 1, read_len);
+            }
+        }
+        ctx->set_descriptor_argument_length(0, static_cast<std::uint32_t>(read_finish_len));
 
         //LOG_TRACE(SERVICE_EFSRV, "Readed {} from {} to address 0x{:x}", read_finish_len, read_pos, ctx->msg->args.args[0]);
         ctx->complete(epoc::error_none);
@@ -740,27 +772,29 @@ namespace eka2l1 {
             buffer_length = ctx->get_argument_value<std::uint32_t>(3).value();
         }
 
-        // Open the file, one time only, from VFS
-        io_system *io = ctx->sys->get_io_system();
-        symfile target_file = io->open_file(target_file_path.value(), READ_MODE | BIN_MODE);
-
-        if (!target_file) {
-            ctx->complete(epoc::error_path_not_found);
-            return;
-        }
-
         std::uint32_t slot_to_set_length = (old_read_model ? 3 : 0);
         std::uint8_t *buffer = ctx->get_descriptor_argument_ptr(slot_to_set_length);
 
         if (!buffer) {
             ctx->complete(epoc::error_argument);
-            target_file->close();
             return;
         }
 
-        target_file->seek(position, eka2l1::file_seek_mode::beg);
-        const std::size_t readed_size = target_file->read_file(buffer, buffer_length, 1);
-        target_file->close();
+        buffer_length = std::min<std::uint32_t>(buffer_length, static_cast<std::uint32_t>(ctx->get_argument_max_data_size(slot_to_set_length)));
+
+        // Sections of the same few files are read in bursts, keep their handles around
+        io_system *io = ctx->sys->get_io_system();
+        bool file_found = false;
+
+        server<fs_server>()->get_buffered_files().flush(target_file_path.value());
+
+        const std::size_t readed_size = server<fs_server>()->get_section_cache().read(io, target_file_path.value(), position,
+            buffer, buffer_length, &file_found);
+
+        if (!file_found) {
+            ctx->complete(epoc::error_path_not_found);
+            return;
+        }
 
         if (!ctx->set_descriptor_argument_length(slot_to_set_length, static_cast<std::uint32_t>(readed_size))) {
             ctx->complete(epoc::error_argument);
@@ -914,7 +948,12 @@ namespace eka2l1 {
         // TODO
 
         //======================= DO OPEN AND FILL ==========================
-        new_node->vfs_node = io->open_file(name, access_mode);
+        if (access_mode & WRITE_MODE) {
+            // May be truncated or recreated
+            server<fs_server>()->get_section_cache().invalidate(name);
+        }
+
+        new_node->vfs_node = make_buffered_file(io->open_file(name, access_mode), &server<fs_server>()->get_buffered_files());
 
         if (!new_node->vfs_node) {
             LOG_TRACE(SERVICE_EFSRV, "Can't open file {}", common::ucs2_to_utf8(name));
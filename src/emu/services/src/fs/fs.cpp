@@ -172,6 +172,13 @@ namespace eka2l1 {
 
         system_drive_prop->first = static_cast<int>(FS_UID);
         system_drive_prop->second = static_cast<int>(SYSTEM_DRIVE_KEY);
+
+        // Services reading files straight from the VFS must see what clients wrote through us
+        sys->get_io_system()->set_pending_write_flusher(buffered_file_registry::flush_for_io, &buffered_files_);
+    }
+
+    fs_server::~fs_server() {
+        sys->get_io_system()->set_pending_write_flusher(nullptr, nullptr);
     }
 
     void fs_server_client::fetch(service::ipc_context *ctx) {
@@ -325,6 +332,10 @@ namespace eka2l1 {
 
         io_system *io = ctx->sys->get_io_system();
 
+        server<fs_server>()->get_buffered_files().flush(target);
+        server<fs_server>()->get_section_cache().invalidate(target);
+        server<fs_server>()->get_section_cache().invalidate(dest);
+
         // If exists, delete it so the new file can be replaced
         if (io->exist(dest)) {
             io->delete_entry(dest);
@@ -371,6 +382,8 @@ namespace eka2l1 {
             return;
         }
 
+        server<fs_server>()->get_buffered_files().flush(target);
+        server<fs_server>()->get_section_cache().invalidate(target);
         bool res = io->rename(target, dest);
 
         if (!res) {
@@ -397,6 +410,7 @@ namespace eka2l1 {
         }
 
         io_system *io = ctx->sys->get_io_system();
+        server<fs_server>()->get_section_cache().invalidate(path);
 
         bool success = io->delete_entry(path);
 
@@ -736,6 +750,8 @@ namespace eka2l1 {
         }
 
         io_system *io = ctx->sys->get_io_system();
+        server<fs_server>()->get_section_cache().invalidate(dir.value());
+
         io->delete_entry(dir.value());
 
         ctx->complete(epoc::error_none);
@@ -780,6 +796,8 @@ namespace eka2l1 {
 
         io_system *io = ctx->sys->get_io_system();
 
+        // Size and modification time must include what open handles still hold
+        server<fs_server>()->get_buffered_files().flush(fname);
         std::optional<entry_info> entry_hle = io->get_entry_info(fname);
 
         if (!entry_hle) {
@@ -810,6 +828,8 @@ namespace eka2l1 {
 
         io_system *io = ctx->sys->get_io_system();
 
+        // Size and modification time must include what open handles still hold
+        server<fs_server>()->get_buffered_files().flush(fname);
         std::optional<entry_info> entry_hle = io->get_entry_info(fname);
 
         if (!entry_hle) {
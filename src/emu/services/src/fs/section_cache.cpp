@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team
+ * 
+ * This file is part of EKA2L1 project
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <services/fs/section_cache.h>
+#include <vfs/vfs.h>
+
+#include <common/algorithm.h>
+#include <common/log.h>
+#include <common/path.h>
+
+namespace eka2l1 {
+    static std::u16string make_section_cache_key(const std::u16string &path) {
+        std::u16string key = common::lowercase_ucs2_string(path);
+
+        while ((key.length() > 1) && eka2l1::is_separator(key.back())) {
+            key.pop_back();
+        }
+
+        return key;
+    }
+
+    file_section_cache::file_section_cache(const std::size_t capacity)
+        : capacity_(capacity) {
+    }
+
+    file_section_cache::~file_section_cache() {
+        LOG_TRACE(SERVICE_EFSRV, "File section cache: {} hits, {} misses, {} evictions", stats_.hits_, stats_.misses_,
+            stats_.evictions_);
+    }
+
+    file *file_section_cache::get(io_system *io, const std::u16string &path) {
+        const std::u16string key = make_section_cache_key(path);
+        const std::optional<entry_info> info = io->get_entry_info(path);
+
+        for (auto ite = files_.begin(); ite != files_.end(); ite++) {
+            if (ite->key_ != key) {
+                continue;
+            }
+
+            if (info && (info->type == io_component_type::file) && (info->size == ite->size_) && (info->last_write == ite->modify_time_)) {
+                stats_.hits_++;
+                files_.splice(files_.begin(), files_, ite);
+
+                return files_.front().file_.get();
+            }
+
+            // Changed under us, reopen it
+            files_.erase(ite);
+            break;
+        }
+
+        stats_.misses_++;
+
+        if (!info || (info->type != io_component_type::file)) {
+            return nullptr;
+        }
+
+        std::unique_ptr<file> target = io->open_file(path, READ_MODE | BIN_MODE);
+
+        if (!target) {
+            return nullptr;
+        }
+
+        if (files_.size() >= capacity_) {
+            files_.pop_back();
+            stats_.evictions_++;
+        }
+
+        files_.push_front(cached_file{ key, std::move(target), info->size, info->last_write });
+        return files_.front().file_.get();
+    }
+
+    std::size_t file_section_cache::read(io_system *io, const std::u16string &path, const std::uint64_t position, void *dest,
+        const std::size_t size, bool *found) {
+        file *target = get(io, path);
+
+        if (found) {
+            *found = (target != nullptr);
+        }
+
+        if (!target) {
+            return 0;
+        }
+
+        if (target->seek(position, file_seek_mode::beg) != position) {
+            return 0;
+        }
+
+        return target->read_file(dest, 1, static_cast<std::uint32_t>(size));
+    }
+
+    void file_section_cache::invalidate(const std::u16string &path) {
+        const std::u16string key = make_section_cache_key(path);
+
+        for (auto ite = files_.begin(); ite != files_.end();) {
+            const bool under = (ite->key_.length() > key.length()) && (ite->key_.compare(0, key.length(), key) == 0)
+                && eka2l1::is_separator(ite->key_[key.length()]);
+
+            if ((ite->key_ == key) || under) {
+                ite = files_.erase(ite);
+            } else {
+                ite++;
+            }
+        }
+    }
+
+    void file_section_cache::clear() {
+        files_.clear();
+    }
+}
@@ -37,7 +37,9 @@
 
 #include <common/buffer.h>
 #include <common/log.h>
+#include <common/pixel.h>
 #include <common/runlen.h>
+#include <common/thread_pool.h>
 #include <common/time.h>
 
 #define XXH_INLINE_ALL
@@ -77,111 +79,22 @@ namespace eka2l1::epoc {
         return (dsp == epoc::display_mode::color16) || (dsp == epoc::display_mode::color256);
     }
 
-    static char *converted_one_bpp_to_twenty_four_bpp_bitmap(epoc::bitwise_bitmap *bw_bmp,
-        const std::uint32_t *original_ptr, std::size_t &raw_size) {
-        std::uint32_t byte_width_converted = common::align(bw_bmp->header_.size_pixels.x * 3, 4);
+    // GPU don't support them. Palette and below 8 bpp bitmaps are expanded to 24 bpp on CPU
+    static char *convert_bitmap_to_twenty_four_bpp(epoc::bitwise_bitmap *bw_bmp, const std::uint8_t *original_ptr,
+        const common::pixel_format source_format, const std::uint32_t *palette, std::size_t &raw_size) {
+        const std::uint32_t byte_width_converted = common::align(bw_bmp->header_.size_pixels.x * 3, 4);
         raw_size = byte_width_converted * bw_bmp->header_.size_pixels.y;
 
         char *return_ptr = new char[raw_size];
 
-        for (std::size_t y = 0; y < bw_bmp->header_.size_pixels.y; y++) {
-            for (std::size_t x = 0; x < bw_bmp->header_.size_pixels.x; x++) {
-                std::uint32_t word_per_line = (bw_bmp->header_.size_pixels.x + 31) / 32;
-                std::uint32_t color = original_ptr[y * word_per_line + x / 32];
-                std::uint32_t converted_color = 0;
-                if (color & (1 << (x & 0x1F))) {
-                    converted_color = 0xFFFFFF;
-                }
-
-                std::memcpy(return_ptr + byte_width_converted * y + x * 3, reinterpret_cast<const char *>(&converted_color), 3);
-            }
-        }
-        return return_ptr;
-    }
-    
-    static char *converted_gray_four_bpp_to_twenty_four_bpp_bitmap(epoc::bitwise_bitmap *bw_bmp,
-        const std::uint8_t *original_ptr, std::size_t &raw_size) {
-        std::uint32_t byte_width_converted = common::align(bw_bmp->header_.size_pixels.x * 3, 4);
-        raw_size = byte_width_converted * bw_bmp->header_.size_pixels.y;
-
-        char *return_ptr = new char[raw_size];
-        std::uint32_t scan_line_size = ((bw_bmp->header_.size_pixels.x + 7) >> 3) << 2;
-
-        for (std::size_t y = 0; y < bw_bmp->header_.size_pixels.y; y++) {
-            for (std::size_t x = 0; x < bw_bmp->header_.size_pixels.x / 2; x++) {
-                std::uint8_t gray_pack = original_ptr[y * scan_line_size + x];
-                std::uint8_t converted_color_comp_first = (gray_pack & 0xF) | ((gray_pack & 0xF) << 4);
-                std::uint8_t converted_color_comp_second = ((gray_pack & 0xF0) >> 4) | (gray_pack & 0xF0);
-
-                std::memset(return_ptr + y * byte_width_converted + x * 3 * 2, converted_color_comp_first, 3);
-                std::memset(return_ptr + y * byte_width_converted + x * 3 * 2 + 3, converted_color_comp_second, 3);
-            }
-        }
-
-        return return_ptr;
-    }
-
-    static char *converted_palette_bitmap_to_twenty_four_bitmap(epoc::bitwise_bitmap *bw_bmp,
-        const std::uint8_t *original_ptr, epoc::palette_256 &the_palette, epoc::palette_16 &the_palette_16,
-        std::size_t &raw_size) {
-        std::uint32_t byte_width_converted = common::align(bw_bmp->header_.size_pixels.x * 3, 4);
-        raw_size = byte_width_converted * bw_bmp->header_.size_pixels.y;
-        char *return_ptr = new char[raw_size];
-
-        epoc::display_mode dsp = bw_bmp->settings_.current_display_mode();
-        if (dsp == epoc::display_mode::none) {
-            dsp = bw_bmp->settings_.initial_display_mode();
-        }
-
-        std::uint32_t skip_width = 1;
-        if (dsp == epoc::display_mode::color16) {
-            skip_width = 2;
-        }
-
-        for (std::size_t y = 0; y < bw_bmp->header_.size_pixels.y; y++) {
-            for (std::size_t x = 0; x < bw_bmp->header_.size_pixels.x / skip_width; x++) {
-                switch (dsp) {
-                case epoc::display_mode::color256: {
-                    const std::uint8_t palette_index = original_ptr[y * bw_bmp->byte_width_ + x];
-                    const std::uint32_t palette_color = the_palette[palette_index];
-                    const std::size_t location = byte_width_converted * y + x * 3;
-
-                    return_ptr[location + 2] = palette_color & 0xFF;
-                    return_ptr[location + 1] = (palette_color >> 8) & 0xFF;
-                    return_ptr[location] = (palette_color >> 16) & 0xFF;
-
-                    break;
-                }
-
-                case epoc::display_mode::color16: {
-                    const std::uint8_t palette_index_for_two = original_ptr[y * bw_bmp->byte_width_ + x];
-                    const std::uint32_t palette_color_first = the_palette[palette_index_for_two & 0xFFFF];
-                    const std::uint32_t palette_color_second = the_palette[(palette_index_for_two >> 4) & 0xFFFF];
-                    const std::size_t location = byte_width_converted * y + x * 3 * 2;
-
-                    return_ptr[location + 2] = palette_color_first & 0xFF;
-                    return_ptr[location + 1] = (palette_color_first >> 8) & 0xFF;
-                    return_ptr[location] = (palette_color_first >> 16) & 0xFF;
-
-                    return_ptr[location + 5] = palette_color_second & 0xFF;
-                    return_ptr[location + 4] = (palette_color_second >> 8) & 0xFF;
-                    return_ptr[location + 3] = (palette_color_second >> 16) & 0xFF;
-                    
-                    break;
-                }
-
-                default:
-                    LOG_ERROR(SERVICE_WINDOW, "Unhandled display mode to convert {}", static_cast<int>(dsp));
-                    break;
-                }
-            }
-        }
+        common::convert_pixel_rows(return_ptr, byte_width_converted, common::pixel_format::bgr888, original_ptr, bw_bmp->byte_width_,
+            source_format, bw_bmp->header_.size_pixels.x, bw_bmp->header_.size_pixels.y, palette, &common::get_shared_thread_pool());
 
         return return_ptr;
     }
 
     static std::uint32_t get_suitable_bpp_for_bitmap(epoc::bitwise_bitmap *bmp) {
-        if (is_palette_bitmap(bmp) || (bmp->header_.bit_per_pixels == 1) || (bmp->header_.bit_per_pixels == 4)) {
+        if (is_palette_bitmap(bmp) || (bmp->header_.bit_per_pixels < 8)) {
             return 24;
         }
 
@@ -345,7 +258,6 @@ namespace eka2l1::epoc {
                 data_pointer = new_data_pointer;
             }
 
-            std::uint32_t bpp = bmp->header_.bit_per_pixels;
             std::size_t pixels_per_line = 0;
 
             if ((bmp->header_.bit_per_pixels % 8) == 0) {
@@ -359,45 +271,36 @@ namespace eka2l1::epoc {
                 dsp = bmp->settings_.initial_display_mode();
             }
 
-            // GPU don't support them. Convert them on CPU
-            if (is_palette_bitmap(bmp) || (dsp == epoc::display_mode::gray16)) {
-                char *new_pointer = nullptr;
-                if (dsp == epoc::display_mode::gray16) {
-                    new_pointer = converted_gray_four_bpp_to_twenty_four_bpp_bitmap(bmp, reinterpret_cast<const std::uint8_t *>(data_pointer), raw_size_big);
-                } else {
-                    new_pointer = converted_palette_bitmap_to_twenty_four_bitmap(bmp, reinterpret_cast<const std::uint8_t *>(data_pointer),
-                        epoc::get_suitable_palette_256(kern->get_epoc_version()), epoc::color_16_palette, raw_size_big);
+            if (is_palette_bitmap(bmp) || (bmp->header_.bit_per_pixels < 8)) {
+                // The data is laid out for the bit count in the header, the display mode may say otherwise
+                epoc::display_mode data_mode = dsp;
+                if (get_bpp_from_display_mode(data_mode) != static_cast<int>(bmp->header_.bit_per_pixels)) {
+                    data_mode = get_display_mode_from_bpp(bmp->header_.bit_per_pixels, bmp->header_.color);
                 }
 
-                bpp = 24;
-                raw_size = static_cast<std::uint32_t>(raw_size_big);
+                common::pixel_format source_format = common::pixel_format::bgr888;
+                const std::uint32_t *palette = nullptr;
 
-                delete[] data_pointer;
-                data_pointer = new_pointer;
-
-                // Use default
-                pixels_per_line = 0;
-            }
-
-            char *newly_pointer = nullptr;
+                if (data_mode == epoc::display_mode::color16) {
+                    palette = epoc::color_16_palette.data();
+                } else if (data_mode == epoc::display_mode::color256) {
+                    palette = epoc::get_suitable_palette_256(kern->get_epoc_version()).data();
+                }
 
-            switch (bpp) {
-            case 1:
-                newly_pointer = converted_one_bpp_to_twenty_four_bpp_bitmap(bmp, reinterpret_cast<const std::uint32_t *>(data_pointer),
-                    raw_size_big);
-                bpp = 24;
-                raw_size = static_cast<std::uint32_t>(raw_size_big);
-                pixels_per_line = 0;
+                if (get_pixel_format_from_display_mode(data_mode, source_format)) {
+                    char *new_pointer = convert_bitmap_to_twenty_four_bpp(bmp, reinterpret_cast<const std::uint8_t *>(data_pointer),
+                        source_format, palette, raw_size_big);
 
-                break;
+                    raw_size = static_cast<std::uint32_t>(raw_size_big);
 
-            default:
-                break;
-            }
+                    delete[] data_pointer;
+                    data_pointer = new_pointer;
 
-            if (newly_pointer) {
-                delete[] data_pointer;
-                data_pointer = newly_pointer;
+                    // Use default
+                    pixels_per_line = 0;
+                } else {
+                    LOG_ERROR(SERVICE_WINDOW, "Unhandled display mode to convert {}", static_cast<int>(data_mode));
+                }
             }
 
             if (builder) {
@@ -150,9 +150,8 @@ namespace eka2l1::epoc {
         epoc::gdi_store_command_draw_text_data &draw_text_data = draw_text_cmd.get_data_struct<epoc::gdi_store_command_draw_text_data>();
 
         draw_text_cmd.opcode_ = epoc::gdi_store_command_draw_text;
-        draw_text_data.string_ = reinterpret_cast<char16_t*>(draw_text_cmd.allocate_dynamic_data((text.length() + 1) * sizeof(char16_t)));
-
-        std::memcpy(draw_text_data.string_, text.data(), (text.length() + 1) * sizeof(char16_t));
+        draw_text_data.string_ = const_cast<char16_t*>(text.c_str());
+        draw_text_cmd.attach_dynamic_data(text.c_str(), (text.length() + 1) * sizeof(char16_t));
 
         draw_text_data.alignment_ = static_cast<std::uint32_t>(align);
         draw_text_data.text_box_ = area;
@@ -296,9 +295,9 @@ namespace eka2l1::epoc {
             epoc::gdi_store_command_set_clip_rect_multiple_data &data = cmd.get_data_struct<epoc::gdi_store_command_set_clip_rect_multiple_data>();
 
             data.rect_count_ = static_cast<std::uint32_t>(the_region->rects_.size());
-            data.rects_ = reinterpret_cast<eka2l1::rect*>(cmd.allocate_dynamic_data(data.rect_count_ * sizeof(eka2l1::rect)));
+            data.rects_ = the_region->rects_.data();
 
-            std::memcpy(data.rects_, the_region->rects_.data(), data.rect_count_ * sizeof(eka2l1::rect));
+            cmd.attach_dynamic_data(the_region->rects_.data(), data.rect_count_ * sizeof(eka2l1::rect));
         }
 
         attached_window->add_draw_command(cmd);
@@ -647,9 +646,9 @@ namespace eka2l1::epoc {
             cmd_data.point_count_ = 5;
             cmd_data.color_ = pen_color;
             cmd_data.style_ = pen_style;
-            cmd_data.points_ = reinterpret_cast<eka2l1::point*>(gdi_cmd.allocate_dynamic_data(5 * sizeof(eka2l1::point)));
+            cmd_data.points_ = point_list;
 
-            std::memcpy(cmd_data.points_, point_list, 5 * sizeof(eka2l1::point));
+            gdi_cmd.attach_dynamic_data(point_list, 5 * sizeof(eka2l1::point));
 
             attached_window->add_draw_command(gdi_cmd);
         }
@@ -661,6 +660,7 @@ namespace eka2l1::epoc {
             rect_draw_data.rect_ = area;
             rect_draw_data.color_ = pen_color;
             gdi_cmd.opcode_ = epoc::gdi_store_command_draw_rect;
+            gdi_cmd.attach_dynamic_data(nullptr, 0);
 
             attached_window->add_draw_command(gdi_cmd);
         }
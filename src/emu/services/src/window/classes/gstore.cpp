@@ -25,12 +25,61 @@
 #include <services/fbs/fbs.h>
 #include <services/fbs/bitmap.h>
 
-#include <common/time.h>
 #include <common/algorithm.h>
 
+#include <cstring>
+
 namespace eka2l1::epoc {
-    // NOTE: Must store objects then free ref with local font atlas.
+    static std::size_t gdi_store_command_data_size(const gdi_store_command_opcode opcode) {
+        switch (opcode) {
+        case gdi_store_command_draw_rect:
+            return sizeof(gdi_store_command_draw_rect_data);
+
+        case gdi_store_command_draw_line:
+            return sizeof(gdi_store_command_draw_line_data);
+
+        case gdi_store_command_draw_polygon:
+            return sizeof(gdi_store_command_draw_polygon_data);
+
+        case gdi_store_command_draw_bitmap:
+            return sizeof(gdi_store_command_draw_bitmap_data);
+
+        case gdi_store_command_draw_text:
+            return sizeof(gdi_store_command_draw_text_data);
+
+        case gdi_store_command_set_clip_rect_single:
+            return sizeof(gdi_store_command_set_clip_rect_single_data);
+
+        case gdi_store_command_set_clip_rect_multiple:
+            return sizeof(gdi_store_command_set_clip_rect_multiple_data);
+
+        case gdi_store_command_update_texture:
+            return sizeof(gdi_store_command_update_texture_data);
+
+        default:
+            break;
+        }
+
+        return 0;
+    }
+
+    static constexpr std::size_t align_record_size(const std::size_t size) {
+        return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    }
+
+    gdi_store_command_segment::gdi_store_command_segment(common::arena_chunk_pool &pool)
+        : type_(gdi_store_command_segment_non_redraw)
+        , stream_(pool)
+        , first_command_(nullptr)
+        , last_command_(nullptr) {
+    }
+
     gdi_store_command_segment::~gdi_store_command_segment() {
+        reset();
+    }
+
+    // NOTE: Must store objects then free ref with local font atlas.
+    void gdi_store_command_segment::reset() {
         for (std::size_t i = 0; i < font_objects_.size(); i++) {
             reinterpret_cast<fbsfont*>(font_objects_[i])->deref();
         }
@@ -38,6 +87,15 @@ namespace eka2l1::epoc {
         for (std::size_t i = 0; i < bitmap_objects_.size(); i++) {
             reinterpret_cast<fbsbitmap*>(bitmap_objects_[i])->deref();
         }
+
+        font_objects_.clear();
+        bitmap_objects_.clear();
+
+        region_.make_empty();
+        stream_.reset();
+
+        first_command_ = nullptr;
+        last_command_ = nullptr;
     }
 
     void gdi_store_command_segment::add_command(gdi_store_command &command) {
@@ -74,18 +132,78 @@ namespace eka2l1::epoc {
             }
         }
 
-        commands_.push_back(command);
+        // Layout: record header, data struct, dynamic data. All in one piece of the stream.
+        const std::size_t data_size = gdi_store_command_data_size(command.opcode_);
+        const std::size_t header_and_data_size = align_record_size(sizeof(gdi_store_command_record) + data_size);
+        const std::size_t record_size = header_and_data_size + align_record_size(command.dynamic_size_);
+
+        std::uint8_t *record_ptr = reinterpret_cast<std::uint8_t*>(stream_.allocate(record_size));
+        gdi_store_command_record *record = reinterpret_cast<gdi_store_command_record*>(record_ptr);
+
+        record->opcode_ = command.opcode_;
+        record->record_size_ = static_cast<std::uint32_t>(record_size);
+        record->next_ = nullptr;
+
+        std::uint8_t *data_ptr = reinterpret_cast<std::uint8_t*>(record + 1);
+        std::memcpy(data_ptr, command.data_, data_size);
+
+        if (command.dynamic_data_ && command.dynamic_size_) {
+            std::uint8_t *dynamic_ptr = record_ptr + header_and_data_size;
+            std::memcpy(dynamic_ptr, command.dynamic_data_, command.dynamic_size_);
+
+            // Redirect the data struct to the copy living in the stream
+            switch (command.opcode_) {
+            case gdi_store_command_draw_text:
+                reinterpret_cast<gdi_store_command_draw_text_data*>(data_ptr)->string_ = reinterpret_cast<char16_t*>(dynamic_ptr);
+                break;
+
+            case gdi_store_command_draw_polygon:
+                reinterpret_cast<gdi_store_command_draw_polygon_data*>(data_ptr)->points_ = reinterpret_cast<eka2l1::point*>(dynamic_ptr);
+                break;
+
+            case gdi_store_command_set_clip_rect_multiple:
+                reinterpret_cast<gdi_store_command_set_clip_rect_multiple_data*>(data_ptr)->rects_ = reinterpret_cast<eka2l1::rect*>(dynamic_ptr);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        if (last_command_) {
+            last_command_->next_ = record;
+        } else {
+            first_command_ = record;
+        }
+
+        last_command_ = record;
     }
 
-    gdi_store_command_collection::gdi_store_command_collection()
-        : current_segment_(nullptr) {
+    gdi_store_command_collection::gdi_store_command_collection(common::arena_chunk_pool &pool)
+        : pool_(pool)
+        , current_segment_(nullptr) {
+    }
+
+    void gdi_store_command_collection::recycle_segment(std::unique_ptr<gdi_store_command_segment> &segment) {
+        if (segment.get() == current_segment_) {
+            current_segment_ = nullptr;
+        }
+
+        segment->reset();
+        free_segments_.push_back(std::move(segment));
     }
 
     gdi_store_command_segment *gdi_store_command_collection::add_new_segment(const eka2l1::rect &draw_rect, const gdi_store_command_segment_type type) {
-        std::unique_ptr<gdi_store_command_segment> new_segment = std::make_unique<gdi_store_command_segment>();
+        std::unique_ptr<gdi_store_command_segment> new_segment;
+
+        if (!free_segments_.empty()) {
+            new_segment = std::move(free_segments_.back());
+            free_segments_.pop_back();
+        } else {
+            new_segment = std::make_unique<gdi_store_command_segment>(pool_);
+        }
 
         new_segment->type_ = type;
-        new_segment->creation_date_ = common::get_current_utc_time_in_microseconds_since_epoch();
         new_segment->region_.add_rect(draw_rect);
 
         gdi_store_command_segment *new_segment_ptr = new_segment.get();
@@ -111,6 +229,12 @@ namespace eka2l1::epoc {
                     segments_[j]->region_.eliminate(lastest_segment->region_.rects_[i]);
 
                     if (segments_[j]->region_.empty()) {
+                        // Keep it alive until the redraw is done, then release everything at once
+                        if (segments_[j].get() == current_segment_) {
+                            current_segment_ = nullptr;
+                        }
+
+                        retired_segments_.push_back(std::move(segments_[j]));
                         segments_.erase(segments_.begin() + j);
                     } else {
                         j++;
@@ -129,25 +253,27 @@ namespace eka2l1::epoc {
             return false;
         }
 
-        std::uint32_t non_redraw_segment_count = 0;
+        std::size_t non_redraw_bytes = 0;
         for (std::size_t i = 0; i < segments_.size(); i++) {
             if (segments_[i]->type_ == gdi_store_command_segment_non_redraw) {
-                non_redraw_segment_count++;
+                non_redraw_bytes += segments_[i]->byte_size();
             }
         }
 
         // If we managed to clean out some old non-redraw segments, we gotta invalidate all the window
         // Because some non-redraw segment may need to stay there.
         bool need_invalidate = false;
-        std::int32_t left_to_keep = KEEP_NON_REDRAW_SEGMENTS;
+        std::size_t kept_bytes = 0;
 
-        if (non_redraw_segment_count > LIMIT_NON_REDRAW_SEGMENTS) {
-            for (std::int32_t i = 0; i < static_cast<std::int32_t>(segments_.size()); ) {
+        if (non_redraw_bytes > LIMIT_NON_REDRAW_BYTES) {
+            for (std::size_t i = 0; i < segments_.size(); ) {
                 if ((segments_[i].get() != current_segment_) && (segments_[i]->type_ == gdi_store_command_segment_non_redraw)) {
-                    if (left_to_keep-- > 0) {
+                    if (kept_bytes + segments_[i]->byte_size() <= KEEP_NON_REDRAW_BYTES) {
+                        kept_bytes += segments_[i]->byte_size();
                         i++;
                         continue;
                     } else {
+                        recycle_segment(segments_[i]);
                         segments_.erase(segments_.begin() + i);
                         need_invalidate = true;
                     }
@@ -158,26 +284,26 @@ namespace eka2l1::epoc {
         }
 
         if (current_segment_ && (current_segment_->type_ == gdi_store_command_segment_non_redraw)) {
-            std::uint64_t current_time = common::get_current_utc_time_in_microseconds_since_epoch();
-
-            // Try to make it able to be cleaned (this routine is actually from OSS)
-            if (current_time - current_segment_->creation_date_ > AGE_LIMIT_NONREDRAW_US) {
-                // Try to find older segments
-                for (std::size_t i = 0; i < segments_.size(); ) {
-                    if ((segments_[i].get() != current_segment_) && (segments_[i]->type_ == gdi_store_command_segment_non_redraw)) {
-                        if ((current_time - segments_[i]->creation_date_) > AGE_LIMIT_NONREDRAW_US * 2) {
-                            segments_.erase(segments_.begin() + i);
+            // Try to make it able to be cleaned (this routine is actually from OSS). The segment is aged by
+            // the amount of drawing done to it, rather than by time.
+            if (current_segment_->byte_size() > ROLLOVER_NON_REDRAW_BYTES) {
+                std::size_t newer_bytes = current_segment_->byte_size();
+
+                // Try to find older segments, those that have been drawn over by a lot since
+                for (std::size_t i = segments_.size(); i > 0; i--) {
+                    gdi_store_command_segment *segment = segments_[i - 1].get();
+
+                    if ((segment != current_segment_) && (segment->type_ == gdi_store_command_segment_non_redraw)) {
+                        if (newer_bytes > ROLLOVER_NON_REDRAW_BYTES * 2) {
+                            recycle_segment(segments_[i - 1]);
+                            segments_.erase(segments_.begin() + (i - 1));
                         } else {
-                            i++;
+                            newer_bytes += segment->byte_size();
                         }
-                    } else {
-                        i++;
                     }
                 }
 
-                current_segment_->creation_date_ = current_time;
                 current_segment_ = nullptr;
-
                 need_invalidate = true;
             }
         }
@@ -187,6 +313,21 @@ namespace eka2l1::epoc {
 
     void gdi_store_command_collection::redraw_done() {
         current_segment_ = nullptr;
+
+        for (std::size_t i = 0; i < retired_segments_.size(); i++) {
+            recycle_segment(retired_segments_[i]);
+        }
+
+        retired_segments_.clear();
+    }
+
+    std::size_t gdi_store_command_collection::total_bytes() const {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < segments_.size(); i++) {
+            total += segments_[i]->byte_size();
+        }
+
+        return total;
     }
 
     gdi_command_builder::gdi_command_builder(drivers::graphics_driver *drv, drivers::graphics_command_builder &builder, bitmap_cache &bcache,
@@ -201,12 +342,12 @@ namespace eka2l1::epoc {
     }
 
     void gdi_command_builder::build_segment(const gdi_store_command_segment &segment) {
-        for (std::size_t i = 0; i < segment.commands_.size(); i++) {
-            build_single_command(segment.commands_[i]);
+        for (const gdi_store_command_record *record = segment.first_command_; record; record = record->next_) {
+            build_single_command(*record);
         }
     }
 
-    void gdi_command_builder::build_single_command(const gdi_store_command &command) {
+    void gdi_command_builder::build_single_command(const gdi_store_command_record &command) {
         switch (command.opcode_) {
         case gdi_store_command_draw_rect:
             build_command_draw_rect(command.get_data_struct_const<gdi_store_command_draw_rect_data>());
@@ -310,25 +451,20 @@ namespace eka2l1::epoc {
 
         if (text_font->of_info.adapter->vectorizable()) {
             scaled_font_size = static_cast<std::int16_t>(scaled_font_size * scale_factor_);
-            
-            if ((text_font->atlas.atlas_handle_ != 0) && (scaled_font_size != text_font->atlas.get_char_size())) {
-                text_font->atlas.destroy(driver_);
-            }
         } else {
             scale_to_pass = scale_factor_;
         }
 
-        if (text_font->atlas.atlas_handle_ == 0) {
-            text_font->atlas.init(text_font->of_info.adapter, text_font->of_info.idx, 0x20, 0xFF - 0x20,
-                scaled_font_size);
-        }
+        // Atlases are shared by every font object of the same typeface and size
+        font_atlas *atlas = text_font->serv->get_glyph_cache().get_atlas(text_font->of_info.adapter, text_font->of_info.idx,
+            scaled_font_size);
 
         eka2l1::rect scaled_text_box = cmd.text_box_;
         scaled_text_box.top += position_;
 
         scale_rectangle(scaled_text_box, scale_factor_);
 
-        text_font->atlas.draw_text(cmd.string_, scaled_text_box, static_cast<epoc::text_alignment>(cmd.alignment_),
+        atlas->draw_text(cmd.string_, scaled_text_box, static_cast<epoc::text_alignment>(cmd.alignment_),
             driver_, builder_, scale_to_pass);
     }
 
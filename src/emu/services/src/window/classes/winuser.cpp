@@ -82,7 +82,9 @@ namespace eka2l1::epoc {
         , max_pointer_buffer_(0)
         , last_draw_(0)
         , last_fps_sync_(0)
-        , fps_count_(0) {
+        , fps_count_(0)
+        , last_store_allocation_count_(0)
+        , pending_segment_(store_pool_) {
         set_initial_state();
 
         abs_rect.top = reinterpret_cast<canvas_interface *>(parent)->absolute_position();
@@ -147,10 +149,6 @@ namespace eka2l1::epoc {
             return;
         }
 
-        if (!pending_segment_) {
-            pending_segment_ = std::make_unique<gdi_store_command_segment>();
-        }
-
         if (command.opcode_ == gdi_store_command_draw_bitmap) {
             // We must do it sync now...
             gdi_store_command_draw_bitmap_data &data = command.get_data_struct<gdi_store_command_draw_bitmap_data>();
@@ -178,15 +176,15 @@ namespace eka2l1::epoc {
             }
 
             if (new_update_command_main.opcode_ != gdi_store_command_invalid) {
-                pending_segment_->add_command(new_update_command_main);
+                pending_segment_.add_command(new_update_command_main);
             }
 
             if (new_update_command_mask.opcode_ != gdi_store_command_invalid) {
-                pending_segment_->add_command(new_update_command_mask);
+                pending_segment_.add_command(new_update_command_mask);
             }
         }
 
-        pending_segment_->add_command(command);
+        pending_segment_.add_command(command);
     }
 
     bool canvas_base::can_be_physically_seen() const {
@@ -416,6 +414,15 @@ namespace eka2l1::epoc {
             if (crr - last_fps_sync_ >= common::microsecs_per_sec) {
                 scr->last_fps = fps_count_;
 
+                // Heap allocations done by the command store in the last second. Should stay at zero in steady state
+                const std::uint64_t store_allocation_count = store_pool_.heap_allocation_count();
+                if (fps_count_ != 0) {
+                    LOG_TRACE(SERVICE_WINDOW, "Window 0x{:X}: {} command store allocations over {} frames", id,
+                        store_allocation_count - last_store_allocation_count_, fps_count_);
+                }
+
+                last_store_allocation_count_ = store_allocation_count;
+
                 last_fps_sync_ = crr;
                 fps_count_ = 0;
             }
@@ -835,7 +842,8 @@ namespace eka2l1::epoc {
 
     redraw_msg_canvas::redraw_msg_canvas(window_server_client_ptr client, screen *scr, window *parent,
         const epoc::display_mode dmode, const std::uint32_t client_handle)
-        : canvas_base(client, scr, parent, epoc::window_type::redraw, dmode, client_handle) {
+        : canvas_base(client, scr, parent, epoc::window_type::redraw, dmode, client_handle)
+        , redraw_segments_(store_pool_) {
     }
 
     void redraw_msg_canvas::handle_extent_changed(const eka2l1::vec2 &new_size, const eka2l1::vec2 &new_pos) {
@@ -962,6 +970,10 @@ namespace eka2l1::epoc {
 
         // remove all pending redraws. End redraw will report invalidates later
         client->remove_redraws(this);
+
+        // Segments replaced by the previous redraw are released now, so their chunks and segment
+        // objects get reused by this one
+        redraw_segments_.redraw_done();
         redraw_segments_.add_new_segment(redraw_rect_curr, epoc::gdi_store_command_segment_pending_redraw);
 
         flags |= flags_in_redraw;
@@ -1101,18 +1113,18 @@ namespace eka2l1::epoc {
 
         if (scr->flags_ & screen::FLAG_CLIENT_REDRAW_PENDING) {
             drivers::command_list cmd_list = driver_builder_.retrieve_command_list();
-            if (pending_segment_ || !cmd_list.empty()) {
+            if (!pending_segment_.empty() || !cmd_list.empty()) {
                 draw_background_color();
             }
 
-            if (pending_segment_) {
+            if (!pending_segment_.empty()) {
                 builder.clip_bitmap_region(visible_region, scr->display_scale_factor);
 
                 gdi_command_builder gdi_builder(client->get_ws().get_graphics_driver(), builder,
                     *client->get_ws().get_bitmap_cache(), filter, abs_rect.top, scr->display_scale_factor,
                     visible_region);
 
-                gdi_builder.build_segment(*pending_segment_);
+                gdi_builder.build_segment(pending_segment_);
                 pending_segment_.reset();
             }
 
@@ -1221,6 +1233,8 @@ namespace eka2l1::epoc {
     }
 
     bitmap_backed_canvas::~bitmap_backed_canvas() {
+        wait_pending_sync();
+
         if (bitmap_) {
             bitmap_->deref();
         }
@@ -1282,6 +1296,8 @@ namespace eka2l1::epoc {
             create_backed_bitmap();
         }
 
+        wait_pending_sync();
+
         if (!bitmap_) {
             ctx.complete(epoc::error_no_memory);
             return;
@@ -1297,42 +1313,75 @@ namespace eka2l1::epoc {
             return 0;
         }
 
-        if (pending_segment_) {
+        if (!pending_segment_.empty()) {
             gdi_command_builder gdi_builder(client->get_ws().get_graphics_driver(), driver_builder_,
                 *client->get_ws().get_bitmap_cache(), drivers::filter_option::linear, eka2l1::vec2(0, 0),
                 1.0f, common::region{});
 
-            gdi_builder.build_segment(*pending_segment_);
+            gdi_builder.build_segment(pending_segment_);
             pending_segment_.reset();
         }
 
+        // A queued read targets the same memory, let it land first
+        wait_pending_sync();
+
+        // Sync back to the bitmap. The read goes in the same list as the draws, so it costs no extra round trip.
+        int sync_status = 0;
+        int *queued_status = queue_sync_to_bitmap(&sync_status);
+
         drivers::command_list list = driver_builder_.retrieve_command_list();
         drv->submit_command_list(list);
 
         driver_builder_.bind_bitmap(driver_win_id);
 
-        // Sync back to the bitmap
-        if (bitmap_) {
-            if (bitmap_->bitmap_->compression_type() != epoc::bitmap_file_no_compression) {
-                LOG_ERROR(SERVICE_WINDOW, "Try to sync data back to backed bitmap canvas but compression is required on the bitmap!");
-            } else {
-                fbs_server *serv = client->get_ws().get_fbs_server();
+        // If FBS can not hold the read until the bitmap is next touched, the client may look at the bitmap
+        // as soon as this request completes, so the data must be there
+        if (queued_status == &sync_status) {
+            drv->wait_for(&sync_status);
+        }
+
+        return canvas_base::try_update(drawer);
+    }
+
+    int *bitmap_backed_canvas::queue_sync_to_bitmap(int *fallback_status) {
+        if (!bitmap_) {
+            return nullptr;
+        }
 
-                bool support_current_display_mode = true;
-                bool support_dirty_bitmap = true;
+        if (bitmap_->bitmap_->compression_type() != epoc::bitmap_file_no_compression) {
+            LOG_ERROR(SERVICE_WINDOW, "Try to sync data back to backed bitmap canvas but compression is required on the bitmap!");
+            return nullptr;
+        }
 
-                query_fbs_feature_support(serv, support_current_display_mode, support_dirty_bitmap);
+        fbs_server *serv = client->get_ws().get_fbs_server();
 
-                eka2l1::vec2 to_sync_size(common::min<int>(bitmap_->bitmap_->header_.size_pixels.x, size().x),
-                    common::min<int>(bitmap_->bitmap_->header_.size_pixels.y, size().y));
+        bool support_current_display_mode = true;
+        bool support_dirty_bitmap = true;
 
-                drivers::read_bitmap(drv, driver_win_id, eka2l1::point(0, 0), to_sync_size, get_bpp_from_display_mode(
-                    support_current_display_mode ? bitmap_->bitmap_->settings_.current_display_mode() : bitmap_->bitmap_->settings_.initial_display_mode()),
-                    bitmap_->bitmap_->data_pointer(serv));
-            }
+        query_fbs_feature_support(serv, support_current_display_mode, support_dirty_bitmap);
+
+        eka2l1::vec2 to_sync_size(common::min<int>(bitmap_->bitmap_->header_.size_pixels.x, size().x),
+            common::min<int>(bitmap_->bitmap_->header_.size_pixels.y, size().y));
+
+        std::uint8_t *data = bitmap_->bitmap_->data_pointer(serv);
+
+        // Let FBS hold the read in flight until the bitmap data is next touched, if it can
+        int *status = serv->defer_bitmap_read(bitmap_->bitmap_);
+        if (!status) {
+            status = fallback_status;
         }
 
-        return canvas_base::try_update(drawer);
+        driver_builder_.read_bitmap(driver_win_id, eka2l1::point(0, 0), to_sync_size, get_bpp_from_display_mode(
+            support_current_display_mode ? bitmap_->bitmap_->settings_.current_display_mode() : bitmap_->bitmap_->settings_.initial_display_mode()),
+            data, status);
+
+        return status;
+    }
+
+    void bitmap_backed_canvas::wait_pending_sync() {
+        if (bitmap_) {
+            client->get_ws().get_fbs_server()->wait_bitmap_read(bitmap_->bitmap_);
+        }
     }
 
     void bitmap_backed_canvas::add_draw_command(gdi_store_command &command) {
@@ -1367,6 +1416,9 @@ namespace eka2l1::epoc {
             return;
         }
 
+        // Upload what the client sees, not what a read in flight is still writing
+        wait_pending_sync();
+
         prepare_for_draw();
 
         epoc::bitmap_cache *cache = client->get_ws().get_bitmap_cache();
@@ -123,6 +123,51 @@ namespace eka2l1::epoc {
 
         return epoc::display_mode::color_last;
     }
+
+    bool get_pixel_format_from_display_mode(const epoc::display_mode disp_mode, common::pixel_format &format) {
+        switch (disp_mode) {
+        case epoc::display_mode::gray2:
+            format = common::pixel_format::gray2;
+            break;
+        case epoc::display_mode::gray4:
+            format = common::pixel_format::gray4;
+            break;
+        case epoc::display_mode::gray16:
+            format = common::pixel_format::gray16;
+            break;
+        case epoc::display_mode::gray256:
+            format = common::pixel_format::gray256;
+            break;
+        case epoc::display_mode::color16:
+            format = common::pixel_format::palette16;
+            break;
+        case epoc::display_mode::color256:
+            format = common::pixel_format::palette256;
+            break;
+        case epoc::display_mode::color4k:
+            format = common::pixel_format::xrgb4444;
+            break;
+        case epoc::display_mode::color64k:
+            format = common::pixel_format::rgb565;
+            break;
+        case epoc::display_mode::color16m:
+            format = common::pixel_format::bgr888;
+            break;
+        case epoc::display_mode::color16mu:
+            format = common::pixel_format::bgrx8888;
+            break;
+        case epoc::display_mode::color16ma:
+            format = common::pixel_format::bgra8888;
+            break;
+        case epoc::display_mode::color16map:
+            format = common::pixel_format::bgra8888_premultiplied;
+            break;
+        default:
+            return false;
+        }
+
+        return true;
+    }
     
     int get_byte_width(const std::uint32_t pixels_width, const std::uint8_t bits_per_pixel) {
         int word_width = 0;
@@ -154,16 +154,35 @@ namespace eka2l1::epoc {
         delete pitcher;
     }
 
-    void screen::sync_screen_buffer_data(drivers::graphics_driver *driver) {
-        std::uint8_t *buffer_ptr = screen_buffer_ptr();
+    bool screen::queue_screen_buffer_sync(drivers::graphics_driver *driver, drivers::graphics_command_builder &builder) {
+        // The previous read writes to the same memory
+        finish_screen_buffer_sync(driver);
+
         const config::screen_mode &crrmode = current_mode();
 
-        drivers::read_bitmap(driver, screen_texture, eka2l1::point(0, 0), eka2l1::object_size(crrmode.size),
-            get_bpp_from_display_mode(disp_mode), buffer_ptr);
+        builder.read_bitmap(screen_texture, eka2l1::point(0, 0), eka2l1::object_size(crrmode.size),
+            get_bpp_from_display_mode(disp_mode), screen_buffer_ptr(), &sync_screen_buffer_status);
+
+        // Flipped content has to be fixed up on the CPU once it has landed. Otherwise the read can stay in flight:
+        // screen memory changes behind the guest's back on a real device too.
+        sync_screen_buffer_flip = (crrmode.rotation == 90) || (crrmode.rotation == 180);
+        return sync_screen_buffer_flip;
+    }
 
-        if ((crrmode.rotation == 90) || (crrmode.rotation == 180)) {
+    void screen::finish_screen_buffer_sync(drivers::graphics_driver *driver) {
+        if (sync_screen_buffer_status == 0) {
+            return;
+        }
+
+        driver->wait_for(&sync_screen_buffer_status);
+        sync_screen_buffer_status = 0;
+
+        if (sync_screen_buffer_flip) {
+            const config::screen_mode &crrmode = current_mode();
             const std::uint32_t current_pitch = epoc::get_byte_width(crrmode.size.x, epoc::get_bpp_from_display_mode(disp_mode));
-            flip_screen_image(buffer_ptr, current_pitch, crrmode.size.y);
+
+            flip_screen_image(screen_buffer_ptr(), current_pitch, crrmode.size.y);
+            sync_screen_buffer_flip = false;
         }
     }
 
@@ -210,12 +229,17 @@ namespace eka2l1::epoc {
         // Make command list first, and bind our screen bitmap
         drivers::graphics_command_builder builder;
         const bool performed = redraw(builder, true);
+        bool need_finish_sync = false;
+
+        if (performed && sync_screen_buffer && (display_scale_factor == 1.0f)) {
+            need_finish_sync = queue_screen_buffer_sync(driver, builder);
+        }
     
         eka2l1::drivers::command_list retrieved = builder.retrieve_command_list();
         driver->submit_command_list(retrieved);
 
-        if (performed && sync_screen_buffer && (display_scale_factor == 1.0f)) {
-            sync_screen_buffer_data(driver);
+        if (need_finish_sync) {
+            finish_screen_buffer_sync(driver);
         }
 
         fire_screen_redraw_callbacks(false);
@@ -224,6 +248,8 @@ namespace eka2l1::epoc {
     void screen::deinit(drivers::graphics_driver *driver) {
         // Make command list first, and bind our screen bitmap
         if (driver) {
+            finish_screen_buffer_sync(driver);
+
             drivers::graphics_command_builder builder;
 
             if (dsa_texture) {
@@ -266,12 +292,17 @@ namespace eka2l1::epoc {
         }
 
         const bool performed = redraw(builder, need_bind);
+        bool need_finish_sync = false;
+
+        if (performed && sync_screen_buffer) {
+            need_finish_sync = queue_screen_buffer_sync(driver, builder);
+        }
 
         eka2l1::drivers::command_list retrieved = builder.retrieve_command_list();
         driver->submit_command_list(retrieved);
 
-        if (performed && sync_screen_buffer) {
-            sync_screen_buffer_data(driver);
+        if (need_finish_sync) {
+            finish_screen_buffer_sync(driver);
         }
     }
 
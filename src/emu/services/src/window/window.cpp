@@ -1785,6 +1785,18 @@ namespace eka2l1 {
             }
         }
 
+        // A frame may still draw with text atlases evicted while it was built, free them once it is submitted
+        for (crr = screens; crr; crr = crr->next) {
+            crr->add_screen_redraw_callback(this, [](void *userdata, epoc::screen *scr, const bool is_dsa) {
+                window_server *serv = reinterpret_cast<window_server *>(userdata);
+                fbs_server *fbss = serv->get_fbs_server();
+
+                if (!is_dsa && fbss) {
+                    fbss->get_glyph_cache().release_retired_atlases(serv->get_graphics_driver());
+                }
+            });
+        }
+
         // Set default focus screen to be the first
         focus_screen_ = screens;
 
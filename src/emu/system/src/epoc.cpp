@@ -59,6 +59,7 @@
 #include <kernel/libmanager.h>
 #include <kernel/timing.h>
 #include <ldd/collection.h>
+#include <loader/rofs.h>
 #include <loader/rom.h>
 #include <services/init.h>
 #include <vfs/vfs.h>
@@ -133,6 +134,7 @@ namespace eka2l1 {
         bool startup_inited = false;
 
         std::optional<filesystem_id> rom_fs_id_;
+        std::optional<filesystem_id> rofs_fs_id_;
         std::optional<filesystem_id> physical_fs_id_;
 
         system *parent_;
@@ -519,7 +521,7 @@ namespace eka2l1 {
         timing_ = std::make_unique<ntimer>(DEFAULT_CPU_HZ);
         timing_->set_realtime_level(get_realtime_level_from_string(conf_->rtos_level.c_str()));
 
-        file_system_inst physical_fs = create_physical_filesystem(epocver::epoc94, "");
+        file_system_inst physical_fs = create_physical_filesystem(epocver::epoc94, "", conf_->enable_vfs_metadata_cache);
         physical_fs_id_ = io_->add_filesystem(physical_fs);
 
         exmonitor = arm::create_exclusive_monitor(cpu_type, 1);
@@ -701,11 +703,24 @@ namespace eka2l1 {
             }
 
             file_system_inst rom_fs = create_rom_filesystem(&romf_, mem_.get(),
-                get_symbian_version_use(), current_device->firmware_code);
+                get_symbian_version_use(), current_device->firmware_code, conf_->enable_vfs_metadata_cache);
 
             rom_fs_id_ = io_->add_filesystem(rom_fs);
         }
 
+        // ROFS images of the device are stored next to the ROM and served in place
+        if (rofs_fs_id_.has_value()) {
+            io_->remove_filesystem(rofs_fs_id_.value());
+            rofs_fs_id_ = std::nullopt;
+        }
+
+        const std::vector<std::string> rofs_images = loader::find_rofs_images(eka2l1::file_directory(path));
+
+        if (!rofs_images.empty()) {
+            file_system_inst rofs_fs = create_rofs_filesystem(rofs_images, drive_z, get_symbian_version_use());
+            rofs_fs_id_ = io_->add_filesystem(rofs_fs);
+        }
+
         bool res1 = kern_->map_rom(romf_.header.rom_base, path);
 
         if (!res1) {
@@ -27,6 +27,8 @@
 #include <common/fileutils.h>
 #include <common/log.h>
 #include <common/path.h>
+#include <common/platform.h>
+#include <common/virtualmem.h>
 
 #include <loader/fpsx.h>
 #include <loader/rofs.h>
@@ -97,6 +99,81 @@ namespace eka2l1 {
         }
     }
 
+    // Folders read to identify the device, the only part of a ROFS image that is extracted.
+    // The rest is served in place from the image after the device is installed.
+    static const char16_t *ROFS_IDENTIFICATION_FOLDERS[] = {
+        u"resource\\versions",
+        u"system\\versions",
+        u"system\\install"
+    };
+
+    static bool extract_rofs_identification_files(const std::string &image_path, const std::string &drives_z_path) {
+        const std::int64_t image_size = common::file_size(image_path);
+
+        if (image_size <= 0) {
+            return false;
+        }
+
+        std::uint8_t *image = reinterpret_cast<std::uint8_t *>(common::map_file(image_path, prot_read));
+
+        if (!image) {
+            return false;
+        }
+
+        loader::rofs_index index;
+        const bool result = index.add_image(image, static_cast<std::size_t>(image_size));
+
+        if (result) {
+            for (const char16_t *folder : ROFS_IDENTIFICATION_FOLDERS) {
+                const loader::rofs_index_entry *folder_entry = index.find(folder);
+
+                if (!folder_entry || !folder_entry->dir_) {
+                    continue;
+                }
+
+                std::string folder_path = common::ucs2_to_utf8(folder);
+                if (common::is_platform_case_sensitive()) {
+                    folder_path = common::lowercase_string(folder_path);
+                }
+
+                folder_path = eka2l1::add_path(drives_z_path, folder_path + eka2l1::get_separator());
+                common::create_directories(folder_path);
+
+                for (const std::uint32_t child : folder_entry->children_) {
+                    const loader::rofs_index_entry &entry = index.get(child);
+
+                    if (entry.dir_) {
+                        continue;
+                    }
+
+                    std::string fname = common::ucs2_to_utf8(entry.name_);
+                    if (common::is_platform_case_sensitive()) {
+                        fname = common::lowercase_string(fname);
+                    }
+
+                    FILE *f = common::open_c_file(eka2l1::add_path(folder_path, fname), "wb");
+
+                    if (!f) {
+                        LOG_ERROR(SYSTEM, "Fail to extract file with name: {}", fname);
+                        continue;
+                    }
+
+                    fwrite(image + entry.offset_, 1, entry.size_, f);
+                    fclose(f);
+                }
+            }
+        }
+
+        common::unmap_file(image, static_cast<std::size_t>(image_size));
+        return result;
+    }
+
+    static void remove_rofs_images(const std::string &folder) {
+        for (const std::string &image_path : loader::find_rofs_images(folder)) {
+            common::remove(image_path);
+        }
+    }
+
     static device_installation_error dump_data_from_fpsx(loader::firmware::fpsx_header &header, common::ro_stream &stream, const std::string &drives_c_path,
         const std::string &drives_e_path, const std::string &drives_z_path, const std::string &rom_resident_path,
         progress_changed_callback progress_cb, cancel_requested_callback cancel_cb) {
@@ -272,14 +349,23 @@ namespace eka2l1 {
             if (progress_cb)
                 progress_cb(1, 1);
         } else {
-            // Extract the ROFS image
-            common::ro_std_file_stream rofs_img_stream(image_path, true);
+            // Keep the ROFS image as the next layer, it's mounted in place when the device boots
+            const std::string rofs_path = eka2l1::add_path(rom_resident_path,
+                loader::get_rofs_image_name(loader::find_rofs_images(rom_resident_path).size() + 1));
+
+            common::remove(rofs_path);
+
+            if (!common::move_file(image_path, rofs_path) || !extract_rofs_identification_files(rofs_path, drives_z_path)) {
+                LOG_ERROR(SYSTEM, "Error while storing ROFS!");
+                common::remove(image_path);
 
-            // Dump quality ROFS content!!!!!
-            if (!loader::dump_rofs_system(rofs_img_stream, drives_z_path, progress_cb, cancel_cb)) {
-                LOG_ERROR(SYSTEM, "Error while dumping ROFS!");
                 return device_installation_rofs_corrupt;
             }
+
+            if (progress_cb)
+                progress_cb(1, 1);
+
+            return device_installation_none;
         }
 
         // Remove the image, no need it no more :((
@@ -422,6 +508,9 @@ namespace eka2l1 {
         std::string drives_z_temp_path = eka2l1::add_path(drives_z_path, "temp\\");
         std::size_t so_far = 0;
 
+        // Leftovers of an interrupted installation would be taken as layers of this one
+        remove_rofs_images(rom_resident_path);
+
         for (auto &fpsx_filename : filenames) {
             common::ro_std_file_stream fpsx_file_stream(fpsx_filename, true);
             std::optional<loader::firmware::fpsx_header> fpsx_head = loader::firmware::read_fpsx_header(
@@ -444,6 +533,8 @@ namespace eka2l1 {
 
             if (result != device_installation_none) {
                 common::delete_folder(drives_z_temp_path);
+                remove_rofs_images(rom_resident_path);
+
                 return result;
             }
 
@@ -460,6 +551,7 @@ namespace eka2l1 {
         if (!loader::determine_rpkg_product_info(drives_z_temp_path, manufacturer, firmcode, model)) {
             LOG_ERROR(SYSTEM, "Revert all changes");
             eka2l1::common::delete_folder(drives_z_temp_path);
+            remove_rofs_images(rom_resident_path);
 
             return device_installation_determine_product_failure;
         }
@@ -470,6 +562,7 @@ namespace eka2l1 {
             LOG_ERROR(SYSTEM, "The device already exists, revert all changes");
             eka2l1::common::delete_folder(drives_z_temp_path);
             eka2l1::common::remove(current_temp_rom);
+            remove_rofs_images(rom_resident_path);
 
             return device_installation_already_exist;
         }
@@ -484,6 +577,7 @@ namespace eka2l1 {
             LOG_ERROR(SYSTEM, "This device ({}) failed to be install, revert all changes", firmcode);
             eka2l1::common::delete_folder(add_path(drives_z_path, firmcode_low + "\\"));
             eka2l1::common::remove(current_temp_rom);
+            remove_rofs_images(rom_resident_path);
 
             return device_installation_general_failure;
         }
@@ -492,6 +586,13 @@ namespace eka2l1 {
         common::create_directories(eka2l1::file_directory(target_rom_path));
         common::move_file(current_temp_rom, target_rom_path);
 
+        const std::string target_rom_folder = eka2l1::file_directory(target_rom_path);
+        remove_rofs_images(target_rom_folder);
+
+        for (const std::string &rofs_path : loader::find_rofs_images(rom_resident_path)) {
+            common::move_file(rofs_path, eka2l1::add_path(target_rom_folder, eka2l1::filename(rofs_path)));
+        }
+
         if (progress_callback) {
             progress_callback(1, 1);
         }
@@ -32,6 +32,7 @@
 #include <mutex>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace eka2l1 {
     class memory_system;
@@ -153,6 +154,14 @@ namespace eka2l1 {
          */
         virtual bool close() = 0;
 
+        /*! \brief Check if the file was closed, and can no longer be used.
+         *
+         * Files whose close does not release anything are never reported closed.
+         */
+        virtual bool is_closed() const {
+            return false;
+        }
+
         /*! \brief Please don't use this. */
         virtual std::string get_error_descriptor() = 0;
 
@@ -177,6 +186,25 @@ namespace eka2l1 {
 
         virtual std::uint64_t last_modify_since_0ad() = 0;
 
+        /*! \brief Get a host pointer to a region of the file, for reading without copies.
+         *
+         * Only supported by files whose content can not change while they are open: ROM and
+         * ROFS files, and host files on read-only drives.
+         *
+         * \param offset Offset of the region in the file.
+         * \param size   Size of the region. Must be within the file.
+         *
+         * \returns Pointer to the region, valid until the file is closed. Null if unsupported.
+         */
+        virtual const std::uint8_t *map_view(const std::uint64_t offset, const std::uint64_t size) {
+            return nullptr;
+        }
+
+        /*! \brief Check if map_view is supported, without mapping anything. */
+        virtual bool is_mappable() const {
+            return false;
+        }
+
         std::size_t read_file(const std::uint64_t offset, void *buf, std::uint32_t size,
             std::uint32_t count);
     };
@@ -213,8 +241,8 @@ namespace eka2l1 {
         std::string full_path;
 
         io_component_type type;
-        std::size_t size;
-        std::uint64_t last_write;
+        std::size_t size = 0;
+        std::uint64_t last_write = 0;
     };
 
     struct directory : public io_component {
@@ -231,6 +259,19 @@ namespace eka2l1 {
         virtual std::optional<entry_info> peek_next_entry() = 0;
     };
 
+    /*! \brief Lookup statistics of a filesystem's path and metadata caches.
+    */
+    struct file_system_cache_stats {
+        std::uint64_t path_hits_ = 0;
+        std::uint64_t path_misses_ = 0;
+        std::uint64_t metadata_hits_ = 0;
+        std::uint64_t metadata_misses_ = 0;
+
+        //! Number of metadata queries that went to the host.
+        std::uint64_t host_stats_ = 0;
+        std::uint64_t invalidations_ = 0;
+    };
+
     enum class abstract_file_system_err_code {
         unsupported,
         failed,
@@ -244,6 +285,7 @@ namespace eka2l1 {
     };
 
     using drive_change_notify_callback = std::function<void(void *, drive_number, drive_action)>;
+    using pending_write_flush_callback = std::function<void(void *, const std::u16string &)>;
 
     /* \brief An abstract filesystem
     */
@@ -311,11 +353,27 @@ namespace eka2l1 {
          * @brief Validate the filesystem for host to be able to use it.
          */
         virtual void validate_for_host() = 0;
+
+        /**
+         * @brief Get the statistics of the filesystem's lookup caches, if it has any.
+         */
+        virtual std::optional<file_system_cache_stats> get_cache_stats() {
+            return std::nullopt;
+        }
     };
 
-    std::shared_ptr<abstract_file_system> create_physical_filesystem(const epocver ver, const std::string &product_code);
+    std::shared_ptr<abstract_file_system> create_physical_filesystem(const epocver ver, const std::string &product_code,
+        const bool enable_metadata_cache = true);
     std::shared_ptr<abstract_file_system> create_rom_filesystem(loader::rom *rom_cache, memory_system *mem,
-        const epocver ver, const std::string &product_code);
+        const epocver ver, const std::string &product_code, const bool enable_metadata_cache = true);
+
+    /*! \brief Create a read-only file system serving files from ROFS images on a drive.
+     *
+     * \param image_paths Host paths of the images. Later images overlay earlier ones.
+     * \param drv         The drive the content appears on, usually the ROM drive.
+     */
+    std::shared_ptr<abstract_file_system> create_rofs_filesystem(const std::vector<std::string> &image_paths,
+        const drive_number drv, const epocver ver);
 
     using file_system_inst = std::shared_ptr<abstract_file_system>;
     using filesystem_id = std::size_t;
@@ -330,8 +388,12 @@ namespace eka2l1 {
         std::atomic<filesystem_id> id_counter;
         common::identity_container<drive_change_callback_and_data> drive_change_callbacks;
 
+        pending_write_flush_callback pending_write_flusher;
+        void *pending_write_flusher_userdata;
+
     protected:
         void invoke_drive_change_callbacks(drive_number drv, drive_action act);
+        void flush_pending_writes(const std::u16string &path);
 
     public:
         explicit io_system();
@@ -345,6 +407,21 @@ namespace eka2l1 {
         std::size_t register_drive_change_notify(drive_change_notify_callback callback, void *userdata);
         bool remove_drive_change_notify(const std::size_t handle);
 
+        /*! \brief Set the function writing out data that is buffered above the VFS for a path.
+         *
+         * It is called before the path is opened, queried or handed out as a host path, so those
+         * see everything written so far. Pass null to remove it.
+         */
+        void set_pending_write_flusher(pending_write_flush_callback callback, void *userdata);
+
+        /*! \brief Get the host path of a virtual path.
+         *
+         * Files that are only served by a file system without host storage (ROFS) are copied
+         * to the host folder of their drive first. This trades the no-extraction mount of such
+         * images for host-path users (media, INI parsers), one file at a time and only on request.
+         * Directories are never copied, so the returned path may not exist for them, nor when no
+         * file system has the entry.
+         */
         std::optional<std::u16string> get_raw_path(const std::u16string &path);
 
         /*! \brief Add a new file system to the IO system
@@ -452,13 +529,21 @@ namespace eka2l1 {
 
     symfile physical_file_proxy(const std::string &path, int mode);
 
+    /*! \brief Read-only stream over a file.
+     *
+     * Reads are served from the file's mapped view when it has one. The stream then keeps its own
+     * position, and moves the file's cursor there when destroyed, unless the file was closed by then.
+     */
     class ro_file_stream : public common::ro_stream {
         file *f_;
 
+        const std::uint8_t *view_;
+        std::uint64_t view_size_;
+        std::uint64_t view_pos_;
+
     public:
-        explicit ro_file_stream(file *f)
-            : f_(f) {
-        }
+        explicit ro_file_stream(file *f);
+        ~ro_file_stream() override;
 
         void seek(const std::int64_t amount, common::seek_where wh) override;
         bool valid() override;
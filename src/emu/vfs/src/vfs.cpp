@@ -24,21 +24,32 @@
 #include <common/log.h>
 #include <common/path.h>
 #include <common/platform.h>
+#include <common/virtualmem.h>
 #include <common/wildcard.h>
 
+#include <loader/rofs.h>
 #include <loader/rom.h>
 #include <mem/mem.h>
 #include <mem/ptr.h>
 #include <vfs/vfs.h>
 
+#include <fmt/format.h>
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <cwctype>
 #include <iostream>
+#include <list>
 #include <map>
 #include <mutex>
 #include <regex>
+#include <set>
 #include <stack>
 #include <thread>
+#include <unordered_map>
 
 #include <string.h>
 
@@ -94,6 +105,18 @@ namespace eka2l1 {
             crr_pos = 0;
         }
 
+        const std::uint8_t *map_view(const std::uint64_t offset, const std::uint64_t size) override {
+            if (!file_ptr || (offset > file.size) || (size > file.size - offset)) {
+                return nullptr;
+            }
+
+            return file_ptr + offset;
+        }
+
+        bool is_mappable() const override {
+            return file_ptr != nullptr;
+        }
+
         uint64_t size() const override {
             return file.size;
         }
@@ -188,6 +211,226 @@ namespace eka2l1 {
         }
     };
 
+    /**
+     * @brief Cache of host metadata of physical paths.
+     *
+     * Entries are keyed by host path and evicted least recently used first. Only paths that exist are
+     * kept. The cache is shared with files opened for writing, so they can invalidate what they change.
+     */
+    class physical_metadata_cache {
+    public:
+        enum query_flags {
+            query_size = 1 << 0,
+            query_modify_time = 1 << 1
+        };
+
+        struct metadata {
+            common::file_type type_ = common::FILE_INVALID;
+            std::uint64_t size_ = 0;
+            std::uint64_t modify_time_ = 0;
+            std::uint32_t queried_ = 0;
+        };
+
+    private:
+        struct metadata_entry {
+            metadata data_;
+            std::list<std::string>::iterator lru_pos_;
+        };
+
+        std::mutex lock_;
+
+        // Ordered, so everything under a folder can be invalidated at once
+        std::map<std::string, metadata_entry> entries_;
+        std::list<std::string> lru_;
+
+        std::size_t capacity_;
+        bool enabled_;
+
+        file_system_cache_stats stats_;
+
+        void query_missing(const std::string &host_path, metadata &data, const std::uint32_t flags) {
+            if (!data.queried_) {
+                data.type_ = common::get_file_type(host_path);
+                stats_.host_stats_++;
+            }
+
+            data.queried_ |= 1 << 31;
+
+            if ((flags & query_size) && !(data.queried_ & query_size)) {
+                if (data.type_ == common::FILE_REGULAR) {
+                    data.size_ = common::file_size(host_path);
+                    stats_.host_stats_++;
+                }
+
+                data.queried_ |= query_size;
+            }
+
+            if ((flags & query_modify_time) && !(data.queried_ & query_modify_time)) {
+                if (data.type_ != common::FILE_INVALID) {
+                    data.modify_time_ = common::get_last_modifiy_since_ad(common::utf8_to_ucs2(host_path));
+                    stats_.host_stats_++;
+                }
+
+                data.queried_ |= query_modify_time;
+            }
+        }
+
+    public:
+        static std::string normalize_host_path(std::string host_path) {
+            if (get_separator() == '\\') {
+                std::replace(host_path.begin(), host_path.end(), '/', '\\');
+            }
+
+            while ((host_path.length() > 1) && eka2l1::is_separator(host_path.back())) {
+                host_path.pop_back();
+            }
+
+            return host_path;
+        }
+
+        explicit physical_metadata_cache(const std::size_t capacity, const bool enabled)
+            : capacity_(capacity)
+            , enabled_(enabled) {
+        }
+
+        ~physical_metadata_cache() {
+            LOG_INFO(VFS, "Path cache: {} hits/{} misses, metadata cache: {} hits/{} misses, {} host stats, {} invalidations",
+                stats_.path_hits_, stats_.path_misses_, stats_.metadata_hits_, stats_.metadata_misses_, stats_.host_stats_,
+                stats_.invalidations_);
+        }
+
+        bool enabled() const {
+            return enabled_;
+        }
+
+        /**
+         * @brief Get the metadata of a host path.
+         *
+         * @param flags         Extra metadata needed, from query_flags. The type is always available.
+         * @param new_entry     Set to true if the path had no entry in the cache before, and now has one.
+         */
+        metadata get(const std::string &path, const std::uint32_t flags, bool *new_entry = nullptr) {
+            const std::string host_path = normalize_host_path(path);
+            const std::lock_guard<std::mutex> guard(lock_);
+
+            if (new_entry) {
+                *new_entry = false;
+            }
+
+            if (!enabled_) {
+                metadata data;
+                query_missing(host_path, data, flags);
+
+                return data;
+            }
+
+            auto ite = entries_.find(host_path);
+
+            if (ite != entries_.end()) {
+                lru_.splice(lru_.begin(), lru_, ite->second.lru_pos_);
+
+                if ((ite->second.data_.queried_ & flags) == flags) {
+                    stats_.metadata_hits_++;
+                    return ite->second.data_;
+                }
+
+                stats_.metadata_misses_++;
+                query_missing(host_path, ite->second.data_, flags);
+
+                return ite->second.data_;
+            }
+
+            stats_.metadata_misses_++;
+
+            metadata data;
+            query_missing(host_path, data, flags);
+
+            // Missing paths are not kept. Anything on the host may create them (INI writers, installers, host
+            // copies of ROFS files), and only the watcher would tell, late.
+            if (data.type_ == common::FILE_INVALID) {
+                return data;
+            }
+
+            if (entries_.size() >= capacity_) {
+                entries_.erase(lru_.back());
+                lru_.pop_back();
+            }
+
+            lru_.push_front(host_path);
+
+            metadata_entry &entry = entries_[host_path];
+            entry.lru_pos_ = lru_.begin();
+            entry.data_ = data;
+
+            if (new_entry) {
+                *new_entry = true;
+            }
+
+            return entry.data_;
+        }
+
+        /**
+         * @brief Drop the metadata of a host path.
+         *
+         * @param descendants   Also drop everything under the path, for folders.
+         */
+        void invalidate(const std::string &path, const bool descendants = false) {
+            const std::string host_path = normalize_host_path(path);
+            const std::lock_guard<std::mutex> guard(lock_);
+
+            auto ite = entries_.lower_bound(host_path);
+
+            while (ite != entries_.end()) {
+                const bool is_self = (ite->first == host_path);
+                const bool is_descendant = descendants && (ite->first.length() > host_path.length())
+                    && (ite->first.compare(0, host_path.length(), host_path) == 0)
+                    && eka2l1::is_separator(ite->first[host_path.length()]);
+
+                if (!is_self && !is_descendant) {
+                    // Descendants sort right after the path itself, except names starting with
+                    // characters below the separator. Skip those.
+                    if (descendants && (ite->first.compare(0, host_path.length(), host_path) == 0)) {
+                        ite++;
+                        continue;
+                    }
+
+                    break;
+                }
+
+                lru_.erase(ite->second.lru_pos_);
+                ite = entries_.erase(ite);
+
+                stats_.invalidations_++;
+            }
+        }
+
+        void clear() {
+            const std::lock_guard<std::mutex> guard(lock_);
+
+            stats_.invalidations_ += entries_.size();
+
+            entries_.clear();
+            lru_.clear();
+        }
+
+        void record_path_lookup(const bool hit) {
+            const std::lock_guard<std::mutex> guard(lock_);
+
+            if (hit) {
+                stats_.path_hits_++;
+            } else {
+                stats_.path_misses_++;
+            }
+        }
+
+        file_system_cache_stats get_stats() {
+            const std::lock_guard<std::mutex> guard(lock_);
+            return stats_;
+        }
+    };
+
+    using physical_metadata_cache_ptr = std::shared_ptr<physical_metadata_cache>;
+
     struct physical_file : public file {
         FILE *file;
 
@@ -198,6 +441,28 @@ namespace eka2l1 {
 
         bool closed;
 
+        physical_metadata_cache_ptr metadata_cache;
+
+        // Only files that nothing can write to while they are open may be mapped
+        bool mappable;
+        std::uint8_t *mapped_view;
+        std::uint64_t mapped_view_size;
+
+        void unmap_view() {
+            if (mapped_view) {
+                common::unmap_file(mapped_view, static_cast<std::size_t>(mapped_view_size));
+
+                mapped_view = nullptr;
+                mapped_view_size = 0;
+            }
+        }
+
+        void invalidate_metadata() {
+            if (metadata_cache && (fmode & (WRITE_MODE | APPEND_MODE))) {
+                metadata_cache->invalidate(common::ucs2_to_utf8(physical_path));
+            }
+        }
+
         const char *translate_mode(int mode, const bool reopen = false) {
             if (mode & READ_MODE) {
                 if (mode & BIN_MODE) {
@@ -310,13 +575,56 @@ namespace eka2l1 {
     if (closed)    \
         LOG_WARN(VFS, "File {} closed but operation still continues", common::ucs2_to_utf8(input_name));
 
-        physical_file(const utf16_str &vfs_path, const utf16_str &real_path, const int mode)
-            : file(nullptr) {
+        physical_file(const utf16_str &vfs_path, const utf16_str &real_path, const int mode,
+            physical_metadata_cache_ptr metadata_cache = nullptr, const bool mappable = false)
+            : file(nullptr)
+            , fmode(mode)
+            , metadata_cache(metadata_cache)
+            , mappable(mappable && !(mode & (WRITE_MODE | APPEND_MODE)))
+            , mapped_view(nullptr)
+            , mapped_view_size(0) {
             init(vfs_path, real_path, mode);
         }
 
         ~physical_file() override {
+            unmap_view();
             shutdown();
+            invalidate_metadata();
+        }
+
+        bool is_mappable() const override {
+            return mappable && !closed && file;
+        }
+
+        const std::uint8_t *map_view(const std::uint64_t offset, const std::uint64_t size) override {
+            if (!mappable || closed || !file) {
+                return nullptr;
+            }
+
+            if (!mapped_view) {
+                const std::uint64_t file_size = this->size();
+
+                if (file_size == 0) {
+                    return nullptr;
+                }
+
+                mapped_view = reinterpret_cast<std::uint8_t *>(common::map_file(common::ucs2_to_utf8(physical_path),
+                    prot_read, static_cast<std::size_t>(file_size)));
+
+                if (!mapped_view) {
+                    // Don't try again
+                    mappable = false;
+                    return nullptr;
+                }
+
+                mapped_view_size = file_size;
+            }
+
+            if ((offset > mapped_view_size) || (size > mapped_view_size - offset)) {
+                return nullptr;
+            }
+
+            return mapped_view + offset;
         }
 
         bool valid() override {
@@ -354,7 +662,10 @@ namespace eka2l1 {
         size_t write_file(const void *data, uint32_t size, uint32_t count) override {
             WARN_CLOSE
 
-            return fwrite(data, size, count, file) * size;
+            const size_t written = fwrite(data, size, count, file) * size;
+            invalidate_metadata();
+
+            return written;
         }
 
         size_t read_file(void *data, uint32_t size, uint32_t count) override {
@@ -378,12 +689,19 @@ namespace eka2l1 {
         bool close() override {
             WARN_CLOSE
 
+            unmap_view();
+
             fclose(file);
             closed = true;
 
+            invalidate_metadata();
             return true;
         }
 
+        bool is_closed() const override {
+            return closed;
+        }
+
         uint64_t tell() override {
             WARN_CLOSE
 
@@ -451,6 +769,7 @@ namespace eka2l1 {
 #endif
 
             fseek(file, static_cast<long>(saved_pos), SEEK_SET);
+            invalidate_metadata();
 
             return (err_code != 0) ? false : true;
         }
@@ -596,10 +915,117 @@ namespace eka2l1 {
         }
     };
 
+    static constexpr std::size_t METADATA_CACHE_CAPACITY = 8192;
+    static constexpr std::size_t REAL_PATH_CACHE_CAPACITY = 8192;
+    static constexpr std::size_t MAX_METADATA_WATCHES = 1024;
+
     class physical_file_system : public abstract_file_system {
+        struct cached_real_path {
+            std::u16string real_path_;
+            bool is_root_;
+        };
+
+        struct metadata_watch {
+            physical_metadata_cache *cache_;
+            std::string folder_;
+        };
+
         std::mutex fs_mutex;
+
+        // Both declared before the watcher, so its callbacks stop before they go away
+        physical_metadata_cache_ptr metadata_cache_;
+        std::map<std::string, std::unique_ptr<metadata_watch>> metadata_watches_;
+
         std::unique_ptr<common::directory_watcher> watcher_;
 
+        std::mutex real_path_cache_lock_;
+        std::unordered_map<std::u16string, cached_real_path> real_path_cache_;
+        std::mutex metadata_watches_lock_;
+
+        void clear_real_path_cache() {
+            const std::lock_guard<std::mutex> guard(real_path_cache_lock_);
+            real_path_cache_.clear();
+        }
+
+        // Entries are only kept while the host folder holding them is watched for changes
+        void watch_for_metadata(const std::string &host_path) {
+            const std::string folder = physical_metadata_cache::normalize_host_path(eka2l1::file_directory(
+                physical_metadata_cache::normalize_host_path(host_path)));
+
+            if (folder.empty() || (folder == physical_metadata_cache::normalize_host_path(host_path))) {
+                metadata_cache_->invalidate(host_path);
+                return;
+            }
+
+            const std::lock_guard<std::mutex> guard(metadata_watches_lock_);
+            auto existing = metadata_watches_.find(folder);
+
+            if (existing != metadata_watches_.end()) {
+                if (!existing->second) {
+                    metadata_cache_->invalidate(host_path);
+                }
+
+                return;
+            }
+
+            if (metadata_watches_.size() >= MAX_METADATA_WATCHES) {
+                metadata_cache_->invalidate(host_path);
+                return;
+            }
+
+            if (!watcher_) {
+                watcher_ = std::make_unique<common::directory_watcher>();
+            }
+
+            auto watch = std::make_unique<metadata_watch>();
+            watch->cache_ = metadata_cache_.get();
+            watch->folder_ = folder;
+
+            const std::int32_t handle = watcher_->watch(
+                folder, [](void *userdata, common::directory_changes &changes) {
+                    metadata_watch *watch = reinterpret_cast<metadata_watch *>(userdata);
+
+                    for (const auto &change : changes) {
+                        watch->cache_->invalidate(eka2l1::add_path(watch->folder_, change.filename_), true);
+                    }
+                },
+                watch.get(), common::directory_change_move | common::directory_change_last_write | common::directory_change_creation);
+
+            if (handle <= 0) {
+                // Remember the failure, so the folder is not tried again
+                watch.reset();
+                metadata_cache_->invalidate(host_path);
+            }
+
+            metadata_watches_.emplace(folder, std::move(watch));
+        }
+
+        physical_metadata_cache::metadata get_host_metadata(const std::string &host_path, const std::uint32_t flags = 0) {
+            bool new_entry = false;
+            const physical_metadata_cache::metadata data = metadata_cache_->get(host_path, flags, &new_entry);
+
+            if (new_entry) {
+                watch_for_metadata(host_path);
+            }
+
+            return data;
+        }
+
+        void invalidate_with_ancestors(std::string host_path) {
+            while (true) {
+                host_path = physical_metadata_cache::normalize_host_path(host_path);
+                metadata_cache_->invalidate(host_path);
+
+                const std::string parent = eka2l1::file_directory(host_path);
+
+                if (parent.empty() || (physical_metadata_cache::normalize_host_path(parent) == host_path)) {
+                    break;
+                }
+
+                host_path = parent;
+            }
+        }
+
     protected:
         std::string firmcode;
         epocver ver;
@@ -666,11 +1092,12 @@ namespace eka2l1 {
 
             // Mark as mapped
             mappings[static_cast<int>(drv)].second = true;
+            clear_real_path_cache();
 
             return true;
         }
 
-        std::optional<std::u16string> get_real_physical_path(const std::u16string &vert_path, bool *is_root = nullptr) {
+        std::optional<std::u16string> resolve_real_physical_path(const std::u16string &vert_path, bool *is_root = nullptr) {
             const std::int32_t stack_level = path_stack_level(vert_path);
 
             if (stack_level < 0) {
@@ -722,10 +1149,56 @@ namespace eka2l1 {
             return eka2l1::add_path(map_path, vert_path_no_root);
         }
 
+        std::optional<std::u16string> get_real_physical_path(const std::u16string &vert_path, bool *is_root = nullptr) {
+            if (!metadata_cache_->enabled()) {
+                return resolve_real_physical_path(vert_path, is_root);
+            }
+
+            // Host paths are lowercased on case-sensitive hosts, so the virtual path can be too
+            const std::u16string key = common::is_system_case_insensitive() ? vert_path : common::lowercase_ucs2_string(vert_path);
+
+            {
+                const std::lock_guard<std::mutex> guard(real_path_cache_lock_);
+                auto ite = real_path_cache_.find(key);
+
+                if (ite != real_path_cache_.end()) {
+                    metadata_cache_->record_path_lookup(true);
+
+                    if (is_root) {
+                        *is_root = ite->second.is_root_;
+                    }
+
+                    return ite->second.real_path_;
+                }
+
+                metadata_cache_->record_path_lookup(false);
+            }
+
+            bool root = false;
+            std::optional<std::u16string> result = resolve_real_physical_path(vert_path, &root);
+
+            if (is_root) {
+                *is_root = root;
+            }
+
+            if (result && !result->empty()) {
+                const std::lock_guard<std::mutex> guard(real_path_cache_lock_);
+
+                if (real_path_cache_.size() >= REAL_PATH_CACHE_CAPACITY) {
+                    real_path_cache_.clear();
+                }
+
+                real_path_cache_.emplace(key, cached_real_path{ result.value(), root });
+            }
+
+            return result;
+        }
+
     public:
-        explicit physical_file_system(epocver ver, const std::string &product_code)
+        explicit physical_file_system(epocver ver, const std::string &product_code, const bool enable_metadata_cache = true)
             : ver(ver)
             , firmcode(product_code)
+            , metadata_cache_(std::make_shared<physical_metadata_cache>(METADATA_CACHE_CAPACITY, enable_metadata_cache))
             , watcher_(nullptr) {
             for (auto &[drv, mapped] : mappings) {
                 mapped = false;
@@ -734,6 +1207,11 @@ namespace eka2l1 {
 
         void set_epoc_ver(const epocver ever) override {
             ver = ever;
+            clear_real_path_cache();
+        }
+
+        std::optional<file_system_cache_stats> get_cache_stats() override {
+            return metadata_cache_->get_stats();
         }
 
         std::optional<std::u16string> get_raw_path(const std::u16string &path) override {
@@ -747,16 +1225,21 @@ namespace eka2l1 {
                 return false;
             }
 
-            return common::remove(common::ucs2_to_utf8(*path_real));
+            const std::string path_real_utf8 = common::ucs2_to_utf8(*path_real);
+            const bool result = common::remove(path_real_utf8);
+
+            metadata_cache_->invalidate(path_real_utf8, true);
+            return result;
         }
 
         void set_product_code(const std::string &pc) override {
             firmcode = pc;
+            clear_real_path_cache();
         }
 
         bool exists(const std::u16string &path) override {
             std::optional<std::u16string> real_path = get_real_physical_path(path);
-            return real_path ? common::exists(common::ucs2_to_utf8(*real_path)) : false;
+            return real_path ? (get_host_metadata(common::ucs2_to_utf8(*real_path)).type_ != common::FILE_INVALID) : false;
         }
 
         bool replace(const std::u16string &old_path, const std::u16string &new_path) override {
@@ -767,8 +1250,15 @@ namespace eka2l1 {
                 return false;
             }
 
-            return common::move_file(common::ucs2_to_utf8(*old_path_real),
-                common::ucs2_to_utf8(*new_path_real));
+            const std::string old_path_real_utf8 = common::ucs2_to_utf8(*old_path_real);
+            const std::string new_path_real_utf8 = common::ucs2_to_utf8(*new_path_real);
+
+            const bool result = common::move_file(old_path_real_utf8, new_path_real_utf8);
+
+            metadata_cache_->invalidate(old_path_real_utf8, true);
+            metadata_cache_->invalidate(new_path_real_utf8, true);
+
+            return result;
         }
 
         bool create_directories(const std::u16string &path) override {
@@ -778,7 +1268,11 @@ namespace eka2l1 {
                 return false;
             }
 
-            common::create_directories(common::ucs2_to_utf8(*real_path));
+            const std::string real_path_utf8 = common::ucs2_to_utf8(*real_path);
+
+            common::create_directories(real_path_utf8);
+            invalidate_with_ancestors(real_path_utf8);
+
             return true;
         }
 
@@ -789,7 +1283,10 @@ namespace eka2l1 {
                 return false;
             }
 
-            common::create_directory(common::ucs2_to_utf8(*real_path));
+            const std::string real_path_utf8 = common::ucs2_to_utf8(*real_path);
+
+            common::create_directory(real_path_utf8);
+            metadata_cache_->invalidate(real_path_utf8);
 
             return true;
         }
@@ -806,6 +1303,7 @@ namespace eka2l1 {
         bool unmount(const drive_number drv) override {
             if (mappings[static_cast<int>(drv)].second) {
                 mappings[static_cast<int>(drv)].second = false;
+                clear_real_path_cache();
 
                 for (auto &watch_handle : watches[drv]) {
                     if (watcher_) {
@@ -866,7 +1364,7 @@ namespace eka2l1 {
 
             std::string new_path_utf8 = common::ucs2_to_utf8(*new_path);
 
-            if (!common::exists(new_path_utf8)) {
+            if (get_host_metadata(new_path_utf8).type_ == common::FILE_INVALID) {
                 return std::unique_ptr<directory>(nullptr);
             }
 
@@ -882,25 +1380,24 @@ namespace eka2l1 {
             }
 
             std::string real_path_utf8 = common::ucs2_to_utf8(*real_path);
+            const physical_metadata_cache::metadata host_data = get_host_metadata(real_path_utf8,
+                physical_metadata_cache::query_size | physical_metadata_cache::query_modify_time);
 
-            if (!common::exists(real_path_utf8)) {
+            if (host_data.type_ == common::FILE_INVALID) {
                 return std::nullopt;
             }
 
             entry_info info;
 
-            if (common::is_file(real_path_utf8, common::FILE_DIRECTORY)) {
+            if (host_data.type_ == common::FILE_DIRECTORY) {
                 info.type = io_component_type::dir;
                 info.size = 0;
             } else {
                 info.type = io_component_type::file;
-                info.size = common::file_size(real_path_utf8);
+                info.size = static_cast<std::size_t>(host_data.size_);
             }
 
-            /* TODO: Recover this code with new EKA2L1's common code.
-            auto last_mod = fs::last_write_time(*real_path);
-            info.last_write = static_cast<uint64_t>(last_mod.time_since_epoch().count());
-            */
+            info.last_write = host_data.modify_time_;
 
             std::string path_utf8 = common::ucs2_to_utf8(path);
 
@@ -917,6 +1414,7 @@ namespace eka2l1 {
 
         std::unique_ptr<file> open_file(const std::u16string &path, const int mode) override {
             const std::u16string &root = eka2l1::root_name(path, true);
+            bool read_only_drive = false;
 
             if (!root.empty()) {
                 const drive_number drv = char16_to_drive(root[0]);
@@ -931,6 +1429,9 @@ namespace eka2l1 {
 
                     return nullptr;
                 }
+
+                read_only_drive = (mappings[static_cast<int>(drv)].first.attribute & io_attrib_write_protected)
+                    || (mappings[static_cast<int>(drv)].first.media_type == drive_media::rom);
             }
 
             std::optional<std::u16string> real_path = get_real_physical_path(path);
@@ -941,11 +1442,18 @@ namespace eka2l1 {
 
             std::string real_path_utf8 = common::ucs2_to_utf8(*real_path);
 
-            if (!(mode & WRITE_MODE) && (!common::exists(real_path_utf8) || common::is_file(real_path_utf8, common::FILE_DIRECTORY))) {
-                return nullptr;
+            if (!(mode & WRITE_MODE)) {
+                const common::file_type type = get_host_metadata(real_path_utf8).type_;
+
+                if ((type == common::FILE_INVALID) || (type == common::FILE_DIRECTORY)) {
+                    return nullptr;
+                }
+            } else {
+                // The file may be created or truncated
+                metadata_cache_->invalidate(real_path_utf8);
             }
 
-            return std::make_unique<physical_file>(path, *real_path, mode);
+            return std::make_unique<physical_file>(path, *real_path, mode, metadata_cache_, read_only_drive);
         }
 
         std::int64_t watch_directory(const std::u16string &path, common::directory_watcher_callback callback,
@@ -1003,6 +1511,8 @@ namespace eka2l1 {
                     common::copy_folder(mapping.first.real_path, mapping.first.real_path, common::FOLDER_COPY_FLAG_LOWERCASE_NAME,
                         nullptr);
                 }
+
+                metadata_cache_->clear();
             }
         }
     };
@@ -1012,8 +1522,9 @@ namespace eka2l1 {
         memory_system *mem;
 
     public:
-        explicit rom_file_system(loader::rom *cache, memory_system *mem, epocver ver, const std::string &product_code)
-            : physical_file_system(ver, product_code)
+        explicit rom_file_system(loader::rom *cache, memory_system *mem, epocver ver, const std::string &product_code,
+            const bool enable_metadata_cache)
+            : physical_file_system(ver, product_code, enable_metadata_cache)
             , rom_cache(cache)
             , mem(mem) {
         }
@@ -1138,55 +1649,551 @@ namespace eka2l1 {
         }
     };
 
-    std::shared_ptr<abstract_file_system> create_physical_filesystem(const epocver ver, const std::string &product_code) {
-        return std::make_unique<physical_file_system>(ver, product_code);
-    }
+    // A ROFS image mapped into host memory, shared by the file system and every file opened from it
+    struct rofs_mapping {
+        std::uint8_t *data_ = nullptr;
+        std::size_t size_ = 0;
 
-    std::shared_ptr<abstract_file_system> create_rom_filesystem(loader::rom *rom_cache, memory_system *mem,
-        const epocver ver, const std::string &product_code) {
-        return std::make_unique<rom_file_system>(rom_cache, mem, ver, product_code);
-    }
+        ~rofs_mapping() {
+            if (data_) {
+                common::unmap_file(data_, size_);
+            }
+        }
+    };
 
-    io_component::io_component(io_component_type type, const std::uint32_t attrib)
-        : type(type)
-        , attribute(attrib) {
-    }
+    using rofs_mapping_list = std::vector<std::shared_ptr<rofs_mapping>>;
 
-    bool io_drive_callback_free_check_func(drive_change_callback_and_data &elem) {
-        return !elem.first;
-    }
+    struct rofs_file : public file {
+        std::shared_ptr<rofs_mapping> mapping;
+        const std::uint8_t *file_ptr;
 
-    void io_drive_callback_free_func(drive_change_callback_and_data &elem) {
-        elem.first = nullptr;
-    }
+        std::uint64_t file_size;
+        std::uint64_t crr_pos;
+        std::uint64_t modify_time;
 
-    io_system::io_system()
-        : drive_change_callbacks(io_drive_callback_free_check_func, io_drive_callback_free_func) {
-    }
+        std::u16string input_path;
 
-    io_system::~io_system() {
-        filesystems.clear();
-    }
+        explicit rofs_file(std::shared_ptr<rofs_mapping> mapping, const loader::rofs_index_entry &entry,
+            const std::uint64_t modify_time, const std::u16string &inpp)
+            : mapping(mapping)
+            , file_ptr(mapping->data_ + entry.offset_)
+            , file_size(entry.size_)
+            , crr_pos(0)
+            , modify_time(modify_time)
+            , input_path(inpp) {
+        }
 
-    std::optional<filesystem_id> io_system::add_filesystem(file_system_inst &inst) {
-        const std::lock_guard<std::mutex> guard(access_lock);
+        uint64_t size() const override {
+            return file_size;
+        }
 
-        ++id_counter;
+        bool valid() override {
+            return crr_pos < file_size;
+        }
 
-        filesystems.emplace(id_counter, inst);
-        return id_counter;
-    }
+        const std::uint8_t *map_view(const std::uint64_t offset, const std::uint64_t size) override {
+            if ((offset > file_size) || (size > file_size - offset)) {
+                return nullptr;
+            }
 
-    /*! \brief Remove the filesystem from the IO system
-    */
-    bool io_system::remove_filesystem(const filesystem_id id) {
-        const std::lock_guard<std::mutex> guard(access_lock);
+            return file_ptr + offset;
+        }
 
-        if (id > id_counter) {
-            return false;
+        bool is_mappable() const override {
+            return true;
         }
 
-        filesystems.erase(id);
+        size_t read_file(void *data, uint32_t size, uint32_t count) override {
+            if (crr_pos >= file_size) {
+                return 0;
+            }
+
+            const std::uint64_t will_read = std::min(static_cast<std::uint64_t>(count) * size, file_size - crr_pos);
+            std::memcpy(data, file_ptr + crr_pos, will_read);
+
+            crr_pos += will_read;
+            return static_cast<size_t>(will_read);
+        }
+
+        int file_mode() const override {
+            return READ_MODE;
+        }
+
+        size_t write_file(const void *data, uint32_t size, uint32_t count) override {
+            LOG_ERROR(VFS, "Can't write into ROFS!");
+            return -1;
+        }
+
+        std::uint64_t seek(std::int64_t seek_off, file_seek_mode where) override {
+            if (where == file_seek_mode::address) {
+                // Not execute-in-place, there is no linear address
+                return 0xFFFFFFFF;
+            }
+
+            std::int64_t new_pos = seek_off;
+
+            if (where == file_seek_mode::crr) {
+                new_pos += static_cast<std::int64_t>(crr_pos);
+            } else if (where == file_seek_mode::end) {
+                new_pos += static_cast<std::int64_t>(file_size);
+            }
+
+            if (new_pos < 0) {
+                LOG_ERROR(VFS, "Attempting to seek to a negative position ({})", new_pos);
+                return 0xFFFFFFFFFFFFFFFF;
+            }
+
+            crr_pos = static_cast<std::uint64_t>(new_pos);
+            return crr_pos;
+        }
+
+        std::uint64_t last_modify_since_0ad() override {
+            return modify_time;
+        }
+
+        std::string get_error_descriptor() override {
+            return "no";
+        }
+
+        bool is_in_rom() const override {
+            return false;
+        }
+
+        address rom_address() const override {
+            return 0;
+        }
+
+        uint64_t tell() override {
+            return crr_pos;
+        }
+
+        std::u16string file_name() const override {
+            return input_path;
+        }
+
+        bool close() override {
+            return true;
+        }
+
+        bool resize(const std::size_t new_size) override {
+            return false;
+        }
+    };
+
+    static entry_info make_rofs_entry_info(const loader::rofs_index &index, const loader::rofs_index_entry &entry,
+        const std::string &full_path) {
+        entry_info info;
+        info.type = entry.dir_ ? io_component_type::dir : io_component_type::file;
+        info.attribute = io_attrib_internal | io_attrib_write_protected;
+        info.has_raw_attribute = true;
+        info.raw_attribute = entry.att_;
+        info.size = entry.size_;
+        info.name = common::ucs2_to_utf8(entry.name_);
+        info.full_path = full_path;
+        info.last_write = (index.image_count() != 0) ? index.image_time(entry.image_) : 0;
+
+        return info;
+    }
+
+    class rofs_directory : public directory {
+        std::shared_ptr<loader::rofs_index> index;
+        rofs_mapping_list mappings;
+
+        std::vector<std::uint32_t> children;
+        std::size_t crr_child;
+
+        std::regex filter;
+        std::string vir_path;
+        epoc::uid_type utype;
+
+        std::optional<entry_info> peek_info;
+        bool peeking;
+
+        bool match_uids(const loader::rofs_index_entry &entry) {
+            std::uint32_t uids[3];
+
+            if (entry.has_uids_) {
+                std::memcpy(uids, entry.uids_, sizeof(uids));
+            } else {
+                if (entry.size_ < sizeof(uids)) {
+                    return false;
+                }
+
+                std::memcpy(uids, mappings[entry.image_]->data_ + entry.offset_, sizeof(uids));
+            }
+
+            return !(((utype.uid1 != 0) && (utype.uid1 != uids[0])) || ((utype.uid2 != 0) && (utype.uid2 != uids[1]))
+                || ((utype.uid3 != 0) && (utype.uid3 != uids[2])));
+        }
+
+    public:
+        explicit rofs_directory(std::shared_ptr<loader::rofs_index> index, const rofs_mapping_list &mappings,
+            const loader::rofs_index_entry &dir_entry, const std::string &vir_path, const std::string &filter,
+            epoc::uid_type type, const std::uint32_t attrib)
+            : directory(attrib)
+            , index(index)
+            , mappings(mappings)
+            , children(dir_entry.children_)
+            , crr_child(0)
+            , filter(common::wildcard_to_regex_string(common::lowercase_string(filter)))
+            , vir_path(vir_path)
+            , utype(type)
+            , peeking(false) {
+        }
+
+        std::optional<entry_info> get_next_entry() override {
+            if (peeking) {
+                peeking = false;
+                return peek_info;
+            }
+
+            while (crr_child < children.size()) {
+                const loader::rofs_index_entry &entry = index->get(children[crr_child++]);
+
+                if (attribute != io_attrib_none) {
+                    if (!(attribute & io_attrib_include_dir) && entry.dir_) {
+                        continue;
+                    }
+
+                    if (!(attribute & io_attrib_include_file) && !entry.dir_) {
+                        continue;
+                    }
+                }
+
+                const std::string name = common::ucs2_to_utf8(entry.name_);
+
+                if (!std::regex_match(common::lowercase_string(name), filter)) {
+                    continue;
+                }
+
+                if (!entry.dir_ && (attribute & io_attrib_include_file) && (attribute & io_attrib_allow_uid) && !match_uids(entry)) {
+                    continue;
+                }
+
+                return make_rofs_entry_info(*index, entry, eka2l1::add_path(vir_path, name));
+            }
+
+            return std::nullopt;
+        }
+
+        std::optional<entry_info> peek_next_entry() override {
+            if (!peeking) {
+                peek_info = get_next_entry();
+                peeking = true;
+            }
+
+            return peek_info;
+        }
+    };
+
+    /**
+     * @brief Read-only file system serving the content of ROFS images straight from their mapping.
+     *
+     * The images are mapped, and their directory trees indexed, on the first access. Later images
+     * overlay the earlier ones, like the ROFS layers on the device.
+     */
+    class rofs_file_system : public abstract_file_system {
+        std::vector<std::string> image_paths_;
+        drive_number drive_;
+        epocver ver_;
+
+        std::mutex index_lock_;
+        bool index_built_;
+
+        std::shared_ptr<loader::rofs_index> index_;
+        rofs_mapping_list mappings_;
+
+        loader::rofs_index *get_index() {
+            const std::lock_guard<std::mutex> guard(index_lock_);
+
+            if (index_built_) {
+                return index_.get();
+            }
+
+            index_built_ = true;
+
+            const auto build_start = std::chrono::steady_clock::now();
+            auto index = std::make_shared<loader::rofs_index>();
+
+            for (const std::string &path : image_paths_) {
+                auto mapping = std::make_shared<rofs_mapping>();
+                const std::int64_t image_size = common::file_size(path);
+
+                if (image_size > 0) {
+                    mapping->data_ = reinterpret_cast<std::uint8_t *>(common::map_file(path, prot_read));
+                    mapping->size_ = static_cast<std::size_t>(image_size);
+                }
+
+                if (!mapping->data_) {
+                    LOG_ERROR(VFS, "Unable to map ROFS image {}", path);
+                    continue;
+                }
+
+                const std::size_t image_count_before = index->image_count();
+                const bool complete = index->add_image(mapping->data_, mapping->size_);
+
+                if (index->image_count() == image_count_before) {
+                    LOG_ERROR(VFS, "{} is not a supported ROFS image", path);
+                    continue;
+                }
+
+                if (!complete) {
+                    LOG_ERROR(VFS, "ROFS image {} is corrupted, only part of it is available", path);
+                }
+
+                // The index refers to images in the order they were added
+                mappings_.push_back(std::move(mapping));
+            }
+
+            if (mappings_.empty()) {
+                return nullptr;
+            }
+
+            const auto build_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - build_start);
+
+            LOG_INFO(VFS, "Indexed {} ROFS entries from {} images in {} ms", index->entry_count(), mappings_.size(),
+                build_time.count());
+
+            index_ = std::move(index);
+            return index_.get();
+        }
+
+        const loader::rofs_index_entry *find_entry(const std::u16string &path) {
+            const std::u16string root = eka2l1::root_name(path, true);
+
+            if (root.empty() || (char16_to_drive(root[0]) != drive_)) {
+                return nullptr;
+            }
+
+            loader::rofs_index *index = get_index();
+
+            if (!index) {
+                return nullptr;
+            }
+
+            std::u16string new_path = path;
+
+            if (static_cast<int>(ver_) >= static_cast<int>(epocver::eka2)) {
+                if (common::compare_ignore_case(u"\\system\\libs", new_path.substr(2, 12)) == 0) {
+                    new_path.replace(2, 12, u"\\sys\\bin");
+                } else if (common::compare_ignore_case(u"\\system\\programs", new_path.substr(2, 16)) == 0) {
+                    new_path.replace(2, 16, u"\\sys\\bin");
+                }
+            }
+
+            return index->find(new_path);
+        }
+
+    public:
+        explicit rofs_file_system(const std::vector<std::string> &image_paths, const drive_number drv, const epocver ver)
+            : image_paths_(image_paths)
+            , drive_(drv)
+            , ver_(ver)
+            , index_built_(false) {
+        }
+
+        bool exists(const std::u16string &path) override {
+            return find_entry(path) != nullptr;
+        }
+
+        bool replace(const std::u16string &old_path, const std::u16string &new_path) override {
+            return false;
+        }
+
+        bool unmount(const drive_number drv) override {
+            return false;
+        }
+
+        void set_epoc_ver(const epocver ver) override {
+            ver_ = ver;
+        }
+
+        std::unique_ptr<file> open_file(const std::u16string &path, const int mode) override {
+            const loader::rofs_index_entry *entry = find_entry(path);
+
+            if (!entry || entry->dir_) {
+                return nullptr;
+            }
+
+            if (mode & WRITE_MODE) {
+                LOG_ERROR(VFS, "Opening a read-only file (ROFS) with write mode");
+                return nullptr;
+            }
+
+            return std::make_unique<rofs_file>(mappings_[entry->image_], *entry, index_->image_time(entry->image_), path);
+        }
+
+        std::unique_ptr<directory> open_directory(const std::u16string &path, epoc::uid_type type, const std::uint32_t attrib) override {
+            std::u16string vir_path = path;
+            std::string filter("*");
+
+            const std::size_t pos_check = vir_path.find_last_of(u"\\/");
+
+            // Check if there should be a filter
+            if ((pos_check != std::u16string::npos) && (pos_check != vir_path.length() - 1)) {
+                filter = common::ucs2_to_utf8(vir_path.substr(pos_check + 1));
+                vir_path.erase(pos_check + 1);
+            }
+
+            const loader::rofs_index_entry *entry = find_entry(vir_path);
+
+            if (!entry || !entry->dir_) {
+                return nullptr;
+            }
+
+            return std::make_unique<rofs_directory>(index_, mappings_, *entry, common::ucs2_to_utf8(vir_path),
+                filter, type, attrib);
+        }
+
+        std::optional<entry_info> get_entry_info(const std::u16string &path) override {
+            const loader::rofs_index_entry *entry = find_entry(path);
+
+            if (!entry) {
+                return std::nullopt;
+            }
+
+            return make_rofs_entry_info(*index_, *entry, common::ucs2_to_utf8(path));
+        }
+
+        abstract_file_system_err_code is_entry_in_rom(const std::u16string &path) override {
+            // ROFS content is loaded to RAM on the device, it's not executed in place
+            return abstract_file_system_err_code::no;
+        }
+
+        bool delete_entry(const std::u16string &path) override {
+            return false;
+        }
+
+        bool create_directory(const std::u16string &path) override {
+            return false;
+        }
+
+        bool create_directories(const std::u16string &path) override {
+            return false;
+        }
+
+        std::optional<drive> get_drive_entry(const drive_number drv) override {
+            // The drive itself is provided by the ROM file system
+            return std::nullopt;
+        }
+
+        std::optional<std::u16string> get_raw_path(const std::u16string &path) override {
+            // No host storage. The IO system copies entries out to the drive's host folder when asked.
+            return std::nullopt;
+        }
+
+        void validate_for_host() override {
+        }
+    };
+
+    // Lists the entries of the same directory from several file systems, the first one wins on name collisions
+    class merged_directory : public directory {
+        std::vector<std::unique_ptr<directory>> dirs;
+        std::size_t crr_dir;
+
+        std::set<std::string> seen_names;
+
+        std::optional<entry_info> peek_info;
+        bool peeking;
+
+    public:
+        explicit merged_directory(std::vector<std::unique_ptr<directory>> &dirs, const std::uint32_t attrib)
+            : directory(attrib)
+            , dirs(std::move(dirs))
+            , crr_dir(0)
+            , peeking(false) {
+        }
+
+        std::optional<entry_info> get_next_entry() override {
+            if (peeking) {
+                peeking = false;
+                return peek_info;
+            }
+
+            while (crr_dir < dirs.size()) {
+                std::optional<entry_info> info = dirs[crr_dir]->get_next_entry();
+
+                if (!info) {
+                    crr_dir++;
+                    continue;
+                }
+
+                if (seen_names.insert(common::lowercase_string(info->name)).second) {
+                    return info;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        std::optional<entry_info> peek_next_entry() override {
+            if (!peeking) {
+                peek_info = get_next_entry();
+                peeking = true;
+            }
+
+            return peek_info;
+        }
+    };
+
+    std::shared_ptr<abstract_file_system> create_physical_filesystem(const epocver ver, const std::string &product_code,
+        const bool enable_metadata_cache) {
+        return std::make_unique<physical_file_system>(ver, product_code, enable_metadata_cache);
+    }
+
+    std::shared_ptr<abstract_file_system> create_rom_filesystem(loader::rom *rom_cache, memory_system *mem,
+        const epocver ver, const std::string &product_code, const bool enable_metadata_cache) {
+        return std::make_unique<rom_file_system>(rom_cache, mem, ver, product_code, enable_metadata_cache);
+    }
+
+    std::shared_ptr<abstract_file_system> create_rofs_filesystem(const std::vector<std::string> &image_paths,
+        const drive_number drv, const epocver ver) {
+        return std::make_unique<rofs_file_system>(image_paths, drv, ver);
+    }
+
+    io_component::io_component(io_component_type type, const std::uint32_t attrib)
+        : type(type)
+        , attribute(attrib) {
+    }
+
+    bool io_drive_callback_free_check_func(drive_change_callback_and_data &elem) {
+        return !elem.first;
+    }
+
+    void io_drive_callback_free_func(drive_change_callback_and_data &elem) {
+        elem.first = nullptr;
+    }
+
+    io_system::io_system()
+        : drive_change_callbacks(io_drive_callback_free_check_func, io_drive_callback_free_func)
+        , pending_write_flusher(nullptr)
+        , pending_write_flusher_userdata(nullptr) {
+    }
+
+    io_system::~io_system() {
+        filesystems.clear();
+    }
+
+    std::optional<filesystem_id> io_system::add_filesystem(file_system_inst &inst) {
+        const std::lock_guard<std::mutex> guard(access_lock);
+
+        ++id_counter;
+
+        filesystems.emplace(id_counter, inst);
+        return id_counter;
+    }
+
+    /*! \brief Remove the filesystem from the IO system
+    */
+    bool io_system::remove_filesystem(const filesystem_id id) {
+        const std::lock_guard<std::mutex> guard(access_lock);
+
+        if (id > id_counter) {
+            return false;
+        }
+
+        filesystems.erase(id);
         return true;
     }
 
@@ -1230,6 +2237,7 @@ namespace eka2l1 {
     }
 
     std::unique_ptr<file> io_system::open_file(utf16_str vir_path, int mode) {
+        flush_pending_writes(vir_path);
         const std::lock_guard<std::mutex> guard(access_lock);
 
         for (auto &[id, fs] : filesystems) {
@@ -1243,14 +2251,24 @@ namespace eka2l1 {
 
     std::unique_ptr<directory> io_system::open_dir(std::u16string vir_path, epoc::uid_type type, const std::uint32_t attrib) {
         const std::lock_guard<std::mutex> guard(access_lock);
+        std::vector<std::unique_ptr<directory>> dirs;
 
+        // Several file systems can serve the same drive (ROM and ROFS on Z:), list them all
         for (auto &[id, fs] : filesystems) {
             if (auto dir = fs->open_directory(vir_path, type, attrib)) {
-                return dir;
+                dirs.push_back(std::move(dir));
             }
         }
 
-        return nullptr;
+        if (dirs.empty()) {
+            return nullptr;
+        }
+
+        if (dirs.size() == 1) {
+            return std::move(dirs[0]);
+        }
+
+        return std::make_unique<merged_directory>(dirs, attrib);
     }
 
     bool io_system::exist(const std::u16string &path) {
@@ -1326,6 +2344,7 @@ namespace eka2l1 {
     }
 
     std::optional<entry_info> io_system::get_entry_info(const std::u16string &path) {
+        flush_pending_writes(path);
         const std::lock_guard<std::mutex> guard(access_lock);
 
         for (auto &[id, fs] : filesystems) {
@@ -1349,16 +2368,89 @@ namespace eka2l1 {
         return std::nullopt;
     }
 
+    // Copy a file of a file system without host storage (ROFS) out to the given host path
+    static bool materialise_on_host(file *source_file, const std::string &host_path) {
+        static std::atomic<std::uint32_t> temp_counter(0);
+
+        const std::string host_dir = eka2l1::file_directory(host_path);
+
+        if (!host_dir.empty() && !common::exists(host_dir)) {
+            common::create_directories(host_dir);
+        }
+
+        // Write to a temporary file first, so a partial copy is never taken for the real one. Callers may race
+        // to copy the same entry, give each its own.
+        const std::string temp_path = fmt::format("{}.{}.tmp", host_path, temp_counter++);
+        FILE *f = common::open_c_file(temp_path, "wb");
+
+        if (!f) {
+            return false;
+        }
+
+        std::vector<std::uint8_t> buffer(0x10000);
+        bool ok = true;
+
+        while (ok) {
+            const std::size_t read = source_file->read_file(buffer.data(), 1, static_cast<std::uint32_t>(buffer.size()));
+
+            if ((read == 0) || (read == static_cast<std::size_t>(-1))) {
+                break;
+            }
+
+            ok = (fwrite(buffer.data(), 1, read, f) == read);
+        }
+
+        fclose(f);
+
+        if (!ok || !common::move_file(temp_path, host_path)) {
+            common::remove(temp_path);
+            return false;
+        }
+
+        return true;
+    }
+
     std::optional<std::u16string> io_system::get_raw_path(const std::u16string &path) {
-        const std::lock_guard<std::mutex> guard(access_lock);
+        flush_pending_writes(path);
 
-        for (auto &[id, fs] : filesystems) {
-            if (auto p = fs->get_raw_path(path)) {
-                return p;
+        std::optional<std::u16string> host_path;
+        std::unique_ptr<file> hostless_file;
+
+        {
+            const std::lock_guard<std::mutex> guard(access_lock);
+
+            for (auto &[id, fs] : filesystems) {
+                if (auto p = fs->get_raw_path(path)) {
+                    if (common::exists(common::ucs2_to_utf8(*p))) {
+                        return p;
+                    }
+
+                    // Where the entry would be created, if nobody has it
+                    if (!host_path) {
+                        host_path = p;
+                    }
+                } else if (!hostless_file) {
+                    // Directories are not copied, only files have content to see
+                    const std::optional<entry_info> info = fs->get_entry_info(path);
+
+                    if (info && (info->type == io_component_type::file)) {
+                        hostless_file = fs->open_file(path, READ_MODE | BIN_MODE);
+                    }
+                }
             }
         }
 
-        return std::nullopt;
+        // Only a file system without host storage has the file. Put it where the drive keeps its host files,
+        // so host-path users (INI parsers, media, patches) see the same content as the guest. The source file
+        // holds its own view of the image, so the copy does not need to block the other VFS users.
+        if (host_path && hostless_file && !host_path->empty()) {
+            if (!materialise_on_host(hostless_file.get(), common::ucs2_to_utf8(*host_path))) {
+                LOG_ERROR(VFS, "Unable to copy {} to the host", common::ucs2_to_utf8(path));
+                return std::nullopt;
+            }
+        }
+
+        return host_path;
     }
 
     bool io_system::is_directory(const std::u16string &path) {
@@ -1446,6 +2538,29 @@ namespace eka2l1 {
         return drive_change_callbacks.remove(handle);
     }
 
+    void io_system::set_pending_write_flusher(pending_write_flush_callback callback, void *userdata) {
+        const std::lock_guard<std::mutex> guard(access_lock);
+
+        pending_write_flusher = callback;
+        pending_write_flusher_userdata = userdata;
+    }
+
+    void io_system::flush_pending_writes(const std::u16string &path) {
+        pending_write_flush_callback flusher = nullptr;
+        void *userdata = nullptr;
+
+        {
+            const std::lock_guard<std::mutex> guard(access_lock);
+            flusher = pending_write_flusher;
+            userdata = pending_write_flusher_userdata;
+        }
+
+        // Outside of the lock, the writes go through files the flusher already holds
+        if (flusher) {
+            flusher(userdata, path);
+        }
+    }
+
     void io_system::invoke_drive_change_callbacks(drive_number drv, drive_action act) {
         for (auto &callback : drive_change_callbacks) {
             access_lock.unlock();
@@ -1455,34 +2570,84 @@ namespace eka2l1 {
     }
 
     symfile physical_file_proxy(const std::string &path, int mode) {
-        return std::make_unique<physical_file>(common::utf8_to_ucs2(path), common::utf8_to_ucs2(path), mode);
+        // Host files opened by the emulator itself, nothing else writes to them
+        return std::make_unique<physical_file>(common::utf8_to_ucs2(path), common::utf8_to_ucs2(path), mode, nullptr, true);
+    }
+
+    ro_file_stream::ro_file_stream(file *f)
+        : f_(f)
+        , view_(nullptr)
+        , view_size_(0)
+        , view_pos_(0) {
+        view_size_ = f_->size();
+        view_ = view_size_ ? f_->map_view(0, view_size_) : nullptr;
+
+        if (view_) {
+            view_pos_ = f_->tell();
+        }
+    }
+
+    ro_file_stream::~ro_file_stream() {
+        if (view_ && !f_->is_closed()) {
+            f_->seek(static_cast<std::int64_t>(view_pos_), file_seek_mode::beg);
+        }
     }
 
     void ro_file_stream::seek(const std::int64_t amount, common::seek_where wh) {
-        f_->seek(amount, static_cast<file_seek_mode>(wh));
+        if (!view_) {
+            f_->seek(amount, static_cast<file_seek_mode>(wh));
+            return;
+        }
+
+        std::int64_t new_pos = amount;
+
+        if (wh == common::seek_where::cur) {
+            new_pos += static_cast<std::int64_t>(view_pos_);
+        } else if (wh == common::seek_where::end) {
+            new_pos += static_cast<std::int64_t>(view_size_);
+        }
+
+        if (new_pos >= 0) {
+            view_pos_ = static_cast<std::uint64_t>(new_pos);
+        }
     }
 
     bool ro_file_stream::valid() {
-        return f_->tell() < f_->size();
+        return tell() < size();
     }
 
     std::uint64_t ro_file_stream::left() {
-        if (f_->tell() >= f_->size()) {
+        const std::uint64_t pos = tell();
+        const std::uint64_t total = size();
+
+        if (pos >= total) {
             return 0;
         }
 
-        return f_->size() - f_->tell();
+        return total - pos;
     }
 
     std::uint64_t ro_file_stream::tell() const {
-        return f_->tell();
+        return view_ ? view_pos_ : f_->tell();
     }
 
     std::uint64_t ro_file_stream::size() {
-        return f_->size();
+        return view_ ? view_size_ : f_->size();
     }
 
     std::uint64_t ro_file_stream::read(void *buf, const std::uint64_t read_size) {
+        if (view_) {
+            if (view_pos_ >= view_size_) {
+                return 0;
+            }
+
+            const std::uint64_t will_read = std::min<std::uint64_t>(read_size, view_size_ - view_pos_);
+            std::memcpy(buf, view_ + view_pos_, static_cast<std::size_t>(will_read));
+
+            view_pos_ += will_read;
+            return will_read;
+        }
+
         std::size_t result = f_->read_file(buf, static_cast<std::uint32_t>(read_size), 1);
         if (result == static_cast<std::size_t>(-1)) {
             return 0;
@@ -20,6 +20,7 @@
 #include <catch2/catch.hpp>
 #include <common/allocator.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 
@@ -128,4 +129,44 @@ TEST_CASE("bitmap_count_unaligned_start_end", "bitmap_allocator") {
     // First bitmap has 4 valid bits on (from offset 2), plus with bitmap 2 and 3 (4 bits before offset 70),
     // we got 4 + 12 + 4 = 20 bits
     REQUIRE(alloc.allocated_count(2, 70) == 20);
-}
\ No newline at end of file
+}
+TEST_CASE("arena_reuse_chunks_after_reset", "arena_allocator") {
+    common::arena_chunk_pool pool(256, 4);
+    common::arena_allocator arena(pool);
+
+    void *first = arena.allocate(100);
+    void *second = arena.allocate(100, 8);
+
+    REQUIRE(first != nullptr);
+    REQUIRE(second != nullptr);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(second) % 8 == 0);
+    REQUIRE(arena.used_bytes() == 200);
+
+    // Third allocation does not fit in the first chunk anymore
+    arena.allocate(100);
+    REQUIRE(pool.heap_allocation_count() == 2);
+
+    arena.reset();
+    REQUIRE(arena.used_bytes() == 0);
+
+    // Same pattern again should be served entirely from the pool
+    arena.allocate(100);
+    arena.allocate(100);
+    arena.allocate(100);
+
+    REQUIRE(pool.heap_allocation_count() == 2);
+}
+
+TEST_CASE("arena_large_allocation_own_block", "arena_allocator") {
+    common::arena_chunk_pool pool(256, 4);
+    common::arena_allocator arena(pool);
+
+    std::uint8_t *large = reinterpret_cast<std::uint8_t *>(arena.allocate(1000));
+    REQUIRE(large != nullptr);
+
+    // Must be writable over its entire size
+    std::fill(large, large + 1000, 0xCD);
+
+    REQUIRE(arena.used_bytes() == 1000);
+    REQUIRE(pool.heap_allocation_count() == 1);
+}
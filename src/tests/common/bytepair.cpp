@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/buffer.h>
+#include <common/bytepair.h>
+#include <common/thread_pool.h>
+
+#include <array>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace eka2l1;
+
+// Compress a page by repeatedly replacing the most frequent pair with a byte unused by the page
+static std::vector<std::uint8_t> bytepair_compress_page(const std::uint8_t *data, const std::size_t size, const std::size_t max_pairs) {
+    std::vector<std::uint8_t> tokens(data, data + size);
+    std::vector<std::array<std::uint8_t, 3>> pairs;
+
+    auto find_unused = [&]() -> int {
+        std::array<bool, 256> used{};
+
+        for (const std::uint8_t b : tokens) {
+            used[b] = true;
+        }
+
+        // Bytes an existing pair expands to must keep meaning themselves
+        for (const auto &pair : pairs) {
+            used[pair[0]] = true;
+            used[pair[1]] = true;
+            used[pair[2]] = true;
+        }
+
+        for (int i = 0; i < 256; i++) {
+            if (!used[i]) {
+                return i;
+            }
+        }
+
+        return -1;
+    };
+
+    // Reserve the marker first, it must not be a literal
+    const int marker = find_unused();
+
+    if (marker >= 0) {
+        pairs.push_back({ static_cast<std::uint8_t>(marker), 0, 0 });
+
+        while (pairs.size() - 1 < max_pairs) {
+            std::vector<int> freq(65536, 0);
+            int best = -1;
+
+            for (std::size_t i = 0; i + 1 < tokens.size(); i++) {
+                const int key = (tokens[i] << 8) | tokens[i + 1];
+
+                if ((++freq[key] >= 3) && ((best < 0) || (freq[key] > freq[best]))) {
+                    best = key;
+                }
+            }
+
+            const int token = find_unused();
+
+            if ((best < 0) || (token < 0)) {
+                break;
+            }
+
+            std::vector<std::uint8_t> replaced;
+
+            for (std::size_t i = 0; i < tokens.size(); i++) {
+                if ((i + 1 < tokens.size()) && (((tokens[i] << 8) | tokens[i + 1]) == best)) {
+                    replaced.push_back(static_cast<std::uint8_t>(token));
+                    i++;
+                } else {
+                    replaced.push_back(tokens[i]);
+                }
+            }
+
+            tokens = std::move(replaced);
+            pairs.push_back({ static_cast<std::uint8_t>(token), static_cast<std::uint8_t>(best >> 8), static_cast<std::uint8_t>(best & 0xFF) });
+        }
+
+        pairs.erase(pairs.begin());
+    }
+
+    std::vector<std::uint8_t> result;
+    result.push_back(static_cast<std::uint8_t>(pairs.size()));
+
+    if (!pairs.empty()) {
+        result.push_back(static_cast<std::uint8_t>(marker));
+
+        if (pairs.size() < 32) {
+            for (const auto &pair : pairs) {
+                result.insert(result.end(), pair.begin(), pair.end());
+            }
+        } else {
+            std::array<std::uint8_t, 32> mask{};
+            std::array<const std::array<std::uint8_t, 3> *, 256> by_token{};
+
+            for (const auto &pair : pairs) {
+                mask[pair[0] >> 3] |= 1 << (pair[0] & 7);
+                by_token[pair[0]] = &pair;
+            }
+
+            result.insert(result.end(), mask.begin(), mask.end());
+
+            for (int b = 0; b < 256; b++) {
+                if (by_token[b]) {
+                    result.push_back((*by_token[b])[1]);
+                    result.push_back((*by_token[b])[2]);
+                }
+            }
+        }
+    }
+
+    result.insert(result.end(), tokens.begin(), tokens.end());
+    return result;
+}
+
+static std::vector<std::uint8_t> bytepair_compress(const std::vector<std::uint8_t> &data, const std::size_t max_pairs) {
+    std::vector<std::vector<std::uint8_t>> pages;
+
+    for (std::size_t off = 0; off < data.size(); off += common::BYTEPAIR_PAGE_SIZE) {
+        const std::size_t len = std::min<std::size_t>(data.size() - off, common::BYTEPAIR_PAGE_SIZE);
+        pages.push_back(bytepair_compress_page(data.data() + off, len, max_pairs));
+    }
+
+    std::vector<std::uint8_t> result(10 + pages.size() * sizeof(std::uint16_t));
+    std::uint32_t total = 0;
+
+    for (std::size_t i = 0; i < pages.size(); i++) {
+        const std::uint16_t page_size = static_cast<std::uint16_t>(pages[i].size());
+        std::memcpy(&result[10 + i * sizeof(std::uint16_t)], &page_size, sizeof(std::uint16_t));
+
+        total += page_size;
+    }
+
+    const std::int32_t decompressed_size = static_cast<std::int32_t>(data.size());
+    const std::uint16_t page_count = static_cast<std::uint16_t>(pages.size());
+
+    std::memcpy(&result[0], &total, sizeof(std::uint32_t));
+    std::memcpy(&result[4], &decompressed_size, sizeof(std::int32_t));
+    std::memcpy(&result[8], &page_count, sizeof(std::uint16_t));
+
+    for (const auto &page : pages) {
+        result.insert(result.end(), page.begin(), page.end());
+    }
+
+    return result;
+}
+
+static std::vector<std::uint8_t> make_code_like_data(const std::size_t size, const std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::uint8_t> data(size);
+
+    // A few recurring instruction words, with some noise in between
+    static const std::uint32_t words[] = { 0xE92D4010, 0xE8BD8010, 0xE12FFF1E, 0xE59F0000, 0xEB000000, 0xE3A00000 };
+
+    for (std::size_t i = 0; i + 4 <= size; i += 4) {
+        std::uint32_t word = words[rng() % 6];
+
+        if (rng() % 4 == 0) {
+            word = static_cast<std::uint32_t>(rng());
+        }
+
+        std::memcpy(&data[i], &word, sizeof(std::uint32_t));
+    }
+
+    return data;
+}
+
+TEST_CASE("bytepair_pages_parallel_match_serial", "bytepair") {
+    common::thread_pool pool(4);
+
+    for (const std::size_t max_pairs : { 0, 20, 200 }) {
+        const std::vector<std::uint8_t> source = make_code_like_data(common::BYTEPAIR_PAGE_SIZE * 37 + 1234, static_cast<std::uint32_t>(max_pairs));
+        std::vector<std::uint8_t> compressed = bytepair_compress(source, max_pairs);
+
+        std::vector<char> serial(source.size());
+        std::vector<char> parallel(source.size());
+
+        {
+            common::ro_buf_stream raw(compressed.data(), compressed.size());
+            common::ibytepair_stream stream(&raw);
+
+            REQUIRE(stream.read_pages(serial.data(), serial.size()) == source.size());
+        }
+
+        {
+            common::ro_buf_stream raw(compressed.data(), compressed.size());
+            common::ibytepair_stream stream(&raw);
+
+            REQUIRE(stream.read_pages(parallel.data(), parallel.size(), &pool) == source.size());
+        }
+
+        REQUIRE(std::memcmp(serial.data(), source.data(), source.size()) == 0);
+        REQUIRE(std::memcmp(parallel.data(), source.data(), source.size()) == 0);
+    }
+}
+
+TEST_CASE("bytepair_pages_decompress_on_demand", "bytepair") {
+    const std::vector<std::uint8_t> source = make_code_like_data(common::BYTEPAIR_PAGE_SIZE * 5 + 100, 42);
+    std::vector<std::uint8_t> compressed = bytepair_compress(source, 40);
+
+    common::ro_buf_stream raw(compressed.data(), compressed.size());
+    common::ibytepair_stream stream(&raw);
+    common::bytepair_pages pages;
+
+    REQUIRE(stream.read_compressed_pages(pages));
+    REQUIRE(pages.page_count() == 6);
+    REQUIRE(pages.decompressed_size() == source.size());
+    REQUIRE(pages.page_size(5) == 100);
+
+    // Pages can be brought in out of order
+    std::vector<std::uint8_t> page(common::BYTEPAIR_PAGE_SIZE);
+
+    for (const std::size_t i : { 3, 5, 0, 4, 1, 2 }) {
+        REQUIRE(pages.decompress_page(page.data(), i) == pages.page_size(i));
+        REQUIRE(std::memcmp(page.data(), source.data() + i * common::BYTEPAIR_PAGE_SIZE, pages.page_size(i)) == 0);
+    }
+
+    REQUIRE(pages.decompress_page(page.data(), 6) == 0);
+}
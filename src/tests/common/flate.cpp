@@ -0,0 +1,960 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/flate.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <vector>
+
+using namespace eka2l1;
+
+// The bit-by-bit tree walking inflater the table-driven one replaced, kept to check the output is the same
+namespace legacy {
+    static const std::uint32_t HUFFMAN_META_DECODE[] = {
+        0x0004006c, 0x00040064, 0x0004005c, 0x00040050, 0x00040044, 0x0004003c, 0x00040034,
+        0x00040021, 0x00040023, 0x00040025, 0x00040027, 0x00040029, 0x00040014, 0x0004000c,
+        0x00040035, 0x00390037, 0x00330031, 0x0004002b, 0x002f002d, 0x001f001d, 0x001b0019,
+        0x00040013, 0x00170015, 0x0004000d, 0x0011000f, 0x000b0009, 0x00070003, 0x00050001
+    };
+
+    static std::uint32_t swap_bo(std::uint32_t val) {
+        std::uint32_t tval = (val << 16) | (val >> 16);
+        tval ^= val;
+        tval &= 0xff00ffff;
+        val = (val >> 8) | (val << 24);
+        return val ^ (tval >> 8);
+    }
+
+    struct bit_input {
+        int count;
+        std::uint32_t bits;
+        int remain;
+        const std::uint32_t *buf_ptr;
+
+        bit_input(const std::uint8_t *ptr, int len) {
+            std::uintptr_t p = (std::uintptr_t)ptr;
+            int off = 0;
+
+            const std::uint32_t *nptr = (const std::uint32_t *)(p & ~3);
+            off += (p & 3) << 3;
+
+            if (len == 0)
+                count = 0;
+            else {
+                bits = swap_bo(*nptr++) << off;
+                off = 32 - off;
+                len -= off;
+
+                if (len < 0)
+                    off += len;
+
+                count = off;
+            }
+
+            remain = len;
+            buf_ptr = nptr;
+        }
+
+        std::uint32_t read(int size) {
+            if (!size)
+                return 0;
+
+            std::uint32_t val = 0;
+            std::uint32_t tbits = bits;
+
+            count -= size;
+
+            while (count < 0) {
+                if (count + size != 0)
+                    val |= tbits >> (32 - (count + size)) << (-count);
+
+                size = -count;
+
+                if (remain > 0) {
+                    tbits = swap_bo(*buf_ptr++);
+                    count += 32;
+                    remain -= 32;
+
+                    if (remain < 0)
+                        count += remain;
+                } else {
+                    tbits = bits;
+                    count -= size;
+
+                    return 0;
+                }
+            }
+
+            bits = (size == 32) ? 0 : tbits << size;
+
+            return val | (tbits >> (32 - size));
+        }
+
+        std::uint32_t read() {
+            std::uint32_t tbits = bits;
+            int tcount = count;
+
+            if (--tcount < 0)
+                return read(1);
+
+            count = tcount;
+            bits = tbits << 1;
+
+            return tbits >> 31;
+        }
+
+        std::uint32_t huffman(const std::uint32_t *tree) {
+            std::uint32_t huff = 0;
+
+            do {
+                tree = (const std::uint32_t *)((const std::uint8_t *)(tree) + (huff >> 16));
+                huff = *tree;
+
+                if (read() == 0)
+                    huff <<= 16;
+            } while ((huff & 0x10000u) == 0);
+
+            return huff >> 17;
+        }
+    };
+
+    static void internalize(bit_input &input, std::uint32_t *huffman, int num_codes) {
+        std::array<std::uint8_t, flate::HUFFMAN_METACODE> list;
+
+        for (std::uint8_t i = 0; i < list.size(); ++i)
+            list[i] = i;
+
+        int last = 0;
+        std::uint32_t *p = huffman;
+        std::uint32_t *end = p + num_codes;
+        int rl = 0;
+
+        while (p + rl < end) {
+            int c = input.huffman(HUFFMAN_META_DECODE);
+
+            if (c < 2) {
+                rl += rl + c + 1;
+            } else {
+                while (rl > 0) {
+                    *p++ = last;
+                    --rl;
+                }
+
+                --c;
+                list[0] = std::uint8_t(last);
+                last = list[c];
+
+                std::memmove(&list[1], &list[0], (std::size_t)c);
+                *p++ = last;
+            }
+        }
+
+        while (rl > 0) {
+            *p++ = last;
+            --rl;
+        }
+    }
+
+    struct inflater {
+        bit_input bits;
+        const std::uint8_t *rptr = nullptr;
+        int len = 0;
+        const std::uint8_t *avail;
+        const std::uint8_t *limit;
+        flate::encoding encode;
+        std::uint8_t out[flate::DEFLATE_MAX_DIST];
+
+        explicit inflater(const bit_input &input)
+            : bits(input) {
+            avail = out;
+            limit = out;
+        }
+
+        bool init() {
+            internalize(bits, encode.lit_len, flate::DEFLATE_CODES);
+
+            if (!flate::huffman::valid(encode.lit_len, flate::ENCODING_LITERAL_LEN) || !flate::huffman::valid(encode.dist, flate::ENCODING_DISTS)) {
+                return false;
+            }
+
+            flate::huffman::decoding(reinterpret_cast<int *>(encode.lit_len), flate::ENCODING_LITERAL_LEN, encode.lit_len);
+            flate::huffman::decoding(reinterpret_cast<int *>(encode.dist), flate::ENCODING_DISTS, encode.dist, flate::DEFLATE_DIST_CODE_BASE);
+
+            return true;
+        }
+
+        int inflate() {
+            std::uint8_t *tout = out;
+            std::uint8_t *end = out + flate::DEFLATE_MAX_DIST;
+            std::uint32_t *tree = encode.lit_len;
+
+            if (len < 0)
+                return 0;
+            if (len > 0)
+                goto use_history;
+
+            while (tout < end) {
+                {
+                    int val = bits.huffman(tree) - flate::ENCODING_LITERALS;
+
+                    if (val < 0) {
+                        *tout++ = (std::uint8_t)val;
+                        continue;
+                    }
+
+                    if (val == flate::ENCODING_EOS - flate::ENCODING_LITERALS) {
+                        len -= 1;
+                        break;
+                    }
+
+                    int code = val & 0xff;
+
+                    if (code >= 8) {
+                        int xtra = (code >> 2) - 1;
+                        code -= xtra << 2;
+                        code <<= xtra;
+                        code |= bits.read(xtra);
+                    }
+
+                    if (val < flate::DEFLATE_DIST_CODE_BASE - flate::ENCODING_LITERALS) {
+                        len = code + flate::DEFLATE_MIN_LENGTH;
+                        tree = encode.dist;
+                        continue;
+                    }
+
+                    rptr = tout - (code + 1);
+
+                    if (rptr + flate::DEFLATE_MAX_DIST < end) {
+                        rptr += flate::DEFLATE_MAX_DIST;
+                    }
+                }
+            use_history:
+                int tfr = std::min(static_cast<int>(end - tout), len);
+                len -= tfr;
+
+                const std::uint8_t *from = rptr;
+                do {
+                    *tout++ = *from++;
+
+                    if (from == end)
+                        from -= flate::DEFLATE_MAX_DIST;
+                } while (--tfr != 0);
+
+                rptr = from;
+                tree = encode.lit_len;
+            }
+
+            return static_cast<int>(tout - out);
+        }
+
+        int read(std::uint8_t *buf, std::size_t rlen) {
+            int tfr = 0;
+
+            for (;;) {
+                int hlen = std::min(static_cast<int>(rlen), static_cast<int>(limit - avail));
+
+                if (hlen && buf) {
+                    std::memcpy(buf, avail, hlen);
+                    buf += hlen;
+                }
+
+                rlen -= hlen;
+                avail += hlen;
+                tfr += hlen;
+
+                if (rlen == 0)
+                    return tfr;
+
+                hlen = inflate();
+
+                if (hlen == 0)
+                    return tfr;
+
+                avail = out;
+                limit = avail + hlen;
+            }
+        }
+    };
+}
+
+// Writes Symbian deflate streams, so that the inflaters have something to decode
+namespace {
+    static const std::uint32_t HUFFMAN_META_ENCODE[] = {
+        0x10000000, 0x1c000000, 0x12000000, 0x1d000000, 0x26000000, 0x26800000, 0x2f000000, 0x37400000,
+        0x37600000, 0x37800000, 0x3fa00000, 0x3fb00000, 0x3fc00000, 0x3fd00000, 0x47e00000, 0x47e80000,
+        0x47f00000, 0x4ff80000, 0x57fc0000, 0x5ffe0000, 0x67ff0000, 0x77ff8000, 0x7fffa000, 0x7fffb000,
+        0x7fffc000, 0x7fffd000, 0x7fffe000, 0x87fff000, 0x87fff800
+    };
+
+    struct bit_writer {
+        std::vector<std::uint8_t> data;
+        std::size_t bit_count = 0;
+
+        void write(const std::uint32_t value, const int size) {
+            for (int i = size - 1; i >= 0; i--) {
+                if ((bit_count & 7) == 0) {
+                    data.push_back(0);
+                }
+
+                if ((value >> i) & 1) {
+                    data.back() |= 0x80 >> (bit_count & 7);
+                }
+
+                bit_count++;
+            }
+        }
+
+        void write_meta(const int symbol) {
+            const std::uint32_t packed = HUFFMAN_META_ENCODE[symbol];
+            const int size = packed >> flate::HUFFMAN_MAX_CODELENGTH;
+
+            write((packed >> (flate::HUFFMAN_MAX_CODELENGTH - size)) & ((1u << size) - 1), size);
+        }
+    };
+
+    struct stream_encoder {
+        std::array<std::uint32_t, flate::DEFLATE_CODES> lengths{};
+        std::array<std::uint32_t, flate::DEFLATE_CODES> codes{};
+        bit_writer writer;
+
+        void write_run(const int run) {
+            if (run > 0) {
+                write_run((run - 1) >> 1);
+                writer.write_meta(1 - (run & 1));
+            }
+        }
+
+        // Store the code lengths, move-to-front coded with runs of repeats
+        void write_lengths() {
+            std::array<std::uint8_t, flate::HUFFMAN_METACODE> list;
+
+            for (std::size_t i = 0; i < list.size(); i++) {
+                list[i] = static_cast<std::uint8_t>(i);
+            }
+
+            int last = 0;
+            int run = 0;
+
+            for (const std::uint32_t len : lengths) {
+                if (static_cast<int>(len) == last) {
+                    run++;
+                    continue;
+                }
+
+                write_run(run);
+                run = 0;
+
+                int j = 1;
+                while (list[j] != len) {
+                    j++;
+                }
+
+                writer.write_meta(j + 1);
+
+                while (--j > 0) {
+                    list[j + 1] = list[j];
+                }
+
+                list[1] = static_cast<std::uint8_t>(last);
+                last = len;
+            }
+
+            write_run(run);
+        }
+
+        // Canonical codes: shorter first, then by symbol
+        void assign_codes(const std::size_t first, const std::size_t count) {
+            std::uint32_t next = 0;
+
+            for (std::uint32_t len = 1; len <= flate::HUFFMAN_MAX_CODELENGTH; len++) {
+                for (std::size_t i = first; i < first + count; i++) {
+                    if (lengths[i] == len) {
+                        codes[i] = next++;
+                    }
+                }
+
+                next <<= 1;
+            }
+        }
+
+        void begin() {
+            assign_codes(0, flate::ENCODING_LITERAL_LEN);
+            assign_codes(flate::ENCODING_LITERAL_LEN, flate::ENCODING_DISTS);
+            write_lengths();
+        }
+
+        void write_symbol(const std::size_t symbol) {
+            writer.write(codes[symbol], lengths[symbol]);
+        }
+
+        static int value_code(const int value, int &xtra) {
+            xtra = 0;
+
+            if (value < 8) {
+                return value;
+            }
+
+            int high = 31;
+            while (!((value >> high) & 1)) {
+                high--;
+            }
+
+            xtra = high - 2;
+            return ((xtra + 1) << 2) + ((value >> xtra) - 4);
+        }
+
+        void write_literal(const std::uint8_t value) {
+            write_symbol(value);
+        }
+
+        void write_match(const int length, const int distance) {
+            int xtra = 0;
+            int code = value_code(length - flate::DEFLATE_MIN_LENGTH, xtra);
+
+            write_symbol(flate::ENCODING_LITERALS + code);
+            writer.write((length - flate::DEFLATE_MIN_LENGTH) & ((1 << xtra) - 1), xtra);
+
+            code = value_code(distance - 1, xtra);
+
+            write_symbol(flate::ENCODING_LITERAL_LEN + code);
+            writer.write((distance - 1) & ((1 << xtra) - 1), xtra);
+        }
+
+        void end() {
+            write_symbol(flate::ENCODING_EOS);
+        }
+    };
+
+    // Lengths of a random complete prefix code with the given number of codes
+    static std::vector<std::uint32_t> make_random_code_lengths(std::mt19937 &rng, const std::size_t count) {
+        if (count == 1) {
+            return { 1 };
+        }
+
+        std::vector<std::uint32_t> leaves = { 1, 1 };
+
+        while (leaves.size() < count) {
+            const std::size_t index = rng() % leaves.size();
+
+            if (leaves[index] >= flate::HUFFMAN_MAX_CODELENGTH) {
+                continue;
+            }
+
+            leaves[index]++;
+            leaves.push_back(leaves[index]);
+        }
+
+        std::shuffle(leaves.begin(), leaves.end(), rng);
+        return leaves;
+    }
+
+    static void assign_random_lengths(std::mt19937 &rng, std::uint32_t *lengths, const std::vector<std::size_t> &used) {
+        std::vector<std::uint32_t> code_lengths = make_random_code_lengths(rng, used.size());
+
+        for (std::size_t i = 0; i < used.size(); i++) {
+            lengths[used[i]] = code_lengths[i];
+        }
+    }
+
+    // Lengths from symbol frequencies, limited to the longest code Symbian allows
+    static void assign_huffman_lengths(std::uint32_t *lengths, std::vector<std::uint64_t> freqs) {
+        for (;;) {
+            using node = std::pair<std::uint64_t, int>;
+
+            std::priority_queue<node, std::vector<node>, std::greater<node>> queue;
+            std::vector<int> parents;
+
+            for (std::size_t i = 0; i < freqs.size(); i++) {
+                lengths[i] = 0;
+
+                if (freqs[i]) {
+                    queue.push({ freqs[i], static_cast<int>(parents.size()) });
+                    parents.push_back(-1);
+                }
+            }
+
+            if (queue.size() == 1) {
+                for (std::size_t i = 0; i < freqs.size(); i++) {
+                    lengths[i] = freqs[i] ? 1 : 0;
+                }
+
+                return;
+            }
+
+            while (queue.size() > 1) {
+                const node a = queue.top();
+                queue.pop();
+                const node b = queue.top();
+                queue.pop();
+
+                const int parent = static_cast<int>(parents.size());
+                parents.push_back(-1);
+                parents[a.second] = parent;
+                parents[b.second] = parent;
+
+                queue.push({ a.first + b.first, parent });
+            }
+
+            bool fits = true;
+            std::size_t leaf = 0;
+
+            for (std::size_t i = 0; i < freqs.size(); i++) {
+                if (!freqs[i]) {
+                    continue;
+                }
+
+                std::uint32_t depth = 0;
+                for (int n = static_cast<int>(leaf++); parents[n] != -1; n = parents[n]) {
+                    depth++;
+                }
+
+                lengths[i] = depth;
+                fits = fits && (depth <= flate::HUFFMAN_MAX_CODELENGTH);
+            }
+
+            if (fits) {
+                return;
+            }
+
+            for (auto &freq : freqs) {
+                if (freq) {
+                    freq = (freq >> 1) | 1;
+                }
+            }
+        }
+    }
+
+    // A greedy compressor, good enough to give the inflaters streams shaped like real images
+    static std::vector<std::uint8_t> deflate_buffer(const std::vector<std::uint8_t> &data) {
+        struct token {
+            int length;
+            int distance_or_literal;
+        };
+
+        std::vector<token> tokens;
+        std::vector<int> head(1 << 16, -1);
+        std::vector<int> prev(data.size(), -1);
+
+        auto hash_at = [&](const std::size_t pos) {
+            return ((data[pos] << 8) ^ (data[pos + 1] << 4) ^ data[pos + 2]) & 0xFFFF;
+        };
+
+        std::size_t pos = 0;
+
+        while (pos < data.size()) {
+            int best_len = 0;
+            int best_dist = 0;
+
+            if (pos + flate::DEFLATE_MIN_LENGTH <= data.size()) {
+                const int hash = hash_at(pos);
+                int candidate = head[hash];
+
+                for (int tries = 0; (candidate >= 0) && (tries < 16); tries++, candidate = prev[candidate]) {
+                    const int dist = static_cast<int>(pos) - candidate;
+
+                    if (dist > static_cast<int>(flate::DEFLATE_MAX_DIST)) {
+                        break;
+                    }
+
+                    int len = 0;
+                    while ((len < static_cast<int>(flate::DEFLATE_MAX_LENGTH)) && (pos + len < data.size()) && (data[candidate + len] == data[pos + len])) {
+                        len++;
+                    }
+
+                    if (len > best_len) {
+                        best_len = len;
+                        best_dist = dist;
+                    }
+                }
+            }
+
+            const std::size_t advance = (best_len >= static_cast<int>(flate::DEFLATE_MIN_LENGTH)) ? best_len : 1;
+
+            if (advance > 1) {
+                tokens.push_back({ best_len, best_dist });
+            } else {
+                tokens.push_back({ 0, data[pos] });
+            }
+
+            for (std::size_t i = 0; i < advance; i++, pos++) {
+                if (pos + flate::DEFLATE_MIN_LENGTH <= data.size()) {
+                    const int hash = hash_at(pos);
+                    prev[pos] = head[hash];
+                    head[hash] = static_cast<int>(pos);
+                }
+            }
+        }
+
+        std::vector<std::uint64_t> lit_freqs(flate::ENCODING_LITERAL_LEN, 0);
+        std::vector<std::uint64_t> dist_freqs(flate::ENCODING_DISTS, 0);
+
+        for (const token &tok : tokens) {
+            int xtra = 0;
+
+            if (tok.length) {
+                lit_freqs[flate::ENCODING_LITERALS + stream_encoder::value_code(tok.length - flate::DEFLATE_MIN_LENGTH, xtra)]++;
+                dist_freqs[stream_encoder::value_code(tok.distance_or_literal - 1, xtra)]++;
+            } else {
+                lit_freqs[tok.distance_or_literal]++;
+            }
+        }
+
+        lit_freqs[flate::ENCODING_EOS]++;
+
+        stream_encoder encoder;
+        assign_huffman_lengths(encoder.lengths.data(), lit_freqs);
+        assign_huffman_lengths(encoder.lengths.data() + flate::ENCODING_LITERAL_LEN, dist_freqs);
+
+        encoder.begin();
+
+        for (const token &tok : tokens) {
+            if (tok.length) {
+                encoder.write_match(tok.length, tok.distance_or_literal);
+            } else {
+                encoder.write_literal(static_cast<std::uint8_t>(tok.distance_or_literal));
+            }
+        }
+
+        encoder.end();
+        return encoder.writer.data;
+    }
+
+    // Pad so that the word-reading legacy input stays in bounds
+    static std::vector<std::uint8_t> pad_stream(std::vector<std::uint8_t> stream) {
+        stream.resize(stream.size() + 8, 0);
+        return stream;
+    }
+
+    static std::vector<std::uint8_t> inflate_with_table(const std::vector<std::uint8_t> &stream, const int bit_len,
+        const std::size_t out_size, std::mt19937 *chunk_rng = nullptr) {
+        flate::bit_input input(stream.data(), bit_len);
+        flate::inflater inflater(input);
+        inflater.init();
+
+        std::vector<std::uint8_t> result(out_size + 64, 0xCD);
+        std::size_t done = 0;
+
+        while (done < result.size()) {
+            const std::size_t chunk = chunk_rng ? std::min<std::size_t>(1 + (*chunk_rng)() % 9000, result.size() - done) : result.size() - done;
+            const int got = inflater.read(result.data() + done, chunk);
+
+            done += got;
+
+            if (got < static_cast<int>(chunk)) {
+                break;
+            }
+        }
+
+        result.resize(done);
+        return result;
+    }
+
+    static std::vector<std::uint8_t> inflate_with_legacy(const std::vector<std::uint8_t> &stream, const int bit_len,
+        const std::size_t out_size) {
+        legacy::bit_input input(stream.data(), bit_len);
+        legacy::inflater inflater(input);
+        REQUIRE(inflater.init());
+
+        std::vector<std::uint8_t> result(out_size + 64, 0xCD);
+        result.resize(inflater.read(result.data(), result.size()));
+
+        return result;
+    }
+
+    // Code-like data: a few instruction patterns with varying fields, string tables and zero fill
+    static std::vector<std::uint8_t> make_image_like_data(const std::size_t size, const std::uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::vector<std::uint8_t> data;
+        data.reserve(size);
+
+        static const std::uint32_t OPCODES[] = { 0xE59F0000, 0xE1A00000, 0xEB000000, 0xE8BD8000, 0xE92D4000, 0xE3A00000, 0xE5900000, 0xE12FFF1E };
+        static const char *WORDS[] = { "CBase", "RThread", "TDesC16", "User::Leave", "iEikonEnv", "CCoeControl", "Draw", "KErrNone" };
+
+        while (data.size() < size) {
+            const std::uint32_t kind = rng() % 10;
+
+            if (kind < 7) {
+                for (int i = 0; i < 16; i++) {
+                    const std::uint32_t word = OPCODES[rng() % 8] | (rng() % 4 ? (rng() & 0xF) : (rng() & 0xFFF));
+                    for (int b = 0; b < 4; b++) {
+                        data.push_back(static_cast<std::uint8_t>(word >> (b * 8)));
+                    }
+                }
+            } else if (kind < 9) {
+                const char *word = WORDS[rng() % 8];
+                for (const char *c = word; *c; c++) {
+                    data.push_back(static_cast<std::uint8_t>(*c));
+                    data.push_back(0);
+                }
+            } else {
+                data.insert(data.end(), rng() % 200, 0);
+            }
+        }
+
+        data.resize(size);
+        return data;
+    }
+}
+
+TEST_CASE("inflate_round_trip", "[flate]") {
+    const std::vector<std::uint8_t> data = make_image_like_data(200000, 1);
+    const std::vector<std::uint8_t> stream = pad_stream(deflate_buffer(data));
+
+    REQUIRE(stream.size() < data.size() / 2);
+
+    const int bit_len = static_cast<int>(stream.size() * 8);
+    REQUIRE(inflate_with_legacy(stream, bit_len, data.size()) == data);
+    REQUIRE(inflate_with_table(stream, bit_len, data.size()) == data);
+
+    std::mt19937 rng(2);
+    REQUIRE(inflate_with_table(stream, bit_len, data.size(), &rng) == data);
+}
+
+TEST_CASE("inflate_matches_legacy_on_random_streams", "[flate]") {
+    std::mt19937 rng(0x5EED);
+
+    for (int round = 0; round < 300; round++) {
+        stream_encoder encoder;
+
+        // Pick which symbols are used. The end of stream one always is.
+        std::vector<std::size_t> literals;
+        std::vector<std::size_t> length_codes;
+        std::vector<std::size_t> dist_codes;
+
+        const std::size_t literal_count = (round % 7 == 0) ? 0 : (1 + rng() % flate::ENCODING_LITERALS);
+        const std::size_t length_count = (round % 5 == 0) ? 0 : (1 + rng() % flate::ENCODING_LENGTHS);
+
+        std::vector<std::size_t> all_literals(flate::ENCODING_LITERALS);
+        for (std::size_t i = 0; i < all_literals.size(); i++) {
+            all_literals[i] = i;
+        }
+
+        std::shuffle(all_literals.begin(), all_literals.end(), rng);
+        literals.assign(all_literals.begin(), all_literals.begin() + literal_count);
+
+        for (std::size_t i = 0; i < length_count; i++) {
+            length_codes.push_back(flate::ENCODING_LITERALS + rng() % flate::ENCODING_LENGTHS);
+        }
+
+        std::sort(length_codes.begin(), length_codes.end());
+        length_codes.erase(std::unique(length_codes.begin(), length_codes.end()), length_codes.end());
+
+        if (!length_codes.empty()) {
+            const std::size_t dist_count = 1 + rng() % flate::ENCODING_DISTS;
+
+            for (std::size_t i = 0; i < dist_count; i++) {
+                dist_codes.push_back(rng() % flate::ENCODING_DISTS);
+            }
+
+            std::sort(dist_codes.begin(), dist_codes.end());
+            dist_codes.erase(std::unique(dist_codes.begin(), dist_codes.end()), dist_codes.end());
+        }
+
+        if (literals.empty() && length_codes.empty()) {
+            literals.push_back(rng() % flate::ENCODING_LITERALS);
+        }
+
+        std::vector<std::size_t> lit_len_used = literals;
+        lit_len_used.insert(lit_len_used.end(), length_codes.begin(), length_codes.end());
+        lit_len_used.push_back(flate::ENCODING_EOS);
+
+        assign_random_lengths(rng, encoder.lengths.data(), lit_len_used);
+
+        if (!dist_codes.empty()) {
+            assign_random_lengths(rng, encoder.lengths.data() + flate::ENCODING_LITERAL_LEN, dist_codes);
+        }
+
+        encoder.begin();
+
+        // Matches may only reach back into what has been written
+        const std::size_t token_count = rng() % 6000;
+        std::size_t written = 0;
+
+        for (std::size_t i = 0; i < token_count; i++) {
+            const bool can_match = !length_codes.empty() && (written > 0);
+
+            if (literals.empty() || (can_match && (rng() % 3 == 0))) {
+                if (!can_match) {
+                    continue;
+                }
+
+                // Random length and distance, drawn through their codes so rare long codes get used too
+                const std::size_t length_code = length_codes[rng() % length_codes.size()] - flate::ENCODING_LITERALS;
+                const std::size_t dist_code = dist_codes[rng() % dist_codes.size()];
+
+                auto random_value = [&](const int code) {
+                    if (code < 8) {
+                        return code;
+                    }
+
+                    const int xtra = (code >> 2) - 1;
+                    return (((code - (xtra << 2)) << xtra) | static_cast<int>(rng() & ((1 << xtra) - 1)));
+                };
+
+                const int length = random_value(static_cast<int>(length_code)) + flate::DEFLATE_MIN_LENGTH;
+                const int distance = random_value(static_cast<int>(dist_code)) + 1;
+
+                if (distance > static_cast<int>(written)) {
+                    continue;
+                }
+
+                encoder.write_match(length, distance);
+                written += length;
+            } else {
+                encoder.write_literal(static_cast<std::uint8_t>(literals[rng() % literals.size()]));
+                written++;
+            }
+        }
+
+        encoder.end();
+
+        // Some streams end right after the last code, without whole bytes of padding
+        const int bit_len = static_cast<int>(encoder.writer.bit_count);
+        const std::vector<std::uint8_t> stream = pad_stream(encoder.writer.data);
+
+        const std::vector<std::uint8_t> expected = inflate_with_legacy(stream, bit_len, written);
+        REQUIRE(expected.size() == written);
+        REQUIRE(inflate_with_table(stream, bit_len, written) == expected);
+        REQUIRE(inflate_with_table(stream, bit_len, written, &rng) == expected);
+    }
+}
+
+TEST_CASE("inflate_single_code_takes_either_bit", "[flate]") {
+    // With only the end of stream code, the decode tree reads one bit and ignores its value
+    stream_encoder encoder;
+    encoder.lengths[flate::ENCODING_EOS] = 1;
+    encoder.begin();
+    encoder.writer.write(1, 1);
+
+    const std::vector<std::uint8_t> stream = pad_stream(encoder.writer.data);
+    const int bit_len = static_cast<int>(encoder.writer.bit_count);
+
+    REQUIRE(inflate_with_legacy(stream, bit_len, 16).empty());
+    REQUIRE(inflate_with_table(stream, bit_len, 16).empty());
+}
+
+TEST_CASE("inflate_truncated_stream_stops", "[flate]") {
+    const std::vector<std::uint8_t> data = make_image_like_data(50000, 3);
+    const std::vector<std::uint8_t> stream = pad_stream(deflate_buffer(data));
+
+    const std::vector<std::uint8_t> result = inflate_with_table(stream, static_cast<int>(stream.size() * 4), data.size());
+
+    REQUIRE(result.size() < data.size());
+    REQUIRE(std::equal(result.begin(), result.end(), data.begin()));
+}
+
+static std::vector<std::uint8_t> zlib_compress_buffer(const std::vector<std::uint8_t> &data) {
+    mz_ulong compressed_size = mz_compressBound(static_cast<mz_ulong>(data.size()));
+    std::vector<std::uint8_t> compressed(compressed_size);
+
+    REQUIRE(mz_compress(compressed.data(), &compressed_size, data.data(), static_cast<mz_ulong>(data.size())) == MZ_OK);
+    compressed.resize(compressed_size);
+
+    return compressed;
+}
+
+TEST_CASE("inflate_stream_bounded_buffers", "[flate]") {
+    // Mostly zeroes, so a few input bytes inflate to far more than any output buffer
+    std::vector<std::uint8_t> data(6 * 1024 * 1024, 0);
+    const std::vector<std::uint8_t> noise = make_image_like_data(100000, 4);
+    std::copy(noise.begin(), noise.end(), data.begin() + 3 * 1024 * 1024);
+
+    const std::vector<std::uint8_t> compressed = zlib_compress_buffer(data);
+    REQUIRE(compressed.size() < data.size() / 20);
+
+    auto make_reader = [&](std::size_t *pos, const std::size_t limit) {
+        return [&compressed, pos, limit](std::uint8_t *buf, const std::size_t size) {
+            const std::size_t grab = std::min<std::size_t>({ size, 1000, limit - *pos });
+            std::memcpy(buf, compressed.data() + *pos, grab);
+            *pos += grab;
+
+            return grab;
+        };
+    };
+
+    std::vector<std::uint8_t> result;
+    std::size_t largest_piece = 0;
+    std::size_t pos = 0;
+    std::uint64_t out_size = 0;
+
+    REQUIRE(flate::inflate_stream(make_reader(&pos, compressed.size()), [&](const std::uint8_t *piece, const std::size_t size) {
+        result.insert(result.end(), piece, piece + size);
+        largest_piece = std::max(largest_piece, size);
+
+        return true;
+    }, &out_size));
+
+    REQUIRE(result == data);
+    REQUIRE(out_size == data.size());
+    REQUIRE(largest_piece < data.size() / 8);
+
+    // A cut stream fails, after giving out what it could
+    result.clear();
+    pos = 0;
+
+    REQUIRE_FALSE(flate::inflate_stream(make_reader(&pos, compressed.size() / 2), [&](const std::uint8_t *piece, const std::size_t size) {
+        result.insert(result.end(), piece, piece + size);
+        return true;
+    }));
+
+    REQUIRE(result.size() < data.size());
+    REQUIRE(std::equal(result.begin(), result.end(), data.begin()));
+
+    // So does a writer asking to stop
+    std::size_t pieces = 0;
+    pos = 0;
+
+    REQUIRE_FALSE(flate::inflate_stream(make_reader(&pos, compressed.size()), [&](const std::uint8_t *, const std::size_t) {
+        return ++pieces < 2;
+    }));
+
+    REQUIRE(pieces == 2);
+}
+
+TEST_CASE("inflate_benchmark", "[.][benchmark]") {
+    // About the size of a large application executable
+    static constexpr std::size_t IMAGE_SIZE = 4 * 1024 * 1024;
+    static constexpr std::size_t RUNS = 5;
+
+    const std::vector<std::uint8_t> data = make_image_like_data(IMAGE_SIZE, 7);
+    const std::vector<std::uint8_t> stream = pad_stream(deflate_buffer(data));
+    const int bit_len = static_cast<int>(stream.size() * 8);
+
+    auto measure = [&](auto func) {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < RUNS; i++) {
+            REQUIRE(func() == data);
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return static_cast<double>(IMAGE_SIZE * RUNS) / (1024.0 * 1024.0) / seconds;
+    };
+
+    const double legacy_speed = measure([&]() { return inflate_with_legacy(stream, bit_len, data.size()); });
+    const double table_speed = measure([&]() { return inflate_with_table(stream, bit_len, data.size()); });
+
+    WARN("Inflating " << stream.size() << " bytes to " << IMAGE_SIZE << ": tree " << legacy_speed << " MB/s, table "
+                      << table_speed << " MB/s");
+}
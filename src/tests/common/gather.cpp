@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/gather.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace eka2l1;
+
+// Typical Symbian client array layout: 16.16 fixed position and texcoord, byte normal and
+// unsigned byte color, all interleaved with a stride of 28 bytes.
+struct client_vertex {
+    std::int32_t position[3];
+    std::int32_t texcoord[2];
+    std::int8_t normal[4];
+    std::uint8_t color[4];
+};
+
+static_assert(sizeof(client_vertex) == 28);
+
+static std::vector<client_vertex> make_client_vertices(const std::size_t count) {
+    std::vector<client_vertex> vertices(count);
+
+    for (std::size_t i = 0; i < count; i++) {
+        const std::int32_t v = static_cast<std::int32_t>(i);
+
+        vertices[i].position[0] = v * 0x18000;
+        vertices[i].position[1] = -v * 0x4000 - 1;
+        vertices[i].position[2] = 0x7FFFFFFF - v;
+        vertices[i].texcoord[0] = v & 0xFFFF;
+        vertices[i].texcoord[1] = static_cast<std::int32_t>(0x80000000U + i);
+
+        vertices[i].normal[0] = static_cast<std::int8_t>(-128 + (i % 256));
+        vertices[i].normal[1] = static_cast<std::int8_t>(127 - (i % 256));
+        vertices[i].normal[2] = 0;
+        vertices[i].normal[3] = 0;
+
+        vertices[i].color[0] = static_cast<std::uint8_t>(i);
+        vertices[i].color[1] = static_cast<std::uint8_t>(255 - i);
+        vertices[i].color[2] = 0x80;
+        vertices[i].color[3] = 0xFF;
+    }
+
+    return vertices;
+}
+
+static std::uint32_t make_client_sources(const std::vector<client_vertex> &vertices, common::gather_source *sources) {
+    const std::uint8_t *base = reinterpret_cast<const std::uint8_t *>(vertices.data());
+    std::uint32_t offset = 0;
+
+    sources[0] = { base + offsetof(client_vertex, position), sizeof(client_vertex), 3, 4, common::gather_convert_fixed_to_float, 0 };
+    sources[1] = { base + offsetof(client_vertex, texcoord), sizeof(client_vertex), 2, 4, common::gather_convert_fixed_to_float, 0 };
+    sources[2] = { base + offsetof(client_vertex, normal), sizeof(client_vertex), 3, 1, common::gather_convert_byte_norm, 0 };
+    sources[3] = { base + offsetof(client_vertex, color), sizeof(client_vertex), 4, 1, common::gather_convert_copy, 0 };
+
+    for (std::size_t i = 0; i < 4; i++) {
+        sources[i].dest_offset_ = offset;
+        offset += common::gather_dest_size(sources[i]);
+    }
+
+    return offset;
+}
+
+TEST_CASE("gather_converts_and_interleaves", "gather") {
+    const std::vector<client_vertex> vertices = make_client_vertices(300);
+
+    common::gather_source sources[4];
+    const std::uint32_t stride = make_client_sources(vertices, sources);
+
+    REQUIRE(stride == 12 + 8 + 12 + 4);
+
+    std::vector<std::uint8_t> gathered(stride * vertices.size());
+    common::gather_vertices(gathered.data(), stride, sources, 4, vertices.size());
+
+    for (std::size_t i = 0; i < vertices.size(); i++) {
+        const std::uint8_t *vert = gathered.data() + i * stride;
+        float values[8];
+
+        std::memcpy(values, vert, 20);
+        REQUIRE(values[0] == static_cast<float>(vertices[i].position[0]) / 65536.0f);
+        REQUIRE(values[1] == static_cast<float>(vertices[i].position[1]) / 65536.0f);
+        REQUIRE(values[2] == static_cast<float>(vertices[i].position[2]) / 65536.0f);
+        REQUIRE(values[3] == static_cast<float>(vertices[i].texcoord[0]) / 65536.0f);
+        REQUIRE(values[4] == static_cast<float>(vertices[i].texcoord[1]) / 65536.0f);
+
+        std::memcpy(values, vert + 20, 12);
+        REQUIRE(values[0] == Approx(std::max(vertices[i].normal[0] / 127.0f, -1.0f)));
+        REQUIRE(values[1] == Approx(std::max(vertices[i].normal[1] / 127.0f, -1.0f)));
+        REQUIRE(values[2] == 0.0f);
+
+        REQUIRE(std::memcmp(vert + 32, vertices[i].color, 4) == 0);
+    }
+}
+
+TEST_CASE("gather_vector_matches_scalar", "gather") {
+    static constexpr std::size_t COUNT = 257;
+
+    std::vector<std::uint8_t> source(COUNT * 16);
+    for (std::size_t i = 0; i < source.size(); i++) {
+        source[i] = static_cast<std::uint8_t>(i * 37 + 11);
+    }
+
+    const common::gather_convert converts[] = {
+        common::gather_convert_fixed_to_float,
+        common::gather_convert_byte_norm,
+        common::gather_convert_ubyte_norm,
+        common::gather_convert_short_norm,
+        common::gather_convert_ushort_norm
+    };
+
+    const std::uint32_t component_sizes[] = { 4, 1, 1, 2, 2 };
+
+    for (std::size_t c = 0; c < 5; c++) {
+        for (std::uint32_t comp = 1; comp <= 4; comp++) {
+            // Tightly packed for the largest element, so the last element ends exactly at the end
+            // of the source buffer.
+            const std::uint32_t src_stride = comp * component_sizes[c];
+            common::gather_source gsource = { source.data() + source.size() - src_stride * COUNT, src_stride, comp,
+                component_sizes[c], converts[c], 0 };
+
+            const std::uint32_t dest_stride = common::gather_dest_size(gsource);
+
+            std::vector<std::uint8_t> vector_result(dest_stride * COUNT, 0);
+            std::vector<std::uint8_t> scalar_result(dest_stride * COUNT, 0);
+
+            common::gather_vertices(vector_result.data(), dest_stride, &gsource, 1, COUNT);
+            common::gather_vertices_scalar(scalar_result.data(), dest_stride, &gsource, 1, COUNT);
+
+            REQUIRE(vector_result == scalar_result);
+        }
+    }
+}
+
+TEST_CASE("gather_draw_call_microbenchmark", "[.][benchmark]") {
+    // Roughly what a mid-sized model draw pushes per frame. Run with the [benchmark] tag.
+    static constexpr std::size_t VERTEX_COUNT = 4096;
+    static constexpr std::size_t DRAW_COUNT = 2000;
+
+    const std::vector<client_vertex> vertices = make_client_vertices(VERTEX_COUNT);
+
+    common::gather_source sources[4];
+    const std::uint32_t stride = make_client_sources(vertices, sources);
+
+    std::vector<std::uint8_t> gathered(stride * VERTEX_COUNT);
+    std::vector<std::uint8_t> copied(sizeof(client_vertex) * VERTEX_COUNT * 4);
+
+    auto measure = [&](auto func) {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < DRAW_COUNT; i++) {
+            func();
+        }
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // The old path: the whole strided range copied once per attribute, conversion left to the GPU.
+    const auto copy_us = measure([&]() {
+        for (std::size_t i = 0; i < 4; i++) {
+            std::memcpy(copied.data() + i * vertices.size() * sizeof(client_vertex), vertices.data(), vertices.size() * sizeof(client_vertex));
+        }
+    });
+
+    const auto scalar_us = measure([&]() {
+        common::gather_vertices_scalar(gathered.data(), stride, sources, 4, VERTEX_COUNT);
+    });
+
+    const auto vector_us = measure([&]() {
+        common::gather_vertices(gathered.data(), stride, sources, 4, VERTEX_COUNT);
+    });
+
+    WARN("Per draw of " << VERTEX_COUNT << " vertices: per-attribute copy " << (copy_us * 1000 / DRAW_COUNT)
+                        << " ns (" << copied.size() << " bytes), scalar gather " << (scalar_us * 1000 / DRAW_COUNT)
+                        << " ns, vector gather " << (vector_us * 1000 / DRAW_COUNT) << " ns (" << gathered.size() << " bytes)");
+}
+
+TEST_CASE("scan_and_rebase_indices", "gather") {
+    std::vector<std::uint16_t> indices16;
+    std::vector<std::uint8_t> indices8;
+
+    // Odd count so both the vector loop and the tail are used
+    for (std::size_t i = 0; i < 77; i++) {
+        indices16.push_back(static_cast<std::uint16_t>(40000 + (i * 7919) % 1000));
+        indices8.push_back(static_cast<std::uint8_t>(100 + (i * 31) % 150));
+    }
+
+    indices16[70] = 39999;
+    indices16[3] = 65535;
+
+    std::uint32_t min_index = 0;
+    std::uint32_t max_index = 0;
+
+    REQUIRE(common::scan_index_range(indices16.data(), indices16.size(), 2, min_index, max_index));
+    REQUIRE(min_index == 39999);
+    REQUIRE(max_index == 65535);
+
+    REQUIRE(common::scan_index_range(indices8.data(), indices8.size(), 1, min_index, max_index));
+    REQUIRE(min_index == *std::min_element(indices8.begin(), indices8.end()));
+    REQUIRE(max_index == *std::max_element(indices8.begin(), indices8.end()));
+
+    REQUIRE_FALSE(common::scan_index_range(indices8.data(), 0, 1, min_index, max_index));
+
+    std::vector<std::uint16_t> rebased16(indices16.size());
+    common::rebase_indices(rebased16.data(), indices16.data(), indices16.size(), 2, 39999);
+
+    for (std::size_t i = 0; i < indices16.size(); i++) {
+        REQUIRE(rebased16[i] == indices16[i] - 39999);
+    }
+
+    std::vector<std::uint8_t> rebased8 = indices8;
+    common::rebase_indices(rebased8.data(), rebased8.data(), rebased8.size(), 1, min_index);
+
+    for (std::size_t i = 0; i < indices8.size(); i++) {
+        REQUIRE(rebased8[i] == indices8[i] - min_index);
+    }
+}
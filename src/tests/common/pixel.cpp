@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/pixel.h>
+#include <common/thread_pool.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace eka2l1;
+
+static const common::pixel_format ALL_FORMATS[] = {
+    common::pixel_format::gray2,
+    common::pixel_format::gray4,
+    common::pixel_format::gray16,
+    common::pixel_format::gray256,
+    common::pixel_format::palette16,
+    common::pixel_format::palette256,
+    common::pixel_format::xrgb4444,
+    common::pixel_format::rgb565,
+    common::pixel_format::bgr888,
+    common::pixel_format::bgrx8888,
+    common::pixel_format::bgra8888,
+    common::pixel_format::bgra8888_premultiplied,
+    common::pixel_format::rgb888,
+    common::pixel_format::rgba8888
+};
+
+static const common::pixel_simd_level ALL_LEVELS[] = {
+    common::pixel_simd_level::scalar,
+    common::pixel_simd_level::sse2,
+    common::pixel_simd_level::avx2,
+    common::pixel_simd_level::neon
+};
+
+static std::vector<std::uint8_t> make_random_data(const std::size_t size, const std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::uint8_t> data(size);
+
+    for (auto &b: data) {
+        b = static_cast<std::uint8_t>(rng());
+    }
+
+    return data;
+}
+
+// Restores the dispatched level when a test ends
+struct simd_level_guard {
+    common::pixel_simd_level previous_;
+
+    simd_level_guard()
+        : previous_(common::get_pixel_simd_level()) {
+    }
+
+    ~simd_level_guard() {
+        common::set_pixel_simd_level(previous_);
+    }
+};
+
+TEST_CASE("pixel_kernels_match_scalar_for_all_pairs", "pixel") {
+    simd_level_guard guard;
+
+    const std::vector<std::uint8_t> palette_data = make_random_data(256 * 4, 5);
+    std::vector<std::uint32_t> palette(256);
+    std::memcpy(palette.data(), palette_data.data(), palette_data.size());
+
+    // Odd lengths leave tails for the scalar loops, the long one crosses conversion chunks
+    for (const std::size_t count: { 1, 3, 7, 17, 33, 100, 1001 }) {
+        for (const common::pixel_format source_format: ALL_FORMATS) {
+            const std::vector<std::uint8_t> source = make_random_data(common::get_pixel_run_size(source_format, count), static_cast<std::uint32_t>(count));
+
+            for (const common::pixel_format dest_format: ALL_FORMATS) {
+                const std::size_t dest_size = common::get_pixel_run_size(dest_format, count);
+                const std::vector<std::uint8_t> initial = make_random_data(dest_size, 77);
+
+                common::set_pixel_simd_level(common::pixel_simd_level::scalar);
+
+                std::vector<std::uint8_t> expected = initial;
+                const bool supported = common::convert_pixels(expected.data(), dest_format, source.data(), source_format, count, palette.data());
+
+                REQUIRE(supported == ((dest_format == source_format) || ((dest_format != common::pixel_format::palette16) && (dest_format != common::pixel_format::palette256))));
+
+                if (!supported) {
+                    continue;
+                }
+
+                for (const common::pixel_simd_level level: ALL_LEVELS) {
+                    if (!common::set_pixel_simd_level(level)) {
+                        continue;
+                    }
+
+                    std::vector<std::uint8_t> result = initial;
+                    REQUIRE(common::convert_pixels(result.data(), dest_format, source.data(), source_format, count, palette.data()));
+                    REQUIRE(result == expected);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("pixel_sixteen_bit_formats_exhaustive", "pixel") {
+    simd_level_guard guard;
+
+    std::vector<std::uint16_t> all_values(65536);
+    for (std::size_t i = 0; i < all_values.size(); i++) {
+        all_values[i] = static_cast<std::uint16_t>(i);
+    }
+
+    for (const common::pixel_simd_level level: ALL_LEVELS) {
+        if (!common::set_pixel_simd_level(level)) {
+            continue;
+        }
+
+        std::vector<std::uint8_t> rgba(65536 * 4);
+        std::vector<std::uint16_t> back(65536);
+
+        REQUIRE(common::convert_pixels(rgba.data(), common::pixel_format::rgba8888, all_values.data(), common::pixel_format::rgb565, 65536));
+
+        for (std::uint32_t value = 0; value < 65536; value++) {
+            const std::uint32_t r5 = value >> 11;
+            const std::uint32_t g6 = (value >> 5) & 0x3F;
+            const std::uint32_t b5 = value & 0x1F;
+
+            REQUIRE(rgba[value * 4] == (r5 * 255 * 2 + 31) / 62);
+            REQUIRE(rgba[value * 4 + 1] == (g6 * 255 * 2 + 63) / 126);
+            REQUIRE(rgba[value * 4 + 2] == (b5 * 255 * 2 + 31) / 62);
+            REQUIRE(rgba[value * 4 + 3] == 0xFF);
+        }
+
+        // Widening then narrowing gives the same value back
+        REQUIRE(common::convert_pixels(back.data(), common::pixel_format::rgb565, rgba.data(), common::pixel_format::rgba8888, 65536));
+        REQUIRE(back == all_values);
+
+        REQUIRE(common::convert_pixels(rgba.data(), common::pixel_format::rgba8888, all_values.data(), common::pixel_format::xrgb4444, 65536));
+        REQUIRE(common::convert_pixels(back.data(), common::pixel_format::xrgb4444, rgba.data(), common::pixel_format::rgba8888, 65536));
+
+        for (std::uint32_t value = 0; value < 65536; value++) {
+            REQUIRE(rgba[value * 4] == ((value >> 8) & 0xF) * 17);
+            REQUIRE(rgba[value * 4 + 2] == (value & 0xF) * 17);
+            REQUIRE(back[value] == (value & 0xFFF));
+        }
+    }
+}
+
+TEST_CASE("pixel_premultiplied_alpha_exhaustive", "pixel") {
+    simd_level_guard guard;
+
+    // Every colour and alpha pair, in the blue channel
+    std::vector<std::uint8_t> straight(256 * 256 * 4);
+    for (std::uint32_t alpha = 0; alpha < 256; alpha++) {
+        for (std::uint32_t color = 0; color < 256; color++) {
+            std::uint8_t *pixel = straight.data() + (alpha * 256 + color) * 4;
+
+            pixel[0] = static_cast<std::uint8_t>(color);
+            pixel[1] = static_cast<std::uint8_t>(255 - color);
+            pixel[2] = static_cast<std::uint8_t>(color);
+            pixel[3] = static_cast<std::uint8_t>(alpha);
+        }
+    }
+
+    for (const common::pixel_simd_level level: ALL_LEVELS) {
+        if (!common::set_pixel_simd_level(level)) {
+            continue;
+        }
+
+        std::vector<std::uint8_t> premultiplied(straight.size());
+        std::vector<std::uint8_t> back(straight.size());
+
+        REQUIRE(common::convert_pixels(premultiplied.data(), common::pixel_format::bgra8888_premultiplied, straight.data(),
+            common::pixel_format::bgra8888, 65536));
+        REQUIRE(common::convert_pixels(back.data(), common::pixel_format::bgra8888, premultiplied.data(),
+            common::pixel_format::bgra8888_premultiplied, 65536));
+
+        for (std::uint32_t alpha = 0; alpha < 256; alpha++) {
+            for (std::uint32_t color = 0; color < 256; color++) {
+                const std::size_t offset = (alpha * 256 + color) * 4;
+
+                REQUIRE(premultiplied[offset] == (color * alpha * 2 + 255) / 510);
+                REQUIRE(premultiplied[offset + 3] == alpha);
+
+                if (alpha == 0) {
+                    REQUIRE(back[offset] == 0);
+                } else {
+                    // Precision lost by the multiplication can not come back, but stays within one step of alpha
+                    const int error = static_cast<int>(back[offset]) - static_cast<int>(color);
+                    REQUIRE(std::abs(error) * static_cast<int>(alpha) <= 255);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("pixel_gray_and_palette_bit_order", "pixel") {
+    // First pixel in the lowest bits
+    const std::uint8_t gray16[] = { 0x1F, 0x80 };
+    std::uint8_t rgba[4 * 4];
+
+    REQUIRE(common::convert_pixels(rgba, common::pixel_format::rgba8888, gray16, common::pixel_format::gray16, 4));
+    REQUIRE(rgba[0] == 0xFF);
+    REQUIRE(rgba[4] == 0x11);
+    REQUIRE(rgba[8] == 0x00);
+    REQUIRE(rgba[12] == 0x88);
+
+    std::uint32_t palette[16] = {};
+    palette[0x3] = 0x00112233;
+    palette[0xA] = 0x00445566;
+
+    const std::uint8_t indices = 0xA3;
+    REQUIRE(common::convert_pixels(rgba, common::pixel_format::rgba8888, &indices, common::pixel_format::palette16, 2, palette));
+    REQUIRE(std::memcmp(rgba, "\x33\x22\x11\xFF\x66\x55\x44\xFF", 8) == 0);
+
+    REQUIRE_FALSE(common::convert_pixels(rgba, common::pixel_format::rgba8888, &indices, common::pixel_format::palette16, 2));
+    REQUIRE_FALSE(common::convert_pixels(rgba, common::pixel_format::palette256, gray16, common::pixel_format::gray256, 2));
+
+    // Gray survives a trip through colour, and pixels past the run keep their bits
+    for (const common::pixel_format format: { common::pixel_format::gray2, common::pixel_format::gray4, common::pixel_format::gray16 }) {
+        const std::vector<std::uint8_t> source = make_random_data(16, 3);
+        std::vector<std::uint8_t> colour(21 * 3);
+        std::vector<std::uint8_t> back(16, 0x5A);
+
+        REQUIRE(common::convert_pixels(colour.data(), common::pixel_format::bgr888, source.data(), format, 21));
+        REQUIRE(common::convert_pixels(back.data(), format, colour.data(), common::pixel_format::bgr888, 21));
+
+        const std::size_t bits = 21 * common::get_pixel_format_bpp(format);
+        for (std::size_t bit = 0; bit < 128; bit++) {
+            const int expected = (bit < bits) ? ((source[bit / 8] >> (bit & 7)) & 1) : ((0x5A >> (bit & 7)) & 1);
+            REQUIRE(((back[bit / 8] >> (bit & 7)) & 1) == expected);
+        }
+    }
+}
+
+TEST_CASE("pixel_rows_parallel_matches_serial", "pixel") {
+    common::thread_pool pool(3);
+
+    const std::size_t width = 301;
+    const std::size_t height = 400;
+    const std::size_t source_stride = 304 * 2;
+
+    const std::vector<std::uint8_t> source = make_random_data(source_stride * height, 11);
+    std::vector<std::uint8_t> serial(width * 4 * height);
+    std::vector<std::uint8_t> parallel(width * 4 * height);
+
+    REQUIRE(common::convert_pixel_rows(serial.data(), width * 4, common::pixel_format::rgba8888, source.data(), source_stride,
+        common::pixel_format::rgb565, width, height));
+    REQUIRE(common::convert_pixel_rows(parallel.data(), width * 4, common::pixel_format::rgba8888, source.data(), source_stride,
+        common::pixel_format::rgb565, width, height, nullptr, &pool));
+
+    REQUIRE(serial == parallel);
+}
+
+TEST_CASE("pixel_conversion_benchmark", "[.][benchmark]") {
+    simd_level_guard guard;
+
+    // A full screen worth of a large S^3 display, several times over
+    static constexpr std::size_t PIXEL_COUNT = 1024 * 1024;
+    static constexpr std::size_t RUNS = 20;
+
+    const std::vector<std::uint8_t> source = make_random_data(PIXEL_COUNT * 4, 42);
+    std::vector<std::uint8_t> dest(PIXEL_COUNT * 4);
+
+    const std::pair<common::pixel_format, common::pixel_format> pairs[] = {
+        { common::pixel_format::rgb565, common::pixel_format::rgba8888 },
+        { common::pixel_format::bgr888, common::pixel_format::rgba8888 },
+        { common::pixel_format::bgra8888, common::pixel_format::rgba8888 },
+        { common::pixel_format::gray256, common::pixel_format::rgba8888 },
+        { common::pixel_format::bgra8888, common::pixel_format::bgra8888_premultiplied },
+        { common::pixel_format::bgrx8888, common::pixel_format::rgb565 },
+        { common::pixel_format::rgba8888, common::pixel_format::bgr888 }
+    };
+
+    static const char *LEVEL_NAMES[] = { "scalar", "SSE2", "AVX2", "NEON" };
+
+    for (const auto &[source_format, dest_format]: pairs) {
+        for (const common::pixel_simd_level level: ALL_LEVELS) {
+            if (!common::set_pixel_simd_level(level)) {
+                continue;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < RUNS; i++) {
+                common::convert_pixels(dest.data(), dest_format, source.data(), source_format, PIXEL_COUNT);
+            }
+
+            const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+            WARN("Format " << static_cast<int>(source_format) << " to " << static_cast<int>(dest_format) << ", "
+                           << LEVEL_NAMES[static_cast<int>(level)] << ": " << (PIXEL_COUNT * RUNS) / std::max<long long>(us, 1) << " Mpixels/s");
+        }
+    }
+}
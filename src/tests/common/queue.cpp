@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ * 
+ * This file is part of EKA2L1 project.
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/queue.h>
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+using namespace eka2l1;
+
+TEST_CASE("spsc_ring_full_and_empty", "spsc_ring") {
+    spsc_ring<int, 4> ring;
+
+    REQUIRE(ring.empty());
+    REQUIRE_FALSE(ring.pop().has_value());
+
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(ring.push(i));
+    }
+
+    REQUIRE(ring.size() == 4);
+    REQUIRE_FALSE(ring.push(4));
+
+    REQUIRE(ring.pop().value() == 0);
+    REQUIRE(ring.push(4));
+
+    for (int i = 1; i <= 4; i++) {
+        REQUIRE(ring.pop().value() == i);
+    }
+
+    REQUIRE(ring.empty());
+}
+
+TEST_CASE("spsc_ring_move_only_retry", "spsc_ring") {
+    spsc_ring<std::unique_ptr<int>, 2> ring;
+
+    REQUIRE(ring.push(std::make_unique<int>(0)));
+    REQUIRE(ring.push(std::make_unique<int>(1)));
+
+    // A failed push must leave the item with the caller, so it can be pushed again later
+    std::unique_ptr<int> item = std::make_unique<int>(2);
+    REQUIRE_FALSE(ring.push(std::move(item)));
+    REQUIRE(item);
+
+    REQUIRE(*ring.pop().value() == 0);
+    REQUIRE(ring.push(std::move(item)));
+    REQUIRE_FALSE(item);
+
+    REQUIRE(*ring.pop().value() == 1);
+    REQUIRE(*ring.pop().value() == 2);
+}
+
+TEST_CASE("spsc_ring_cross_thread_order", "spsc_ring") {
+    static constexpr std::uint32_t ITEM_COUNT = 200000;
+    spsc_ring<std::uint32_t, 64> ring;
+
+    std::thread producer([&]() {
+        for (std::uint32_t i = 0; i < ITEM_COUNT; i++) {
+            while (!ring.push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::uint32_t expected = 0;
+    bool in_order = true;
+
+    while (expected < ITEM_COUNT) {
+        std::optional<std::uint32_t> item = ring.pop();
+
+        if (!item) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        in_order = in_order && (item.value() == expected);
+        expected++;
+    }
+
+    producer.join();
+
+    REQUIRE(in_order);
+    REQUIRE(ring.empty());
+}
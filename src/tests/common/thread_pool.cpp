@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/thread_pool.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace eka2l1;
+
+TEST_CASE("thread_pool_covers_range_once", "thread_pool") {
+    common::thread_pool pool(3);
+    std::vector<std::atomic<int>> visits(10007);
+
+    pool.parallel_for(visits.size(), 16, [&](const std::size_t begin, const std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) {
+            visits[i]++;
+        }
+    });
+
+    for (auto &visit: visits) {
+        REQUIRE(visit == 1);
+    }
+}
+
+TEST_CASE("thread_pool_nested_and_concurrent_calls", "thread_pool") {
+    common::thread_pool pool(2);
+    std::atomic<std::size_t> total(0);
+
+    auto work = [&]() {
+        pool.parallel_for(8, 1, [&](const std::size_t begin, const std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                // Calls made from inside a worker must not wait on themselves
+                pool.parallel_for(100, 1, [&](const std::size_t inner_begin, const std::size_t inner_end) {
+                    total += inner_end - inner_begin;
+                });
+            }
+        });
+    };
+
+    std::thread other(work);
+    work();
+    other.join();
+
+    REQUIRE(total == 2 * 8 * 100);
+}
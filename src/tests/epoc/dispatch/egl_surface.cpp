@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ * 
+ * This file is part of EKA2L1 project.
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <dispatch/libraries/egl/def.h>
+#include <drivers/graphics/backend/null/graphics_null.h>
+#include <drivers/itc.h>
+
+using namespace eka2l1;
+
+static dispatch::egl_config make_window_config() {
+    dispatch::egl_config config(0);
+    config.set_buffer_size(32);
+    config.set_surface_type(dispatch::egl_config::EGL_SURFACE_TYPE_WINDOW);
+
+    return config;
+}
+
+TEST_CASE("egl_surface_rotates_binding_without_copy", "egl_surface") {
+    drivers::null_graphics_driver driver;
+
+    const drivers::handle first = drivers::create_bitmap(&driver, eka2l1::vec2(16, 16), 32);
+    dispatch::egl_surface surface(nullptr, nullptr, eka2l1::vec2(16, 16), first, make_window_config());
+
+    drivers::handle handles[3] = { first, 0, 0 };
+
+    for (std::size_t i = 0; i < dispatch::EGL_SURFACE_PRESENT_RING_SIZE; i++) {
+        const std::size_t swapped = surface.rotate_present_buffer(&driver);
+        REQUIRE(swapped == i);
+
+        surface.frame_flushed(&driver, swapped);
+
+        if (i + 1 < dispatch::EGL_SURFACE_PRESENT_RING_SIZE) {
+            handles[i + 1] = surface.handle_;
+        }
+    }
+
+    // Back to the first buffer after a full turn, having gone through three different ones
+    REQUIRE(surface.handle_ == first);
+    REQUIRE(handles[1] != 0);
+    REQUIRE(handles[2] != 0);
+    REQUIRE(handles[0] != handles[1]);
+    REQUIRE(handles[1] != handles[2]);
+    REQUIRE(handles[0] != handles[2]);
+    REQUIRE(driver.live_object_count() == 3);
+
+    // Rotation only moves the binding, nothing is drawn
+    const std::vector<drivers::graphics_command_stats> stats = driver.get_command_stats();
+    if (stats.size() > drivers::graphics_driver_draw_bitmap) {
+        REQUIRE(stats[drivers::graphics_driver_draw_bitmap].count_ == 0);
+    }
+}
+
+TEST_CASE("egl_surface_present_fence_covers_composite", "egl_surface") {
+    drivers::null_graphics_driver driver;
+
+    const drivers::handle first = drivers::create_bitmap(&driver, eka2l1::vec2(16, 16), 32);
+    const drivers::handle window = drivers::create_bitmap(&driver, eka2l1::vec2(16, 16), 32);
+
+    dispatch::egl_surface surface(nullptr, nullptr, eka2l1::vec2(16, 16), first, make_window_config());
+
+    // Same order as a swap: hand the buffer to the window, rotate, flush the frame, then composite
+    drivers::graphics_command_builder window_builder;
+    window_builder.bind_bitmap(window);
+    window_builder.draw_bitmap(surface.handle_, 0, eka2l1::rect(eka2l1::vec2(0, 0), eka2l1::vec2(16, 16)),
+        eka2l1::rect(eka2l1::vec2(0, 0), eka2l1::vec2(0, 0)));
+
+    const std::size_t swapped = surface.rotate_present_buffer(&driver);
+    REQUIRE(surface.handle_ != first);
+
+    drivers::graphics_command_builder frame_builder;
+    frame_builder.bind_bitmap(first);
+
+    drivers::command_list frame_list = frame_builder.retrieve_command_list();
+    driver.submit_command_list(frame_list);
+
+    const std::uint64_t frame_fence = driver.current_fence();
+
+    drivers::command_list composite_list = window_builder.retrieve_command_list();
+    driver.submit_command_list(composite_list);
+
+    surface.frame_flushed(&driver, swapped);
+
+    REQUIRE(surface.present_fences_[swapped] == driver.current_fence());
+    REQUIRE(surface.present_fences_[swapped] > frame_fence);
+    REQUIRE(driver.invalid_handle_uses() == 0);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ * 
+ * This file is part of EKA2L1 project.
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <drivers/graphics/backend/null/graphics_null.h>
+#include <drivers/itc.h>
+
+using namespace eka2l1;
+
+TEST_CASE("null_graphics_driver_tracks_handles", "graphics_null") {
+    drivers::null_graphics_driver driver;
+
+    const drivers::handle bmp = drivers::create_bitmap(&driver, eka2l1::vec2(16, 16), 32);
+    REQUIRE(bmp != 0);
+    REQUIRE(driver.live_object_count() == 1);
+
+    drivers::graphics_command_builder builder;
+    builder.bind_bitmap(bmp);
+    builder.destroy_bitmap(bmp);
+    builder.bind_bitmap(bmp);
+
+    drivers::command_list list = builder.retrieve_command_list();
+    driver.submit_command_list(list);
+
+    REQUIRE(driver.live_object_count() == 0);
+    REQUIRE(driver.invalid_handle_uses() == 1);
+}
+
+TEST_CASE("null_graphics_driver_counts_opcodes", "graphics_null") {
+    drivers::null_graphics_driver driver;
+    const drivers::handle bmp = drivers::create_bitmap(&driver, eka2l1::vec2(4, 4), 32);
+
+    std::uint8_t pixels[4 * 4 * 4] = {};
+
+    drivers::graphics_command_builder builder;
+    builder.update_bitmap(bmp, reinterpret_cast<const char *>(pixels), sizeof(pixels), { 0, 0 }, { 4, 4 });
+    builder.update_bitmap(bmp, reinterpret_cast<const char *>(pixels), sizeof(pixels), { 0, 0 }, { 4, 4 });
+    builder.set_brush_color(eka2l1::vec3(255, 0, 0));
+
+    drivers::command_list list = builder.retrieve_command_list();
+    driver.submit_command_list(list);
+
+    const std::vector<drivers::graphics_command_stats> stats = driver.get_command_stats();
+
+    REQUIRE(stats.size() > drivers::graphics_driver_update_bitmap);
+    REQUIRE(stats[drivers::graphics_driver_update_bitmap].count_ == 2);
+
+    // The pixels are copied into the list, so both records carry them
+    REQUIRE(stats[drivers::graphics_driver_update_bitmap].bytes_ >= 2 * sizeof(pixels));
+    REQUIRE(stats[drivers::graphics_driver_set_brush_color].count_ == 1);
+}
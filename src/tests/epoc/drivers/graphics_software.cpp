@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ * 
+ * This file is part of EKA2L1 project.
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/region.h>
+#include <drivers/graphics/backend/software/graphics_software.h>
+#include <drivers/graphics/backend/software/raster_software.h>
+#include <drivers/itc.h>
+
+#include <random>
+#include <vector>
+
+using namespace eka2l1;
+
+static constexpr std::uint32_t OPAQUE_BLACK = 0xFF000000;
+static constexpr std::uint32_t OPAQUE_RED = 0xFF0000FF;
+static constexpr std::uint32_t OPAQUE_GREEN = 0xFF00FF00;
+static constexpr std::uint32_t OPAQUE_BLUE = 0xFFFF0000;
+
+static void submit(drivers::software_graphics_driver &driver, drivers::graphics_command_builder &builder) {
+    drivers::command_list list = builder.retrieve_command_list();
+    driver.submit_command_list(list);
+}
+
+// Pixels as RGBA8 with R in the lowest byte, the same as the rasteriser keeps them
+static std::vector<std::uint32_t> read_pixels(drivers::software_graphics_driver &driver, const drivers::handle bmp, const eka2l1::vec2 &size) {
+    std::vector<std::uint32_t> pixels(size.x * size.y);
+    REQUIRE(drivers::read_bitmap(&driver, bmp, { 0, 0 }, size, 32, reinterpret_cast<std::uint8_t *>(pixels.data())));
+
+    return pixels;
+}
+
+static drivers::handle make_target(drivers::software_graphics_driver &driver, drivers::graphics_command_builder &builder, const eka2l1::vec2 &size) {
+    const drivers::handle bmp = drivers::create_bitmap(&driver, size, 32);
+
+    builder.bind_bitmap(bmp);
+    builder.set_feature(drivers::graphics_feature::blend, false);
+    builder.clear({ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f }, drivers::draw_buffer_bit_color_buffer);
+
+    return bmp;
+}
+
+TEST_CASE("software_blend_span_matches_scalar", "graphics_software") {
+    std::mt19937 rng(42);
+
+    const drivers::blend_factor factors[] = { drivers::blend_factor::one, drivers::blend_factor::zero, drivers::blend_factor::frag_out_alpha,
+        drivers::blend_factor::one_minus_frag_out_alpha, drivers::blend_factor::current_alpha, drivers::blend_factor::one_minus_current_alpha,
+        drivers::blend_factor::frag_out_color, drivers::blend_factor::frag_out_alpha_saturate };
+
+    const drivers::blend_equation equations[] = { drivers::blend_equation::add, drivers::blend_equation::sub, drivers::blend_equation::isub };
+
+    std::vector<std::uint32_t> source(37);
+    std::vector<std::uint32_t> dest(source.size());
+
+    for (const drivers::blend_equation rgb_equation: equations) {
+        for (const drivers::blend_factor rgb_source: factors) {
+            for (const drivers::blend_factor rgb_dest: factors) {
+                drivers::software_blend_state state;
+                state.enabled_ = true;
+                state.rgb_equation_ = rgb_equation;
+                state.alpha_equation_ = drivers::blend_equation::add;
+                state.rgb_source_ = rgb_source;
+                state.rgb_dest_ = rgb_dest;
+                state.alpha_source_ = drivers::blend_factor::one;
+                state.alpha_dest_ = drivers::blend_factor::one_minus_frag_out_alpha;
+
+                for (std::size_t i = 0; i < source.size(); i++) {
+                    source[i] = static_cast<std::uint32_t>(rng());
+                    dest[i] = static_cast<std::uint32_t>(rng());
+                }
+
+                std::vector<std::uint32_t> vector_result = dest;
+                std::vector<std::uint32_t> scalar_result = dest;
+
+                drivers::software_blend_span(vector_result.data(), source.data(), source.size(), state);
+                drivers::software_blend_span_scalar(scalar_result.data(), source.data(), source.size(), state);
+
+                REQUIRE(vector_result == scalar_result);
+            }
+        }
+    }
+}
+
+TEST_CASE("software_blend_source_over", "graphics_software") {
+    drivers::software_blend_state state;
+    state.enabled_ = true;
+    state.rgb_source_ = drivers::blend_factor::frag_out_alpha;
+    state.rgb_dest_ = drivers::blend_factor::one_minus_frag_out_alpha;
+    state.alpha_source_ = drivers::blend_factor::one;
+    state.alpha_dest_ = drivers::blend_factor::one_minus_frag_out_alpha;
+
+    std::uint32_t dest[5] = { OPAQUE_BLACK, OPAQUE_BLACK, OPAQUE_BLACK, OPAQUE_BLACK, OPAQUE_BLACK };
+    drivers::software_fill_span(dest, drivers::pack_software_color(255, 255, 255, 128), 5, state);
+
+    for (const std::uint32_t pixel: dest) {
+        REQUIRE(pixel == drivers::pack_software_color(128, 128, 128, 255));
+    }
+}
+
+TEST_CASE("software_rectangle_fill_and_clear", "graphics_software") {
+    drivers::software_graphics_driver driver;
+    drivers::graphics_command_builder builder;
+
+    const eka2l1::vec2 size(8, 6);
+    const drivers::handle bmp = make_target(driver, builder, size);
+
+    builder.set_brush_color(eka2l1::vec3(255, 0, 0));
+    builder.draw_rectangle(eka2l1::rect({ 2, 1 }, { 3, 4 }));
+    submit(driver, builder);
+
+    const std::vector<std::uint32_t> pixels = read_pixels(driver, bmp, size);
+
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            const bool inside = (x >= 2) && (x < 5) && (y >= 1) && (y < 5);
+            REQUIRE(pixels[y * size.x + x] == (inside ? OPAQUE_RED : OPAQUE_BLACK));
+        }
+    }
+}
+
+TEST_CASE("software_masked_blit_with_blending", "graphics_software") {
+    drivers::software_graphics_driver driver;
+    drivers::graphics_command_builder builder;
+
+    // 2x2 source in BGRA order, as 32bpp bitmaps are uploaded
+    const std::uint8_t source_data[] = {
+        0, 0, 255, 255,     0, 255, 0, 255,
+        255, 0, 0, 255,     255, 255, 255, 255
+    };
+
+    // 8bpp mask, rows aligned to 4 bytes
+    const std::uint8_t mask_data[] = {
+        255, 0, 0, 0,
+        0, 255, 0, 0
+    };
+
+    const drivers::handle source = drivers::create_bitmap(&driver, { 2, 2 }, 32);
+    const drivers::handle mask = drivers::create_bitmap(&driver, { 2, 2 }, 8);
+
+    builder.update_bitmap(source, reinterpret_cast<const char *>(source_data), sizeof(source_data), { 0, 0 }, { 2, 2 });
+    builder.update_bitmap(mask, reinterpret_cast<const char *>(mask_data), sizeof(mask_data), { 0, 0 }, { 2, 2 });
+
+    const eka2l1::vec2 size(4, 4);
+    const drivers::handle bmp = make_target(driver, builder, size);
+
+    builder.set_feature(drivers::graphics_feature::blend, true);
+    builder.blend_formula(drivers::blend_equation::add, drivers::blend_equation::add, drivers::blend_factor::frag_out_alpha,
+        drivers::blend_factor::one_minus_frag_out_alpha, drivers::blend_factor::one, drivers::blend_factor::one);
+
+    // Upscaled 2x, so each texel covers a 2x2 block
+    builder.draw_bitmap(source, mask, eka2l1::rect({ 0, 0 }, { 4, 4 }), eka2l1::rect({ 0, 0 }, { 2, 2 }));
+    submit(driver, builder);
+
+    const std::vector<std::uint32_t> pixels = read_pixels(driver, bmp, size);
+
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            std::uint32_t expected = OPAQUE_BLACK;
+
+            if ((x < 2) && (y < 2)) {
+                expected = OPAQUE_RED;
+            } else if ((x >= 2) && (y >= 2)) {
+                expected = 0xFFFFFFFF;
+            }
+
+            REQUIRE(pixels[y * size.x + x] == expected);
+        }
+    }
+}
+
+TEST_CASE("software_region_clip_and_flip", "graphics_software") {
+    drivers::software_graphics_driver driver;
+    drivers::graphics_command_builder builder;
+
+    const std::uint8_t source_data[] = {
+        255, 0, 0, 255,
+        0, 255, 0, 255
+    };
+
+    const drivers::handle source = drivers::create_bitmap(&driver, { 1, 2 }, 32);
+    builder.update_bitmap(source, reinterpret_cast<const char *>(source_data), sizeof(source_data), { 0, 0 }, { 1, 2 });
+
+    const eka2l1::vec2 size(6, 2);
+    const drivers::handle bmp = make_target(driver, builder, size);
+
+    common::region clip;
+    clip.rects_.push_back(eka2l1::rect({ 0, 0 }, { 2, 2 }));
+    clip.rects_.push_back(eka2l1::rect({ 4, 0 }, { 1, 2 }));
+
+    builder.clip_bitmap_region(clip);
+    builder.draw_bitmap(source, 0, eka2l1::rect({ 0, 0 }, { 6, 2 }), eka2l1::rect({ 0, 0 }, { 1, 2 }), { 0, 0 }, 0.0f,
+        drivers::bitmap_draw_flag_flip);
+    submit(driver, builder);
+
+    const std::vector<std::uint32_t> pixels = read_pixels(driver, bmp, size);
+
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            const bool visible = (x < 2) || (x == 4);
+            const std::uint32_t flipped = (y == 0) ? OPAQUE_GREEN : OPAQUE_BLUE;
+
+            REQUIRE(pixels[y * size.x + x] == (visible ? flipped : OPAQUE_BLACK));
+        }
+    }
+}
+
+TEST_CASE("software_dashed_line", "graphics_software") {
+    drivers::software_graphics_driver driver;
+    drivers::graphics_command_builder builder;
+
+    const eka2l1::vec2 size(20, 3);
+    const drivers::handle bmp = make_target(driver, builder, size);
+
+    builder.set_brush_color(eka2l1::vec3(0, 255, 0));
+    builder.set_pen_style(drivers::pen_style_dashed);
+    builder.draw_line({ 0, 1 }, { 18, 1 });
+    submit(driver, builder);
+
+    const std::vector<std::uint32_t> pixels = read_pixels(driver, bmp, size);
+
+    for (int x = 0; x < size.x; x++) {
+        // 0x3F3F: six on, two off. The last point is not drawn.
+        const bool drawn = (x < 18) && ((0x3F3F >> (x & 15)) & 1);
+
+        REQUIRE(pixels[size.x + x] == (drawn ? OPAQUE_GREEN : OPAQUE_BLACK));
+        REQUIRE(pixels[x] == OPAQUE_BLACK);
+        REQUIRE(pixels[2 * size.x + x] == OPAQUE_BLACK);
+    }
+}
+
+TEST_CASE("software_large_scaled_blit_to_screen", "graphics_software") {
+    drivers::software_graphics_driver driver;
+    drivers::graphics_command_builder builder;
+
+    const std::uint8_t source_data[] = {
+        0, 0, 255, 255,     0, 255, 0, 255,
+        255, 0, 0, 255,     255, 255, 255, 255
+    };
+
+    const drivers::handle source = drivers::create_bitmap(&driver, { 2, 2 }, 32);
+    builder.update_bitmap(source, reinterpret_cast<const char *>(source_data), sizeof(source_data), { 0, 0 }, { 2, 2 });
+
+    // Big enough to be split between threads
+    const eka2l1::vec2 size(512, 384);
+
+    builder.set_swapchain_size(size);
+    builder.bind_bitmap(0);
+    builder.set_feature(drivers::graphics_feature::blend, false);
+    builder.draw_bitmap(source, 0, eka2l1::rect({ 0, 0 }, size), eka2l1::rect({ 0, 0 }, { 2, 2 }));
+    submit(driver, builder);
+
+    eka2l1::vec2 screen_size;
+    const std::vector<std::uint32_t> pixels = driver.get_screen_pixels(screen_size);
+
+    REQUIRE(screen_size == size);
+
+    const std::uint32_t quadrants[4] = { OPAQUE_RED, OPAQUE_GREEN, OPAQUE_BLUE, 0xFFFFFFFF };
+
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            const int quadrant = ((y >= size.y / 2) ? 2 : 0) + ((x >= size.x / 2) ? 1 : 0);
+            REQUIRE(pixels[y * size.x + x] == quadrants[quadrant]);
+        }
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <drivers/graphics/sprite_batch.h>
+
+#include <vector>
+
+using namespace eka2l1;
+
+static drivers::sprite_batch_key make_textured_key(const std::uint64_t texture) {
+    drivers::sprite_batch_key key;
+    key.kind_ = drivers::sprite_batch_kind_textured;
+    key.texture_ = texture;
+    key.color_ = { 255.0f, 255.0f, 255.0f, 255.0f };
+
+    return key;
+}
+
+TEST_CASE("sprite_batch_quad_geometry", "sprite_batch") {
+    drivers::sprite_batch batch;
+    const drivers::sprite_batch_key key = make_textured_key(1);
+
+    // Quarter of a 64x32 texture, flipped
+    batch.add_sprite(key, eka2l1::rect({ 10, 20 }, { 16, 8 }), eka2l1::rect({ 32, 16 }, { 32, 16 }), { 64, 32 },
+        { 0, 0 }, 0.0f, true);
+
+    const std::vector<drivers::sprite_vertex> &vertices = batch.vertices();
+    REQUIRE(vertices.size() == 4);
+
+    // Bottom left, top right, top left, bottom right
+    const float expected_pos[4][2] = { { 10, 28 }, { 26, 20 }, { 10, 20 }, { 26, 28 } };
+    const float expected_coord[4][2] = { { 0.5f, 0.5f }, { 1.0f, 1.0f }, { 0.5f, 1.0f }, { 1.0f, 0.5f } };
+
+    for (std::size_t i = 0; i < 4; i++) {
+        REQUIRE(vertices[i].pos_[0] == Approx(expected_pos[i][0]));
+        REQUIRE(vertices[i].pos_[1] == Approx(expected_pos[i][1]));
+        REQUIRE(vertices[i].coord_[0] == Approx(expected_coord[i][0]));
+        REQUIRE(vertices[i].coord_[1] == Approx(expected_coord[i][1]));
+    }
+}
+
+TEST_CASE("sprite_batch_rotates_around_origin", "sprite_batch") {
+    drivers::sprite_batch batch;
+
+    // A 90 degree turn around the top left corner
+    batch.add_sprite(make_textured_key(1), eka2l1::rect({ 100, 100 }, { 10, 20 }), eka2l1::rect(), { 10, 20 },
+        { 0, 0 }, 90.0f, false);
+
+    const drivers::sprite_vertex &top_right = batch.vertices()[1];
+    REQUIRE(top_right.pos_[0] == Approx(100.0f).margin(0.001));
+    REQUIRE(top_right.pos_[1] == Approx(110.0f));
+
+    const drivers::sprite_vertex &bottom_left = batch.vertices()[0];
+    REQUIRE(bottom_left.pos_[0] == Approx(80.0f));
+    REQUIRE(bottom_left.pos_[1] == Approx(100.0f).margin(0.001));
+
+    // Whole texture when the source is empty
+    REQUIRE(bottom_left.coord_[0] == 0.0f);
+    REQUIRE(bottom_left.coord_[1] == 1.0f);
+}
+
+TEST_CASE("sprite_batch_only_merges_same_state", "sprite_batch") {
+    drivers::sprite_batch batch;
+    const eka2l1::rect dest({ 0, 0 }, { 4, 4 });
+
+    REQUIRE(batch.can_append(make_textured_key(1)));
+    batch.add_sprite(make_textured_key(1), dest, eka2l1::rect(), { 4, 4 }, { 0, 0 }, 0.0f, false);
+    batch.add_sprite(make_textured_key(1), dest, eka2l1::rect(), { 4, 4 }, { 0, 0 }, 0.0f, false);
+
+    REQUIRE(batch.can_append(make_textured_key(1)));
+    REQUIRE(!batch.can_append(make_textured_key(2)));
+
+    drivers::sprite_batch_key tinted = make_textured_key(1);
+    tinted.color_[3] = 128.0f;
+    REQUIRE(!batch.can_append(tinted));
+
+    drivers::sprite_batch_key fill;
+    fill.kind_ = drivers::sprite_batch_kind_fill;
+    REQUIRE(!batch.can_append(fill));
+
+    REQUIRE(batch.quad_count() == 2);
+    batch.clear();
+
+    REQUIRE(batch.empty());
+    REQUIRE(batch.can_append(fill));
+
+    batch.add_fill(fill, dest);
+    batch.clear();
+    batch.count_unbatched_draw();
+
+    // Four draws, three draw calls
+    const drivers::sprite_batch_stats stats = batch.get_stats();
+    REQUIRE(stats.sprites_ == 4);
+    REQUIRE(stats.draw_calls_ == 3);
+}
+
+TEST_CASE("sprite_batch_capacity_and_indices", "sprite_batch") {
+    drivers::sprite_batch batch;
+    const drivers::sprite_batch_key key = make_textured_key(1);
+
+    for (std::size_t i = 0; i < drivers::SPRITE_BATCH_MAX_QUADS; i++) {
+        REQUIRE(batch.can_append(key));
+        batch.add_fill(key, eka2l1::rect({ 0, 0 }, { 1, 1 }));
+    }
+
+    REQUIRE(!batch.can_append(key));
+
+    std::vector<std::uint16_t> indices(drivers::SPRITE_BATCH_MAX_QUADS * drivers::SPRITE_BATCH_INDICES_PER_QUAD);
+    drivers::sprite_batch::fill_quad_indices(indices.data(), drivers::SPRITE_BATCH_MAX_QUADS);
+
+    REQUIRE(indices[6] == 4);
+    REQUIRE(indices[11] == 5);
+    REQUIRE(indices.back() == static_cast<std::uint16_t>((drivers::SPRITE_BATCH_MAX_QUADS - 1) * 4 + 1));
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/fileutils.h>
+#include <common/thread_pool.h>
+#include <drivers/graphics/texture_decode.h>
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+void decompressBlockETC2(unsigned int block_part1, unsigned int block_part2, std::uint8_t *img, int width, int height, int startx, int starty);
+uint32_t PVRTDecompressPVRTC(const void *compressedData, uint32_t do2bitMode, uint32_t xDim, uint32_t yDim, uint32_t doPvrtType, uint8_t *outResultImage);
+
+using namespace eka2l1;
+
+static std::vector<std::uint8_t> make_random_data(const std::size_t size, const std::uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::uint8_t> data(size);
+
+    for (auto &b: data) {
+        b = static_cast<std::uint8_t>(rng());
+    }
+
+    return data;
+}
+
+// Decode with the reference ETC2 decoder, block by block, expanding to RGBA
+static std::vector<std::uint8_t> decode_etc_reference(const std::uint8_t *source, const std::uint32_t width, const std::uint32_t height) {
+    const std::uint32_t blocks_x = (width + 3) / 4;
+    const std::uint32_t blocks_y = (height + 3) / 4;
+
+    std::vector<std::uint8_t> rgb(blocks_x * 4 * blocks_y * 4 * 3);
+
+    for (std::uint32_t by = 0; by < blocks_y; by++) {
+        for (std::uint32_t bx = 0; bx < blocks_x; bx++) {
+            const std::uint8_t *block = source + (by * blocks_x + bx) * 8;
+            const std::uint32_t part1 = (block[0] << 24) | (block[1] << 16) | (block[2] << 8) | block[3];
+            const std::uint32_t part2 = (block[4] << 24) | (block[5] << 16) | (block[6] << 8) | block[7];
+
+            decompressBlockETC2(part1, part2, rgb.data(), blocks_x * 4, blocks_y * 4, bx * 4, by * 4);
+        }
+    }
+
+    std::vector<std::uint8_t> rgba(width * height * 4);
+    for (std::uint32_t y = 0; y < height; y++) {
+        for (std::uint32_t x = 0; x < width; x++) {
+            std::memcpy(rgba.data() + (y * width + x) * 4, rgb.data() + (y * blocks_x * 4 + x) * 3, 3);
+            rgba[(y * width + x) * 4 + 3] = 0xFF;
+        }
+    }
+
+    return rgba;
+}
+
+TEST_CASE("etc_block_matches_reference", "texture_decode") {
+    // Random blocks cover the individual and differential modes, and the ETC2 modes handed to the fallback
+    const std::vector<std::uint8_t> blocks = make_random_data(8 * 4096, 1234);
+
+    for (std::size_t i = 0; i < blocks.size(); i += 8) {
+        std::uint8_t vector_result[64];
+        std::uint8_t scalar_result[64];
+
+        drivers::decode_etc_block(blocks.data() + i, vector_result, 16);
+        drivers::decode_etc_block_scalar(blocks.data() + i, scalar_result, 16);
+
+        const std::vector<std::uint8_t> reference = decode_etc_reference(blocks.data() + i, 4, 4);
+
+        REQUIRE(std::memcmp(vector_result, reference.data(), 64) == 0);
+        REQUIRE(std::memcmp(scalar_result, reference.data(), 64) == 0);
+    }
+}
+
+TEST_CASE("etc_texture_parallel_with_partial_blocks", "texture_decode") {
+    common::thread_pool pool(3);
+
+    const std::uint32_t widths[] = { 1, 2, 6, 64, 130 };
+    const std::uint32_t heights[] = { 1, 3, 4, 66, 257 };
+
+    for (std::size_t i = 0; i < 5; i++) {
+        const std::uint32_t width = widths[i];
+        const std::uint32_t height = heights[i];
+
+        const std::vector<std::uint8_t> source = make_random_data(((width + 3) / 4) * ((height + 3) / 4) * 8, width * 31 + height);
+        std::vector<std::uint8_t> decoded(width * height * 4);
+
+        drivers::decode_etc_texture(decoded.data(), source.data(), width, height, &pool);
+        REQUIRE(decoded == decode_etc_reference(source.data(), width, height));
+    }
+}
+
+TEST_CASE("pvrtc_parallel_matches_serial", "texture_decode") {
+    common::thread_pool pool(3);
+
+    for (const bool is_2bpp: { false, true }) {
+        for (const std::uint32_t size: { 8u, 32u, 256u }) {
+            const std::uint32_t width = is_2bpp ? size * 2 : size;
+            const std::vector<std::uint8_t> source = make_random_data(width * size * (is_2bpp ? 2 : 4) / 8, size);
+
+            std::vector<std::uint8_t> serial(width * size * 4);
+            std::vector<std::uint8_t> parallel(width * size * 4);
+
+            PVRTDecompressPVRTC(source.data(), is_2bpp, width, size, 0, serial.data());
+            drivers::decode_pvrtc_texture(parallel.data(), source.data(), width, size, is_2bpp, &pool);
+
+            REQUIRE(serial == parallel);
+        }
+    }
+}
+
+TEST_CASE("paletted_texture_expands_high_nibble_first", "texture_decode") {
+    common::thread_pool pool(2);
+
+    const std::vector<std::uint8_t> palette = make_random_data(256 * 4, 99);
+
+    for (const std::uint32_t entry_size: { 2u, 3u, 4u }) {
+        for (const std::uint32_t index_bits: { 4u, 8u }) {
+            // Odd count, large enough to be split between threads
+            const std::size_t texel_count = 300001;
+            const std::vector<std::uint8_t> indices = make_random_data(index_bits == 8 ? texel_count : (texel_count + 1) / 2, entry_size);
+
+            std::vector<std::uint8_t> result(texel_count * entry_size);
+            drivers::decode_paletted_texture(result.data(), indices.data(), palette.data(), index_bits, entry_size, texel_count, &pool);
+
+            for (std::size_t i = 0; i < texel_count; i++) {
+                const std::uint32_t index = (index_bits == 8) ? indices[i] : ((i & 1) ? (indices[i / 2] & 0xF) : (indices[i / 2] >> 4));
+
+                REQUIRE(std::memcmp(result.data() + i * entry_size, palette.data() + index * entry_size, entry_size) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("decoded_texture_cache_evicts_and_persists", "texture_decode") {
+    drivers::decoded_texture_cache cache(1000);
+
+    const std::vector<std::uint8_t> source = make_random_data(64, 7);
+    const std::uint64_t key1 = drivers::decoded_texture_cache::make_key(drivers::texture_format::etc2_rgb8, 8, 8, source.data(), source.size());
+    const std::uint64_t key2 = drivers::decoded_texture_cache::make_key(drivers::texture_format::etc2_rgb8, 16, 4, source.data(), source.size());
+
+    REQUIRE(key1 != key2);
+    REQUIRE(cache.get(key1, 600) == nullptr);
+
+    cache.put(key1, std::vector<std::uint8_t>(600, 1));
+    REQUIRE(cache.get(key1, 600) != nullptr);
+
+    // Over budget, the older entry goes
+    cache.put(key2, std::vector<std::uint8_t>(600, 2));
+    REQUIRE(cache.get(key1, 600) == nullptr);
+    REQUIRE(cache.get(key2, 600) != nullptr);
+
+    const drivers::decoded_texture_cache_stats stats = cache.get_stats();
+    REQUIRE(stats.hits_ == 2);
+    REQUIRE(stats.misses_ == 2);
+    REQUIRE(stats.used_bytes_ == 600);
+
+    const std::string disk_path = "decodedtexturecachetest/";
+
+    {
+        drivers::decoded_texture_cache writer(1000);
+        writer.set_disk_path(disk_path);
+        writer.put(key1, std::vector<std::uint8_t>(600, 3));
+    }
+
+    drivers::decoded_texture_cache reader(1000);
+    reader.set_disk_path(disk_path);
+
+    REQUIRE(reader.get(key1, 599) == nullptr);
+
+    drivers::decoded_texture loaded = reader.get(key1, 600);
+    REQUIRE(loaded != nullptr);
+    REQUIRE(*loaded == std::vector<std::uint8_t>(600, 3));
+    REQUIRE(reader.get_stats().disk_hits_ == 1);
+
+    common::delete_folder(disk_path);
+}
+
+TEST_CASE("etc_decode_atlas_benchmark", "[.][benchmark]") {
+    // A 1024x1024 atlas, the size that stalls frames when decoded on the graphics thread
+    static constexpr std::uint32_t SIZE = 1024;
+    static constexpr std::size_t RUNS = 10;
+
+    const std::vector<std::uint8_t> source = make_random_data((SIZE / 4) * (SIZE / 4) * 8, 42);
+    std::vector<std::uint8_t> decoded(SIZE * SIZE * 4);
+
+    auto measure = [&](auto func) {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < RUNS; i++) {
+            func();
+        }
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / RUNS;
+    };
+
+    const auto reference_us = measure([&]() {
+        decode_etc_reference(source.data(), SIZE, SIZE);
+    });
+
+    const auto serial_us = measure([&]() {
+        drivers::decode_etc_texture(decoded.data(), source.data(), SIZE, SIZE, nullptr);
+    });
+
+    const auto parallel_us = measure([&]() {
+        drivers::decode_etc_texture(decoded.data(), source.data(), SIZE, SIZE, &common::get_shared_thread_pool());
+    });
+
+    WARN("ETC " << SIZE << "x" << SIZE << ": reference " << reference_us << " us, vector " << serial_us << " us, vector on "
+                << (common::get_shared_thread_pool().worker_count() + 1) << " threads " << parallel_us << " us");
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/fileutils.h>
+#include <kernel/codeseg_cache.h>
+#include <loader/e32img.h>
+
+#include <cstdio>
+#include <vector>
+
+using namespace eka2l1;
+
+static const char *CODESEG_CACHE_TEST_FOLDER = "codeseg_cache_test/";
+
+TEST_CASE("codeseg_cache_relocated_round_trip", "codeseg_cache") {
+    common::delete_folder(CODESEG_CACHE_TEST_FOLDER);
+
+    {
+        kernel::codeseg_cache cache(CODESEG_CACHE_TEST_FOLDER);
+
+        const std::uint64_t image_key = kernel::codeseg_cache::make_image_key(u"C:\\Sys\\Bin\\test.dll", 1234, 5678);
+        const std::uint64_t relocation_key = kernel::codeseg_cache::make_relocation_key(0x70000000, 0x00400000,
+            { { 0x10, 0x80001234 }, { 0x14, 0x80005678 } });
+
+        std::vector<std::uint8_t> code(0x1000);
+        std::vector<std::uint8_t> data(0x30);
+
+        for (std::size_t i = 0; i < code.size(); i++) {
+            code[i] = static_cast<std::uint8_t>(i * 7);
+        }
+
+        for (std::size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<std::uint8_t>(i * 3 + 1);
+        }
+
+        std::vector<std::uint8_t> code_out(code.size());
+        std::vector<std::uint8_t> data_out(data.size());
+
+        REQUIRE_FALSE(cache.load_relocated(image_key, relocation_key, code_out.data(), static_cast<std::uint32_t>(code_out.size()),
+            data_out.data(), static_cast<std::uint32_t>(data_out.size())));
+
+        REQUIRE(cache.store_relocated(image_key, relocation_key, code.data(), static_cast<std::uint32_t>(code.size()),
+            data.data(), static_cast<std::uint32_t>(data.size())));
+
+        REQUIRE(cache.load_relocated(image_key, relocation_key, code_out.data(), static_cast<std::uint32_t>(code_out.size()),
+            data_out.data(), static_cast<std::uint32_t>(data_out.size())));
+
+        REQUIRE(code_out == code);
+        REQUIRE(data_out == data);
+
+        // Another load address or another import resolution is another entry
+        const std::uint64_t moved_key = kernel::codeseg_cache::make_relocation_key(0x70010000, 0x00400000,
+            { { 0x10, 0x80001234 }, { 0x14, 0x80005678 } });
+        const std::uint64_t reimported_key = kernel::codeseg_cache::make_relocation_key(0x70000000, 0x00400000,
+            { { 0x10, 0x80001234 }, { 0x14, 0x80005679 } });
+
+        REQUIRE(moved_key != relocation_key);
+        REQUIRE(reimported_key != relocation_key);
+
+        REQUIRE_FALSE(cache.load_relocated(image_key, moved_key, code_out.data(), static_cast<std::uint32_t>(code_out.size()),
+            data_out.data(), static_cast<std::uint32_t>(data_out.size())));
+
+        // Sizes must match what was stored
+        REQUIRE_FALSE(cache.load_relocated(image_key, relocation_key, code_out.data(), static_cast<std::uint32_t>(code_out.size() - 4),
+            data_out.data(), static_cast<std::uint32_t>(data_out.size())));
+
+        REQUIRE(cache.get_stats().relocation_hits_ == 1);
+        REQUIRE(cache.get_stats().relocation_misses_ == 3);
+    }
+
+    common::delete_folder(CODESEG_CACHE_TEST_FOLDER);
+}
+
+TEST_CASE("codeseg_cache_image_key", "codeseg_cache") {
+    const std::uint64_t key = kernel::codeseg_cache::make_image_key(u"C:\\Sys\\Bin\\test.dll", 1234, 5678);
+
+    // Paths are case insensitive, the file's size and modification time are not
+    REQUIRE(kernel::codeseg_cache::make_image_key(u"c:\\sys\\bin\\TEST.DLL", 1234, 5678) == key);
+    REQUIRE(kernel::codeseg_cache::make_image_key(u"C:\\Sys\\Bin\\test.dll", 1235, 5678) != key);
+    REQUIRE(kernel::codeseg_cache::make_image_key(u"C:\\Sys\\Bin\\test.dll", 1234, 5679) != key);
+}
+
+TEST_CASE("codeseg_cache_disabled", "codeseg_cache") {
+    kernel::codeseg_cache cache("");
+    std::uint8_t code[4] = { 1, 2, 3, 4 };
+
+    REQUIRE_FALSE(cache.enabled());
+    REQUIRE_FALSE(cache.store_relocated(1, 2, code, sizeof(code), nullptr, 0));
+    REQUIRE_FALSE(cache.load_relocated(1, 2, code, sizeof(code), nullptr, 0));
+    REQUIRE_FALSE(cache.load_image(1));
+
+    REQUIRE(cache.get_stats().relocation_misses_ == 0);
+    REQUIRE(cache.get_stats().image_misses_ == 0);
+}
+
+TEST_CASE("codeseg_cache_prune_on_startup", "codeseg_cache") {
+    common::delete_folder(CODESEG_CACHE_TEST_FOLDER);
+
+    std::vector<std::uint8_t> code(0x1000, 0xCC);
+    std::vector<std::uint8_t> code_out(code.size());
+
+    const std::uint64_t first_key = kernel::codeseg_cache::make_image_key(u"C:\\Sys\\Bin\\first.dll", 1, 1);
+    const std::uint64_t second_key = kernel::codeseg_cache::make_image_key(u"C:\\Sys\\Bin\\second.dll", 1, 1);
+
+    {
+        kernel::codeseg_cache cache(CODESEG_CACHE_TEST_FOLDER);
+        REQUIRE(cache.store_relocated(first_key, 1, code.data(), static_cast<std::uint32_t>(code.size()), nullptr, 0));
+        REQUIRE(cache.store_relocated(first_key, 2, code.data(), static_cast<std::uint32_t>(code.size()), nullptr, 0));
+        REQUIRE(cache.store_relocated(second_key, 1, code.data(), static_cast<std::uint32_t>(code.size()), nullptr, 0));
+    }
+
+    // Left over by an interrupted store
+    const std::string stray_path = std::string(CODESEG_CACHE_TEST_FOLDER) + "0000000000000000.img.tmp";
+    FILE *stray = common::open_c_file(stray_path, "wb");
+    REQUIRE(stray);
+    fwrite(code.data(), 1, code.size(), stray);
+    fclose(stray);
+
+    {
+        // Room for one image's relocations only
+        kernel::codeseg_cache cache(CODESEG_CACHE_TEST_FOLDER, 0x2100);
+        REQUIRE_FALSE(common::exists(stray_path));
+
+        const bool first_kept = cache.load_relocated(first_key, 1, code_out.data(), static_cast<std::uint32_t>(code_out.size()), nullptr, 0);
+        const bool first_other_kept = cache.load_relocated(first_key, 2, code_out.data(), static_cast<std::uint32_t>(code_out.size()), nullptr, 0);
+        const bool second_kept = cache.load_relocated(second_key, 1, code_out.data(), static_cast<std::uint32_t>(code_out.size()), nullptr, 0);
+
+        // Relocations go together with their image
+        REQUIRE(first_kept == first_other_kept);
+        REQUIRE(first_kept != second_kept);
+
+        // Under the limit, nothing more goes
+        REQUIRE(cache.prune() == 0);
+    }
+
+    common::delete_folder(CODESEG_CACHE_TEST_FOLDER);
+}
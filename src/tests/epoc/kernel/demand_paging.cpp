@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/buffer.h>
+#include <common/bytepair.h>
+#include <kernel/codeseg.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace eka2l1;
+
+// Store every page with no pairs, which the bytepair decompressor copies as is
+static std::shared_ptr<common::bytepair_pages> make_stored_pages(const std::vector<std::uint8_t> &data) {
+    const std::uint16_t page_count = static_cast<std::uint16_t>((data.size() + common::BYTEPAIR_PAGE_SIZE - 1) / common::BYTEPAIR_PAGE_SIZE);
+    std::vector<std::uint8_t> stream(10 + page_count * sizeof(std::uint16_t));
+
+    const std::int32_t decompressed_size = static_cast<std::int32_t>(data.size());
+    const std::uint32_t total = static_cast<std::uint32_t>(data.size() + page_count);
+
+    std::memcpy(&stream[0], &total, sizeof(std::uint32_t));
+    std::memcpy(&stream[4], &decompressed_size, sizeof(std::int32_t));
+    std::memcpy(&stream[8], &page_count, sizeof(std::uint16_t));
+
+    for (std::uint16_t i = 0; i < page_count; i++) {
+        const std::size_t start = i * common::BYTEPAIR_PAGE_SIZE;
+        const std::size_t len = std::min<std::size_t>(data.size() - start, common::BYTEPAIR_PAGE_SIZE);
+        const std::uint16_t page_size = static_cast<std::uint16_t>(len + 1);
+
+        std::memcpy(&stream[10 + i * sizeof(std::uint16_t)], &page_size, sizeof(std::uint16_t));
+    }
+
+    for (std::uint16_t i = 0; i < page_count; i++) {
+        const std::size_t start = i * common::BYTEPAIR_PAGE_SIZE;
+        const std::size_t len = std::min<std::size_t>(data.size() - start, common::BYTEPAIR_PAGE_SIZE);
+
+        stream.push_back(0);
+        stream.insert(stream.end(), data.begin() + start, data.begin() + start + len);
+    }
+
+    common::ro_buf_stream raw(stream.data(), stream.size());
+    common::ibytepair_stream bytepair(&raw);
+
+    auto pages = std::make_shared<common::bytepair_pages>();
+    REQUIRE(bytepair.read_compressed_pages(*pages));
+
+    return pages;
+}
+
+static std::uint32_t read_word(const std::vector<std::uint8_t> &code, const std::uint32_t offset) {
+    std::uint32_t word = 0;
+    std::memcpy(&word, code.data() + offset, sizeof(std::uint32_t));
+
+    return word;
+}
+
+static void write_word(std::vector<std::uint8_t> &code, const std::uint32_t offset, const std::uint32_t word) {
+    std::memcpy(code.data() + offset, &word, sizeof(std::uint32_t));
+}
+
+TEST_CASE("demand_paged_code_pages_in_with_fixups", "demand_paging") {
+    const std::uint32_t code_size = common::BYTEPAIR_PAGE_SIZE * 3 + 200;
+    std::vector<std::uint8_t> source(code_size);
+
+    for (std::uint32_t i = 0; i < code_size; i++) {
+        source[i] = static_cast<std::uint8_t>(i * 13 + 7);
+    }
+
+    // Values to relocate: one in the code range, one in the data range, one across pages
+    write_word(source, 0x1010, 0x00400100);
+    write_word(source, 0x2020, 0x00401000);
+    write_word(source, 0x2030, 0x00800010);
+    write_word(source, common::BYTEPAIR_PAGE_SIZE * 2 - 2, 0x00400200);
+
+    std::vector<std::uint8_t> code(code_size, 0);
+    kernel::demand_paged_code paged(code.data(), make_stored_pages(source), code_size);
+
+    paged.code_base_ = 0x00400000;
+    paged.code_end_ = 0x00400000 + code_size;
+    paged.data_base_ = 0x00800000;
+    paged.data_end_ = 0x00801000;
+    paged.code_delta_ = 0x70000000;
+    paged.data_delta_ = 0x00100000;
+
+    paged.add_fixup(0x2030, 0, kernel::code_fixup_add_inferred);
+    paged.add_fixup(0x1010, 0x1000, kernel::code_fixup_add);
+    paged.add_fixup(common::BYTEPAIR_PAGE_SIZE * 2 - 2, 0, kernel::code_fixup_add_inferred);
+    paged.add_fixup(0x8, 0xDEADBEEF, kernel::code_fixup_set);
+    paged.add_fixup(0x2020, 0, kernel::code_fixup_add_inferred);
+    paged.finalise();
+
+    // Only the touched page comes in
+    REQUIRE(paged.page_in(0x2024));
+    REQUIRE_FALSE(paged.page_in(0x2000));
+
+    REQUIRE(read_word(code, 0x2020) == 0x70401000);
+    REQUIRE(read_word(code, 0x2030) == 0x00900010);
+    REQUIRE(std::memcmp(code.data() + 0x2040, source.data() + 0x2040, 0x100) == 0);
+    REQUIRE(code[0x1010] == 0);
+    REQUIRE(code[0x8] == 0);
+
+    // The fixup spanning page 1 and page 2 is applied once both are present
+    REQUIRE(paged.page_in(0x1500));
+    REQUIRE(read_word(code, 0x1010) == 0x00401100);
+    REQUIRE(read_word(code, common::BYTEPAIR_PAGE_SIZE * 2 - 2) == 0x70400200);
+
+    REQUIRE(paged.page_in(0x0));
+    REQUIRE(read_word(code, 0x8) == 0xDEADBEEF);
+
+    // The tail page is shorter than a full page, and nothing past the code is paged
+    REQUIRE_FALSE(paged.page_in(code_size));
+    paged.page_in_all();
+
+    REQUIRE(std::memcmp(code.data() + common::BYTEPAIR_PAGE_SIZE * 3, source.data() + common::BYTEPAIR_PAGE_SIZE * 3, 200) == 0);
+    REQUIRE(std::all_of(paged.present_.begin(), paged.present_.end(), [](const bool present) { return present; }));
+}
+
+TEST_CASE("demand_paged_code_spanning_fixup_pulls_next_page", "demand_paging") {
+    const std::uint32_t code_size = common::BYTEPAIR_PAGE_SIZE * 2;
+    std::vector<std::uint8_t> source(code_size, 0x11);
+
+    write_word(source, common::BYTEPAIR_PAGE_SIZE - 1, 0x00000010);
+
+    std::vector<std::uint8_t> code(code_size, 0);
+    kernel::demand_paged_code paged(code.data(), make_stored_pages(source), code_size);
+
+    paged.add_fixup(common::BYTEPAIR_PAGE_SIZE - 1, 0x01000000, kernel::code_fixup_add);
+    paged.finalise();
+
+    // Paging in the first page brings in the second before patching
+    REQUIRE(paged.page_in(0));
+    REQUIRE(paged.present_[1]);
+    REQUIRE(read_word(code, common::BYTEPAIR_PAGE_SIZE - 1) == 0x01000010);
+
+    REQUIRE_FALSE(paged.page_in(common::BYTEPAIR_PAGE_SIZE));
+    REQUIRE(read_word(code, common::BYTEPAIR_PAGE_SIZE - 1) == 0x01000010);
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/cvt.h>
+#include <common/fileutils.h>
+#include <common/path.h>
+#include <loader/rofs.h>
+#include <vfs/vfs.h>
+
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace eka2l1;
+
+struct test_rofs_file {
+    std::u16string name_;
+    std::string content_;
+    std::uint32_t uid3_;
+};
+
+struct test_rofs_dir {
+    std::u16string name_;
+    std::vector<test_rofs_file> files_;
+    std::vector<test_rofs_dir> subdirs_;
+};
+
+template <typename T>
+static void write_value(std::vector<std::uint8_t> &buf, const std::size_t pos, const T value) {
+    std::memcpy(buf.data() + pos, &value, sizeof(T));
+}
+
+// Write a modern (v2) ROFS entry, returns the position of its file address field
+static std::size_t write_rofs_entry(std::vector<std::uint8_t> &buf, const std::u16string &name, const std::uint8_t att,
+    const std::uint32_t size, const std::uint32_t uid3) {
+    static constexpr std::size_t ENTRY_FIXED_SIZE = 30;
+
+    const std::size_t start = buf.size();
+    const std::size_t struct_size = (ENTRY_FIXED_SIZE + name.length() * 2 + 3) & ~3;
+
+    buf.resize(start + struct_size, 0);
+
+    write_value<std::uint16_t>(buf, start, static_cast<std::uint16_t>(struct_size));
+    write_value<std::uint32_t>(buf, start + 10, uid3);
+    write_value<std::uint8_t>(buf, start + 18, static_cast<std::uint8_t>(ENTRY_FIXED_SIZE));
+    write_value<std::uint8_t>(buf, start + 19, att);
+    write_value<std::uint32_t>(buf, start + 20, size);
+    write_value<std::uint8_t>(buf, start + 29, static_cast<std::uint8_t>(name.length()));
+    std::memcpy(buf.data() + start + ENTRY_FIXED_SIZE, name.data(), name.length() * 2);
+
+    return start + 24;
+}
+
+static std::uint32_t write_rofs_dir(std::vector<std::uint8_t> &buf, const test_rofs_dir &dir) {
+    const std::size_t dir_start = buf.size();
+    buf.resize(dir_start + 12, 0);
+
+    std::vector<std::size_t> subdir_addr_pos;
+
+    for (const auto &subdir : dir.subdirs_) {
+        subdir_addr_pos.push_back(write_rofs_entry(buf, subdir.name_, 0x10, 0, 0));
+    }
+
+    write_value<std::uint16_t>(buf, dir_start, static_cast<std::uint16_t>(buf.size() - dir_start));
+    write_value<std::uint8_t>(buf, dir_start + 3, 12);
+
+    if (!dir.files_.empty()) {
+        const std::size_t block_start = buf.size();
+        std::vector<std::size_t> file_addr_pos;
+
+        for (const auto &file : dir.files_) {
+            file_addr_pos.push_back(write_rofs_entry(buf, file.name_, 0, static_cast<std::uint32_t>(file.content_.size()), file.uid3_));
+        }
+
+        write_value<std::uint32_t>(buf, dir_start + 4, static_cast<std::uint32_t>(block_start));
+        write_value<std::uint32_t>(buf, dir_start + 8, static_cast<std::uint32_t>(buf.size() - block_start));
+
+        for (std::size_t i = 0; i < dir.files_.size(); i++) {
+            write_value<std::uint32_t>(buf, file_addr_pos[i], static_cast<std::uint32_t>(buf.size()));
+            buf.insert(buf.end(), dir.files_[i].content_.begin(), dir.files_[i].content_.end());
+        }
+    }
+
+    for (std::size_t i = 0; i < dir.subdirs_.size(); i++) {
+        write_value<std::uint32_t>(buf, subdir_addr_pos[i], write_rofs_dir(buf, dir.subdirs_[i]));
+    }
+
+    return static_cast<std::uint32_t>(dir_start);
+}
+
+static std::vector<std::uint8_t> make_rofs_image(const test_rofs_dir &root, const std::uint64_t time) {
+    std::vector<std::uint8_t> buf(sizeof(loader::rofs_header), 0);
+
+    loader::rofs_header header{};
+    std::memcpy(header.magic_, "ROFS", 4);
+    header.header_size_ = sizeof(loader::rofs_header);
+    header.rofs_format_version_ = loader::ROFS_MODERN_VERSION;
+    header.dir_tree_offset_ = sizeof(loader::rofs_header);
+    header.time_ = time;
+
+    write_rofs_dir(buf, root);
+
+    header.img_size_ = static_cast<std::uint32_t>(buf.size());
+    std::memcpy(buf.data(), &header, sizeof(header));
+
+    return buf;
+}
+
+static const test_rofs_dir BASE_LAYER = {
+    u"",
+    { { u"Readme.TXT", "base readme", 0 } },
+    { { u"Resource",
+        {},
+        { { u"Versions",
+            { { u"sw.txt", "V 10.0.001", 0 }, { u"model.txt", "N00", 0 } },
+            {} } } },
+        { u"sys",
+            {},
+            { { u"bin",
+                { { u"euser.dll", std::string(64, 'E'), 0x100039E5 }, { u"efsrv.dll", std::string(32, 'F'), 0x100039CE } },
+                {} } } } }
+};
+
+static const test_rofs_dir UPPER_LAYER = {
+    u"",
+    {},
+    { { u"resource",
+        {},
+        { { u"versions",
+            { { u"SW.TXT", "V 20.0.002", 0 }, { u"extra.txt", "layer two", 0 } },
+            {} } } } }
+};
+
+TEST_CASE("rofs_index_lookup", "rofs") {
+    const std::vector<std::uint8_t> image = make_rofs_image(BASE_LAYER, 1234);
+
+    loader::rofs_index index;
+    REQUIRE(index.add_image(image.data(), image.size()));
+    REQUIRE(index.image_count() == 1);
+    REQUIRE(index.image_time(0) == 1234);
+
+    // Lookup ignores case, the drive and the separator kind
+    const loader::rofs_index_entry *euser = index.find(u"Z:\\SYS\\BIN\\EUSER.DLL");
+
+    REQUIRE(euser);
+    REQUIRE_FALSE(euser->dir_);
+    REQUIRE(euser->name_ == u"euser.dll");
+    REQUIRE(euser->size_ == 64);
+    REQUIRE(euser->has_uids_);
+    REQUIRE(euser->uids_[2] == 0x100039E5);
+    REQUIRE(image[euser->offset_] == 'E');
+
+    REQUIRE(index.find(u"sys/bin/efsrv.dll") == index.find(u"\\Sys\\Bin\\efsrv.dll\\"));
+    REQUIRE(index.find(u"z:\\sys\\bin\\nothere.dll") == nullptr);
+
+    const loader::rofs_index_entry *bin = index.find(u"z:\\sys\\bin");
+
+    REQUIRE(bin);
+    REQUIRE(bin->dir_);
+    REQUIRE(bin->children_.size() == 2);
+
+    REQUIRE(index.find(u"Z:\\") == &index.root());
+    REQUIRE(index.root().children_.size() == 3);
+}
+
+TEST_CASE("rofs_index_layers_overlay", "rofs") {
+    const std::vector<std::uint8_t> base = make_rofs_image(BASE_LAYER, 1);
+    const std::vector<std::uint8_t> upper = make_rofs_image(UPPER_LAYER, 2);
+
+    loader::rofs_index index;
+    REQUIRE(index.add_image(base.data(), base.size()));
+    REQUIRE(index.add_image(upper.data(), upper.size()));
+
+    const loader::rofs_index_entry *sw = index.find(u"z:\\resource\\versions\\sw.txt");
+
+    REQUIRE(sw);
+    REQUIRE(sw->image_ == 1);
+    REQUIRE(std::string(upper.begin() + sw->offset_, upper.begin() + sw->offset_ + sw->size_) == "V 20.0.002");
+
+    // Directories merge, untouched files of the lower layer stay
+    const loader::rofs_index_entry *versions = index.find(u"z:\\resource\\versions");
+
+    REQUIRE(versions);
+    REQUIRE(versions->children_.size() == 3);
+
+    const loader::rofs_index_entry *model = index.find(u"z:\\resource\\versions\\model.txt");
+
+    REQUIRE(model);
+    REQUIRE(model->image_ == 0);
+}
+
+TEST_CASE("rofs_index_rejects_garbage", "rofs") {
+    std::vector<std::uint8_t> image = make_rofs_image(BASE_LAYER, 1);
+    image[0] = 'X';
+
+    loader::rofs_index index;
+    REQUIRE_FALSE(index.add_image(image.data(), image.size()));
+    REQUIRE(index.image_count() == 0);
+
+    // A directory tree pointing outside of the image
+    image = make_rofs_image(BASE_LAYER, 1);
+    image.resize(sizeof(loader::rofs_header) + 8);
+
+    REQUIRE_FALSE(index.add_image(image.data(), image.size()));
+}
+
+static void write_host_file(const std::string &path, const std::vector<std::uint8_t> &data) {
+    FILE *f = common::open_c_file(path, "wb");
+    REQUIRE(f);
+
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+TEST_CASE("rofs_file_system_serves_in_place", "rofs") {
+    const std::string folder = "rofs_test_images/";
+
+    common::delete_folder(folder);
+    common::create_directories(folder);
+
+    write_host_file(eka2l1::add_path(folder, loader::get_rofs_image_name(1)), make_rofs_image(BASE_LAYER, 1));
+    write_host_file(eka2l1::add_path(folder, loader::get_rofs_image_name(2)), make_rofs_image(UPPER_LAYER, 2));
+
+    {
+        const std::vector<std::string> images = loader::find_rofs_images(folder);
+
+        REQUIRE(images.size() == 2);
+        REQUIRE(eka2l1::filename(images[0]) == loader::get_rofs_image_name(1));
+
+        io_system io;
+        file_system_inst rofs_fs = create_rofs_filesystem(images, drive_z, epocver::epoc94);
+        io.add_filesystem(rofs_fs);
+
+        REQUIRE(io.exist(u"Z:\\Resource\\Versions\\SW.TXT"));
+        REQUIRE_FALSE(io.exist(u"C:\\Resource\\Versions\\sw.txt"));
+        REQUIRE(io.is_directory(u"Z:\\sys\\bin\\"));
+
+        // EKA2 maps the old library folder to sys\bin
+        REQUIRE(io.exist(u"Z:\\System\\Libs\\euser.dll"));
+
+        symfile f = io.open_file(u"Z:\\resource\\versions\\sw.txt", READ_MODE | BIN_MODE);
+        REQUIRE(f);
+        REQUIRE(f->size() == 10);
+        REQUIRE_FALSE(f->is_in_rom());
+        REQUIRE(f->last_modify_since_0ad() == 2);
+
+        char buf[16] = {};
+        REQUIRE(f->read_file(buf, 1, sizeof(buf)) == 10);
+        REQUIRE(std::string(buf) == "V 20.0.002");
+
+        REQUIRE(f->seek(2, file_seek_mode::beg) == 2);
+        REQUIRE(f->read_file(buf, 1, 2) == 2);
+        REQUIRE(std::string(buf, 2) == "20");
+
+        // Served straight from the mapped image
+        const std::uint8_t *view = f->map_view(2, 8);
+        REQUIRE(view);
+        REQUIRE(std::string(reinterpret_cast<const char *>(view), 8) == "20.0.002");
+        REQUIRE_FALSE(f->map_view(2, 9));
+
+        REQUIRE_FALSE(io.open_file(u"Z:\\resource\\versions\\sw.txt", WRITE_MODE));
+
+        auto dir = io.open_dir(u"Z:\\Resource\\Versions\\*.txt", {}, io_attrib_include_file);
+        REQUIRE(dir);
+
+        std::size_t count = 0;
+        while (auto entry = dir->get_next_entry()) {
+            REQUIRE(entry->type == io_component_type::file);
+            count++;
+        }
+
+        REQUIRE(count == 3);
+
+        epoc::uid_type euser_uid{};
+        euser_uid.uid3 = 0x100039E5;
+
+        auto bin_dir = io.open_dir(u"Z:\\sys\\bin\\", euser_uid, io_attrib_include_file | io_attrib_allow_uid);
+        REQUIRE(bin_dir);
+
+        auto euser_entry = bin_dir->get_next_entry();
+        REQUIRE(euser_entry);
+        REQUIRE(euser_entry->name == "euser.dll");
+        REQUIRE_FALSE(bin_dir->get_next_entry());
+    }
+
+    common::delete_folder(folder);
+}
+
+TEST_CASE("rofs_file_system_copies_for_host_paths", "rofs") {
+    const std::string folder = "rofs_test_images/";
+    const std::string host_folder = "rofs_test_host/";
+
+    common::delete_folder(folder);
+    common::delete_folder(host_folder);
+    common::create_directories(folder);
+    common::create_directories(host_folder);
+
+    write_host_file(eka2l1::add_path(folder, loader::get_rofs_image_name(1)), make_rofs_image(BASE_LAYER, 1));
+
+    {
+        io_system io;
+        file_system_inst physical_fs = create_physical_filesystem(epocver::epoc94, "");
+        file_system_inst rofs_fs = create_rofs_filesystem(loader::find_rofs_images(folder), drive_z, epocver::epoc94);
+
+        io.add_filesystem(physical_fs);
+        io.add_filesystem(rofs_fs);
+        io.mount_physical_path(drive_z, drive_media::physical, io_attrib_internal | io_attrib_write_protected, u"rofs_test_host");
+
+        // Files only in the image are copied out for users that need a host path
+        const std::optional<std::u16string> path = io.get_raw_path(u"Z:\\Resource\\Versions\\sw.txt");
+        REQUIRE(path);
+
+        const std::string host_path = common::ucs2_to_utf8(*path);
+        REQUIRE(common::file_size(host_path) == 10);
+
+        FILE *f = common::open_c_file(host_path, "rb");
+        REQUIRE(f);
+
+        char buf[16] = {};
+        REQUIRE(fread(buf, 1, sizeof(buf), f) == 10);
+        REQUIRE(std::string(buf) == "V 10.0.001");
+
+        fclose(f);
+
+        // Only the file itself is left behind, no temporary copy
+        auto ite = common::make_directory_iterator(eka2l1::file_directory(host_path) + eka2l1::get_separator());
+        REQUIRE(ite);
+
+        std::size_t count = 0;
+        common::dir_entry entry{};
+
+        while (ite->next_entry(entry) == 0) {
+            if ((entry.name != ".") && (entry.name != "..")) {
+                count++;
+            }
+        }
+
+        REQUIRE(count == 1);
+
+        // Directories are not copied
+        const std::optional<std::u16string> dir_path = io.get_raw_path(u"Z:\\sys\\bin\\");
+        REQUIRE(dir_path);
+        REQUIRE_FALSE(common::exists(common::ucs2_to_utf8(*dir_path)));
+    }
+
+    common::delete_folder(folder);
+    common::delete_folder(host_folder);
+}
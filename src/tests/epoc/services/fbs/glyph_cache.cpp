@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/thread_pool.h>
+#include <drivers/graphics/backend/null/graphics_null.h>
+#include <drivers/itc.h>
+#include <services/fbs/glyph_cache.h>
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace eka2l1;
+
+// Rasterizes each glyph to a square filled with its code. Space has no bitmap, CJK is missing.
+class fake_font_adapter : public epoc::adapter::font_file_adapter_base {
+protected:
+    std::uint32_t get_glyph_advance(const std::size_t face_index, const std::uint32_t codepoint, const std::uint16_t font_size, const bool vertical) override {
+        return font_size;
+    }
+
+public:
+    std::atomic<int> rasterize_count_{ 0 };
+    bool concurrent_ = false;
+
+    bool is_valid() override {
+        return true;
+    }
+
+    bool vectorizable() const override {
+        return true;
+    }
+
+    bool supports_concurrent_rasterization() const override {
+        return concurrent_;
+    }
+
+    bool get_face_attrib(const std::size_t idx, epoc::open_font_face_attrib &face_attrib) override {
+        return false;
+    }
+
+    bool get_metrics(const std::size_t idx, epoc::open_font_metrics &metrics) override {
+        return false;
+    }
+
+    bool get_glyph_metric(const std::size_t idx, std::uint32_t code, epoc::open_font_character_metric &metric,
+        const std::int32_t baseline_horz_off, const std::uint16_t font_size) override {
+        return false;
+    }
+
+    std::uint8_t *get_glyph_bitmap(const std::size_t idx, std::uint32_t code, const std::uint16_t font_size,
+        int *rasterized_width, int *rasterized_height, std::uint32_t &total_size, epoc::glyph_bitmap_type *bmp_type) override {
+        rasterize_count_++;
+
+        if ((code == ' ') || (code >= 0x3000)) {
+            return nullptr;
+        }
+
+        *rasterized_width = font_size;
+        *rasterized_height = font_size;
+        *bmp_type = epoc::glyph_bitmap_type::antialised_glyph_bitmap;
+
+        total_size = font_size * font_size;
+        std::uint8_t *data = new std::uint8_t[total_size];
+        std::memset(data, static_cast<int>(code & 0xFF), total_size);
+
+        return data;
+    }
+
+    void free_glyph_bitmap(std::uint8_t *data) override {
+        delete[] data;
+    }
+
+    epoc::glyph_bitmap_type get_output_bitmap_type() const override {
+        return epoc::glyph_bitmap_type::antialised_glyph_bitmap;
+    }
+
+    bool does_glyph_exist(std::size_t idx, std::uint32_t code) override {
+        return (code == ' ');
+    }
+
+    std::int32_t begin_get_atlas(std::uint8_t *atlas_ptr, const eka2l1::vec2 atlas_size) override {
+        return -1;
+    }
+
+    bool get_glyph_atlas(const std::int32_t handle, const std::size_t idx, const char16_t start_code, int *unicode_point,
+        const char16_t num_code, const int font_size, epoc::adapter::character_info *info) override {
+        return false;
+    }
+
+    void end_get_atlas(const std::int32_t handle) override {
+    }
+
+    std::size_t count() override {
+        return 1;
+    }
+
+    std::uint32_t unique_id(const std::size_t face_index) override {
+        return 1;
+    }
+
+    bool has_character(const std::size_t face_index, const std::int32_t codepoint) override {
+        return true;
+    }
+};
+
+TEST_CASE("glyph_cache_shares_rasterized_glyphs", "glyph_cache") {
+    fake_font_adapter adapter;
+    epoc::glyph_cache cache(1024 * 1024, 4);
+
+    bool hit = true;
+    epoc::cached_glyph_ptr first = cache.get(&adapter, 0, 12, 'A', &hit);
+
+    REQUIRE(!hit);
+    REQUIRE(first->exists_);
+    REQUIRE(first->width_ == 12);
+    REQUIRE(first->bitmap_ == std::vector<std::uint8_t>(144, 'A'));
+
+    // Another session asking for the same glyph does not rasterize again
+    epoc::cached_glyph_ptr second = cache.get(&adapter, 0, 12, 'A', &hit);
+    REQUIRE(hit);
+    REQUIRE(second == first);
+    REQUIRE(adapter.rasterize_count_ == 1);
+
+    // Size is part of the key
+    REQUIRE(cache.get(&adapter, 0, 13, 'A')->width_ == 13);
+    REQUIRE(adapter.rasterize_count_ == 2);
+
+    // A glyph without bitmap is remembered too, missing glyphs are told apart
+    REQUIRE(cache.get(&adapter, 0, 12, ' ')->exists_);
+    REQUIRE(!cache.get(&adapter, 0, 12, 0x3000)->exists_);
+
+    const epoc::glyph_cache_stats stats = cache.get_stats();
+    REQUIRE(stats.hits_ == 1);
+    REQUIRE(stats.misses_ == 4);
+}
+
+TEST_CASE("glyph_cache_evicts_least_recently_used", "glyph_cache") {
+    fake_font_adapter adapter;
+
+    // Room for two 16x16 glyphs with their bookkeeping, not three
+    epoc::glyph_cache cache(700, 4);
+
+    cache.get(&adapter, 0, 16, 'A');
+    cache.get(&adapter, 0, 16, 'B');
+    cache.get(&adapter, 0, 16, 'A');
+    cache.get(&adapter, 0, 16, 'C');
+
+    bool hit = false;
+    cache.get(&adapter, 0, 16, 'A', &hit);
+    REQUIRE(hit);
+
+    cache.get(&adapter, 0, 16, 'B', &hit);
+    REQUIRE(!hit);
+
+    const epoc::glyph_cache_stats stats = cache.get_stats();
+    REQUIRE(stats.evictions_ == 2);
+    REQUIRE(stats.used_bytes_ <= 700);
+}
+
+TEST_CASE("glyph_cache_batch_matches_serial", "glyph_cache") {
+    common::thread_pool pool(3);
+
+    std::vector<std::uint32_t> codes;
+    for (std::uint32_t code = 0x20; code <= 0x7E; code++) {
+        codes.push_back(code);
+    }
+
+    fake_font_adapter serial_adapter;
+    fake_font_adapter parallel_adapter;
+    parallel_adapter.concurrent_ = true;
+
+    epoc::glyph_cache serial_cache(1024 * 1024, 4);
+    epoc::glyph_cache parallel_cache(1024 * 1024, 4);
+
+    serial_cache.rasterize_batch(&serial_adapter, 0, 10, codes, &pool);
+    parallel_cache.rasterize_batch(&parallel_adapter, 0, 10, codes, &pool);
+
+    // Already cached glyphs are skipped
+    parallel_cache.rasterize_batch(&parallel_adapter, 0, 10, codes, &pool);
+    REQUIRE(parallel_adapter.rasterize_count_ == static_cast<int>(codes.size()));
+    REQUIRE(parallel_cache.get_stats().batch_rasterized_ == codes.size());
+
+    for (const std::uint32_t code: codes) {
+        bool hit = false;
+        epoc::cached_glyph_ptr parallel_glyph = parallel_cache.get(&parallel_adapter, 0, 10, code, &hit);
+
+        REQUIRE(hit);
+        REQUIRE(parallel_glyph->bitmap_ == serial_cache.get(&serial_adapter, 0, 10, code)->bitmap_);
+        REQUIRE(parallel_glyph->exists_);
+    }
+}
+
+TEST_CASE("glyph_cache_retires_evicted_atlases", "glyph_cache") {
+    fake_font_adapter adapter;
+    drivers::null_graphics_driver driver;
+    epoc::glyph_cache cache(1024 * 1024, 2);
+
+    // Stand in for an atlas that text was drawn with
+    epoc::font_atlas *first = cache.get_atlas(&adapter, 0, 10);
+    first->atlas_handle_ = drivers::create_bitmap(&driver, eka2l1::vec2(16, 16), 8);
+
+    REQUIRE(cache.get_atlas(&adapter, 0, 10) == first);
+
+    cache.get_atlas(&adapter, 0, 11);
+    cache.get_atlas(&adapter, 0, 12);
+
+    // Builders not submitted yet may still draw with the evicted atlas, so its texture stays
+    epoc::glyph_cache_stats stats = cache.get_stats();
+    REQUIRE(stats.atlas_count_ == 2);
+    REQUIRE(stats.retired_atlas_count_ == 1);
+    REQUIRE(driver.live_object_count() == 1);
+
+    cache.release_retired_atlases(&driver);
+
+    REQUIRE(cache.get_stats().retired_atlas_count_ == 0);
+    REQUIRE(driver.live_object_count() == 0);
+
+    cache.destroy_atlases(&driver);
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <common/fileutils.h>
+#include <services/fs/buffered.h>
+
+#include "fs_test_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace eka2l1;
+
+static const char *BUFFERED_FILE_TEST_FOLDER = "buffered_file_test";
+
+struct buffered_file_test_io : public fs_test_io {
+    buffered_file_registry registry_;
+
+    explicit buffered_file_test_io()
+        : fs_test_io(BUFFERED_FILE_TEST_FOLDER) {
+    }
+
+    std::unique_ptr<buffered_file> open(const std::u16string &path, const int mode) {
+        symfile f = make_buffered_file(io_.open_file(path, mode), &registry_);
+        REQUIRE(f);
+
+        buffered_file *buffered = dynamic_cast<buffered_file *>(f.get());
+        REQUIRE(buffered);
+
+        f.release();
+        return std::unique_ptr<buffered_file>(buffered);
+    }
+};
+
+TEST_CASE("buffered_file_read_ahead", "fs") {
+    buffered_file_test_io test;
+    const std::vector<std::uint8_t> data = make_fs_test_data(100000, 3);
+    test.write(u"E:\\Data.bin", data);
+
+    std::unique_ptr<buffered_file> f = test.open(u"E:\\Data.bin", READ_MODE | BIN_MODE);
+    std::vector<std::uint8_t> out(data.size());
+
+    // Small sequential reads are served by a growing window
+    for (std::size_t pos = 0; pos < data.size(); pos += 100) {
+        REQUIRE(f->read_file(out.data() + pos, 1, 100) == 100);
+        REQUIRE(f->tell() == pos + 100);
+    }
+
+    REQUIRE(out == data);
+    REQUIRE(f->read_file(out.data(), 1, 100) == 0);
+
+    const buffered_file_stats &stats = f->get_stats();
+
+    REQUIRE(stats.reads_ == 1001);
+    REQUIRE(stats.host_reads_ < 20);
+    REQUIRE(stats.host_calls_saved() > 980);
+
+    // Random reads go straight to the file
+    const std::uint64_t host_reads = stats.host_reads_;
+    std::uint8_t buf[16];
+
+    for (std::uint64_t pos : { 5000, 100, 70000 }) {
+        REQUIRE(f->seek(pos, file_seek_mode::beg) == pos);
+        REQUIRE(f->read_file(buf, 1, sizeof(buf)) == sizeof(buf));
+        REQUIRE(std::memcmp(buf, data.data() + pos, sizeof(buf)) == 0);
+    }
+
+    REQUIRE(stats.host_reads_ == host_reads + 3);
+
+    // Reading past the end is cut short
+    REQUIRE(f->seek(-4, file_seek_mode::end) == data.size() - 4);
+    REQUIRE(f->read_file(buf, 1, sizeof(buf)) == 4);
+    REQUIRE(std::memcmp(buf, data.data() + data.size() - 4, 4) == 0);
+
+    REQUIRE(f->seek(-1, file_seek_mode::beg) == 0xFFFFFFFFFFFFFFFF);
+}
+
+TEST_CASE("buffered_file_write_coalescing", "fs") {
+    buffered_file_test_io test;
+    const std::vector<std::uint8_t> data = make_fs_test_data(6400, 9);
+
+    std::unique_ptr<buffered_file> f = test.open(u"E:\\Out.bin", WRITE_MODE | BIN_MODE);
+
+    for (std::size_t pos = 0; pos < data.size(); pos += 64) {
+        REQUIRE(f->write_file(data.data() + pos, 1, 64) == 64);
+    }
+
+    // Nothing reached the host yet, but the handle sees everything
+    REQUIRE(f->get_stats().host_writes_ == 0);
+    REQUIRE(f->get_stats().coalesced_writes_ == 99);
+    REQUIRE(f->size() == data.size());
+
+    REQUIRE(f->flush());
+    REQUIRE(f->get_stats().host_writes_ == 1);
+    REQUIRE(test.read(u"E:\\Out.bin") == data);
+
+    // Overwrite a piece in the middle, then read it back through the same handle
+    const std::uint8_t patch[4] = { 0xDE, 0xAD, 0xBE, 0xEF };
+    REQUIRE(f->seek(1000, file_seek_mode::beg) == 1000);
+    REQUIRE(f->write_file(patch, 1, sizeof(patch)) == sizeof(patch));
+
+    std::uint8_t buf[8];
+    REQUIRE(f->seek(998, file_seek_mode::beg) == 998);
+    REQUIRE(f->read_file(buf, 1, sizeof(buf)) == sizeof(buf));
+
+    REQUIRE(buf[0] == data[998]);
+    REQUIRE(std::memcmp(buf + 2, patch, sizeof(patch)) == 0);
+    REQUIRE(buf[6] == data[1004]);
+
+    // Growing the file and closing it keeps the data
+    REQUIRE(f->seek(0, file_seek_mode::end) == data.size());
+    REQUIRE(f->write_file(patch, 1, sizeof(patch)) == sizeof(patch));
+    REQUIRE(f->size() == data.size() + sizeof(patch));
+    REQUIRE(f->close());
+
+    const std::vector<std::uint8_t> written = test.read(u"E:\\Out.bin");
+
+    REQUIRE(written.size() == data.size() + sizeof(patch));
+    REQUIRE(std::memcmp(written.data() + 1000, patch, sizeof(patch)) == 0);
+    REQUIRE(std::memcmp(written.data() + data.size(), patch, sizeof(patch)) == 0);
+}
+
+TEST_CASE("buffered_file_shared_handles", "fs") {
+    buffered_file_test_io test;
+    test.write(u"E:\\Shared.bin", make_fs_test_data(100, 1));
+
+    std::unique_ptr<buffered_file> first = test.open(u"E:\\Shared.bin", READ_MODE | WRITE_MODE | BIN_MODE);
+    REQUIRE(first->is_buffering());
+
+    const std::uint8_t value = 0x55;
+    REQUIRE(first->seek(10, file_seek_mode::beg) == 10);
+    REQUIRE(first->write_file(&value, 1, 1) == 1);
+
+    // Another process can flush the pending data out by path
+    test.registry_.flush(u"e:\\SHARED.BIN");
+    REQUIRE(test.read(u"E:\\Shared.bin")[10] == value);
+
+    {
+        // While two handles share the file, both write through
+        std::unique_ptr<buffered_file> second = test.open(u"E:\\Shared.bin", READ_MODE | BIN_MODE);
+
+        REQUIRE_FALSE(first->is_buffering());
+        REQUIRE_FALSE(second->is_buffering());
+
+        REQUIRE(first->tell() == 11);
+        REQUIRE(first->write_file(&value, 1, 1) == 1);
+
+        std::uint8_t buf[2];
+        REQUIRE(second->seek(10, file_seek_mode::beg) == 10);
+        REQUIRE(second->read_file(buf, 1, sizeof(buf)) == sizeof(buf));
+        REQUIRE(buf[1] == value);
+    }
+
+    REQUIRE(first->is_buffering());
+    REQUIRE(first->tell() == 12);
+}
+
+TEST_CASE("buffered_file_flushed_for_vfs_users", "fs") {
+    buffered_file_test_io test;
+    test.io_.set_pending_write_flusher(buffered_file_registry::flush_for_io, &test.registry_);
+
+    const std::vector<std::uint8_t> data = make_fs_test_data(256, 3);
+
+    std::unique_ptr<buffered_file> f = test.open(u"E:\\Config.ini", WRITE_MODE | BIN_MODE);
+    REQUIRE(f->write_file(data.data(), 1, static_cast<std::uint32_t>(data.size())) == data.size());
+    REQUIRE(f->get_stats().host_writes_ == 0);
+
+    // Services opening the path through the VFS, or asking for it on the host, see the pending data
+    REQUIRE(test.read(u"E:\\Config.ini") == data);
+    REQUIRE(f->get_stats().host_writes_ == 1);
+
+    REQUIRE(f->write_file(data.data(), 1, 16) == 16);
+    REQUIRE(test.io_.get_raw_path(u"E:\\Config.ini"));
+    REQUIRE(common::file_size(std::string(BUFFERED_FILE_TEST_FOLDER) + "/config.ini") == data.size() + 16);
+
+    test.io_.set_pending_write_flusher(nullptr, nullptr);
+}
+
+TEST_CASE("buffered_file_flushed_from_other_thread", "fs") {
+    buffered_file_test_io test;
+    const std::vector<std::uint8_t> data = make_fs_test_data(64 * 1024, 11);
+
+    std::unique_ptr<buffered_file> f = test.open(u"E:\\Threaded.bin", WRITE_MODE | BIN_MODE);
+    std::atomic<bool> done(false);
+
+    // Flushes from the VFS may come from any thread while the server keeps writing
+    std::thread flusher([&]() {
+        while (!done) {
+            test.registry_.flush(u"E:\\Threaded.bin");
+        }
+    });
+
+    for (std::size_t off = 0; off < data.size(); off += 100) {
+        const std::uint32_t len = static_cast<std::uint32_t>(std::min<std::size_t>(100, data.size() - off));
+        REQUIRE(f->write_file(data.data() + off, 1, len) == len);
+    }
+
+    done = true;
+    flusher.join();
+
+    REQUIRE(f->close());
+    REQUIRE(test.read(u"E:\\Threaded.bin") == data);
+}
+
+TEST_CASE("buffered_file_skips_mappable_files", "fs") {
+    buffered_file_test_io test;
+    test.write(u"E:\\Mapped.bin", make_fs_test_data(64, 5));
+
+    test.io_.mount_physical_path(drive_y, drive_media::physical, io_attrib_internal | io_attrib_write_protected, u"buffered_file_test");
+
+    // Files on read-only drives can be mapped, so reads never go through a buffer
+    symfile f = make_buffered_file(test.io_.open_file(u"Y:\\Mapped.bin", READ_MODE | BIN_MODE), &test.registry_);
+    REQUIRE(f);
+    REQUIRE(f->is_mappable());
+    REQUIRE_FALSE(dynamic_cast<buffered_file *>(f.get()));
+
+    f.reset();
+    test.io_.unmount(drive_y);
+}
+
+TEST_CASE("buffered_file_small_reads_benchmark", "[.][benchmark]") {
+    static constexpr std::size_t FILE_SIZE = 8 * 1024 * 1024;
+    static constexpr std::size_t CHUNK_SIZE = 512;
+
+    buffered_file_test_io test;
+    test.write(u"E:\\Stream.bin", make_fs_test_data(FILE_SIZE, 5));
+
+    std::vector<std::uint8_t> guest(CHUNK_SIZE);
+
+    auto measure = [&](file *f) {
+        const auto start = std::chrono::steady_clock::now();
+
+        // Seek and read, like every RFile::Read does
+        for (std::size_t pos = 0; pos < FILE_SIZE; pos += CHUNK_SIZE) {
+            f->seek(pos, file_seek_mode::beg);
+            REQUIRE(f->read_file(guest.data(), 1, CHUNK_SIZE) == CHUNK_SIZE);
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return static_cast<double>(FILE_SIZE) / (1024.0 * 1024.0) / seconds;
+    };
+
+    symfile plain = test.io_.open_file(u"E:\\Stream.bin", READ_MODE | BIN_MODE);
+    const double plain_speed = measure(plain.get());
+    plain.reset();
+
+    std::unique_ptr<buffered_file> buffered = test.open(u"E:\\Stream.bin", READ_MODE | BIN_MODE);
+    const double buffered_speed = measure(buffered.get());
+
+    WARN("Sequential 512 byte reads: unbuffered " << plain_speed << " MB/s, buffered " << buffered_speed
+                                                  << " MB/s, " << buffered->get_stats().host_calls_saved()
+                                                  << " host calls saved");
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <catch2/catch.hpp>
+#include <common/cvt.h>
+#include <common/fileutils.h>
+#include <common/path.h>
+#include <vfs/vfs.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace eka2l1 {
+    /**
+     * @brief An IO system with a fresh host folder mounted as drive E, removed with its content afterwards.
+     */
+    struct fs_test_io {
+        io_system io_;
+        std::string folder_;
+
+        explicit fs_test_io(const std::string &folder)
+            : folder_(folder) {
+            common::delete_folder(folder_ + eka2l1::get_separator());
+            common::create_directories(folder_);
+
+            file_system_inst physical_fs = create_physical_filesystem(epocver::epoc94, "");
+            io_.add_filesystem(physical_fs);
+            io_.mount_physical_path(drive_e, drive_media::physical, io_attrib_internal, common::utf8_to_ucs2(folder_));
+        }
+
+        ~fs_test_io() {
+            io_.unmount(drive_e);
+            common::delete_folder(folder_ + eka2l1::get_separator());
+        }
+
+        void write(const std::u16string &path, const std::vector<std::uint8_t> &data) {
+            symfile f = io_.open_file(path, WRITE_MODE | BIN_MODE);
+            REQUIRE(f);
+            REQUIRE(f->write_file(data.data(), 1, static_cast<std::uint32_t>(data.size())) == data.size());
+        }
+
+        std::vector<std::uint8_t> read(const std::u16string &path) {
+            symfile f = io_.open_file(path, READ_MODE | BIN_MODE);
+            REQUIRE(f);
+
+            std::vector<std::uint8_t> data(static_cast<std::size_t>(f->size()));
+            REQUIRE(f->read_file(data.data(), 1, static_cast<std::uint32_t>(data.size())) == data.size());
+
+            return data;
+        }
+    };
+
+    /**
+     * @brief Make test file content that differs at every offset and for every seed.
+     */
+    inline std::vector<std::uint8_t> make_fs_test_data(const std::size_t size, const std::uint8_t seed) {
+        std::vector<std::uint8_t> data(size);
+
+        for (std::size_t i = 0; i < size; i++) {
+            data[i] = static_cast<std::uint8_t>(i * 13 + seed);
+        }
+
+        return data;
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2021 EKA2L1 Team.
+ *
+ * This file is part of EKA2L1 project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <catch2/catch.hpp>
+#include <services/fs/section_cache.h>
+
+#include "fs_test_io.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+using namespace eka2l1;
+
+static const char *SECTION_CACHE_TEST_FOLDER = "section_cache_test";
+
+struct section_cache_test_io : public fs_test_io {
+    explicit section_cache_test_io()
+        : fs_test_io(SECTION_CACHE_TEST_FOLDER) {
+    }
+};
+
+TEST_CASE("file_section_cache_reuses_handles", "fs") {
+    section_cache_test_io test;
+    test.write(u"E:\\Resource.rsc", make_fs_test_data(1000, 1));
+
+    file_section_cache cache(2);
+    std::uint8_t buf[16];
+    bool found = false;
+
+    REQUIRE(cache.read(&test.io_, u"E:\\Resource.rsc", 10, buf, sizeof(buf), &found) == sizeof(buf));
+    REQUIRE(found);
+    REQUIRE(buf[0] == static_cast<std::uint8_t>(10 * 13 + 1));
+
+    REQUIRE(cache.read(&test.io_, u"e:\\RESOURCE.RSC", 992, buf, sizeof(buf)) == 8);
+    REQUIRE(cache.read(&test.io_, u"E:\\Resource.rsc", 1000, buf, sizeof(buf)) == 0);
+
+    REQUIRE(cache.get_stats().misses_ == 1);
+    REQUIRE(cache.get_stats().hits_ == 2);
+
+    REQUIRE(cache.read(&test.io_, u"E:\\Missing.rsc", 0, buf, sizeof(buf), &found) == 0);
+    REQUIRE_FALSE(found);
+}
+
+TEST_CASE("file_section_cache_sees_changes", "fs") {
+    section_cache_test_io test;
+    test.write(u"E:\\Data.bin", make_fs_test_data(100, 1));
+
+    file_section_cache cache;
+    std::uint8_t buf[4];
+
+    REQUIRE(cache.read(&test.io_, u"E:\\Data.bin", 0, buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(buf[0] == 1);
+
+    // Rewritten with another size, the old handle must not be reused
+    test.write(u"E:\\Data.bin", make_fs_test_data(200, 7));
+
+    REQUIRE(cache.read(&test.io_, u"E:\\Data.bin", 150, buf, sizeof(buf)) == sizeof(buf));
+    REQUIRE(buf[0] == static_cast<std::uint8_t>(150 * 13 + 7));
+
+    // Handles of everything under a deleted folder go away
+    REQUIRE(test.io_.create_directories(u"E:\\Folder\\"));
+    test.write(u"E:\\Folder\\Inner.bin", make_fs_test_data(10, 3));
+
+    REQUIRE(cache.read(&test.io_, u"E:\\Folder\\Inner.bin", 0, buf, sizeof(buf)) == sizeof(buf));
+
+    cache.invalidate(u"E:\\Folder\\");
+    cache.invalidate(u"E:\\Data.bin");
+
+    REQUIRE(test.io_.delete_entry(u"E:\\Folder\\Inner.bin"));
+    REQUIRE(cache.read(&test.io_, u"E:\\Folder\\Inner.bin", 0, buf, sizeof(buf)) == 0);
+}
+
+TEST_CASE("file_read_sequential_benchmark", "[.][benchmark]") {
+    static constexpr std::size_t FILE_SIZE = 32 * 1024 * 1024;
+    static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+    section_cache_test_io test;
+    const std::vector<std::uint8_t> data = make_fs_test_data(FILE_SIZE, 5);
+    test.write(u"E:\\Media.bin", data);
+
+    // Stands in for the guest descriptor's buffer
+    std::vector<std::uint8_t> guest(CHUNK_SIZE);
+
+    auto measure = [&](auto read_chunk) {
+        const auto start = std::chrono::steady_clock::now();
+
+        for (std::size_t pos = 0; pos < FILE_SIZE; pos += CHUNK_SIZE) {
+            REQUIRE(read_chunk(pos) == CHUNK_SIZE);
+        }
+
+        REQUIRE(std::memcmp(guest.data(), data.data() + FILE_SIZE - CHUNK_SIZE, CHUNK_SIZE) == 0);
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return static_cast<double>(FILE_SIZE) / (1024.0 * 1024.0) / seconds;
+    };
+
+    // What RFile::Read used to do: read into a temporary, then copy into the descriptor
+    symfile handle = test.io_.open_file(u"E:\\Media.bin", READ_MODE | BIN_MODE);
+    REQUIRE(handle);
+
+    const double copy_speed = measure([&](const std::size_t pos) {
+        std::vector<char> temp(CHUNK_SIZE);
+        handle->seek(pos, file_seek_mode::beg);
+
+        const std::size_t read = handle->read_file(temp.data(), 1, CHUNK_SIZE);
+        std::memcpy(guest.data(), temp.data(), read);
+
+        return read;
+    });
+
+    const double direct_speed = measure([&](const std::size_t pos) {
+        handle->seek(pos, file_seek_mode::beg);
+        return handle->read_file(guest.data(), 1, CHUNK_SIZE);
+    });
+
+    // What RFs::ReadFileSection used to do: open and close the file on every call
+    const double reopen_speed = measure([&](const std::size_t pos) {
+        symfile f = test.io_.open_file(u"E:\\Media.bin", READ_MODE | BIN_MODE);
+        f->seek(pos, file_seek_mode::beg);
+
+        return f->read_file(guest.data(), 1, CHUNK_SIZE);
+    });
+
+    file_section_cache cache;
+
+    const double cached_speed = measure([&](const std::size_t pos) {
+        return cache.read(&test.io_, u"E:\\Media.bin", pos, guest.data(), CHUNK_SIZE);
+    });
+
+    handle.reset();
+
+    WARN("Sequential 64 KB reads: file read with copy " << copy_speed << " MB/s, direct " << direct_speed
+                                                        << " MB/s; section read reopening " << reopen_speed
+                                                        << " MB/s, cached handle " << cached_speed << " MB/s");
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch.hpp>
 #include <common/algorithm.h>
+#include <common/fileutils.h>
 #include <common/path.h>
 #include <common/types.h>
 #include <vfs/vfs.h>
@@ -37,3 +38,143 @@ TEST_CASE("get_physical", "vfs") {
 
     REQUIRE(eka2l1::common::compare_ignore_case(*actual_path_b, std::u16string(u"drive_b") + static_cast<char16_t>(eka2l1::get_separator()) + u"despacito3leak") == 0);
 }
+
+static std::uint64_t count_host_stats(const bool enable_cache) {
+    eka2l1::common::delete_folder("drive_cache_test");
+    eka2l1::common::create_directories("drive_cache_test");
+
+    eka2l1::io_system io;
+    eka2l1::file_system_inst physical_fs = eka2l1::create_physical_filesystem(epocver::epoc94, "", enable_cache);
+    io.add_filesystem(physical_fs);
+
+    io.mount_physical_path(drive_number::drive_e, drive_media::physical, io_attrib_internal, u"drive_cache_test");
+
+    {
+        eka2l1::symfile f = io.open_file(u"E:\\Cached.txt", WRITE_MODE | BIN_MODE);
+        REQUIRE(f);
+        REQUIRE(f->write_file("abcd", 1, 4) == 4);
+    }
+
+    // Repeated lookups of the same paths, like a loader probing for an image
+    for (int i = 0; i < 16; i++) {
+        REQUIRE(io.exist(u"E:\\Cached.txt"));
+        REQUIRE_FALSE(io.exist(u"E:\\NotHere.dll"));
+    }
+
+    auto info = io.get_entry_info(u"E:\\Cached.txt");
+    REQUIRE(info);
+    REQUIRE(info->size == 4);
+
+    // Writes through the VFS are seen right away
+    {
+        eka2l1::symfile f = io.open_file(u"E:\\Cached.txt", APPEND_MODE | BIN_MODE);
+        REQUIRE(f);
+        REQUIRE(f->write_file("efgh", 1, 4) == 4);
+    }
+
+    info = io.get_entry_info(u"E:\\Cached.txt");
+    REQUIRE(info);
+    REQUIRE(info->size == 8);
+
+    REQUIRE(io.delete_entry(u"E:\\Cached.txt"));
+    REQUIRE_FALSE(io.exist(u"E:\\Cached.txt"));
+
+    // A file created on the host right after a failed lookup is seen right away
+    {
+        FILE *f = eka2l1::common::open_c_file("drive_cache_test/nothere.dll", "wb");
+        REQUIRE(f);
+        fclose(f);
+    }
+
+    REQUIRE(io.exist(u"E:\\NotHere.dll"));
+    REQUIRE(io.delete_entry(u"E:\\NotHere.dll"));
+
+    const std::optional<eka2l1::file_system_cache_stats> stats = physical_fs->get_cache_stats();
+    REQUIRE(stats);
+
+    if (enable_cache) {
+        REQUIRE(stats->metadata_hits_ > 0);
+        REQUIRE(stats->path_hits_ > 0);
+        REQUIRE(stats->invalidations_ > 0);
+    } else {
+        REQUIRE(stats->metadata_hits_ == 0);
+        REQUIRE(stats->path_hits_ == 0);
+    }
+
+    io.unmount(drive_number::drive_e);
+    eka2l1::common::delete_folder("drive_cache_test");
+
+    return stats->host_stats_;
+}
+
+TEST_CASE("physical_metadata_cache", "vfs") {
+    const std::uint64_t uncached_host_stats = count_host_stats(false);
+    const std::uint64_t cached_host_stats = count_host_stats(true);
+
+    REQUIRE(cached_host_stats < uncached_host_stats);
+}
+
+TEST_CASE("map_view_read_only_files", "vfs") {
+    eka2l1::common::delete_folder("drive_view_test/");
+    eka2l1::common::create_directories("drive_view_test");
+
+    {
+        FILE *f = eka2l1::common::open_c_file("drive_view_test/data.bin", "wb");
+        REQUIRE(f);
+
+        for (int i = 0; i < 4096; i++) {
+            fputc(i & 0xFF, f);
+        }
+
+        fclose(f);
+    }
+
+    eka2l1::io_system io;
+    eka2l1::file_system_inst physical_fs = eka2l1::create_physical_filesystem(epocver::epoc94, "");
+    io.add_filesystem(physical_fs);
+
+    io.mount_physical_path(drive_number::drive_y, drive_media::physical, io_attrib_internal | io_attrib_write_protected, u"drive_view_test");
+    io.mount_physical_path(drive_number::drive_e, drive_media::physical, io_attrib_internal, u"drive_view_test");
+
+    {
+        eka2l1::symfile f = io.open_file(u"Y:\\data.bin", READ_MODE | BIN_MODE);
+        REQUIRE(f);
+
+        const std::uint8_t *view = f->map_view(100, 200);
+        REQUIRE(view);
+        REQUIRE(view[0] == 100);
+        REQUIRE(view[199] == static_cast<std::uint8_t>(299));
+
+        REQUIRE_FALSE(f->map_view(4000, 200));
+
+        // Streams read from the view, and leave the cursor where they stopped
+        f->seek(10, eka2l1::file_seek_mode::beg);
+
+        {
+            eka2l1::ro_file_stream stream(f.get());
+            std::uint8_t buf[4];
+
+            REQUIRE(stream.tell() == 10);
+            REQUIRE(stream.read(buf, sizeof(buf)) == sizeof(buf));
+            REQUIRE(buf[0] == 10);
+
+            stream.seek(-2, eka2l1::common::seek_where::end);
+            REQUIRE(stream.read(buf, sizeof(buf)) == 2);
+            REQUIRE(buf[1] == 0xFF);
+        }
+
+        REQUIRE(f->tell() == 4096);
+    }
+
+    // Writable drives may change the file under a mapping
+    {
+        eka2l1::symfile f = io.open_file(u"E:\\data.bin", READ_MODE | BIN_MODE);
+        REQUIRE(f);
+        REQUIRE_FALSE(f->map_view(0, 16));
+    }
+
+    io.unmount(drive_number::drive_y);
+    io.unmount(drive_number::drive_e);
+
+    eka2l1::common::delete_folder("drive_view_test/");
+}